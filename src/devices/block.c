@@ -1,9 +1,22 @@
 #include "devices/block.h"
+#include <histogram.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include <sysstat.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Request scheduling.  Reads should be served within
+   READ_DEADLINE ticks and writes within WRITE_DEADLINE; up to
+   MERGE_MAX adjacent sectors are moved in one transfer. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (5 * TIMER_FREQ)
+#define MERGE_MAX 64
 
 /* A block device. */
 struct block
@@ -19,6 +32,22 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long request_cnt;     /* Number of requests. */
+    unsigned long long seq_cnt;         /* Requests at LAST_END. */
+    block_sector_t last_end;            /* Sector after last request. */
+    uint64_t busy_ns;                   /* Time in the driver. */
+    uint64_t lat_total_ns;              /* Sum of request latencies. */
+    uint64_t lat_max_ns;                /* Longest request latency. */
+    struct histogram lat_hist;          /* From block_submit() to done. */
+
+    struct block *parent;               /* Device holding this one, if any. */
+    block_sector_t parent_start;        /* First sector within PARENT. */
+
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_cond;        /* Signaled on new requests. */
+    struct list queue;                  /* Pending requests, by sector. */
+    block_sector_t head;                /* Sector after the last transfer. */
+    bool worker_started;                /* I/O thread created? */
   };
 
 /* List of all block devices. */
@@ -28,6 +57,14 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer_sync (struct block *, block_sector_t, size_t cnt,
+                           void *buffer, bool write);
+static list_less_func request_less;
+static int request_priority (const struct block_request *);
+static void note_done (struct block_request *);
+static void driver_transfer (struct block *, block_sector_t, size_t cnt,
+                             uint8_t *buffer, bool write);
+static thread_func io_worker NO_RETURN;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +157,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +168,323 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes, using a single driver request if the driver supports
+   it. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, using
+   a single driver request if the driver supports it.  Returns
+   after the block device has acknowledged receiving the data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Waits until every write to BLOCK that has completed, such as
+   each block_write() that has returned, is on stable storage and
+   would survive a power failure.  Writes still queued are not
+   covered.  A device that does not cache writes has nothing to
+   do.  Flushing a partition flushes the whole device. */
+void
+block_flush (struct block *block)
+{
+  while (block->parent != NULL)
+    block = block->parent;
+  if (block->ops->flush != NULL)
+    block->ops->flush (block->aux);
+}
+
+/* Completion function for transfer_sync(). */
+static void
+wake_submitter (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Submits a request to transfer CNT sectors between BLOCK and
+   BUFFER and waits for it to complete. */
+static void
+transfer_sync (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  struct block_request r;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  r.sector = sector;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.write = write;
+  r.waiter = thread_current ();
+  r.complete = wake_submitter;
+  r.aux = &done;
+  block_submit (block, &r);
+  sema_down (&done);
+}
+
+/* Queues request R on BLOCK and returns at once.  R->complete
+   is called, from the device's I/O thread, once the transfer is
+   done; until then R and its buffer must stay valid.  Requests
+   on a partition go to the queue of the device it lives on.  A
+   device whose transfers are immediate does R straight away and
+   calls R->complete before returning.
+
+   R is served at the priority of the thread that submits it, or,
+   if R->waiter is not null, at the priority that thread has
+   while it waits, if that is higher, counting any donated to it
+   meanwhile by threads waiting on its locks. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0);
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+  block->request_cnt++;
+  if (r->sector == block->last_end)
+    block->seq_cnt++;
+  block->last_end = r->sector + r->cnt;
+  r->priority = thread_get_priority ();
+  r->origin = block;
+  r->submit_ns = timer_ns ();
+
+  for (; block->parent != NULL; block = block->parent)
+    r->sector += block->parent_start;
+
+  trace (TRACE_BLOCK_SUBMIT, r->sector,
+         r->cnt | (r->write ? TRACE_BLOCK_WRITE : 0));
+  if (block->ops->immediate)
+    {
+      driver_transfer (block, r->sector, r->cnt, r->buffer, r->write);
+      note_done (r);
+      r->complete (r);
+      return;
+    }
+
+  r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+  lock_acquire (&block->queue_lock);
+  if (!block->worker_started)
+    {
+      char name[16];
+
+      block->worker_started = true;
+      snprintf (name, sizeof name, "io-%.12s", block->name);
+      thread_create (name, PRI_MAX, io_worker, block);
+    }
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_cond, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Orders block requests by starting sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Returns the priority at which request R is served, as
+   described for block_submit(). */
+static int
+request_priority (const struct block_request *r)
+{
+  int priority = r->priority;
+
+  if (r->waiter != NULL && r->waiter->priority > priority)
+    priority = r->waiter->priority;
+  return priority;
+}
+
+/* Chooses the next request to serve on BLOCK, whose queue must be
+   nonempty.  A request past its deadline goes first, so that no
+   request starves however low its priority; otherwise this is
+   C-LOOK among the requests of the highest priority queued: the
+   lowest sector at or beyond the head position, wrapping around
+   to the lowest sector overall.  BLOCK's queue_lock must be
+   held. */
+static struct block_request *
+choose_request (struct block *block)
+{
+  struct block_request *oldest = NULL, *first = NULL, *next = NULL;
+  struct block_request *r;
+  struct list_elem *e;
+  int top = PRI_MIN;
+
+  list_foreach (e, r, block->queue, elem)
+    {
+      int priority = request_priority (r);
+
+      if (oldest == NULL || r->deadline < oldest->deadline)
+        oldest = r;
+      if (first == NULL || priority > top)
+        {
+          top = priority;
+          first = r;
+          next = NULL;
+        }
+      else if (priority < top)
+        continue;
+      if (next == NULL && r->sector >= block->head)
+        next = r;
+    }
+
+  if (oldest->deadline <= timer_ticks ())
+    return oldest;
+  return next != NULL ? next : first;
+}
+
+/* Charges the latency of request R, which is done, to the
+   device it was submitted to. */
+static void
+note_done (struct block_request *r)
+{
+  struct block *block = r->origin;
+  uint64_t ns = timer_ns () - r->submit_ns;
+
+  histogram_add (&block->lat_hist, ns);
+  block->lat_total_ns += ns;
+  if (ns > block->lat_max_ns)
+    block->lat_max_ns = ns;
+}
+
+/* Calls BLOCK's driver to move CNT sectors between BLOCK and
+   BUFFER, and adds the time it takes to BLOCK's busy time. */
+static void
+driver_transfer (struct block *block, block_sector_t sector, size_t cnt,
+                 uint8_t *buffer, bool write)
+{
+  uint64_t start = timer_ns ();
+  size_t i;
+
+  if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      {
+        if (write)
+          block->ops->write (block->aux, sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+        else
+          block->ops->read (block->aux, sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      }
+  block->busy_ns += timer_ns () - start;
+}
+
+/* I/O thread for BLOCK.  Serves BLOCK's queue in elevator order.
+   The chosen request is merged with the requests for the sectors
+   that directly follow it in the same direction, and the whole
+   batch goes to the driver as one transfer through a bounce
+   buffer. */
+static void
+io_worker (void *block_)
+{
+  struct block *block = block_;
+  uint8_t *bounce = malloc (MERGE_MAX * BLOCK_SECTOR_SIZE);
+
+  for (;;)
+    {
+      struct list batch;
+      struct block_request *first, *r;
+      struct list_elem *e;
+      block_sector_t end;
+      size_t cnt;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_cond, &block->queue_lock);
+
+      list_init (&batch);
+      first = choose_request (block);
+      e = list_remove (&first->elem);
+      list_push_back (&batch, &first->elem);
+      end = first->sector + first->cnt;
+      cnt = first->cnt;
+      while (bounce != NULL && e != list_end (&block->queue))
+        {
+          r = list_entry (e, struct block_request, elem);
+          if (r->sector != end || r->write != first->write
+              || cnt + r->cnt > MERGE_MAX)
+            break;
+          e = list_remove (&r->elem);
+          list_push_back (&batch, &r->elem);
+          end += r->cnt;
+          cnt += r->cnt;
+        }
+      block->head = end;
+      lock_release (&block->queue_lock);
+
+      if (cnt == first->cnt)
+        driver_transfer (block, first->sector, cnt, first->buffer,
+                         first->write);
+      else
+        {
+          uint8_t *p;
+
+          if (first->write)
+            for (p = bounce, e = list_begin (&batch); e != list_end (&batch);
+                 p += r->cnt * BLOCK_SECTOR_SIZE, e = list_next (e))
+              {
+                r = list_entry (e, struct block_request, elem);
+                memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+              }
+          driver_transfer (block, first->sector, cnt, bounce, first->write);
+          if (!first->write)
+            for (p = bounce, e = list_begin (&batch); e != list_end (&batch);
+                 p += r->cnt * BLOCK_SECTOR_SIZE, e = list_next (e))
+              {
+                r = list_entry (e, struct block_request, elem);
+                memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+              }
+        }
+
+      /* COMPLETE may free the request, so advance first. */
+      for (e = list_begin (&batch); e != list_end (&batch); )
+        {
+          r = list_entry (e, struct block_request, elem);
+          e = list_next (e);
+          note_done (r);
+          r->complete (r);
+        }
+    }
+}
+
+/* Makes BLOCK a view of the sectors of PARENT starting at START,
+   so that its requests are queued and scheduled together with
+   PARENT's own. */
+void
+block_set_parent (struct block *block, struct block *parent,
+                  block_sector_t start)
+{
+  block->parent = parent;
+  block->parent_start = start;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,7 +508,32 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Stores the counters of up to SYSSTAT_BLOCK_MAX block devices
+   into STAT.  They are read without locking, so a device that is
+   busy may be reported a request behind. */
+void
+block_get_stats (struct sysstat *stat)
+{
+  struct list_elem *e;
+
+  stat->block_cnt = 0;
+  for (e = list_begin (&all_blocks);
+       e != list_end (&all_blocks) && stat->block_cnt < SYSSTAT_BLOCK_MAX;
+       e = list_next (e))
+    {
+      struct block *block = list_elem_to_block (e);
+      struct sysstat_block *s = &stat->blocks[stat->block_cnt++];
+
+      strlcpy (s->name, block->name, sizeof s->name);
+      s->read_cnt = block->read_cnt;
+      s->write_cnt = block->write_cnt;
+      s->request_cnt = block->request_cnt;
+      s->busy_ns = block->busy_ns;
+    }
+}
+
+/* Prints statistics for each block device used for a Pintos role.
+   A partition's busy time is that of the device it lives on. */
 void
 block_print_stats (void)
 {
@@ -169,12 +542,30 @@ block_print_stats (void)
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
     {
       struct block *block = block_by_role[i];
-      if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+      struct block *disk;
+
+      if (block == NULL)
+        continue;
+      for (disk = block; disk->parent != NULL; disk = disk->parent)
+        continue;
+
+      printf ("%s (%s): %llu reads, %llu writes\n",
+              block->name, block_type_name (block->type),
+              block->read_cnt, block->write_cnt);
+      if (block->request_cnt == 0)
+        continue;
+      printf ("%s (%s): %llu bytes in %llu requests, %llu%% sequential, "
+              "%s busy %"PRIu64" ms\n",
+              block->name, block_type_name (block->type),
+              (block->read_cnt + block->write_cnt) * BLOCK_SECTOR_SIZE,
+              block->request_cnt, block->seq_cnt * 100 / block->request_cnt,
+              disk->name, disk->busy_ns / 1000000);
+      printf ("%s (%s): latency avg %"PRIu64"us, max %"PRIu64"us:",
+              block->name, block_type_name (block->type),
+              block->lat_total_ns / block->request_cnt / 1000,
+              block->lat_max_ns / 1000);
+      histogram_print (&block->lat_hist);
+      printf ("\n");
     }
 }
 
@@ -200,6 +591,20 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  block->seq_cnt = 0;
+  block->last_end = 0;
+  block->busy_ns = 0;
+  block->lat_total_ns = 0;
+  block->lat_max_ns = 0;
+  histogram_init (&block->lat_hist);
+  block->parent = NULL;
+  block->parent_start = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_cond);
+  list_init (&block->queue);
+  block->head = 0;
+  block->worker_started = false;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,9 +1,13 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
+struct thread;
+
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
    disks.  It's not worth it to try to cater to other sector
@@ -53,10 +57,36 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_flush (struct block *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous I/O. */
+struct block_request
+  {
+    struct list_elem elem;      /* Element in device queue. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write (true) or read (false)? */
+    struct thread *waiter;      /* Thread waiting for it, or null. */
+    int priority;               /* Set by block_submit(). */
+    int64_t deadline;           /* Set by block_submit(). */
+    struct block *origin;       /* Set by block_submit(). */
+    uint64_t submit_ns;         /* Set by block_submit(). */
+    void (*complete) (struct block_request *); /* Called when done. */
+    void *aux;                  /* For COMPLETE's use. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+
 /* Statistics. */
+struct sysstat;
+void block_get_stats (struct sysstat *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +95,29 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfers of several consecutive sectors.  Optional: if
+       null, the block layer issues one read or write per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Waits until every write that has completed is on stable
+       storage.  Optional: null for a device that does not cache
+       writes. */
+    void (*flush) (void *aux);
+
+    /* True if transfers never wait, as on a RAM disk.  Requests
+       then skip the queue and the I/O thread and are done at
+       once, in the submitter's thread. */
+    bool immediate;
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_parent (struct block *, struct block *parent,
+                       block_sector_t start);
 
 #endif /* devices/block.h */
@@ -3,19 +3,26 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If a PCI
+   bus-master IDE controller is present, data is moved by DMA;
+   otherwise, or if DMA fails, by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
-#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error. */
+#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error (r/o). */
+#define reg_features(CHANNEL) reg_error (CHANNEL)       /* Features (w/o). */
 #define reg_nsect(CHANNEL) ((CHANNEL)->reg_base + 2)    /* Sector Count. */
 #define reg_lbal(CHANNEL) ((CHANNEL)->reg_base + 3)     /* LBA 0:7. */
 #define reg_lbam(CHANNEL) ((CHANNEL)->reg_base + 4)     /* LBA 15:8. */
@@ -34,10 +41,30 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Direction: device to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
+/* PCI configuration space ports and the bus master IDE class. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_CLASS_IDE 0x0101    /* Mass storage, IDE. */
+
 /* Device Register bits. */
 #define DEV_MBS 0xa0            /* Must be set. */
 #define DEV_LBA 0x40            /* Linear based addressing. */
@@ -49,6 +76,20 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+#define CMD_SET_FEATURES 0xef           /* SET FEATURES. */
+
+/* SET FEATURES subcommands, written to the Features register. */
+#define FEAT_ENABLE_WCACHE 0x02         /* Enable write cache. */
+
+/* Most sectors moved by one READ or WRITE command.  A sector count
+   register value of 0 means 256. */
+#define MAX_TRANSFER 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,7 +98,25 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Transfer by bus-master DMA? */
+    bool write_cache;           /* Write cache enabled? */
+    block_sector_t capacity;    /* Size in sectors, found by probing. */
+    char info[128];             /* Description for block_register(). */
+  };
+
+/* A physical region descriptor.  A channel's PRD table lists the
+   memory regions of one DMA transfer.  A region may not cross a
+   64 kB boundary, and a size of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
   };
+#define PRD_EOT 0x8000
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
@@ -70,9 +129,13 @@ struct channel
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct completion done;             /* Completed by interrupt handler. */
+
+    uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
+    struct completion probed;   /* Completed by probe_channel(). */
   };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -84,11 +147,13 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void register_ata_device (struct ata_disk *);
+static thread_func probe_channel;
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -97,16 +162,27 @@ static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+static uint16_t find_bus_master (void);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *buffer, bool write);
+
+/* Initialize the disk subsystem and detect disks.
+
+   Resetting a channel and identifying its disks takes waits of
+   up to seconds, so each channel is probed by a thread of its
+   own and the channels' waits overlap.  Disks are registered in
+   order once every probe is done, so that hda through hdd keep
+   their block device order. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
+  int dev_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
-      int dev_no;
 
       /* Initialize channel. */
       snprintf (c->name, sizeof c->name, "ide%zu", chan_no);
@@ -123,9 +199,18 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, "ide");
       c->expecting_interrupt = false;
-      sema_init (&c->completion_wait, 0);
+      completion_init (&c->done);
+      completion_init (&c->probed);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,28 +221,59 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Probe the channel, in this thread if no other can be had. */
+      if (thread_create (c->name, PRI_DEFAULT, probe_channel, c)
+          == TID_ERROR)
+        probe_channel (c);
+    }
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  /* Register the disks found. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
 
-      /* Read hard disk identity information. */
+      wait_for_completion (&c->probed);
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+          register_ata_device (&c->devices[dev_no]);
     }
 }
+
+/* Resets channel C_ and identifies the ATA disks on it, then
+   completes its `probed'. */
+static void
+probe_channel (void *c_) 
+{
+  struct channel *c = c_;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device (&c->devices[dev_no]);
+
+  complete (&c->probed);
+}
 
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
+static void set_multiple_mode (struct ata_disk *, int sectors);
+static bool enable_write_cache (struct ata_disk *);
 
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
@@ -188,6 +304,10 @@ reset_channel (struct channel *c)
                          && inb (reg_lbal (c)) == 0xaa);
     }
 
+  /* An empty channel has nothing to wait for. */
+  if (!present[0] && !present[1])
+    return;
+
   /* Issue soft reset sequence, which selects device 0 as a side effect.
      Also enable interrupts. */
   outb (reg_ctl (c), 0);
@@ -254,8 +374,8 @@ check_device_type (struct ata_disk *d)
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
-   response.  Registers the disk with the block device
-   layer. */
+   response into D, for register_ata_device().  Clears D's
+   is_ata if the disk is not to be used. */
 static void
 identify_ata_device (struct ata_disk *d) 
 {
@@ -263,8 +383,7 @@ identify_ata_device (struct ata_disk *d)
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
   char *model, *serial;
-  char extra_info[128];
-  struct block *block;
+  char *extra_info = d->info;
 
   ASSERT (d->is_ata);
 
@@ -273,20 +392,20 @@ identify_ata_device (struct ata_disk *d)
      into our buffer. */
   select_device_wait (d);
   issue_pio_command (c, CMD_IDENTIFY_DEVICE);
-  sema_down (&c->completion_wait);
+  wait_for_completion (&c->done);
   if (!wait_while_busy (d))
     {
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
-  snprintf (extra_info, sizeof extra_info,
+  snprintf (extra_info, sizeof d->info,
             "model \"%s\", serial \"%s\"", model, serial);
 
   /* Disable access to IDE disks over 1 GB, which are likely
@@ -303,12 +422,75 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
-  /* Register. */
-  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+  /* Use READ/WRITE MULTIPLE with the largest block the drive
+     supports, so that a transfer interrupts once per block instead
+     of once per sector. */
+  if ((id[47 * 2] & 0xff) > 1)
+    set_multiple_mode (d, id[47 * 2] & 0xff);
+
+  /* Word 49 bit 8: DMA supported. */
+  if (c->bm_base != 0 && (id[49 * 2 + 1] & 1))
+    {
+      d->dma = true;
+      strlcat (extra_info, ", DMA", sizeof d->info);
+    }
+
+  /* Word 82 bit 5: write cache supported.  It is only turned on
+     if the drive also has FLUSH CACHE, word 83 bit 12, so that
+     ide_flush() can make writes durable. */
+  if ((id[82 * 2] & 0x20) && (id[83 * 2 + 1] & 0x10)
+      && enable_write_cache (d))
+    strlcat (extra_info, ", write cache", sizeof d->info);
+
+  d->capacity = capacity;
+}
+
+/* Registers disk D, identified by identify_ata_device(), with the
+   block device layer, and scans it for partitions. */
+static void
+register_ata_device (struct ata_disk *d) 
+{
+  struct block *block;
+
+  block = block_register (d->name, BLOCK_RAW, d->info, d->capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sets disk D to transfer SECTORS sectors per interrupt in
+   READ/WRITE MULTIPLE.  If the drive refuses, D keeps using
+   single-sector data blocks. */
+static void
+set_multiple_mode (struct ata_disk *d, int sectors)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  wait_for_completion (&c->done);
+  wait_while_busy (d);
+  if (!(inb (reg_status (c)) & STA_ERR))
+    d->multiple = sectors;
+}
+
+/* Turns on disk D's write cache, so that a write completes once
+   the data is in the drive's buffer, not on the medium.  Returns
+   true if the drive accepted. */
+static bool
+enable_write_cache (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_features (c), FEAT_ENABLE_WCACHE);
+  issue_pio_command (c, CMD_SET_FEATURES);
+  wait_for_completion (&c->done);
+  wait_while_busy (d);
+  d->write_cache = !(inb (reg_status (c)) & STA_ERR);
+  return d->write_cache;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +519,161 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  size_t per_block = d->multiple > 0 ? (size_t) d->multiple : 1;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t xfer = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+      size_t left;
+
+      if (d->dma && dma_transfer (d, sec_no, xfer, buffer, false))
+        {
+          buffer += xfer * BLOCK_SECTOR_SIZE;
+          sec_no += xfer;
+          cnt -= xfer;
+          continue;
+        }
+
+      select_sectors (d, sec_no, xfer);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_READ_MULTIPLE
+                             : CMD_READ_SECTOR_RETRY));
+      for (left = xfer; left > 0; )
+        {
+          size_t n = left < per_block ? left : per_block;
+
+          wait_for_completion (&c->done);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+          input_sectors (c, buffer, n);
+          buffer += n * BLOCK_SECTOR_SIZE;
+          left -= n;
+        }
+      sec_no += xfer;
+      cnt -= xfer;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Write CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  size_t per_block = d->multiple > 0 ? (size_t) d->multiple : 1;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t xfer = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+      size_t left;
+
+      if (d->dma && dma_transfer (d, sec_no, xfer, buffer, true))
+        {
+          buffer += xfer * BLOCK_SECTOR_SIZE;
+          sec_no += xfer;
+          cnt -= xfer;
+          continue;
+        }
+
+      select_sectors (d, sec_no, xfer);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                             : CMD_WRITE_SECTOR_RETRY));
+      for (left = xfer; left > 0; )
+        {
+          size_t n = left < per_block ? left : per_block;
+
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+          output_sectors (c, buffer, n);
+          wait_for_completion (&c->done);
+          buffer += n * BLOCK_SECTOR_SIZE;
+          left -= n;
+        }
+      sec_no += xfer;
+      cnt -= xfer;
+    }
+  lock_release (&c->lock);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Waits until every write that disk D has completed is on the
+   medium, if D's write cache is on. */
+static void
+ide_flush (void *d_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  if (!d->write_cache)
+    return;
+
+  lock_acquire (&c->lock);
+  select_device_wait (d);
+  issue_pio_command (c, CMD_FLUSH_CACHE);
+  wait_for_completion (&c->done);
+  wait_while_busy (d);
+  if (inb (reg_status (c)) & STA_ERR)
+    PANIC ("%s: cache flush failed", d->name);
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_flush,
+    false
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between 1
+   and MAX_TRANSFER, to the disk's sector selection registers.
+   (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_TRANSFER);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_TRANSFER ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -401,6 +681,128 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
         DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
 }
 
+/* Fills channel C's PRD table to describe the SIZE bytes at
+   BUFFER.  Returns false if BUFFER is not suitable for DMA. */
+static bool
+build_prdt (struct channel *c, const void *buffer, size_t size)
+{
+  uint32_t phys;
+  size_t i;
+
+  if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1) != 0)
+    return false;
+
+  /* Kernel virtual memory maps physical memory linearly, so a
+     kernel buffer is physically contiguous. */
+  phys = vtop (buffer);
+  for (i = 0; size > 0; i++)
+    {
+      size_t chunk = 0x10000 - (phys & 0xffff);
+      if (chunk > size)
+        chunk = size;
+      if (i >= PRD_CNT)
+        return false;
+      c->prdt[i].addr = phys;
+      c->prdt[i].size = chunk & 0xffff;
+      c->prdt[i].flags = 0;
+      phys += chunk;
+      size -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and BUFFER
+   by bus-master DMA, to the disk if WRITE is true, from it
+   otherwise.  The caller must hold the channel lock.  The thread
+   sleeps until the completion interrupt, leaving the CPU to
+   others.  Returns false if the transfer could not be done by
+   DMA, in which case the caller should redo it by PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  if (!build_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  wait_for_completion (&c->done);
+  outb (reg_bm_command (c), direction);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERR) || (inb (reg_status (c)) & STA_ERR))
+    {
+      printf ("%s: DMA failed, sector=%"PRDSNu", using PIO\n",
+              d->name, sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
+/* Reads the 32-bit register at offset REG in the PCI configuration
+   space of function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG in the PCI
+   configuration space of BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks for a PCI IDE controller capable of bus mastering.  If
+   one is found, enables bus mastering on it and returns the base
+   of its bus master registers (BAR4).  Returns 0 if there is none,
+   in which case all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          uint32_t class, bar4;
+
+          if ((pci_read_config (bus, dev, func, 0x00) & 0xffff) == 0xffff)
+            continue;
+          class = pci_read_config (bus, dev, func, 0x08);
+          if ((class >> 16) != PCI_CLASS_IDE || !(class & 0x8000))
+            continue;
+          bar4 = pci_read_config (bus, dev, func, 0x20);
+          if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+            continue;
+
+          /* Enable I/O space and bus mastering. */
+          pci_write_config (bus, dev, func, 0x04,
+                            pci_read_config (bus, dev, func, 0x04) | 0x5);
+          return bar4 & 0xfffc;
+        }
+  return 0;
+}
+
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
@@ -414,20 +816,21 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * BLOCK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
@@ -455,7 +858,8 @@ wait_until_idle (const struct ata_disk *d)
 /* Wait up to 30 seconds for disk D to clear BSY,
    and then return the status of the DRQ bit.
    The ATA standards say that a disk may take as long as that to
-   complete its reset. */
+   complete its reset.  A status of all 1s, as read from a
+   channel with nothing attached, fails at once. */
 static bool
 wait_while_busy (const struct ata_disk *d) 
 {
@@ -464,6 +868,8 @@ wait_while_busy (const struct ata_disk *d)
   
   for (i = 0; i < 3000; i++)
     {
+      if (inb (reg_alt_status (c)) == 0xff)
+        break;
       if (i == 700)
         printf ("%s: busy, waiting...", d->name);
       if (!(inb (reg_alt_status (c)) & STA_BSY)) 
@@ -475,7 +881,8 @@ wait_while_busy (const struct ata_disk *d)
       timer_msleep (10);
     }
 
-  printf ("failed\n");
+  if (i >= 700)
+    printf ("failed\n");
   return false;
 }
 
@@ -514,7 +921,7 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            complete (&c->done);                /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
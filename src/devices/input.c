@@ -2,15 +2,20 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/waitq.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Woken when a key arrives. */
+static struct waitq waiters;
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
   intq_init (&buffer);
+  waitq_init (&waiters);
 }
 
 /* Adds a key to the input buffer.
@@ -23,6 +28,7 @@ input_putc (uint8_t key)
 
   intq_putc (&buffer, key);
   serial_notify ();
+  waitq_wake (&waiters);
 }
 
 /* Retrieves a key from the input buffer.
@@ -41,6 +47,21 @@ input_getc (void)
   return key;
 }
 
+/* Returns true if the input buffer is empty, so that
+   input_getc() would wait. */
+bool
+input_empty (void)
+{
+  return intq_empty (&buffer);
+}
+
+/* Returns the wait queue that is woken when a key arrives. */
+struct waitq *
+input_waitq (void)
+{
+  return &waiters;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -2,7 +2,6 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
@@ -12,23 +11,21 @@ intq_init (struct intq *q)
 {
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
-  q->head = q->tail = 0;
+  ring_init (&q->ring, q->buf, 1, INTQ_BUFSIZE);
 }
 
 /* Returns true if Q is empty, false otherwise. */
 bool
 intq_empty (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return ring_empty (&q->ring);
 }
 
 /* Returns true if Q is full, false otherwise. */
 bool
 intq_full (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return ring_full (&q->ring);
 }
 
 /* Removes a byte from Q and returns it.
@@ -48,8 +45,7 @@ intq_getc (struct intq *q)
       lock_release (&q->lock);
     }
   
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  ring_get (&q->ring, &byte, 1);
   signal (q, &q->not_full);
   return byte;
 }
@@ -69,18 +65,35 @@ intq_putc (struct intq *q, uint8_t byte)
       lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
+  ring_put (&q->ring, &byte, 1);
   signal (q, &q->not_empty);
 }
-
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
+
+/* Removes up to CNT bytes from Q into BUF, without waiting, and
+   returns the number removed. */
+size_t
+intq_get (struct intq *q, uint8_t *buf, size_t cnt) 
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cnt = ring_get (&q->ring, buf, cnt);
+  if (cnt > 0)
+    signal (q, &q->not_full);
+  return cnt;
 }
 
+/* Adds up to CNT bytes from BUF to the end of Q, as many as fit
+   without waiting, and returns the number added. */
+size_t
+intq_put (struct intq *q, const uint8_t *buf, size_t cnt) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cnt = ring_put (&q->ring, buf, cnt);
+  if (cnt > 0)
+    signal (q, &q->not_empty);
+  return cnt;
+}
 /* WAITER must be the address of Q's not_empty or not_full
    member.  Waits until the given condition is true. */
 static void
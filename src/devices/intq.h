@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <ring.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -15,9 +16,13 @@
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.
 
-/* Queue buffer size, in bytes. */
+   The bytes themselves are kept in a struct ring, so testing
+   whether the queue is empty or full does not need interrupts
+   off, and intq_get() and intq_put() move many bytes at once. */
+
+/* Queue buffer size, in bytes.  Must be a power of 2. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -29,9 +34,8 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
+    struct ring ring;           /* Queued bytes, in BUF. */
     uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
   };
 
 void intq_init (struct intq *);
@@ -39,5 +43,7 @@ bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_get (struct intq *, uint8_t *, size_t cnt);
+size_t intq_put (struct intq *, const uint8_t *, size_t cnt);
 
 #endif /* devices/intq.h */
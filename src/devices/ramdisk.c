@@ -0,0 +1,135 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* RAM disk.
+
+   A block device kept in memory, for file systems whose contents
+   need not outlive the machine, such as a scratch disk or a file
+   system for temporary files, where it spares them the cost of
+   programmed I/O to a real disk.  Its sectors live in pages from
+   the kernel pool, allocated zeroed when the disk is created and
+   never freed.  Transfers are plain copies that never wait, so
+   the block layer does them straight away instead of queuing
+   them for an I/O thread. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Its pages, in order. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of SIZE sectors, which are initially zero,
+   registers it as a block device of the given TYPE, and returns
+   it.  Panics if memory runs out. */
+struct block *
+ramdisk_create (enum block_type type, block_sector_t size)
+{
+  static unsigned next_id;
+  struct ramdisk *rd;
+  size_t page_cnt = DIV_ROUND_UP (size, SECTORS_PER_PAGE);
+  char name[16];
+  char extra_info[32];
+  size_t i;
+
+  ASSERT (size > 0);
+
+  rd = malloc (sizeof *rd);
+  if (rd != NULL)
+    rd->pages = malloc (page_cnt * sizeof *rd->pages);
+  if (rd == NULL || rd->pages == NULL)
+    PANIC ("ramdisk: out of memory");
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("ramdisk: out of memory after %zu of %zu pages",
+               i, page_cnt);
+    }
+
+  snprintf (name, sizeof name, "ram%u", next_id++);
+  snprintf (extra_info, sizeof extra_info, "%zu pages of RAM", page_cnt);
+  return block_register (name, type, extra_info, size,
+                         &ramdisk_operations, rd);
+}
+
+/* Copies CNT sectors starting at SECTOR between RAM disk RD and
+   BUFFER, to RD if WRITE is true, from it otherwise. */
+static void
+transfer (struct ramdisk *rd, block_sector_t sector, size_t cnt,
+          uint8_t *buffer, bool write)
+{
+  while (cnt > 0)
+    {
+      size_t page_ofs = sector % SECTORS_PER_PAGE;
+      size_t chunk = SECTORS_PER_PAGE - page_ofs;
+      uint8_t *data;
+
+      if (chunk > cnt)
+        chunk = cnt;
+      data = (rd->pages[sector / SECTORS_PER_PAGE]
+              + page_ofs * BLOCK_SECTOR_SIZE);
+      if (write)
+        memcpy (data, buffer, chunk * BLOCK_SECTOR_SIZE);
+      else
+        memcpy (buffer, data, chunk * BLOCK_SECTOR_SIZE);
+
+      sector += chunk;
+      cnt -= chunk;
+      buffer += chunk * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads sector SECTOR from RAM disk RD into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd, block_sector_t sector, void *buffer)
+{
+  transfer (rd, sector, 1, buffer, false);
+}
+
+/* Writes sector SECTOR to RAM disk RD from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *rd, block_sector_t sector, const void *buffer)
+{
+  transfer (rd, sector, 1, (uint8_t *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SECTOR from RAM disk RD into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
+static void
+ramdisk_read_multiple (void *rd, block_sector_t sector, size_t cnt,
+                       void *buffer)
+{
+  transfer (rd, sector, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SECTOR to RAM disk RD from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write_multiple (void *rd, block_sector_t sector, size_t cnt,
+                        const void *buffer)
+{
+  transfer (rd, sector, cnt, (uint8_t *) buffer, true);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL,
+    true
+  };
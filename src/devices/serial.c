@@ -33,6 +33,17 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (16550A or later). */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear the receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear the transmit FIFO. */
+
+/* Transmit FIFO depth of the 16550A. */
+#define TX_FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -54,8 +65,19 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Bytes received by the interrupt handler but not yet passed to
+   the input layer and echoed, which the receive tasklet does. */
+static struct intq rxq;
+static struct intr_tasklet rx_tasklet;
+static intr_tasklet_func receive;
+
+/* Bytes that may be written to THR each time it reports empty:
+   TX_FIFO_SIZE if the UART has working FIFOs, otherwise 1. */
+static size_t tx_burst;
+
 static void set_serial (int bps);
-static void putc_poll (uint8_t);
+static void write_poll (const uint8_t *, size_t);
+static void drain_poll (size_t);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,10 +90,15 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
+
+  /* An 8250 or 16450 ignores the FIFO enable. */
+  tx_burst = (inb (IIR_REG) & IIR_FIFO) == IIR_FIFO ? TX_FIFO_SIZE : 1;
   intq_init (&txq);
+  intq_init (&rxq);
+  intr_tasklet_init (&rx_tasklet, receive, NULL);
   mode = POLL;
 } 
 
@@ -98,32 +125,53 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_write (&byte, 1);
+}
+
+/* Sends the N bytes in BUF to the serial port. */
+void
+serial_write (const void *buf_, size_t n)
+{
+  const uint8_t *buf = buf_;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      write_poll (buf, n);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue as much as fits at a time and update the
+         interrupt enable register. */
+      for (;;)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t cnt = intq_put (&txq, buf, n);
+          buf += cnt;
+          n -= cnt;
+          write_ier ();
+          if (n == 0)
+            break;
+
+          if (old_level == INTR_OFF)
+            {
+              /* Interrupts are off and the transmit queue is full.
+                 If we wanted to wait for the queue to empty,
+                 we'd have to reenable interrupts.
+                 That's impolite, so we'll send a FIFO's worth
+                 via polling instead. */
+              drain_poll (tx_burst);
+            }
+          else
+            {
+              /* Wait for the transmit interrupt to make room. */
+              intq_putc (&txq, *buf++);
+              n--;
+            }
         }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
     }
   
   intr_set_level (old_level);
@@ -141,8 +189,7 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  drain_poll (SIZE_MAX);
   intr_set_level (old_level);
 }
 
@@ -155,7 +202,14 @@ serial_notify (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
   if (mode == QUEUE)
-    write_ier ();
+    {
+      /* Bytes held back because the input buffer was full can
+         move once it has room.  The tasklet runs by the next
+         interrupt at the latest. */
+      if (!intq_empty (&rxq) && !input_full ())
+        intr_tasklet_schedule (&rx_tasklet);
+      write_ier ();
+    }
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -193,22 +247,46 @@ write_ier (void)
 
   /* Enable receive interrupt if we have room to store any
      characters we receive. */
-  if (!input_full ())
+  if (!input_full () && !intq_full (&rxq))
     ier |= IER_RECV;
   
   outb (IER_REG, ier);
 }
 
-/* Polls the serial port until it's ready,
-   and then transmits BYTE. */
+/* Transmits the N bytes in BUF by polling, a FIFO's worth each
+   time the transmitter reports empty. */
 static void
-putc_poll (uint8_t byte) 
+write_poll (const uint8_t *buf, size_t n)
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  while ((inb (LSR_REG) & LSR_THRE) == 0)
-    continue;
-  outb (THR_REG, byte);
+  while (n > 0)
+    {
+      size_t cnt = n < tx_burst ? n : tx_burst;
+
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      outsb (THR_REG, buf, cnt);
+      buf += cnt;
+      n -= cnt;
+    }
+}
+
+/* Takes up to MAX bytes off the transmit queue and transmits them
+   by polling. */
+static void
+drain_poll (size_t max)
+{
+  uint8_t chunk[INTQ_BUFSIZE];
+  size_t cnt;
+
+  while (max > 0
+         && (cnt = intq_get (&txq, chunk,
+                             max < sizeof chunk ? max : sizeof chunk)) > 0)
+    {
+      write_poll (chunk, cnt);
+      max -= cnt;
+    }
 }
 
 /* Serial interrupt handler. */
@@ -220,24 +298,44 @@ serial_interrupt (struct intr_frame *f UNUSED)
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
-  while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
+     has a byte for us, receive a byte.  The rest of the work is
+     left to the receive tasklet. */
+  while (!intq_full (&rxq) && (inb (LSR_REG) & LSR_DR) != 0)
+    intq_putc (&rxq, inb (RBR_REG));
+  if (!intq_empty (&rxq))
+    intr_tasklet_schedule (&rx_tasklet);
+
+  /* If the transmitter is empty, refill the whole FIFO with one
+     burst.  THRE only reports that the FIFO is completely empty,
+     so there is nothing to gain by testing it again. */
+  if (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      uint8_t chunk[TX_FIFO_SIZE];
+      size_t cnt = intq_get (&txq, chunk, tx_burst);
+      outsb (THR_REG, chunk, cnt);
+    }
+
+  /* Update interrupt enable register based on queue status. */
+  write_ier ();
+}
+
+/* Receive tasklet.  Moves received bytes into the input buffer
+   and echoes them through the transmit queue. */
+static void
+receive (void *aux UNUSED)
+{
+  enum intr_level old_level = intr_disable ();
+
+  while (!intq_empty (&rxq) && !input_full ())
     {
-      uint8_t data = inb (RBR_REG);
+      uint8_t data = intq_getc (&rxq);
       data = (data == '\r' ? '\n' : data);
       input_putc (data);
 
       /* terminal echo */
-      while (!(inb (LSR_REG) & LSR_THRE))
-	;
-      outb(THR_REG, data);
+      serial_write (&data, 1);
     }
-
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
-
-  /* Update interrupt enable register based on queue status. */
   write_ier ();
+
+  intr_set_level (old_level);
 }
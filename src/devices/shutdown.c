@@ -4,8 +4,14 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -94,6 +100,8 @@ shutdown_power_off (void)
   filesys_done ();
 #endif
 
+  trace_dump ();
+  profile_dump ();
   print_stats ();
 
   printf ("Powering off...\n");
@@ -129,7 +137,11 @@ static void
 print_stats (void)
 {
   timer_print_stats ();
+  intr_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  lock_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
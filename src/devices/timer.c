@@ -3,8 +3,15 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <time-page.h>
 #include "devices/pit.h"
+#include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "tests/threads/tests.h"
@@ -18,29 +25,166 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Only changed by the
+   timer interrupt and timer_idle_exit(), with interrupts off,
+   inside ticks_seq. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
-/* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+/* Time-stamp counter cycles per timer tick, or 0 if the CPU has
+   no TSC.  Initialized by timer_calibrate(). */
+static uint64_t tsc_per_tick;
+
+/* Timer ticks over which the TSC is calibrated. */
+#define TSC_CALIBRATE_TICKS 2
+
+/* Nanoseconds per timer tick. */
+#define NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
+/* Number of loops per timer tick, for delays on CPUs without a
+   TSC.  Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* If true, the idle thread reprograms the PIT as a one-shot timer
+   for the next sleeper's deadline instead of taking a periodic
+   interrupt every tick. */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, and the longest one-shot interval,
+   in ticks, that fits in the PIT's 16-bit counter. */
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX_TICKS (UINT16_MAX / TICK_COUNT)
+
+/* Length of the one-shot interval in progress, in ticks and in
+   PIT cycles, or 0 while the timer is periodic. */
+static int64_t oneshot_ticks;
+static uint16_t oneshot_count;
+
+/* On a multiprocessor, each CPU takes its own tick from its local
+   APIC timer, which calls thread_tick() for that CPU, while the
+   PIT's interrupt, on the bootstrap CPU alone, keeps only the
+   global tick count and the timers.  Only CPUs started with
+   timer_cpu_init() do so; until then the PIT drives
+   thread_tick() as on a uniprocessor.  lapic_count is the local
+   APIC timer count per tick, measured against the PIT, or 0 if
+   not yet measured. */
+static bool lapic_ticks;
+static uint32_t lapic_count;
+
+/* Timer ticks over which the local APIC timer is calibrated. */
+#define LAPIC_CALIBRATE_TICKS 4
+
+/* Page shared read-only with user processes. */
+static struct time_page *time_page;
+
+/* Hierarchical timer wheel, after Varghese and Lauck.
+
+   Level 0 has one slot per tick for the next WHEEL_SIZE ticks.
+   Each slot of level L > 0 covers WHEEL_SIZE times as many ticks
+   as a slot of level L - 1.  A timer goes into the lowest level
+   whose span reaches its deadline, so arming and cancelling are
+   O(1).  Whenever wheel_now crosses a level-L slot boundary, the
+   timers in the slot just reached are redistributed into the
+   levels below ("cascaded"); each timer cascades at most
+   WHEEL_LEVELS - 1 times.  Deadlines beyond the top level's span
+   are parked in its farthest slot and re-filed when they cascade.
+
+   The wheel is only touched with interrupts off. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_now;       /* First tick not yet expired. */
+static size_t wheel_cnt;        /* Number of pending timers. */
+
+/* Expires timers after the timer interrupt has been
+   acknowledged, rather than inside it. */
+static struct intr_tasklet timer_tasklet;
+static void timer_tasklet_run (void *);
+
 static intr_handler_func timer_interrupt;
+static void update_time_page (void);
+static void run_timers (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static intr_handler_func lapic_timer_interrupt;
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  size_t level, slot;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
+  intr_tasklet_init (&timer_tasklet, timer_tasklet_run, NULL);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  seqlock_init (&ticks_seq);
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
+
+  time_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  time_page->freq = TIMER_FREQ;
+  time_page->boot_time = rtc_get_time ();
+}
+
+/* Switches the running CPU's calls to thread_tick() from the PIT
+   to its local APIC timer, at TIMER_FREQ, measuring the timer
+   against the PIT on the first call.  Does nothing without a
+   local APIC or with "-nosmp".  Interrupts must be on. */
+void
+timer_cpu_init (void)
+{
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (!lapic_present () || !mp_enabled)
+    return;
+
+  if (lapic_count == 0)
+    {
+      int64_t start;
+
+      intr_register_ext (LAPIC_TIMER_VEC, lapic_timer_interrupt,
+                         "Local APIC Timer");
+
+      /* Count down from one tick to a later one. */
+      start = timer_ticks ();
+      while (timer_ticks () == start)
+        barrier ();
+      lapic_timer_start (UINT32_MAX, false);
+      start++;
+      while (timer_ticks () < start + LAPIC_CALIBRATE_TICKS)
+        barrier ();
+      lapic_count = (UINT32_MAX - lapic_timer_count ())
+                    / LAPIC_CALIBRATE_TICKS;
+      lapic_timer_stop ();
+      if (lapic_count == 0)
+        return;
+      printf ("Local APIC timer: %'"PRIu64" counts/s.\n",
+              (uint64_t) lapic_count * TIMER_FREQ);
+    }
+
+  lapic_ticks = true;
+  lapic_timer_start (lapic_count, true);
+}
+
+/* Returns the kernel virtual address of the time page, for
+   mapping into a process at TIME_PAGE. */
+void *
+timer_time_page (void)
+{
+  return time_page;
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates the clock used to implement brief delays: the TSC,
+   timed over a few timer ticks, or else loops_per_tick. */
 void
 timer_calibrate (void) 
 {
@@ -49,6 +193,27 @@ timer_calibrate (void)
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
+  if (cpu_features () & CPUID_TSC)
+    {
+      int64_t start;
+      uint64_t tsc;
+
+      /* Count cycles from one tick to a later one. */
+      start = ticks;
+      while (ticks == start)
+        barrier ();
+      start = ticks;
+      tsc = cpu_rdtsc ();
+      while (ticks < start + TSC_CALIBRATE_TICKS)
+        barrier ();
+      tsc_per_tick = (cpu_rdtsc () - tsc) / TSC_CALIBRATE_TICKS;
+      if (tsc_per_tick != 0)
+        {
+          printf ("%'"PRIu64" cycles/s.\n", tsc_per_tick * TIMER_FREQ);
+          return;
+        }
+    }
+
   /* Approximate loops_per_tick as the largest power-of-two
      still less than one timer tick. */
   loops_per_tick = 1u << 10;
@@ -71,9 +236,15 @@ timer_calibrate (void)
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -85,6 +256,177 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Files T in the wheel according to its deadline. */
+static void
+wheel_insert (struct timer *t)
+{
+  int64_t when = t->deadline;
+  int64_t delta = when - wheel_now;
+  int level;
+
+  if (delta < 0)
+    when = wheel_now;
+  else if (delta >= WHEEL_SPAN)
+    when = wheel_now + WHEEL_SPAN - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (when - wheel_now < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  list_push_back (&wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Arms timer T to call FUNC(T) from the timer interrupt at tick
+   DEADLINE, or at the next tick if DEADLINE has passed.  AUX is
+   stored in T for FUNC's use.  T must not already be pending. */
+void
+timer_add (struct timer *t, int64_t deadline, timer_func *func, void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!t->pending);
+  t->deadline = deadline;
+  t->func = func;
+  t->aux = aux;
+  t->pending = true;
+  wheel_insert (t);
+  wheel_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Disarms timer T.  Returns true if it was pending, false if it
+   had already expired or was never armed. */
+bool
+timer_cancel (struct timer *t)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  old_level = intr_disable ();
+  was_pending = t->pending;
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+      wheel_cnt--;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Returns the tick by which the next timer is due, or INT64_MAX
+   if none is pending.  This is exact for a timer due before the
+   next cascade; otherwise it is the tick of that cascade, which
+   is early but safe.  Interrupts must be off. */
+int64_t
+timer_next_deadline (void)
+{
+  int64_t t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (wheel_cnt == 0)
+    return INT64_MAX;
+  for (t = wheel_now; (t & WHEEL_MASK) != 0; t++)
+    if (!list_empty (&wheel[0][t & WHEEL_MASK]))
+      return t;
+  return t;
+}
+
+/* Refiles every timer in slot SLOT of level LEVEL. */
+static void
+cascade (int level, size_t slot)
+{
+  struct list *l = &wheel[level][slot];
+
+  while (!list_empty (l))
+    wheel_insert (list_entry (list_pop_front (l), struct timer, elem));
+}
+
+/* Expires, in deadline order, every timer due by the current
+   tick.  Called from the timer tasklet with interrupts off;
+   briefly turns them on between timers. */
+static void
+run_timers (void)
+{
+  while (wheel_now <= ticks)
+    {
+      struct list *slot = &wheel[0][wheel_now & WHEEL_MASK];
+      struct list due;
+      int level;
+
+      /* Crossing into a new slot of level L pulls its timers
+         down into the levels below. */
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        if ((wheel_now & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) != 0)
+          break;
+      while (--level > 0)
+        cascade (level, (wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+      /* Detach the due timers before advancing, so that a timer
+         re-armed by its function for a past deadline runs on the
+         next tick instead of in this loop. */
+      list_init (&due);
+      if (!list_empty (slot))
+        list_splice (list_end (&due), list_begin (slot), list_end (slot));
+      wheel_now++;
+
+      while (!list_empty (&due))
+        {
+          struct timer *t = list_entry (list_pop_front (&due),
+                                        struct timer, elem);
+          t->pending = false;
+          wheel_cnt--;
+          t->func (t);
+
+          /* Interrupt handlers that arrive here do not expire
+             timers, but they may add or cancel them, which is
+             safe because DUE is only touched with interrupts
+             off. */
+          intr_enable ();
+          intr_disable ();
+        }
+    }
+}
+
+/* Returns the number of CPU cycles since reset, or 0 if the CPU
+   has no time-stamp counter. */
+uint64_t
+timer_cycles (void)
+{
+  return tsc_per_tick != 0 ? cpu_rdtsc () : 0;
+}
+
+/* Returns the number of nanoseconds since the CPU was reset,
+   from the TSC, or since boot to the accuracy of a timer tick if
+   the CPU has no TSC. */
+uint64_t
+timer_ns (void)
+{
+  if (tsc_per_tick == 0)
+    return timer_ticks () * NS_PER_TICK;
+  return timer_cycles_to_ns (cpu_rdtsc ());
+}
+
+/* Converts CYCLES, a count or difference of TSC values, to
+   nanoseconds.  Returns 0 until timer_calibrate() has measured
+   the TSC, or if the CPU has none. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  if (tsc_per_tick == 0)
+    return 0;
+
+  /* Convert whole ticks and the remainder separately, so that
+     nothing overflows. */
+  return (cycles / tsc_per_tick * NS_PER_TICK
+          + cycles % tsc_per_tick * NS_PER_TICK / tsc_per_tick);
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
@@ -165,6 +507,69 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If tickless idle is enabled, replaces the periodic tick
+   by a single interrupt at DEADLINE, the tick of the earliest
+   sleeper (or INT64_MAX if there is none), or as close to it as
+   the PIT allows. */
+void
+timer_idle_enter (int64_t deadline)
+{
+  int64_t n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  n = deadline - ticks;
+  if (n > ONESHOT_MAX_TICKS)
+    n = ONESHOT_MAX_TICKS;
+  if (n <= 1)
+    return;
+
+  oneshot_ticks = n;
+  oneshot_count = n * TICK_COUNT;
+  pit_start_oneshot (0, oneshot_count);
+  if (lapic_ticks)
+    lapic_timer_stop ();
+}
+
+/* Called when the idle thread is switched out, with interrupts
+   off.  If a one-shot interval is still running, because some
+   other interrupt woke a thread up, credits the whole ticks that
+   elapsed so far and restores the periodic tick.  At most
+   oneshot_ticks - 1 ticks are credited, since an expiry interrupt
+   that is already pending will still count as one tick. */
+void
+timer_idle_exit (void)
+{
+  uint16_t left;
+  int64_t elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  left = pit_read_counter (0);
+  if (left > oneshot_count)
+    elapsed = oneshot_ticks;    /* Counter wrapped: already expired. */
+  else
+    elapsed = (oneshot_count - left) / TICK_COUNT;
+  if (elapsed > oneshot_ticks - 1)
+    elapsed = oneshot_ticks - 1;
+
+  seqlock_write_begin (&ticks_seq);
+  ticks += elapsed;
+  seqlock_write_end (&ticks_seq);
+  update_time_page ();
+  oneshot_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  if (lapic_ticks)
+    lapic_timer_start (lapic_count, true);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -174,10 +579,66 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  /* End of a one-shot interval: go back to periodic mode and
+     account for all the ticks it covered at once.  thread_tick()
+     copes with TICKS advancing by more than one. */
+  seqlock_write_begin (&ticks_seq);
+  if (oneshot_ticks != 0)
+    {
+      ticks += oneshot_ticks - 1;
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      if (lapic_ticks)
+        lapic_timer_start (lapic_count, true);
+    }
   ticks++;
-  thread_tick (ticks);
+  seqlock_write_end (&ticks_seq);
+  update_time_page ();
+  if (!lapic_ticks)
+    {
+      profile_sample (args);
+      thread_tick (ticks);
+    }
+  intr_tasklet_schedule (&timer_tasklet);
+}
+
+/* Local APIC timer interrupt handler: the running CPU's tick.
+   The local tick runs off a different clock from the global
+   one, so it is kept from falling behind it, as it would after a
+   tickless idle period. */
+static void
+lapic_timer_interrupt (struct intr_frame *args)
+{
+  int64_t local = cpu_current ()->ticks + 1;
+  int64_t global = timer_ticks ();
+
+  profile_sample (args);
+  thread_tick (global > local ? global : local);
+}
+
+/* Timer tasklet.  Timer functions expect interrupts off, so
+   they still run that way, but interrupts are let in between
+   one timer and the next. */
+static void
+timer_tasklet_run (void *aux UNUSED)
+{
+  enum intr_level old_level = intr_disable ();
+  run_timers ();
+  intr_set_level (old_level);
+}
+
+/* Copies the tick count into the time page.  Interrupts must be
+   off, so there is only ever one writer. */
+static void
+update_time_page (void)
+{
+  time_page->seq++;
+  barrier ();
+  time_page->ticks = ticks;
+  barrier ();
+  time_page->seq++;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -213,6 +674,22 @@ busy_wait (int64_t loops)
     barrier ();
 }
 
+/* Returns the number of TSC cycles in NUM/DENOM seconds. */
+static uint64_t
+tsc_cycles (int64_t num, int32_t denom)
+{
+  /* Even at 10 GHz this overflows only past 900 M units. */
+  return tsc_per_tick * TIMER_FREQ * num / denom;
+}
+
+/* Busy-waits until CYCLES TSC cycles have passed since START. */
+static void
+tsc_wait (uint64_t start, uint64_t cycles)
+{
+  while (cpu_rdtsc () - start < cycles)
+    barrier ();
+}
+
 /* Sleep for approximately NUM/DENOM seconds. */
 static void
 real_time_sleep (int64_t num, int32_t denom) 
@@ -226,7 +703,18 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (tsc_per_tick != 0)
+    {
+      /* Yield the CPU for the whole ticks, then busy-wait for the
+         residual.  A sleep of N ticks ends at the Nth tick
+         boundary, between N - 1 and N ticks later, so sleeping
+         one tick less never overshoots. */
+      uint64_t start = cpu_rdtsc ();
+      if (ticks > 1)
+        timer_sleep (ticks - 1);
+      tsc_wait (start, tsc_cycles (num, denom));
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
@@ -245,6 +733,12 @@ real_time_sleep (int64_t num, int32_t denom)
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
+  if (tsc_per_tick != 0)
+    {
+      tsc_wait (cpu_rdtsc (), tsc_cycles (num, denom));
+      return;
+    }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
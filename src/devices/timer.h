@@ -1,18 +1,53 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+struct timer;
+
+/* Function called, in interrupt context (the timer tasklet) and
+   with interrupts off, when timer T expires. */
+typedef void timer_func (struct timer *t);
+
+/* A timeout.  Owned by its user, who embeds it in some larger
+   object, so arming one never allocates. */
+struct timer
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t deadline;           /* Tick at which to expire. */
+    timer_func *func;           /* Called on expiry. */
+    void *aux;                  /* For FUNC's use. */
+    bool pending;               /* Armed and not yet expired? */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_cpu_init (void);
+void *timer_time_page (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+uint64_t timer_cycles (void);
+uint64_t timer_ns (void);
+uint64_t timer_cycles_to_ns (uint64_t cycles);
+
+/* Timeouts. */
+void timer_add (struct timer *, int64_t deadline, timer_func *, void *aux);
+bool timer_cancel (struct timer *);
+int64_t timer_next_deadline (void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +59,10 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_idle_enter (int64_t deadline);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -14,6 +14,9 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Number of whole rows in the 32 kB of text-mode video memory. */
+#define FB_ROW_CNT (0x8000 / (COL_CNT * 2))
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
@@ -21,15 +24,31 @@ static size_t cx, cy;
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
-/* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+/* A blank cell, twice over, for clearing a word at a time. */
+#define BLANK_PAIR (0x00010001u * (' ' | (GRAY_ON_BLACK << 8)))
+
+/* Framebuffer: all of video memory, as FB_ROW_CNT rows.  See
+   [FREEVGA] under "VGA Text Mode Operation".
+
+   The display shows ROW_CNT rows starting at row `top', so
+   scrolling only advances `top' and reprograms the CRTC start
+   address, instead of moving the whole screen.  When the display
+   reaches the end of video memory, it is copied back to the
+   start, once every FB_ROW_CNT - ROW_CNT lines.
+
+   The character at (x,y) on the display is fb[top + y][x][0].
+   The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
+static size_t top;
+
+/* True if `top' changed since the CRTC start address was set. */
+static bool top_changed;
 
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
 static void move_cursor (void);
+static void set_start_address (void);
 static void find_cursor (size_t *x, size_t *y);
 
 /* Initializes the VGA text display. */
@@ -50,6 +69,16 @@ init (void)
    characters in the conventional ways.  */
 void
 vga_putc (int c)
+{
+  char ch = c;
+  vga_write (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display,
+   interpreting control characters in the conventional ways.  The
+   hardware cursor is moved once, at the end. */
+void
+vga_write (const char *buffer, size_t n)
 {
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
@@ -57,75 +86,82 @@ vga_putc (int c)
 
   init ();
   
-  switch (c) 
+  while (n-- > 0)
     {
-    case '\n':
-      newline ();
-      break;
-
-    case '\f':
-      cls ();
-      break;
-
-    case '\b':
-      if (cx > 0)
-        cx--;
-      break;
+      uint8_t c = *buffer++;
+
+      switch (c) 
+        {
+        case '\n':
+          newline ();
+          break;
+
+        case '\f':
+          cls ();
+          break;
+
+        case '\b':
+          if (cx > 0)
+            cx--;
+          break;
       
-    case '\r':
-      cx = 0;
-      break;
-
-    case '\t':
-      cx = ROUND_UP (cx + 1, 8);
-      if (cx >= COL_CNT)
-        newline ();
-      break;
-
-    case '\a':
-      intr_set_level (old_level);
-      speaker_beep ();
-      intr_disable ();
-      break;
+        case '\r':
+          cx = 0;
+          break;
+
+        case '\t':
+          cx = ROUND_UP (cx + 1, 8);
+          if (cx >= COL_CNT)
+            newline ();
+          break;
+
+        case '\a':
+          intr_set_level (old_level);
+          speaker_beep ();
+          intr_disable ();
+          break;
       
-    default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
-      if (++cx >= COL_CNT)
-        newline ();
-      break;
+        default:
+          fb[top + cy][cx][0] = c;
+          fb[top + cy][cx][1] = GRAY_ON_BLACK;
+          if (++cx >= COL_CNT)
+            newline ();
+          break;
+        }
     }
 
-  /* Update cursor position. */
+  /* Update display start and cursor position. */
+  if (top_changed)
+    set_start_address ();
   move_cursor ();
 
   intr_set_level (old_level);
 }
-
-/* Clears the screen and moves the cursor to the upper left. */
+
+/* Clears the screen and moves the cursor to the upper left.
+   The hardware cursor is updated by the caller. */
 static void
 cls (void)
 {
   size_t y;
 
+  top = 0;
+  top_changed = true;
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears display row Y to spaces. */
 static void
 clear_row (size_t y) 
 {
-  size_t x;
+  uint32_t *row = (uint32_t *) fb[top + y];
+  size_t i;
 
-  for (x = 0; x < COL_CNT; x++)
-    {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
-    }
+  for (i = 0; i < COL_CNT / 2; i++)
+    row[i] = BLANK_PAIR;
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -139,7 +175,14 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      if (top + ROW_CNT < FB_ROW_CNT)
+        top++;
+      else
+        {
+          memcpy (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
+      top_changed = true;
       clear_row (ROW_CNT - 1);
     }
 }
@@ -149,11 +192,23 @@ static void
 move_cursor (void) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
+  uint16_t cp = cx + COL_CNT * (top + cy);
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
 
+/* Makes the display start at row `top' of video memory. */
+static void
+set_start_address (void)
+{
+  /* See [FREEVGA] under "CRTC Registers", Start Address High and
+     Low Registers.  The address is in character cells. */
+  uint16_t sa = COL_CNT * top;
+  outw (0x3d4, 0x0c | (sa & 0xff00));
+  outw (0x3d4, 0x0d | (sa << 8));
+  top_changed = false;
+}
+
 /* Reads the current hardware cursor position into (*X,*Y). */
 static void
 find_cursor (size_t *x, size_t *y) 
@@ -12,6 +12,37 @@
 #include <stdio.h>
 #include <string.h>
 
+/* Entries read from a directory per system call. */
+#define BATCH 32
+
+static void
+print_entry (const char *dir, const char *name, bool verbose)
+{
+  printf ("%s", name); 
+  if (verbose) 
+    {
+      char full_name[128];
+      int entry_fd;
+
+      snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
+      entry_fd = open (full_name);
+
+      printf (": ");
+      if (entry_fd != -1)
+        {
+          if (isdir (entry_fd))
+            printf ("directory");
+          else
+            printf ("%d-byte file", filesize (entry_fd));
+          printf (", inumber %d", inumber (entry_fd));
+        }
+      else
+        printf ("open failed");
+      close (entry_fd);
+    }
+  printf ("\n");
+}
+
 static bool
 list_dir (const char *dir, bool verbose) 
 {
@@ -24,39 +55,17 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct dirent ents[BATCH];
+      int cnt, i;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
-        {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
-
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
-
-              printf (": ");
-              if (entry_fd != -1)
-                {
-                  if (isdir (entry_fd))
-                    printf ("directory");
-                  else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
-                }
-              else
-                printf ("open failed");
-              close (entry_fd);
-            }
-          printf ("\n");
-        }
+      while ((cnt = readdir_batch (dir_fd, ents, BATCH)) > 0)
+        for (i = 0; i < cnt; i++)
+          print_entry (dir, ents[i].name, verbose);
     }
   else 
     printf ("%s: not a directory\n", dir);
@@ -5,6 +5,10 @@
 
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static void run_pipeline (char *command);
+
+/* Most commands in one pipeline. */
+#define MAX_STAGES 8
 
 int
 main (void)
@@ -30,6 +34,8 @@ main (void)
         {
           /* Empty command. */
         }
+      else if (strchr (command, '|') != NULL)
+        run_pipeline (command);
       else
         {
           pid_t pid = exec (command);
@@ -44,6 +50,78 @@ main (void)
   return EXIT_SUCCESS;
 }
 
+/* Runs COMMAND, of the form "a | b | ...", with the standard
+   output of each stage piped to the standard input of the next,
+   then waits for every stage.  Each child inherits the shell's
+   descriptors 0 and 1 as they are when it is started, so the
+   shell redirects its own around each exec() and closes them
+   again afterward, which gives them back to the console. */
+static void
+run_pipeline (char *command)
+{
+  char *stages[MAX_STAGES];
+  pid_t pids[MAX_STAGES];
+  char *stage, *save_ptr;
+  int stage_cnt = 0;
+  int i;
+
+  for (stage = strtok_r (command, "|", &save_ptr); stage != NULL;
+       stage = strtok_r (NULL, "|", &save_ptr))
+    {
+      if (stage_cnt >= MAX_STAGES)
+        {
+          printf ("too many commands in pipeline\n");
+          return;
+        }
+      while (*stage == ' ')
+        stage++;
+      stages[stage_cnt++] = stage;
+    }
+
+  for (i = 0; i < stage_cnt; i++)
+    {
+      int fds[2];
+      bool piped = i + 1 < stage_cnt;
+
+      if (piped)
+        {
+          if (!pipe (fds))
+            {
+              printf ("pipe failed\n");
+              piped = false;
+            }
+          else
+            {
+              dup2 (fds[1], STDOUT_FILENO);
+              close (fds[1]);
+            }
+        }
+
+      pids[i] = exec (stages[i]);
+      if (piped)
+        close (STDOUT_FILENO);
+      if (i > 0)
+        close (STDIN_FILENO);
+      if (pids[i] == PID_ERROR)
+        printf ("\"%s\": exec failed\n", stages[i]);
+
+      if (piped)
+        {
+          dup2 (fds[0], STDIN_FILENO);
+          close (fds[0]);
+        }
+      else
+        {
+          stage_cnt = i + 1;
+          break;
+        }
+    }
+
+  for (i = 0; i < stage_cnt; i++)
+    if (pids[i] != PID_ERROR)
+      printf ("\"%s\": exit code %d\n", stages[i], wait (pids[i]));
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
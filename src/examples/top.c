@@ -0,0 +1,103 @@
+/* top.c
+
+   Prints a summary of kernel activity every few seconds, from
+   the counters returned by the sysstat() system call.
+
+   Usage: top [SECONDS [COUNT]]
+
+   Samples every SECONDS seconds (default 1), COUNT times
+   (default 10).  Rates are per interval.  There is no way to
+   sleep from user space, so top spins between samples and its
+   own time shows up as user time. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Returns PART as a percentage of WHOLE. */
+static int
+percent (int64_t part, int64_t whole)
+{
+  return whole > 0 ? (int) (part * 100 / whole) : 0;
+}
+
+/* Prints the differences between samples OLD and NEW. */
+static void
+print_sample (const struct sysstat *old, const struct sysstat *new)
+{
+  int64_t busy = new->ticks - old->ticks;
+  uint64_t hits = new->cache_hit_cnt - old->cache_hit_cnt;
+  uint64_t misses = new->cache_miss_cnt - old->cache_miss_cnt;
+  unsigned i;
+
+  printf ("up %lld ticks, %u threads, %u ready, cpu %d%% user "
+          "%d%% kernel %d%% idle\n",
+          new->ticks, new->thread_cnt, new->ready_cnt,
+          percent (new->user_ticks - old->user_ticks, busy),
+          percent (new->kernel_ticks - old->kernel_ticks, busy),
+          percent (new->idle_ticks - old->idle_ticks, busy));
+  printf ("  mem: kernel %u/%u pages, user %u/%u pages\n",
+          new->mem.kernel_pool.used_cnt, new->mem.kernel_pool.page_cnt,
+          new->mem.user_pool.used_cnt, new->mem.user_pool.page_cnt);
+  printf ("  intr: %llu, timer %llu, ide %llu\n",
+          new->intr_cnt - old->intr_cnt,
+          new->irq_cnt[0] - old->irq_cnt[0],
+          (new->irq_cnt[14] - old->irq_cnt[14])
+          + (new->irq_cnt[15] - old->irq_cnt[15]));
+  printf ("  cache: %llu hits, %llu misses, %d%% hit rate\n",
+          hits, misses, percent (hits, hits + misses));
+  printf ("  faults: %u minor, %u file, %u swap, %u cow, %u stack, "
+          "%u evictions\n",
+          new->faults.minor_cnt - old->faults.minor_cnt,
+          new->faults.file_cnt - old->faults.file_cnt,
+          new->faults.swap_cnt - old->faults.swap_cnt,
+          new->faults.cow_cnt - old->faults.cow_cnt,
+          new->faults.stack_cnt - old->faults.stack_cnt,
+          new->faults.evict_cnt - old->faults.evict_cnt);
+  for (i = 0; i < new->block_cnt && i < old->block_cnt; i++)
+    {
+      const struct sysstat_block *o = &old->blocks[i];
+      const struct sysstat_block *n = &new->blocks[i];
+
+      printf ("  %s: %llu reads, %llu writes, %llu requests\n",
+              n->name, n->read_cnt - o->read_cnt,
+              n->write_cnt - o->write_cnt,
+              n->request_cnt - o->request_cnt);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  static struct sysstat samples[2];
+  int seconds = argc > 1 ? atoi (argv[1]) : 1;
+  int count = argc > 2 ? atoi (argv[2]) : 10;
+  int i;
+
+  if (seconds < 1 || count < 1)
+    {
+      printf ("usage: top [SECONDS [COUNT]]\n");
+      return EXIT_FAILURE;
+    }
+
+  sysstat (&samples[0], sizeof samples[0]);
+  if (samples[0].version != SYSSTAT_VERSION)
+    {
+      printf ("top: kernel statistics are version %u, expected %u\n",
+              samples[0].version, SYSSTAT_VERSION);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      struct sysstat *old = &samples[i % 2];
+      struct sysstat *new = &samples[(i + 1) % 2];
+      int64_t until = clock_ticks () + (int64_t) seconds * clock_freq ();
+
+      while (clock_ticks () < until)
+        continue;
+      sysstat (new, sizeof *new);
+      print_sample (old, new);
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+/* tune.c
+
+   Prints or sets the kernel's tunables.
+
+   Usage: tune NAME [VALUE]
+
+   Prints the value of the tunable NAME, then sets it to VALUE,
+   if given.  The kernel's -h option lists the tunables. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[])
+{
+  unsigned old, new;
+
+  if (argc != 2 && argc != 3)
+    {
+      printf ("usage: tune NAME [VALUE]\n");
+      return EXIT_FAILURE;
+    }
+  new = argc == 3 ? (unsigned) atoi (argv[2]) : 0;
+  if (!tune (argv[1], argc == 3 ? &new : NULL, &old))
+    {
+      printf ("%s: %s\n", argv[1],
+              argc == 3 ? "unknown tunable or bad value" : "unknown tunable");
+      return EXIT_FAILURE;
+    }
+  if (argc == 3)
+    printf ("%s: %u -> %u\n", argv[1], old, new);
+  else
+    printf ("%s: %u\n", argv[1], old);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,845 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysstat.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Buffer cache of file system sectors.
+
+   A fixed array of CACHE_SIZE entries, each holding one sector of
+   fs_device.  Lookups are a linear search of the array, which at
+   this size is cheaper than maintaining an index.  Replacement is
+   the clock (second chance) algorithm over the array.  Writes only
+   mark an entry dirty; dirty entries reach the disk when they are
+   evicted, when the periodic flush runs every CACHE_FLUSH_INTERVAL
+   ticks, or from cache_done().  The periodic flush and read-ahead
+   run as tasks on the kernel work queue.
+
+   Entries written with cache_write_meta() hold file system
+   metadata, which must reach its home sector only after the
+   journal has committed it (see journal.c).  The periodic flush
+   commits the journal before flushing, and cache_flush() passes such
+   entries over; journal_commit() collects them with
+   cache_for_each_meta() and writes them home with
+   cache_checkpoint().  Eviction passes them over too.  So that
+   half of the cache is always left for eviction, journal_begin()
+   commits before an operation starts once they take up the other
+   half.  A miss never commits, since a commit waits for the
+   operations in progress and one of those may be waiting for a
+   lock the missing thread holds.  Only if the operations in
+   progress dirty more than half of the cache between them, and
+   so leave nothing else, does a miss write one home early.
+
+   So that the cache does not start cold after every boot,
+   cache_done() records which sectors were the most used, ranked
+   by how often the entries holding them were looked up, in
+   CACHE_HOT_SECTOR, and cache_hot_prefetch() brings them back in
+   at the next mount, in the background and in order of sector
+   number.
+
+   Flushes write runs of dirty entries for consecutive sectors in
+   a single transfer each, of up to FLUSH_RUN sectors, so data
+   that was allocated together goes out together.
+
+   So that a process streaming writes cannot fill the cache with
+   dirty data, leaving readers to wait behind its write-backs on
+   every miss, the dirty entries that a flush can write, that is,
+   those not holding metadata, are counted, in total and against
+   the thread that dirtied each.  The thread settles up in
+   cache_throttle() when it can safely sleep, as at the end of a
+   system call.  Past half of cache_dirty_limit, a flush starts
+   in the background; past the limit, the thread also sleeps, for
+   a time that grows with the sectors it dirtied and with the
+   excess, so that heavy writers are held back the most while the
+   flush catches up.
+
+   Locking: cache_lock protects the sector <-> entry mapping and
+   the clock hand.  Each entry's own lock protects its data and
+   flags and is held across disk I/O on that entry.  A thread
+   waits for at most one entry lock at a time: flushes only try
+   for the further entries of a run.  Nor does a thread ever wait
+   for an entry lock while holding cache_lock, so the locks cannot
+   deadlock. */
+
+#define CACHE_SIZE 64                   /* Number of cached sectors. */
+#define CACHE_FLUSH_INTERVAL (5 * TIMER_FREQ) /* Write-behind period. */
+#define READAHEAD_DEPTH 16              /* Max queued read-aheads. */
+#define FLUSH_RUN 16                    /* Max sectors per flush write. */
+#define THROTTLE_MAX (TIMER_FREQ / 10)  /* Longest sleep per write. */
+
+/* Most dirty data entries before writers are throttled. */
+unsigned cache_dirty_limit = CACHE_SIZE / 2;
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct lock lock;                   /* Protects everything below. */
+    block_sector_t sector;              /* Cached sector. */
+    bool valid;                         /* Holds SECTOR's data? */
+    bool dirty;                         /* Modified since last write? */
+    bool accessed;                      /* Used since clock last passed? */
+    bool meta;                          /* Dirty data is metadata? */
+    bool readahead;                     /* Read ahead, not yet used? */
+    unsigned use_cnt;                   /* Lookups since filled. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Statistics, protected by cache_lock, like each entry's
+   READAHEAD flag. */
+static unsigned long long hit_cnt;      /* Lookups found cached. */
+static unsigned long long miss_cnt;     /* Lookups read from disk. */
+static unsigned long long ahead_cnt;    /* Sectors read ahead. */
+static unsigned long long ahead_hit_cnt; /* Hits on read-ahead sectors. */
+static unsigned long long evict_clean_cnt; /* Clean entries evicted. */
+static unsigned long long evict_dirty_cnt; /* Dirty entries evicted. */
+static unsigned long long flush_cnt;    /* Flushes. */
+static unsigned long long flush_write_cnt; /* Sectors written by flushes. */
+static unsigned long long throttle_cnt; /* Writes throttled. */
+static unsigned long long throttle_ticks; /* Ticks they slept. */
+
+/* Dirty entries not holding metadata.  Changed with interrupts
+   off, since each entry is under its own lock. */
+static unsigned dirty_cnt;
+
+/* Dirty entries holding metadata, all uncommitted.  Likewise. */
+static unsigned meta_cnt;
+
+/* Sectors queued for asynchronous read-ahead. */
+static block_sector_t readahead_queue[READAHEAD_DEPTH];
+static size_t readahead_head, readahead_cnt;
+static struct lock readahead_lock;
+
+/* On-disk list of hot sectors, in CACHE_HOT_SECTOR.  If the
+   sector lacks the magic number, as on a disk formatted before
+   there was a list, it belongs to something else and is left
+   alone. */
+#define HOT_MAGIC 0x686f7473            /* "hots" */
+#define HOT_MAX CACHE_SIZE              /* Most sectors listed. */
+
+struct hot_list
+  {
+    uint32_t magic;                     /* HOT_MAGIC. */
+    uint32_t cnt;                       /* Number of sectors listed. */
+    block_sector_t sectors[HOT_MAX];    /* The sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - HOT_MAX * sizeof (block_sector_t)];
+  };
+
+static struct hot_list hot;             /* Read at mount, for prefetch. */
+static bool hot_valid;                  /* Is CACHE_HOT_SECTOR ours? */
+static struct work prefetch_work;       /* Runs prefetch_task(). */
+
+/* Flushes gather runs here, one flush at a time. */
+static uint8_t flush_buf[FLUSH_RUN * BLOCK_SECTOR_SIZE];
+static struct lock flush_lock;
+
+/* Background tasks. */
+static struct timer flush_timer;        /* Expires at next flush. */
+static struct work flush_work;          /* Runs flush_task(). */
+static struct work readahead_work;      /* Runs readahead_task(). */
+static struct work writeback_work;      /* Runs writeback_task(). */
+
+static work_func flush_task, readahead_task, prefetch_task, writeback_task;
+static timer_func flush_tick;
+
+/* Initializes the buffer cache and schedules its first periodic
+   flush. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init_named (&cache_lock, "cache");
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      lock_init (&cache[i].lock);
+      cache[i].valid = false;
+    }
+  clock_hand = 0;
+
+  lock_init (&readahead_lock);
+  lock_init (&flush_lock);
+  readahead_head = readahead_cnt = 0;
+
+  work_init (&flush_work, flush_task, NULL, PRI_DEFAULT);
+  work_init (&readahead_work, readahead_task, NULL, PRI_DEFAULT);
+  work_init (&prefetch_work, prefetch_task, NULL, PRI_DEFAULT);
+  work_init (&writeback_work, writeback_task, NULL, PRI_DEFAULT);
+  dirty_cnt = meta_cnt = 0;
+  timer_add (&flush_timer, timer_ticks () + CACHE_FLUSH_INTERVAL,
+             flush_tick, NULL);
+}
+
+static void flush (bool meta);
+
+static void save_hot (void);
+
+/* Writes every dirty entry back to disk and records the hot
+   sectors.  Called at file system shutdown, after the journal's
+   final commit. */
+void
+cache_done (void)
+{
+  flush (true);
+  save_hot ();
+}
+
+/* Sets E's DIRTY and META flags, keeping dirty_cnt and meta_cnt
+   up to date.  E's lock must be held. */
+static void
+set_dirty (struct cache_entry *e, bool dirty, bool meta)
+{
+  bool counted = e->dirty && !e->meta;
+  bool counted_meta = e->dirty && e->meta;
+
+  if (counted != (dirty && !meta) || counted_meta != (dirty && meta))
+    {
+      enum intr_level old_level = intr_disable ();
+      if (counted != (dirty && !meta))
+        {
+          if (counted)
+            dirty_cnt--;
+          else
+            {
+              dirty_cnt++;
+              thread_current ()->cache_dirtied++;
+            }
+        }
+      if (counted_meta)
+        meta_cnt--;
+      else if (dirty && meta)
+        meta_cnt++;
+      intr_set_level (old_level);
+    }
+  e->dirty = dirty;
+  e->meta = meta;
+}
+
+/* Writes E back to disk if it is dirty.  E's lock must be held.
+   Returns true if E was written. */
+static bool
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (!e->valid || !e->dirty)
+    return false;
+  block_write (fs_device, e->sector, e->data);
+  set_dirty (e, false, false);
+  return true;
+}
+
+/* Returns the entry caching SECTOR, or a null pointer.
+   cache_lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm and returns
+   it with its lock held.  Entries that are currently locked are
+   passed over, and so are entries holding uncommitted metadata
+   unless TAKE_META is true.  Returns a null pointer if a whole
+   sweep finds nothing but such entries to pass over.  cache_lock
+   must be held. */
+static struct cache_entry *
+choose_victim (bool take_meta)
+{
+  size_t scanned, meta_seen = 0;
+
+  for (scanned = 0; ; scanned++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      /* Every entry is busy: let their holders finish. */
+      if (scanned > 0 && scanned % (2 * CACHE_SIZE) == 0)
+        thread_yield ();
+      if (scanned % CACHE_SIZE == 0)
+        meta_seen = 0;
+
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (e->valid && e->dirty && e->meta && !take_meta)
+        {
+          lock_release (&e->lock);
+          if (++meta_seen == CACHE_SIZE)
+            return NULL;
+          continue;
+        }
+      if (!e->valid || !e->accessed)
+        return e;
+      e->accessed = false;
+      lock_release (&e->lock);
+    }
+}
+
+/* Returns the entry for SECTOR, reading it from disk if it is not
+   cached, with its lock held.  If ZERO is true the caller is
+   about to overwrite the whole sector, so a missing sector is
+   zeroed instead of read.  AHEAD is true for read-ahead, which
+   is not counted as a hit or a miss. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool zero, bool ahead)
+{
+  struct cache_entry *e;
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          if (!ahead)
+            {
+              hit_cnt++;
+              if (e->readahead)
+                ahead_hit_cnt++;
+              e->readahead = false;
+            }
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+
+          /* It may have been evicted while we waited. */
+          if (e->valid && e->sector == sector)
+            {
+              e->accessed = true;
+              if (!ahead)
+                e->use_cnt++;
+              return e;
+            }
+          lock_release (&e->lock);
+          continue;
+        }
+
+      /* Miss.  The old contents must reach the disk before the
+         entry is visible under its new sector, or a concurrent
+         miss on the old sector could read stale data, so the
+         write-back happens with cache_lock held.  The periodic
+         flush keeps this rare. */
+      e = choose_victim (false);
+      if (e == NULL)
+        {
+          /* Nothing but uncommitted metadata is cached, which
+             journal_begin() keeps from happening unless the
+             operations in progress dirty half of the cache.
+             Write an entry home early: that only loses atomicity
+             if the system crashes before the next commit. */
+          e = choose_victim (true);
+        }
+      if (ahead)
+        ahead_cnt++;
+      else
+        miss_cnt++;
+      if (write_back (e))
+        evict_dirty_cnt++;
+      else if (e->valid)
+        evict_clean_cnt++;
+      e->sector = sector;
+      e->valid = true;
+      e->dirty = false;
+      e->meta = false;
+      e->accessed = true;
+      e->readahead = ahead;
+      e->use_cnt = ahead ? 0 : 1;
+      lock_release (&cache_lock);
+
+      if (zero)
+        memset (e->data, 0, BLOCK_SECTOR_SIZE);
+      else
+        block_read (fs_device, sector, e->data);
+      return e;
+    }
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, off_t ofs, off_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector, false, false);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Reads the CNT whole sectors starting at SECTOR into BUFFER.
+   Cached sectors are copied from the cache.  Runs of uncached
+   sectors are read from disk straight into BUFFER in a single
+   transfer, without displacing anything from the cache. */
+void
+cache_read_multiple (block_sector_t sector, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t run;
+
+      lock_acquire (&cache_lock);
+      for (run = 0; i + run < cnt && lookup (sector + i + run) == NULL; run++)
+        continue;
+      miss_cnt += run;
+      lock_release (&cache_lock);
+
+      if (run > 0)
+        block_read_multiple (fs_device, sector + i, run,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+      else
+        {
+          cache_read (sector + i, buffer + i * BLOCK_SECTOR_SIZE,
+                      0, BLOCK_SECTOR_SIZE);
+          run = 1;
+        }
+      i += run;
+    }
+}
+
+/* Writes the CNT whole sectors starting at SECTOR from BUFFER
+   straight to disk in a single transfer, without displacing
+   anything from the cache.  Those of the sectors that are cached
+   are updated in the cache as well, after the transfer, so that
+   a copy brought in meanwhile does not stay stale.  Not for
+   metadata, which must go through the journal. */
+void
+cache_write_multiple (block_sector_t sector, size_t cnt,
+                      const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  block_write_multiple (fs_device, sector, cnt, buffer);
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = lookup (sector + i);
+      lock_release (&cache_lock);
+      if (e == NULL)
+        continue;
+
+      lock_acquire (&e->lock);
+      if (e->valid && e->sector == sector + i)
+        memcpy (e->data, buffer + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      lock_release (&e->lock);
+    }
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   OFS, marking the sector as metadata if META is true. */
+static void
+store (block_sector_t sector, const void *buffer, off_t ofs, off_t size,
+       bool meta)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector, size == BLOCK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  set_dirty (e, true, e->meta || meta);
+  lock_release (&e->lock);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+   The data reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, off_t ofs,
+             off_t size)
+{
+  store (sector, buffer, ofs, size, false);
+}
+
+/* Writes SIZE bytes of file system metadata from BUFFER into
+   SECTOR starting at byte OFS.  The sector reaches its home on
+   disk only after the journal commits it.  Must be called within
+   a journal operation. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer, off_t ofs,
+                  off_t size)
+{
+  store (sector, buffer, ofs, size, true);
+}
+
+/* Asks for SECTOR to be brought into the cache in the background.
+   The request is dropped if the read-ahead queue is full. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt < READAHEAD_DEPTH)
+    {
+      readahead_queue[(readahead_head + readahead_cnt++) % READAHEAD_DEPTH]
+        = sector;
+      work_queue (&readahead_work);
+    }
+  lock_release (&readahead_lock);
+}
+
+/* Returns true if E is dirty and should be written by a flush
+   that includes metadata only if META is true.  E's lock must be
+   held. */
+static bool
+needs_flush (const struct cache_entry *e, bool meta)
+{
+  return e->valid && e->dirty && (meta || !e->meta);
+}
+
+/* Writes FIRST, which needs_flush(), back to disk together with
+   the entries for the sectors that follow it, as long as they
+   are cached, need flushing in the sense of META and are not
+   busy.  FIRST's lock must be held.  flush_lock must be held.
+   Returns the number of sectors written. */
+static size_t
+flush_run (struct cache_entry *first, bool meta)
+{
+  struct cache_entry *run[FLUSH_RUN];
+  size_t cnt, i;
+
+  run[0] = first;
+  for (cnt = 1; cnt < FLUSH_RUN; cnt++)
+    {
+      block_sector_t sector = first->sector + cnt;
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = lookup (sector);
+      lock_release (&cache_lock);
+      if (e == NULL || !lock_try_acquire (&e->lock))
+        break;
+      if (e->sector != sector || !needs_flush (e, meta))
+        {
+          lock_release (&e->lock);
+          break;
+        }
+      run[cnt] = e;
+    }
+
+  if (cnt == 1)
+    {
+      write_back (first);
+      return 1;
+    }
+  for (i = 0; i < cnt; i++)
+    memcpy (flush_buf + i * BLOCK_SECTOR_SIZE, run[i]->data,
+            BLOCK_SECTOR_SIZE);
+  block_write_multiple (fs_device, first->sector, cnt, flush_buf);
+  for (i = 0; i < cnt; i++)
+    {
+      set_dirty (run[i], false, false);
+      if (i > 0)
+        lock_release (&run[i]->lock);
+    }
+  return cnt;
+}
+
+/* Writes dirty entries back to disk, including those holding
+   metadata only if META is true. */
+static void
+flush (bool meta)
+{
+  size_t written = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&e->lock);
+      if (needs_flush (e, meta))
+        written += flush_run (e, meta);
+      lock_release (&e->lock);
+    }
+  lock_release (&flush_lock);
+
+  lock_acquire (&cache_lock);
+  flush_cnt++;
+  flush_write_cnt += written;
+  lock_release (&cache_lock);
+}
+
+/* Writes all dirty entries that do not hold metadata back to
+   disk. */
+void
+cache_flush (void)
+{
+  flush (false);
+}
+
+/* Throttles the current thread for the entries it has dirtied
+   since it last called this function, as described at the top
+   of this file.  The thread must hold no locks that others might
+   need meanwhile. */
+void
+cache_throttle (void)
+{
+  struct thread *t = thread_current ();
+  unsigned sectors = t->cache_dirtied;
+  unsigned limit = cache_dirty_limit;
+  unsigned dirty = dirty_cnt;
+  int64_t ticks;
+
+  t->cache_dirtied = 0;
+  if (sectors == 0 || dirty <= limit / 2)
+    return;
+  work_queue (&writeback_work);
+  if (dirty <= limit)
+    return;
+
+  ticks = DIV_ROUND_UP ((int64_t) sectors * (dirty - limit),
+                        CACHE_SIZE - limit + 1);
+  if (ticks > THROTTLE_MAX)
+    ticks = THROTTLE_MAX;
+  lock_acquire (&cache_lock);
+  throttle_cnt++;
+  throttle_ticks += ticks;
+  lock_release (&cache_lock);
+  timer_sleep (ticks);
+}
+
+/* Stores the cache's statistics into STAT. */
+void
+cache_get_stats (struct sysstat *stat)
+{
+  lock_acquire (&cache_lock);
+  stat->cache_hit_cnt = hit_cnt;
+  stat->cache_miss_cnt = miss_cnt;
+  stat->cache_ahead_cnt = ahead_cnt;
+  stat->cache_ahead_hit_cnt = ahead_hit_cnt;
+  stat->cache_evict_clean_cnt = evict_clean_cnt;
+  stat->cache_evict_dirty_cnt = evict_dirty_cnt;
+  stat->cache_flush_cnt = flush_cnt;
+  stat->cache_flush_write_cnt = flush_write_cnt;
+  stat->cache_throttle_cnt = throttle_cnt;
+  stat->cache_throttle_ticks = throttle_ticks;
+  lock_release (&cache_lock);
+}
+
+/* Prints the cache's statistics. */
+void
+cache_print_stats (void)
+{
+  unsigned long long lookups = hit_cnt + miss_cnt;
+
+  printf ("Cache: %llu hits, %llu misses, %llu%% hit rate\n",
+          hit_cnt, miss_cnt, lookups ? hit_cnt * 100 / lookups : 0);
+  printf ("Cache: %llu sectors read ahead, %llu used; "
+          "%llu clean and %llu dirty evictions\n",
+          ahead_cnt, ahead_hit_cnt, evict_clean_cnt, evict_dirty_cnt);
+  printf ("Cache: %llu flushes wrote %llu sectors\n",
+          flush_cnt, flush_write_cnt);
+  printf ("Cache: %llu writes throttled for %llu ticks\n",
+          throttle_cnt, throttle_ticks);
+}
+
+/* Calls FUNC for each entry holding dirty metadata, with its
+   sector and contents, given auxiliary data AUX.  The entry is
+   locked during the call.  Stops early if FUNC returns false. */
+void
+cache_for_each_meta (cache_meta_func *func, void *aux)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      bool more = true;
+
+      lock_acquire (&e->lock);
+      if (e->valid && e->dirty && e->meta)
+        more = func (e->sector, e->data, aux);
+      lock_release (&e->lock);
+      if (!more)
+        break;
+    }
+}
+
+/* Returns true if uncommitted metadata takes up half of the
+   cache or more, in which case the journal should commit before
+   another operation begins. */
+bool
+cache_meta_crowded (void)
+{
+  return meta_cnt >= CACHE_SIZE / 2;
+}
+
+/* Writes SECTOR back to its home on disk if it is cached and
+   dirty. */
+void
+cache_checkpoint (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  lock_release (&cache_lock);
+  if (e == NULL)
+    return;
+
+  lock_acquire (&e->lock);
+  if (e->sector == sector)
+    write_back (e);
+  lock_release (&e->lock);
+}
+
+/* Timer function that queues the periodic flush. */
+static void
+flush_tick (struct timer *t UNUSED)
+{
+  work_queue (&flush_work);
+}
+
+/* Periodic flush task: commits the journal, which also writes out
+   the free map changes made since the last pass, then writes
+   back dirty data, and schedules the next pass. */
+static void
+flush_task (void *aux UNUSED)
+{
+  journal_commit ();
+  cache_flush ();
+  timer_add (&flush_timer, timer_ticks () + CACHE_FLUSH_INTERVAL,
+             flush_tick, NULL);
+}
+
+/* Background flush started by cache_throttle(). */
+static void
+writeback_task (void *aux UNUSED)
+{
+  cache_flush ();
+}
+
+/* Writes an empty list of hot sectors to a newly formatted
+   device. */
+void
+cache_hot_format (void)
+{
+  memset (&hot, 0, sizeof hot);
+  hot.magic = HOT_MAGIC;
+  block_write (fs_device, CACHE_HOT_SECTOR, &hot);
+  hot_valid = true;
+}
+
+/* Compares the sectors that A_ and B_ point to, for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  block_sector_t a = *(const block_sector_t *) a_;
+  block_sector_t b = *(const block_sector_t *) b_;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Reads the list of hot sectors that the last shutdown recorded
+   and starts bringing them into the cache in the background.
+   Called at mount, once the journal has been recovered. */
+void
+cache_hot_prefetch (void)
+{
+  ASSERT (sizeof hot == BLOCK_SECTOR_SIZE);
+
+  block_read (fs_device, CACHE_HOT_SECTOR, &hot);
+  hot_valid = hot.magic == HOT_MAGIC;
+  if (!hot_valid || hot.cnt == 0 || hot.cnt > HOT_MAX)
+    return;
+  qsort (hot.sectors, hot.cnt, sizeof *hot.sectors, compare_sectors);
+  work_queue (&prefetch_work);
+}
+
+/* Compares the entries that A_ and B_ point to, for qsort(), so
+   that the more used sorts first. */
+static int
+compare_use (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->use_cnt > b->use_cnt ? -1 : a->use_cnt < b->use_cnt;
+}
+
+/* Records in CACHE_HOT_SECTOR the cached sectors that were found
+   in the cache more than once, the most used first.  Called at
+   shutdown.  The list goes out through a buffer of its own, in
+   case a short run is still prefetching from HOT. */
+static void
+save_hot (void)
+{
+  static struct hot_list out;
+  struct cache_entry *used[CACHE_SIZE];
+  size_t cnt = 0, i;
+
+  if (!hot_valid)
+    return;
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].use_cnt > 1)
+      used[cnt++] = &cache[i];
+  qsort (used, cnt, sizeof *used, compare_use);
+
+  memset (&out, 0, sizeof out);
+  out.magic = HOT_MAGIC;
+  out.cnt = cnt < HOT_MAX ? cnt : HOT_MAX;
+  for (i = 0; i < out.cnt; i++)
+    out.sectors[i] = used[i]->sector;
+  block_write (fs_device, CACHE_HOT_SECTOR, &out);
+}
+
+/* Prefetch task: loads the sectors in HOT into the cache, as
+   read-ahead, so that they are counted as hits only once they
+   are used.  Sectors beyond the end of the device, which only a
+   damaged list would name, are skipped. */
+static void
+prefetch_task (void *aux UNUSED)
+{
+  size_t i;
+
+  for (i = 0; i < hot.cnt; i++)
+    if (hot.sectors[i] < block_size (fs_device))
+      lock_release (&get_entry (hot.sectors[i], false, true)->lock);
+}
+
+/* Read-ahead task: loads queued sectors into the cache until the
+   queue is empty. */
+static void
+readahead_task (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&readahead_lock);
+      if (readahead_cnt == 0)
+        {
+          lock_release (&readahead_lock);
+          return;
+        }
+      sector = readahead_queue[readahead_head];
+      readahead_head = (readahead_head + 1) % READAHEAD_DEPTH;
+      readahead_cnt--;
+      lock_release (&readahead_lock);
+
+      lock_release (&get_entry (sector, false, true)->lock);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/journal.h"
+#include "filesys/off_t.h"
+
+/* Sector holding the list of hot sectors, just after the
+   journal. */
+#define CACHE_HOT_SECTOR (JOURNAL_SECTOR + JOURNAL_SECTORS)
+
+/* Most dirty data sectors before writers are throttled. */
+extern unsigned cache_dirty_limit;
+
+void cache_init (void);
+void cache_done (void);
+void cache_hot_format (void);
+void cache_hot_prefetch (void);
+
+void cache_read (block_sector_t, void *buffer, off_t ofs, off_t size);
+void cache_write (block_sector_t, const void *buffer, off_t ofs, off_t size);
+void cache_write_meta (block_sector_t, const void *buffer, off_t ofs,
+                       off_t size);
+void cache_read_multiple (block_sector_t, size_t cnt, void *buffer);
+void cache_write_multiple (block_sector_t, size_t cnt, const void *buffer);
+void cache_readahead (block_sector_t);
+void cache_flush (void);
+void cache_throttle (void);
+
+struct sysstat;
+void cache_get_stats (struct sysstat *);
+void cache_print_stats (void);
+
+/* Visits a cached metadata sector, given auxiliary data AUX.
+   Returns false to stop the iteration. */
+typedef bool cache_meta_func (block_sector_t, const void *data, void *aux);
+void cache_for_each_meta (cache_meta_func *, void *aux);
+void cache_checkpoint (block_sector_t);
+bool cache_meta_crowded (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,210 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Dentry cache.
+
+   Remembers the results of recent directory lookups, as a map
+   from (directory inode sector, name) to the sector of the named
+   file's inode.  A negative entry records that the name does not
+   exist, so that repeated lookups of missing names are cheap
+   too.  The directory code keeps it up to date: dir_add() and
+   dir_remove() replace the entry for the name they change, and
+   removing a directory drops every entry within it.
+
+   There are DCACHE_SIZE entries in a fixed array.  When all are
+   in use, the least recently used one is reused.
+
+   dcache_lock protects everything here.  It is never held while
+   calling into other file system code. */
+
+#define DCACHE_SIZE 256                 /* Number of cached names. */
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    bool negative;                      /* NAME does not exist? */
+    block_sector_t sector;              /* Inode sector, if !NEGATIVE. */
+  };
+
+static struct dentry dentry_pool[DCACHE_SIZE];
+static struct hash dentries;            /* Cached entries. */
+static struct list lru_list;            /* All entries, most recent first. */
+static struct lock dcache_lock;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("dentry cache creation failed");
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+
+  /* Unused entries have an empty name and sit at the back of the
+     LRU list, so they are taken first. */
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      dentry_pool[i].name[0] = '\0';
+      list_push_back (&lru_list, &dentry_pool[i].lru_elem);
+    }
+}
+
+/* Returns the cached entry for NAME in directory DIR, or a null
+   pointer.  dcache_lock must be held. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in directory DIR.  On DCACHE_HIT, stores the
+   sector of its inode in *SECTORP. */
+enum dcache_result
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  enum dcache_result result = DCACHE_MISS;
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      if (d->negative)
+        result = DCACHE_NEGATIVE;
+      else
+        {
+          *sectorp = d->sector;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records that NAME in directory DIR is the inode in SECTOR, if
+   NEGATIVE is false, or does not exist, if it is true. */
+static void
+insert (block_sector_t dir, const char *name, bool negative,
+        block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      /* Reuse the least recently used entry. */
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->name[0] != '\0')
+        hash_delete (&dentries, &d->hash_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->negative = negative;
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Records that NAME in directory DIR is the inode in SECTOR. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  insert (dir, name, false, sector);
+}
+
+/* Records that NAME does not exist in directory DIR. */
+void
+dcache_insert_negative (block_sector_t dir, const char *name)
+{
+  insert (dir, name, true, 0);
+}
+
+/* Forgets anything cached about NAME in directory DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      d->name[0] = '\0';
+      list_remove (&d->lru_elem);
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets everything cached about names in directory DIR. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      struct dentry *d = &dentry_pool[i];
+      if (d->name[0] != '\0' && d->dir == dir)
+        {
+          hash_delete (&dentries, &d->hash_elem);
+          d->name[0] = '\0';
+          list_remove (&d->lru_elem);
+          list_push_back (&lru_list, &d->lru_elem);
+        }
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns a hash value for dentry D. */
+static unsigned
+dentry_hash (const struct hash_elem *d_, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (d_, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,24 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Result of a dentry cache lookup. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Not cached: search the directory. */
+    DCACHE_HIT,                 /* Name exists; sector returned. */
+    DCACHE_NEGATIVE             /* Name is known not to exist. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (block_sector_t dir, const char *name,
+                                  block_sector_t *sectorp);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector);
+void dcache_insert_negative (block_sector_t dir, const char *name);
+void dcache_invalidate (block_sector_t dir, const char *name);
+void dcache_invalidate_dir (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -1,12 +1,23 @@
 #include "filesys/directory.h"
+#include <dirent.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
-/* A directory. */
+/* A directory.
+
+   Each directory is locked through its inode's user lock (see
+   inode_lock()): lookups and reads hold it shared, dir_add() and
+   dir_remove() exclusively.  Removing a directory also locks the
+   directory being removed, after its parent, while checking that
+   it is empty, so that nothing can be added to it meanwhile. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
@@ -21,12 +32,104 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory formats.
+
+   A small directory is an array of struct dir_entry that is
+   searched from the beginning.  A directory that would grow past
+   DIR_LINEAR_MAX entries is converted in place to the hashed
+   format, in which the file is an array of BLOCK_SECTOR_SIZE
+   blocks:
+
+   Block 0 holds a struct dir_header.  It begins with an entry
+   that is not in use, has an empty name and has DIR_HASH_MAGIC as
+   its sector, which no linear directory ever contains, so reading
+   the first entry tells the two formats apart.
+
+   Every other block is a struct dir_block of ENTRIES_PER_BLOCK
+   entries.  A name hashes to a bucket.  Each bucket has a primary
+   block at a fixed place, and a chain of overflow blocks
+   appended to the file when the primary fills.  The buckets grow
+   by linear hashing: once the entries would fill more than 3/4
+   of the buckets' primary blocks, bucket SPLIT gives up the
+   entries that now hash to bucket SPLIT + (BASE_BUCKETS << LEVEL)
+   and SPLIT advances, so the table grows one bucket at a time and
+   is never rehashed as a whole.  Primary blocks are allocated in
+   segments of consecutive blocks at the end of the file: segment
+   0 holds the first BASE_BUCKETS buckets, and segment K > 0 the
+   next BASE_BUCKETS << (K - 1).
+
+   Removing an entry leaves a free slot that later insertions
+   into the same bucket reuse.  Blocks are never freed, but once
+   fewer than 1/COMPACT_RATIO of the slots in them are in use the
+   directory is rebuilt from its live entries at the front of the
+   file, so that reading it costs in proportion to what is left.
+   Rebuilding moves entries, so it waits until no file is open on
+   the directory, since a file's position would be left pointing
+   at the wrong entry.
+
+   A linear directory keeps, in its inode, the offset before
+   which it has no free slot (see inode_free_hint()), so adding
+   an entry does not rescan the slots that are known to be full.
+
+   Names are hashed with hash_string(), so changing it makes
+   existing hashed directories unreadable. */
+#define DIR_LINEAR_MAX 32               /* Largest linear directory. */
+#define DIR_HASH_MAGIC 0x48534944       /* Marks a hashed directory. */
+#define BASE_BUCKETS 4u                 /* Buckets in segment 0. */
+#define MAX_SEGMENTS 24                 /* Segments in a directory. */
+#define ENTRIES_PER_BLOCK \
+        ((BLOCK_SECTOR_SIZE - sizeof (uint32_t)) / sizeof (struct dir_entry))
+#define COMPACT_RATIO 8                 /* See maybe_compact(). */
+#define COMPACT_MAX (8 * ENTRIES_PER_BLOCK) /* Most entries to rebuild. */
+
+/* Header of a hashed directory, in block 0. */
+struct dir_header
+  {
+    struct dir_entry marker;            /* Identifies the format. */
+    uint32_t level;                     /* Log2 of buckets / BASE_BUCKETS. */
+    uint32_t split;                     /* Next bucket to split. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t block_cnt;                 /* Blocks in the file. */
+    uint32_t segments[MAX_SEGMENTS];    /* First block of each segment. */
+  };
+
+/* A block of entries in a hashed directory. */
+struct dir_block
+  {
+    uint32_t next;                      /* Next block in chain, or 0. */
+    struct dir_entry entries[ENTRIES_PER_BLOCK];
+  };
+
+/* Cache of struct dir. */
+static struct kmem_cache *dir_cache;
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+  dcache_init ();
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, as a subdirectory of the directory in sector
+   PARENT, and gives it its "." and ".." entries.  (The root
+   directory is its own parent.)  Returns true if successful,
+   false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -34,7 +137,7 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_alloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
@@ -44,7 +147,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +175,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,6 +186,359 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads DIR's header into *H and returns true if DIR is in the
+   hashed format, otherwise returns false. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->marker.inode_sector == DIR_HASH_MAGIC
+          && h->marker.name[0] == '\0'
+          && !h->marker.in_use);
+}
+
+/* Writes header H to DIR.  Returns true if successful. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h)
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Reads block IDX of DIR into *B.  Returns true if successful. */
+static bool
+read_block (const struct dir *dir, uint32_t idx, struct dir_block *b)
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, idx * BLOCK_SECTOR_SIZE)
+          == sizeof *b);
+}
+
+/* Writes *B to block IDX of DIR.  Returns true if successful. */
+static bool
+write_block (struct dir *dir, uint32_t idx, const struct dir_block *b)
+{
+  return (inode_write_at (dir->inode, b, sizeof *b, idx * BLOCK_SECTOR_SIZE)
+          == sizeof *b);
+}
+
+/* Returns the byte offset in a hashed directory of entry I of
+   block IDX. */
+static off_t
+entry_ofs (uint32_t idx, size_t i)
+{
+  return (idx * BLOCK_SECTOR_SIZE + offsetof (struct dir_block, entries)
+          + i * sizeof (struct dir_entry));
+}
+
+/* Returns the number of buckets in H. */
+static uint32_t
+bucket_cnt (const struct dir_header *h)
+{
+  return (BASE_BUCKETS << h->level) + h->split;
+}
+
+/* Returns the bucket of NAME in H. */
+static uint32_t
+bucket_of (const struct dir_header *h, const char *name)
+{
+  uint32_t hash = hash_string (name);
+  uint32_t bucket = hash & ((BASE_BUCKETS << h->level) - 1);
+
+  /* Buckets before SPLIT have already been split this round. */
+  if (bucket < h->split)
+    bucket = hash & ((BASE_BUCKETS << (h->level + 1)) - 1);
+  return bucket;
+}
+
+/* Returns the segment holding BUCKET and stores BUCKET's index
+   within it in *OFSP. */
+static size_t
+segment_of (uint32_t bucket, uint32_t *ofsp)
+{
+  uint32_t start = BASE_BUCKETS;
+  size_t seg = 1;
+
+  if (bucket < BASE_BUCKETS)
+    {
+      *ofsp = bucket;
+      return 0;
+    }
+  while (bucket >= start * 2)
+    {
+      start *= 2;
+      seg++;
+    }
+  *ofsp = bucket - start;
+  return seg;
+}
+
+/* Returns the primary block of BUCKET in H. */
+static uint32_t
+bucket_block (const struct dir_header *h, uint32_t bucket)
+{
+  uint32_t ofs;
+  size_t seg = segment_of (bucket, &ofs);
+  return h->segments[seg] + ofs;
+}
+
+/* Appends segment SEG's blocks, empty, to hashed directory DIR
+   with header H, using B as a buffer.  Returns true if
+   successful. */
+static bool
+add_segment (struct dir *dir, struct dir_header *h, size_t seg,
+             struct dir_block *b)
+{
+  uint32_t size = seg == 0 ? BASE_BUCKETS : BASE_BUCKETS << (seg - 1);
+  uint32_t i;
+
+  memset (b, 0, sizeof *b);
+  for (i = 0; i < size; i++)
+    if (!write_block (dir, h->block_cnt + i, b))
+      return false;
+  h->segments[seg] = h->block_cnt;
+  h->block_cnt += size;
+  return true;
+}
+
+/* Searches the bucket for NAME in hashed directory DIR with
+   header H, using B as a buffer, like lookup(). */
+static bool
+lookup_hashed (const struct dir *dir, const struct dir_header *h,
+               const char *name, struct dir_entry *ep, off_t *ofsp,
+               struct dir_block *b)
+{
+  uint32_t idx;
+  size_t i;
+
+  for (idx = bucket_block (h, bucket_of (h, name)); idx != 0; idx = b->next)
+    {
+      if (!read_block (dir, idx, b))
+        return false;
+      for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+        if (b->entries[i].in_use && !strcmp (name, b->entries[i].name))
+          {
+            if (ep != NULL)
+              *ep = b->entries[i];
+            if (ofsp != NULL)
+              *ofsp = entry_ofs (idx, i);
+            return true;
+          }
+    }
+  return false;
+}
+
+/* Stores E in the first free slot of its bucket in hashed
+   directory DIR with header H, extending the bucket's chain if
+   it is full, using B as a buffer.  Updates H but does not write
+   it.  Returns true if successful. */
+static bool
+insert_hashed (struct dir *dir, struct dir_header *h,
+               const struct dir_entry *e, struct dir_block *b)
+{
+  uint32_t idx = bucket_block (h, bucket_of (h, e->name));
+  uint32_t new_idx;
+  size_t i;
+
+  for (;;)
+    {
+      if (!read_block (dir, idx, b))
+        return false;
+      for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+        if (!b->entries[i].in_use)
+          {
+            b->entries[i] = *e;
+            if (!write_block (dir, idx, b))
+              return false;
+            h->entry_cnt++;
+            return true;
+          }
+      if (b->next == 0)
+        break;
+      idx = b->next;
+    }
+
+  /* Every block in the chain is full: append an overflow
+     block. */
+  new_idx = h->block_cnt;
+  memset (b, 0, sizeof *b);
+  b->entries[0] = *e;
+  if (!write_block (dir, new_idx, b)
+      || inode_write_at (dir->inode, &new_idx, sizeof new_idx,
+                         idx * BLOCK_SECTOR_SIZE) != sizeof new_idx)
+    return false;
+  h->block_cnt++;
+  h->entry_cnt++;
+  return true;
+}
+
+/* Splits the next bucket of hashed directory DIR with header H,
+   if the directory is fuller than 3/4 of its primary blocks,
+   using B and B2 as buffers.  Updates H but does not write it.
+   Returns true if successful. */
+static bool
+maybe_split (struct dir *dir, struct dir_header *h,
+             struct dir_block *b, struct dir_block *b2)
+{
+  uint32_t old_bucket, new_bucket, ofs, idx;
+  size_t seg, i;
+
+  if (h->entry_cnt * 4 <= bucket_cnt (h) * ENTRIES_PER_BLOCK * 3)
+    return true;
+
+  old_bucket = h->split;
+  new_bucket = bucket_cnt (h);
+  seg = segment_of (new_bucket, &ofs);
+  if (seg >= MAX_SEGMENTS)
+    return true;
+  if (ofs == 0 && !add_segment (dir, h, seg, b))
+    return false;
+
+  if (++h->split == BASE_BUCKETS << h->level)
+    {
+      h->level++;
+      h->split = 0;
+    }
+
+  /* Move the entries that now hash to the new bucket. */
+  for (idx = bucket_block (h, old_bucket); idx != 0; idx = b->next)
+    {
+      bool moved = false;
+
+      if (!read_block (dir, idx, b))
+        return false;
+      for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (e->in_use && bucket_of (h, e->name) == new_bucket)
+            {
+              if (!insert_hashed (dir, h, e, b2))
+                return false;
+              h->entry_cnt--;
+              e->in_use = false;
+              moved = true;
+            }
+        }
+      if (moved && !write_block (dir, idx, b))
+        return false;
+    }
+  return true;
+}
+
+/* Adds E to hashed directory DIR with header H.  Returns true if
+   successful. */
+static bool
+add_hashed (struct dir *dir, struct dir_header *h, const struct dir_entry *e)
+{
+  struct dir_block *b = malloc (2 * sizeof *b);
+  bool success = (b != NULL
+                  && insert_hashed (dir, h, e, b)
+                  && maybe_split (dir, h, b, b + 1)
+                  && write_header (dir, h));
+  free (b);
+  return success;
+}
+
+/* Rebuilds hashed directory DIR with header H from its live
+   entries if fewer than 1/COMPACT_RATIO of its slots hold one.
+   Updates and writes H.
+
+   A rebuilt directory needs at most about a third of that many
+   slots, so the next rebuild waits for many more removals.  Only
+   directories of up to COMPACT_MAX entries are rebuilt, so that
+   the blocks rewritten fit in one journal commit along with the
+   rest of the removal.  Those blocks all lie within the old
+   ones, so writing them fails only on a disk error. */
+static void
+maybe_compact (struct dir *dir, struct dir_header *h)
+{
+  size_t slots = (h->block_cnt - 1) * ENTRIES_PER_BLOCK;
+  struct dir_entry *entries = NULL;
+  struct dir_block *b = NULL;
+  size_t cnt = 0;
+  uint32_t idx;
+  size_t i;
+
+  if (h->entry_cnt * COMPACT_RATIO >= slots
+      || h->entry_cnt > COMPACT_MAX
+      || h->block_cnt <= 1 + 2 * BASE_BUCKETS
+      || inode_file_cnt (dir->inode) > 0)
+    return;
+
+  entries = malloc ((h->entry_cnt + 1) * sizeof *entries);
+  b = malloc (2 * sizeof *b);
+  if (entries == NULL || b == NULL)
+    goto done;
+
+  /* Gather the live entries, and give up if the header does not
+     count them right. */
+  for (idx = 1; idx < h->block_cnt; idx++)
+    {
+      if (!read_block (dir, idx, b))
+        goto done;
+      for (i = 0; i < ENTRIES_PER_BLOCK; i++)
+        if (b->entries[i].in_use)
+          {
+            if (cnt == h->entry_cnt)
+              goto done;
+            entries[cnt++] = b->entries[i];
+          }
+    }
+  if (cnt != h->entry_cnt)
+    goto done;
+
+  memset (h, 0, sizeof *h);
+  h->marker.inode_sector = DIR_HASH_MAGIC;
+  h->block_cnt = 1;
+  if (!add_segment (dir, h, 0, b))
+    goto done;
+  for (i = 0; i < cnt; i++)
+    if (!insert_hashed (dir, h, &entries[i], b)
+        || !maybe_split (dir, h, b, b + 1))
+      goto done;
+  write_header (dir, h);
+
+ done:
+  free (b);
+  free (entries);
+}
+
+/* Rewrites linear directory DIR in the hashed format, and stores
+   its new header in *H.  Returns true if successful.  On failure
+   the linear contents are put back. */
+static bool
+convert_to_hashed (struct dir *dir, struct dir_header *h)
+{
+  size_t cnt = inode_length (dir->inode) / sizeof (struct dir_entry);
+  off_t size = cnt * sizeof (struct dir_entry);
+  struct dir_entry *entries = malloc (size);
+  struct dir_block *b = malloc (2 * sizeof *b);
+  bool success = false;
+  size_t i;
+
+  if (entries == NULL || b == NULL
+      || inode_read_at (dir->inode, entries, size, 0) != size)
+    goto done;
+
+  memset (h, 0, sizeof *h);
+  h->marker.inode_sector = DIR_HASH_MAGIC;
+  h->block_cnt = 1;
+  if (!add_segment (dir, h, 0, b))
+    goto restore;
+  for (i = 0; i < cnt; i++)
+    if (entries[i].in_use
+        && (!insert_hashed (dir, h, &entries[i], b)
+            || !maybe_split (dir, h, b, b + 1)))
+      goto restore;
+  success = write_header (dir, h);
+
+ restore:
+  if (!success)
+    inode_write_at (dir->inode, entries, size, 0);
+ done:
+  free (b);
+  free (entries);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +548,21 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    {
+      struct dir_block *b = malloc (sizeof *b);
+      bool found = b != NULL && lookup_hashed (dir, &h, name, ep, ofsp, b);
+      free (b);
+      return found;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -111,6 +576,49 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Does the work of dir_lookup().  DIR must be locked. */
+static bool
+lookup_name (const struct dir *dir, const char *name, struct inode **inode)
+{
+  block_sector_t dir_sector, sector;
+  struct dir_entry e;
+
+  /* A removed directory has no entries, not even "." and "..".
+     (Checking this first also keeps the dentry cache from
+     answering for a sector that may have been reused.) */
+  *inode = NULL;
+  if (inode_is_removed (dir->inode))
+    return false;
+
+  dir_sector = inode_get_inumber (dir->inode);
+  switch (dcache_lookup (dir_sector, name, &sector))
+    {
+    case DCACHE_HIT:
+      *inode = inode_open (sector);
+      return *inode != NULL;
+
+    case DCACHE_NEGATIVE:
+      *inode = NULL;
+      return false;
+
+    case DCACHE_MISS:
+      break;
+    }
+
+  if (lookup (dir, name, &e, NULL))
+    {
+      dcache_insert (dir_sector, name, e.inode_sector);
+      *inode = inode_open (e.inode_sector);
+    }
+  else
+    {
+      dcache_insert_negative (dir_sector, name);
+      *inode = NULL;
+    }
+
+  return *inode != NULL;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -119,43 +627,45 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  bool found;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
-
-  return *inode != NULL;
+  inode_lock_shared (dir->inode);
+  found = lookup_name (dir, name, inode);
+  inode_unlock_shared (dir->inode);
+  return found;
 }
 
-/* Adds a file named NAME to DIR, which must not already contain a
-   file by that name.  The file's inode is in sector
-   INODE_SECTOR.
-   Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
-bool
-dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+/* Does the work of dir_add() for a valid NAME.  DIR must be
+   locked exclusively. */
+static bool
+add_entry (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
 
-  ASSERT (dir != NULL);
-  ASSERT (name != NULL);
-
-  /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (inode_is_removed (dir->inode))
     return false;
 
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  /* Fill in the new entry. */
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+
+  if (read_header (dir, &h))
+    {
+      success = add_hashed (dir, &h, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -163,36 +673,92 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  for (ofs = inode_free_hint (dir->inode); ; ofs += sizeof e)
+    {
+      struct dir_entry slot;
+      if (inode_read_at (dir->inode, &slot, sizeof slot, ofs) != sizeof slot
+          || !slot.in_use)
+        break;
+    }
+
+  /* A full directory that is already at the size limit for the
+     linear format switches to the hashed one, if it can. */
+  if (ofs >= DIR_LINEAR_MAX * (off_t) sizeof e && convert_to_hashed (dir, &h))
+    {
+      success = add_hashed (dir, &h, &e);
+      goto done;
+    }
 
   /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    inode_set_free_hint (dir->inode, ofs + sizeof e);
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  else
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
   return success;
 }
 
-/* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+/* Adds a file named NAME to DIR, which must not already contain a
+   file by that name.  The file's inode is in sector
+   INODE_SECTOR.
+   Returns true if successful, false on failure.
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
-dir_remove (struct dir *dir, const char *name) 
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  bool success;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  /* Check NAME for validity. */
+  if (*name == '\0' || strlen (name) > NAME_MAX)
+    return false;
+
+  inode_lock (dir->inode);
+  success = add_entry (dir, name, inode_sector);
+  inode_unlock (dir->inode);
+  return success;
+}
+
+static bool next_entry (struct dir *, char name[NAME_MAX + 1]);
+
+/* Returns true if the directory INODE has no entries other than
+   "." and "..".  INODE must be locked. */
+static bool
+is_empty (struct inode *inode)
 {
+  struct dir *dir = dir_open (inode_reopen (inode));
+  char name[NAME_MAX + 1];
+  bool empty;
+
+  if (dir == NULL)
+    return false;
+  empty = !next_entry (dir, name);
+  dir_close (dir);
+  return empty;
+}
+
+/* Does the work of dir_remove().  DIR must be locked
+   exclusively. */
+static bool
+remove_entry (struct dir *dir, const char *name)
+{
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool locked = false;
   bool success = false;
   off_t ofs;
 
-  ASSERT (dir != NULL);
-  ASSERT (name != NULL);
-
   /* Find directory entry. */
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    goto done;
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -200,33 +766,88 @@ dir_remove (struct dir *dir, const char *name)
   inode = inode_open (e.inode_sector);
   if (inode == NULL)
     goto done;
+  if (inode_is_dir (inode))
+    {
+      inode_lock (inode);
+      locked = true;
+      if (!is_empty (inode))
+        goto done;
+    }
 
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_insert_negative (inode_get_inumber (dir->inode), name);
+  if (read_header (dir, &h))
+    {
+      h.entry_cnt--;
+      if (write_header (dir, &h))
+        maybe_compact (dir, &h);
+    }
+  else if (ofs < inode_free_hint (dir->inode))
+    inode_set_free_hint (dir->inode, ofs);
 
-  /* Remove inode. */
+  /* Remove inode.  Whatever is cached about names in a removed
+     directory must go, since its sector may be reused. */
   inode_remove (inode);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (e.inode_sector);
   success = true;
 
  done:
+  if (locked)
+    inode_unlock (inode);
   inode_close (inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Removes any entry for NAME in DIR.
+   Returns true if successful, false on failure,
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if NAME is a directory that is not empty.
+   A removed directory that is still open, for example as some
+   process's working directory, stays usable only for closing. */
 bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+dir_remove (struct dir *dir, const char *name) 
 {
+  bool success;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  inode_lock (dir->inode);
+  success = remove_entry (dir, name);
+  inode_unlock (dir->inode);
+  return success;
+}
+
+/* Does the work of dir_readdir().  DIR must be locked. */
+static bool
+next_entry (struct dir *dir, char name[NAME_MAX + 1])
+{
+  struct dir_header h;
   struct dir_entry e;
+  off_t end = inode_length (dir->inode);
+  bool hashed = read_header (dir, &h);
+
+  if (hashed)
+    {
+      /* Visit the entries of blocks 1 onward in file order. */
+      end = h.block_cnt * BLOCK_SECTOR_SIZE;
+      if (dir->pos < entry_ofs (1, 0))
+        dir->pos = entry_ofs (1, 0);
+    }
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while (dir->pos < end
+         && inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (hashed
+          && dir->pos == entry_ofs (dir->pos / BLOCK_SECTOR_SIZE,
+                                    ENTRIES_PER_BLOCK))
+        dir->pos = entry_ofs (dir->pos / BLOCK_SECTOR_SIZE + 1, 0);
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +855,118 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries.  "." and ".." are skipped. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool found;
+
+  inode_lock_shared (dir->inode);
+  found = next_entry (dir, name);
+  inode_unlock_shared (dir->inode);
+  return found;
+}
+
+/* Reads up to CNT of the next entries in DIR into ENTS, skipping
+   "." and "..", and returns the number read, which is less than
+   CNT only at the end of the directory.  Returns -1 if memory is
+   short.
+
+   Unlike dir_readdir(), which reads one struct dir_entry at a
+   time, this reads a block's worth of entries per inode_read_at()
+   call. */
+int
+dir_readdir_many (struct dir *dir, struct dirent ents[], size_t cnt)
+{
+  struct dir_header h;
+  struct dir_block *b;
+  off_t end;
+  bool hashed;
+  size_t n = 0;
+
+  ASSERT (sizeof ents->name == sizeof b->entries->name);
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return -1;
+
+  inode_lock_shared (dir->inode);
+  end = inode_length (dir->inode);
+  hashed = read_header (dir, &h);
+  if (hashed)
+    {
+      end = h.block_cnt * BLOCK_SECTOR_SIZE;
+      if (dir->pos < entry_ofs (1, 0))
+        dir->pos = entry_ofs (1, 0);
+    }
+
+  while (n < cnt && dir->pos < end)
+    {
+      off_t base;
+      size_t i, per_block;
+
+      /* Read the rest of the block that holds DIR->POS.  A
+         linear directory has no blocks, so read as many entries
+         as fit in one. */
+      if (hashed)
+        {
+          uint32_t idx = dir->pos / BLOCK_SECTOR_SIZE;
+
+          if (!read_block (dir, idx, b))
+            break;
+          base = entry_ofs (idx, 0);
+          i = (dir->pos - base) / sizeof *b->entries;
+          per_block = ENTRIES_PER_BLOCK;
+        }
+      else
+        {
+          base = dir->pos;
+          i = 0;
+          per_block = (inode_read_at (dir->inode, b->entries,
+                                      sizeof b->entries, base)
+                       / sizeof *b->entries);
+          if (per_block == 0)
+            break;
+        }
+
+      for (; i < per_block && n < cnt; i++)
+        {
+          const struct dir_entry *e = &b->entries[i];
+          if (e->in_use && strcmp (e->name, ".") && strcmp (e->name, ".."))
+            {
+              ents[n].inumber = e->inode_sector;
+              strlcpy (ents[n].name, e->name, sizeof ents[n].name);
+              n++;
+            }
+        }
+
+      dir->pos = base + i * sizeof *b->entries;
+      if (hashed && i == per_block)
+        dir->pos = entry_ofs (dir->pos / BLOCK_SECTOR_SIZE + 1, 0);
+    }
+  inode_unlock_shared (dir->inode);
+
+  free (b);
+  return n;
+}
+
+/* Sets the position of the next dir_readdir() on DIR to POS, as
+   previously returned by dir_tell(), or to 0 to start over. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position of the next dir_readdir() on DIR. */
+off_t
+dir_tell (const struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
+}
@@ -1,65 +1,234 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <madvise.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "threads/palloc.h"
+#include "threads/refcount.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 
-/* An open file. */
+/* An open file, or an end of a pipe, for which INODE is null
+   and reads and writes go to PIPE instead.  A file descriptor
+   holds one reference, and a system call using the file through
+   it holds another until it is done, so that closing the
+   descriptor meanwhile does not free the file under it. */
 struct file 
   {
+    struct refcount ref_cnt;    /* References; see file_get(). */
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct pipe *pipe;          /* Pipe this is an end of, or null. */
+    bool pipe_writer;           /* Write end of PIPE? */
+    bool direct;                /* Bypass the buffer cache? */
+    int advice;                 /* MADV_* access hint. */
+
+    /* Read-ahead; see read_ahead(). */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of data already read ahead. */
+    off_t ra_window;            /* Bytes to keep read ahead, 0 if none. */
   };
 
+/* Bounds on the read-ahead window, in bytes.  The buffer cache
+   holds only a few dozen sectors, so reading further ahead would
+   just evict what was read ahead before it is used. */
+unsigned file_ra_max = 16;      /* Upper bound in sectors, tunable. */
+#define RA_MIN (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX ((off_t) file_ra_max * BLOCK_SECTOR_SIZE)
+
+/* Cache of struct file. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void)
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
+      refcount_init (&file->ref_cnt, 1);
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->pipe = NULL;
+      file->direct = false;
+      file->advice = MADV_NORMAL;
+      file->ra_next = file->ra_end = file->ra_window = 0;
+      inode_file_opened (inode);
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
-   Returns a null pointer if unsuccessful. */
+/* Opens a file for the read end of pipe P, or for its write end
+   if WRITER is true, taking over a reader or writer already
+   counted in P.  Returns a null pointer if an allocation fails,
+   in which case the caller remains responsible for that count. */
+struct file *
+file_open_pipe (struct pipe *p, bool writer)
+{
+  struct file *file = kmem_cache_alloc (file_cache);
+  if (file != NULL)
+    {
+      refcount_init (&file->ref_cnt, 1);
+      file->inode = NULL;
+      file->pos = 0;
+      file->deny_write = false;
+      file->pipe = p;
+      file->pipe_writer = writer;
+      file->direct = false;
+      file->advice = MADV_NORMAL;
+      file->ra_next = file->ra_end = file->ra_window = 0;
+    }
+  return file;
+}
+
+/* Opens and returns a new file for the same inode as FILE, or
+   for the same end of the same pipe.  Returns a null pointer if
+   unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
-  return file_open (inode_reopen (file->inode));
+  struct file *new;
+
+  if (file->pipe == NULL)
+    return file_open (inode_reopen (file->inode));
+
+  pipe_open (file->pipe, file->pipe_writer);
+  new = file_open_pipe (file->pipe, file->pipe_writer);
+  if (new == NULL)
+    pipe_close (file->pipe, file->pipe_writer);
+  return new;
 }
 
-/* Closes FILE. */
+/* Adds a reference to FILE, of which the caller must already
+   hold one or keep it from being closed, and returns FILE.
+   file_close() drops it. */
+struct file *
+file_get (struct file *file)
+{
+  refcount_get (&file->ref_cnt);
+  return file;
+}
+
+/* Drops a reference to FILE, and closes FILE if it was the last
+   one. */
 void
 file_close (struct file *file) 
 {
-  if (file != NULL)
+  if (file != NULL && refcount_put (&file->ref_cnt))
     {
-      file_allow_write (file);
-      inode_close (file->inode);
-      free (file); 
+      if (file->pipe != NULL)
+        pipe_close (file->pipe, file->pipe_writer);
+      else
+        {
+          file_allow_write (file);
+          inode_file_closed (file->inode);
+          inode_close (file->inode);
+        }
+      kmem_cache_free (file_cache, file);
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is an end of a pipe. */
 struct inode *
 file_get_inode (struct file *file) 
 {
   return file->inode;
 }
 
+/* Returns the pipe that FILE is the write end of, if WRITER is
+   true, or the read end of, if it is false, or a null pointer if
+   FILE is no such thing. */
+struct pipe *
+file_get_pipe (struct file *file, bool writer)
+{
+  return file->pipe != NULL && file->pipe_writer == writer ? file->pipe : NULL;
+}
+
+/* Called after BYTES_READ bytes have been read from FILE at OFS.
+   While FILE is read sequentially, each read starting where the
+   last one ended, keeps the data just past the read on its way
+   into the buffer cache in the background.  The amount kept read
+   ahead starts at RA_MIN and doubles with each sequential read up
+   to RA_MAX; a read anywhere else drops it to nothing until
+   sequential reading resumes.  Data already read ahead is not
+   asked for again.  A file advised MADV_SEQUENTIAL is always
+   read RA_MAX ahead, one advised MADV_RANDOM never. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  off_t start;
+
+  if (bytes_read <= 0)
+    return;
+  if (file->advice == MADV_SEQUENTIAL)
+    {
+      if (ofs != file->ra_next)
+        file->ra_end = ofs;
+      file->ra_window = RA_MAX;
+    }
+  else if (ofs != file->ra_next || file->advice == MADV_RANDOM)
+    {
+      file->ra_window = 0;
+      file->ra_next = ofs + bytes_read;
+      return;
+    }
+  else if (file->ra_window == 0)
+    file->ra_window = RA_MIN;
+  else if (file->ra_window < RA_MAX)
+    file->ra_window *= 2;
+  file->ra_next = ofs + bytes_read;
+
+  start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+  if (start < file->ra_next + file->ra_window)
+    {
+      file->ra_end = file->ra_next + file->ra_window;
+      inode_readahead (file->inode, start, file->ra_end - start);
+    }
+}
+
+/* Reads SIZE bytes from the inode of FILE into BUFFER, starting
+   at OFS, in FILE's mode, and returns the number of bytes read. */
+static off_t
+read_inode (struct file *file, void *buffer, off_t size, off_t ofs)
+{
+  off_t bytes_read;
+
+  if (file->direct || file->advice == MADV_DONTNEED)
+    return inode_read_direct (file->inode, buffer, size, ofs);
+  bytes_read = inode_read_at (file->inode, buffer, size, ofs);
+  read_ahead (file, ofs, bytes_read);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into the inode of FILE, starting
+   at OFS, in FILE's mode, and returns the number of bytes
+   written. */
+static off_t
+write_inode (struct file *file, const void *buffer, off_t size, off_t ofs)
+{
+  if (file->direct || file->advice == MADV_DONTNEED)
+    return inode_write_direct (file->inode, buffer, size, ofs);
+  return inode_write_at (file->inode, buffer, size, ofs);
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -68,7 +237,11 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? 0 : pipe_read (file->pipe, buffer, size, true);
+  bytes_read = read_inode (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -77,11 +250,14 @@ file_read (struct file *file, void *buffer, off_t size)
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   A pipe has no offsets, so this is file_read() for one. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  if (file->pipe != NULL)
+    return file_read (file, buffer, size);
+  return read_inode (file, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,7 +270,11 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? pipe_write (file->pipe, buffer, size) : 0;
+  bytes_written = write_inode (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -105,12 +285,148 @@ file_write (struct file *file, const void *buffer, off_t size)
    which may be less than SIZE if end of file is reached.
    (Normally we'd grow the file in that case, but file growth is
    not yet implemented.)
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   A pipe has no offsets, so this is file_write() for one. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  if (file->pipe != NULL)
+    return file_write (file, buffer, size);
+  return write_inode (file, buffer, size, file_ofs);
+}
+
+/* Reads from FILE into the CNT buffers of IOV in turn, as one
+   transfer starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than the buffers' total size if end of file
+   is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, size_t cnt) 
+{
+  off_t bytes_read = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      off_t n = file_read_at (file, iov[i].iov_base, iov[i].iov_len,
+                              file->pos + bytes_read);
+      bytes_read += n;
+      if (n < (off_t) iov[i].iov_len)
+        break;
+    }
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the CNT buffers of IOV in turn into FILE, as one
+   transfer starting at the file's current position.
+   Returns the number of bytes actually written,
+   which may be less than the buffers' total size if the write
+   is cut short.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, size_t cnt) 
+{
+  off_t bytes_written = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      off_t n = file_write_at (file, iov[i].iov_base, iov[i].iov_len,
+                               file->pos + bytes_written);
+      bytes_written += n;
+      if (n < (off_t) iov[i].iov_len)
+        break;
+    }
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, into DST, starting at its current position, through
+   a kernel buffer a page at a time.  Returns the number of bytes
+   copied, which may be less than SIZE if end of SRC is reached
+   or a write is cut short, or if memory for the buffer is
+   short.  Advances both files' positions by the number of bytes
+   copied. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size) 
+{
+  uint8_t *buffer = palloc_get_page (0);
+  off_t bytes_copied = 0;
+
+  if (buffer == NULL)
+    return 0;
+  while (bytes_copied < size)
+    {
+      off_t left = size - bytes_copied;
+      off_t chunk = left < PGSIZE ? left : PGSIZE;
+      off_t bytes_read, bytes_written;
+
+      /* Data read from a pipe cannot be put back, so if the
+         write is cut short, the rest is lost. */
+      bytes_read = file_read_at (src, buffer, chunk, src->pos);
+      bytes_written = file_write_at (dst, buffer, bytes_read, dst->pos);
+      if (src->pipe == NULL)
+        src->pos += bytes_written;
+      if (dst->pipe == NULL)
+        dst->pos += bytes_written;
+      bytes_copied += bytes_written;
+      if (bytes_written < chunk)
+        break;
+    }
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
+/* Makes reads and writes of FILE bypass the buffer cache as far
+   as possible if DIRECT is true, or go through it again if it is
+   false.  Direct I/O suits large transfers that are made once,
+   such as copying a big file, which would otherwise evict data
+   that other processes still use.  It makes no difference to a
+   pipe. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
+/* Applies access hint ADVICE, one of the MADV_* values, to FILE.
+   MADV_WILLNEED starts reading RA_MAX bytes from FILE's position
+   into the buffer cache in the background.  The other hints set
+   how FILE is read from now on, replacing any earlier one: with
+   MADV_SEQUENTIAL or MADV_RANDOM, read_ahead() always or never
+   reads ahead, and with MADV_DONTNEED, FILE's data bypasses the
+   buffer cache as with file_set_direct().  Returns false if
+   ADVICE is invalid.  It makes no difference to a pipe. */
+bool
+file_advise (struct file *file, int advice)
+{
+  ASSERT (file != NULL);
+
+  if (advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    return false;
+  if (advice != MADV_WILLNEED)
+    file->advice = advice;
+  else if (file->pipe == NULL)
+    inode_readahead (file->inode, file->pos, RA_MAX);
+  return true;
+}
+
+/* Starts reading the SIZE bytes of FILE at OFS, but no more than
+   RA_MAX of them, into the buffer cache in the background, as
+   MADV_WILLNEED does at FILE's position.  It makes no difference
+   to a pipe. */
+void
+file_prefetch (struct file *file, off_t ofs, off_t size)
+{
+  ASSERT (file != NULL);
+
+  if (file->pipe == NULL)
+    inode_readahead (file->inode, ofs, size < RA_MAX ? size : RA_MAX);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -140,12 +456,12 @@ file_allow_write (struct file *file)
     }
 }
 
-/* Returns the size of FILE in bytes. */
+/* Returns the size of FILE in bytes, or 0 for a pipe. */
 off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
-  return inode_length (file->inode);
+  return file->pipe == NULL ? inode_length (file->inode) : 0;
 }
 
 /* Sets the current position in FILE to NEW_POS bytes from the
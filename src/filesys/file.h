@@ -1,21 +1,39 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <iovec.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct pipe;
+
+/* Most sectors read ahead of a sequential reader. */
+extern unsigned file_ra_max;
+
+void file_init (void);
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
+struct file *file_open_pipe (struct pipe *, bool writer);
 struct file *file_reopen (struct file *);
+struct file *file_get (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
+struct pipe *file_get_pipe (struct file *, bool writer);
 
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, size_t cnt);
+off_t file_writev (struct file *, const struct iovec *, size_t cnt);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+void file_set_direct (struct file *, bool);
+bool file_advise (struct file *, int advice);
+void file_prefetch (struct file *, off_t ofs, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,10 +2,13 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,13 +24,20 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  journal_init ();
   inode_init ();
+  dir_init ();
+  file_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
+  else
+    journal_recover ();
 
   free_map_open ();
+  cache_hot_prefetch ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -36,8 +46,134 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_commit ();
+  cache_done ();
+  block_flush (fs_device);
+  cache_print_stats ();
 }
 
+/* Opens and returns the current thread's working directory, or
+   the root directory if it has none.  Returns a null pointer on
+   failure. */
+static struct dir *
+open_cwd (void)
+{
+  struct dir *cwd = thread_current ()->cwd;
+
+  return cwd != NULL ? dir_reopen (cwd) : dir_open_root ();
+}
+
+/* Resolves PATH up to its last component.  On success, opens the
+   directory that should contain the last component and stores it
+   in *DIRP, which the caller must close, copies the last
+   component into NAME, and returns true.  A PATH that ends in
+   the directory itself, such as "/", names "." within it.
+
+   An absolute PATH is looked up from the root directory, any
+   other from the current thread's working directory.  Returns
+   false if PATH is empty, if a component is longer than
+   NAME_MAX, or if a component before the last is not an existing
+   directory. */
+static bool
+resolve (const char *path, struct dir **dirp, char name[NAME_MAX + 1])
+{
+  struct dir *dir;
+  const char *p = path;
+
+  if (*p == '\0')
+    return false;
+  dir = *p == '/' ? dir_open_root () : open_cwd ();
+  if (dir == NULL)
+    return false;
+
+  for (;;)
+    {
+      struct inode *inode;
+      const char *start;
+      size_t len;
+
+      /* Copy the next component into NAME. */
+      while (*p == '/')
+        p++;
+      for (start = p; *p != '\0' && *p != '/'; p++)
+        continue;
+      len = p - start;
+      if (len > NAME_MAX)
+        {
+          dir_close (dir);
+          return false;
+        }
+      memcpy (name, start, len);
+      name[len] = '\0';
+
+      /* Stop at the last component. */
+      while (*p == '/')
+        p++;
+      if (*p == '\0')
+        break;
+
+      /* Descend into this one. */
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return false;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return false;
+    }
+
+  if (name[0] == '\0')
+    strlcpy (name, ".", NAME_MAX + 1);
+  *dirp = dir;
+  return true;
+}
+
+/* Creates a file or, if IS_DIR is true, a directory named PATH.
+   A file gets INITIAL_SIZE bytes.  Returns true if successful,
+   false otherwise. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
+{
+  block_sector_t inode_sector = 0, parent, goal;
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool success = false;
+
+  if (!resolve (path, &dir, name))
+    return false;
+  journal_begin ();
+  parent = inode_get_inumber (dir_get_inode (dir));
+  goal = is_dir ? free_map_dir_goal (parent) : parent + 1;
+  if (free_map_allocate (1, goal, &inode_sector))
+    {
+      bool created = (is_dir
+                      ? dir_create (inode_sector, 16, parent)
+                      : inode_create (inode_sector, initial_size, false));
+
+      success = created && dir_add (dir, name, inode_sector);
+      if (!success)
+        {
+          /* Removing the inode releases its sector along with any
+             data it was given. */
+          struct inode *inode = created ? inode_open (inode_sector) : NULL;
+          if (inode != NULL)
+            {
+              inode_remove (inode);
+              inode_close (inode);
+            }
+          else
+            free_map_release (inode_sector, 1);
+        }
+    }
+  journal_end ();
+  dir_close (dir);
+
+  return success;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -45,17 +181,17 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
 }
 
 /* Opens the file with the given NAME.
@@ -66,12 +202,15 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir;
   struct inode *inode = NULL;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+  if (resolve (name, &dir, base))
+    {
+      dir_lookup (dir, base, &inode);
+      dir_close (dir);
+    }
 
   return file_open (inode);
 }
@@ -83,20 +222,58 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  if (!resolve (name, &dir, base))
+    return false;
+  journal_begin ();
+  success = dir_remove (dir, base);
+  journal_end ();
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Makes the directory named NAME the current thread's working
+   directory.  Returns true if successful, false if NAME is not
+   an existing directory. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char base[NAME_MAX + 1];
+  struct inode *inode = NULL;
+  struct dir *dir;
+
+  if (!resolve (name, &dir, base))
+    return false;
+  dir_lookup (dir, base, &inode);
+  dir_close (dir);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_format ();
+  cache_hot_format ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,52 +1,281 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Free map bits per sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Block groups.  The disk is divided into groups of GROUP_SECTORS
+   consecutive sectors, each described by one sector of the free
+   map file, and group_free[] counts the free sectors in each.
+   Allocation takes a goal sector and looks first in the goal's
+   group, from the goal onward, then in the following groups,
+   skipping any without enough free sectors, so that a file's
+   sectors land near each other and near its inode, and files
+   land near their directory.  The counts are derived from the
+   free map and never written to disk. */
+#define GROUP_SECTORS BITS_PER_SECTOR
+
+static size_t *group_free;           /* Free sectors in each group. */
+static size_t group_cnt;             /* Number of groups. */
+
+/* Sectors of the free map file that are out of date, one bit per
+   BITS_PER_SECTOR bits of free_map.  Changes to the free map only
+   mark their sectors here; free_map_flush() writes the marked
+   ones, in runs, at each journal commit and when the free map is
+   closed.  The free map file is metadata, so its sectors join the
+   same commit as the changes that depend on them. */
+static struct bitmap *dirty_sectors;
+
+/* Protects free_map, group_free and dirty_sectors. */
+static struct lock free_map_lock;
+
+/* Marks the free map sectors holding the CNT bits starting at
+   SECTOR as out of date.  free_map_lock must be held. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  if (free_map_file != NULL)
+    bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
+}
+
+/* Returns the first sector of group G. */
+static block_sector_t
+group_start (size_t g)
+{
+  return g * GROUP_SECTORS;
+}
+
+/* Returns the sector just past the end of group G. */
+static block_sector_t
+group_end (size_t g)
+{
+  size_t end = (g + 1) * GROUP_SECTORS;
+  return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
+}
+
+/* Recomputes every group's free count from the free map. */
+static void
+count_groups (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    group_free[g] = bitmap_count (free_map, group_start (g),
+                                  group_end (g) - group_start (g), false);
+}
+
+/* Adds DELTA times the number of sectors among the CNT starting
+   at SECTOR that fall in each group to that group's free count.
+   free_map_lock must be held. */
+static void
+adjust_groups (block_sector_t sector, size_t cnt, int delta)
+{
+  while (cnt > 0)
+    {
+      size_t g = sector / GROUP_SECTORS;
+      size_t n = group_end (g) - sector;
+
+      if (n > cnt)
+        n = cnt;
+      group_free[g] += delta * (int) n;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns the first sector of a run of CNT free sectors that lies
+   within [START, END), or BITMAP_ERROR if there is none.
+   free_map_lock must be held. */
+static size_t
+scan_range (size_t start, size_t end, size_t cnt)
+{
+  size_t sector = bitmap_scan (free_map, start, cnt, false);
+  return sector != BITMAP_ERROR && sector + cnt <= end ? sector : BITMAP_ERROR;
+}
+
+/* Returns the first sector of a run of CNT free sectors, chosen to
+   be as close after GOAL as block groups allow, or BITMAP_ERROR
+   if there is none.  free_map_lock must be held. */
+static size_t
+scan_near (size_t cnt, block_sector_t goal)
+{
+  size_t first, i;
+
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  first = goal / GROUP_SECTORS;
+
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t g = (first + i) % group_cnt;
+      size_t sector;
+
+      if (group_free[g] < cnt)
+        continue;
+      if (i == 0)
+        {
+          sector = scan_range (goal, group_end (g), cnt);
+          if (sector != BITMAP_ERROR)
+            return sector;
+        }
+      sector = scan_range (group_start (g), group_end (g), cnt);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+
+  /* Only a run that crosses groups will do. */
+  return bitmap_scan (free_map, 0, cnt, false);
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (block_size (fs_device),
+                                               BITS_PER_SECTOR));
+  group_cnt = DIV_ROUND_UP (block_size (fs_device), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (free_map == NULL || dirty_sectors == NULL || group_free == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  bitmap_mark (free_map, CACHE_HOT_SECTOR);
+  count_groups ();
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, as close
+   after sector GOAL as possible, and stores the first into
+   *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_near (cnt, goal);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      adjust_groups (sector, cnt, -1);
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates SECTOR itself, if it exists and is free, so that a
+   run of sectors can be extended in place.  Returns true if
+   successful, false otherwise. */
+bool
+free_map_allocate_at (block_sector_t sector)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = sector < bitmap_size (free_map) && !bitmap_test (free_map, sector);
+  if (success)
+    {
+      bitmap_mark (free_map, sector);
+      adjust_groups (sector, 1, -1);
+      mark_dirty (sector, 1);
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  adjust_groups (sector, cnt, 1);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Returns a goal sector for a new directory whose parent's inode
+   is in sector PARENT.  It stays in its parent's group unless
+   that group has less free space than the average, in which case
+   it goes to the group with the most free space, so that
+   subtrees spread out over the disk and each has room to grow
+   near its directory. */
+block_sector_t
+free_map_dir_goal (block_sector_t parent)
+{
+  size_t total = 0, best = 0;
+  size_t g;
+
+  lock_acquire (&free_map_lock);
+  for (g = 0; g < group_cnt; g++)
+    {
+      total += group_free[g];
+      if (group_free[g] > group_free[best])
+        best = g;
+    }
+  g = parent / GROUP_SECTORS;
+  if (g < group_cnt && group_free[g] * group_cnt >= total)
+    best = g;
+  lock_release (&free_map_lock);
+
+  return best == g ? parent : group_start (best);
+}
+
+/* Writes the out-of-date sectors of the free map file, each run
+   of adjacent ones with a single write. */
+void
+free_map_flush (void)
+{
+  size_t start = 0;
+
+  if (free_map_file == NULL)
+    return;
+
+  journal_begin ();
+  lock_acquire (&free_map_lock);
+  while ((start = bitmap_scan (dirty_sectors, start, 1, true))
+         != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (dirty_sectors, start, 1, false);
+      size_t first_bit, last_bit;
+
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (dirty_sectors);
+      first_bit = start * BITS_PER_SECTOR;
+      last_bit = end * BITS_PER_SECTOR;
+      if (last_bit > bitmap_size (free_map))
+        last_bit = bitmap_size (free_map);
+
+      if (!bitmap_write_range (free_map, free_map_file,
+                               first_bit, last_bit - first_bit))
+        PANIC ("can't write free map");
+      bitmap_set_multiple (dirty_sectors, start, end - start, false);
+      start = end;
+    }
+  lock_release (&free_map_lock);
+  journal_end ();
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +287,22 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
+
+  /* New files use the layout chosen when the disk was formatted. */
+  inode_set_default_layout (inode_get_layout (file_get_inode (free_map_file)));
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
-  file_close (free_map_file);
+  struct file *file;
+
+  free_map_flush ();
+  file = free_map_file;
+  free_map_file = NULL;
+  file_close (file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,14 +310,22 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The first write allocates the file's
+     sectors, which must not recurse into writing the free map, so
+     it happens before free_map_file is set.  The second one then
+     records those allocations. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  free_map_file = file;
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
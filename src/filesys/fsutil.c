@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,25 +68,63 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Pages of scratch device read by fsutil_extract() at a time. */
+#define EXTRACT_PAGES 8
+#define EXTRACT_SECTORS (EXTRACT_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Sectors of the scratch device read ahead by fsutil_extract(). */
+struct extract_buf
+  {
+    struct block *src;          /* Scratch device. */
+    char *data;                 /* EXTRACT_SECTORS sectors. */
+    block_sector_t first;       /* First sector in DATA. */
+    size_t cnt;                 /* Number of sectors in DATA. */
+  };
+
+/* Returns the buffered data for SECTOR and stores in *CNT the
+   number of consecutive sectors, starting at SECTOR, that the
+   buffer holds.  If SECTOR is not buffered, first refills the
+   buffer with as many sectors as fit, starting from SECTOR, in a
+   single read. */
+static char *
+extract_sectors (struct extract_buf *b, block_sector_t sector, size_t *cnt)
+{
+  if (sector < b->first || sector >= b->first + b->cnt)
+    {
+      block_sector_t size = block_size (b->src);
+
+      if (sector >= size)
+        PANIC ("ustar archive runs past end of scratch device");
+      b->first = sector;
+      b->cnt = size - sector < EXTRACT_SECTORS
+                ? size - sector : EXTRACT_SECTORS;
+      block_read_multiple (b->src, b->first, b->cnt, b->data);
+    }
+  *cnt = b->first + b->cnt - sector;
+  return b->data + (sector - b->first) * BLOCK_SECTOR_SIZE;
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   The archive is read EXTRACT_SECTORS at a time.  Headers are
+   parsed in place in the buffer, and each file body is written
+   with one file_write() per buffer's worth of data. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
-  struct block *src;
-  void *header, *data;
+  struct extract_buf b;
 
-  /* Allocate buffers. */
-  header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+  /* Allocate buffer. */
+  b.data = palloc_get_multiple (PAL_ASSERT, EXTRACT_PAGES);
+  b.first = 0;
+  b.cnt = 0;
 
   /* Open source block device. */
-  src = block_get_role (BLOCK_SCRATCH);
-  if (src == NULL)
+  b.src = block_get_role (BLOCK_SCRATCH);
+  if (b.src == NULL)
     PANIC ("couldn't open scratch device");
 
   printf ("Extracting ustar archive from scratch device "
@@ -96,11 +135,12 @@ fsutil_extract (char **argv UNUSED)
       const char *file_name;
       const char *error;
       enum ustar_type type;
+      size_t cnt;
       int size;
 
       /* Read and parse ustar header. */
-      block_read (src, sector++, header);
-      error = ustar_parse_header (header, &file_name, &type, &size);
+      error = ustar_parse_header (extract_sectors (&b, sector++, &cnt),
+                                  &file_name, &type, &size);
       if (error != NULL)
         PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
 
@@ -113,27 +153,32 @@ fsutil_extract (char **argv UNUSED)
         printf ("ignoring directory %s\n", file_name);
       else if (type == USTAR_REGULAR)
         {
+          char name[100];       /* Longest ustar name, plus null. */
           struct file *dst;
 
-          printf ("Putting '%s' into the file system...\n", file_name);
+          /* The header may be overwritten by the file body, so
+             copy out the name. */
+          strlcpy (name, file_name, sizeof name);
+          printf ("Putting '%s' into the file system...\n", name);
 
           /* Create destination file. */
-          if (!filesys_create (file_name, size))
-            PANIC ("%s: create failed", file_name);
-          dst = filesys_open (file_name);
+          if (!filesys_create (name, size))
+            PANIC ("%s: create failed", name);
+          dst = filesys_open (name);
           if (dst == NULL)
-            PANIC ("%s: open failed", file_name);
+            PANIC ("%s: open failed", name);
 
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              char *data = extract_sectors (&b, sector, &cnt);
+              int chunk_size = (size > (int) (cnt * BLOCK_SECTOR_SIZE)
+                                ? (int) (cnt * BLOCK_SECTOR_SIZE)
                                 : size);
-              block_read (src, sector++, data);
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
-                       file_name, size);
+                       name, size);
+              sector += DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
               size -= chunk_size;
             }
 
@@ -147,12 +192,10 @@ fsutil_extract (char **argv UNUSED)
      two blocks because two blocks of zeros are the ustar
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
-  memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  memset (b.data, 0, 2 * BLOCK_SECTOR_SIZE);
+  block_write_multiple (b.src, 0, 2, b.data);
 
-  free (data);
-  free (header);
+  palloc_free_multiple (b.data, EXTRACT_PAGES);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch
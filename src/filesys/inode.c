@@ -1,76 +1,712 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/refcount.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector index layout (INODE_INDEXED).  An inode's data sectors
+   are found through DIRECT_CNT pointers held in the inode itself,
+   then one indirect block of PTRS_PER_SECTOR pointers, then one
+   doubly indirect block of pointers to indirect blocks.  A pointer
+   of 0 means the sector has not been allocated yet: it reads as
+   zeros and is allocated on first write.  (Sector 0 always holds
+   the free map inode, so it can never be a data sector.) */
+#define DIRECT_CNT 121
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define INDIRECT_LIMIT (DIRECT_CNT + PTRS_PER_SECTOR)
+#define DOUBLY_LIMIT (INDIRECT_LIMIT + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+struct inode_index
+  {
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
+  };
+
+/* Extent layout (INODE_EXTENTS).  The file's data is a sequence
+   of runs of consecutive sectors.  The first INLINE_EXTENTS runs
+   are kept in the inode, up to BLOCK_EXTENTS more in a single
+   extent block.  Growth extends the last run in place whenever
+   the following sector is free, so a file written sequentially
+   usually stays in one run.  Extent files have no holes: writing
+   past the end allocates every sector in between. */
+#define INLINE_EXTENTS 60
+#define BLOCK_EXTENTS (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (INLINE_EXTENTS + BLOCK_EXTENTS)
+
+struct extent
+  {
+    block_sector_t start;               /* First sector of the run. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+struct inode_extents
+  {
+    uint32_t cnt;                       /* Number of extents in use. */
+    struct extent inline_[INLINE_EXTENTS]; /* First extents. */
+    block_sector_t block;               /* Sector of further extents. */
+  };
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Only the first INIT_SECTORS data sectors of a file are known to
+   hold its data.  Sectors after them may be allocated, by
+   inode_reserve() or when an extent file grows, but still hold
+   whatever was on disk before, so they read as zeros without
+   being read, and are zeroed as needed when writes reach them.
+   This is what lets sectors be allocated without being zeroed
+   first.
+
+   An ordinary file of at most INLINE_MAX bytes keeps its data in
+   the inode itself, in place of the sector map, and so takes no
+   data sectors and is read along with its inode.  It moves to
+   sectors of its layout as soon as it grows larger; see
+   uninline().  Bytes of the inline data beyond the length are
+   always zero. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint16_t layout;                    /* enum inode_layout. */
+    uint16_t inline_data;               /* Nonzero if data is in MAP. */
+    union
+      {
+        struct inode_index index;       /* INODE_INDEXED. */
+        struct inode_extents extents;   /* INODE_EXTENTS. */
+        uint8_t data[sizeof (struct inode_index)]; /* Inline data. */
+      } map;
+    uint32_t is_dir;                    /* Nonzero for a directory. */
+    uint32_t init_sectors;              /* Data sectors initialized. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* Largest file kept inline. */
+#define INLINE_MAX ((off_t) sizeof ((struct inode_disk *) 0)->map.data)
+
+/* Most sectors read or written in one disk transfer. */
+#define MAX_RUN 64
+
+/* Bounds on the sectors allocated ahead of an append; see
+   preallocate(). */
+#define PREALLOC_MIN 8
+#define PREALLOC_MAX 64
+
+/* Layout given to newly created inodes. */
+static enum inode_layout default_layout = INODE_INDEXED;
+
+/* In-memory inode.
+
+   Locking: MAP_LOCK protects DATA, that is, the file's length,
+   initialized size and sector map.  Reads hold it for reading
+   throughout, so reads of the same file run in parallel.  Writes
+   hold it for reading to find the sectors they write, and for
+   writing only to allocate sectors or to extend the file.
+   USER_LOCK is not used here at all: it is for inode users such
+   as the directory code that must make a sequence of calls
+   atomic.  Sector allocation has its own lock, in free-map.c.
+   PAGES_LOCK protects PAGES, and WRITE_CNT, which changes under
+   it once a write's data is in PAGES; see inode_add_page().
+
+   PAGES holds the pages of the file that are mapped into memory,
+   in order of file offset.  inode_read_at() takes the data of
+   those pages from memory and inode_write_at() stores into them
+   as well as to disk, so that a read never misses the changes a
+   process has made through a mapping and a mapping never misses
+   a write.  Only the virtual memory system adds pages, and it
+   removes them again before their inode can be closed for the
+   last time.
 
-/* In-memory inode. */
+   Appends allocate sectors ahead of the data in runs, so that a
+   file grown by many small writes, even while other files grow
+   alongside it, still gets consecutive sectors; PREALLOC_END
+   counts the sectors so allocated.  Those past the end of file
+   are given back when the inode is closed for the last time. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct list_elem elem;              /* Element in open inode bucket. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    struct refcount open_cnt;           /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned write_cnt;                 /* Changes on every write. */
+    struct rwlock map_lock;             /* Protects length and sector map. */
+    struct rwlock user_lock;            /* See inode_lock(). */
+    struct rb_tree pages;               /* Mapped pages, by offset. */
+    struct lock pages_lock;             /* Protects PAGES, WRITE_CNT. */
+    size_t prealloc_end;                /* Sectors allocated ahead. */
+    struct refcount file_cnt;           /* Open struct files. */
+    off_t free_hint;                    /* See inode_free_hint(). */
     struct inode_disk data;             /* Inode content. */
+    struct rcu_head rcu;                /* For freeing after last close. */
   };
 
+static char zeros[BLOCK_SECTOR_SIZE];
+
+static bool extent_reserve (struct inode *, size_t cnt);
+static rb_less_func page_less;
+static struct inode_page *find_page (struct inode *, off_t ofs);
+static void write_pages (struct inode *, const uint8_t *, off_t size,
+                         off_t offset);
+
+/* Returns true if INODE's data is itself file system metadata,
+   and so must be written through the journal. */
+static bool
+is_meta (const struct inode *inode)
+{
+  return inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
+/* Returns true if INODE's data is kept in the inode itself. */
+static bool
+is_inline (const struct inode *inode)
+{
+  return inode->data.inline_data != 0;
+}
+
+/* Writes SIZE bytes from BUFFER into data sector SECTOR of INODE,
+   starting at byte OFS within the sector. */
+static void
+write_data (struct inode *inode, block_sector_t sector, const void *buffer,
+            off_t ofs, off_t size)
+{
+  if (is_meta (inode))
+    cache_write_meta (sector, buffer, ofs, size);
+  else
+    cache_write (sector, buffer, ofs, size);
+}
+
+/* Allocates a sector, as close after GOAL as possible, zeroes it
+   if ZERO is true, and stores its number in *SECTORP.  Returns
+   false if the disk is full. */
+static bool
+allocate (block_sector_t goal, bool zero, block_sector_t *sectorp)
+{
+  if (!free_map_allocate (1, goal, sectorp))
+    return false;
+  if (zero)
+    cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns pointer IDX of index block TABLE.  If it is 0 and
+   CREATE is true, allocates a sector for it first, near GOAL,
+   zeroed if ZERO is true.  Returns 0 if the pointer is
+   unallocated and is not (or cannot be) created. */
+static block_sector_t
+index_get (block_sector_t table, size_t idx, bool create,
+           block_sector_t goal, bool zero)
+{
+  block_sector_t sector;
+  off_t ofs = idx * sizeof sector;
+
+  cache_read (table, &sector, ofs, sizeof sector);
+  if (sector == 0 && create && allocate (goal, zero, &sector))
+    cache_write_meta (table, &sector, ofs, sizeof sector);
+  return sector;
+}
+
+/* Makes sure *SLOT, a pointer held in INODE's on-disk inode,
+   refers to an allocated sector if CREATE is true, allocating it
+   near GOAL, zeroed if ZERO is true, and writing the inode back
+   if it changes.  Returns *SLOT. */
+static block_sector_t
+inode_slot (struct inode *inode, block_sector_t *slot, bool create,
+            block_sector_t goal, bool zero)
+{
+  if (*slot == 0 && create && allocate (goal, zero, slot))
+    cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  return *slot;
+}
+
+/* Looks up data sector number IDX of INODE, allocating it and any
+   index blocks on the way if CREATE is true.  Returns 0 for a
+   sector that is not allocated (a hole, or a failed or
+   out-of-range allocation).  The caller must hold INODE's
+   map_lock, for writing if it passes CREATE.
+
+   New sectors are allocated just after data sector IDX - 1, if
+   there is one, otherwise just after the inode, so that a file
+   written in order is laid out in order.  Index blocks are
+   zeroed.  A new data sector is only zeroed if it falls within
+   the file's initialized sectors. */
+static block_sector_t
+index_lookup (struct inode *inode, size_t idx, bool create)
+{
+  struct inode_index *d = &inode->data.map.index;
+  block_sector_t goal = inode->sector;
+  bool zero = idx < inode->data.init_sectors;
+  block_sector_t table;
+
+  if (create && idx > 0)
+    {
+      block_sector_t prev = index_lookup (inode, idx - 1, false);
+      if (prev != 0)
+        goal = prev;
+    }
+  goal++;
+
+  if (idx < DIRECT_CNT)
+    return inode_slot (inode, &d->direct[idx], create, goal, zero);
+
+  if (idx < INDIRECT_LIMIT)
+    {
+      table = inode_slot (inode, &d->indirect, create, goal, true);
+      return (table != 0
+              ? index_get (table, idx - DIRECT_CNT, create, goal, zero) : 0);
+    }
+
+  if (idx < DOUBLY_LIMIT)
+    {
+      idx -= INDIRECT_LIMIT;
+      table = inode_slot (inode, &d->doubly_indirect, create, goal, true);
+      if (table != 0)
+        table = index_get (table, idx / PTRS_PER_SECTOR, create, goal, true);
+      return (table != 0
+              ? index_get (table, idx % PTRS_PER_SECTOR, create, goal, zero)
+              : 0);
+    }
+
+  return 0;
+}
+
+/* Reads extent I of INODE into *E. */
+static void
+extent_get (struct inode *inode, size_t i, struct extent *e)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+
+  if (i < INLINE_EXTENTS)
+    *e = x->inline_[i];
+  else
+    cache_read (x->block, e, (i - INLINE_EXTENTS) * sizeof *e, sizeof *e);
+}
+
+/* Stores *E as extent I of INODE.  Extent I must be in use or be
+   the next free one, and for I >= INLINE_EXTENTS the extent block
+   must already exist. */
+static void
+extent_put (struct inode *inode, size_t i, const struct extent *e)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+
+  if (i < INLINE_EXTENTS)
+    x->inline_[i] = *e;
+  else
+    cache_write_meta (x->block, e, (i - INLINE_EXTENTS) * sizeof *e,
+                      sizeof *e);
+  if (i == x->cnt)
+    x->cnt++;
+  cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Appends one sector to extent-mapped INODE, growing its last
+   extent if the next sector on disk is free.  The sector is past
+   the initialized ones, so it is not zeroed.  Returns false if
+   the disk is full or INODE has no room for another extent. */
+static bool
+extent_append (struct inode *inode)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+  struct extent e;
+
+  if (x->cnt > 0)
+    {
+      extent_get (inode, x->cnt - 1, &e);
+      if (free_map_allocate_at (e.start + e.length))
+        {
+          e.length++;
+          extent_put (inode, x->cnt - 1, &e);
+          return true;
+        }
+    }
+
+  if (x->cnt >= MAX_EXTENTS)
+    return false;
+  if (x->cnt == INLINE_EXTENTS && x->block == 0
+      && !allocate (inode->sector + 1, true, &x->block))
+    return false;
+  if (!allocate (x->cnt > 0 ? e.start + e.length : inode->sector + 1, false,
+                 &e.start))
+    return false;
+  e.length = 1;
+  extent_put (inode, x->cnt, &e);
+  return true;
+}
+
+/* Looks up data sector number IDX of extent-mapped INODE.  If
+   CREATE is true, the file is first grown to cover IDX.  Returns 0
+   if IDX is not mapped.  The caller must hold INODE's map_lock,
+   for writing if it passes CREATE. */
+static block_sector_t
+extent_lookup (struct inode *inode, size_t idx, bool create)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+  size_t mapped = 0;
+  struct extent e;
+  size_t i;
+
+  for (i = 0; i < x->cnt; i++)
+    {
+      extent_get (inode, i, &e);
+      if (idx < mapped + e.length)
+        return e.start + (idx - mapped);
+      mapped += e.length;
+    }
+
+  if (!create)
+    return 0;
+  for (; mapped <= idx; mapped++)
+    if (!extent_append (inode))
+      return 0;
+  return extent_lookup (inode, idx, false);
+}
+
+/* Returns data sector IDX of INODE, or 0 if it is not allocated,
+   allocating it if CREATE is true. */
+static block_sector_t
+sector_lookup (struct inode *inode, size_t idx, bool create)
+{
+  if (inode->data.layout == INODE_EXTENTS)
+    return extent_lookup (inode, idx, create);
+  else
+    return index_lookup (inode, idx, create);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE, for reading, or 0 if that sector should read as
+   zeros because it has not been allocated or initialized.
+   INODE's map_lock must be held. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  return (idx < inode->data.init_sectors
+          ? sector_lookup (inode, idx, false) : 0);
+}
+
+/* Allocates data sectors of ordinary file INODE from IDX, which
+   is past its end, onward in one run, ahead of the data that is
+   being appended.  The run is as long as the file already is,
+   within PREALLOC_MIN and PREALLOC_MAX sectors, so that a file
+   that keeps growing is allocated in ever larger runs.  The new
+   sectors lie past the initialized ones and so need not be
+   zeroed.  This is only a hint: it stops quietly when the disk
+   fills up.  INODE's map_lock must be held for writing. */
+static void
+preallocate (struct inode *inode, size_t idx)
+{
+  size_t ahead = idx + 1, cnt;
+
+  if (ahead < PREALLOC_MIN)
+    ahead = PREALLOC_MIN;
+  else if (ahead > PREALLOC_MAX)
+    ahead = PREALLOC_MAX;
+  cnt = idx + 1 + ahead;
+  if (cnt <= inode->prealloc_end)
+    return;
+
+  if (inode->data.layout == INODE_EXTENTS)
+    {
+      if (!extent_reserve (inode, cnt))
+        return;
+    }
+  else
+    {
+      size_t i;
+
+      for (i = idx; i < cnt; i++)
+        if (index_lookup (inode, i, true) == 0)
+          return;
+    }
+  inode->prealloc_end = cnt;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, for writing, allocating it if needed.  Writes
+   that append to an ordinary file allocate ahead with
+   preallocate().  Returns 0 only if the disk is full or POS is
+   beyond the largest possible file. */
+static block_sector_t
+byte_to_sector_alloc (struct inode *inode, off_t pos)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+
+  rwlock_read_acquire (&inode->map_lock);
+  sector = sector_lookup (inode, idx, false);
+  rwlock_read_release (&inode->map_lock);
+
+  if (sector == 0)
+    {
+      rwlock_write_acquire (&inode->map_lock);
+      if (!is_meta (inode)
+          && idx >= (size_t) DIV_ROUND_UP (inode->data.length,
+                                           BLOCK_SECTOR_SIZE))
+        preallocate (inode, idx);
+      sector = sector_lookup (inode, idx, true);
+      rwlock_write_release (&inode->map_lock);
+    }
+  return sector;
+}
+
+/* Releases the sectors referenced by index block TABLE, which is
+   LEVEL levels above the data (1 for an indirect block), and then
+   TABLE itself. */
+static void
+release_table (block_sector_t table, int level)
+{
+  size_t i;
+
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    {
+      block_sector_t sector = index_get (table, i, false, 0, false);
+      if (sector == 0)
+        continue;
+      if (level > 1)
+        release_table (sector, level - 1);
+      else
+        free_map_release (sector, 1);
+    }
+  free_map_release (table, 1);
+}
+
+/* Releases every data and index sector of INODE. */
+static void
+release_sectors (struct inode *inode)
+{
+  struct inode_index *d = &inode->data.map.index;
+  struct inode_extents *x = &inode->data.map.extents;
+  struct extent e;
+  size_t i;
+
+  if (is_inline (inode))
+    return;
+  if (inode->data.layout == INODE_EXTENTS)
+    {
+      for (i = 0; i < x->cnt; i++)
+        {
+          extent_get (inode, i, &e);
+          free_map_release (e.start, e.length);
+        }
+      if (x->block != 0)
+        free_map_release (x->block, 1);
+      return;
+    }
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (d->direct[i] != 0)
+      free_map_release (d->direct[i], 1);
+  if (d->indirect != 0)
+    release_table (d->indirect, 1);
+  if (d->doubly_indirect != 0)
+    release_table (d->doubly_indirect, 2);
+}
+
+/* Releases the data sectors of extent-mapped INODE after the
+   first CNT. */
+static void
+extent_trim (struct inode *inode, size_t cnt)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+  size_t mapped = 0, used = 0;
+  struct extent e;
+  size_t i;
+
+  for (i = 0; i < x->cnt; i++)
+    {
+      size_t keep = mapped < cnt ? cnt - mapped : 0;
+
+      extent_get (inode, i, &e);
+      mapped += e.length;
+      if (keep >= e.length)
+        {
+          used = i + 1;
+          continue;
+        }
+      free_map_release (e.start + keep, e.length - keep);
+      if (keep > 0)
+        {
+          e.length = keep;
+          extent_put (inode, i, &e);
+          used = i + 1;
+        }
+    }
+  x->cnt = used;
+}
+
+/* Releases data sector IDX of indexed INODE, if it is allocated,
+   leaving a hole.  Index blocks are kept. */
+static void
+index_release (struct inode *inode, size_t idx)
+{
+  struct inode_index *d = &inode->data.map.index;
+  block_sector_t table, sector;
+  const block_sector_t none = 0;
+  off_t ofs;
+
+  if (idx < DIRECT_CNT)
+    {
+      if (d->direct[idx] != 0)
+        free_map_release (d->direct[idx], 1);
+      d->direct[idx] = 0;
+      return;
+    }
+
+  if (idx < INDIRECT_LIMIT)
+    {
+      table = d->indirect;
+      idx -= DIRECT_CNT;
+    }
+  else if (idx < DOUBLY_LIMIT)
+    {
+      idx -= INDIRECT_LIMIT;
+      table = d->doubly_indirect;
+      if (table != 0)
+        table = index_get (table, idx / PTRS_PER_SECTOR, false, 0, false);
+      idx %= PTRS_PER_SECTOR;
+    }
   else
-    return -1;
+    return;
+  if (table == 0)
+    return;
+
+  ofs = idx * sizeof sector;
+  cache_read (table, &sector, ofs, sizeof sector);
+  if (sector != 0)
+    {
+      cache_write_meta (table, &none, ofs, sizeof none);
+      free_map_release (sector, 1);
+    }
+}
+
+/* Gives back the sectors that preallocate() allocated to INODE
+   past its end of file.  Must be called within a journal
+   operation. */
+static void
+release_prealloc (struct inode *inode)
+{
+  size_t cnt = DIV_ROUND_UP (inode->data.length, BLOCK_SECTOR_SIZE);
+
+  rwlock_write_acquire (&inode->map_lock);
+  if (inode->prealloc_end > cnt && !is_inline (inode))
+    {
+      if (inode->data.layout == INODE_EXTENTS)
+        extent_trim (inode, cnt);
+      else
+        {
+          size_t i;
+
+          for (i = cnt; i < inode->prealloc_end; i++)
+            index_release (inode, i);
+        }
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  inode->prealloc_end = 0;
+  rwlock_write_release (&inode->map_lock);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, so that opening a single inode twice
+   returns the same `struct inode'.  It is a fixed array of
+   OPEN_BUCKETS buckets indexed by a hash of the sector, each a
+   list with its own lock, so looking an inode up costs a short
+   chain walk however many are open, and opens and closes of
+   inodes in different buckets do not wait for each other.
+   inode_reopen() callers hold no lock at all, so an inode's
+   open_cnt is a struct refcount.
+
+   Lookups that find an inode already open, the common case, do
+   not take the bucket lock either: they walk the bucket under
+   RCU and keep only an inode whose open_cnt they can raise from
+   above 0.  Adding an inode to a bucket, and removing one, which
+   the last close does, take the lock, and a removed inode is
+   freed only after an RCU grace period, so a lookup may still
+   be looking at it meanwhile. */
+#define OPEN_BUCKETS 256                /* Power of 2. */
+
+struct open_bucket
+  {
+    struct list inodes;                 /* Open inodes in this bucket. */
+    struct lock lock;                   /* Protects INODES. */
+  };
+
+static struct open_bucket open_inodes[OPEN_BUCKETS];
+
+/* Returns the bucket that holds the open inode for SECTOR. */
+static struct open_bucket *
+bucket_of (block_sector_t sector)
+{
+  return &open_inodes[hash_int (sector) & (OPEN_BUCKETS - 1)];
+}
+
+/* Cache of struct inode. */
+static struct kmem_cache *inode_cache;
+
+/* Constructs an inode in INODE_CACHE. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  rwlock_init (&inode->map_lock);
+  rwlock_init (&inode->user_lock);
+  lock_init (&inode->pages_lock);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  size_t i;
+
+  for (i = 0; i < OPEN_BUCKETS; i++)
+    {
+      list_init (&open_inodes[i].inodes);
+      lock_init (&open_inodes[i].lock);
+    }
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor);
+}
+
+/* Sets the layout used by inode_create() from now on. */
+void
+inode_set_default_layout (enum inode_layout layout)
+{
+  default_layout = layout;
+}
+
+/* Returns INODE's layout. */
+enum inode_layout
+inode_get_layout (const struct inode *inode)
+{
+  return inode->data.layout;
 }
 
-/* Initializes an inode with LENGTH bytes of data and
+/* Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR is true or an ordinary file otherwise, and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  An indexed file gets no data sectors up front and reads
+   as zeros until it is written; an extent file gets one contiguous
+   run for LENGTH if the free map has one, which is not zeroed.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is larger
+   than the biggest possible file. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,63 +717,114 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (default_layout == INODE_INDEXED
+      && DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE) > (off_t) DOUBLY_LIMIT)
+    return false;
+
+  journal_begin ();
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      size_t sectors = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+      struct inode_extents *x = &disk_inode->map.extents;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->layout = default_layout;
+      disk_inode->is_dir = is_dir;
+
+      /* A small ordinary file starts out inline.  The free map is
+         read and written a sector at a time on its own, so it
+         never does.  Otherwise, give an extent file its initial
+         size as a single run if one is free, or else it grows on
+         demand like any other.  None of it is initialized, so
+         none of it needs zeroing. */
+      if (!is_dir && sector != FREE_MAP_SECTOR && length <= INLINE_MAX)
+        disk_inode->inline_data = true;
+      else if (default_layout == INODE_EXTENTS && sectors > 0
+               && free_map_allocate (sectors, sector + 1,
+                                     &x->inline_[0].start))
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+          x->inline_[0].length = sectors;
+          x->cnt = 1;
+        }
+      cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
       free (disk_inode);
     }
+  journal_end ();
   return success;
 }
 
+/* Returns the open inode for SECTOR in bucket B, or a null
+   pointer if it is not open.  B's lock must be held, or the
+   caller must be in an RCU read-side critical section, in which
+   case the inode may be on its way to being freed. */
+static struct inode *
+find_open (struct open_bucket *b, block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&b->inodes); e != list_end (&b->inodes);
+       e = list_next (e)) 
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector) 
+        return inode;
+    }
+  return NULL;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct open_bucket *b = bucket_of (sector);
+  struct inode *inode, *new;
+  enum intr_level old_level;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  old_level = rcu_read_lock ();
+  inode = find_open (b, sector);
+  if (inode != NULL && !refcount_get_unless_zero (&inode->open_cnt))
+    inode = NULL;
+  rcu_read_unlock (old_level);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
+  new = kmem_cache_alloc (inode_cache);
+  if (new == NULL)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  new->sector = sector;
+  refcount_init (&new->open_cnt, 1);
+  new->deny_write_cnt = 0;
+  new->write_cnt = 0;
+  new->removed = false;
+  new->prealloc_end = 0;
+  refcount_init (&new->file_cnt, 0);
+  new->free_hint = 0;
+  rb_init (&new->pages, page_less, NULL);
+  cache_read (new->sector, &new->data, 0, BLOCK_SECTOR_SIZE);
+
+  /* Someone else may have opened it meanwhile. */
+  lock_acquire (&b->lock);
+  inode = find_open (b, sector);
+  if (inode != NULL)
+    refcount_get (&inode->open_cnt);
+  else
+    {
+      rcu_list_push_front (&b->inodes, &new->elem);
+      inode = new;
+      new = NULL;
+    }
+  lock_release (&b->lock);
+
+  kmem_cache_free (inode_cache, new);
   return inode;
 }
 
@@ -146,10 +833,25 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    refcount_get (&inode->open_cnt);
   return inode;
 }
 
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns true if INODE has been removed and is only waiting for
+   its last opener to close it. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -157,31 +859,59 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Frees the inode whose rcu member is HEAD, once no lookup can
+   be looking at it any more. */
+static void
+free_inode (struct rcu_head *head)
+{
+  kmem_cache_free (inode_cache, (struct inode *) ((uint8_t *) head
+                                 - offsetof (struct inode, rcu)));
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  struct open_bucket *b;
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (refcount_put_unless_last (&inode->open_cnt))
+    return;
+  b = bucket_of (inode->sector);
+  lock_acquire (&b->lock);
+  last = refcount_put (&inode->open_cnt);
+  if (last)
+    list_remove (&inode->elem);
+  lock_release (&b->lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      ASSERT (rb_empty (&inode->pages));
+
+      /* Deallocate blocks if removed, otherwise just those
+         allocated ahead of appends that never came. */
       if (inode->removed) 
         {
+          journal_begin ();
+          release_sectors (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          journal_end ();
+        }
+      else if (inode->prealloc_end > 0)
+        {
+          journal_begin ();
+          release_prealloc (inode);
+          journal_end ();
         }
 
-      free (inode); 
+      call_rcu (&inode->rcu, free_inode);
     }
 }
 
@@ -194,16 +924,31 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Reads SIZE bytes from INODE's sectors into BUFFER, starting at
+   position OFFSET, ignoring its mapped pages.  Whole sectors that
+   are not cached are read straight into BUFFER, in runs; if
+   DIRECT is true, even single ones are, and nothing is read
+   ahead.  Returns the number of bytes actually read, which may be
+   less than SIZE if an error occurs or end of file is reached. */
+static off_t
+read_sectors (struct inode *inode, uint8_t *buffer, off_t size,
+              off_t offset, bool direct) 
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_read_acquire (&inode->map_lock);
+  if (is_inline (inode))
+    {
+      if (offset < inode_length (inode))
+        {
+          bytes_read = inode_length (inode) - offset;
+          if (bytes_read > size)
+            bytes_read = size;
+          memcpy (buffer, inode->data.map.data + offset, bytes_read);
+        }
+      rwlock_read_release (&inode->map_lock);
+      return bytes_read;
+    }
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,91 +965,338 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx != 0 && sector_ofs == 0
+          && chunk_size == BLOCK_SECTOR_SIZE
+          && (size >= 2 * BLOCK_SECTOR_SIZE || direct))
+        {
+          /* Whole sectors: read as long a contiguous run as
+             possible in one transfer. */
+          off_t run = 1;
+          while (run < MAX_RUN
+                 && size - run * BLOCK_SECTOR_SIZE >= BLOCK_SECTOR_SIZE
+                 && (inode_length (inode) - offset
+                     >= (run + 1) * BLOCK_SECTOR_SIZE)
+                 && (byte_to_sector (inode, offset + run * BLOCK_SECTOR_SIZE)
+                     == sector_idx + run))
+            run++;
+          chunk_size = run * BLOCK_SECTOR_SIZE;
+          cache_read_multiple (sector_idx, run, buffer + bytes_read);
+        }
+      else if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
+      
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  /* Sequential readers usually come back for the next sector. */
+  if (!direct && bytes_read > 0 && offset < inode_length (inode))
+    {
+      block_sector_t next = byte_to_sector (inode, offset);
+      if (next != 0)
+        cache_readahead (next);
+    }
+  rwlock_read_release (&inode->map_lock);
+
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, passing DIRECT to read_sectors().  Returns the number of
+   bytes actually read, which may be less than SIZE if an error
+   occurs or end of file is reached. */
+static off_t
+read_at (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+         bool direct)
+{
+  off_t bytes_read = 0;
+
+  /* Checked without pages_lock, which only the slow path below
+     needs.  The check reads one word, the tree's root, so it sees
+     the tree either before or after a concurrent change.  If a
+     page is added just after the check, we read the disk
+     instead.  That is still correct, because inode_add_page()
+     only accepts a page read since the last write (see
+     WRITE_CNT), so the disk holds the same data.  Any later
+     store through the mapping is concurrent with this read, so
+     the read may miss it.  If a page is removed just after the
+     check, the slow path finds no page there and reads the disk
+     anyway. */
+  if (rb_empty (&inode->pages))
+    return read_sectors (inode, buffer, size, offset, direct);
+
+  while (size > 0)
+    {
+      /* Bytes left in inode, lesser of that and SIZE. */
+      off_t inode_left = inode_length (inode) - offset;
+      off_t chunk_size = size < inode_left ? size : inode_left;
+      int page_ofs = offset % PGSIZE;
+      struct inode_page *p;
+      bool mapped;
+
+      if (chunk_size <= 0)
+        break;
+
+      /* Copy from the page holding OFFSET, if it is mapped, or
+         else read up to the next mapped page from disk. */
+      lock_acquire (&inode->pages_lock);
+      p = find_page (inode, offset - page_ofs);
+      mapped = p != NULL && p->ofs == offset - page_ofs;
+      if (mapped)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          if (chunk_size > PGSIZE - page_ofs)
+            chunk_size = PGSIZE - page_ofs;
+          memcpy (buffer + bytes_read, (uint8_t *) p->kpage + page_ofs,
+                  chunk_size);
         }
-      else 
+      else if (p != NULL && chunk_size > p->ofs - offset)
+        chunk_size = p->ofs - offset;
+      lock_release (&inode->pages_lock);
+      if (!mapped)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          off_t n = read_sectors (inode, buffer + bytes_read, chunk_size,
+                                  offset, direct);
+          if (n < chunk_size)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              bytes_read += n;
+              break;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
-      
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, false);
+}
+
+/* Reads like inode_read_at(), but bypassing the buffer cache as
+   far as possible, for large streaming transfers that would only
+   evict data that is still in use.  Parts of sectors still go
+   through the cache, and so do the sectors that are cached
+   already. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+                   off_t offset)
+{
+  return read_at (inode, buffer, size, offset, true);
+}
+
+/* Asks for the sectors holding the SIZE bytes of INODE starting
+   at OFFSET, or as many of them as lie before the end of INODE,
+   to be read into the buffer cache in the background. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end;
+
+  rwlock_read_acquire (&inode->map_lock);
+  end = offset + size;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != 0)
+        cache_readahead (sector);
+    }
+  rwlock_read_release (&inode->map_lock);
+}
+
+/* Makes data sectors up to IDX of INODE initialized, either
+   before a write into only part of sector IDX, if WHOLE is false,
+   or after one that covered all of it, if WHOLE is true.
+   Allocated sectors between the old and new extent of the
+   initialized part are zeroed, as is sector IDX itself for a
+   partial write, before the new extent is published, so that a
+   reader never finds a sector there that holds neither zeros nor
+   the data written.  Returns true if INODE's initialized part
+   grew and so INODE must be written back. */
+static bool
+init_sectors (struct inode *inode, size_t idx, bool whole)
+{
+  bool grew = false;
+
+  rwlock_write_acquire (&inode->map_lock);
+  if (idx >= inode->data.init_sectors)
+    {
+      size_t i;
+
+      for (i = inode->data.init_sectors; i <= idx; i++)
+        {
+          block_sector_t sector = sector_lookup (inode, i, false);
+          if (sector != 0 && (i < idx || !whole))
+            write_data (inode, sector, zeros, 0, BLOCK_SECTOR_SIZE);
+        }
+      inode->data.init_sectors = idx + 1;
+      grew = true;
+    }
+  rwlock_write_release (&inode->map_lock);
+  return grew;
+}
+
+/* Writes the SIZE bytes in BUFFER into inline INODE at OFFSET,
+   if INODE is still inline and they fit.  Returns SIZE if
+   successful, or -1 if the data has to go to sectors instead. */
+static off_t
+write_inline (struct inode *inode, const uint8_t *buffer, off_t size,
+              off_t offset)
+{
+  off_t bytes_written = -1;
+
+  rwlock_write_acquire (&inode->map_lock);
+  if (is_inline (inode) && offset + size <= INLINE_MAX)
+    {
+      memcpy (inode->data.map.data + offset, buffer, size);
+      if (offset + size > inode->data.length)
+        inode->data.length = offset + size;
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      bytes_written = size;
+    }
+  rwlock_write_release (&inode->map_lock);
+  return bytes_written;
+}
+
+/* Moves INODE's data, if it is inline, to a data sector of
+   INODE's layout and gives INODE an empty sector map, so that it
+   can grow past INLINE_MAX.  INODE's map_lock must be held for
+   writing.  Returns false, leaving INODE inline, if memory or
+   disk space runs out. */
+static bool
+uninline (struct inode *inode)
+{
+  uint8_t *data;
+
+  if (!is_inline (inode))
+    return true;
+  data = calloc (1, BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return false;
+
+  memcpy (data, inode->data.map.data, inode->data.length);
+  memset (&inode->data.map, 0, sizeof inode->data.map);
+  inode->data.inline_data = false;
+  if (inode->data.length > 0)
+    {
+      block_sector_t sector = sector_lookup (inode, 0, true);
+      if (sector == 0)
+        {
+          memcpy (inode->data.map.data, data, inode->data.length);
+          inode->data.inline_data = true;
+          free (data);
+          return false;
+        }
+      write_data (inode, sector, data, 0, BLOCK_SECTOR_SIZE);
+      inode->data.init_sectors = 1;
+    }
+  cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  free (data);
+  return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   If DIRECT is true, whole sectors of an ordinary file go
+   straight to disk, in runs, instead of through the cache.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+   less than SIZE if the disk fills up or the file reaches its
+   maximum size.  Writing past end of file extends the inode;
+   any gap between the old end and OFFSET reads as zeros. */
+static off_t
+write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+          off_t offset, bool direct)
 {
-  const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t start = offset;
+  bool init_grew = false;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  journal_begin ();
+  if (is_inline (inode))
+    {
+      bool moved;
+
+      bytes_written = write_inline (inode, buffer, size, offset);
+      if (bytes_written >= 0)
+        {
+          write_pages (inode, buffer, bytes_written, offset);
+          journal_end ();
+          return bytes_written;
+        }
+      bytes_written = 0;
+
+      rwlock_write_acquire (&inode->map_lock);
+      moved = uninline (inode);
+      rwlock_write_release (&inode->map_lock);
+      if (!moved)
+        {
+          journal_end ();
+          return 0;
+        }
+    }
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector_alloc (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (direct && chunk_size == BLOCK_SECTOR_SIZE && !is_meta (inode))
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Whole sectors: write as long a contiguous run as
+             possible in one transfer. */
+          size_t idx = offset / BLOCK_SECTOR_SIZE;
+          off_t run, i;
+
+          for (run = 1; (run < MAX_RUN
+                         && size >= (run + 1) * BLOCK_SECTOR_SIZE); run++)
+            if (byte_to_sector_alloc (inode, offset + run * BLOCK_SECTOR_SIZE)
+                != sector_idx + run)
+              break;
+          cache_write_multiple (sector_idx, run, buffer + bytes_written);
+          for (i = 0; i < run; i++)
+            if (idx + i >= inode->data.init_sectors
+                && init_sectors (inode, idx + i, true))
+              init_grew = true;
+          chunk_size = run * BLOCK_SECTOR_SIZE;
         }
-      else 
+      else
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+          size_t idx = offset / BLOCK_SECTOR_SIZE;
+          bool whole = chunk_size == BLOCK_SECTOR_SIZE;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          if (!whole && idx >= inode->data.init_sectors
+              && init_sectors (inode, idx, false))
+            init_grew = true;
+          write_data (inode, sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size);
+          if (whole && idx >= inode->data.init_sectors
+              && init_sectors (inode, idx, true))
+            init_grew = true;
         }
 
       /* Advance. */
@@ -312,18 +1304,144 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file if we wrote past its end, and record any
+     newly initialized sectors. */
+  if (offset > inode->data.length || init_grew)
+    {
+      rwlock_write_acquire (&inode->map_lock);
+      if (offset > inode->data.length)
+        inode->data.length = offset;
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      rwlock_write_release (&inode->map_lock);
+    }
+  write_pages (inode, buffer, bytes_written, start);
+  journal_end ();
 
   return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or the file reaches its
+   maximum size.  Writing past end of file extends the inode;
+   any gap between the old end and OFFSET reads as zeros. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  return write_at (inode, buffer, size, offset, false);
+}
+
+/* Writes like inode_write_at(), but sends whole sectors of an
+   ordinary file straight to disk rather than through the buffer
+   cache, for large streaming transfers that would only evict
+   data that is still in use. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset)
+{
+  return write_at (inode, buffer, size, offset, true);
+}
+
+/* Reserves sectors for extent-mapped INODE up to data sector
+   count CNT, preferably as one run just after its last extent.
+   INODE's map_lock must be held for writing.  Returns false if
+   the disk is full or the extents run out. */
+static bool
+extent_reserve (struct inode *inode, size_t cnt)
+{
+  struct inode_extents *x = &inode->data.map.extents;
+  size_t mapped = 0;
+  block_sector_t goal = inode->sector + 1, start;
+  struct extent e;
+  size_t i;
+
+  for (i = 0; i < x->cnt; i++)
+    {
+      extent_get (inode, i, &e);
+      mapped += e.length;
+      goal = e.start + e.length;
+    }
+  if (mapped >= cnt)
+    return true;
+
+  if (free_map_allocate (cnt - mapped, goal, &start))
+    {
+      if (x->cnt > 0 && start == goal)
+        {
+          e.length += cnt - mapped;
+          extent_put (inode, x->cnt - 1, &e);
+          return true;
+        }
+      if (x->cnt < MAX_EXTENTS
+          && (x->cnt != INLINE_EXTENTS || x->block != 0
+              || allocate (inode->sector + 1, true, &x->block)))
+        {
+          e.start = start;
+          e.length = cnt - mapped;
+          extent_put (inode, x->cnt, &e);
+          return true;
+        }
+      free_map_release (start, cnt - mapped);
+    }
+
+  /* No single run is free.  Take what there is. */
+  return cnt == 0 || extent_lookup (inode, cnt - 1, true) != 0;
+}
+
+/* Reserves disk space for the first LENGTH bytes of INODE without
+   writing it, extending INODE to LENGTH bytes if it is shorter.
+   Sectors already allocated are kept, and sectors reserved here
+   read as zeros until they are written.  Returns true if
+   successful, false if the disk is full, LENGTH is beyond the
+   largest possible file, or writes to INODE are denied; some
+   sectors may have been reserved even so. */
+bool
+inode_reserve (struct inode *inode, off_t length)
+{
+  size_t cnt = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+  bool success = true;
+
+  ASSERT (length >= 0);
+
+  if (inode->deny_write_cnt)
+    return false;
+
+  journal_begin ();
+  rwlock_write_acquire (&inode->map_lock);
+  if (is_inline (inode) && length > INLINE_MAX)
+    success = uninline (inode);
+  if (!success || is_inline (inode))
+    {
+      /* Inline data needs no sectors. */
+    }
+  else if (inode->data.layout == INODE_EXTENTS)
+    success = extent_reserve (inode, cnt);
+  else
+    {
+      size_t i;
+
+      for (i = 0; success && i < cnt; i++)
+        success = index_lookup (inode, i, true) != 0;
+    }
+  if (success && length > inode->data.length)
+    inode->data.length = length;
+  cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rwlock_write_release (&inode->map_lock);
+  inode->write_cnt++;
+  journal_end ();
+
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
   inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= refcount_read (&inode->open_cnt));
 }
 
 /* Re-enables writes to INODE.
@@ -333,13 +1451,203 @@ void
 inode_allow_write (struct inode *inode) 
 {
   ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= refcount_read (&inode->open_cnt));
   inode->deny_write_cnt--;
 }
 
+/* Acquires INODE's user lock for exclusive use.  The inode
+   functions never take this lock themselves, so a caller may
+   hold it across a sequence of them, for example to add an entry
+   to a directory atomically. */
+void
+inode_lock (struct inode *inode)
+{
+  rwlock_write_acquire (&inode->user_lock);
+}
+
+/* Releases INODE's user lock, acquired with inode_lock(). */
+void
+inode_unlock (struct inode *inode)
+{
+  rwlock_write_release (&inode->user_lock);
+}
+
+/* Acquires INODE's user lock shared with other threads that only
+   read through it, such as directory lookups. */
+void
+inode_lock_shared (struct inode *inode)
+{
+  rwlock_read_acquire (&inode->user_lock);
+}
+
+/* Releases INODE's user lock, acquired with
+   inode_lock_shared(). */
+void
+inode_unlock_shared (struct inode *inode)
+{
+  rwlock_read_release (&inode->user_lock);
+}
+
+/* Returns a count that changes at the end of every write to
+   INODE, so that a caller that remembers it while holding INODE
+   open can tell whether INODE has been written since. */
+unsigned
+inode_write_cnt (const struct inode *inode)
+{
+  return inode->write_cnt;
+}
+
+/* Counts a struct file newly opened on INODE. */
+void
+inode_file_opened (struct inode *inode)
+{
+  refcount_get (&inode->file_cnt);
+}
+
+/* Counts a struct file on INODE as closed. */
+void
+inode_file_closed (struct inode *inode)
+{
+  refcount_put (&inode->file_cnt);
+}
+
+/* Returns the number of struct files open on INODE, which may
+   change as soon as it is read.  For a directory, a file's
+   position is a position within the directory, so while this is
+   nonzero the directory's entries must stay where they are. */
+int
+inode_file_cnt (const struct inode *inode)
+{
+  return refcount_read (&inode->file_cnt);
+}
+
+/* Returns the offset before which directory INODE has no free
+   entry, as last set with inode_set_free_hint().  It is kept only
+   in memory, so it is 0 whenever INODE is opened anew. */
+off_t
+inode_free_hint (const struct inode *inode)
+{
+  return inode->free_hint;
+}
+
+/* Sets INODE's free entry hint to OFS.  The caller must hold
+   INODE's user lock exclusively. */
+void
+inode_set_free_hint (struct inode *inode, off_t ofs)
+{
+  inode->free_hint = ofs;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns true if mapped page A precedes mapped page B. */
+static bool
+page_less (const struct rb_elem *a_, const struct rb_elem *b_,
+           void *aux UNUSED)
+{
+  const struct inode_page *a = rb_entry (a_, struct inode_page, elem);
+  const struct inode_page *b = rb_entry (b_, struct inode_page, elem);
+
+  return a->ofs < b->ofs;
+}
+
+/* Returns INODE's first mapped page at or after OFS, or a null
+   pointer if there is none.  INODE's pages_lock must be held. */
+static struct inode_page *
+find_page (struct inode *inode, off_t ofs)
+{
+  struct inode_page key;
+  struct rb_elem *e;
+
+  key.ofs = ofs;
+  e = rb_lower_bound (&inode->pages, &key.elem);
+  return e != NULL ? rb_entry (e, struct inode_page, elem) : NULL;
+}
+
+/* Copies the SIZE bytes just written from BUFFER to INODE at
+   OFFSET into the mapped pages they overlap, and then counts the
+   write.  A page being written back to its own file is the
+   source of the write and is left alone. */
+static void
+write_pages (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset)
+{
+  struct inode_page key;
+  struct rb_elem *e;
+
+  key.ofs = offset - offset % PGSIZE;
+  lock_acquire (&inode->pages_lock);
+  for (e = rb_lower_bound (&inode->pages, &key.elem); e != NULL;
+       e = rb_next (e))
+    {
+      struct inode_page *p = rb_entry (e, struct inode_page, elem);
+      off_t start = p->ofs > offset ? p->ofs : offset;
+      off_t end = (p->ofs + PGSIZE < offset + size
+                   ? p->ofs + PGSIZE : offset + size);
+      uint8_t *dst = (uint8_t *) p->kpage + (start - p->ofs);
+
+      if (p->ofs >= offset + size)
+        break;
+      if (dst != buffer + (start - offset))
+        memcpy (dst, buffer + (start - offset), end - start);
+    }
+  inode->write_cnt++;
+  lock_release (&inode->pages_lock);
+}
+
+/* Adds P, whose OFS and KPAGE must be set, to INODE's mapped
+   pages, so that reads and writes of that part of INODE go
+   through it from now on.  WRITE_CNT must be inode_write_cnt()
+   from before P's contents were read from INODE.  Fails, and so
+   returns false, if INODE has been written since, in which case
+   the contents may be out of date and should be read again, or
+   if INODE already has a page at the same offset. */
+bool
+inode_add_page (struct inode *inode, struct inode_page *p,
+                unsigned write_cnt)
+{
+  struct inode_page *q;
+  bool success;
+
+  ASSERT (p->ofs % PGSIZE == 0);
+
+  lock_acquire (&inode->pages_lock);
+  q = find_page (inode, p->ofs);
+  success = inode->write_cnt == write_cnt && (q == NULL || q->ofs != p->ofs);
+  if (success)
+    rb_insert (&inode->pages, &p->elem);
+  lock_release (&inode->pages_lock);
+  return success;
+}
+
+/* Returns INODE's mapped page at file offset OFS, or a null
+   pointer if there is none.  The caller must make sure that the
+   page cannot be removed meanwhile. */
+struct inode_page *
+inode_find_page (struct inode *inode, off_t ofs)
+{
+  struct inode_page *p;
+
+  lock_acquire (&inode->pages_lock);
+  p = find_page (inode, ofs);
+  if (p != NULL && p->ofs != ofs)
+    p = NULL;
+  lock_release (&inode->pages_lock);
+  return p;
+}
+
+/* Removes P from INODE's mapped pages.  Its contents must already
+   have been written back, if they were modified through the
+   mapping. */
+void
+inode_remove_page (struct inode *inode, struct inode_page *p)
+{
+  lock_acquire (&inode->pages_lock);
+  rb_remove (&inode->pages, &p->elem);
+  lock_release (&inode->pages_lock);
+}
@@ -1,23 +1,66 @@
 #ifndef FILESYS_INODE_H
 #define FILESYS_INODE_H
 
+#include <rbtree.h>
 #include <stdbool.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
 
+/* A page of a file's data that is mapped into memory, such as a
+   page of a memory-mapped file.  While it is added to its inode,
+   reads of that part of the file come from the page and writes
+   update it as well as the disk, so that the mapping and read()
+   and write() always agree. */
+struct inode_page
+  {
+    struct rb_elem elem;        /* Element in inode's pages. */
+    off_t ofs;                  /* File offset, a multiple of PGSIZE. */
+    void *kpage;                /* The page's contents. */
+  };
+
+/* How an inode maps file offsets to disk sectors. */
+enum inode_layout
+  {
+    INODE_INDEXED,              /* Direct, indirect, doubly indirect. */
+    INODE_EXTENTS               /* Runs of consecutive sectors. */
+  };
+
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+void inode_set_default_layout (enum inode_layout);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_reserve (struct inode *, off_t length);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t offset, off_t size);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
+void inode_lock_shared (struct inode *);
+void inode_unlock_shared (struct inode *);
 off_t inode_length (const struct inode *);
+unsigned inode_write_cnt (const struct inode *);
+void inode_file_opened (struct inode *);
+void inode_file_closed (struct inode *);
+int inode_file_cnt (const struct inode *);
+off_t inode_free_hint (const struct inode *);
+void inode_set_free_hint (struct inode *, off_t);
+enum inode_layout inode_get_layout (const struct inode *);
+bool inode_add_page (struct inode *, struct inode_page *,
+                     unsigned write_cnt);
+struct inode_page *inode_find_page (struct inode *, off_t ofs);
+void inode_remove_page (struct inode *, struct inode_page *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,258 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Metadata (inodes, index and extent blocks, directory contents
+   and the free map) is written into the buffer cache with
+   cache_write_meta() and stays there until the journal commits
+   it.  A commit copies every dirty metadata sector into the
+   journal region with one sequential write, then writes a
+   descriptor listing their home sectors, which is the commit
+   point.  Only then are the sectors written to their homes
+   ("checkpointed"), after which the header records the commit as
+   done.  If the disk caches writes, it is flushed after the
+   descriptor and again before the header, so that neither the
+   homes nor the header can reach the medium ahead of what they
+   depend on.  If the system crashes after the descriptor is written
+   but before the header is, journal_recover() replays the
+   descriptor at the next mount.  A crash before the descriptor
+   is written loses the whole commit but leaves the old metadata
+   intact.
+
+   Changes are grouped: each file system operation that updates
+   metadata is bracketed by journal_begin() and journal_end(),
+   and the buffer cache's periodic flush commits everything the
+   completed operations changed every few seconds, so many creates and
+   removes share one journal write.  A commit waits for the
+   operations in progress to end and holds off new ones until it
+   is done, so that each commit contains only whole operations.
+   Brackets nest; only the outermost counts.
+
+   The region is JOURNAL_SECTORS sectors starting at
+   JOURNAL_SECTOR: a header, a descriptor, and room for
+   JOURNAL_BLOCKS sectors of data, as many as the buffer cache
+   can hold dirty. */
+
+#define JOURNAL_MAGIC 0x4a524e4c        /* Identifies a journal header. */
+#define TXN_MAGIC 0x4a54584e            /* Identifies a descriptor. */
+
+#define HEADER_SECTOR JOURNAL_SECTOR
+#define TXN_SECTOR (JOURNAL_SECTOR + 1)
+#define DATA_SECTOR (JOURNAL_SECTOR + 2)
+
+/* Journal header.  Must be exactly BLOCK_SECTOR_SIZE bytes. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t done_seq;                  /* Last commit checkpointed. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 2 * sizeof (uint32_t)];
+  };
+
+/* Commit descriptor.  Must be exactly BLOCK_SECTOR_SIZE bytes. */
+struct journal_txn
+  {
+    uint32_t magic;                     /* TXN_MAGIC. */
+    uint32_t seq;                       /* Commit sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    uint32_t checksum;                  /* See checksum(). */
+    block_sector_t sectors[JOURNAL_BLOCKS]; /* Home sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 4 * sizeof (uint32_t)
+                   - JOURNAL_BLOCKS * sizeof (block_sector_t)];
+  };
+
+static struct journal_header header;
+static struct journal_txn txn;
+static uint8_t *blocks;                 /* JOURNAL_BLOCKS sectors. */
+static uint32_t next_seq;               /* Sequence of next commit. */
+
+/* Operations and commits.  journal_lock protects the variables
+   below.  A commit sets COMMITTING, waits on QUIET until no
+   operation is active, and broadcasts DONE when it finishes. */
+static struct lock journal_lock;
+static struct condition quiet, done;
+static int active_cnt;                  /* Operations in progress. */
+static bool committing;                 /* Commit in progress? */
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof txn == BLOCK_SECTOR_SIZE);
+
+  blocks = malloc (JOURNAL_BLOCKS * BLOCK_SECTOR_SIZE);
+  if (blocks == NULL)
+    PANIC ("journal buffer allocation failed");
+  lock_init (&journal_lock);
+  cond_init (&quiet);
+  cond_init (&done);
+  active_cnt = 0;
+  committing = false;
+}
+
+/* Returns the checksum of TXN and the data blocks it describes,
+   which are in BLOCKS. */
+static uint32_t
+checksum (const struct journal_txn *t)
+{
+  return (hash_bytes (t->sectors, t->cnt * sizeof *t->sectors)
+          ^ hash_bytes (blocks, t->cnt * BLOCK_SECTOR_SIZE)
+          ^ t->seq);
+}
+
+/* Writes an empty journal to a newly formatted device. */
+void
+journal_format (void)
+{
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  header.done_seq = 0;
+  block_write (fs_device, HEADER_SECTOR, &header);
+
+  memset (&txn, 0, sizeof txn);
+  block_write (fs_device, TXN_SECTOR, &txn);
+  next_seq = 1;
+}
+
+/* Replays the last commit if the system stopped before it was
+   checkpointed.  Must be called at mount, before anything else
+   reads metadata. */
+void
+journal_recover (void)
+{
+  size_t i;
+
+  block_read (fs_device, HEADER_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal; reformat it");
+  next_seq = header.done_seq + 1;
+
+  block_read (fs_device, TXN_SECTOR, &txn);
+  if (txn.magic != TXN_MAGIC || txn.seq <= header.done_seq
+      || txn.cnt > JOURNAL_BLOCKS)
+    return;
+  block_read_multiple (fs_device, DATA_SECTOR, txn.cnt, blocks);
+  if (txn.checksum != checksum (&txn))
+    return;
+
+  printf ("Replaying file system journal...");
+  for (i = 0; i < txn.cnt; i++)
+    block_write (fs_device, txn.sectors[i], blocks + i * BLOCK_SECTOR_SIZE);
+  block_flush (fs_device);
+  header.done_seq = txn.seq;
+  block_write (fs_device, HEADER_SECTOR, &header);
+  next_seq = txn.seq + 1;
+  printf ("done.\n");
+}
+
+/* Begins an operation that updates metadata, waiting for any
+   commit in progress to finish first.  If uncommitted metadata
+   crowds the buffer cache, commits it first, so that operations
+   in progress do not run the cache out of entries it can
+   evict. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth > 0)
+    {
+      t->journal_depth++;
+      return;
+    }
+
+  if (cache_meta_crowded ())
+    journal_commit ();
+
+  t->journal_depth++;
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&done, &journal_lock);
+  active_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation begun with journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  if (--active_cnt == 0)
+    cond_signal (&quiet, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR, whose contents are DATA, to the commit being
+   built. */
+static bool
+add_block (block_sector_t sector, const void *data, void *aux UNUSED)
+{
+  memcpy (blocks + txn.cnt * BLOCK_SECTOR_SIZE, data, BLOCK_SECTOR_SIZE);
+  txn.sectors[txn.cnt++] = sector;
+  return txn.cnt < JOURNAL_BLOCKS;
+}
+
+/* Commits the metadata changed by every operation that has ended
+   since the last commit, and checkpoints it.  Must not be called
+   within an operation. */
+void
+journal_commit (void)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  ASSERT (t->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&done, &journal_lock);
+  committing = true;
+  while (active_cnt > 0)
+    cond_wait (&quiet, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* The free map's own writes belong to this commit, so they
+     count as a nested operation rather than waiting for it. */
+  t->journal_depth++;
+  free_map_flush ();
+  t->journal_depth--;
+
+  txn.cnt = 0;
+  cache_for_each_meta (add_block, NULL);
+  if (txn.cnt > 0)
+    {
+      txn.magic = TXN_MAGIC;
+      txn.seq = next_seq++;
+      txn.checksum = checksum (&txn);
+      block_write_multiple (fs_device, DATA_SECTOR, txn.cnt, blocks);
+      block_write (fs_device, TXN_SECTOR, &txn);
+      block_flush (fs_device);
+
+      for (i = 0; i < txn.cnt; i++)
+        cache_checkpoint (txn.sectors[i]);
+      block_flush (fs_device);
+      header.done_seq = txn.seq;
+      block_write (fs_device, HEADER_SECTOR, &header);
+    }
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&done, &journal_lock);
+  lock_release (&journal_lock);
+}
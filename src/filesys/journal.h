@@ -0,0 +1,19 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include "devices/block.h"
+
+/* On-disk journal region, just after the system file inodes. */
+#define JOURNAL_SECTOR 2        /* First journal sector. */
+#define JOURNAL_BLOCKS 64       /* Most sectors one commit can hold. */
+#define JOURNAL_SECTORS (2 + JOURNAL_BLOCKS) /* Size of the region. */
+
+void journal_init (void);
+void journal_format (void);
+void journal_recover (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+
+#endif /* filesys/journal.h */
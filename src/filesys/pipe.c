@@ -0,0 +1,335 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <poll.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/waitq.h"
+
+/* Pipes.
+
+   A pipe is a ring of up to PIPE_PAGES kernel pages, each
+   holding the bytes between its OFS and LEN that were written
+   but not yet read.  Writers append to the last page while it
+   has room, and start a new one when it is full; readers take
+   from the first page, freeing it once it is used up, so that
+   every page in the ring has unread data whenever LOCK is free.  Both
+   ends are struct files (see file_open_pipe()), which the file
+   descriptor table holds like any other.
+
+   A write of a whole page can hand over its page instead of
+   copying it, with pipe_write_page(), and a read of a whole
+   page can take one that way, with pipe_read_page(), so a page
+   of data moves from writer to reader without being copied in
+   the kernel at all: the system calls already bounce user data
+   through a kernel page of their own.
+
+   A read waits until there is data or every writer is gone, and
+   then returns what it can without waiting again.  A write
+   waits for room until it is done or every reader is gone.
+   LOCK protects everything.  Every change that could make
+   either end ready also wakes POLLERS, for poll(). */
+
+#define PIPE_PAGES 16                   /* Most pages buffered. */
+
+/* One page of buffered data. */
+struct pipe_page
+  {
+    uint8_t *page;                      /* Kernel page. */
+    size_t ofs;                         /* Offset of first unread byte. */
+    size_t len;                         /* Offset past last written byte. */
+  };
+
+struct pipe
+  {
+    struct lock lock;
+    struct condition readable;          /* Data or no writers. */
+    struct condition writable;          /* Room or no readers. */
+    struct waitq pollers;               /* Woken on any change. */
+    struct pipe_page pages[PIPE_PAGES]; /* Ring of pages. */
+    size_t head;                        /* Index of first page. */
+    size_t cnt;                         /* Number of pages. */
+    int reader_cnt;                     /* Open read ends. */
+    int writer_cnt;                     /* Open write ends. */
+  };
+
+static void destroy (struct pipe *);
+
+/* Creates a pipe and opens a file for each of its ends, storing
+   them in *READ_END and *WRITE_END.  Returns false if memory is
+   short. */
+bool
+pipe_create (struct file **read_end, struct file **write_end)
+{
+  struct pipe *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return false;
+  lock_init (&p->lock);
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  waitq_init (&p->pollers);
+  p->head = p->cnt = 0;
+  p->reader_cnt = p->writer_cnt = 1;
+
+  *read_end = file_open_pipe (p, false);
+  *write_end = file_open_pipe (p, true);
+  if (*read_end == NULL || *write_end == NULL)
+    {
+      /* Closing whichever end opened drops its count. */
+      file_close (*read_end);
+      file_close (*write_end);
+      if (*read_end == NULL)
+        pipe_close (p, false);
+      if (*write_end == NULL)
+        pipe_close (p, true);
+      return false;
+    }
+  return true;
+}
+
+/* Adds a reader, or a writer if WRITER is true, to P, for a
+   reopened end. */
+void
+pipe_open (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writer_cnt++;
+  else
+    p->reader_cnt++;
+  lock_release (&p->lock);
+}
+
+/* Drops a reader, or a writer if WRITER is true, from P, waking
+   whoever waits on the other end if it was the last, and
+   destroying P once both ends are closed. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool gone;
+
+  lock_acquire (&p->lock);
+  if (writer && --p->writer_cnt == 0)
+    cond_broadcast (&p->readable, &p->lock);
+  else if (!writer && --p->reader_cnt == 0)
+    cond_broadcast (&p->writable, &p->lock);
+  gone = p->reader_cnt == 0 && p->writer_cnt == 0;
+  waitq_wake (&p->pollers);
+  lock_release (&p->lock);
+
+  if (gone)
+    destroy (p);
+}
+
+/* Waits until P has data or no writers.  Returns true if it has
+   data. */
+static bool
+wait_readable (struct pipe *p)
+{
+  while (p->cnt == 0 && p->writer_cnt > 0)
+    cond_wait (&p->readable, &p->lock);
+  return p->cnt > 0;
+}
+
+/* Waits until P has room for another page or no readers.
+   Returns true if it has room. */
+static bool
+wait_writable (struct pipe *p)
+{
+  while (p->cnt == PIPE_PAGES && p->reader_cnt > 0)
+    cond_wait (&p->writable, &p->lock);
+  return p->reader_cnt > 0;
+}
+
+/* Removes the first page of P, which must be used up or taken
+   whole, and wakes a writer. */
+static void
+pop_page (struct pipe *p)
+{
+  p->head = (p->head + 1) % PIPE_PAGES;
+  p->cnt--;
+  cond_signal (&p->writable, &p->lock);
+  waitq_wake (&p->pollers);
+}
+
+/* Appends PAGE, holding LEN bytes, to P, which must have room,
+   and wakes a reader. */
+static void
+push_page (struct pipe *p, void *page, size_t len)
+{
+  struct pipe_page *pp = &p->pages[(p->head + p->cnt++) % PIPE_PAGES];
+
+  pp->page = page;
+  pp->ofs = 0;
+  pp->len = len;
+  cond_signal (&p->readable, &p->lock);
+  waitq_wake (&p->pollers);
+}
+
+/* Reads up to SIZE bytes from P into BUFFER.  If P is empty,
+   waits until it is not, if WAIT is true and some writer is
+   left.  Returns the number of bytes read, which is 0 at end of
+   file. */
+off_t
+pipe_read (struct pipe *p, void *buffer_, off_t size, bool wait)
+{
+  uint8_t *buffer = buffer_;
+  off_t total = 0;
+
+  lock_acquire (&p->lock);
+  if (size > 0 && (wait ? wait_readable (p) : p->cnt > 0))
+    while (total < size && p->cnt > 0)
+      {
+        struct pipe_page *pp = &p->pages[p->head];
+        size_t n = pp->len - pp->ofs;
+
+        if (n > (size_t) (size - total))
+          n = size - total;
+        memcpy (buffer + total, pp->page + pp->ofs, n);
+        pp->ofs += n;
+        total += n;
+        if (pp->ofs == pp->len)
+          {
+            palloc_free_page (pp->page);
+            pop_page (p);
+          }
+      }
+  lock_release (&p->lock);
+  return total;
+}
+
+/* Writes SIZE bytes from BUFFER to P, waiting for room as
+   needed.  Returns the number of bytes written, which is less
+   than SIZE only if every reader is gone, or memory runs out. */
+off_t
+pipe_write (struct pipe *p, const void *buffer_, off_t size)
+{
+  const uint8_t *buffer = buffer_;
+  off_t total = 0;
+
+  lock_acquire (&p->lock);
+  while (total < size)
+    {
+      struct pipe_page *last = &p->pages[(p->head + p->cnt - 1)
+                                         % PIPE_PAGES];
+      size_t n;
+
+      if (p->reader_cnt == 0)
+        break;
+      if (p->cnt == 0 || last->len == PGSIZE)
+        {
+          void *page;
+
+          if (!wait_writable (p))
+            break;
+          page = palloc_get_page (0);
+          if (page == NULL)
+            break;
+          push_page (p, page, 0);
+          continue;
+        }
+
+      n = PGSIZE - last->len;
+      if (n > (size_t) (size - total))
+        n = size - total;
+      memcpy (last->page + last->len, buffer + total, n);
+      last->len += n;
+      total += n;
+      cond_signal (&p->readable, &p->lock);
+      waitq_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return total;
+}
+
+/* If the next data in P is a whole page, as written by
+   pipe_write_page(), removes that page from P and returns it,
+   and the caller must free it.  Waits for data first as
+   pipe_read() does.  Otherwise, returns a null pointer; the
+   caller should then read with pipe_read(), which does not wait
+   again if there is data. */
+void *
+pipe_read_page (struct pipe *p, bool wait)
+{
+  void *page = NULL;
+
+  lock_acquire (&p->lock);
+  if (wait ? wait_readable (p) : p->cnt > 0)
+    {
+      struct pipe_page *pp = &p->pages[p->head];
+      if (pp->ofs == 0 && pp->len == PGSIZE)
+        {
+          page = pp->page;
+          pop_page (p);
+        }
+    }
+  lock_release (&p->lock);
+  return page;
+}
+
+/* Appends PAGE, a full page of data from palloc_get_page(), to
+   P, waiting for room as needed.  P takes ownership of PAGE.
+   Returns false, leaving PAGE to the caller, if every reader is
+   gone. */
+bool
+pipe_write_page (struct pipe *p, void *page)
+{
+  bool ok;
+
+  lock_acquire (&p->lock);
+  ok = wait_writable (p);
+  if (ok)
+    push_page (p, page, PGSIZE);
+  lock_release (&p->lock);
+  return ok;
+}
+
+/* Returns the poll() events, of POLLIN, POLLOUT and POLLHUP, that
+   the read end of P, or its write end if WRITER is true, is
+   ready for: reading if P has data, writing if it has room, and
+   POLLHUP if the other end is closed. */
+unsigned
+pipe_poll (struct pipe *p, bool writer)
+{
+  unsigned events = 0;
+
+  lock_acquire (&p->lock);
+  if (!writer)
+    {
+      if (p->cnt > 0)
+        events |= POLLIN;
+      if (p->writer_cnt == 0)
+        events |= POLLHUP;
+    }
+  else
+    {
+      if (p->reader_cnt == 0)
+        events |= POLLHUP;
+      else if (p->cnt < PIPE_PAGES
+               || p->pages[(p->head + p->cnt - 1) % PIPE_PAGES].len < PGSIZE)
+        events |= POLLOUT;
+    }
+  lock_release (&p->lock);
+  return events;
+}
+
+/* Returns the wait queue woken whenever either end of P may have
+   become ready. */
+struct waitq *
+pipe_waitq (struct pipe *p)
+{
+  return &p->pollers;
+}
+
+/* Frees P and the data left in it. */
+static void
+destroy (struct pipe *p)
+{
+  for (; p->cnt > 0; p->head = (p->head + 1) % PIPE_PAGES, p->cnt--)
+    palloc_free_page (p->pages[p->head].page);
+  free (p);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct pipe;
+struct waitq;
+
+bool pipe_create (struct file **read_end, struct file **write_end);
+void pipe_open (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+off_t pipe_read (struct pipe *, void *, off_t size, bool wait);
+off_t pipe_write (struct pipe *, const void *, off_t size);
+void *pipe_read_page (struct pipe *, bool wait);
+bool pipe_write_page (struct pipe *, void *page);
+unsigned pipe_poll (struct pipe *, bool writer);
+struct waitq *pipe_waitq (struct pipe *);
+
+#endif /* filesys/pipe.h */
@@ -0,0 +1,29 @@
+#ifndef __LIB_AIO_H
+#define __LIB_AIO_H
+
+/* An asynchronous read or write, as given to aio_read() or
+   aio_write().  The kernel copies it at submission, so it may be
+   reused at once; BUF must stay valid until the request is
+   reaped by aio_wait(). */
+struct aiocb
+  {
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* User buffer. */
+    unsigned size;              /* Bytes to transfer. */
+    unsigned offset;            /* Position in the file. */
+  };
+
+/* A finished request, as reported by aio_wait(). */
+struct aio_event
+  {
+    int id;                     /* Value returned at submission. */
+    int result;                 /* Bytes transferred. */
+  };
+
+/* Largest SIZE of one request. */
+#define AIO_SIZE_MAX (16 * 4096)
+
+/* Most requests a process may have unreaped at once. */
+#define AIO_MAX 64
+
+#endif /* lib/aio.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_CHECKPOINT_H
+#define __LIB_CHECKPOINT_H
+
+#include <stdint.h>
+
+/* Registers with which a process restored from a checkpoint
+   resumes.  The user's checkpoint() stores them just before it
+   enters the kernel, as setjmp() would; with the stack, they are
+   all that the calling convention keeps live across the call. */
+struct checkpoint_regs
+  {
+    uint32_t ebx, esi, edi, ebp;        /* Callee-saved registers. */
+    uint32_t esp;                       /* Stack pointer. */
+    uint32_t eip;                       /* Where to resume. */
+  };
+
+#endif /* lib/checkpoint.h */
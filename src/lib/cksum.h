@@ -0,0 +1,13 @@
+#ifndef __LIB_CKSUM_H
+#define __LIB_CKSUM_H
+
+/* The CRC used by the Posix "cksum" utility.  See the
+   documentation of "cksum" in [SUSv3]. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t cksum_update (uint32_t crc, const void *, size_t size);
+uint32_t cksum_finish (uint32_t crc, uint64_t length);
+
+#endif /* lib/cksum.h */
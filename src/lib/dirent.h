@@ -0,0 +1,16 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdint.h>
+
+/* Longest file name in a directory entry. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry, as returned by readdir_batch(). */
+struct dirent
+  {
+    uint32_t inumber;                   /* Inode number. */
+    char name[DIRENT_NAME_MAX + 1];     /* Null-terminated name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_FAULTSTAT_H
+#define __LIB_FAULTSTAT_H
+
+#include <stdint.h>
+
+/* Page fault accounting, kept by the virtual memory system for
+   each process and for the system as a whole.  A high rate of
+   major faults on pages that were evicted earlier, with evictions
+   to match, means thrashing; major faults on pages never loaded
+   before are just a cold start. */
+struct faultstat
+  {
+    uint32_t minor_cnt;         /* Resolved without I/O. */
+    uint32_t file_cnt;          /* Major, read from a file. */
+    uint32_t swap_cnt;          /* Major, read from swap. */
+    uint32_t cow_cnt;           /* Copy-on-write breaks. */
+    uint32_t stack_cnt;         /* Stack growth. */
+    uint32_t evict_cnt;         /* Pages evicted from memory. */
+  };
+
+#endif /* lib/faultstat.h */
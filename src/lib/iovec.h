@@ -0,0 +1,16 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One buffer of a scatter/gather transfer. */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer in bytes. */
+  };
+
+/* Most buffers in one readv() or writev() call. */
+#define IOV_MAX 32
+
+#endif /* lib/iovec.h */
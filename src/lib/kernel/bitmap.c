@@ -60,6 +60,29 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns an elem_type in which the CNT bits starting at bit
+   OFS are turned on.  OFS + CNT must not exceed ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << ofs;
+}
+
+/* Returns the number of bits that are turned on in X.
+   __builtin_popcountl() would need a helper from libgcc, which the
+   kernel does not link against, so count bits in parallel instead:
+   first within pairs, then nibbles, then bytes, then sum the
+   bytes with a multiply. */
+static inline size_t
+popcount (elem_type x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -213,18 +236,31 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time.  Each element is updated
+   atomically, but the group as a whole is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = cnt < ELEM_BITS - ofs ? cnt : ELEM_BITS - ofs;
+      elem_type mask = range_mask (ofs, n);
+
+      /* See bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +268,24 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t total = cnt;
+  size_t true_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  true_cnt = 0;
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = cnt < ELEM_BITS - ofs ? cnt : ELEM_BITS - ofs;
+
+      true_cnt += popcount (b->bits[elem_idx (start)] & range_mask (ofs, n));
+      start += n;
+      cnt -= n;
+    }
+  return value ? true_cnt : total - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,15 +293,22 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  elem_type flip = value ? 0 : (elem_type) -1;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = cnt < ELEM_BITS - ofs ? cnt : ELEM_BITS - ofs;
+
+      if (((b->bits[elem_idx (start)] ^ flip) & range_mask (ofs, n)) != 0)
+        return true;
+      start += n;
+      cnt -= n;
+    }
   return false;
 }
 
@@ -288,6 +338,33 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Elements with
+   no such bit are skipped with a single comparison. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, bit;
+  elem_type word;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  idx = elem_idx (start);
+  word = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (word == 0)
+    {
+      if (++idx >= elem_cnt (b->bit_cnt))
+        return b->bit_cnt;
+      word = b->bits[idx] ^ flip;
+    }
+
+  /* Bits past the end of the last element are unused. */
+  bit = idx * ELEM_BITS + __builtin_ctzl (word);
+  return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,17 +375,49 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt - start)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      /* Find the next run of VALUE bits and see if it is long
+         enough. */
+      size_t first = find_next (b, start, value);
+      size_t end;
+
+      if (cnt > b->bit_cnt - first)
+        break;
+      end = find_next (b, first, !value);
+      if (end - first >= cnt)
+        return first;
+      start = end;
     }
   return BITMAP_ERROR;
 }
 
+/* Like bitmap_scan(), but starts at *CURSOR instead of a fixed
+   index and wraps around to the beginning of B if no group is
+   found after it.  On success, advances *CURSOR just past the
+   group found, so that successive calls hand out bits in order
+   instead of rescanning the front of B each time. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+                  bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+  ASSERT (cursor != NULL);
+
+  if (*cursor > b->bit_cnt)
+    *cursor = 0;
+  idx = bitmap_scan (b, *cursor, cnt, value);
+  if (idx == BITMAP_ERROR && *cursor > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    *cursor = idx + cnt;
+  return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -358,6 +467,26 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the bytes of B holding the CNT bits starting at START to
+   their place in FILE, which must hold a copy of B written by
+   bitmap_write().  Returns true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs, end;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  ofs = start / 8;
+  end = (start + cnt - 1) / 8 + 1;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, end - ofs, ofs)
+         == end - ofs;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
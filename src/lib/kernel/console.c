@@ -1,14 +1,15 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
-static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void vprintf_helper (const char *, size_t, void *);
+static void putbuf_have_lock (const char *, size_t);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -59,11 +60,27 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* Output of a vprintf() call.  It is formatted into DATA without
+   the console lock and written to the devices when the call
+   finishes or DATA fills up, so that each device sees a few
+   large writes instead of one per character.  Output that
+   overflows DATA takes the console lock at the first flush and
+   keeps it to the end, so it is still not mixed with other
+   threads' output. */
+#define CONSOLE_BUF_SIZE 128
+struct console_buf
+  {
+    char data[CONSOLE_BUF_SIZE];        /* Pending characters. */
+    size_t len;                         /* Number in DATA. */
+    int char_cnt;                       /* Total characters output. */
+    bool locked;                        /* Holding the console lock? */
+  };
+
 /* Enable console locking. */
 void
 console_init (void) 
 {
-  lock_init (&console_lock);
+  lock_init_named (&console_lock, "console");
   use_console_lock = true;
 }
 
@@ -125,13 +142,19 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct console_buf b;
 
-  acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  b.len = 0;
+  b.char_cnt = 0;
+  b.locked = false;
+  __vprintf (format, args, vprintf_helper, &b);
+
+  if (!b.locked)
+    acquire_console ();
+  putbuf_have_lock (b.data, b.len);
   release_console ();
 
-  return char_cnt;
+  return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,9 +163,8 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -153,8 +175,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,30 +183,54 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  char ch = c;
+
   acquire_console ();
-  putchar_have_lock (c);
+  putbuf_have_lock (&ch, 1);
   release_console ();
   
   return c;
 }
-
+
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (const char *s, size_t n, void *b_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct console_buf *b = b_;
+
+  b->char_cnt += n;
+  while (n > 0)
+    {
+      size_t copy;
+
+      if (b->len >= sizeof b->data)
+        {
+          if (!b->locked)
+            {
+              acquire_console ();
+              b->locked = true;
+            }
+          putbuf_have_lock (b->data, b->len);
+          b->len = 0;
+        }
+      copy = sizeof b->data - b->len;
+      if (copy > n)
+        copy = n;
+      memcpy (b->data + b->len, s, copy);
+      b->len += copy;
+      s += copy;
+      n -= copy;
+    }
 }
 
-/* Writes C to the vga display and serial port.
-   The caller has already acquired the console lock if
-   appropriate. */
+/* Writes the N characters in BUFFER to the vga display and
+   serial port.  The caller has already acquired the console lock
+   if appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  write_cnt += n;
+  serial_write (buffer, n);
+  vga_write (buffer, n);
 }
@@ -7,6 +7,8 @@
 
 #include "hash.h"
 #include "../debug.h"
+#include <stdint.h>
+#include <string.h>
 #include "threads/malloc.h"
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
@@ -18,6 +20,9 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void move_buckets (struct hash *);
+static void free_old_buckets (struct hash *);
+static struct list *next_bucket (struct hash *, struct list *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +33,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->move_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,12 +61,10 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
-  size_t i;
+  struct list *bucket;
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
-
       if (destructor != NULL) 
         while (!list_empty (bucket)) 
           {
@@ -70,6 +76,7 @@ hash_clear (struct hash *h, hash_action_func *destructor)
       list_init (bucket); 
     }    
 
+  free_old_buckets (h);
   h->elem_cnt = 0;
 }
 
@@ -88,6 +95,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free_old_buckets (h);
   free (h->buckets);
 }
 
@@ -162,13 +170,12 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct list *bucket;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -223,7 +230,8 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, i->bucket);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -257,56 +265,135 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_32_PRIME 16777619u
-#define FNV_32_BASIS 2166136261u
+/* MurmurHash3 (x86, 32-bit) constants. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+#define MURMUR_SEED 0x9747b28cu
+
+/* A word that may be read from any address. */
+typedef uint32_t unaligned_word __attribute__ ((may_alias, aligned (1)));
+
+/* Returns X rotated left by R bits. */
+static inline uint32_t
+rotl (uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+/* Scrambles word K before it is mixed into a MurmurHash3 state. */
+static inline uint32_t
+murmur_scramble (uint32_t k)
+{
+  k *= MURMUR_C1;
+  k = rotl (k, 15);
+  return k * MURMUR_C2;
+}
+
+/* MurmurHash3 finalizer: makes every bit of H affect every bit
+   of the result. */
+static inline uint32_t
+murmur_fmix (uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
-  const unsigned char *buf = buf_;
-  unsigned hash;
+  /* MurmurHash3 (x86, 32-bit), a word at a time.  x86 permits
+     unaligned loads, so BUF need not be aligned. */
+  const uint8_t *buf = buf_;
+  const uint8_t *end = buf + (size & ~(size_t) 3);
+  uint32_t hash, k;
 
   ASSERT (buf != NULL);
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  hash = MURMUR_SEED;
+  for (; buf < end; buf += 4)
+    {
+      hash ^= murmur_scramble (*(const unaligned_word *) buf);
+      hash = rotl (hash, 13);
+      hash = hash * 5 + 0xe6546b64u;
+    }
+
+  k = 0;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= buf[2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= buf[1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= buf[0];
+      hash ^= murmur_scramble (k);
+    }
 
-  return hash;
-} 
+  return murmur_fmix (hash ^ size);
+}
 
 /* Returns a hash of string S. */
 unsigned
-hash_string (const char *s_) 
+hash_string (const char *s)
 {
-  const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
-
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
-
-  return hash;
+  return hash_bytes (s, strlen (s));
 }
 
 /* Returns a hash of integer I. */
 unsigned
-hash_int (int i) 
+hash_int (int i)
+{
+  /* Consecutive or page-aligned integers differ in only a few
+     bits; the finalizer spreads those over the whole result. */
+  return murmur_fmix ((uint32_t) i * 0x9e3779b9u);
+}
+
+/* Returns a hash of pointer P. */
+unsigned
+hash_ptr (const void *p)
 {
-  return hash_bytes (&i, sizeof i);
+  return hash_int ((uintptr_t) p);
 }
-
-/* Returns the bucket in H that E belongs in. */
+
+/* Returns the bucket in H that E belongs in: its old bucket, if
+   H is being resized and that has not been moved yet, otherwise
+   its new one. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->move_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket in H that follows BUCKET, or a null pointer
+   if BUCKET is the last.  The new buckets come first, then the
+   old buckets not yet moved. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket) 
+{
+  if (bucket >= h->buckets && bucket < h->buckets + h->bucket_cnt)
+    {
+      if (++bucket < h->buckets + h->bucket_cnt)
+        return bucket;
+      return h->old_buckets != NULL ? &h->old_buckets[h->move_idx] : NULL;
+    }
+  return ++bucket < h->old_buckets + h->old_bucket_cnt ? bucket : NULL;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,21 +431,31 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets moved by each insertion or deletion while a table
+   is resized.  Resizing ends within a quarter as many operations
+   as there were old buckets, well before the table could need
+   another resize. */
+#define MOVE_BUCKETS 4
+
 /* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
+   ideal, or, if H is already being resized, carries that on.
+   This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
    we can still continue. */
 static void
 rehash (struct hash *h) 
 {
   size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
+  if (h->old_buckets != NULL) 
+    {
+      move_buckets (h);
+      return;
+    }
   old_bucket_cnt = h->bucket_cnt;
 
   /* Calculate the number of buckets to use now.
@@ -387,29 +484,48 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until all of
+     their elements have been moved. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = old_bucket_cnt;
+  h->move_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  move_buckets (h);
+}
+
+/* Moves each element of the next MOVE_BUCKETS old buckets in H
+   into the appropriate new bucket.  Frees the old buckets once
+   all have been moved. */
+static void
+move_buckets (struct hash *h) 
+{
+  size_t i;
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+  for (i = 0; i < MOVE_BUCKETS && h->move_idx < h->old_bucket_cnt; i++)
     {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
+      struct list *old_bucket = &h->old_buckets[h->move_idx++];
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
+      while (!list_empty (old_bucket)) 
         {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
+          struct list_elem *elem = list_pop_front (old_bucket);
+          unsigned hash = h->hash (list_elem_to_hash_elem (elem), h->aux);
+          list_push_front (&h->buckets[hash & (h->bucket_cnt - 1)], elem);
         }
     }
 
-  free (old_buckets);
+  if (h->move_idx >= h->old_bucket_cnt)
+    free_old_buckets (h);
+}
+
+/* Frees H's old buckets, which must be empty, ending any resize. */
+static void
+free_old_buckets (struct hash *h) 
+{
+  free (h->old_buckets);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->move_idx = 0;
 }
 
 /* Inserts E into BUCKET (in hash table H). */
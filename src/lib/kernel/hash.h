@@ -55,12 +55,20 @@ typedef bool hash_less_func (const struct hash_elem *a,
    data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
-/* Hash table. */
+/* Hash table.
+
+   Resizing is incremental: while the table is resized, it keeps
+   its old buckets too, and each insertion or deletion moves a
+   few of them into the new ones.  An element is in its old
+   bucket until that bucket is moved. */
 struct hash 
   {
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being moved, or null. */
+    size_t old_bucket_cnt;      /* Number of old buckets. */
+    size_t move_idx;            /* Old buckets before this are moved. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -99,5 +107,6 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
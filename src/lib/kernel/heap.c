@@ -0,0 +1,188 @@
+/* Pairing heap.
+
+   See heap.h for basic information.
+
+   This follows Fredman, Sedgewick, Sleator and Tarjan, "The
+   Pairing Heap: A New Form of Self-Adjusting Heap", Algorithmica
+   1 (1986).  The heap is a tree in which every element is no
+   less than its parent.  Each element's children form a list,
+   linked through NEXT, whose first member's PREV points to the
+   parent, so that an element can be cut out of the tree from
+   anywhere.  Removing the root merges its children in pairs from
+   left to right, then merges the pairs from right to left. */
+
+#include "heap.h"
+#include "../debug.h"
+
+/* Merges the trees rooted at A and B into one and returns its
+   root.  A and B must not be null.  Their siblings, if any, are
+   ignored. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *tmp = a;
+      a = b;
+      b = tmp;
+    }
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Merges the list of sibling trees starting at FIRST into one
+   tree and returns its root.  FIRST must not be null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root;
+
+  /* Merge in pairs, left to right, pushing each result onto
+     PAIRS, so that PAIRS ends up in reverse order. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          a = meld (h, a, b);
+        }
+      else
+        {
+          first = NULL;
+          a->prev = NULL;
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Merge the pairs, right to left. */
+  root = pairs;
+  pairs = pairs->next;
+  root->next = NULL;
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      root = meld (h, pairs, root);
+      pairs = next;
+    }
+  return root;
+}
+
+/* Cuts E, which must not be the root, and its subtree out of the
+   tree. */
+static void
+cut (struct heap_elem *e)
+{
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? meld (h, h->root, e) : e;
+  h->size++;
+}
+
+/* Removes the smallest element from H and returns it.  H must
+   not be empty. */
+struct heap_elem *
+heap_pop_min (struct heap *h)
+{
+  struct heap_elem *min = h->root;
+
+  ASSERT (!heap_empty (h));
+
+  h->root = min->child != NULL ? merge_pairs (h, min->child) : NULL;
+  h->size--;
+  min->child = NULL;
+  return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (!heap_empty (h));
+
+  if (e == h->root)
+    {
+      heap_pop_min (h);
+      return;
+    }
+  cut (e);
+  if (e->child != NULL)
+    h->root = meld (h, h->root, merge_pairs (h, e->child));
+  e->child = NULL;
+  h->size--;
+}
+
+/* Restores H's order after the value of E, which must be in H,
+   has decreased.  To move an element the other way, remove it,
+   change it, and insert it again. */
+void
+heap_decrease (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (!heap_empty (h));
+
+  if (e != h->root)
+    {
+      cut (e);
+      h->root = meld (h, h->root, e);
+    }
+}
+
+/* Returns the smallest element in H, or a null pointer if H is
+   empty. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
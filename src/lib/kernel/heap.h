@@ -0,0 +1,67 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+
+   A priority queue: finding the smallest element takes O(1)
+   time, insertion takes O(1), and removing the smallest element,
+   or any other, takes O(log n) amortized, as does moving an
+   element up after its key has decreased.  Unlike a binary heap
+   in an array, it needs no size fixed in advance.  Elements that
+   compare equal come out in no particular order; a caller that
+   wants them first come first served must break ties itself.
+
+   Like the lists in list.h, the heap does no dynamic
+   allocation.  Each structure that can be in a heap embeds a
+   struct heap_elem member, and heap_entry converts a pointer to
+   that member back to a pointer to the structure.
+
+   The heap does no locking of its own. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child, or null. */
+    struct heap_elem *next;     /* Next sibling, or null. */
+    struct heap_elem *prev;     /* Previous sibling, else parent. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) (HEAP_ELEM)                    \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Pairing heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Smallest element, or null. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for LESS. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_decrease (struct heap *, struct heap_elem *);
+
+struct heap_elem *heap_min (const struct heap *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,43 @@
+#include "histogram.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Empties H. */
+void
+histogram_init (struct histogram *h)
+{
+  memset (h->buckets, 0, sizeof h->buckets);
+}
+
+/* Counts a duration of NS nanoseconds in H. */
+void
+histogram_add (struct histogram *h, uint64_t ns)
+{
+  uint64_t us = ns / 1000;
+  int b = 0;
+
+  while (us != 0 && b < HISTOGRAM_BUCKETS - 1)
+    {
+      us >>= 1;
+      b++;
+    }
+  h->buckets[b]++;
+}
+
+/* Prints H's nonempty buckets on the current line, each as its
+   upper bound, or lower bound for the last, and its count. */
+void
+histogram_print (const struct histogram *h)
+{
+  int b;
+
+  for (b = 0; b < HISTOGRAM_BUCKETS; b++)
+    if (h->buckets[b] != 0)
+      {
+        if (b == HISTOGRAM_BUCKETS - 1)
+          printf (" >=%luus %"PRIu32, 1ul << (b - 1), h->buckets[b]);
+        else
+          printf (" <%luus %"PRIu32, 1ul << b, h->buckets[b]);
+      }
+}
@@ -0,0 +1,22 @@
+#ifndef __LIB_KERNEL_HISTOGRAM_H
+#define __LIB_KERNEL_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Histogram of durations, in log2 buckets of microseconds:
+   bucket 0 counts durations under 1 us, bucket B those under
+   2**B us, and the last bucket everything longer.  A histogram
+   in static storage starts out empty; others must be given to
+   histogram_init(). */
+#define HISTOGRAM_BUCKETS 24
+
+struct histogram
+  {
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+  };
+
+void histogram_init (struct histogram *);
+void histogram_add (struct histogram *, uint64_t ns);
+void histogram_print (const struct histogram *);
+
+#endif /* lib/kernel/histogram.h */
@@ -0,0 +1,159 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* The compressed data is a sequence of items, each starting with
+   a control byte C:
+
+     C < 32: a run of C + 1 literal bytes follows.
+
+     C >= 32: a back reference.  Its length less 2 is C >> 5, or if
+     that is 7, 7 plus the next byte.  One more byte follows, and
+     with the low 5 bits of C it gives the distance back, less 1,
+     from the end of the output to the copy's source.  The copy
+     may overlap its own output, which repeats a short pattern.
+
+   The compressor finds matches through a hash table of the last
+   position of each 3-byte sequence, so it runs in a single pass
+   and never searches: a match missed because of a collision just
+   costs some compression. */
+
+#define MAX_LIT 32                      /* Longest literal run. */
+#define MAX_OFF 8192                    /* Farthest back a match reaches. */
+#define MAX_REF (2 + 7 + 255)           /* Longest match. */
+
+/* Returns the hash of the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the SIZE bytes at SRC, which must be between 1 and
+   LZ_MAX_LEN, into DST, using S as working memory.  Returns the
+   length of the compressed data, or 0 if it would be longer than
+   DST_MAX bytes. */
+size_t
+lz_compress (struct lz_state *s, const void *src_, size_t size,
+             void *dst_, size_t dst_max)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0;                /* Next input byte. */
+  size_t op = 1;                /* Next output byte, after a control. */
+  size_t lit = 0;               /* Length of current literal run. */
+
+  ASSERT (size > 0 && size <= LZ_MAX_LEN);
+
+  /* The table holds positions plus 1, so that 0 means none. */
+  memset (s->table, 0, sizeof s->table);
+  while (ip < size)
+    {
+      if (ip + 2 < size)
+        {
+          unsigned h = hash3 (src + ip);
+          size_t ref = s->table[h];
+
+          s->table[h] = ip + 1;
+          if (ref-- != 0 && ip - ref <= MAX_OFF
+              && src[ref] == src[ip] && src[ref + 1] == src[ip + 1]
+              && src[ref + 2] == src[ip + 2])
+            {
+              size_t off = ip - ref - 1;
+              size_t max = size - ip < MAX_REF ? size - ip : MAX_REF;
+              size_t len = 3;
+
+              while (len < max && src[ref + len] == src[ip + len])
+                len++;
+
+              /* Close the literal run, dropping its control byte
+                 if it is empty. */
+              if (lit > 0)
+                dst[op - lit - 1] = lit - 1;
+              else
+                op--;
+              if (op + (len - 2 < 7 ? 2 : 3) > dst_max)
+                return 0;
+              if (len - 2 < 7)
+                dst[op++] = off >> 8 | (len - 2) << 5;
+              else
+                {
+                  dst[op++] = off >> 8 | 7 << 5;
+                  dst[op++] = len - 2 - 7;
+                }
+              dst[op++] = off & 0xff;
+
+              /* Control byte of the next literal run. */
+              op++;
+              lit = 0;
+              ip += len;
+              continue;
+            }
+        }
+
+      if (op >= dst_max)
+        return 0;
+      dst[op++] = src[ip++];
+      if (++lit == MAX_LIT)
+        {
+          dst[op - lit - 1] = lit - 1;
+          op++;
+          lit = 0;
+        }
+    }
+
+  if (lit > 0)
+    dst[op - lit - 1] = lit - 1;
+  else
+    op--;
+  return op;
+}
+
+/* Decompresses the SIZE bytes of data at SRC, produced by
+   lz_compress(), into DST.  Returns the length of the
+   decompressed data, or 0 if it would be longer than DST_MAX
+   bytes or SRC is not valid compressed data. */
+size_t
+lz_decompress (const void *src_, size_t size, void *dst_, size_t dst_max)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0;
+
+  while (ip < size)
+    {
+      unsigned c = src[ip++];
+
+      if (c < 32)
+        {
+          size_t len = c + 1;
+
+          if (ip + len > size || op + len > dst_max)
+            return 0;
+          memcpy (dst + op, src + ip, len);
+          ip += len;
+          op += len;
+        }
+      else
+        {
+          size_t len = c >> 5, back;
+
+          if (len == 7)
+            {
+              if (ip >= size)
+                return 0;
+              len += src[ip++];
+            }
+          if (ip >= size)
+            return 0;
+          back = ((c & 0x1f) << 8) + src[ip++] + 1;
+          len += 2;
+          if (back > op || op + len > dst_max)
+            return 0;
+          for (; len > 0; len--, op++)
+            dst[op] = dst[op - back];
+        }
+    }
+  return op;
+}
@@ -0,0 +1,26 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Fast LZ77 compression, in the format of LZF: a sequence of
+   literal runs and back references, with no header. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_HASH_BITS 10
+#define LZ_MAX_LEN 65535        /* Largest input to lz_compress(). */
+
+/* Working memory for lz_compress(), which is too large for a
+   kernel stack: a table of where each hash of 3 bytes last
+   occurred. */
+struct lz_state
+  {
+    uint16_t table[1 << LZ_HASH_BITS];
+  };
+
+size_t lz_compress (struct lz_state *, const void *src, size_t size,
+                    void *dst, size_t dst_max);
+size_t lz_decompress (const void *src, size_t size, void *dst,
+                      size_t dst_max);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,325 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.
+
+   This follows the algorithms in chapter 13 of Cormen et al.,
+   "Introduction to Algorithms", except that missing children are
+   null pointers rather than a shared sentinel, so removal tracks
+   the parent of the node that replaced the removed one
+   explicitly.  A null child counts as black. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Returns true if E is a red node, false if it is black or
+   null. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Makes V take U's place as a child of U's parent.  V may be
+   null. */
+static void
+transplant (struct rb_tree *t, struct rb_elem *u, struct rb_elem *v)
+{
+  if (u->parent == NULL)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Rotates X's right child up into X's place. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates X's left child up into X's place. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Returns the smallest element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->first = NULL;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+  bool leftmost = true;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (e, parent, t->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  if (leftmost)
+    t->first = e;
+
+  /* Restore the red-black properties: a red node's parent is
+     black, and every path down has the same number of black
+     nodes. */
+  while (is_red (e->parent))
+    {
+      struct rb_elem *p = e->parent;
+      struct rb_elem *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_elem *u = g->right;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->right)
+            {
+              rotate_left (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_elem *u = g->left;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->left)
+            {
+              rotate_right (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *xp;
+  bool removed_red = e->red;
+
+  if (t->first == e)
+    t->first = rb_next (e);
+
+  /* Unlink E.  X takes the place of the node actually removed
+     from its position, E itself or E's successor, and XP is X's
+     parent, since X may be null. */
+  if (e->left == NULL || e->right == NULL)
+    {
+      x = e->left != NULL ? e->left : e->right;
+      xp = e->parent;
+      transplant (t, e, x);
+    }
+  else
+    {
+      struct rb_elem *y = subtree_min (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        xp = y;
+      else
+        {
+          xp = y->parent;
+          transplant (t, y, y->right);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      transplant (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+  if (removed_red)
+    return;
+
+  /* A black node left its path: X carries an extra black until
+     it reaches a red node or the root. */
+  while (x != t->root && !is_red (x))
+    {
+      if (x == xp->left)
+        {
+          struct rb_elem *w = xp->right;
+          if (is_red (w))
+            {
+              w->red = false;
+              xp->red = true;
+              rotate_left (t, xp);
+              w = xp->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = xp;
+              xp = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->right))
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (t, w);
+                  w = xp->right;
+                }
+              w->red = xp->red;
+              xp->red = false;
+              w->right->red = false;
+              rotate_left (t, xp);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rb_elem *w = xp->left;
+          if (is_red (w))
+            {
+              w->red = false;
+              xp->red = true;
+              rotate_right (t, xp);
+              w = xp->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = xp;
+              xp = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->left))
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (t, w);
+                  w = xp->left;
+                }
+              w->red = xp->red;
+              xp->red = false;
+              w->left->red = false;
+              rotate_right (t, xp);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
+
+/* Returns the smallest element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (const struct rb_tree *t)
+{
+  return t->first;
+}
+
+/* Returns the smallest element in T that is not less than KEY,
+   which need not be in T, or a null pointer if every element is
+   less than KEY. */
+struct rb_elem *
+rb_lower_bound (const struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root, *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        bound = e;
+        e = e->left;
+      }
+  return bound;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the largest. */
+struct rb_elem *
+rb_next (const struct rb_elem *e)
+{
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t)
+{
+  return t->root == NULL;
+}
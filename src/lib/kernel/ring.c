@@ -0,0 +1,140 @@
+#include "ring.h"
+#include <debug.h>
+#include <string.h>
+
+/* Compiler barrier.  Both ends of a ring run on the same CPU, so
+   keeping the compiler from moving the data copies past the
+   HEAD or TAIL update is all the ordering needed. */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Reads *P, which the other end of the ring may change. */
+static inline unsigned
+read_once (const unsigned *p)
+{
+  return *(const volatile unsigned *) p;
+}
+
+/* Initializes R to use BUF, which must hold CAPACITY elements of
+   ELEM_SIZE bytes.  CAPACITY must be a power of 2. */
+void
+ring_init (struct ring *r, void *buf, size_t elem_size, unsigned capacity)
+{
+  ASSERT (r != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (elem_size > 0);
+  ASSERT (capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+  r->buf = buf;
+  r->elem_size = elem_size;
+  r->capacity = capacity;
+  r->head = r->tail = 0;
+}
+
+/* Returns the number of elements in R. */
+unsigned
+ring_count (const struct ring *r)
+{
+  return read_once (&r->head) - read_once (&r->tail);
+}
+
+/* Returns the number of elements that R has room for. */
+unsigned
+ring_space (const struct ring *r)
+{
+  return r->capacity - ring_count (r);
+}
+
+/* Returns true if R holds no elements. */
+bool
+ring_empty (const struct ring *r)
+{
+  return ring_count (r) == 0;
+}
+
+/* Returns true if R has no room for another element. */
+bool
+ring_full (const struct ring *r)
+{
+  return ring_space (r) == 0;
+}
+
+/* Copies CNT elements between BUF and R's slots starting at
+   position POS, which wrap around the end of R's buffer.  Copies
+   into R if TO_RING, out of it otherwise. */
+static void
+copy (const struct ring *r, unsigned pos, void *buf_, unsigned cnt,
+      bool to_ring)
+{
+  uint8_t *buf = buf_;
+  unsigned ofs = pos & (r->capacity - 1);
+  unsigned first = cnt < r->capacity - ofs ? cnt : r->capacity - ofs;
+  size_t first_bytes = first * r->elem_size;
+  size_t rest_bytes = (cnt - first) * r->elem_size;
+  uint8_t *slot = r->buf + ofs * r->elem_size;
+
+  if (to_ring)
+    {
+      memcpy (slot, buf, first_bytes);
+      memcpy (r->buf, buf + first_bytes, rest_bytes);
+    }
+  else
+    {
+      memcpy (buf, slot, first_bytes);
+      memcpy (buf + first_bytes, r->buf, rest_bytes);
+    }
+}
+
+/* Appends up to CNT elements from ELEMS to R, as many as fit, and
+   returns the number appended.  Only the producer may call this
+   function. */
+unsigned
+ring_put (struct ring *r, const void *elems, unsigned cnt)
+{
+  unsigned head = r->head;
+  unsigned space = r->capacity - (head - read_once (&r->tail));
+
+  if (cnt > space)
+    cnt = space;
+  copy (r, head, (void *) elems, cnt, true);
+  barrier ();
+  r->head = head + cnt;
+  return cnt;
+}
+
+/* Copies up to CNT elements from the front of R into ELEMS,
+   without removing them, and returns the number copied.  Only
+   the consumer may call this function. */
+unsigned
+ring_peek (const struct ring *r, void *elems, unsigned cnt)
+{
+  unsigned tail = r->tail;
+  unsigned count = read_once (&r->head) - tail;
+
+  if (cnt > count)
+    cnt = count;
+  barrier ();
+  copy (r, tail, elems, cnt, false);
+  return cnt;
+}
+
+/* Removes CNT elements, which must be present, from the front of
+   R.  Only the consumer may call this function. */
+void
+ring_skip (struct ring *r, unsigned cnt)
+{
+  ASSERT (cnt <= ring_count (r));
+
+  barrier ();
+  r->tail += cnt;
+}
+
+/* Removes up to CNT elements from the front of R into ELEMS and
+   returns the number removed.  Only the consumer may call this
+   function. */
+unsigned
+ring_get (struct ring *r, void *elems, unsigned cnt)
+{
+  cnt = ring_peek (r, elems, cnt);
+  ring_skip (r, cnt);
+  return cnt;
+}
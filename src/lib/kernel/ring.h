@@ -0,0 +1,42 @@
+#ifndef __LIB_KERNEL_RING_H
+#define __LIB_KERNEL_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Single-producer, single-consumer ring buffer.
+
+   A ring holds up to CAPACITY elements of ELEM_SIZE bytes each,
+   in a buffer supplied by the caller.  CAPACITY must be a power
+   of 2.  HEAD and TAIL count the elements ever put and taken,
+   wrapping around at UINT_MAX, so HEAD - TAIL is the number of
+   elements in the ring and no slot is wasted.
+
+   Only the producer advances HEAD and only the consumer
+   advances TAIL, each after it has finished moving the data, so
+   one producer and one consumer may use a ring at the same time
+   without locking or disabling interrupts, e.g. an interrupt
+   handler and a kernel thread.  Several producers, or several
+   consumers, must exclude each other by other means. */
+struct ring
+  {
+    uint8_t *buf;               /* CAPACITY * ELEM_SIZE bytes. */
+    size_t elem_size;           /* Bytes per element. */
+    unsigned capacity;          /* Elements; a power of 2. */
+    unsigned head;              /* Elements put so far. */
+    unsigned tail;              /* Elements taken so far. */
+  };
+
+void ring_init (struct ring *, void *buf, size_t elem_size,
+                unsigned capacity);
+unsigned ring_count (const struct ring *);
+unsigned ring_space (const struct ring *);
+bool ring_empty (const struct ring *);
+bool ring_full (const struct ring *);
+unsigned ring_put (struct ring *, const void *elems, unsigned cnt);
+unsigned ring_get (struct ring *, void *elems, unsigned cnt);
+unsigned ring_peek (const struct ring *, void *elems, unsigned cnt);
+void ring_skip (struct ring *, unsigned cnt);
+
+#endif /* lib/kernel/ring.h */
@@ -0,0 +1,13 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Access pattern hints for madvise(), for a range of memory, and
+   fadvise(), for an open file. */
+#define MADV_NORMAL 0           /* No particular pattern. */
+#define MADV_SEQUENTIAL 1       /* Read in order: read well ahead. */
+#define MADV_RANDOM 2           /* Read anywhere: do not read ahead. */
+#define MADV_WILLNEED 3         /* Needed soon: start reading it now. */
+#define MADV_DONTNEED 4         /* Not needed again soon. */
+#define MADV_HUGEPAGE 5         /* madvise() only: use 4 MB pages. */
+
+#endif /* lib/madvise.h */
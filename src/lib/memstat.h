@@ -0,0 +1,37 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stdint.h>
+
+/* Memory statistics, filled in by the memstat() system call. */
+
+/* Counters for one page allocator pool. */
+struct memstat_pool
+  {
+    uint32_t page_cnt;          /* Pages in the pool. */
+    uint32_t used_cnt;          /* Pages in use. */
+    uint32_t peak_cnt;          /* Most pages ever in use at once. */
+    uint32_t zeroed_cnt;        /* Free pages already zeroed. */
+    uint32_t fail_cnt;          /* Allocations that failed. */
+  };
+
+/* Counters for one malloc() block size. */
+struct memstat_desc
+  {
+    uint32_t block_size;        /* Size of each block in bytes. */
+    uint32_t arena_cnt;         /* Arenas allocated. */
+    uint32_t free_cnt;          /* Blocks on the free list. */
+    uint32_t fail_cnt;          /* Allocations that failed. */
+  };
+
+#define MEMSTAT_DESC_MAX 10
+
+struct memstat
+  {
+    struct memstat_pool kernel_pool;
+    struct memstat_pool user_pool;
+    uint32_t desc_cnt;          /* Entries used in DESCS. */
+    struct memstat_desc descs[MEMSTAT_DESC_MAX];
+  };
+
+#endif /* lib/memstat.h */
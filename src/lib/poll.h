@@ -0,0 +1,27 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* One source waited on by poll(). */
+struct pollfd
+  {
+    int fd;                     /* File descriptor, or POLLFD_AIO. */
+    short events;               /* Events of interest. */
+    short revents;              /* Events that occurred. */
+  };
+
+/* Events.  POLLHUP and POLLNVAL are reported whether asked for or
+   not. */
+#define POLLIN 0x01             /* Can read without waiting. */
+#define POLLOUT 0x04            /* Can write without waiting. */
+#define POLLHUP 0x10            /* Other end of a pipe is closed. */
+#define POLLNVAL 0x20           /* FD is not open. */
+
+/* A FD that stands for the process's asynchronous I/O, which is
+   readable when a finished request is waiting to be reaped by
+   aio_wait(). */
+#define POLLFD_AIO (-2)
+
+/* Most sources in one poll() call. */
+#define POLL_MAX 32
+
+#endif /* lib/poll.h */
@@ -81,3 +81,45 @@ random_ulong (void)
   random_bytes (&ul, sizeof ul);
   return ul;
 }
+
+/* Returns X rotated left by K bits. */
+static inline uint32_t
+rotl (uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+/* Initializes P with the given SEED.  The state words come from
+   successive outputs of the "splitmix32" mixer, so that
+   neighbouring seeds give unrelated sequences and the state is
+   never all zeros. */
+void
+prng_init (struct prng *p, uint32_t seed)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      uint32_t z = seed += 0x9e3779b9;
+      z = (z ^ (z >> 16)) * 0x85ebca6b;
+      z = (z ^ (z >> 13)) * 0xc2b2ae35;
+      p->s[i] = z ^ (z >> 16);
+    }
+}
+
+/* Returns the next 32 pseudo-random bits from P. */
+uint32_t
+prng_next (struct prng *p)
+{
+  uint32_t *s = p->s;
+  uint32_t result = rotl (s[1] * 5, 7) * 9;
+  uint32_t t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl (s[3], 11);
+  return result;
+}
@@ -2,9 +2,22 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* Fast generator ("xoshiro128**") for uses that need speed but
+   not unpredictability, such as random eviction, jitter and
+   benchmark data.  Each user keeps its own state, so there is no
+   locking and no shared stream. */
+struct prng
+  {
+    uint32_t s[4];
+  };
+
+void prng_init (struct prng *, uint32_t seed);
+uint32_t prng_next (struct prng *);
+
 #endif /* lib/random.h */
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -52,7 +53,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,21 +62,40 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+/* Swaps the elements of SIZE bytes at A and B, a word at a time
+   if they are word-aligned and a whole number of words long. */
 static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+swap (unsigned char *a, unsigned char *b, size_t size)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (((uintptr_t) a | (uintptr_t) b | size) % sizeof (uint32_t) == 0)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      uint32_t *wa = (uint32_t *) a;
+      uint32_t *wb = (uint32_t *) b;
+
+      for (i = 0; i < size / sizeof (uint32_t); i++)
+        {
+          uint32_t t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
     }
+  else
+    for (i = 0; i < size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
+}
+
+/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
+   with elements of SIZE bytes each. */
+static void
+do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+{
+  swap (array + (a_idx - 1) * size, array + (b_idx - 1) * size, size);
 }
 
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
@@ -122,33 +142,143 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
     }
 }
 
+/* Heapsorts ARRAY, which contains CNT elements of SIZE bytes
+   each, using COMPARE to compare elements, passing AUX as
+   auxiliary data. */
+static void
+heap_sort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux) 
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (array, 1, i, size);
+      heapify (array, 1, i - 1, size, compare, aux); 
+    }
+}
+
+/* Partitions no larger than this are insertion sorted. */
+#define INSERTION_SORT_MAX 12
+
+/* Insertion sorts ARRAY, which contains CNT elements of SIZE
+   bytes each, using COMPARE to compare elements, passing AUX as
+   auxiliary data. */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux) 
+{
+  unsigned char *end = array + cnt * size;
+  unsigned char *p, *q;
+
+  for (p = array + size; p < end; p += size)
+    for (q = p; q > array && compare (q - size, q, aux) > 0; q -= size)
+      swap (q - size, q, size);
+}
+
+/* Introsorts ARRAY, which contains CNT elements of SIZE bytes
+   each, using COMPARE to compare elements, passing AUX as
+   auxiliary data.  Quicksorts with a median-of-three pivot until
+   partitions are small enough to insertion sort, or until DEPTH
+   levels of partitioning have failed to get them there, which
+   only adversarial input does, and then heapsorts.  Recurses
+   only into the smaller side of each partition, so the stack
+   stays O(lg n). */
+static void
+introsort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux, unsigned depth) 
+{
+  while (cnt > INSERTION_SORT_MAX)
+    {
+      unsigned char *lo = array;
+      unsigned char *mid = array + cnt / 2 * size;
+      unsigned char *hi = array + (cnt - 1) * size;
+      unsigned char *i, *j;
+      size_t left_cnt, right_cnt;
+
+      if (depth-- == 0)
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Order LO <= MID <= HI, then use MID as the pivot, moved
+         to LO.  HI stops the upward scan and the pivot itself
+         stops the downward one. */
+      if (compare (mid, lo, aux) < 0)
+        swap (mid, lo, size);
+      if (compare (hi, mid, aux) < 0)
+        {
+          swap (hi, mid, size);
+          if (compare (mid, lo, aux) < 0)
+            swap (mid, lo, size);
+        }
+      swap (lo, mid, size);
+
+      i = lo;
+      j = hi + size;
+      for (;;)
+        {
+          do
+            i += size;
+          while (compare (i, lo, aux) < 0);
+          do
+            j -= size;
+          while (compare (j, lo, aux) > 0);
+          if (i >= j)
+            break;
+          swap (i, j, size);
+        }
+      swap (lo, j, size);
+
+      /* [LO, J) <= pivot at J <= (J, HI]. */
+      left_cnt = (j - lo) / size;
+      right_cnt = cnt - left_cnt - 1;
+      if (left_cnt < right_cnt)
+        {
+          introsort (lo, left_cnt, size, compare, aux, depth);
+          array = j + size;
+          cnt = right_cnt;
+        }
+      else
+        {
+          introsort (j + size, right_cnt, size, compare, aux, depth);
+          cnt = left_cnt;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  unsigned depth = 0;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
-
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
-    {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
-    }
+  /* Allow 2 lg n levels of partitioning before heapsorting. */
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  introsort (array, cnt, size, compare, aux, depth);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
@@ -5,6 +5,14 @@
 
 /* Standard functions. */
 int atoi (const char *);
+
+/* Memory allocation, in threads/malloc.c for the kernel and in
+   lib/user/malloc.c for user programs. */
+void *malloc (size_t) __attribute__ ((malloc));
+void *calloc (size_t, size_t) __attribute__ ((malloc));
+void *realloc (void *, size_t);
+void free (void *);
+
 void qsort (void *array, size_t cnt, size_t size,
             int (*compare) (const void *, const void *));
 void *bsearch (const void *key, const void *array, size_t cnt,
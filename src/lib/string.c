@@ -1,5 +1,85 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* memcpy(), memmove() and memset() move the bulk of a block a
+   32-bit word at a time with the x86 string instructions, after
+   moving single bytes until the destination is word-aligned.
+   Blocks shorter than STRING_WORD_MIN bytes are not worth the
+   setup and go byte by byte.  Interrupt and system call entry
+   clear the direction flag, so the upward copies can rely on it
+   being clear, and the downward copy sets it only within one asm
+   statement. */
+#define STRING_WORD_MIN 16
+
+/* The searching and comparing functions below read memory a
+   32-bit word at a time once their pointers are aligned, using
+   has_zero() to spot a null or matching byte in a whole word.
+   An aligned word never straddles a page boundary, so reading
+   the whole word that holds a string's terminator cannot fault
+   even if the bytes after it are unmapped. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+#define WORD_ALIGNED(P) (((uintptr_t) (P) & (sizeof (word_t) - 1)) == 0)
+#define ONES 0x01010101u
+
+/* Returns nonzero if any byte of W is zero. */
+static inline word_t
+has_zero (word_t w)
+{
+  return (w - ONES) & ~w & (ONES << 7);
+}
+
+/* Copies SIZE bytes from SRC to DST, lowest address first. */
+static inline void
+copy_up (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  if (size >= STRING_WORD_MIN)
+    {
+      size_t align = -(uintptr_t) dst & 3;
+      size_t words = (size - align) / 4;
+
+      size = (size - align) % 4;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (align) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+}
+
+/* Copies SIZE bytes from SRC to DST, highest address first. */
+static inline void
+copy_down (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  unsigned char *dst_end = dst + size;
+  const unsigned char *src_end = src + size;
+  size_t tail, words, rest;
+
+  tail = size >= STRING_WORD_MIN ? (uintptr_t) dst_end & 3 : size;
+  words = (size - tail) / 4;
+  rest = (size - tail) % 4;
+
+  /* Bytes down to an aligned end of DST, then words, then the
+     leftover bytes at the start. */
+  asm volatile ("std\n\t"
+                "decl %%edi\n\t"
+                "decl %%esi\n\t"
+                "movl %2, %%ecx\n\t"
+                "rep movsb\n\t"
+                "subl $3, %%edi\n\t"
+                "subl $3, %%esi\n\t"
+                "movl %3, %%ecx\n\t"
+                "rep movsl\n\t"
+                "addl $3, %%edi\n\t"
+                "addl $3, %%esi\n\t"
+                "movl %4, %%ecx\n\t"
+                "rep movsb\n\t"
+                "cld"
+                : "+D" (dst_end), "+S" (src_end)
+                : "g" (tail), "g" (words), "g" (rest)
+                : "ecx", "cc", "memory");
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,8 +92,7 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  copy_up (dst, src, size);
 
   return dst_;
 }
@@ -29,20 +108,12 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
+  if (dst <= src || dst >= src + size) 
+    copy_up (dst, src, size);
   else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+    copy_down (dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +129,19 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words; x86 allows B to be misaligned, and all
+     reads stay within the blocks. */
+  for (; size > 0 && !WORD_ALIGNED (a); size--, a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  for (; size >= sizeof (word_t); size -= sizeof (word_t))
+    {
+      if (*(const word_t *) a != *(const word_t *) b)
+        break;
+      a += sizeof (word_t);
+      b += sizeof (word_t);
+    }
+
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +162,22 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* Whole words can be compared only if A and B are aligned
+     alike, since a misaligned read of B could run past its
+     terminator onto an unmapped page. */
+  if (WORD_ALIGNED (a - b))
+    {
+      for (; !WORD_ALIGNED (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      while (*(const word_t *) a == *(const word_t *) b
+             && !has_zero (*(const word_t *) a))
+        {
+          a += sizeof (word_t);
+          b += sizeof (word_t);
+        }
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -98,6 +198,16 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && !WORD_ALIGNED (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= sizeof (word_t); size -= sizeof (word_t))
+    {
+      if (has_zero (*(const word_t *) block ^ (ch * ONES)))
+        break;
+      block += sizeof (word_t);
+    }
+
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +223,25 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  word_t pattern = (unsigned char) c * ONES;
 
   ASSERT (string != NULL);
 
+  /* Skip words holding neither C nor the terminator, then find
+     which byte it was. */
+  for (; !WORD_ALIGNED (string); string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  for (;;)
+    {
+      word_t w = *(const word_t *) string;
+      if (has_zero (w) || has_zero (w ^ pattern))
+        break;
+      string += sizeof (word_t);
+    }
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -279,11 +405,23 @@ void *
 memset (void *dst_, int value, size_t size) 
 {
   unsigned char *dst = dst_;
+  uint32_t fill = (unsigned char) value * 0x01010101u;
 
   ASSERT (dst != NULL || size == 0);
   
-  while (size-- > 0)
-    *dst++ = value;
+  if (size >= STRING_WORD_MIN)
+    {
+      size_t align = -(uintptr_t) dst & 3;
+      size_t words = (size - align) / 4;
+
+      size = (size - align) % 4;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (align) : "a" (fill) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (fill) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (fill) : "memory");
 
   return dst_;
 }
@@ -296,7 +434,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !WORD_ALIGNED (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const word_t *) p))
+    p += sizeof (word_t);
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -28,7 +28,48 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_COPY_FILE_RANGE,        /* Copy data from one file to another. */
+    SYS_RING_SETUP,             /* Register a system call ring. */
+    SYS_RING_ENTER,             /* Run system calls queued in the ring. */
+    SYS_MEMSTAT,                /* Report memory allocator statistics. */
+    SYS_FUTEX_WAIT,             /* Sleep on a word of user memory. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a word. */
+    SYS_READDIR_BATCH,          /* Read several directory entries. */
+    SYS_FALLOCATE,              /* Reserve disk space for a file. */
+    SYS_SCHED_EDF,              /* Set deadline scheduling parameters. */
+    SYS_CPU_QUOTA,              /* Limit a process tree's CPU time. */
+    SYS_THREAD_CREATE,          /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+    SYS_THREAD_EXIT,            /* End the calling thread. */
+    SYS_THREADSTAT,             /* Report a thread's CPU accounting. */
+    SYS_STATS,                  /* Report kernel-wide counters. */
+    SYS_SCHED_SETAFFINITY,      /* Choose the CPUs a thread runs on. */
+    SYS_SCHED_GETAFFINITY,      /* Report the CPUs a thread runs on. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_DUP2,                   /* Duplicate a file descriptor. */
+    SYS_SHM_CREATE,             /* Create a shared memory segment. */
+    SYS_SHM_REMOVE,             /* Remove a shared memory segment. */
+    SYS_SHM_MAP,                /* Map a shared memory segment. */
+    SYS_SHM_UNMAP,              /* Unmap a shared memory segment. */
+    SYS_AIO_READ,               /* Start an asynchronous read. */
+    SYS_AIO_WRITE,              /* Start an asynchronous write. */
+    SYS_AIO_WAIT,               /* Reap finished asynchronous I/O. */
+    SYS_POLL,                   /* Wait for any of several sources. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_DIRECT_IO,              /* Bypass the buffer cache for a fd. */
+    SYS_MADVISE,                /* Give a hint about use of memory. */
+    SYS_FADVISE,                /* Give a hint about use of a fd. */
+    SYS_TUNE,                   /* Get or set a tunable. */
+    SYS_MLOCK,                  /* Lock pages into memory. */
+    SYS_MUNLOCK,                /* Unlock pages locked by mlock. */
+    SYS_RSS_LIMIT,              /* Limit a process's resident pages. */
+    SYS_CHECKPOINT,             /* Save the process's state to a file. */
+    SYS_RESTORE                 /* Start a process from a checkpoint. */
   };
 
 #endif /* lib/syscall-nr.h */
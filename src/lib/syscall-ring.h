@@ -0,0 +1,32 @@
+#ifndef __LIB_SYSCALL_RING_H
+#define __LIB_SYSCALL_RING_H
+
+#include <stdint.h>
+
+/* A system call queued in a syscall ring. */
+struct syscall_entry
+  {
+    uint32_t nr;                /* SYS_* number. */
+    uint32_t args[3];           /* Arguments. */
+    int32_t result;             /* Return value, set by the kernel. */
+  };
+
+/* Submission ring, shared between a process and the kernel.
+
+   The process fills in ENTRIES[TAIL % SIZE] and increments TAIL
+   for each system call it queues, then calls ring_enter().  The
+   kernel carries out queued calls in order, stores each one's
+   return value in its entry, and increments HEAD past it.  Both
+   counters run freely and wrap around.  SIZE, given to
+   ring_setup(), must be a power of 2 no greater than
+   SYSCALL_RING_MAX. */
+struct syscall_ring
+  {
+    uint32_t head;              /* Next entry the kernel will run. */
+    uint32_t tail;              /* Next entry the process will fill. */
+    struct syscall_entry entries[];
+  };
+
+#define SYSCALL_RING_MAX 4096
+
+#endif /* lib/syscall-ring.h */
@@ -0,0 +1,75 @@
+#ifndef __LIB_SYSSTAT_H
+#define __LIB_SYSSTAT_H
+
+#include <stdint.h>
+#include <faultstat.h>
+#include <memstat.h>
+
+/* Kernel-wide counters, filled in by the sysstat() system call
+   while the system runs.  The same numbers are printed at
+   shutdown.
+
+   VERSION is bumped whenever the layout changes incompatibly;
+   new members are only ever added at the end, and the kernel
+   copies no more than the caller's buffer holds, so a program
+   built against an older layout keeps working. */
+
+#define SYSSTAT_VERSION 1
+
+#define SYSSTAT_BLOCK_MAX 8     /* Block devices reported. */
+#define SYSSTAT_IRQ_CNT 16      /* Hardware interrupt lines. */
+
+/* Counters for one block device. */
+struct sysstat_block
+  {
+    char name[16];              /* Device name, e.g. "hda1". */
+    uint64_t read_cnt;          /* Sectors read. */
+    uint64_t write_cnt;         /* Sectors written. */
+    uint64_t request_cnt;       /* Requests completed. */
+    uint64_t busy_ns;           /* Time in the driver. */
+  };
+
+struct sysstat
+  {
+    uint32_t version;           /* SYSSTAT_VERSION. */
+    uint32_t size;              /* Kernel's sizeof (struct sysstat). */
+
+    /* Scheduler.  Times are in timer ticks. */
+    int64_t ticks;              /* Ticks since boot. */
+    int64_t idle_ticks;         /* Spent in the idle thread. */
+    int64_t kernel_ticks;       /* Spent in kernel threads. */
+    int64_t user_ticks;         /* Spent in user programs. */
+    uint32_t thread_cnt;        /* Live threads. */
+    uint32_t ready_cnt;         /* Threads waiting for the CPU. */
+
+    /* Memory allocators. */
+    struct memstat mem;
+
+    /* Block devices. */
+    uint32_t block_cnt;         /* Entries used in BLOCKS. */
+    struct sysstat_block blocks[SYSSTAT_BLOCK_MAX];
+
+    /* Interrupts. */
+    uint64_t intr_cnt;          /* All interrupts and exceptions. */
+    uint64_t irq_cnt[SYSSTAT_IRQ_CNT]; /* Per hardware line. */
+
+    /* File system buffer cache, zero without a file system. */
+    uint64_t cache_hit_cnt;     /* Lookups found in the cache. */
+    uint64_t cache_miss_cnt;    /* Lookups read from disk. */
+
+    /* Page faults, zero without virtual memory. */
+    struct faultstat faults;    /* Whole system. */
+    struct faultstat proc_faults; /* Calling process. */
+
+    /* More buffer cache counters. */
+    uint64_t cache_ahead_cnt;   /* Sectors read ahead. */
+    uint64_t cache_ahead_hit_cnt; /* Read-ahead sectors later used. */
+    uint64_t cache_evict_clean_cnt; /* Clean entries evicted. */
+    uint64_t cache_evict_dirty_cnt; /* Dirty entries written and evicted. */
+    uint64_t cache_flush_cnt;   /* Flushes of the whole cache. */
+    uint64_t cache_flush_write_cnt; /* Sectors written by flushes. */
+    uint64_t cache_throttle_cnt; /* Writes slowed for write-back. */
+    uint64_t cache_throttle_ticks; /* Timer ticks they slept. */
+  };
+
+#endif /* lib/sysstat.h */
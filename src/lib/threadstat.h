@@ -0,0 +1,31 @@
+#ifndef __LIB_THREADSTAT_H
+#define __LIB_THREADSTAT_H
+
+#include <stdint.h>
+
+/* Hardware events counted per thread with the kernel's "-pmu"
+   option.  Event E is also general-purpose counter E, which user
+   programs may read directly with RDPMC under "-pmu=user". */
+enum pmu_event
+  {
+    PMU_CYCLES,                 /* Unhalted core cycles. */
+    PMU_INSTRUCTIONS,           /* Instructions retired. */
+    PMU_LLC_MISSES,             /* Last-level cache misses. */
+    PMU_BRANCH_MISSES,          /* Mispredicted branches retired. */
+    PMU_EVENT_CNT
+  };
+
+/* Per-thread CPU accounting, kept by the scheduler and filled in
+   by the threadstat() system call.  Times are in timer ticks. */
+struct threadstat
+  {
+    int64_t user_ticks;         /* Running in user mode. */
+    int64_t kernel_ticks;       /* Running in the kernel. */
+    int64_t ready_ticks;        /* Ready but waiting for the CPU. */
+    int64_t blocked_ticks;      /* Blocked, including sleeping. */
+    uint32_t voluntary_cnt;     /* Switches away by blocking. */
+    uint32_t involuntary_cnt;   /* Switches away while still ready. */
+    uint64_t pmu[PMU_EVENT_CNT]; /* Hardware events, zero without -pmu. */
+  };
+
+#endif /* lib/threadstat.h */
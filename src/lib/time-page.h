@@ -0,0 +1,24 @@
+#ifndef __LIB_TIME_PAGE_H
+#define __LIB_TIME_PAGE_H
+
+#include <stdint.h>
+
+/* Time page, mapped read-only at TIME_PAGE in every process.
+
+   The kernel updates it on every timer tick, so a process can
+   read the time without a system call.  SEQ is odd while an
+   update is in progress: a reader samples SEQ, reads the other
+   members, and starts over if SEQ was odd or has changed. */
+struct time_page
+  {
+    uint32_t seq;               /* Update sequence number. */
+    uint32_t freq;              /* Timer ticks per second. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    uint32_t boot_time;         /* Seconds since the epoch at boot. */
+  };
+
+/* User virtual address of the time page, just below the start of
+   the executable's text. */
+#define TIME_PAGE ((const volatile struct time_page *) 0x08047000)
+
+#endif /* lib/time-page.h */
@@ -1,8 +1,110 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <synch.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* Output buffering.
+
+   Output to each of the first STDIO_HANDLES handles collects in a
+   buffer of STDIO_BUF_SIZE bytes, allocated on first use, and is
+   written out when the buffer fills or fflush() is called.  The
+   console, STDOUT_FILENO, is line buffered instead: it is also
+   flushed at the end of every line.  The system call wrappers in
+   lib/user/syscall.c flush a handle before it is read, seeked,
+   closed or replaced by dup2(), flush the console before reading
+   from the keyboard, and flush everything before exec() and
+   exit(), so that buffering is seldom visible.  Output written
+   with write() itself is not buffered, and so can overtake
+   buffered output unless the handle is flushed first.  A process
+   killed by the kernel loses what is still buffered. */
+
+#define STDIO_HANDLES 16                /* Handles with buffers. */
+#define STDIO_BUF_SIZE 4096             /* Size of each buffer. */
+
+/* A handle's output buffer. */
+struct stdio_buf
+  {
+    char *data;                 /* STDIO_BUF_SIZE bytes, or null. */
+    size_t len;                 /* Bytes in DATA. */
+  };
+
+static struct stdio_buf bufs[STDIO_HANDLES];
+static struct mutex stdio_mutex = MUTEX_INITIALIZER;
+
+/* Writes out HANDLE's buffered output.  stdio_mutex must be
+   held. */
+static void
+flush_buf (int handle)
+{
+  struct stdio_buf *b = &bufs[handle];
+
+  if (b->len > 0)
+    write (handle, b->data, b->len);
+  b->len = 0;
+}
+
+/* Writes out the buffered output for HANDLE, or for every handle
+   if HANDLE is -1.  Returns 0. */
+int
+fflush (int handle)
+{
+  int i;
+
+  mutex_lock (&stdio_mutex);
+  for (i = 0; i < STDIO_HANDLES; i++)
+    if (i == handle || handle == -1)
+      flush_buf (i);
+  mutex_unlock (&stdio_mutex);
+  return 0;
+}
+
+/* Writes the SIZE bytes in BUFFER to HANDLE through its output
+   buffer, if it has one. */
+static void
+buffered_write (int handle, const char *buffer, size_t size)
+{
+  struct stdio_buf *b;
+  bool newline;
+
+  if (handle < 0 || handle >= STDIO_HANDLES)
+    {
+      write (handle, buffer, size);
+      return;
+    }
+
+  mutex_lock (&stdio_mutex);
+  b = &bufs[handle];
+  if (b->data == NULL)
+    b->data = malloc (STDIO_BUF_SIZE);
+  if (b->data == NULL)
+    {
+      mutex_unlock (&stdio_mutex);
+      write (handle, buffer, size);
+      return;
+    }
+
+  newline = (handle == STDOUT_FILENO
+             && memchr (buffer, '\n', size) != NULL);
+  while (size > 0)
+    {
+      size_t n = STDIO_BUF_SIZE - b->len;
+
+      if (n > size)
+        n = size;
+      memcpy (b->data + b->len, buffer, n);
+      b->len += n;
+      buffer += n;
+      size -= n;
+      if (b->len == STDIO_BUF_SIZE)
+        flush_buf (handle);
+    }
+  if (newline)
+    flush_buf (handle);
+  mutex_unlock (&stdio_mutex);
+}
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
@@ -30,7 +132,7 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
+  buffered_write (STDOUT_FILENO, s, strlen (s));
   putchar ('\n');
 
   return 0;
@@ -41,7 +143,7 @@ int
 putchar (int c) 
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+  buffered_write (STDOUT_FILENO, &c2, 1);
   return c;
 }
 
@@ -54,7 +156,7 @@ struct vhprintf_aux
     int handle;         /* Output file handle. */
   };
 
-static void add_char (char, void *);
+static void add_chars (const char *, size_t, void *);
 static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
@@ -67,28 +169,39 @@ vhprintf (int handle, const char *format, va_list args)
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
-  __vprintf (format, args, add_char, &aux);
+  __vprintf (format, args, add_chars, &aux);
   flush (&aux);
   return aux.char_cnt;
 }
 
-/* Adds C to the buffer in AUX, flushing it if the buffer fills
-   up. */
+/* Adds the N characters in S to the buffer in AUX, flushing it
+   if the buffer fills up. */
 static void
-add_char (char c, void *aux_) 
+add_chars (const char *s, size_t n, void *aux_) 
 {
   struct vhprintf_aux *aux = aux_;
-  *aux->p++ = c;
-  if (aux->p >= aux->buf + sizeof aux->buf)
-    flush (aux);
-  aux->char_cnt++;
+
+  aux->char_cnt += n;
+  while (n > 0)
+    {
+      size_t copy = aux->buf + sizeof aux->buf - aux->p;
+
+      if (copy > n)
+        copy = n;
+      memcpy (aux->p, s, copy);
+      aux->p += copy;
+      s += copy;
+      n -= copy;
+      if (aux->p >= aux->buf + sizeof aux->buf)
+        flush (aux);
+    }
 }
 
-/* Flushes the buffer in AUX. */
+/* Flushes the buffer in AUX into its handle's output buffer. */
 static void
 flush (struct vhprintf_aux *aux)
 {
   if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
+    buffered_write (aux->handle, aux->buf, aux->p - aux->buf);
   aux->p = aux->buf;
 }
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <synch.h>
+#include <syscall.h>
+
+/* User memory allocator.
+
+   Memory comes from the heap, which sbrk() grows a page at a time
+   and which the kernel fills with zeros only on first touch.
+
+   Small requests, up to 1 kB, are rounded up to a power of 2 of
+   at least 16 bytes.  Each such size class has a list of free
+   blocks, which are carved out of pages dedicated to that size;
+   a page begins with a struct chunk giving the size.  So malloc()
+   and free() of a small block are a list push or pop, and the
+   page holding a block, and thus its size, is found by rounding
+   its address down.
+
+   A larger request gets a run of whole pages of its own, which
+   also begins with a struct chunk.  Freed runs go on a list and
+   are reused first fit, splitting off whatever is not needed;
+   the run at the top of the heap is instead given back to the
+   kernel.  Free space is never coalesced.
+
+   A single mutex protects everything.  It is a futex, so it
+   costs a system call only when threads actually contend for
+   it.  The user library has no thread-local storage, so there
+   are no per-thread caches of free blocks. */
+
+#define PAGE_SIZE 4096
+#define MIN_SHIFT 4                     /* Smallest class: 16 bytes. */
+#define MAX_SHIFT 10                    /* Largest class: 1 kB. */
+#define CLASS_CNT (MAX_SHIFT - MIN_SHIFT + 1)
+
+/* Header of a page of small blocks, or of a large block's run. */
+struct chunk
+  {
+    size_t size;                /* Block size, or bytes in the run. */
+    struct chunk *next;         /* Next free run, in free_runs. */
+  };
+
+/* Space taken by the header, keeping blocks 16-byte aligned. */
+#define HEADER_SIZE 16
+
+/* A free small block. */
+struct block
+  {
+    struct block *next;         /* Next free block of this size. */
+  };
+
+static struct block *free_blocks[CLASS_CNT];    /* By size class. */
+static struct chunk *free_runs;                 /* Free large runs. */
+static struct mutex heap_mutex = MUTEX_INITIALIZER;
+
+/* Returns the chunk containing block B. */
+static struct chunk *
+chunk_of (void *b)
+{
+  return (struct chunk *) ((uintptr_t) b & ~(uintptr_t) (PAGE_SIZE - 1));
+}
+
+/* Obtains a run of PAGE_CNT pages, reusing a free one if
+   possible.  Returns the run, or a null pointer if the heap
+   cannot grow.  heap_mutex must be held. */
+static struct chunk *
+get_run (size_t page_cnt)
+{
+  size_t size = page_cnt * PAGE_SIZE;
+  struct chunk **cp, *c;
+
+  if (page_cnt > INTPTR_MAX / PAGE_SIZE)
+    return NULL;
+
+  for (cp = &free_runs; *cp != NULL; cp = &(*cp)->next)
+    if ((*cp)->size >= size)
+      {
+        c = *cp;
+        *cp = c->next;
+        if (c->size > size)
+          {
+            struct chunk *rest = (struct chunk *) ((uint8_t *) c + size);
+            rest->size = c->size - size;
+            rest->next = free_runs;
+            free_runs = rest;
+            c->size = size;
+          }
+        return c;
+      }
+
+  c = sbrk (size);
+  if (c == NULL)
+    return NULL;
+  c->size = size;
+  return c;
+}
+
+/* Frees run C, giving it back to the kernel if it is at the top
+   of the heap.  heap_mutex must be held. */
+static void
+put_run (struct chunk *c)
+{
+  if ((uint8_t *) c + c->size == sbrk (0))
+    sbrk (-(intptr_t) c->size);
+  else
+    {
+      c->next = free_runs;
+      free_runs = c;
+    }
+}
+
+/* Returns the size class for SIZE bytes, or CLASS_CNT if SIZE is
+   too big for all of them. */
+static int
+size_class (size_t size)
+{
+  int class = 0;
+
+  while (class < CLASS_CNT && ((size_t) 1 << (class + MIN_SHIFT)) < size)
+    class++;
+  return class;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, or a
+   null pointer if memory is exhausted. */
+void *
+malloc (size_t size)
+{
+  int class = size_class (size);
+  void *p = NULL;
+
+  mutex_lock (&heap_mutex);
+  if (class < CLASS_CNT)
+    {
+      if (free_blocks[class] == NULL)
+        {
+          /* Carve a new page into blocks of this size. */
+          size_t block_size = (size_t) 1 << (class + MIN_SHIFT);
+          struct chunk *c = get_run (1);
+
+          if (c != NULL)
+            {
+              uint8_t *b;
+
+              c->size = block_size;
+              for (b = (uint8_t *) c + PAGE_SIZE - block_size;
+                   b >= (uint8_t *) c + HEADER_SIZE; b -= block_size)
+                {
+                  struct block *fb = (struct block *) b;
+                  fb->next = free_blocks[class];
+                  free_blocks[class] = fb;
+                }
+            }
+        }
+      if (free_blocks[class] != NULL)
+        {
+          p = free_blocks[class];
+          free_blocks[class] = free_blocks[class]->next;
+        }
+    }
+  else if (size <= SIZE_MAX - HEADER_SIZE - PAGE_SIZE)
+    {
+      struct chunk *c = get_run ((size + HEADER_SIZE + PAGE_SIZE - 1)
+                                 / PAGE_SIZE);
+      if (c != NULL)
+        p = (uint8_t *) c + HEADER_SIZE;
+    }
+  mutex_unlock (&heap_mutex);
+  return p;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  p = malloc (a * b);
+  if (p != NULL)
+    memset (p, 0, a * b);
+  return p;
+}
+
+/* Returns the number of bytes the block at P can hold. */
+static size_t
+block_size (void *p)
+{
+  struct chunk *c = chunk_of (p);
+
+  if ((uint8_t *) p == (uint8_t *) c + HEADER_SIZE
+      && c->size > ((size_t) 1 << MAX_SHIFT))
+    return c->size - HEADER_SIZE;
+  return c->size;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving
+   it in the process.  If successful, returns the new block;
+   on failure, returns a null pointer.  A call with null
+   OLD_BLOCK is equivalent to malloc(NEW_SIZE).  A call with
+   zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  void *new_block;
+  size_t old_size;
+
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  old_size = block_size (old_block);
+  if (new_size <= old_size)
+    return old_block;
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block, old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct chunk *c;
+
+  if (p == NULL)
+    return;
+  c = chunk_of (p);
+  mutex_lock (&heap_mutex);
+  if ((uint8_t *) p == (uint8_t *) c + HEADER_SIZE
+      && c->size > ((size_t) 1 << MAX_SHIFT))
+    put_run (c);
+  else
+    {
+      struct block *b = p;
+      int class = size_class (c->size);
+
+      b->next = free_blocks[class];
+      free_blocks[class] = b;
+    }
+  mutex_unlock (&heap_mutex);
+}
@@ -3,5 +3,6 @@
 
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
+int fflush (int handle);
 
 #endif /* lib/user/stdio.h */
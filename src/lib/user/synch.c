@@ -0,0 +1,105 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* The mutex is the three-state design from Drepper, "Futexes Are
+   Tricky": an uncontended lock or unlock is a single atomic
+   instruction, and only a thread that finds the mutex held, or
+   that releases it while others wait, makes a system call.
+
+   A condition variable is a sequence number.  A waiter samples it
+   before releasing the mutex and sleeps only if no signal has
+   bumped it since, so a signal between the two cannot be lost.
+   Wakeups may be spurious, so callers must recheck their
+   condition in a loop. */
+
+/* If *P equals OLD, stores NEW into it.  Returns the previous
+   value of *P. */
+static inline int
+cmpxchg (volatile int *p, int old, int new)
+{
+  int prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p) : "r" (new), "0" (old) : "memory");
+  return prev;
+}
+
+/* Stores NEW into *P and returns the previous value. */
+static inline int
+xchg (volatile int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+void
+mutex_init (struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock (struct mutex *m)
+{
+  int c = cmpxchg (&m->state, 0, 1);
+
+  if (c == 0)
+    return;
+
+  /* Mark the mutex contended, then sleep until it is free. */
+  if (c != 2)
+    c = xchg (&m->state, 2);
+  while (c != 0)
+    {
+      futex_wait (&m->state, 2);
+      c = xchg (&m->state, 2);
+    }
+}
+
+bool
+mutex_trylock (struct mutex *m)
+{
+  return cmpxchg (&m->state, 0, 1) == 0;
+}
+
+void
+mutex_unlock (struct mutex *m)
+{
+  if (xchg (&m->state, 0) == 2)
+    futex_wake (&m->state, 1);
+}
+
+void
+condvar_init (struct condvar *cv)
+{
+  cv->seq = 0;
+}
+
+void
+condvar_wait (struct condvar *cv, struct mutex *m)
+{
+  int seq = cv->seq;
+
+  mutex_unlock (m);
+  futex_wait (&cv->seq, seq);
+
+  /* Others may have been woken with us, so take the mutex as
+     contended to make sure our unlock wakes the next one. */
+  while (xchg (&m->state, 2) != 0)
+    futex_wait (&m->state, 2);
+}
+
+void
+condvar_signal (struct condvar *cv)
+{
+  asm volatile ("lock incl %0" : "+m" (cv->seq) : : "memory");
+  futex_wake (&cv->seq, 1);
+}
+
+void
+condvar_broadcast (struct condvar *cv)
+{
+  asm volatile ("lock incl %0" : "+m" (cv->seq) : : "memory");
+  futex_wake (&cv->seq, INT_MAX);
+}
@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutex built on futex_wait() and futex_wake().  Locking and
+   unlocking an uncontended mutex do not enter the kernel. */
+struct mutex
+  {
+    volatile int state;         /* 0: free, 1: held, 2: held, waiters. */
+  };
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable for use with a struct mutex. */
+struct condvar
+  {
+    volatile int seq;           /* Incremented by every signal. */
+  };
+
+#define CONDVAR_INITIALIZER { 0 }
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/synch.h */
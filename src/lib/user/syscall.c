@@ -1,31 +1,66 @@
+#include <checkpoint.h>
+#include <stdio.h>
 #include <syscall.h>
+#include <time-page.h>
 #include "../syscall-nr.h"
 
+/* True if system calls should enter the kernel with SYSENTER
+   instead of "int $0x30".  Set by syscall_detect(). */
+static bool use_sysenter;
+
+/* Uses SYSENTER for system calls if the CPU supports it.  The
+   kernel enables it on every CPU that does.  Called by _start()
+   before main(). */
+void
+syscall_detect (void)
+{
+  unsigned eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  use_sysenter = (edx & (1u << 11)) != 0;
+}
+
+/* Enters the kernel, after the system call number and arguments
+   have been pushed, and then pops ARGS bytes of them.  SYSENTER
+   returns to the address in %edx with the stack pointer in %ecx
+   (see userprog/sysenter.S); the trap gate is the fallback. */
+#define SYSCALL_ENTER(BYTES)                                    \
+            "cmpb $0, %[fast]; je 1f; "                         \
+            "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "    \
+            "1: int $0x30; "                                    \
+            "2: addl $" #BYTES ", %%esp"
+
+/* Registers and flags SYSCALL_ENTER does not preserve. */
+#define SYSCALL_CLOBBERS "ecx", "edx", "cc", "memory"
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_ENTER (4)              \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter)                      \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg0]; pushl %[number]; "                 \
+             SYSCALL_ENTER (8)                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [fast] "m" (use_sysenter)                      \
+               : SYSCALL_CLOBBERS);                             \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -35,12 +70,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER (12)             \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
-                 [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+                 [arg1] "r" (ARG1),                             \
+                 [fast] "m" (use_sysenter)                      \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
@@ -51,19 +87,21 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER (16)             \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
-                 [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+                 [arg2] "r" (ARG2),                             \
+                 [fast] "m" (use_sysenter)                      \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
 void
 halt (void) 
 {
+  fflush (-1);
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +109,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (-1);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,6 +117,7 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  fflush (-1);
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
@@ -114,6 +154,7 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  fflush (fd == STDIN_FILENO ? STDOUT_FILENO : fd);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -126,18 +167,21 @@ write (int fd, const void *buffer, unsigned size)
 void
 seek (int fd, unsigned position) 
 {
+  fflush (fd);
   syscall2 (SYS_SEEK, fd, position);
 }
 
 unsigned
 tell (int fd) 
 {
+  fflush (fd);
   return syscall1 (SYS_TELL, fd);
 }
 
 void
 close (int fd)
 {
+  fflush (fd);
   syscall1 (SYS_CLOSE, fd);
 }
 
@@ -182,3 +226,312 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+bool
+ring_setup (struct syscall_ring *ring, unsigned size)
+{
+  return syscall2 (SYS_RING_SETUP, ring, size);
+}
+
+int
+ring_enter (unsigned cnt)
+{
+  return syscall1 (SYS_RING_ENTER, cnt);
+}
+
+int
+memstat (struct memstat *stat)
+{
+  return syscall1 (SYS_MEMSTAT, stat);
+}
+
+int
+futex_wait (volatile int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (volatile int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+int
+readdir_batch (int fd, struct dirent *ents, unsigned cnt)
+{
+  return syscall3 (SYS_READDIR_BATCH, fd, ents, cnt);
+}
+
+bool
+fallocate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FALLOCATE, fd, length);
+}
+
+bool
+sched_edf (unsigned period, unsigned budget)
+{
+  return syscall2 (SYS_SCHED_EDF, period, budget);
+}
+
+bool
+cpu_quota (unsigned quota, unsigned period)
+{
+  return syscall2 (SYS_CPU_QUOTA, quota, period);
+}
+
+/* Where a thread made by thread_create() starts, with FUNC and
+   AUX on its stack as if called. */
+static void NO_RETURN
+thread_start (int (*func) (void *), void *aux)
+{
+  thread_exit (func (aux));
+}
+
+tid_t
+thread_create (int (*func) (void *), void *aux)
+{
+  return syscall3 (SYS_THREAD_CREATE, thread_start, func, aux);
+}
+
+int
+thread_join (tid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+void
+thread_exit (int value)
+{
+  syscall1 (SYS_THREAD_EXIT, value);
+  NOT_REACHED ();
+}
+
+bool
+threadstat (tid_t tid, struct threadstat *stats)
+{
+  return syscall2 (SYS_THREADSTAT, tid, stats);
+}
+
+unsigned
+sysstat (struct sysstat *stat, unsigned size)
+{
+  return syscall2 (SYS_STATS, stat, size);
+}
+
+bool
+sched_setaffinity (unsigned mask)
+{
+  return syscall1 (SYS_SCHED_SETAFFINITY, mask);
+}
+
+unsigned
+sched_getaffinity (void)
+{
+  return syscall0 (SYS_SCHED_GETAFFINITY);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+dup2 (int old_fd, int new_fd)
+{
+  fflush (old_fd);
+  fflush (new_fd);
+  return syscall2 (SYS_DUP2, old_fd, new_fd);
+}
+
+int
+aio_read (const struct aiocb *cb)
+{
+  return syscall1 (SYS_AIO_READ, cb);
+}
+
+int
+aio_write (const struct aiocb *cb)
+{
+  return syscall1 (SYS_AIO_WRITE, cb);
+}
+
+int
+aio_wait (struct aio_event *events, unsigned cnt)
+{
+  return syscall2 (SYS_AIO_WAIT, events, cnt);
+}
+
+int
+poll (struct pollfd *fds, unsigned cnt, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, cnt, timeout);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+bool
+direct_io (int fd, bool direct)
+{
+  return syscall2 (SYS_DIRECT_IO, fd, (int) direct);
+}
+
+bool
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+mlock (void *addr, size_t length)
+{
+  return syscall2 (SYS_MLOCK, addr, length);
+}
+
+bool
+munlock (void *addr, size_t length)
+{
+  return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
+unsigned
+rss_limit (unsigned limit)
+{
+  return syscall1 (SYS_RSS_LIMIT, limit);
+}
+
+int
+checkpoint (const char *file)
+{
+  struct checkpoint_regs regs;
+  int retval;
+
+  /* Flush first, or a process restored from the checkpoint would
+     write out this one's buffered output again. */
+  fflush (-1);
+
+  /* Like setjmp(), save the registers that the call must
+     preserve and the address just past the system call, where a
+     process restored from the checkpoint resumes, on this same
+     stack, with 1 in %eax.  Operands in those registers come
+     back too. */
+  asm volatile
+    ("movl %%ebx, 0(%[regs]); movl %%esi, 4(%[regs]); "
+     "movl %%edi, 8(%[regs]); movl %%ebp, 12(%[regs]); "
+     "movl %%esp, 16(%[regs]); movl $3f, 20(%[regs]); "
+     "pushl %[regs]; pushl %[file]; pushl %[number]; "
+     SYSCALL_ENTER (12) "; 3:"
+       : "=a" (retval)
+       : [number] "i" (SYS_CHECKPOINT),
+         [file] "r" (file),
+         [regs] "r" (&regs),
+         [fast] "m" (use_sysenter)
+       : SYSCALL_CLOBBERS);
+  return retval;
+}
+
+pid_t
+restore (const char *file)
+{
+  fflush (-1);
+  return syscall1 (SYS_RESTORE, file);
+}
+
+bool
+fadvise (int fd, int advice)
+{
+  return syscall2 (SYS_FADVISE, fd, advice);
+}
+
+bool
+tune (const char *name, const unsigned *new_value, unsigned *old_value)
+{
+  return syscall3 (SYS_TUNE, name, new_value, old_value);
+}
+
+bool
+shm_create (const char *name, unsigned size)
+{
+  return syscall2 (SYS_SHM_CREATE, name, size);
+}
+
+bool
+shm_remove (const char *name)
+{
+  return syscall1 (SYS_SHM_REMOVE, name);
+}
+
+bool
+shm_map (const char *name, void *addr)
+{
+  return syscall2 (SYS_SHM_MAP, name, addr);
+}
+
+bool
+shm_unmap (void *addr)
+{
+  return syscall1 (SYS_SHM_UNMAP, addr);
+}
+
+int64_t
+clock_ticks (void)
+{
+  const volatile struct time_page *tp = TIME_PAGE;
+  uint32_t seq;
+  int64_t ticks;
+
+  do
+    {
+      seq = tp->seq;
+      asm volatile ("" : : : "memory");
+      ticks = tp->ticks;
+      asm volatile ("" : : : "memory");
+    }
+  while ((seq & 1) != 0 || seq != tp->seq);
+  return ticks;
+}
+
+unsigned
+clock_freq (void)
+{
+  return TIME_PAGE->freq;
+}
+
+unsigned
+clock_seconds (void)
+{
+  return TIME_PAGE->boot_time + clock_ticks () / clock_freq ();
+}
+
+uint64_t
+pmu_read (enum pmu_event event)
+{
+  uint64_t value;
+
+  asm volatile ("rdpmc" : "=A" (value) : "c" (event));
+  return value;
+}
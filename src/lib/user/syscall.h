@@ -2,12 +2,26 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <aio.h>
 #include <debug.h>
+#include <dirent.h>
+#include <iovec.h>
+#include <madvise.h>
+#include <memstat.h>
+#include <poll.h>
+#include <syscall-ring.h>
+#include <sysstat.h>
+#include <threadstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -19,6 +33,9 @@ typedef int mapid_t;
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Chooses how to enter the kernel.  Called at startup. */
+void syscall_detect (void);
+
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
@@ -45,4 +62,55 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+bool ring_setup (struct syscall_ring *, unsigned size);
+int ring_enter (unsigned cnt);
+int memstat (struct memstat *);
+int futex_wait (volatile int *addr, int expected);
+int futex_wake (volatile int *addr, int cnt);
+int readdir_batch (int fd, struct dirent *, unsigned cnt);
+bool fallocate (int fd, unsigned length);
+bool sched_edf (unsigned period, unsigned budget);
+bool cpu_quota (unsigned quota, unsigned period);
+tid_t thread_create (int (*func) (void *), void *aux);
+int thread_join (tid_t);
+void thread_exit (int value) NO_RETURN;
+bool threadstat (tid_t, struct threadstat *);
+unsigned sysstat (struct sysstat *, unsigned size);
+bool sched_setaffinity (unsigned mask);
+unsigned sched_getaffinity (void);
+bool pipe (int fds[2]);
+int dup2 (int old_fd, int new_fd);
+int aio_read (const struct aiocb *);
+int aio_write (const struct aiocb *);
+int aio_wait (struct aio_event *, unsigned cnt);
+int poll (struct pollfd *, unsigned cnt, int timeout);
+void *sbrk (intptr_t increment);
+bool direct_io (int fd, bool direct);
+bool madvise (void *addr, size_t length, int advice);
+bool mlock (void *addr, size_t length);
+bool munlock (void *addr, size_t length);
+unsigned rss_limit (unsigned limit);
+int checkpoint (const char *file);
+pid_t restore (const char *file);
+bool fadvise (int fd, int advice);
+bool tune (const char *name, const unsigned *new_value, unsigned *old_value);
+bool shm_create (const char *name, unsigned size);
+bool shm_remove (const char *name);
+bool shm_map (const char *name, void *addr);
+bool shm_unmap (void *addr);
+
+/* Clock, read from the time page without entering the kernel. */
+int64_t clock_ticks (void);
+unsigned clock_freq (void);
+unsigned clock_seconds (void);
+
+/* Hardware event counter, read with RDPMC without entering the
+   kernel.  Only under the kernel's "-pmu=user" option; otherwise
+   the process is killed. */
+uint64_t pmu_read (enum pmu_event);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,87 @@
+/* A thread repeatedly broadcasts a condition to N waiters and
+   waits for all of them to come back, measuring the cost of a
+   broadcast wakeup as the number of waiters grows. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_CNT 200
+
+struct broadcast
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition go;        /* Broadcast to start a round. */
+    struct condition ready;     /* Signaled when all have arrived. */
+    int waiter_cnt;             /* Number of waiters. */
+    int arrived;                /* Waiters waiting for GO. */
+    int round;                  /* Current round. */
+    struct semaphore exited;    /* Upped by each waiter at the end. */
+  };
+
+static void run_broadcast (int waiter_cnt);
+static thread_func waiter;
+
+void
+test_bench_condvar (void)
+{
+  run_broadcast (1);
+  run_broadcast (10);
+  run_broadcast (100);
+}
+
+/* Runs ROUND_CNT broadcasts to WAITER_CNT waiters. */
+static void
+run_broadcast (int waiter_cnt)
+{
+  struct broadcast b;
+  char name[32];
+  uint64_t start;
+  int i;
+
+  lock_init (&b.lock);
+  cond_init (&b.go);
+  cond_init (&b.ready);
+  b.waiter_cnt = waiter_cnt;
+  b.arrived = 0;
+  b.round = 0;
+  sema_init (&b.exited, 0);
+  for (i = 0; i < waiter_cnt; i++)
+    thread_create ("waiter", thread_get_priority (), waiter, &b);
+
+  start = bench_start ();
+  lock_acquire (&b.lock);
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      while (b.arrived < waiter_cnt)
+        cond_wait (&b.ready, &b.lock);
+      b.arrived = 0;
+      b.round++;
+      cond_broadcast (&b.go, &b.lock);
+    }
+  lock_release (&b.lock);
+  for (i = 0; i < waiter_cnt; i++)
+    sema_down (&b.exited);
+
+  snprintf (name, sizeof name, "condvar-broadcast-%d", waiter_cnt);
+  bench_report (name, ROUND_CNT, start);
+}
+
+static void
+waiter (void *b_)
+{
+  struct broadcast *b = b_;
+  int round;
+
+  lock_acquire (&b->lock);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      if (++b->arrived == b->waiter_cnt)
+        cond_signal (&b->ready, &b->lock);
+      while (b->round == round)
+        cond_wait (&b->go, &b->lock);
+    }
+  lock_release (&b->lock);
+  sema_up (&b->exited);
+}
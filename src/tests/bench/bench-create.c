@@ -0,0 +1,35 @@
+/* Creates threads that exit at once, one after another, measuring
+   thread creation and teardown. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 1000
+
+static thread_func quick;
+
+void
+test_bench_create (void)
+{
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  start = bench_start ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (thread_create ("quick", thread_get_priority (), quick, &done)
+          == TID_ERROR)
+        fail ("thread_create failed after %d threads", i);
+      sema_down (&done);
+    }
+  bench_report ("create-exit", THREAD_CNT, start);
+}
+
+static void
+quick (void *done)
+{
+  sema_up (done);
+}
@@ -0,0 +1,56 @@
+/* Two threads take turns holding a lock.  Each yields while
+   holding it, so the other is always waiting when it is released
+   and every release hands the lock over. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_CNT 5000
+
+struct handoff
+  {
+    struct lock lock;           /* Lock passed back and forth. */
+    struct semaphore done;      /* Upped when the other thread ends. */
+  };
+
+static void take_turns (struct lock *);
+static thread_func other_thread;
+
+void
+test_bench_lock (void)
+{
+  struct handoff h;
+  uint64_t start;
+
+  lock_init (&h.lock);
+  sema_init (&h.done, 0);
+  start = bench_start ();
+  thread_create ("other", thread_get_priority (), other_thread, &h);
+  take_turns (&h.lock);
+  sema_down (&h.done);
+  bench_report ("lock-handoff", 2 * ROUND_CNT, start);
+}
+
+/* Acquires LOCK and hands it over, ROUND_CNT times. */
+static void
+take_turns (struct lock *lock)
+{
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      lock_acquire (lock);
+      thread_yield ();
+      lock_release (lock);
+    }
+}
+
+static void
+other_thread (void *h_)
+{
+  struct handoff *h = h_;
+
+  take_turns (&h->lock);
+  sema_up (&h->done);
+}
@@ -0,0 +1,99 @@
+/* Exercises malloc() and free().  First, for each size class,
+   repeated allocate/free pairs measure the fast path and its
+   latency.  Then several threads each keep a set of blocks of
+   random sizes and random lifetimes, replacing a random one on
+   every step, which is closer to how the kernel really uses the
+   allocator. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PAIR_CNT 2000           /* Allocate/free pairs per size. */
+#define THREAD_CNT 4            /* Threads in the mixed test. */
+#define SLOT_CNT 64             /* Blocks kept by each thread. */
+#define STEP_CNT 5000           /* Replacements per thread. */
+#define MAX_SIZE 2048           /* Largest block in the mixed test. */
+
+static void run_pairs (size_t size, uint64_t samples[]);
+static thread_func mixer;
+
+void
+test_bench_malloc (void)
+{
+  static const size_t sizes[] =
+    {16, 32, 64, 128, 256, 512, 1024, 2048, 8192};
+  struct semaphore done;
+  uint64_t *samples;
+  uint64_t start;
+  size_t i;
+
+  samples = malloc (sizeof *samples * PAIR_CNT);
+  if (samples == NULL)
+    fail ("couldn't allocate latency samples");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    run_pairs (sizes[i], samples);
+  free (samples);
+
+  sema_init (&done, 0);
+  start = bench_start ();
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("mixer", thread_get_priority (), mixer, &done);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  bench_report ("malloc-mixed", (unsigned long long) THREAD_CNT * STEP_CNT,
+                start);
+}
+
+/* Allocates and frees a block of SIZE bytes PAIR_CNT times,
+   recording the latency of each pair in SAMPLES[]. */
+static void
+run_pairs (size_t size, uint64_t samples[])
+{
+  char name[32];
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < PAIR_CNT; i++)
+    {
+      uint64_t before = timer_ns ();
+      void *p = malloc (size);
+
+      if (p == NULL)
+        fail ("malloc (%zu) failed", size);
+      free (p);
+      samples[i] = timer_ns () - before;
+    }
+  snprintf (name, sizeof name, "malloc-free-%zu", size);
+  bench_report (name, PAIR_CNT, start);
+  bench_latency (name, samples, PAIR_CNT);
+}
+
+/* Replaces a random one of SLOT_CNT blocks by a block of random
+   size, STEP_CNT times, then frees everything. */
+static void
+mixer (void *done)
+{
+  void *slots[SLOT_CNT];
+  uint32_t state = thread_tid () * 2654435761u + 1;
+  int i;
+
+  for (i = 0; i < SLOT_CNT; i++)
+    slots[i] = NULL;
+  for (i = 0; i < STEP_CNT; i++)
+    {
+      void **slot = &slots[bench_random (&state) % SLOT_CNT];
+
+      free (*slot);
+      *slot = malloc (1 + bench_random (&state) % MAX_SIZE);
+      if (*slot == NULL)
+        fail ("malloc failed in mixed test");
+    }
+  for (i = 0; i < SLOT_CNT; i++)
+    free (slots[i]);
+  sema_up (done);
+}
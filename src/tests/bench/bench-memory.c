@@ -0,0 +1,79 @@
+/* Measures the memory that each kernel thread costs, by holding
+   THREAD_CNT threads blocked at once and comparing kernel pool
+   usage before and after creating them.  The result line
+
+     (bench-memory) bench footprint-thread struct-bytes=S
+       pool-bytes=B max-cnt=M
+
+   gives sizeof (struct thread), which shares its page with the
+   thread's kernel stack, the pool memory actually used per
+   thread, which includes anything malloc() allocated for it, and
+   how many such threads would fit in the free kernel pool. */
+
+#include <inttypes.h>
+#include <memstat.h>
+#include "tests/bench/bench.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+#define THREAD_CNT 64
+
+/* Shared with the blocked threads. */
+struct memory_bench
+  {
+    struct semaphore started;   /* Upped by each thread at start. */
+    struct semaphore release;   /* Upped to let a thread exit. */
+    struct semaphore done;      /* Upped by each thread at the end. */
+  };
+
+static thread_func blocker;
+
+void
+test_bench_memory (void)
+{
+  struct memory_bench b;
+  struct memstat before, after;
+  uint32_t per_thread, free_pages;
+  uint64_t start;
+  int i;
+
+  sema_init (&b.started, 0);
+  sema_init (&b.release, 0);
+  sema_init (&b.done, 0);
+
+  palloc_get_stats (&before);
+  start = bench_start ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (thread_create ("blocker", thread_get_priority (), blocker, &b)
+          == TID_ERROR)
+        fail ("thread_create failed after %d threads", i);
+      sema_down (&b.started);
+    }
+  bench_report ("footprint-thread", THREAD_CNT, start);
+  palloc_get_stats (&after);
+
+  per_thread = (after.kernel_pool.used_cnt - before.kernel_pool.used_cnt)
+               * PGSIZE / THREAD_CNT;
+  free_pages = before.kernel_pool.page_cnt - before.kernel_pool.used_cnt;
+  msg ("bench footprint-thread struct-bytes=%zu pool-bytes=%"PRIu32
+       " max-cnt=%"PRIu32, sizeof (struct thread), per_thread,
+       per_thread != 0 ? free_pages * PGSIZE / per_thread : 0);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_up (&b.release);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&b.done);
+}
+
+static void
+blocker (void *b_)
+{
+  struct memory_bench *b = b_;
+
+  sema_up (&b->started);
+  sema_down (&b->release);
+  sema_up (&b->done);
+}
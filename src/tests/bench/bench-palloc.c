@@ -0,0 +1,133 @@
+/* Exercises the page allocator.  palloc_get_multiple() is timed
+   for runs of several sizes with the kernel pool in three states:
+   as it is, with every other page of a region held, and with one
+   page in four held, which leaves holes of one and of three pages
+   that larger runs cannot use.  Then single pages are allocated
+   with and without PAL_ZERO to show what zeroing costs. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "devices/timer.h"
+
+#define REGION_PAGES 128        /* Pages fragmented. */
+#define ROUND_CNT 500           /* Allocate/free pairs per case. */
+
+static void fragment (void *pages[], size_t stride);
+static void unfragment (void *pages[]);
+static void run_multiple (const char *level, size_t page_cnt,
+                          uint64_t samples[]);
+static void run_zero (enum palloc_flags, const char *name,
+                      uint64_t samples[]);
+
+void
+test_bench_palloc (void)
+{
+  static const size_t strides[] = {0, 2, 4};
+  static const size_t page_cnts[] = {1, 2, 4, 8, 16};
+  void *pages[REGION_PAGES];
+  uint64_t *samples;
+  size_t i, j;
+
+  samples = malloc (sizeof *samples * ROUND_CNT);
+  if (samples == NULL)
+    fail ("couldn't allocate latency samples");
+
+  for (i = 0; i < sizeof strides / sizeof *strides; i++)
+    {
+      char level[16];
+
+      snprintf (level, sizeof level, "frag%zu", strides[i]);
+      fragment (pages, strides[i]);
+      for (j = 0; j < sizeof page_cnts / sizeof *page_cnts; j++)
+        run_multiple (level, page_cnts[j], samples);
+      unfragment (pages);
+    }
+
+  run_zero (0, "palloc-page", samples);
+  run_zero (PAL_ZERO, "palloc-page-zero", samples);
+  free (samples);
+}
+
+/* Allocates REGION_PAGES single pages into PAGES[], then frees all
+   but one in every STRIDE of them, or all of them if STRIDE is
+   0. */
+static void
+fragment (void *pages[], size_t stride)
+{
+  size_t i;
+
+  for (i = 0; i < REGION_PAGES; i++)
+    {
+      pages[i] = palloc_get_page (0);
+      if (pages[i] == NULL)
+        fail ("out of pages after %zu", i);
+    }
+  for (i = 0; i < REGION_PAGES; i++)
+    if (stride == 0 || i % stride != 0)
+      {
+        palloc_free_page (pages[i]);
+        pages[i] = NULL;
+      }
+}
+
+/* Frees the pages left in PAGES[] by fragment(). */
+static void
+unfragment (void *pages[])
+{
+  size_t i;
+
+  for (i = 0; i < REGION_PAGES; i++)
+    if (pages[i] != NULL)
+      palloc_free_page (pages[i]);
+}
+
+/* Allocates and frees runs of PAGE_CNT pages ROUND_CNT times at
+   fragmentation level LEVEL, recording latencies in SAMPLES[]. */
+static void
+run_multiple (const char *level, size_t page_cnt, uint64_t samples[])
+{
+  char name[32];
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      uint64_t before = timer_ns ();
+      void *p = palloc_get_multiple (0, page_cnt);
+
+      if (p == NULL)
+        fail ("palloc_get_multiple (%zu) failed", page_cnt);
+      palloc_free_multiple (p, page_cnt);
+      samples[i] = timer_ns () - before;
+    }
+  snprintf (name, sizeof name, "palloc-%s-%zu", level, page_cnt);
+  bench_report (name, ROUND_CNT, start);
+  bench_latency (name, samples, ROUND_CNT);
+}
+
+/* Allocates and frees a single page with FLAGS ROUND_CNT times,
+   reporting the results as NAME, with latencies in SAMPLES[].
+   Only the allocation is timed. */
+static void
+run_zero (enum palloc_flags flags, const char *name, uint64_t samples[])
+{
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      uint64_t before = timer_ns ();
+      void *p = palloc_get_page (flags);
+
+      samples[i] = timer_ns () - before;
+      if (p == NULL)
+        fail ("palloc_get_page failed");
+      palloc_free_page (p);
+    }
+  bench_report (name, ROUND_CNT, start);
+  bench_latency (name, samples, ROUND_CNT);
+}
@@ -0,0 +1,147 @@
+/* Runs the same workloads with N threads, for N from 1 to 256 by
+   powers of 2, so that the time per operation can be plotted
+   against N by tests/bench-scale.  A cost that grows with N, such
+   as a scan of the ready list on every context switch or of the
+   sleeping threads on every tick, shows up as a rising curve.
+
+   scale-yield-N: N threads yield in turn, YIELD_CNT times in all.
+
+   scale-sleep-N: with N threads asleep, the main thread yields
+   for MEASURE_TICKS ticks.  No other thread is ready, so each
+   yield is a trip through the scheduler that should not depend
+   on N; neither should the timer interrupt.  The sleepers sleep
+   SLEEP_TICKS at a time until told to stop, which is long enough
+   that they all stay asleep throughout the measurement even when
+   starting them takes a while under a slow simulator. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MAX_THREADS 256         /* Largest N. */
+#define YIELD_CNT 4096          /* Yields per scale-yield-N run. */
+#define MEASURE_TICKS 10        /* Length of a scale-sleep-N run. */
+#define SLEEP_TICKS 100         /* Length of each sleep. */
+
+/* Shared by the threads of one run. */
+struct scale_bench
+  {
+    int yield_cnt;              /* Yields per thread. */
+    bool stop;                  /* Should sleepers exit? */
+    struct semaphore started;   /* Upped by each sleeper at start. */
+    struct semaphore done;      /* Upped by each thread at the end. */
+  };
+
+static void scale_yield (int thread_cnt);
+static void scale_sleep (int thread_cnt);
+static thread_func yielder, sleeper;
+
+void
+test_bench_scale (void)
+{
+  int n;
+
+  for (n = 1; n <= MAX_THREADS; n *= 2)
+    scale_yield (n);
+  for (n = 1; n <= MAX_THREADS; n *= 2)
+    scale_sleep (n);
+}
+
+/* Creates up to THREAD_CNT threads running FUNC with aux data B,
+   and returns the number created, which is less if memory ran
+   out. */
+static int
+spawn (int thread_cnt, thread_func *func, struct scale_bench *b)
+{
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    if (thread_create ("scale", thread_get_priority (), func, b)
+        == TID_ERROR)
+      break;
+  return i;
+}
+
+/* Runs the scale-yield workload with THREAD_CNT threads. */
+static void
+scale_yield (int thread_cnt)
+{
+  struct scale_bench b;
+  char name[32];
+  uint64_t start;
+  int i;
+
+  b.yield_cnt = YIELD_CNT / thread_cnt;
+  sema_init (&b.done, 0);
+
+  /* The new threads have our priority, so none of them runs
+     until we block. */
+  thread_cnt = spawn (thread_cnt, yielder, &b);
+  start = bench_start ();
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&b.done);
+
+  snprintf (name, sizeof name, "scale-yield-%d", thread_cnt);
+  bench_report (name, (unsigned long long) thread_cnt * b.yield_cnt,
+                start);
+}
+
+static void
+yielder (void *b_)
+{
+  struct scale_bench *b = b_;
+  int i;
+
+  for (i = 0; i < b->yield_cnt; i++)
+    thread_yield ();
+  sema_up (&b->done);
+}
+
+/* Runs the scale-sleep workload with THREAD_CNT sleepers. */
+static void
+scale_sleep (int thread_cnt)
+{
+  struct scale_bench b;
+  unsigned long long yields;
+  char name[32];
+  uint64_t start;
+  int64_t end;
+  int i;
+
+  b.stop = false;
+  sema_init (&b.started, 0);
+  sema_init (&b.done, 0);
+  thread_cnt = spawn (thread_cnt, sleeper, &b);
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&b.started);
+
+  /* Start on a tick boundary. */
+  end = timer_ticks () + 1;
+  while (timer_ticks () < end)
+    thread_yield ();
+
+  start = bench_start ();
+  end += MEASURE_TICKS;
+  for (yields = 0; timer_ticks () < end; yields++)
+    thread_yield ();
+  snprintf (name, sizeof name, "scale-sleep-%d", thread_cnt);
+  bench_report (name, yields, start);
+
+  b.stop = true;
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&b.done);
+}
+
+static void
+sleeper (void *b_)
+{
+  struct scale_bench *b = b_;
+
+  sema_up (&b->started);
+  do
+    timer_sleep (SLEEP_TICKS);
+  while (!b->stop);
+  sema_up (&b->done);
+}
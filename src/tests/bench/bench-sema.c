@@ -0,0 +1,49 @@
+/* Two threads ping-pong through a pair of semaphores, measuring
+   the cost of waking a blocked thread and switching to it. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_CNT 10000
+
+struct ping_pong
+  {
+    struct semaphore ping;      /* Upped by the main thread. */
+    struct semaphore pong;      /* Upped by the other thread. */
+  };
+
+static thread_func ponger;
+
+void
+test_bench_sema (void)
+{
+  struct ping_pong pp;
+  uint64_t start;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_create ("ponger", thread_get_priority (), ponger, &pp);
+
+  start = bench_start ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  bench_report ("sema-pingpong", 2 * ROUND_CNT, start);
+}
+
+static void
+ponger (void *pp_)
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
@@ -0,0 +1,107 @@
+/* Puts N threads to sleep for a few ticks at a time and measures
+   how late timer_sleep() wakes them, for N from 10 to 1000.
+   Lateness is measured from the moment timer_sleep() is called,
+   so it can be up to one tick early when the call falls late in
+   a tick. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEP_CNT 3             /* Sleeps per thread. */
+#define NS_PER_TICK (1000000000 / TIMER_FREQ)
+
+struct sleep_bench
+  {
+    struct lock lock;           /* Protects the members below. */
+    int64_t late_total;         /* Sum of lateness, in ns. */
+    int64_t late_max;           /* Greatest lateness, in ns. */
+    int wake_cnt;               /* Wakeups measured. */
+    struct semaphore exited;    /* Upped by each sleeper at the end. */
+  };
+
+struct sleeper
+  {
+    struct sleep_bench *bench;
+    int ticks;                  /* Ticks to sleep each time. */
+  };
+
+static void run_sleepers (int thread_cnt);
+static thread_func sleeper;
+
+void
+test_bench_sleep (void)
+{
+  run_sleepers (10);
+  run_sleepers (100);
+  run_sleepers (1000);
+}
+
+/* Runs THREAD_CNT sleepers, or as many as memory allows. */
+static void
+run_sleepers (int thread_cnt)
+{
+  struct sleep_bench b;
+  struct sleeper *sleepers;
+  char name[32];
+  uint64_t start;
+  int i;
+
+  sleepers = malloc (sizeof *sleepers * thread_cnt);
+  if (sleepers == NULL)
+    fail ("couldn't allocate %d sleepers", thread_cnt);
+
+  lock_init (&b.lock);
+  b.late_total = b.late_max = 0;
+  b.wake_cnt = 0;
+  sema_init (&b.exited, 0);
+
+  start = bench_start ();
+  for (i = 0; i < thread_cnt; i++)
+    {
+      sleepers[i].bench = &b;
+      sleepers[i].ticks = 1 + i % 10;
+      if (thread_create ("sleeper", thread_get_priority (), sleeper,
+                         &sleepers[i]) == TID_ERROR)
+        break;
+    }
+  thread_cnt = i;
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&b.exited);
+
+  snprintf (name, sizeof name, "sleep-%d", thread_cnt);
+  bench_report (name, b.wake_cnt, start);
+  if (b.wake_cnt > 0)
+    msg ("bench %s late-avg-us=%"PRId64" late-max-us=%"PRId64,
+         name, b.late_total / b.wake_cnt / 1000, b.late_max / 1000);
+  free (sleepers);
+}
+
+static void
+sleeper (void *s_)
+{
+  struct sleeper *s = s_;
+  struct sleep_bench *b = s->bench;
+  int i;
+
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      uint64_t before = timer_ns ();
+      int64_t late;
+
+      timer_sleep (s->ticks);
+      late = (int64_t) (timer_ns () - before) - s->ticks * NS_PER_TICK;
+
+      lock_acquire (&b->lock);
+      b->late_total += late;
+      if (late > b->late_max)
+        b->late_max = late;
+      b->wake_cnt++;
+      lock_release (&b->lock);
+    }
+  sema_up (&b->exited);
+}
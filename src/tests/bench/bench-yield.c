@@ -0,0 +1,37 @@
+/* Two threads of equal priority pass the CPU back and forth with
+   thread_yield(), measuring the cost of a voluntary context
+   switch. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define YIELD_CNT 10000
+
+static thread_func yielder;
+
+void
+test_bench_yield (void)
+{
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  start = bench_start ();
+  thread_create ("yielder", thread_get_priority (), yielder, &done);
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  sema_down (&done);
+  bench_report ("yield", 2 * YIELD_CNT, start);
+}
+
+static void
+yielder (void *done)
+{
+  int i;
+
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  sema_up (done);
+}
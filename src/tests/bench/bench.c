@@ -0,0 +1,75 @@
+/* Timing and reporting shared by the benchmarks.
+
+   Each benchmark prints one or more result lines of the form
+
+     (bench-NAME) bench NAME ops=OPS ns=NS ops/sec=RATE
+
+   and possibly latency lines of the form
+
+     (bench-NAME) bench NAME p50-ns=... p90-ns=... p99-ns=... max-ns=...
+
+   so that runs before and after a change can be compared by a
+   script.  Times come from timer_ns(), which has TSC resolution
+   once the timer is calibrated and tick resolution otherwise. */
+
+#include "tests/bench/bench.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+
+/* Returns the time at which a measurement starts. */
+uint64_t
+bench_start (void)
+{
+  return timer_ns ();
+}
+
+/* Reports that OPS operations of the benchmark called NAME took
+   place since START, as returned by bench_start(). */
+void
+bench_report (const char *name, unsigned long long ops, uint64_t start)
+{
+  uint64_t ns = timer_ns () - start;
+
+  if (ns == 0)
+    ns = 1;
+  msg ("bench %s ops=%llu ns=%"PRIu64" ops/sec=%"PRIu64,
+       name, ops, ns, (uint64_t) ops * 1000000000 / ns);
+}
+
+/* Returns 1 if *A > *B, -1 if *A < *B, 0 otherwise. */
+static int
+compare_samples (const void *a_, const void *b_)
+{
+  const uint64_t *a = a_;
+  const uint64_t *b = b_;
+
+  return *a > *b ? 1 : *a < *b ? -1 : 0;
+}
+
+/* Reports percentiles of the CNT latencies in SAMPLES[], in ns,
+   for the benchmark called NAME.  Sorts SAMPLES. */
+void
+bench_latency (const char *name, uint64_t samples[], size_t cnt)
+{
+  if (cnt == 0)
+    return;
+  qsort (samples, cnt, sizeof *samples, compare_samples);
+  msg ("bench %s p50-ns=%"PRIu64" p90-ns=%"PRIu64" p99-ns=%"PRIu64
+       " max-ns=%"PRIu64, name, samples[cnt / 2], samples[cnt * 9 / 10],
+       samples[cnt * 99 / 100], samples[cnt - 1]);
+}
+
+/* Returns a pseudo-random number from the xorshift generator
+   whose state, which must start out nonzero, is *STATE.  Each
+   thread keeps its own state, so no locking is needed. */
+uint32_t
+bench_random (uint32_t *state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
@@ -0,0 +1,24 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+
+extern test_func test_bench_yield;
+extern test_func test_bench_sema;
+extern test_func test_bench_lock;
+extern test_func test_bench_condvar;
+extern test_func test_bench_create;
+extern test_func test_bench_sleep;
+extern test_func test_bench_malloc;
+extern test_func test_bench_palloc;
+extern test_func test_bench_scale;
+extern test_func test_bench_memory;
+
+uint64_t bench_start (void);
+void bench_report (const char *name, unsigned long long ops, uint64_t start);
+void bench_latency (const char *name, uint64_t samples[], size_t cnt);
+uint32_t bench_random (uint32_t *state);
+
+#endif /* tests/bench/bench.h */
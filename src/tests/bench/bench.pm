@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks that a benchmark ran to the end and reported at least one
+# result.  The numbers themselves are not judged.
+sub check_bench {
+    our ($test);
+    my ($name) = $test =~ m%([^/]+)$%;
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    fail "missing begin in output"
+      unless grep ($_ eq "($name) begin", @output);
+    fail "missing end in output"
+      unless grep ($_ eq "($name) end", @output);
+    fail "no benchmark results in output"
+      unless grep (/^\(\Q$name\E\) bench \S+ ops=\d+ ns=\d+ ops\/sec=\d+\b/,
+		   @output);
+    pass;
+}
+
+1;
@@ -0,0 +1,208 @@
+/* Replays page access patterns against a working set half again
+   as large as the user pool, reporting for each pattern the page
+   faults, swap-ins and evictions it caused, so that eviction
+   policies (see the kernel's "-evict" option) can be compared on
+   the same accesses.  Each access writes to its page, so that
+   victims are dirty and go to swap.  The patterns are:
+
+   evict-loop: sweeps the working set in order, over and over,
+   the worst case for LRU and its approximations.
+
+   evict-random: pages chosen uniformly at random.
+
+   evict-zipf: pages chosen with Zipf's law, where the Kth most
+   popular page is accessed in proportion to 1/K, as with a small
+   hot set over a long cold tail.
+
+   evict-trace: if a file named "evict.trace" exists, the byte
+   addresses it lists, one per line in decimal or with a leading
+   0x in hexadecimal, taken as pages modulo the working set.  The
+   page-fault records that the kernel's "-trace" option dumps
+   give such a list of addresses.
+
+   The random choices come from a fixed seed, so every run and
+   every policy sees the same sequence.
+
+   The working set is taken from the heap, so that it grows with
+   the user pool; swap must hold the half of it that does not
+   fit. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdbool.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define PAGE_SIZE 4096
+#define PASSES 4                /* Accesses per page of working set. */
+#define SEED 0x5eed
+
+static char *array;             /* The working set. */
+static size_t page_cnt;         /* Pages in the working set. */
+
+/* Zipf's law: cumulative weights of the ranks. */
+static uint32_t *zipf_cdf;
+
+/* Writes to page PAGE of the working set. */
+static inline void
+touch (size_t page)
+{
+  array[page % page_cnt * PAGE_SIZE]++;
+}
+
+/* Returns the calling process's page fault counters. */
+static struct faultstat
+get_faults (void)
+{
+  struct sysstat s;
+
+  sysstat (&s, sizeof s);
+  return s.proc_faults;
+}
+
+/* Begins measuring a pattern: stores the fault counters in
+   *BEFORE and returns the start time. */
+static int64_t
+begin (struct faultstat *before)
+{
+  *before = get_faults ();
+  return bench_start ();
+}
+
+/* Reports the ACCESS_CNT accesses made by pattern NAME since
+   START, and the faults since BEFORE, as returned by begin(). */
+static void
+end (const char *name, unsigned long long access_cnt, int64_t start,
+     const struct faultstat *before)
+{
+  struct faultstat after;
+
+  bench_report (name, access_cnt, start);
+  after = get_faults ();
+  msg ("bench %s faults=%"PRIu32" swap-ins=%"PRIu32" evictions=%"PRIu32,
+       name,
+       (after.minor_cnt + after.file_cnt + after.swap_cnt)
+       - (before->minor_cnt + before->file_cnt + before->swap_cnt),
+       after.swap_cnt - before->swap_cnt,
+       after.evict_cnt - before->evict_cnt);
+}
+
+/* Returns a page chosen by Zipf's law.  Ranks are scattered over
+   the working set by multiplying by a prime that PAGE_CNT cannot
+   share a factor with, so that the hot pages are not adjacent. */
+static size_t
+zipf_page (void)
+{
+  uint32_t x = random_ulong () % zipf_cdf[page_cnt - 1];
+  size_t lo = 0, hi = page_cnt - 1;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (zipf_cdf[mid] > x)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return lo * 7919 % page_cnt;
+}
+
+/* Replays "evict.trace", if it exists. */
+static void
+replay_trace (void)
+{
+  struct faultstat before;
+  unsigned long long access_cnt = 0;
+  uintptr_t addr = 0;
+  bool digits = false;
+  int base = 10;
+  char buf[512];
+  int64_t start;
+  int fd, n, i;
+
+  fd = open ("evict.trace");
+  if (fd < 2)
+    return;
+
+  start = begin (&before);
+  while ((n = read (fd, buf, sizeof buf)) > 0)
+    for (i = 0; i < n; i++)
+      {
+        char c = buf[i];
+
+        if (c == '\n')
+          {
+            if (digits)
+              {
+                touch (addr / PAGE_SIZE);
+                access_cnt++;
+              }
+            addr = 0;
+            digits = false;
+            base = 10;
+          }
+        else if ((c == 'x' || c == 'X') && addr == 0 && digits)
+          base = 16;
+        else if (c >= '0' && c <= '9')
+          {
+            addr = addr * base + (c - '0');
+            digits = true;
+          }
+        else if (base == 16 && c >= 'a' && c <= 'f')
+          addr = addr * 16 + (c - 'a' + 10);
+        else if (base == 16 && c >= 'A' && c <= 'F')
+          addr = addr * 16 + (c - 'A' + 10);
+      }
+  close (fd);
+  end ("evict-trace", access_cnt, start, &before);
+}
+
+void
+test_main (void)
+{
+  struct faultstat before;
+  struct sysstat s;
+  size_t access_cnt, i;
+  uint32_t sum;
+  int64_t start;
+
+  sysstat (&s, sizeof s);
+  page_cnt = s.mem.user_pool.page_cnt * 3 / 2;
+  if (page_cnt == 0)
+    fail ("no user pool");
+  CHECK ((array = sbrk (page_cnt * PAGE_SIZE)) != NULL,
+         "sbrk %zu pages", page_cnt);
+  CHECK ((zipf_cdf = sbrk (page_cnt * sizeof *zipf_cdf)) != NULL,
+         "sbrk %zu ranks", page_cnt);
+  access_cnt = PASSES * page_cnt;
+  msg ("working set of %zu pages", page_cnt);
+
+  sum = 0;
+  for (i = 0; i < page_cnt; i++)
+    zipf_cdf[i] = sum += 65536 / (i + 1);
+
+  /* Fault in the whole working set first. */
+  for (i = 0; i < page_cnt; i++)
+    touch (i);
+
+  start = begin (&before);
+  for (i = 0; i < access_cnt; i++)
+    touch (i);
+  end ("evict-loop", access_cnt, start, &before);
+
+  random_init (SEED);
+  start = begin (&before);
+  for (i = 0; i < access_cnt; i++)
+    touch (random_ulong ());
+  end ("evict-random", access_cnt, start, &before);
+
+  random_init (SEED);
+  start = begin (&before);
+  for (i = 0; i < access_cnt; i++)
+    touch (zipf_page ());
+  end ("evict-zipf", access_cnt, start, &before);
+
+  replay_trace ();
+}
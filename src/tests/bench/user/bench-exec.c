@@ -0,0 +1,27 @@
+/* Times exec() and wait() of a program that exits at once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define EXEC_CNT 50
+
+void
+test_main (void)
+{
+  int64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t pid = exec ("child-bexit");
+
+      if (pid == PID_ERROR)
+        fail ("exec \"child-bexit\"");
+      if (wait (pid) != 0)
+        fail ("wait for child-bexit");
+    }
+  bench_report ("exec-wait", EXEC_CNT, start);
+}
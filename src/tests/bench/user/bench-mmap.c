@@ -0,0 +1,40 @@
+/* Maps a file and reads one byte from each page in order, timing
+   how fast the pages are faulted in.  Sequential faults on a file
+   are what fault-around targets. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+
+static char page[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  volatile char sum = 0;
+  mapid_t mapping;
+  int64_t start;
+  int fd;
+  int i;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (write (fd, page, PAGE_SIZE) != PAGE_SIZE)
+      fail ("write \"data\"");
+  CHECK ((mapping = mmap (fd, map)) != MAP_FAILED, "mmap \"data\"");
+
+  start = bench_start ();
+  for (i = 0; i < PAGE_CNT; i++)
+    sum += map[i * PAGE_SIZE];
+  bench_report_bytes ("mmap-fault-in", PAGE_CNT,
+                      (unsigned long long) PAGE_CNT * PAGE_SIZE, start);
+
+  munmap (mapping);
+  close (fd);
+}
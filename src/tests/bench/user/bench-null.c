@@ -0,0 +1,27 @@
+/* Times a loop of the cheapest system call there is, tell() on an
+   open file, to measure the cost of entering and leaving the
+   kernel. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define CALL_CNT 50000
+
+void
+test_main (void)
+{
+  int64_t start;
+  int fd;
+  int i;
+
+  CHECK (create ("null", 0), "create \"null\"");
+  CHECK ((fd = open ("null")) > 1, "open \"null\"");
+
+  start = bench_start ();
+  for (i = 0; i < CALL_CNT; i++)
+    tell (fd);
+  bench_report ("syscall-tell", CALL_CNT, start);
+  close (fd);
+}
@@ -0,0 +1,47 @@
+/* Times read() of 1 byte and of 4 kB from a cached file, showing
+   the fixed cost of a system call against the cost of copying. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define SIZE 4096
+#define READ_CNT 8192
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int64_t start;
+  int fd;
+  int i;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  /* Reads the file a byte at a time, over and over. */
+  start = bench_start ();
+  for (i = 0; i < READ_CNT; i++)
+    {
+      if (i % SIZE == 0)
+        seek (fd, 0);
+      if (read (fd, buf, 1) != 1)
+        fail ("read 1 byte");
+    }
+  bench_report_bytes ("read-1", READ_CNT, READ_CNT, start);
+
+  /* Reads the whole file each time.  Each read also takes a
+     seek(). */
+  start = bench_start ();
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (fd, 0);
+      if (read (fd, buf, SIZE) != SIZE)
+        fail ("read %d bytes", SIZE);
+    }
+  bench_report_bytes ("read-4096", READ_CNT,
+                      (unsigned long long) READ_CNT * SIZE, start);
+  close (fd);
+}
@@ -0,0 +1,71 @@
+/* Runs the same workloads with N processes or N open files, for
+   N from 1 to 256 by powers of 2, so that the time per operation
+   can be plotted against N by tests/bench-scale.
+
+   scale-exec-N: a chain of N processes, each of which executes
+   the next and waits for it, as in multi-recurse.  The chain
+   stops early if memory runs out, and N is then the length it
+   reached.
+
+   scale-files-N: with N files open, opens, checks the size of
+   and closes one more file FILE_OPS times. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define MAX_N 256               /* Largest N. */
+#define FILE_OPS 256            /* Operations per scale-files-N run. */
+
+static int fds[MAX_N];
+
+void
+test_main (void)
+{
+  char name[32];
+  int64_t start;
+  int n, i;
+
+  for (n = 1; n <= MAX_N; n *= 2)
+    {
+      char cmd[64];
+      pid_t pid;
+      int depth;
+
+      snprintf (cmd, sizeof cmd, "child-bscale %d", n);
+      start = bench_start ();
+      CHECK ((pid = exec (cmd)) != PID_ERROR, "exec \"%s\"", cmd);
+      depth = wait (pid);
+      if (depth < 1)
+        fail ("wait for \"%s\" returned %d", cmd, depth);
+      snprintf (name, sizeof name, "scale-exec-%d", depth);
+      bench_report (name, depth, start);
+      if (depth < n)
+        break;
+    }
+
+  CHECK (create ("scale", 0), "create \"scale\"");
+  for (n = 1; n <= MAX_N; n *= 2)
+    {
+      for (i = n / 2; i < n; i++)
+        CHECK ((fds[i] = open ("scale")) > 1, "open \"scale\"");
+
+      start = bench_start ();
+      for (i = 0; i < FILE_OPS; i++)
+        {
+          int fd = open ("scale");
+
+          if (fd < 2)
+            fail ("open \"scale\" with %d files open", n);
+          if (filesize (fd) != 0)
+            fail ("filesize \"scale\"");
+          close (fd);
+        }
+      snprintf (name, sizeof name, "scale-files-%d", n);
+      bench_report (name, FILE_OPS, start);
+    }
+  for (i = 0; i < MAX_N; i++)
+    close (fds[i]);
+}
@@ -0,0 +1,25 @@
+/* Writes one byte to each page of a large zero-filled array,
+   timing the first-touch page faults that give it memory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/timing.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256
+
+static char array[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  int64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < PAGE_CNT; i++)
+    array[i * PAGE_SIZE] = 1;
+  bench_report_bytes ("first-touch", PAGE_CNT,
+                      (unsigned long long) PAGE_CNT * PAGE_SIZE, start);
+}
@@ -0,0 +1,7 @@
+/* Child process for bench-exec.  Exits at once. */
+
+int
+main (void)
+{
+  return 0;
+}
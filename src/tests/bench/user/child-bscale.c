@@ -0,0 +1,26 @@
+/* Child process for bench-scale.  Executes itself recursively to
+   the depth given by the first command-line argument, and exits
+   with the length of the chain that it and its descendants
+   reached, which is less than the depth if an exec() failed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[])
+{
+  char cmd[64];
+  pid_t pid;
+  int n;
+
+  n = argc > 1 ? atoi (argv[1]) : 1;
+  if (n <= 1)
+    return 1;
+
+  snprintf (cmd, sizeof cmd, "child-bscale %d", n - 1);
+  pid = exec (cmd);
+  if (pid == PID_ERROR)
+    return 1;
+  return wait (pid) + 1;
+}
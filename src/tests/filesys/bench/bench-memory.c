@@ -0,0 +1,136 @@
+/* Measures the memory that each process, open file and open
+   directory costs, from the page pool usage reported by
+   memstat() before and after holding many of them at once.  Each
+   result line is of the form
+
+     (bench-memory) bench footprint-WHAT kernel-bytes=K
+       user-bytes=U max-cnt=M
+
+   where K and U are the kernel and user pool memory used per
+   object, which include the malloc() arenas, page tables and
+   other memory allocated for it, and M is how many more such
+   objects would fit in the free pools.  The objects are:
+
+   footprint-process: one of a chain of PROCESS_CNT processes
+   that execute one another, as in multi-recurse, and wait.
+
+   footprint-open: a file opened as a new inode.
+
+   footprint-reopen: a further handle on an already open file,
+   which shares the file's inode.
+
+   footprint-dir: a directory opened as a new inode. */
+
+#include <limits.h>
+#include <memstat.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define PROCESS_CNT 16
+#define FILE_CNT 128
+#define PAGE_SIZE 4096
+
+static int fds[FILE_CNT];
+
+/* Returns the number of objects costing PER bytes each that
+   would fit in the FREE_PAGES free pages of a pool, or UINT_MAX
+   if they cost nothing there. */
+static unsigned
+fit (unsigned free_pages, unsigned per)
+{
+  return per != 0 ? free_pages * PAGE_SIZE / per : UINT_MAX;
+}
+
+/* Reports the footprint of each of the CNT objects called WHAT,
+   given memstat() pool usage BEFORE and AFTER them. */
+static void
+report (const char *what, int cnt, const struct memstat *before,
+        const struct memstat *after)
+{
+  unsigned kernel, user, kernel_fit, user_fit;
+
+  kernel = (after->kernel_pool.used_cnt - before->kernel_pool.used_cnt)
+           * PAGE_SIZE / cnt;
+  user = (after->user_pool.used_cnt - before->user_pool.used_cnt)
+         * PAGE_SIZE / cnt;
+  kernel_fit = fit (after->kernel_pool.page_cnt
+                    - after->kernel_pool.used_cnt, kernel);
+  user_fit = fit (after->user_pool.page_cnt - after->user_pool.used_cnt,
+                  user);
+  msg ("bench footprint-%s kernel-bytes=%u user-bytes=%u max-cnt=%u",
+       what, kernel, user, kernel_fit < user_fit ? kernel_fit : user_fit);
+}
+
+/* Opens the CNT objects named by FORMAT and an index, recording
+   their file descriptors in FDS[]. */
+static void
+open_all (const char *format, int cnt)
+{
+  char name[16];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, format, i);
+      CHECK ((fds[i] = open (name)) > 1, "open \"%s\"", name);
+    }
+}
+
+/* Opens FILE_CNT objects named by FORMAT and an index and reports
+   their footprint as WHAT, then closes them. */
+static void
+measure_open (const char *what, const char *format)
+{
+  struct memstat before, after;
+  int i;
+
+  memstat (&before);
+  open_all (format, FILE_CNT);
+  memstat (&after);
+  report (what, FILE_CNT, &before, &after);
+  for (i = 0; i < FILE_CNT; i++)
+    close (fds[i]);
+}
+
+void
+test_main (void)
+{
+  struct memstat before, during;
+  char name[32];
+  int64_t start;
+  pid_t pid;
+  int code, fd, i;
+
+  /* The last process in the chain exits with the pages in use in
+     each pool while all of them are alive, packed into its exit
+     code. */
+  memstat (&before);
+  snprintf (name, sizeof name, "child-bmem %d", PROCESS_CNT);
+  start = bench_start ();
+  CHECK ((pid = exec (name)) != PID_ERROR, "exec \"%s\"", name);
+  code = wait (pid);
+  bench_report ("footprint-process", PROCESS_CNT, start);
+  if (code < 0)
+    fail ("wait for \"%s\" returned %d", name, code);
+  during = before;
+  during.kernel_pool.used_cnt = code & 0xffff;
+  during.user_pool.used_cnt = code >> 16;
+  report ("process", PROCESS_CNT, &before, &during);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      snprintf (name, sizeof name, "d%d", i);
+      CHECK (mkdir (name), "mkdir \"%s\"", name);
+    }
+
+  measure_open ("open", "f%d");
+  CHECK ((fd = open ("f0")) > 1, "open \"f0\"");
+  measure_open ("reopen", "f0");
+  close (fd);
+  measure_open ("dir", "d%d");
+}
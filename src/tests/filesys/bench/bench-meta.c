@@ -0,0 +1,55 @@
+/* Creates, opens and removes many files in one directory,
+   reporting the rate of each operation. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define FILE_CNT 100
+
+/* Stores the name of file I into NAME. */
+static void
+file_name (char name[16], int i)
+{
+  snprintf (name, 16, "m%d", i);
+}
+
+void
+test_main (void)
+{
+  char name[16];
+  int64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+  bench_report ("meta-create", FILE_CNT, start);
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      file_name (name, i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+  bench_report ("meta-open", FILE_CNT, start);
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  bench_report ("meta-remove", FILE_CNT, start);
+}
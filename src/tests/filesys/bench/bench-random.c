@@ -0,0 +1,37 @@
+/* Reads 512-byte blocks at random offsets of a large file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define BLOCK_SIZE 512
+#define READ_CNT 2000
+
+void
+test_main (void)
+{
+  char block[BLOCK_SIZE];
+  int64_t start;
+  int fd;
+  int i;
+
+  bench_make_file (4096);
+  if ((fd = open (bench_file)) < 2)
+    fail ("open \"%s\"", bench_file);
+
+  start = bench_start ();
+  for (i = 0; i < READ_CNT; i++)
+    {
+      size_t ofs = random_ulong () % (BENCH_FILE_SIZE / BLOCK_SIZE)
+                   * BLOCK_SIZE;
+
+      seek (fd, ofs);
+      if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read \"%s\" at %zu", bench_file, ofs);
+    }
+  bench_report_bytes ("random-read-512", READ_CNT,
+                      (unsigned long long) READ_CNT * BLOCK_SIZE, start);
+  close (fd);
+}
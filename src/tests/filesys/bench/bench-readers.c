@@ -0,0 +1,25 @@
+/* Runs several processes that read the same large file at once,
+   reporting their combined bandwidth. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int64_t start;
+
+  bench_make_file (4096);
+
+  start = bench_start ();
+  exec_children ("child-bread", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  bench_report_bytes ("readers-4", CHILD_CNT,
+                      (unsigned long long) CHILD_CNT * BENCH_FILE_SIZE,
+                      start);
+}
@@ -0,0 +1,43 @@
+/* Writes and then reads back a large file sequentially, at
+   several block sizes, reporting the bandwidth of each. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+static char block[16384];
+
+void
+test_main (void)
+{
+  static const size_t sizes[] = {512, 4096, 16384};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i];
+      char name[32];
+      int64_t start;
+      size_t ofs;
+      int fd;
+
+      start = bench_start ();
+      bench_make_file (size);
+      snprintf (name, sizeof name, "seq-write-%zu", size);
+      bench_report_bytes (name, BENCH_FILE_SIZE / size, BENCH_FILE_SIZE,
+                          start);
+
+      if ((fd = open (bench_file)) < 2)
+        fail ("open \"%s\"", bench_file);
+      start = bench_start ();
+      for (ofs = 0; ofs < BENCH_FILE_SIZE; ofs += size)
+        if (read (fd, block, size) != (int) size)
+          fail ("read \"%s\" at %zu", bench_file, ofs);
+      snprintf (name, sizeof name, "seq-read-%zu", size);
+      bench_report_bytes (name, BENCH_FILE_SIZE / size, BENCH_FILE_SIZE,
+                          start);
+      close (fd);
+    }
+}
@@ -0,0 +1,28 @@
+/* Setup shared by the file system benchmarks.  Timing and
+   reporting are in tests/timing.c. */
+
+#include "tests/filesys/bench/bench.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Creates BENCH_FILE, BENCH_FILE_SIZE bytes long, writing it
+   BLOCK_SIZE bytes at a time.  Fails the test on error. */
+void
+bench_make_file (size_t block_size)
+{
+  static char block[16384];
+  size_t ofs;
+  int fd;
+
+  if (block_size > sizeof block)
+    fail ("block size %zu too large", block_size);
+  remove (bench_file);
+  if (!create (bench_file, 0))
+    fail ("create \"%s\"", bench_file);
+  if ((fd = open (bench_file)) < 2)
+    fail ("open \"%s\"", bench_file);
+  for (ofs = 0; ofs < BENCH_FILE_SIZE; ofs += block_size)
+    if (write (fd, block, block_size) != (int) block_size)
+      fail ("write \"%s\" at %zu", bench_file, ofs);
+  close (fd);
+}
@@ -0,0 +1,17 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+#include <stddef.h>
+#include "tests/timing.h"
+
+/* Name of the file shared by the data benchmarks. */
+static const char bench_file[] = "bench-data";
+
+/* Size of BENCH_FILE.  Several times the size of the kernel's
+   buffer cache, so that reading it back really reaches the
+   disk. */
+#define BENCH_FILE_SIZE (256 * 1024)
+
+void bench_make_file (size_t block_size);
+
+#endif /* tests/filesys/bench/bench.h */
@@ -0,0 +1,37 @@
+/* Child process for the bench-memory benchmark.  Executes
+   itself recursively to the depth given by its argument.  The
+   deepest process exits with the number of pages in use in the
+   kernel pool, plus 65536 times the number in use in the user
+   pool, and the others pass that on. */
+
+#include <memstat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-bmem";
+
+int
+main (int argc, const char *argv[])
+{
+  char cmd[64];
+  pid_t pid;
+  int n;
+
+  quiet = true;
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+
+  n = atoi (argv[1]);
+  if (n <= 1)
+    {
+      struct memstat m;
+
+      memstat (&m);
+      return m.kernel_pool.used_cnt | m.user_pool.used_cnt << 16;
+    }
+
+  snprintf (cmd, sizeof cmd, "child-bmem %d", n - 1);
+  CHECK ((pid = exec (cmd)) != PID_ERROR, "exec \"%s\"", cmd);
+  return wait (pid);
+}
@@ -0,0 +1,29 @@
+/* Child process for the bench-readers benchmark.  Reads the whole
+   benchmark file sequentially and exits with its argument. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/bench/bench.h"
+
+const char *test_name = "child-bread";
+
+static char block[4096];
+
+int
+main (int argc, const char *argv[])
+{
+  size_t ofs;
+  int fd;
+
+  quiet = true;
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+
+  CHECK ((fd = open (bench_file)) > 1, "open \"%s\"", bench_file);
+  for (ofs = 0; ofs < BENCH_FILE_SIZE; ofs += sizeof block)
+    CHECK (read (fd, block, sizeof block) == sizeof block,
+           "read \"%s\" at %zu", bench_file, ofs);
+  close (fd);
+
+  return atoi (argv[1]);
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'a'}{"f$_"} = [''] foreach 0...19;
+check_archive ($fs);
+pass;
@@ -0,0 +1,75 @@
+/* Fills a directory with files, then reads it back with
+   readdir_batch() in batches smaller than the directory and
+   checks that every file turns up exactly once with its inode
+   number.  Also checks that a file that is not a directory
+   cannot be read this way. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20
+#define BATCH_CNT 7
+
+void
+test_main (void) 
+{
+  int inumbers[FILE_CNT];
+  bool seen[FILE_CNT];
+  struct dirent ents[BATCH_CNT];
+  int total = 0;
+  int dir_fd, file_fd;
+  int n;
+  int i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  msg ("creating files");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+      int fd;
+
+      snprintf (name, sizeof name, "a/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      if ((fd = open (name)) < 0)
+        fail ("open \"%s\"", name);
+      inumbers[i] = inumber (fd);
+      close (fd);
+      seen[i] = false;
+    }
+
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  msg ("reading in batches of %d", BATCH_CNT);
+  while ((n = readdir_batch (dir_fd, ents, BATCH_CNT)) > 0)
+    {
+      if (n > BATCH_CNT)
+        fail ("readdir_batch returned %d entries", n);
+      for (i = 0; i < n; i++)
+        {
+          int idx;
+
+          if (ents[i].name[0] != 'f')
+            fail ("unexpected entry \"%s\"", ents[i].name);
+          idx = atoi (ents[i].name + 1);
+          if (idx < 0 || idx >= FILE_CNT || seen[idx])
+            fail ("unexpected or repeated entry \"%s\"", ents[i].name);
+          if ((int) ents[i].inumber != inumbers[idx])
+            fail ("\"%s\" has inode %u, expected %d", ents[i].name,
+                  (unsigned) ents[i].inumber, inumbers[idx]);
+          seen[idx] = true;
+        }
+      total += n;
+    }
+  CHECK (n == 0, "readdir_batch at the end returns 0");
+  CHECK (total == FILE_CNT, "read %d entries", total);
+  close (dir_fd);
+
+  CHECK ((file_fd = open ("a/f0")) > 1, "open \"a/f0\"");
+  CHECK (readdir_batch (file_fd, ents, BATCH_CNT) == -1,
+         "readdir_batch on a file fails");
+}
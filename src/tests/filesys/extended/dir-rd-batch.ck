@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-rd-batch) begin
+(dir-rd-batch) mkdir "a"
+(dir-rd-batch) creating files
+(dir-rd-batch) open "a"
+(dir-rd-batch) reading in batches of 7
+(dir-rd-batch) readdir_batch at the end returns 0
+(dir-rd-batch) read 20 entries
+(dir-rd-batch) open "a/f0"
+(dir-rd-batch) readdir_batch on a file fails
+(dir-rd-batch) end
+EOF
+pass;
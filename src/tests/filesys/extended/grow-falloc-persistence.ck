@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["\0" x 5000 . "x" x 100 . "\0" x 4900],
+		"a" => {}});
+pass;
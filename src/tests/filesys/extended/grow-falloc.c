@@ -0,0 +1,43 @@
+/* Grows an empty file with fallocate() and checks that the
+   reserved space reads as zeros, holds data written into it, and
+   is not given back by a shorter fallocate().  Also checks that
+   a directory cannot be grown this way. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 10000
+#define DATA_OFS 5000
+#define DATA_SIZE 100
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd, dir_fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fallocate (fd, FILE_SIZE), "fallocate %d bytes", FILE_SIZE);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is %d", FILE_SIZE);
+
+  msg ("write at offset %d", DATA_OFS);
+  memset (buf + DATA_OFS, 'x', DATA_SIZE);
+  seek (fd, DATA_OFS);
+  if (write (fd, buf + DATA_OFS, DATA_SIZE) != DATA_SIZE)
+    fail ("write \"%s\"", file_name);
+
+  CHECK (fallocate (fd, FILE_SIZE / 2), "fallocate %d bytes", FILE_SIZE / 2);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is still %d", FILE_SIZE);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  CHECK (!fallocate (dir_fd, FILE_SIZE), "fallocate on a directory fails");
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-falloc) begin
+(grow-falloc) create "testfile"
+(grow-falloc) open "testfile"
+(grow-falloc) fallocate 10000 bytes
+(grow-falloc) filesize is 10000
+(grow-falloc) write at offset 5000
+(grow-falloc) fallocate 5000 bytes
+(grow-falloc) filesize is still 10000
+(grow-falloc) close "testfile"
+(grow-falloc) open "testfile" for verification
+(grow-falloc) verified contents of "testfile"
+(grow-falloc) close "testfile"
+(grow-falloc) mkdir "a"
+(grow-falloc) open "a"
+(grow-falloc) fallocate on a directory fails
+(grow-falloc) end
+EOF
+pass;
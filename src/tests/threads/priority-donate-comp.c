@@ -0,0 +1,50 @@
+/* The main thread binds itself as the owner of a completion.
+   Two higher-priority threads that wait for it should donate
+   their priorities to the main thread, which should give back
+   each donation as complete() wakes its thread, highest priority
+   first. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func wait_thread_func;
+
+void
+test_priority_donate_comp (void) 
+{
+  struct completion c;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  completion_init (&c);
+  completion_set_owner (&c, thread_current ());
+  thread_create ("wait1", PRI_DEFAULT + 1, wait_thread_func, &c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  thread_create ("wait2", PRI_DEFAULT + 2, wait_thread_func, &c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  complete (&c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  complete (&c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  msg ("wait2, wait1 must already have finished, in that order.");
+}
+
+static void
+wait_thread_func (void *c_) 
+{
+  struct completion *c = c_;
+
+  wait_for_completion (c);
+  msg ("%s: woke up", thread_name ());
+}
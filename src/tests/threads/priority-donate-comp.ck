@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-comp) begin
+(priority-donate-comp) This thread should have priority 32.  Actual priority: 32.
+(priority-donate-comp) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-comp) wait2: woke up
+(priority-donate-comp) This thread should have priority 32.  Actual priority: 32.
+(priority-donate-comp) wait1: woke up
+(priority-donate-comp) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-comp) wait2, wait1 must already have finished, in that order.
+(priority-donate-comp) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* The main thread binds itself as the owner of an owned
+   semaphore.  A higher-priority thread that blocks downing it
+   should donate its priority to the main thread, which should
+   lose it again when it ups the semaphore.  A thread that
+   starts waiting on a second semaphore before it has an owner
+   should donate only once the main thread binds itself to it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func down_thread_func;
+
+void
+test_priority_donate_owned (void) 
+{
+  struct owned_semaphore bound, unbound;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  owned_sema_init (&bound, 0);
+  owned_sema_set_owner (&bound, thread_current ());
+  thread_create ("down1", PRI_DEFAULT + 3, down_thread_func, &bound);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+  sema_up (&bound.semaphore);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+
+  owned_sema_init (&unbound, 0);
+  thread_create ("down2", PRI_DEFAULT + 5, down_thread_func, &unbound);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  owned_sema_set_owner (&unbound, thread_current ());
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  sema_up (&unbound.semaphore);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  msg ("down1, down2 must already have finished, in that order.");
+}
+
+static void
+down_thread_func (void *sema_) 
+{
+  struct owned_semaphore *sema = sema_;
+
+  sema_down (&sema->semaphore);
+  msg ("%s: got the semaphore", thread_name ());
+}
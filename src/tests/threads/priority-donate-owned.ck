@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-owned) begin
+(priority-donate-owned) This thread should have priority 34.  Actual priority: 34.
+(priority-donate-owned) down1: got the semaphore
+(priority-donate-owned) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-owned) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-owned) This thread should have priority 36.  Actual priority: 36.
+(priority-donate-owned) down2: got the semaphore
+(priority-donate-owned) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-owned) down1, down2 must already have finished, in that order.
+(priority-donate-owned) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* The main thread binds itself as the owner of a completion that
+   two higher-priority threads wait for, one of them with a
+   timeout.  When that one gives up, the main thread should keep
+   only the other's donation, and lose that too once it completes
+   the completion. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func patient_thread_func;
+static thread_func hasty_thread_func;
+
+void
+test_priority_donate_timeout (void) 
+{
+  struct completion c;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  completion_init (&c);
+  completion_set_owner (&c, thread_current ());
+  thread_create ("patient", PRI_DEFAULT + 2, patient_thread_func, &c);
+  thread_create ("hasty", PRI_DEFAULT + 5, hasty_thread_func, &c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  timer_sleep (50);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  complete_all (&c);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  msg ("hasty, patient must already have finished, in that order.");
+}
+
+static void
+patient_thread_func (void *c_) 
+{
+  struct completion *c = c_;
+
+  wait_for_completion (c);
+  msg ("patient: woke up");
+}
+
+static void
+hasty_thread_func (void *c_) 
+{
+  struct completion *c = c_;
+
+  if (!wait_for_completion_timeout (c, 10))
+    msg ("hasty: timed out");
+}
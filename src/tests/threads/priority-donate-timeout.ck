@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-timeout) begin
+(priority-donate-timeout) This thread should have priority 36.  Actual priority: 36.
+(priority-donate-timeout) hasty: timed out
+(priority-donate-timeout) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-timeout) patient: woke up
+(priority-donate-timeout) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-timeout) hasty, patient must already have finished, in that order.
+(priority-donate-timeout) end
+EOF
+pass;
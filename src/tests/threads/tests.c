@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <string.h>
 #include <stdio.h>
+#include "tests/bench/bench.h"
 
 struct test 
   {
@@ -25,6 +26,9 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-owned", test_priority_donate_owned},
+    {"priority-donate-comp", test_priority_donate_comp},
+    {"priority-donate-timeout", test_priority_donate_timeout},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
@@ -38,6 +42,16 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bench-yield", test_bench_yield},
+    {"bench-sema", test_bench_sema},
+    {"bench-lock", test_bench_lock},
+    {"bench-condvar", test_bench_condvar},
+    {"bench-create", test_bench_create},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-malloc", test_bench_malloc},
+    {"bench-palloc", test_bench_palloc},
+    {"bench-scale", test_bench_scale},
+    {"bench-memory", test_bench_memory},
   };
 
 static const char *test_name;
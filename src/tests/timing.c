@@ -0,0 +1,102 @@
+/* Timing and reporting for user-mode benchmarks.
+
+   Results are printed in the same form as the kernel benchmarks
+   in tests/bench:
+
+     (TEST) bench NAME ops=OPS ns=NS ops/sec=RATE [MB/s=RATE]
+                  [cycles/op=CYCLES]
+
+   all on one line.  Times come from the clock page, so they have
+   tick resolution, and each benchmark runs for many ticks.  On a
+   CPU with a time-stamp counter, which user code may read, the
+   cost of one operation in cycles is reported as well. */
+
+#include "tests/timing.h"
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Time-stamp counter at the last bench_start(), or 0 if the CPU
+   has none. */
+static uint64_t start_tsc;
+
+/* Returns true if the CPU has a time-stamp counter. */
+static bool
+have_tsc (void)
+{
+  uint32_t a, b, c, d;
+
+  asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return (d & (1u << 4)) != 0;
+}
+
+/* Returns the time-stamp counter, or 0 if the CPU has none. */
+static uint64_t
+read_tsc (void)
+{
+  static int tsc = -1;
+  uint64_t t;
+
+  if (tsc < 0)
+    tsc = have_tsc ();
+  if (!tsc)
+    return 0;
+  asm volatile ("rdtsc" : "=A" (t));
+  return t;
+}
+
+/* Returns the time at which a measurement starts. */
+int64_t
+bench_start (void)
+{
+  int64_t now = clock_ticks ();
+
+  /* Start on a tick boundary, so that at most one tick is lost. */
+  while (clock_ticks () == now)
+    continue;
+  start_tsc = read_tsc ();
+  return now + 1;
+}
+
+/* Returns the nanoseconds elapsed since START, at least 1. */
+static uint64_t
+elapsed_ns (int64_t start)
+{
+  uint64_t ns = (uint64_t) (clock_ticks () - start) * 1000000000
+                / clock_freq ();
+  return ns > 0 ? ns : 1;
+}
+
+/* Reports that OPS operations of the benchmark NAME, transferring
+   BYTES in all, took place since START, as returned by
+   bench_start().  Bandwidth is reported only if BYTES is
+   nonzero. */
+void
+bench_report_bytes (const char *name, unsigned long long ops,
+                    unsigned long long bytes, int64_t start)
+{
+  uint64_t tsc = read_tsc ();
+  uint64_t ns = elapsed_ns (start);
+  char rate[32] = "";
+  char cycles[32] = "";
+
+  if (bytes > 0)
+    {
+      uint64_t kb_per_sec = bytes * 1000000 / ns * 1000 / 1024;
+      snprintf (rate, sizeof rate, " MB/s=%llu.%03llu",
+                kb_per_sec / 1024, kb_per_sec % 1024 * 1000 / 1024);
+    }
+  if (tsc != 0 && ops > 0)
+    snprintf (cycles, sizeof cycles, " cycles/op=%llu",
+              (tsc - start_tsc) / ops);
+  msg ("bench %s ops=%llu ns=%llu ops/sec=%llu%s%s",
+       name, ops, ns, ops * 1000000000ull / ns, rate, cycles);
+}
+
+/* Reports that OPS operations of the benchmark NAME took place
+   since START, as returned by bench_start(). */
+void
+bench_report (const char *name, unsigned long long ops, int64_t start)
+{
+  bench_report_bytes (name, ops, 0, start);
+}
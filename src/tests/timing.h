@@ -0,0 +1,11 @@
+#ifndef TESTS_TIMING_H
+#define TESTS_TIMING_H
+
+#include <stdint.h>
+
+int64_t bench_start (void);
+void bench_report (const char *name, unsigned long long ops, int64_t start);
+void bench_report_bytes (const char *name, unsigned long long ops,
+                         unsigned long long bytes, int64_t start);
+
+#endif /* tests/timing.h */
@@ -0,0 +1,43 @@
+/* Checks that sched_setaffinity() rejects a mask with no CPU
+   that runs threads, that sched_getaffinity() reports the mask
+   that was set, limited to such CPUs, and that a new thread
+   starts with its creator's mask. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the CPU mask the new thread started with. */
+static int
+get_mask (void *aux UNUSED)
+{
+  return sched_getaffinity ();
+}
+
+void
+test_main (void) 
+{
+  unsigned all = sched_getaffinity ();
+  tid_t tid;
+
+  CHECK (all & 1, "CPU 0 runs threads");
+  CHECK (!sched_setaffinity (0), "empty mask is rejected");
+  CHECK (sched_getaffinity () == all, "mask is unchanged");
+
+  CHECK (sched_setaffinity (1), "set mask to CPU 0");
+  CHECK (sched_getaffinity () == 1, "mask is CPU 0");
+  CHECK ((tid = thread_create (get_mask, NULL)) != TID_ERROR,
+         "create thread");
+  CHECK (thread_join (tid) == 1, "thread inherited the mask");
+
+  /* Whether the other CPUs run threads depends on the machine. */
+  if (all == 1)
+    CHECK (!sched_setaffinity (~1u), "mask without CPU 0 is handled");
+  else
+    CHECK (sched_setaffinity (~1u) && sched_getaffinity () == (all & ~1u),
+           "mask without CPU 0 is handled");
+
+  CHECK (sched_setaffinity (UINT32_MAX), "set mask to every CPU");
+  CHECK (sched_getaffinity () == all, "mask is every CPU");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(affinity) begin
+(affinity) CPU 0 runs threads
+(affinity) empty mask is rejected
+(affinity) mask is unchanged
+(affinity) set mask to CPU 0
+(affinity) mask is CPU 0
+(affinity) create thread
+(affinity) thread inherited the mask
+(affinity) mask without CPU 0 is handled
+(affinity) set mask to every CPU
+(affinity) mask is every CPU
+(affinity) end
+affinity: exit(0)
+EOF
+pass;
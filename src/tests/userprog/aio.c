@@ -0,0 +1,95 @@
+/* Writes a file with two asynchronous writes and reads it back
+   with two asynchronous reads, closing the file before the reads
+   are reaped, and checks the data, identifiers, and results
+   that aio_wait() reports.  Also checks that an oversized
+   request is refused and that aio_wait() with nothing
+   outstanding returns 0. */
+
+#include <aio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK 4096
+
+static char wbuf[2 * CHUNK];
+static char rbuf[2 * CHUNK];
+
+/* Reaps requests ID0 and ID1, in either order, and fails unless
+   each transferred CHUNK bytes. */
+static void
+reap_pair (int id0, int id1)
+{
+  bool seen[2] = {false, false};
+  int reaped = 0;
+
+  while (reaped < 2)
+    {
+      struct aio_event events[2];
+      int n = aio_wait (events, 2);
+      int i;
+
+      if (n <= 0)
+        fail ("aio_wait returned %d with requests outstanding", n);
+      for (i = 0; i < n; i++)
+        {
+          int which = events[i].id == id0 ? 0 : events[i].id == id1 ? 1 : -1;
+
+          if (which < 0 || seen[which])
+            fail ("unexpected or repeated request %d", events[i].id);
+          if (events[i].result != CHUNK)
+            fail ("request %d transferred %d bytes", events[i].id,
+                  events[i].result);
+          seen[which] = true;
+        }
+      reaped += n;
+    }
+}
+
+void
+test_main (void) 
+{
+  struct aiocb cb[2];
+  int id[2];
+  int fd;
+  size_t i;
+
+  for (i = 0; i < sizeof wbuf; i++)
+    wbuf[i] = i * 7;
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  for (i = 0; i < 2; i++)
+    {
+      cb[i].fd = fd;
+      cb[i].buf = wbuf + i * CHUNK;
+      cb[i].size = CHUNK;
+      cb[i].offset = i * CHUNK;
+      CHECK ((id[i] = aio_write (&cb[i])) >= 0, "aio_write chunk %zu", i);
+    }
+  CHECK (id[0] != id[1], "requests have distinct ids");
+  reap_pair (id[0], id[1]);
+  msg ("reaped writes");
+  CHECK (filesize (fd) == (int) sizeof wbuf, "filesize is %zu", sizeof wbuf);
+
+  for (i = 0; i < 2; i++)
+    {
+      cb[i].buf = rbuf + (1 - i) * CHUNK;
+      cb[i].offset = (1 - i) * CHUNK;
+      CHECK ((id[i] = aio_read (&cb[i])) >= 0, "aio_read chunk %zu", 1 - i);
+    }
+  msg ("close \"data\"");
+  close (fd);
+  reap_pair (id[0], id[1]);
+  msg ("reaped reads");
+  if (memcmp (rbuf, wbuf, sizeof rbuf))
+    fail ("data read differs from data written");
+  msg ("data matches");
+
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  cb[0].fd = fd;
+  cb[0].size = AIO_SIZE_MAX + 1;
+  CHECK (aio_read (&cb[0]) == -1, "oversized request is refused");
+  CHECK (aio_wait (NULL, 1) == 0, "aio_wait with nothing outstanding");
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio) begin
+(aio) create "data"
+(aio) open "data"
+(aio) aio_write chunk 0
+(aio) aio_write chunk 1
+(aio) requests have distinct ids
+(aio) reaped writes
+(aio) filesize is 8192
+(aio) aio_read chunk 1
+(aio) aio_read chunk 0
+(aio) close "data"
+(aio) reaped reads
+(aio) data matches
+(aio) open "data"
+(aio) oversized request is refused
+(aio) aio_wait with nothing outstanding
+(aio) end
+aio: exit(0)
+EOF
+pass;
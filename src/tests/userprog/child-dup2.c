@@ -0,0 +1,28 @@
+/* Child process run by dup2-exec test.
+
+   Reads its stdin to end of file and writes "pong: " and what it
+   read to its stdout.  Both are pipes that it gets from its
+   parent's redirections, so it prints nothing on the console
+   itself. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-dup2";
+
+int
+main (void) 
+{
+  char buf[16];
+  int size = 0;
+  int n;
+
+  while ((n = read (STDIN_FILENO, buf + size, sizeof buf - size)) > 0)
+    size += n;
+  if (n < 0
+      || write (STDOUT_FILENO, "pong: ", 6) != 6
+      || write (STDOUT_FILENO, buf, size) != size)
+    return 1;
+  return 0;
+}
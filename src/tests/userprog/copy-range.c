@@ -0,0 +1,45 @@
+/* Copies most of a file of more than a page into another with
+   copy_file_range(), asking for more than is left, and checks the
+   count, both file positions and the copied data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 5000               /* Bytes in the source file. */
+#define SKIP 100                /* Bytes left uncopied at its start. */
+
+static char data[SIZE];
+static char copy[SIZE];
+
+void
+test_main (void) 
+{
+  int in, out;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    data[i] = i % 251;
+  CHECK (create ("source", 0), "create \"source\"");
+  CHECK ((in = open ("source")) > 1, "open \"source\"");
+  CHECK (write (in, data, SIZE) == SIZE, "write %d bytes", SIZE);
+  CHECK (create ("target", 0), "create \"target\"");
+  CHECK ((out = open ("target")) > 1, "open \"target\"");
+
+  seek (in, SKIP);
+  CHECK (copy_file_range (in, out, 2 * SIZE) == SIZE - SKIP,
+         "copy_file_range %d bytes", SIZE - SKIP);
+  CHECK (tell (in) == SIZE, "source position is %d", SIZE);
+  CHECK (tell (out) == SIZE - SKIP, "target position is %d", SIZE - SKIP);
+  CHECK (copy_file_range (in, out, SIZE) == 0,
+         "copy_file_range at end of file");
+
+  seek (out, 0);
+  CHECK (read (out, copy, SIZE) == SIZE - SKIP,
+         "read %d bytes of \"target\"", SIZE - SKIP);
+  if (memcmp (copy, data + SKIP, SIZE - SKIP))
+    fail ("\"target\" differs from the end of \"source\"");
+  close (in);
+  close (out);
+}
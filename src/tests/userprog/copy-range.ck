@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) create "source"
+(copy-range) open "source"
+(copy-range) write 5000 bytes
+(copy-range) create "target"
+(copy-range) open "target"
+(copy-range) copy_file_range 4900 bytes
+(copy-range) source position is 5000
+(copy-range) target position is 4900
+(copy-range) copy_file_range at end of file
+(copy-range) read 4900 bytes of "target"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
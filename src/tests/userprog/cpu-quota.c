@@ -0,0 +1,71 @@
+/* Checks that cpu_quota() rejects bad parameters and accepts
+   leaving the thread's group, then has a thread limited to 2
+   ticks out of every 10 spin for 40 ticks and checks that it got
+   little more than its quota of the CPU, the main thread
+   sleeping all the while so that nothing else wanted it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PERIOD 10
+#define QUOTA 2
+#define SPIN_TICKS 40
+
+/* Upper bound on the ticks the spinning thread may run: its
+   quota in each period it spans, plus slack for partial
+   periods. */
+#define MAX_RUN_TICKS (SPIN_TICKS / PERIOD * QUOTA + 2 * QUOTA)
+
+static volatile bool limited;
+static volatile int done;
+static volatile int release;
+
+/* Spins for SPIN_TICKS under a quota, if one was set, then sets
+   DONE and stays alive until RELEASE so that its counters can be
+   read. */
+static int
+quota_spin (void *aux UNUSED)
+{
+  limited = cpu_quota (QUOTA, PERIOD);
+  if (limited)
+    {
+      int64_t end = clock_ticks () + SPIN_TICKS;
+      while (clock_ticks () < end)
+        continue;
+    }
+
+  done = 1;
+  futex_wake (&done, 1);
+  while (release == 0)
+    futex_wait (&release, 0);
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  struct threadstat ts;
+  int64_t run_ticks;
+  tid_t tid;
+
+  CHECK (!cpu_quota (QUOTA, 0), "zero period is rejected");
+  CHECK (!cpu_quota (PERIOD + 1, PERIOD),
+         "quota over the period is rejected");
+  CHECK (cpu_quota (0, 0), "leaving the group is allowed");
+
+  CHECK ((tid = thread_create (quota_spin, NULL)) != TID_ERROR,
+         "create limited thread");
+  while (done == 0)
+    futex_wait (&done, 0);
+  CHECK (limited, "quota was set");
+  CHECK (threadstat (tid, &ts), "threadstat");
+  release = 1;
+  futex_wake (&release, 1);
+  CHECK (thread_join (tid) == 0, "join limited thread");
+
+  run_ticks = ts.user_ticks + ts.kernel_ticks;
+  if (run_ticks > MAX_RUN_TICKS)
+    fail ("limited thread ran %lld ticks of %d", run_ticks, SPIN_TICKS);
+  msg ("limited thread kept to its quota");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cpu-quota) begin
+(cpu-quota) zero period is rejected
+(cpu-quota) quota over the period is rejected
+(cpu-quota) leaving the group is allowed
+(cpu-quota) create limited thread
+(cpu-quota) quota was set
+(cpu-quota) threadstat
+(cpu-quota) join limited thread
+(cpu-quota) limited thread kept to its quota
+(cpu-quota) end
+cpu-quota: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Redirects stdin and stdout to pipes and runs child-dup2, which
+   must start with the same redirections: it reads what was
+   written to its stdin and answers on its stdout. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int to[2], from[2];
+  char buf[32];
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (to) && pipe (from), "create pipes");
+  CHECK (write (to[1], "ping", 4) == 4, "write \"ping\" to child's stdin");
+  CHECK (dup2 (to[0], STDIN_FILENO) == STDIN_FILENO, "dup2 onto stdin");
+  msg ("dup2 onto stdout and exec \"child-dup2\"");
+  if (dup2 (from[1], STDOUT_FILENO) != STDOUT_FILENO)
+    fail ("dup2 onto stdout failed");
+  pid = exec ("child-dup2");
+  close (STDOUT_FILENO);
+  close (STDIN_FILENO);
+  close (to[0]);
+  close (from[1]);
+  if (pid == PID_ERROR)
+    fail ("exec \"child-dup2\" failed");
+
+  /* The child reads until end of file, so it cannot finish
+     before this. */
+  msg ("close child's stdin");
+  close (to[1]);
+  msg ("wait(child) = %d", wait (pid));
+
+  n = read (from[0], buf, sizeof buf - 1);
+  if (n < 0)
+    fail ("read from child's stdout failed");
+  buf[n] = '\0';
+  msg ("child wrote \"%s\"", buf);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup2-exec) begin
+(dup2-exec) create pipes
+(dup2-exec) write "ping" to child's stdin
+(dup2-exec) dup2 onto stdin
+(dup2-exec) dup2 onto stdout and exec "child-dup2"
+(dup2-exec) close child's stdin
+child-dup2: exit(0)
+(dup2-exec) wait(child) = 0
+(dup2-exec) child wrote "pong: ping"
+(dup2-exec) end
+dup2-exec: exit(0)
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Redirects stdin and then stdout to the ends of a pipe with
+   dup2(), checks that reads and writes on descriptors 0 and 1 go
+   through the pipe, and that closing descriptor 1 gives it back
+   to the console. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int fds[2];
+  int n;
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (write (fds[1], "in", 2) == 2, "write \"in\" to pipe");
+  CHECK (dup2 (fds[0], STDIN_FILENO) == STDIN_FILENO, "dup2 onto stdin");
+  CHECK (read (STDIN_FILENO, buf, sizeof buf) == 2
+         && !memcmp (buf, "in", 2), "read \"in\" from stdin");
+  msg ("close stdin");
+  close (STDIN_FILENO);
+
+  msg ("dup2 onto stdout");
+  if (dup2 (fds[1], STDOUT_FILENO) != STDOUT_FILENO)
+    fail ("dup2 onto stdout failed");
+  n = write (STDOUT_FILENO, "out", 3);
+  close (STDOUT_FILENO);
+  msg ("close stdout");
+  if (n != 3)
+    fail ("write to redirected stdout returned %d", n);
+
+  CHECK (read (fds[0], buf, sizeof buf) == 3
+         && !memcmp (buf, "out", 3), "read \"out\" from pipe");
+}
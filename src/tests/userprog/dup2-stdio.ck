@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup2-stdio) begin
+(dup2-stdio) pipe
+(dup2-stdio) write "in" to pipe
+(dup2-stdio) dup2 onto stdin
+(dup2-stdio) read "in" from stdin
+(dup2-stdio) close stdin
+(dup2-stdio) dup2 onto stdout
+(dup2-stdio) close stdout
+(dup2-stdio) read "out" from pipe
+(dup2-stdio) end
+dup2-stdio: exit(0)
+EOF
+pass;
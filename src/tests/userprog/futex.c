@@ -0,0 +1,66 @@
+/* Checks futex_wait() and futex_wake() directly, then has
+   several threads bump a shared counter under a struct mutex. */
+
+#include <syscall.h>
+#include <synch.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERATIONS 1000
+
+static volatile int flag;
+static struct mutex counter_lock = MUTEX_INITIALIZER;
+static volatile int counter;
+
+/* Sets FLAG and wakes the main thread waiting on it. */
+static int
+set_flag (void *aux UNUSED)
+{
+  flag = 1;
+  return futex_wake (&flag, 1) >= 0 ? 0 : 1;
+}
+
+/* Increments COUNTER ITERATIONS times under COUNTER_LOCK.  The
+   read and the write are split so that preemption between them
+   would lose updates without the lock. */
+static int
+bump_counter (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      int value;
+
+      mutex_lock (&counter_lock);
+      value = counter;
+      counter = value + 1;
+      mutex_unlock (&counter_lock);
+    }
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  tid_t tid;
+  int i;
+
+  CHECK (futex_wait (&flag, 1) == -1, "wait on a changed word fails");
+  CHECK (futex_wake (&flag, 1) == 0, "wake with no waiters wakes none");
+
+  CHECK ((tid = thread_create (set_flag, NULL)) != TID_ERROR,
+         "create flag thread");
+  while (flag == 0)
+    futex_wait (&flag, 0);
+  CHECK (thread_join (tid) == 0, "flag thread woke the waiter");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = thread_create (bump_counter, NULL)) != TID_ERROR,
+           "create counter thread %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (tids[i]) == 0, "join counter thread %d", i);
+  CHECK (counter == THREAD_CNT * ITERATIONS, "counter is %d", counter);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex) begin
+(futex) wait on a changed word fails
+(futex) wake with no waiters wakes none
+(futex) create flag thread
+(futex) flag thread woke the waiter
+(futex) create counter thread 0
+(futex) create counter thread 1
+(futex) create counter thread 2
+(futex) create counter thread 3
+(futex) join counter thread 0
+(futex) join counter thread 1
+(futex) join counter thread 2
+(futex) join counter thread 3
+(futex) counter is 4000
+(futex) end
+futex: exit(0)
+EOF
+pass;
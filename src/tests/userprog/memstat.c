@@ -0,0 +1,49 @@
+/* Checks that memstat() reports consistent page allocator
+   counters, that the user pool's count of pages in use grows as
+   the process takes more pages, and that a buffer in kernel
+   memory gets -1 rather than killing the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define GROW_PAGES 4
+
+/* Fails unless pool P's counters are consistent. */
+static void
+check_pool (const char *name, const struct memstat_pool *p)
+{
+  if (p->used_cnt > p->peak_cnt || p->peak_cnt > p->page_cnt)
+    fail ("%s pool: %u used, %u peak, %u pages", name,
+          (unsigned) p->used_cnt, (unsigned) p->peak_cnt,
+          (unsigned) p->page_cnt);
+}
+
+void
+test_main (void) 
+{
+  struct memstat before, after;
+  char *heap;
+  int i;
+
+  CHECK (memstat (&before) == 0, "memstat");
+  check_pool ("kernel", &before.kernel_pool);
+  check_pool ("user", &before.user_pool);
+  CHECK (before.user_pool.used_cnt > 0, "user pool has pages in use");
+  CHECK (before.desc_cnt <= MEMSTAT_DESC_MAX, "desc_cnt is in range");
+
+  CHECK ((heap = sbrk (GROW_PAGES * PAGE_SIZE)) != NULL,
+         "sbrk %d pages", GROW_PAGES);
+  for (i = 0; i < GROW_PAGES; i++)
+    heap[i * PAGE_SIZE] = i + 1;
+  CHECK (memstat (&after) == 0, "memstat");
+  check_pool ("user", &after.user_pool);
+  CHECK (after.user_pool.used_cnt >= before.user_pool.used_cnt + GROW_PAGES,
+         "user pool has %d more pages in use", GROW_PAGES);
+  CHECK (after.user_pool.peak_cnt >= before.user_pool.peak_cnt,
+         "user pool peak did not drop");
+
+  CHECK (memstat ((struct memstat *) 0xc0000000) == -1,
+         "memstat into kernel memory fails");
+}
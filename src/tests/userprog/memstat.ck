@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) user pool has pages in use
+(memstat) desc_cnt is in range
+(memstat) sbrk 4 pages
+(memstat) memstat
+(memstat) user pool has 4 more pages in use
+(memstat) user pool peak did not drop
+(memstat) memstat into kernel memory fails
+(memstat) end
+memstat: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Writes to a pipe, closes its write end, and checks that reads
+   return what was written and then end of file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char data[] = "through the pipe";
+  char buf[64];
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (write (fds[1], data, sizeof data) == sizeof data,
+         "write %zu bytes", sizeof data);
+  msg ("close write end");
+  close (fds[1]);
+  CHECK (read (fds[0], buf, sizeof buf) == sizeof data,
+         "read %zu bytes", sizeof data);
+  if (memcmp (buf, data, sizeof data))
+    fail ("read data differs from written data");
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file");
+}
@@ -0,0 +1,18 @@
+/* Closes the read end of a pipe and checks that writing to the
+   write end fails, without waiting for a reader that can never
+   come. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  msg ("close read end");
+  close (fds[0]);
+  CHECK (write (fds[1], "x", 1) == -1, "write with no reader fails");
+}
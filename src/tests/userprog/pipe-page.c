@@ -0,0 +1,34 @@
+/* Writes whole pages to a pipe, which the kernel hands from
+   writer to reader without copying, followed by a partial one,
+   and checks that they read back intact and in order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (2 * PAGE_SIZE + 100)
+
+static char out[SIZE];
+static char in[SIZE];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    out[i] = i % 251;
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (write (fds[1], out, SIZE) == SIZE, "write %d bytes", SIZE);
+  CHECK (read (fds[0], in, PAGE_SIZE) == PAGE_SIZE,
+         "read first page");
+  CHECK (read (fds[0], in + PAGE_SIZE, SIZE - PAGE_SIZE)
+         == SIZE - PAGE_SIZE, "read the rest");
+  if (memcmp (in, out, SIZE))
+    fail ("read data differs from written data");
+  msg ("data matches");
+}
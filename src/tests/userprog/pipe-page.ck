@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-page) begin
+(pipe-page) pipe
+(pipe-page) write 8292 bytes
+(pipe-page) read first page
+(pipe-page) read the rest
+(pipe-page) data matches
+(pipe-page) end
+pipe-page: exit(0)
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Polls the two ends of a pipe through the states they can be
+   in: empty, timing out, woken by a write from another thread,
+   and with the write end closed.  Also checks that a closed fd
+   reports POLLNVAL and that too many sources are refused. */
+
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int pipe_fds[2];
+
+/* Writes one byte into the pipe. */
+static int
+write_byte (void *aux UNUSED)
+{
+  return write (pipe_fds[1], "x", 1) == 1 ? 0 : 1;
+}
+
+void
+test_main (void) 
+{
+  struct pollfd fds[POLL_MAX + 1];
+  char c;
+  tid_t tid;
+
+  CHECK (pipe (pipe_fds), "pipe");
+  fds[0].fd = pipe_fds[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = pipe_fds[1];
+  fds[1].events = POLLOUT;
+  CHECK (poll (fds, 2, 0) == 1, "poll both ends");
+  CHECK (fds[0].revents == 0, "empty pipe is not readable");
+  CHECK (fds[1].revents == POLLOUT, "empty pipe is writable");
+
+  CHECK (poll (fds, 1, 50) == 0, "poll of empty pipe times out");
+  CHECK (fds[0].revents == 0, "read end reports nothing");
+
+  CHECK ((tid = thread_create (write_byte, NULL)) != TID_ERROR,
+         "create writer thread");
+  CHECK (poll (fds, 1, -1) == 1, "poll waits for the writer");
+  CHECK (fds[0].revents == POLLIN, "pipe is readable");
+  CHECK (thread_join (tid) == 0, "join writer thread");
+  CHECK (read (pipe_fds[0], &c, 1) == 1 && c == 'x', "read the byte");
+
+  msg ("close write end");
+  close (pipe_fds[1]);
+  CHECK (poll (fds, 1, 0) == 1, "poll read end");
+  CHECK (fds[0].revents == POLLHUP, "read end reports POLLHUP");
+
+  fds[1].events = POLLIN;
+  CHECK (poll (&fds[1], 1, 0) == 1, "poll closed fd");
+  CHECK (fds[1].revents == POLLNVAL, "closed fd reports POLLNVAL");
+
+  CHECK (poll (fds, POLL_MAX + 1, 0) == -1, "too many sources are refused");
+}
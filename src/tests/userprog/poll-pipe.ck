@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) poll both ends
+(poll-pipe) empty pipe is not readable
+(poll-pipe) empty pipe is writable
+(poll-pipe) poll of empty pipe times out
+(poll-pipe) read end reports nothing
+(poll-pipe) create writer thread
+(poll-pipe) poll waits for the writer
+(poll-pipe) pipe is readable
+(poll-pipe) join writer thread
+(poll-pipe) read the byte
+(poll-pipe) close write end
+(poll-pipe) poll read end
+(poll-pipe) read end reports POLLHUP
+(poll-pipe) poll closed fd
+(poll-pipe) closed fd reports POLLNVAL
+(poll-pipe) too many sources are refused
+(poll-pipe) end
+poll-pipe: exit(0)
+EOF
+pass;
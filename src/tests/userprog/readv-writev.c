@@ -0,0 +1,50 @@
+/* Writes a file with writev() from three buffers, one of them
+   empty, and reads it back with readv() into buffers split at
+   other places, checking that the bytes come back in order. */
+
+#include <iovec.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static char head[] = "scatter";
+  static char tail[600];
+  static char buf[sizeof head + sizeof tail];
+  static char a[100], b[sizeof buf - sizeof a];
+  struct iovec out[3], in[2];
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof tail; i++)
+    tail[i] = 'a' + i % 26;
+  memcpy (buf, head, sizeof head);
+  memcpy (buf + sizeof head, tail, sizeof tail);
+
+  out[0].iov_base = head;
+  out[0].iov_len = sizeof head;
+  out[1].iov_base = NULL;
+  out[1].iov_len = 0;
+  out[2].iov_base = tail;
+  out[2].iov_len = sizeof tail;
+  in[0].iov_base = a;
+  in[0].iov_len = sizeof a;
+  in[1].iov_base = b;
+  in[1].iov_len = sizeof b;
+
+  CHECK (create ("vector", 0), "create \"vector\"");
+  CHECK ((fd = open ("vector")) > 1, "open \"vector\"");
+  CHECK (writev (fd, out, 3) == (int) sizeof buf,
+         "writev %zu bytes from 3 buffers", sizeof buf);
+  CHECK (filesize (fd) == (int) sizeof buf, "filesize is %zu", sizeof buf);
+  seek (fd, 0);
+  CHECK (readv (fd, in, 2) == (int) sizeof buf,
+         "readv %zu bytes into 2 buffers", sizeof buf);
+  if (memcmp (a, buf, sizeof a) || memcmp (b, buf + sizeof a, sizeof b))
+    fail ("data read differs from data written");
+  CHECK (readv (fd, in, 2) == 0, "readv at end of file");
+  close (fd);
+}
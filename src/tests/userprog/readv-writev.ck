@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "vector"
+(readv-writev) open "vector"
+(readv-writev) writev 608 bytes from 3 buffers
+(readv-writev) filesize is 608
+(readv-writev) readv 608 bytes into 2 buffers
+(readv-writev) readv at end of file
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
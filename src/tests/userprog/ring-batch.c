@@ -0,0 +1,80 @@
+/* Queues a batch of file system calls on one descriptor in a
+   system call ring, more than any one system call may hold files,
+   along with a call with a bad number, and runs them with one
+   ring_enter().  Then checks each call's result, that a smaller
+   count runs only part of what is queued, and that the calls did
+   what they should have. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include <syscall-ring.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING_SIZE 8
+
+static struct
+  {
+    struct syscall_ring ring;
+    struct syscall_entry entries[RING_SIZE];
+  }
+r;
+
+/* Queues system call NR with arguments A, B and C. */
+static void
+queue (uint32_t nr, uint32_t a, uint32_t b, uint32_t c)
+{
+  struct syscall_entry *e = &r.ring.entries[r.ring.tail % RING_SIZE];
+
+  e->nr = nr;
+  e->args[0] = a;
+  e->args[1] = b;
+  e->args[2] = c;
+  e->result = 0;
+  r.ring.tail++;
+}
+
+/* Returns the result of the entry queued at position IDX. */
+static int
+result (uint32_t idx)
+{
+  return r.ring.entries[idx % RING_SIZE].result;
+}
+
+void
+test_main (void) 
+{
+  static const char data[] = "ring";
+  char buf[sizeof data];
+  int fd;
+
+  CHECK (create ("batch", 0), "create \"batch\"");
+  CHECK ((fd = open ("batch")) > 1, "open \"batch\"");
+  CHECK (ring_setup (&r.ring, RING_SIZE), "ring_setup");
+
+  queue (SYS_WRITE, fd, (uint32_t) data, sizeof data);
+  queue (SYS_FILESIZE, fd, 0, 0);
+  queue (SYS_SEEK, fd, 0, 0);
+  queue (SYS_READ, fd, (uint32_t) buf, sizeof buf);
+  queue (SYS_TELL, fd, 0, 0);
+  queue (~0u, 0, 0, 0);
+  CHECK (ring_enter (RING_SIZE) == 6, "ring_enter runs 6 calls");
+  CHECK (r.ring.head == 6, "head is 6");
+  CHECK (result (0) == sizeof data, "write returned %zu", sizeof data);
+  CHECK (result (1) == sizeof data, "filesize returned %zu", sizeof data);
+  CHECK (result (3) == sizeof data, "read returned %zu", sizeof data);
+  CHECK (result (4) == sizeof data, "tell returned %zu", sizeof data);
+  CHECK (result (5) == -1, "bad call number returned -1");
+  if (memcmp (buf, data, sizeof data))
+    fail ("data read differs from data written");
+
+  queue (SYS_TELL, fd, 0, 0);
+  queue (SYS_CLOSE, fd, 0, 0);
+  CHECK (ring_enter (1) == 1, "ring_enter runs 1 of 2 calls");
+  CHECK (r.ring.head == 7, "head is 7");
+  CHECK (ring_enter (RING_SIZE) == 1, "ring_enter runs the last call");
+  CHECK (r.ring.head == r.ring.tail, "ring is empty");
+  CHECK (ring_enter (RING_SIZE) == 0, "ring_enter with nothing queued");
+  CHECK (open ("batch") == fd, "descriptor was closed");
+}
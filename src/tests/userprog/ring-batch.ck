@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-batch) begin
+(ring-batch) create "batch"
+(ring-batch) open "batch"
+(ring-batch) ring_setup
+(ring-batch) ring_enter runs 6 calls
+(ring-batch) head is 6
+(ring-batch) write returned 5
+(ring-batch) filesize returned 5
+(ring-batch) read returned 5
+(ring-batch) tell returned 5
+(ring-batch) bad call number returned -1
+(ring-batch) ring_enter runs 1 of 2 calls
+(ring-batch) head is 7
+(ring-batch) ring_enter runs the last call
+(ring-batch) ring is empty
+(ring-batch) ring_enter with nothing queued
+(ring-batch) descriptor was closed
+(ring-batch) end
+ring-batch: exit(0)
+EOF
+pass;
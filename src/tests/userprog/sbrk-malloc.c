@@ -0,0 +1,93 @@
+/* Moves the program break with sbrk() and checks the old breaks
+   it returns, that new heap memory is zeroed, and that moves
+   below the heap or far past it are refused.  Then allocates,
+   fills, frees, and reallocates blocks of many sizes with
+   malloc(), including ones larger than a page, and checks that
+   no block's contents were disturbed. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define GROW 10000
+#define BLOCK_CNT 64
+
+/* Returns the size of block I. */
+static size_t
+block_size (int i)
+{
+  return i % 8 == 7 ? 5000 + i * 100 : i * 37 + 1;
+}
+
+/* Fails unless the first SIZE bytes of block I, at P, hold I. */
+static void
+check_block (int i, const unsigned char *p, size_t size)
+{
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (p[j] != (unsigned char) i)
+      fail ("block %d byte %zu is %d", i, j, p[j]);
+}
+
+void
+test_main (void) 
+{
+  unsigned char *blocks[BLOCK_CNT];
+  unsigned char *brk0, *p;
+  size_t i;
+
+  brk0 = sbrk (0);
+  CHECK (sbrk (GROW) == brk0, "sbrk %d returns the old break", GROW);
+  CHECK (sbrk (0) == brk0 + GROW, "break moved by %d", GROW);
+  for (i = 0; i < GROW; i++)
+    if (brk0[i] != 0)
+      fail ("new heap byte %zu is %d", i, brk0[i]);
+  msg ("new heap is zeroed");
+  memset (brk0, 0xcc, GROW);
+  CHECK (sbrk (-GROW) == brk0 + GROW, "sbrk -%d", GROW);
+  CHECK (sbrk (0) == brk0, "break is back");
+  CHECK (sbrk (-0x10000000) == NULL, "sbrk below the heap fails");
+  CHECK (sbrk (0x40000000) == NULL, "sbrk far past the heap fails");
+  CHECK (sbrk (0) == brk0, "break is unchanged");
+
+  msg ("malloc and fill %d blocks", BLOCK_CNT);
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_size (i));
+      if (blocks[i] == NULL)
+        fail ("malloc block %zu", i);
+      memset (blocks[i], i, block_size (i));
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i, blocks[i], block_size (i));
+
+  msg ("free even blocks, grow odd blocks");
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      p = realloc (blocks[i], block_size (i) * 2);
+      if (p == NULL)
+        fail ("realloc block %zu", i);
+      check_block (i, p, block_size (i));
+      blocks[i] = p;
+    }
+
+  msg ("calloc even blocks");
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = calloc (block_size (i), 1);
+      if (blocks[i] == NULL)
+        fail ("calloc block %zu", i);
+      check_block (0, blocks[i], block_size (i));
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i, blocks[i], block_size (i));
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  msg ("all blocks intact");
+}
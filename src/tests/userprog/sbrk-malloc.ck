@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk-malloc) begin
+(sbrk-malloc) sbrk 10000 returns the old break
+(sbrk-malloc) break moved by 10000
+(sbrk-malloc) new heap is zeroed
+(sbrk-malloc) sbrk -10000
+(sbrk-malloc) break is back
+(sbrk-malloc) sbrk below the heap fails
+(sbrk-malloc) sbrk far past the heap fails
+(sbrk-malloc) break is unchanged
+(sbrk-malloc) malloc and fill 64 blocks
+(sbrk-malloc) free even blocks, grow odd blocks
+(sbrk-malloc) calloc even blocks
+(sbrk-malloc) all blocks intact
+(sbrk-malloc) end
+sbrk-malloc: exit(0)
+EOF
+pass;
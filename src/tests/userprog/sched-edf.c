@@ -0,0 +1,71 @@
+/* Checks that sched_edf() rejects bad parameters and more than
+   the EDF class can take, then has a thread given 2 ticks out of
+   every 10 spin for 40 ticks and checks that it got little more
+   than its budget of the CPU, the main thread sleeping all the
+   while so that nothing else wanted it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PERIOD 10
+#define BUDGET 2
+#define SPIN_TICKS 40
+
+/* Upper bound on the ticks the spinning thread may run: its
+   budget in each period it spans, plus slack for partial
+   periods. */
+#define MAX_RUN_TICKS (SPIN_TICKS / PERIOD * BUDGET + 2 * BUDGET)
+
+static volatile bool admitted;
+static volatile int done;
+static volatile int release;
+
+/* Spins for SPIN_TICKS as an EDF thread, if admitted, then sets
+   DONE and stays alive until RELEASE so that its counters can be
+   read. */
+static int
+edf_spin (void *aux UNUSED)
+{
+  admitted = sched_edf (PERIOD, BUDGET);
+  if (admitted)
+    {
+      int64_t end = clock_ticks () + SPIN_TICKS;
+      while (clock_ticks () < end)
+        continue;
+    }
+
+  done = 1;
+  futex_wake (&done, 1);
+  while (release == 0)
+    futex_wait (&release, 0);
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  struct threadstat ts;
+  int64_t run_ticks;
+  tid_t tid;
+
+  CHECK (!sched_edf (PERIOD, 0), "zero budget is rejected");
+  CHECK (!sched_edf (PERIOD, PERIOD + 1),
+         "budget over the period is rejected");
+  CHECK (!sched_edf (PERIOD, PERIOD), "full CPU is rejected");
+
+  CHECK ((tid = thread_create (edf_spin, NULL)) != TID_ERROR,
+         "create EDF thread");
+  while (done == 0)
+    futex_wait (&done, 0);
+  CHECK (admitted, "EDF thread was admitted");
+  CHECK (threadstat (tid, &ts), "threadstat");
+  release = 1;
+  futex_wake (&release, 1);
+  CHECK (thread_join (tid) == 0, "join EDF thread");
+
+  run_ticks = ts.user_ticks + ts.kernel_ticks;
+  if (run_ticks > MAX_RUN_TICKS)
+    fail ("EDF thread ran %lld ticks of %d", run_ticks, SPIN_TICKS);
+  msg ("EDF thread kept to its budget");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-edf) begin
+(sched-edf) zero budget is rejected
+(sched-edf) budget over the period is rejected
+(sched-edf) full CPU is rejected
+(sched-edf) create EDF thread
+(sched-edf) EDF thread was admitted
+(sched-edf) threadstat
+(sched-edf) join EDF thread
+(sched-edf) EDF thread kept to its budget
+(sched-edf) end
+sched-edf: exit(0)
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Creates threads that write into the process's memory and
+   checks that thread_join() hands back what each returned or
+   passed to thread_exit(), and that joining a thread twice, or
+   joining a tid that is not a thread of this process, fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 3
+
+/* Stores its index into the int that AUX points to, which is on
+   the main thread's stack, and returns the index plus 100. */
+static int
+store_index (void *aux)
+{
+  int *slot = aux;
+  int idx = *slot;
+
+  *slot = -idx;
+  return idx + 100;
+}
+
+/* Leaves through thread_exit() instead of returning. */
+static int
+exit_early (void *aux UNUSED)
+{
+  thread_exit (42);
+}
+
+void
+test_main (void) 
+{
+  int slots[THREAD_CNT];
+  tid_t tids[THREAD_CNT];
+  tid_t tid;
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      slots[i] = i + 1;
+      CHECK ((tids[i] = thread_create (store_index, &slots[i])) != TID_ERROR,
+             "create thread %d", i);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (tids[i]) == i + 101, "join thread %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    if (slots[i] != -(i + 1))
+      fail ("thread %d stored %d", i, slots[i]);
+  msg ("threads wrote to the main thread's stack");
+
+  CHECK (thread_join (tids[0]) == -1, "second join fails");
+  CHECK (thread_join (12345) == -1, "join of a stranger fails");
+
+  CHECK ((tid = thread_create (exit_early, NULL)) != TID_ERROR,
+         "create exiting thread");
+  CHECK (thread_join (tid) == 42, "join returns thread_exit's value");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) create thread 0
+(thread-join) create thread 1
+(thread-join) create thread 2
+(thread-join) join thread 0
+(thread-join) join thread 1
+(thread-join) join thread 2
+(thread-join) threads wrote to the main thread's stack
+(thread-join) second join fails
+(thread-join) join of a stranger fails
+(thread-join) create exiting thread
+(thread-join) join returns thread_exit's value
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Reads the clock from the time page, checking that it advances
+   without any system call being made and never goes backward,
+   and then tries to write the page, which must kill the
+   process. */
+
+#include <syscall.h>
+#include <time-page.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int64_t start, prev, now;
+  unsigned spins;
+
+  CHECK (clock_freq () > 0, "clock_freq is nonzero");
+  start = prev = clock_ticks ();
+  for (spins = 0; spins < 1u << 30; spins++)
+    {
+      now = clock_ticks ();
+      if (now < prev)
+        fail ("clock went from %lld to %lld ticks", prev, now);
+      prev = now;
+      if (now > start + 1)
+        break;
+    }
+  CHECK (prev > start + 1, "clock advanced by 2 ticks");
+  CHECK (clock_seconds () >= TIME_PAGE->boot_time,
+         "clock_seconds is no earlier than boot");
+
+  msg ("write to time page");
+  *(volatile uint32_t *) &TIME_PAGE->seq = 0;
+  fail ("time page is writable");
+}
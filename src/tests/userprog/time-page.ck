@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(time-page) begin
+(time-page) clock_freq is nonzero
+(time-page) clock advanced by 2 ticks
+(time-page) clock_seconds is no earlier than boot
+(time-page) write to time page
+time-page: exit(-1)
+EOF
+pass;
@@ -0,0 +1,21 @@
+/* Child process run by shm-share test.
+
+   Maps the segment that its parent created at another address
+   than the parent's, checks for the parent's data in the first
+   page, and writes its own into the second. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *seg = (char *) 0x20000000;
+
+  CHECK (shm_map ("shared", seg), "map \"shared\"");
+  CHECK (!strcmp (seg, "written by parent"),
+         "read parent's data from first page");
+  strlcpy (seg + 4096, "written by child", 4096);
+}
@@ -0,0 +1,109 @@
+/* Takes a chain of three incremental checkpoints, changing fewer
+   pages before each, and restores every one of them.  Each later
+   checkpoint must be smaller than the first, which holds every
+   page, and each restored process must see its own generation's
+   memory, taken in part from the older checkpoints. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 8
+
+static char pages[PAGE_CNT][4096];
+static int gen;
+
+/* Returns the generation that last wrote page I as of generation
+   G. */
+static int
+writer (int i, int g)
+{
+  if (i == 5 && g >= 3)
+    return 3;
+  else if ((i == 2 || i == 5) && g >= 2)
+    return 2;
+  else
+    return 1;
+}
+
+/* Writes generation G's data to page I. */
+static void
+write_page (int i, int g)
+{
+  memset (pages[i], i * 16 + g, sizeof pages[i]);
+}
+
+/* Checkpoints to file NAME.  In a process restored from NAME,
+   instead verifies memory and exits with the generation. */
+static void
+take (const char *name)
+{
+  int r;
+
+  gen++;
+  r = checkpoint (name);
+  if (r == 1)
+    {
+      int i;
+      size_t j;
+
+      for (i = 0; i < PAGE_CNT; i++)
+        for (j = 0; j < sizeof pages[i]; j++)
+          if (pages[i][j] != (char) (i * 16 + writer (i, gen)))
+            fail ("generation %d: page %d byte %zu differs", gen, i, j);
+      msg ("restored generation %d", gen);
+      exit (gen);
+    }
+  if (r != 0)
+    fail ("checkpoint \"%s\" failed", name);
+  msg ("checkpoint \"%s\"", name);
+}
+
+/* Returns the size of file NAME. */
+static int
+size_of (const char *name)
+{
+  int handle, size;
+
+  handle = open (name);
+  if (handle < 2)
+    fail ("open \"%s\" failed", name);
+  size = filesize (handle);
+  close (handle);
+  return size;
+}
+
+void
+test_main (void)
+{
+  int size1, size2, size3;
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    write_page (i, 1);
+  take ("ck1");
+  write_page (2, 2);
+  write_page (5, 2);
+  take ("ck2");
+  write_page (5, 3);
+  take ("ck3");
+
+  /* Clobber everything, which the restored processes must not
+     see. */
+  memset (pages, 0, sizeof pages);
+
+  size1 = size_of ("ck1");
+  size2 = size_of ("ck2");
+  size3 = size_of ("ck3");
+  CHECK (size2 < size1, "\"ck2\" smaller than \"ck1\"");
+  CHECK (size3 < size1, "\"ck3\" smaller than \"ck1\"");
+  for (i = 1; i <= 3; i++)
+    {
+      char name[8];
+
+      snprintf (name, sizeof name, "ck%d", i);
+      msg ("wait(restore(\"%s\")) = %d", name, wait (restore (name)));
+    }
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ckpt-chain) begin
+(ckpt-chain) checkpoint "ck1"
+(ckpt-chain) checkpoint "ck2"
+(ckpt-chain) checkpoint "ck3"
+(ckpt-chain) "ck2" smaller than "ck1"
+(ckpt-chain) "ck3" smaller than "ck1"
+(ckpt-chain) restored generation 1
+ckpt-chain: exit(1)
+(ckpt-chain) wait(restore("ck1")) = 1
+(ckpt-chain) restored generation 2
+ckpt-chain: exit(2)
+(ckpt-chain) wait(restore("ck2")) = 2
+(ckpt-chain) restored generation 3
+ckpt-chain: exit(3)
+(ckpt-chain) wait(restore("ck3")) = 3
+(ckpt-chain) end
+ckpt-chain: exit(0)
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Fills data, heap and stack memory, checkpoints, clobbers it
+   all, and restores the checkpoint.  The restored process must
+   resume from checkpoint() with the memory as it was then. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE (3 * 4096)
+#define HEAP_SIZE (2 * 4096)
+#define STACK_SIZE 512
+
+static char data[DATA_SIZE];
+
+/* Returns the byte expected at offset OFS of the memory that
+   SEED was used to fill. */
+static char
+byte_at (size_t ofs, int seed)
+{
+  return (ofs * 7 + seed) % 251;
+}
+
+/* Fills the SIZE bytes at BUF using SEED. */
+static void
+fill (char *buf, size_t size, int seed)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = byte_at (i, seed);
+}
+
+/* Fails unless the SIZE bytes at BUF, called WHAT, are as
+   fill() left them with SEED. */
+static void
+verify (const char *buf, size_t size, int seed, const char *what)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != byte_at (i, seed))
+      fail ("byte %zu of %s differs after restore", i, what);
+}
+
+void
+test_main (void)
+{
+  char stack[STACK_SIZE];
+  char *heap;
+  int r;
+
+  CHECK ((heap = sbrk (HEAP_SIZE)) != NULL, "sbrk %d bytes", HEAP_SIZE);
+  fill (data, DATA_SIZE, 1);
+  fill (heap, HEAP_SIZE, 2);
+  fill (stack, STACK_SIZE, 3);
+  msg ("fill memory");
+
+  r = checkpoint ("saved");
+  if (r == 1)
+    {
+      msg ("resumed from checkpoint");
+      verify (data, DATA_SIZE, 1, "data");
+      verify (heap, HEAP_SIZE, 2, "heap");
+      verify (stack, STACK_SIZE, 3, "stack");
+      msg ("memory verified");
+      exit (42);
+    }
+  if (r != 0)
+    fail ("checkpoint \"saved\" failed");
+  msg ("checkpoint \"saved\"");
+
+  memset (data, 0, DATA_SIZE);
+  memset (heap, 0, HEAP_SIZE);
+  memset (stack, 0, STACK_SIZE);
+  msg ("clobber memory");
+
+  msg ("wait(restore()) = %d", wait (restore ("saved")));
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ckpt-restore) begin
+(ckpt-restore) sbrk 8192 bytes
+(ckpt-restore) fill memory
+(ckpt-restore) checkpoint "saved"
+(ckpt-restore) clobber memory
+(ckpt-restore) resumed from checkpoint
+(ckpt-restore) memory verified
+ckpt-restore: exit(42)
+(ckpt-restore) wait(restore()) = 42
+(ckpt-restore) end
+ckpt-restore: exit(0)
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Creates shared memory segments until the system-wide limit
+   refuses one, then checks that a removed segment still counts
+   against the limit while it is mapped, and stops counting once
+   it is unmapped. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Size of each segment. */
+#define SEG_SIZE (16 * 4096)
+
+/* More segments than fit in a quarter of the largest user pool. */
+#define SEG_MAX 256
+
+/* Stores the name of segment I in NAME and returns NAME. */
+static const char *
+seg_name (char name[8], int i)
+{
+  snprintf (name, 8, "s%d", i);
+  return name;
+}
+
+void
+test_main (void)
+{
+  char *addr = (char *) 0x10000000;
+  char name[8];
+  int cnt, i;
+
+  for (cnt = 0; cnt < SEG_MAX; cnt++)
+    if (!shm_create (seg_name (name, cnt), SEG_SIZE))
+      break;
+  if (cnt < 2)
+    fail ("created only %d segments", cnt);
+  if (cnt == SEG_MAX)
+    fail ("created %d segments of %d bytes each", cnt, SEG_SIZE);
+  msg ("creating segments stops at the limit");
+
+  CHECK (shm_map ("s0", addr), "map \"s0\"");
+  addr[0] = 1;
+  CHECK (shm_remove ("s0"), "remove \"s0\"");
+  CHECK (!shm_create ("new", SEG_SIZE),
+         "create \"new\" while \"s0\" is mapped (must fail)");
+  CHECK (shm_unmap (addr), "unmap \"s0\"");
+  CHECK (shm_create ("new", SEG_SIZE), "create \"new\"");
+
+  CHECK (shm_remove ("new"), "remove \"new\"");
+  for (i = 1; i < cnt; i++)
+    if (!shm_remove (seg_name (name, i)))
+      fail ("remove \"%s\" failed", name);
+  msg ("removed the other segments");
+}
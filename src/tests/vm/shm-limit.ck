@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-limit) begin
+(shm-limit) creating segments stops at the limit
+(shm-limit) map "s0"
+(shm-limit) remove "s0"
+(shm-limit) create "new" while "s0" is mapped (must fail)
+(shm-limit) unmap "s0"
+(shm-limit) create "new"
+(shm-limit) remove "new"
+(shm-limit) removed the other segments
+(shm-limit) end
+shm-limit: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Verifies that a shared memory segment cannot be mapped over
+   memory already in use: code, data, the stack, another mapping
+   of a segment, or a memory-mapped file, nor at a misaligned
+   address. */
+
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char x;
+
+void
+test_main (void)
+{
+  char *seg = (char *) 0x10000000;
+  int handle;
+
+  CHECK (shm_create ("seg", 2 * 4096), "create \"seg\"");
+  CHECK (!shm_map ("seg", (void *) ROUND_DOWN ((uintptr_t) test_main, 4096)),
+         "try to map over code segment");
+  CHECK (!shm_map ("seg", (void *) ROUND_DOWN ((uintptr_t) &x, 4096)),
+         "try to map over data segment");
+  CHECK (!shm_map ("seg", (void *) ROUND_DOWN ((uintptr_t) &handle, 4096)),
+         "try to map over stack segment");
+  CHECK (!shm_map ("seg", seg + 1), "try to map at misaligned address");
+
+  CHECK (shm_map ("seg", seg), "map \"seg\"");
+  CHECK (!shm_map ("seg", seg + 4096),
+         "try to map over the second page of \"seg\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, seg + 2 * 4096) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (shm_unmap (seg), "unmap \"seg\"");
+  CHECK (!shm_map ("seg", seg + 4096), "try to map over \"sample.txt\"");
+  CHECK (shm_map ("seg", seg), "map \"seg\" again");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-overlap) begin
+(shm-overlap) create "seg"
+(shm-overlap) try to map over code segment
+(shm-overlap) try to map over data segment
+(shm-overlap) try to map over stack segment
+(shm-overlap) try to map at misaligned address
+(shm-overlap) map "seg"
+(shm-overlap) try to map over the second page of "seg"
+(shm-overlap) open "sample.txt"
+(shm-overlap) mmap "sample.txt"
+(shm-overlap) unmap "seg"
+(shm-overlap) try to map over "sample.txt"
+(shm-overlap) map "seg" again
+(shm-overlap) end
+shm-overlap: exit(0)
+EOF
+pass;
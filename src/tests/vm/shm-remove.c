@@ -0,0 +1,44 @@
+/* Removes a shared memory segment while it is mapped.  The
+   mapping must keep working until it is unmapped, but the name
+   must be gone at once, free for a new segment of its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *old = (char *) 0x10000000;
+  char *new = (char *) 0x20000000;
+  size_t i;
+
+  CHECK (shm_create ("seg", 4096), "create \"seg\"");
+  CHECK (shm_map ("seg", old), "map \"seg\"");
+  memset (old, 0x5a, 4096);
+  CHECK (shm_remove ("seg"), "remove \"seg\"");
+  CHECK (!shm_map ("seg", new), "map removed \"seg\" (must fail)");
+  CHECK (!shm_remove ("seg"), "remove \"seg\" again (must fail)");
+
+  for (i = 0; i < 4096; i++)
+    if (old[i] != 0x5a)
+      fail ("byte %zu of removed segment changed to %#x",
+            i, (unsigned char) old[i]);
+  memset (old, 0xa5, 4096);
+  msg ("removed segment still usable");
+
+  CHECK (shm_create ("seg", 4096), "create new \"seg\"");
+  CHECK (shm_map ("seg", new), "map new \"seg\"");
+  for (i = 0; i < 4096; i++)
+    if (new[i] != 0)
+      fail ("byte %zu of new segment is %#x, not 0",
+            i, (unsigned char) new[i]);
+  msg ("new segment is zeroed");
+  if (old[0] != (char) 0xa5)
+    fail ("new segment aliases the removed one");
+
+  CHECK (shm_unmap (old), "unmap removed \"seg\"");
+  CHECK (shm_unmap (new), "unmap new \"seg\"");
+  CHECK (shm_remove ("seg"), "remove new \"seg\"");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-remove) begin
+(shm-remove) create "seg"
+(shm-remove) map "seg"
+(shm-remove) remove "seg"
+(shm-remove) map removed "seg" (must fail)
+(shm-remove) remove "seg" again (must fail)
+(shm-remove) removed segment still usable
+(shm-remove) create new "seg"
+(shm-remove) map new "seg"
+(shm-remove) new segment is zeroed
+(shm-remove) unmap removed "seg"
+(shm-remove) unmap new "seg"
+(shm-remove) remove new "seg"
+(shm-remove) end
+shm-remove: exit(0)
+EOF
+pass;
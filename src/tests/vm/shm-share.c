@@ -0,0 +1,23 @@
+/* Creates a shared memory segment, maps it, and runs child-shm,
+   which maps the same segment at another address.  Each process
+   must see what the other writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *seg = (char *) 0x10000000;
+
+  CHECK (shm_create ("shared", 2 * 4096), "create \"shared\"");
+  CHECK (shm_map ("shared", seg), "map \"shared\"");
+  strlcpy (seg, "written by parent", 4096);
+  msg ("wait(exec()) = %d", wait (exec ("child-shm")));
+  CHECK (!strcmp (seg + 4096, "written by child"),
+         "read child's data from second page");
+  CHECK (shm_unmap (seg), "unmap \"shared\"");
+  CHECK (shm_remove ("shared"), "remove \"shared\"");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-share) begin
+(shm-share) create "shared"
+(shm-share) map "shared"
+(child-shm) begin
+(child-shm) map "shared"
+(child-shm) read parent's data from first page
+(child-shm) end
+child-shm: exit(0)
+(shm-share) wait(exec()) = 0
+(shm-share) read child's data from second page
+(shm-share) unmap "shared"
+(shm-share) remove "shared"
+(shm-share) end
+shm-share: exit(0)
+EOF
+pass;
@@ -0,0 +1,145 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdint.h>
+
+/* Feature bits returned in EDX by CPUID leaf 1.
+   See [IA32-v2a] "CPUID--CPU Identification". */
+#define CPUID_PSE (1u << 3)     /* 4 MB pages. */
+#define CPUID_TSC (1u << 4)     /* Time-stamp counter. */
+#define CPUID_SEP (1u << 11)    /* SYSENTER and SYSEXIT. */
+#define CPUID_PGE (1u << 13)    /* Global pages. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+
+/* Feature bits returned in ECX by CPUID leaf 1. */
+#define CPUID2_MONITOR (1u << 3) /* MONITOR and MWAIT. */
+
+/* CR0 Register. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Numeric error reporting. */
+
+/* CR4 Register. */
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+#define CR4_PCE 0x00000100      /* RDPMC allowed in user mode. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE/FXRSTOR and SSE enable. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SIMD floating-point exceptions. */
+
+/* Returns the feature bits that CPUID leaf 1 reports in EDX. */
+static inline uint32_t
+cpu_features (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return edx;
+}
+
+/* Stores into REGS the EAX, EBX, ECX and EDX that CPUID returns
+   for LEAF. */
+static inline void
+cpu_cpuid (uint32_t leaf, uint32_t regs[4])
+{
+  asm ("cpuid"
+       : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+       : "a" (leaf), "c" (0));
+}
+
+/* Returns the feature bits that CPUID leaf 1 reports in ECX. */
+static inline uint32_t
+cpu_features2 (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return ecx;
+}
+
+/* Arms the monitor on the cache line holding ADDR, so that a
+   following MWAIT returns once it is written.  The CPU must have
+   CPUID2_MONITOR.  See [IA32-v2a] "MONITOR". */
+static inline void
+cpu_monitor (const volatile void *addr)
+{
+  asm volatile ("monitor" : : "a" (addr), "c" (0), "d" (0) : "memory");
+}
+
+/* Returns the time-stamp counter, which counts CPU cycles since
+   reset.  The CPU must have CPUID_TSC. */
+static inline uint64_t
+cpu_rdtsc (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns model-specific register MSR. */
+static inline uint64_t
+cpu_rdmsr (uint32_t msr)
+{
+  uint64_t value;
+
+  asm volatile ("rdmsr" : "=A" (value) : "c" (msr));
+  return value;
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+cpu_wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value) : "memory");
+}
+
+/* Returns performance-monitoring counter COUNTER. */
+static inline uint64_t
+cpu_rdpmc (uint32_t counter)
+{
+  uint64_t value;
+
+  asm volatile ("rdpmc" : "=A" (value) : "c" (counter));
+  return value;
+}
+
+/* Returns CR4. */
+static inline uint32_t
+cr4_get (void)
+{
+  uint32_t cr4;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Sets the bits in FLAGS in CR4. */
+static inline void
+cr4_set (uint32_t flags)
+{
+  uint32_t cr4;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | flags) : "memory");
+}
+
+/* Returns CR0. */
+static inline uint32_t
+cr0_get (void)
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+/* Stores VALUE into CR0. */
+static inline void
+cr0_put (uint32_t value)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (value) : "memory");
+}
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,178 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.
+
+   The FPU (x87 and, where the CPU has it, SSE) holds the state of
+   at most one thread at a time, FPU_OWNER.  Switching to any
+   other thread sets CR0.TS, so that its first FPU instruction
+   raises #NM (device not available).  Only then does the #NM
+   handler save the owner's state into the owner's save area,
+   load the faulting thread's, and make it the owner.  A thread
+   that never touches the FPU never pays for it, and a thread
+   that is the only one using it keeps its state in the registers
+   across any number of switches.
+
+   A thread's save area is allocated on its first FPU
+   instruction, which also initializes the FPU for it.  The
+   kernel itself is compiled without floating point, so only user
+   programs take these faults in practice.
+
+   FXSAVE and FXRSTOR save and restore SSE state as well as x87
+   state; on CPUs without them, FNSAVE and FRSTOR are used. */
+
+/* Bytes in a save area, and its required alignment. */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+/* Initial MXCSR: all SIMD exceptions masked, round to nearest. */
+#define MXCSR_DEFAULT 0x1f80
+
+static struct thread *fpu_owner;        /* Thread whose state is loaded. */
+static bool fxsr;                       /* FXSAVE and FXRSTOR usable? */
+
+static intr_handler_func fpu_fault;
+
+/* Enables the FPU and registers the #NM handler. */
+void
+fpu_init (void)
+{
+  uint32_t features = cpu_features ();
+
+  fxsr = (features & CPUID_FXSR) != 0;
+  if (fxsr)
+    cr4_set (CR4_OSFXSR
+             | ((features & CPUID_SSE) != 0 ? CR4_OSXMMEXCPT : 0));
+
+  /* Stop emulating, so that FPU instructions run natively, but
+     trap them with TS until a thread has been given the FPU. */
+  cr0_put ((cr0_get () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  fpu_owner = NULL;
+
+  intr_register_int (7, 0, INTR_ON, fpu_fault,
+                     "#NM Device Not Available Exception");
+}
+
+/* Returns T's save area, aligned. */
+static void *
+state_of (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu, FPU_STATE_ALIGN);
+}
+
+/* Saves the FPU's state into T's save area. */
+static void
+save (struct thread *t)
+{
+  if (fxsr)
+    asm volatile ("fxsave %0" : "=m" (*(uint8_t (*)[FPU_STATE_SIZE])
+                                      state_of (t)));
+  else
+    asm volatile ("fnsave %0" : "=m" (*(uint8_t (*)[FPU_STATE_SIZE])
+                                      state_of (t)));
+}
+
+/* Loads the FPU's state from T's save area. */
+static void
+restore (struct thread *t)
+{
+  if (fxsr)
+    asm volatile ("fxrstor %0" : : "m" (*(uint8_t (*)[FPU_STATE_SIZE])
+                                        state_of (t)));
+  else
+    asm volatile ("frstor %0" : : "m" (*(uint8_t (*)[FPU_STATE_SIZE])
+                                       state_of (t)));
+}
+
+/* Puts the FPU in its initial state. */
+static void
+reset (void)
+{
+  asm volatile ("fninit");
+  if (fxsr)
+    {
+      uint32_t mxcsr = MXCSR_DEFAULT;
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+}
+
+/* #NM handler: gives the FPU to the running thread. */
+static void
+fpu_fault (struct intr_frame *f UNUSED)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool fresh = false;
+
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = malloc (FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+      if (cur->fpu == NULL)
+        {
+#ifdef USERPROG
+          cur->leader->exit_status = -1;
+#endif
+          thread_exit ();
+        }
+      fresh = true;
+    }
+
+  old_level = intr_disable ();
+  asm volatile ("clts");
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        save (fpu_owner);
+      if (fresh)
+        reset ();
+      else
+        restore (cur);
+      fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+}
+
+/* Makes the FPU available without a fault to NEXT, the thread
+   about to run, only if NEXT's state is the one loaded.
+   Interrupts must be off. */
+void
+fpu_activate (struct thread *next)
+{
+  uint32_t cr0 = cr0_get ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (next == fpu_owner)
+    {
+      if (cr0 & CR0_TS)
+        asm volatile ("clts");
+    }
+  else if (!(cr0 & CR0_TS))
+    cr0_put (cr0 | CR0_TS);
+}
+
+/* Releases the running thread's FPU state.  Called as it exits. */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    {
+      fpu_owner = NULL;
+      cr0_put (cr0_get () | CR0_TS);
+    }
+  intr_set_level (old_level);
+
+  free (cur->fpu);
+  cur->fpu = NULL;
+}
@@ -15,27 +15,47 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/ioapic.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/pmu.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
+#include "userprog/elfcache.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -52,21 +72,63 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Role to give a RAM disk, and its size in kB. */
+static enum block_type ramdisk_role;
+static int ramdisk_kb;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -pmu: Count hardware events per thread?  With "-pmu=user",
+   also let user programs read the counters. */
+static bool pmu_enabled;
+static bool pmu_user;
+
+/* -bootstats: Print how long each step of booting took. */
+static bool boot_stats;
+
+/* -irqcpu: CPU to deliver each ISA IRQ to, or -1 for the
+   default, the bootstrap processor. */
+static int irq_cpus[IOAPIC_IRQ_CNT] = { [0 ... IOAPIC_IRQ_CNT - 1] = -1 };
+
+/* Boot steps, each stamped when it completes with the TSC, or
+   with the tick count if the CPU has no TSC.  With the TSC, the
+   first steps are the firmware, from reset to the loader, and
+   the loader itself, from the stamps that it and start.S leave,
+   and the last ones cover the first user program, if any, up to
+   its first instruction. */
+#define BOOT_STEP_MAX 40
+struct boot_step
+  {
+    const char *name;
+    uint64_t stamp;
+  };
+static struct boot_step boot_steps[BOOT_STEP_MAX];
+static size_t boot_step_cnt;
+static size_t boot_printed_cnt; /* Steps already printed. */
+static bool boot_tsc;           /* Stamps from the TSC? */
+static bool boot_done;          /* Stopped stamping? */
+
+static void add_boot_step (const char *name, uint64_t stamp);
+static void print_boot_steps (const char *title);
+
 static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static void parse_irq_cpu (char *value);
+static void parse_tune (char *value);
+static void route_irqs (void);
 static void run_actions (char **argv);
 static void usage (void);
 static void minimonitor (void);
 
 #ifdef FILESYS
+static void parse_ramdisk (char *value);
+static void create_ramdisk (void);
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
 #endif
@@ -81,10 +143,12 @@ pintos_init (void)
 
   /* Clear BSS. */  
   bss_init ();
+  boot_mark (NULL);
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
   argv = parse_options (argv);
+  boot_mark ("options");
 
   /* thread_mlfqs = true; */
 
@@ -92,6 +156,7 @@ pintos_init (void)
      then enable console locking. */
   thread_init ();
   console_init ();  
+  boot_mark ("thread_init");
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -99,8 +164,20 @@ pintos_init (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  boot_mark ("palloc_init");
   malloc_init ();
+  trace_init ();
+  profile_init ();
+  boot_mark ("malloc_init");
   paging_init ();
+  mp_init ();
+  boot_mark ("paging_init");
+#ifdef VM
+  frame_init ();
+  page_init ();
+  shm_init ();
+  boot_mark ("frame_init");
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -110,26 +187,54 @@ pintos_init (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
+  if (pmu_enabled)
+    pmu_init (pmu_user);
   timer_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
+  pagedir_init ();
   syscall_init ();
+  elf_cache_init ();
+  process_init ();
 #endif
+  boot_mark ("intr_init");
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
+  boot_mark ("thread_start");
   timer_calibrate ();
+  boot_mark ("timer_calibrate");
+  mp_start ();
+  timer_cpu_init ();
+  route_irqs ();
+  boot_mark ("mp_start");
+  palloc_start_zeroer ();
+  workqueue_init ();
+  rcu_init ();
+  boot_mark ("workqueue_init");
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  boot_mark ("ide_init");
+  if (ramdisk_kb > 0)
+    create_ramdisk ();
   locate_block_devices ();
   filesys_init (format_filesys);
+  boot_mark ("filesys_init");
+#endif
+#ifdef VM
+  swap_init ();
+  frame_reclaim_start ();
+  boot_mark ("swap_init");
 #endif
 
+  if (boot_stats)
+    print_boot_steps ("Boot steps");
   printf ("Boot complete.\n");
   
   if (*argv != NULL) {
@@ -144,6 +249,83 @@ pintos_init (void)
   thread_exit ();
 }
 
+/* Stamps the end of boot step NAME, or with a null NAME the
+   start of booting.  Does nothing once boot_finish() has been
+   called. */
+void
+boot_mark (const char *name)
+{
+  if (boot_done)
+    return;
+  if (name == NULL)
+    {
+      boot_tsc = (cpu_features () & CPUID_TSC) != 0;
+      if (boot_tsc)
+        {
+          /* The loader's stamp has only 32 bits, but it was taken
+             less than 2**32 cycles before start_tsc. */
+          uint32_t loader_cycles = (uint32_t) start_tsc - loader_tsc;
+
+          add_boot_step (NULL, 0);
+          add_boot_step ("firmware", start_tsc - loader_cycles);
+          add_boot_step ("loader", start_tsc);
+          name = "start";
+        }
+    }
+  add_boot_step (name, boot_tsc ? cpu_rdtsc () : (uint64_t) timer_ticks ());
+}
+
+/* Stamps the last boot step, just before the first user program
+   executes its first instruction, and prints the steps since
+   "Boot complete" if "-bootstats" was given.  Only the first call
+   does anything. */
+void
+boot_finish (void)
+{
+  if (boot_done)
+    return;
+  boot_mark ("user");
+  boot_done = true;
+  if (boot_stats)
+    print_boot_steps ("Boot to first user instruction");
+}
+
+/* Records boot step NAME as ending at STAMP. */
+static void
+add_boot_step (const char *name, uint64_t stamp)
+{
+  struct boot_step *s;
+
+  if (boot_step_cnt >= BOOT_STEP_MAX)
+    return;
+  s = &boot_steps[boot_step_cnt++];
+  s->name = name;
+  s->stamp = stamp;
+}
+
+/* Prints under TITLE how long each boot step not yet printed
+   took, and the total since the first step, in microseconds if
+   the TSC was usable, otherwise in timer ticks. */
+static void
+print_boot_steps (const char *title)
+{
+  bool us = boot_tsc && timer_cycles_to_ns (1000000000) != 0;
+  uint64_t total = boot_steps[boot_step_cnt - 1].stamp - boot_steps[0].stamp;
+  size_t i;
+
+  printf ("%s, in %s:\n", title, us ? "microseconds" : "timer ticks");
+  for (i = boot_printed_cnt > 0 ? boot_printed_cnt : 1; i < boot_step_cnt;
+       i++)
+    {
+      uint64_t d = boot_steps[i].stamp - boot_steps[i - 1].stamp;
+      printf ("  %-16s %10"PRIu64"\n", boot_steps[i].name,
+              us ? timer_cycles_to_ns (d) / 1000 : d);
+    }
+  printf ("  %-16s %10"PRIu64"\n", "total",
+          us ? timer_cycles_to_ns (total) / 1000 : total);
+  boot_printed_cnt = boot_step_cnt;
+}
+
 /* Clear the "BSS", a segment that should be initialized to
    zeros.  It isn't actually stored on disk or zeroed by the
    kernel loader, so we have to zero it ourselves.
@@ -160,14 +342,30 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports 4 MB pages, each 4 MB of RAM that lies
+   entirely within memory and does not overlap the read-only
+   kernel text is mapped by a single PDE.  That saves a page
+   table and uses only one TLB entry per 4 MB.  The rest is mapped
+   with 4 kB pages.
+
+   The kernel mapping is the same in every page directory, so if
+   the CPU supports global pages it is marked global, and its TLB
+   entries survive the CR3 reload on each process switch. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
   extern char _start, _end_kernel_text;
 
+  if (pse)
+    cr4_set (CR4_PSE);
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -178,13 +376,22 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0
+          && page + PGSIZE / sizeof *pt <= init_ram_pages
+          && (vaddr + LARGE_PGSIZE <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large_kernel (vaddr, true) | global;
+          page += PGSIZE / sizeof *pt - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -193,6 +400,8 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+  if (global)
+    cr4_set (CR4_PGE);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -249,11 +458,23 @@ parse_options (char **argv)
         shutdown_configure (SHUTDOWN_REBOOT);
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
-        format_filesys = true;
+        {
+          format_filesys = true;
+          if (value == NULL || !strcmp (value, "indexed"))
+            inode_set_default_layout (INODE_INDEXED);
+          else if (!strcmp (value, "extents"))
+            inode_set_default_layout (INODE_EXTENTS);
+          else
+            PANIC ("unknown file system layout `%s'", value);
+        }
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-tracedev"))
+        trace_set_bdev (value);
+      else if (!strcmp (name, "-ramdisk"))
+        parse_ramdisk (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -262,10 +483,59 @@ parse_options (char **argv)
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        {
+          thread_mlfqs = true;
+          thread_fair = false;
+        }
+      else if (!strcmp (name, "-fair"))
+        {
+          thread_fair = true;
+          thread_mlfqs = false;
+        }
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-nosmp"))
+        mp_enabled = false;
+      else if (!strcmp (name, "-irqcpu"))
+        parse_irq_cpu (value);
+      else if (!strcmp (name, "-tune"))
+        parse_tune (value);
+      else if (!strcmp (name, "-pmu"))
+        {
+          pmu_enabled = true;
+          if (value != NULL && !strcmp (value, "user"))
+            pmu_user = true;
+          else if (value != NULL)
+            PANIC ("unknown -pmu mode `%s'", value);
+        }
+      else if (!strcmp (name, "-bootstats"))
+        boot_stats = true;
+      else if (!strcmp (name, "-trace"))
+        trace_page_cnt = value != NULL ? atoi (value) : 16;
+      else if (!strcmp (name, "-profile"))
+        profile_page_cnt = value != NULL ? atoi (value) : 4;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
+      else if (!strcmp (name, "-lw"))
+        frame_low_water = atoi (value);
+      else if (!strcmp (name, "-hw"))
+        frame_high_water = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        swap_pool_limit = atoi (value);
+      else if (!strcmp (name, "-evict"))
+        {
+          if (value == NULL || !strcmp (value, "clock"))
+            frame_policy = FRAME_CLOCK;
+          else if (!strcmp (value, "random"))
+            frame_policy = FRAME_RANDOM;
+          else
+            PANIC ("unknown eviction policy `%s'", value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -350,6 +620,50 @@ run_actions (char **argv)
   
 }
 
+/* Parses VALUE, the "IRQ:CPU" argument to -irqcpu. */
+static void
+parse_irq_cpu (char *value)
+{
+  char *save_ptr;
+  char *irq = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+  char *cpu = irq != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+  int i;
+
+  if (cpu == NULL)
+    PANIC ("-irqcpu requires an IRQ:CPU argument");
+  i = atoi (irq);
+  if (i < 0 || i >= IOAPIC_IRQ_CNT)
+    PANIC ("-irqcpu: bad IRQ `%s'", irq);
+  irq_cpus[i] = atoi (cpu);
+}
+
+/* Parses VALUE, the "NAME:VALUE" argument to -tune, and sets
+   the tunable. */
+static void
+parse_tune (char *value)
+{
+  char *save_ptr;
+  char *name = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+  char *number = name != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+
+  if (number == NULL)
+    PANIC ("-tune requires a NAME:VALUE argument");
+  if (atoi (number) < 0 || !tunable_set (name, atoi (number), true))
+    PANIC ("-tune: unknown tunable `%s' or bad value `%s'", name, number);
+}
+
+/* Applies the -irqcpu options, once the CPUs are up. */
+static void
+route_irqs (void)
+{
+  int irq;
+
+  for (irq = 0; irq < IOAPIC_IRQ_CNT; irq++)
+    if (irq_cpus[irq] >= 0 && !intr_set_irq_cpu (irq, irq_cpus[irq]))
+      printf ("-irqcpu: cannot deliver IRQ %d to CPU %d\n",
+              irq, irq_cpus[irq]);
+}
+
 /* Prints a kernel command line help message and powers off the
    machine. */
 static void
@@ -377,23 +691,78 @@ usage (void)
           "  -q                 Power off VM after actions or on panic.\n"
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
-          "  -f                 Format file system device during startup.\n"
+          "  -f[=LAYOUT]        Format file system device during startup,\n"
+          "                     with `indexed' (default) or `extents' files.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -tracedev=BDEV     Dump the trace to BDEV, not the console.\n"
+          "  -ramdisk=ROLE:KB   Use a KB-kB RAM disk for ROLE: filesys or scratch.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -fair              Use proportional-share fair scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -nosmp             Leave all CPUs but the first halted.\n"
+          "  -irqcpu=IRQ:CPU    Deliver ISA IRQ to CPU (index from 0).\n"
+          "  -tune=NAME:VALUE   Set tunable NAME, listed below, to VALUE.\n"
+          "  -pmu[=user]        Count hardware events per thread; with\n"
+          "                     `user', let user programs use RDPMC.\n"
+          "  -bootstats         Time each boot step, up to the first user program.\n"
+          "  -trace[=PAGES]     Trace kernel events in a PAGES-page buffer.\n"
+          "  -profile[=PAGES]   Count timer-tick eips in a PAGES-page table.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages (default 2048).\n"
+          "  -lw=COUNT          Reclaim user memory when under COUNT pages are free.\n"
+          "  -hw=COUNT          Stop reclaiming once COUNT pages are free.\n"
+          "  -zswap=COUNT       Keep COUNT pages of compressed swap in RAM (default 64).\n"
+          "  -evict=POLICY      Evict by POLICY: clock (default) or random.\n"
 #endif
           );
+  tunable_print ();
   shutdown_power_off ();
 }
 
 #ifdef FILESYS
+/* Parses VALUE, the "ROLE:KB" argument to -ramdisk. */
+static void
+parse_ramdisk (char *value)
+{
+  char *save_ptr;
+  char *role = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+  char *kb = role != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+
+  if (kb == NULL)
+    PANIC ("-ramdisk requires a ROLE:KB argument");
+  if (!strcmp (role, "filesys"))
+    ramdisk_role = BLOCK_FILESYS;
+  else if (!strcmp (role, "scratch"))
+    ramdisk_role = BLOCK_SCRATCH;
+  else
+    PANIC ("-ramdisk: unknown role `%s'", role);
+  ramdisk_kb = atoi (kb);
+  if (ramdisk_kb <= 0)
+    PANIC ("-ramdisk: bad size `%s'", kb);
+}
+
+/* Creates the RAM disk asked for by -ramdisk and, unless another
+   device was named for its role, gives it that role. */
+static void
+create_ramdisk (void)
+{
+  struct block *block = ramdisk_create (ramdisk_role, ramdisk_kb * 2);
+
+  if (ramdisk_role == BLOCK_FILESYS && filesys_bdev_name == NULL)
+    filesys_bdev_name = block_name (block);
+  else if (ramdisk_role == BLOCK_SCRATCH && scratch_bdev_name == NULL)
+    scratch_bdev_name = block_name (block);
+}
+
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
 locate_block_devices (void)
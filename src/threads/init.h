@@ -9,4 +9,8 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Boot timing, printed with "-bootstats". */
+void boot_mark (const char *name);
+void boot_finish (void);
+
 #endif /* threads/init.h */
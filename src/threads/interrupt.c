@@ -3,12 +3,21 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sysstat.h>
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/ioapic.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -37,16 +46,36 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Per-vector counts and handler times, in CPU cycles from the
+   TSC (all zero if there is none).  A handler that runs with
+   interrupts on is charged for whatever interrupts it, and one
+   that sleeps, like a system call, for the time it sleeps.  A
+   handler that never returns, killing its thread, is counted but
+   not timed.  Tasklets and the yield on return are not part of
+   any handler's time. */
+static unsigned long long intr_cnt[INTR_CNT];
+static uint64_t intr_cycles[INTR_CNT];
+static uint64_t intr_max_cycles[INTR_CNT];
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
+   interrupt returns.  Longer work belongs in a tasklet, which
+   runs after the interrupt is acknowledged, with interrupts on. */
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Tasklets waiting to run, in the order they were scheduled.  An
+   external interrupt that arrives while IN_TASKLETS is set only
+   adds to the list; the outer interrupt runs the new tasklets
+   and does any yield they request. */
+static struct intr_tasklet *tasklet_head, *tasklet_tail;
+static bool in_tasklets;        /* Are we running tasklets? */
+static void run_tasklets (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -120,8 +149,15 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
-  /* Initialize interrupt controller. */
+  /* Initialize interrupt controller.  With an I/O APIC, the PICs
+     are left masked, and it delivers their vectors instead. */
   pic_init ();
+  if (ioapic_present ())
+    {
+      outb (PIC0_DATA, 0xff);
+      outb (PIC1_DATA, 0xff);
+      ioapic_start ();
+    }
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
@@ -174,6 +210,15 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
   intr_names[vec_no] = name;
 }
 
+/* Returns true if VEC_NO is an external interrupt: one from the
+   PICs, or from the local APIC other than a spurious one. */
+static inline bool
+is_external (uint8_t vec_no)
+{
+  return ((vec_no >= 0x20 && vec_no <= 0x2f)
+          || (vec_no >= LAPIC_VEC_MIN && vec_no != LAPIC_SPURIOUS_VEC));
+}
+
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
    execute with interrupts disabled. */
@@ -181,7 +226,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,16 +247,16 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt or
+   of the tasklets it scheduled, and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_tasklets;
 }
 
 /* During processing of an external interrupt, directs the
@@ -224,7 +269,81 @@ intr_yield_on_return (void)
   ASSERT (intr_context ());
   yield_on_return = true;
 }
+
+/* Initializes tasklet T to call FUNC, given auxiliary data AUX. */
+void
+intr_tasklet_init (struct intr_tasklet *t, intr_tasklet_func *func,
+                   void *aux)
+{
+  ASSERT (func != NULL);
+
+  t->next = NULL;
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arranges for tasklet T to run once the current external
+   interrupt has been acknowledged.  Does nothing if T is already
+   pending.  Must be called with interrupts off, normally from an
+   external interrupt handler or another tasklet. */
+void
+intr_tasklet_schedule (struct intr_tasklet *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->pending)
+    return;
+  t->pending = true;
+  t->next = NULL;
+  if (tasklet_tail != NULL)
+    tasklet_tail->next = t;
+  else
+    tasklet_head = t;
+  tasklet_tail = t;
+}
+
+/* Runs pending tasklets, including any they or nested interrupts
+   schedule, until there are none left.  Each tasklet runs with
+   interrupts on.  Called with interrupts off, and returns that
+   way. */
+static void
+run_tasklets (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  in_tasklets = true;
+  while (tasklet_head != NULL)
+    {
+      struct intr_tasklet *t = tasklet_head;
+      tasklet_head = t->next;
+      if (tasklet_head == NULL)
+        tasklet_tail = NULL;
+      t->pending = false;
+
+      intr_enable ();
+      t->func (t->aux);
+      intr_disable ();
+    }
+  in_tasklets = false;
+}
 
+/* Delivers ISA IRQ, 0...15, to the CPU with index CPU in cpus[]
+   from now on.  Returns false, changing nothing, if there is no
+   I/O APIC to route it, or if that CPU does not take interrupts:
+   so far, only the bootstrap processor does, since the others
+   stay halted with interrupts disabled. */
+bool
+intr_set_irq_cpu (int irq, int cpu)
+{
+  if (!ioapic_present () || irq < 0 || irq >= IOAPIC_IRQ_CNT
+      || cpu < 0 || (size_t) cpu >= cpu_cnt || !cpus[cpu].bsp)
+    return false;
+
+  ioapic_route (irq, cpus[cpu].apic_id);
+  return true;
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Initializes the PICs.  Refer to [8259A] for details.
@@ -346,26 +465,33 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start, cycles;
+
+  trace (TRACE_INTR, frame->vec_no, (uint32_t) frame->eip);
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external (frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_tasklets)
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
+  intr_cnt[frame->vec_no]++;
+  start = timer_cycles ();
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_SPURIOUS_VEC)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -373,6 +499,10 @@ intr_handler (struct intr_frame *frame)
     }
   else
     unexpected_interrupt (frame);
+  cycles = timer_cycles () - start;
+  intr_cycles[frame->vec_no] += cycles;
+  if (cycles > intr_max_cycles[frame->vec_no])
+    intr_max_cycles[frame->vec_no] = cycles;
 
   /* Complete the processing of an external interrupt. */
   if (external) 
@@ -381,11 +511,30 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_context ());
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      if (frame->vec_no >= LAPIC_VEC_MIN || ioapic_present ())
+        lapic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no); 
+
+      /* An interrupt that arrived during tasklets leaves the rest
+         of the work to the outer one. */
+      if (!in_tasklets)
+        {
+          run_tasklets ();
+          if (yield_on_return) 
+            thread_yield (); 
+        }
+    }
 
-      if (yield_on_return) 
-        thread_yield (); 
+#ifdef USERPROG
+  /* A thread whose process is exiting leaves instead of going
+     back to user mode. */
+  if (frame->cs == SEL_UCSEG && process_killed ())
+    {
+      intr_enable ();
+      thread_exit ();
     }
+#endif
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +585,33 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+/* Stores the interrupt counts into STAT. */
+void
+intr_get_stats (struct sysstat *stat)
+{
+  enum intr_level old_level;
+  int vec;
+
+  old_level = intr_disable ();
+  stat->intr_cnt = 0;
+  for (vec = 0; vec < INTR_CNT; vec++)
+    stat->intr_cnt += intr_cnt[vec];
+  for (vec = 0; vec < SYSSTAT_IRQ_CNT; vec++)
+    stat->irq_cnt[vec] = intr_cnt[0x20 + vec];
+  intr_set_level (old_level);
+}
+
+/* Prints the count and handler time of each interrupt vector
+   that has fired. */
+void
+intr_print_stats (void)
+{
+  int vec;
+
+  for (vec = 0; vec < INTR_CNT; vec++)
+    if (intr_cnt[vec] != 0)
+      printf ("Interrupt %#04x (%s): %llu times, %"PRIu64" cycles, "
+              "max %"PRIu64"\n", vec, intr_names[vec], intr_cnt[vec],
+              intr_cycles[vec], intr_max_cycles[vec]);
+}
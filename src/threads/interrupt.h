@@ -57,14 +57,40 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Deferred interrupt work.  An external interrupt handler that
+   has more to do than acknowledge its device schedules a tasklet
+   and returns.  Pending tasklets run after the outermost external
+   interrupt has been acknowledged on the PIC, with interrupts
+   enabled, so other devices are not held off while they run.
+   Tasklets still run in interrupt context: they may not sleep,
+   but they may call intr_yield_on_return().  A tasklet scheduled
+   again while it is pending runs only once. */
+typedef void intr_tasklet_func (void *aux);
+
+struct intr_tasklet
+  {
+    struct intr_tasklet *next;  /* Next pending tasklet. */
+    intr_tasklet_func *func;    /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* On the pending list? */
+  };
+
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+bool intr_set_irq_cpu (int irq, int cpu);
+
+void intr_tasklet_init (struct intr_tasklet *, intr_tasklet_func *,
+                        void *aux);
+void intr_tasklet_schedule (struct intr_tasklet *);
 
 void intr_dump_frame (const struct intr_frame *);
+struct sysstat;
+void intr_get_stats (struct sysstat *);
+void intr_print_stats (void);
 const char *intr_name (uint8_t vec);
 
 #endif /* threads/interrupt.h */
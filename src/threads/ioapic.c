@@ -0,0 +1,170 @@
+#include "threads/ioapic.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/mp.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* I/O APIC driver.
+
+   On a multiprocessor, device interrupts go through the I/O
+   APIC instead of the 8259A PICs.  Each of its input pins has a
+   redirection table entry that gives the vector to raise and the
+   local APIC to send it to, so that each IRQ can be steered to
+   a CPU of its own choosing.  We keep the PICs' vectors, 0x20
+   plus the ISA IRQ number, so that device drivers cannot tell
+   the difference, and acknowledge them at the local APIC.
+
+   The MP configuration table says which pin each ISA IRQ is
+   wired to, and how; mp_init() passes that along through
+   ioapic_set_source().  IRQs it does not mention are assumed to
+   be on the pin of the same number, edge triggered and active
+   high, as ISA interrupts are.  Only the first I/O APIC is used.
+
+   See [82093AA] "I/O Advanced Programmable Interrupt Controller
+   (IOAPIC)" and [MP] 4.3.4 "I/O Interrupt Assignment Entries". */
+
+/* Kernel virtual address at which the registers are mapped, the
+   page below the local APIC's, in the page table that
+   lapic_init() created. */
+#define IOAPIC_VADDR ((void *) 0xffffe000)
+
+/* Registers, reached by writing a register number to IOREGSEL
+   and then reading or writing IOWIN. */
+#define IOREGSEL 0x00           /* Byte offset of register select. */
+#define IOWIN 0x10              /* Byte offset of data window. */
+#define IOAPIC_VER 0x01         /* Version; entry count in 16...23. */
+#define IOAPIC_REDTBL 0x10      /* Redirection table, two per pin. */
+
+/* Redirection table entry bits, low word.  The destination local
+   APIC ID is in bits 24...31 of the high word. */
+#define RED_ACTIVE_LOW 0x00002000 /* Polarity: active low. */
+#define RED_LEVEL 0x00008000    /* Trigger mode: level. */
+#define RED_MASKED 0x00010000   /* Interrupt masked. */
+
+/* How each ISA IRQ is wired to the I/O APIC. */
+struct source
+  {
+    bool set;                   /* Given by ioapic_set_source()? */
+    uint8_t pin;                /* Input pin. */
+    uint32_t flags;             /* RED_ACTIVE_LOW, RED_LEVEL. */
+  };
+static struct source sources[IOAPIC_IRQ_CNT];
+
+/* Mapped registers, or a null pointer if there is no I/O APIC,
+   and the number of input pins. */
+static volatile uint32_t *ioapic;
+static unsigned pin_cnt;
+
+static uint32_t ioapic_read (unsigned reg);
+static void ioapic_write (unsigned reg, uint32_t value);
+static void write_entry (uint8_t irq, uint8_t apic_id);
+
+/* Records that ISA IRQ is wired to input PIN of the I/O APIC,
+   with the given polarity and trigger mode.  Called by mp_init()
+   for each interrupt assignment in the MP configuration table. */
+void
+ioapic_set_source (uint8_t irq, uint8_t pin, bool active_low, bool level)
+{
+  ASSERT (irq < IOAPIC_IRQ_CNT);
+  sources[irq].set = true;
+  sources[irq].pin = pin;
+  sources[irq].flags = ((active_low ? RED_ACTIVE_LOW : 0)
+                        | (level ? RED_LEVEL : 0));
+}
+
+/* Maps the I/O APIC's registers, at physical address PADDR,
+   into init_page_dir, uncached, and masks all of its pins.  Must
+   be called after lapic_init() and, like it, before any process
+   page directory is created. */
+void
+ioapic_init (uintptr_t paddr)
+{
+  uint32_t *pt;
+  unsigned i;
+
+  ASSERT (init_page_dir[pd_no (IOAPIC_VADDR)] != 0);
+
+  pt = pde_get_pt (init_page_dir[pd_no (IOAPIC_VADDR)]);
+  pt[pt_no (IOAPIC_VADDR)] = ((paddr & ~PGMASK)
+                              | PTE_PCD | PTE_PWT | PTE_W | PTE_P);
+  ioapic = (volatile uint32_t *) ((uint8_t *) IOAPIC_VADDR
+                                  + (paddr & PGMASK));
+
+  pin_cnt = ((ioapic_read (IOAPIC_VER) >> 16) & 0xff) + 1;
+  for (i = 0; i < pin_cnt; i++)
+    ioapic_write (IOAPIC_REDTBL + 2 * i, RED_MASKED);
+
+  for (i = 0; i < IOAPIC_IRQ_CNT; i++)
+    if (!sources[i].set)
+      {
+        sources[i].pin = i;
+        sources[i].flags = 0;
+      }
+}
+
+/* Returns true if ioapic_init() has been called. */
+bool
+ioapic_present (void)
+{
+  return ioapic != NULL;
+}
+
+/* Unmasks each ISA IRQ, delivering it to the bootstrap
+   processor.  Called from intr_init() once the PICs are masked. */
+void
+ioapic_start (void)
+{
+  uint8_t irq;
+
+  for (irq = 0; irq < IOAPIC_IRQ_CNT; irq++)
+    write_entry (irq, cpus[0].apic_id);
+}
+
+/* Delivers ISA IRQ to the CPU whose local APIC ID is APIC_ID
+   from now on.  An interrupt already on its way may still go to
+   the old one. */
+void
+ioapic_route (uint8_t irq, uint8_t apic_id)
+{
+  ASSERT (ioapic != NULL);
+  ASSERT (irq < IOAPIC_IRQ_CNT);
+  write_entry (irq, apic_id);
+}
+
+/* Returns I/O APIC register REG. */
+static uint32_t
+ioapic_read (unsigned reg)
+{
+  ioapic[IOREGSEL / sizeof *ioapic] = reg;
+  return ioapic[IOWIN / sizeof *ioapic];
+}
+
+/* Stores VALUE into I/O APIC register REG. */
+static void
+ioapic_write (unsigned reg, uint32_t value)
+{
+  ioapic[IOREGSEL / sizeof *ioapic] = reg;
+  ioapic[IOWIN / sizeof *ioapic] = value;
+}
+
+/* Points the redirection table entry for ISA IRQ, unmasked, at
+   the local APIC with ID APIC_ID.  The entry is masked while its
+   destination changes, so that it never raises an interrupt half
+   written. */
+static void
+write_entry (uint8_t irq, uint8_t apic_id)
+{
+  const struct source *s = &sources[irq];
+  unsigned reg = IOAPIC_REDTBL + 2 * s->pin;
+
+  if (s->pin >= pin_cnt)
+    {
+      printf ("ioapic: IRQ %u on missing pin %u\n", irq, s->pin);
+      return;
+    }
+  ioapic_write (reg, RED_MASKED);
+  ioapic_write (reg + 1, (uint32_t) apic_id << 24);
+  ioapic_write (reg, (0x20 + irq) | s->flags);
+}
@@ -0,0 +1,18 @@
+#ifndef THREADS_IOAPIC_H
+#define THREADS_IOAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ISA interrupt request lines, which reach the CPU as vectors
+   0x20...0x2f whether through the PICs or the I/O APIC. */
+#define IOAPIC_IRQ_CNT 16
+
+void ioapic_set_source (uint8_t irq, uint8_t pin, bool active_low,
+                        bool level);
+void ioapic_init (uintptr_t paddr);
+bool ioapic_present (void);
+void ioapic_start (void);
+void ioapic_route (uint8_t irq, uint8_t apic_id);
+
+#endif /* threads/ioapic.h */
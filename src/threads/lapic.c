@@ -0,0 +1,191 @@
+#include "threads/lapic.h"
+#include <debug.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC driver.
+
+   Each CPU has a local APIC, whose registers appear at the same
+   physical address on every CPU but address that CPU's own
+   APIC.  We use it to identify the running CPU, to send the
+   interprocessor interrupts that start the other CPUs, and for
+   its timer, which gives each CPU its own tick (see
+   devices/timer.c).  Device interrupts come from the I/O APIC
+   (see ioapic.c) and are acknowledged here too.
+
+   See [IA32-v3a] chapter 10 "Advanced Programmable Interrupt
+   Controller (APIC)". */
+
+/* Kernel virtual address at which the registers are mapped: the
+   last page of the address space, far above the mapping of RAM
+   at PHYS_BASE. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID 0x020          /* Local APIC ID, in bits 24...31. */
+#define LAPIC_EOI 0x0b0         /* End of interrupt. */
+#define LAPIC_SVR 0x0f0         /* Spurious interrupt vector. */
+#define LAPIC_ESR 0x280         /* Error status. */
+#define LAPIC_ICR_LO 0x300      /* Interrupt command, low word. */
+#define LAPIC_ICR_HI 0x310      /* Interrupt command, high word. */
+#define LAPIC_LVT_TIMER 0x320   /* Local vector table: timer. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration. */
+
+/* Spurious interrupt vector register bits. */
+#define SVR_ENABLE 0x100        /* APIC software enable. */
+
+/* Local vector table bits. */
+#define LVT_MASKED 0x00010000   /* Interrupt masked. */
+#define LVT_PERIODIC 0x00020000 /* Timer mode: periodic, not one-shot. */
+
+/* Timer divide configuration: count once per 16 bus clocks. */
+#define TIMER_DIV_16 0x3
+
+/* Interrupt command register bits. */
+#define ICR_INIT 0x00000500     /* Delivery mode: INIT. */
+#define ICR_STARTUP 0x00000600  /* Delivery mode: start-up. */
+#define ICR_PENDING 0x00001000  /* Delivery status: send pending. */
+#define ICR_ASSERT 0x00004000   /* Level: assert. */
+
+/* Mapped registers, or a null pointer if there is no local
+   APIC. */
+static volatile uint32_t *lapic;
+
+/* Returns the register at byte offset REG. */
+static inline uint32_t
+lapic_read (size_t reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Stores VALUE into the register at byte offset REG. */
+static inline void
+lapic_write (size_t reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+}
+
+/* Maps the local APIC's registers, at physical address PADDR,
+   into init_page_dir, uncached, and enables the running CPU's
+   local APIC.  Must be called after paging_init() and before
+   any process page directory is created, since those copy
+   init_page_dir's kernel mappings. */
+void
+lapic_init (uintptr_t paddr)
+{
+  uint32_t *pt;
+
+  ASSERT (paddr % PGSIZE == 0);
+  ASSERT (init_page_dir[pd_no (LAPIC_VADDR)] == 0);
+
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  init_page_dir[pd_no (LAPIC_VADDR)] = pde_create (pt);
+  pt[pt_no (LAPIC_VADDR)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  lapic = LAPIC_VADDR;
+
+  lapic_enable ();
+}
+
+/* Returns true if lapic_init() has been called. */
+bool
+lapic_present (void)
+{
+  return lapic != NULL;
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  ASSERT (lapic != NULL);
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Enables the running CPU's local APIC, which comes out of reset
+   software-disabled.  With no local vector table entries
+   unmasked it raises no interrupts of its own. */
+void
+lapic_enable (void)
+{
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+}
+
+/* Acknowledges the interrupt being handled, if it came through
+   the local APIC. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interprocessor interrupt ICR to the CPU whose local APIC
+   ID is APIC_ID, and waits for it to be accepted. */
+static void
+send_ipi (uint8_t apic_id, uint32_t icr)
+{
+  lapic_write (LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICR_LO, icr);
+  while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+    asm volatile ("pause");
+}
+
+/* Sends interrupt VEC, which must be one of the LAPIC_*_VEC
+   vectors, to the CPU whose local APIC ID is APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  ASSERT (vec >= LAPIC_VEC_MIN);
+  send_ipi (apic_id, ICR_ASSERT | vec);
+}
+
+/* Sends an INIT interprocessor interrupt to the CPU with local
+   APIC ID APIC_ID, which resets it into waiting for a start-up
+   IPI. */
+void
+lapic_send_init (uint8_t apic_id)
+{
+  send_ipi (apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+/* Sends a start-up interprocessor interrupt to the CPU with
+   local APIC ID APIC_ID, which starts it in real mode at
+   physical address PADDR, a page-aligned address below 1 MB. */
+void
+lapic_send_startup (uint8_t apic_id, uintptr_t paddr)
+{
+  ASSERT (paddr % PGSIZE == 0 && paddr < 0x100000);
+  send_ipi (apic_id, ICR_STARTUP | ICR_ASSERT | (paddr / PGSIZE));
+}
+
+/* Starts the running CPU's local APIC timer counting down from
+   COUNT, in units of 16 bus clocks, raising LAPIC_TIMER_VEC when
+   it reaches 0, and then starting over if PERIODIC is true. */
+void
+lapic_timer_start (uint32_t count, bool periodic)
+{
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER,
+               LAPIC_TIMER_VEC | (periodic ? LVT_PERIODIC : 0));
+  lapic_write (LAPIC_TIMER_INIT, count);
+}
+
+/* Returns the running CPU's local APIC timer's current count. */
+uint32_t
+lapic_timer_count (void)
+{
+  return lapic_read (LAPIC_TIMER_CUR);
+}
+
+/* Stops the running CPU's local APIC timer. */
+void
+lapic_timer_stop (void)
+{
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED);
+  lapic_write (LAPIC_TIMER_INIT, 0);
+}
@@ -0,0 +1,34 @@
+#ifndef THREADS_LAPIC_H
+#define THREADS_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Physical address of the local APIC's registers, unless the MP
+   configuration table says otherwise. */
+#define LAPIC_DEFAULT_BASE 0xfee00000
+
+/* Interrupt vectors raised by the local APIC.  Vectors
+   LAPIC_VEC_MIN and up are external interrupts, like the PICs'
+   0x20...0x2f, except for the spurious interrupt vector, which
+   must not be acknowledged. */
+#define LAPIC_VEC_MIN 0xf0
+#define LAPIC_TIMER_VEC 0xf0    /* Local APIC timer. */
+#define LAPIC_TLB_VEC 0xf1      /* TLB shootdown IPI. */
+#define LAPIC_RESCHED_VEC 0xf2  /* Reschedule IPI. */
+#define LAPIC_SPURIOUS_VEC 0xff /* Spurious interrupt. */
+
+void lapic_init (uintptr_t paddr);
+bool lapic_present (void);
+uint8_t lapic_id (void);
+void lapic_enable (void);
+void lapic_eoi (void);
+void lapic_send_init (uint8_t apic_id);
+void lapic_send_startup (uint8_t apic_id, uintptr_t paddr);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+
+void lapic_timer_start (uint32_t count, bool periodic);
+uint32_t lapic_timer_count (void);
+void lapic_timer_stop (void);
+
+#endif /* threads/lapic.h */
@@ -35,6 +35,11 @@
 
 /* Amount of physical memory, in 4 kB pages. */
 extern uint32_t init_ram_pages;
+
+/* Time-stamp counter at entry to the loader, low 32 bits only,
+   and at entry to start.S. */
+extern uint32_t loader_tsc;
+extern uint64_t start_tsc;
 #endif
 
 #endif /* threads/loader.h */
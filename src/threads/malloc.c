@@ -1,12 +1,14 @@
 #include "threads/malloc.h"
 #include <debug.h>
 #include <list.h>
+#include <memstat.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +34,31 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the free lists, each thread keeps a small
+   "magazine" of free blocks for each of the smaller
+   descriptors.  malloc() takes a block from the running
+   thread's magazine and free() puts one back without touching
+   the descriptor's lock.  Only when a magazine runs empty or
+   full does it exchange MAGAZINE_BATCH blocks with the free list
+   in one locked operation.  Blocks in a magazine still count as
+   in use in their arena, so an arena is not returned to the
+   page allocator while any thread caches one of its blocks.
+
+   Big blocks of up to BIG_CACHE_PAGES pages are not returned to
+   the page allocator right away when they are freed.  Up to
+   BIG_CACHE_TOTAL pages' worth are kept on per-size lists, so
+   that a repeated large allocation, such as a file-sized buffer,
+   can reuse a run of the same size.  The cache is emptied if the
+   page allocator runs out. */
+
+/* Blocks moved between a magazine and a free list at a time. */
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
+/* Cache of freed big blocks. */
+#define BIG_CACHE_PAGES 8       /* Largest block cached, in pages. */
+#define BIG_CACHE_TOTAL 32      /* Most pages cached at once. */
 
 /* Descriptor. */
 struct desc
@@ -41,6 +67,11 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics, protected by LOCK. */
+    size_t arena_cnt;           /* Arenas allocated. */
+    size_t free_block_cnt;      /* Blocks on FREE_LIST. */
+    size_t fail_cnt;            /* Failed allocations. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -64,8 +95,19 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Freed big blocks, by size in pages. */
+static struct list big_cache[BIG_CACHE_PAGES + 1];
+static size_t big_cache_pages;  /* Pages in BIG_CACHE. */
+static struct lock big_lock;    /* Protects BIG_CACHE. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct magazine *get_magazine (struct desc *);
+static struct block *take_block (struct desc *);
+static void put_block (struct desc *, struct block *);
+static struct arena *big_cache_get (size_t page_cnt);
+static bool big_cache_put (struct arena *);
+static bool big_cache_flush (void);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,8 +122,14 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      lock_init_named (&d->lock, "malloc");
+      d->arena_cnt = d->free_block_cnt = d->fail_cnt = 0;
     }
+
+  for (block_size = 0; block_size <= BIG_CACHE_PAGES; block_size++)
+    list_init (&big_cache[block_size]);
+  big_cache_pages = 0;
+  lock_init_named (&big_lock, "malloc-big");
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -90,6 +138,7 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
+  struct magazine *m;
   struct block *b;
   struct arena *a;
 
@@ -107,7 +156,11 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = big_cache_get (page_cnt);
+      if (a == NULL)
+        a = palloc_get_multiple (0, page_cnt);
+      if (a == NULL && big_cache_flush ())
+        a = palloc_get_multiple (0, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -119,6 +172,11 @@ malloc (size_t size)
       return a + 1;
     }
 
+  /* Try the running thread's magazine first. */
+  m = get_magazine (d);
+  if (m != NULL && m->cnt > 0)
+    return m->blocks[--m->cnt];
+
   lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
@@ -130,6 +188,7 @@ malloc (size_t size)
       a = palloc_get_page (0);
       if (a == NULL) 
         {
+          d->fail_cnt++;
           lock_release (&d->lock);
           return NULL; 
         }
@@ -143,12 +202,16 @@ malloc (size_t size)
           struct block *b = arena_to_block (a, i);
           list_push_back (&d->free_list, &b->free_elem);
         }
+      d->arena_cnt++;
+      d->free_block_cnt += d->blocks_per_arena;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  /* Get a block from free list and return it, refilling the
+     magazine from the free list while we hold the lock. */
+  b = take_block (d);
+  if (m != NULL)
+    while (m->cnt < MAGAZINE_BATCH && !list_empty (&d->free_list))
+      m->blocks[m->cnt++] = take_block (d);
   lock_release (&d->lock);
   return b;
 }
@@ -223,6 +286,7 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+      struct magazine *m;
       
       if (d != NULL) 
         {
@@ -232,37 +296,218 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Cache it in the running thread's magazine if there
+             is room. */
+          m = get_magazine (d);
+          if (m != NULL && m->cnt < MAGAZINE_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->blocks[m->cnt++] = b;
+              return;
             }
 
+          /* Return it to the free list, along with half of the
+             magazine if the magazine is full. */
+          lock_acquire (&d->lock);
+          put_block (d, b);
+          if (m != NULL)
+            while (m->cnt > MAGAZINE_SIZE - MAGAZINE_BATCH)
+              put_block (d, m->blocks[--m->cnt]);
           lock_release (&d->lock);
         }
       else
         {
-          /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          /* It's a big block.  Cache it for reuse, or free its
+             pages. */
+          if (!big_cache_put (a))
+            palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Returns every block in the running thread's magazines to its
+   free list.  Called when a thread exits. */
+void
+malloc_thread_exit (void)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      struct magazine *m = get_magazine (d);
+
+      if (m == NULL || m->cnt == 0)
+        continue;
+      lock_acquire (&d->lock);
+      while (m->cnt > 0)
+        put_block (d, m->blocks[--m->cnt]);
+      lock_release (&d->lock);
+    }
+}
+
+/* Removes a cached big block of PAGE_CNT pages from the cache and
+   returns it, or returns a null pointer if there is none. */
+static struct arena *
+big_cache_get (size_t page_cnt)
+{
+  struct arena *a = NULL;
+
+  if (page_cnt > BIG_CACHE_PAGES)
+    return NULL;
+
+  lock_acquire (&big_lock);
+  if (!list_empty (&big_cache[page_cnt]))
+    {
+      struct list_elem *e = list_pop_front (&big_cache[page_cnt]);
+      a = block_to_arena (list_entry (e, struct block, free_elem));
+      big_cache_pages -= page_cnt;
+    }
+  lock_release (&big_lock);
+  return a;
+}
+
+/* Adds big block arena A to the cache, if it is small enough and
+   there is room.  Returns true if successful, false if A must be
+   freed instead. */
+static bool
+big_cache_put (struct arena *a)
+{
+  size_t page_cnt = a->free_cnt;
+  bool cached = false;
+
+  if (page_cnt > BIG_CACHE_PAGES)
+    return false;
+
+#ifndef NDEBUG
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (a + 1, 0xcc, PGSIZE * page_cnt - sizeof *a);
+#endif
+
+  lock_acquire (&big_lock);
+  if (big_cache_pages + page_cnt <= BIG_CACHE_TOTAL)
+    {
+      struct block *b = (struct block *) (a + 1);
+      list_push_front (&big_cache[page_cnt], &b->free_elem);
+      big_cache_pages += page_cnt;
+      cached = true;
+    }
+  lock_release (&big_lock);
+  return cached;
+}
+
+/* Returns every cached big block to the page allocator.  Returns
+   true if any pages were freed. */
+static bool
+big_cache_flush (void)
+{
+  bool freed = false;
+  size_t page_cnt;
+
+  lock_acquire (&big_lock);
+  for (page_cnt = 1; page_cnt <= BIG_CACHE_PAGES; page_cnt++)
+    while (!list_empty (&big_cache[page_cnt]))
+      {
+        struct list_elem *e = list_pop_front (&big_cache[page_cnt]);
+        palloc_free_multiple (block_to_arena (list_entry (e, struct block,
+                                                          free_elem)),
+                              page_cnt);
+        freed = true;
+      }
+  big_cache_pages = 0;
+  lock_release (&big_lock);
+  return freed;
+}
+
+/* Stores malloc()'s statistics into STAT. */
+void
+malloc_get_stats (struct memstat *stat)
+{
+  size_t i;
+
+  stat->desc_cnt = desc_cnt < MEMSTAT_DESC_MAX ? desc_cnt : MEMSTAT_DESC_MAX;
+  for (i = 0; i < stat->desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct memstat_desc *sd = &stat->descs[i];
+
+      lock_acquire (&d->lock);
+      sd->block_size = d->block_size;
+      sd->arena_cnt = d->arena_cnt;
+      sd->free_cnt = d->free_block_cnt;
+      sd->fail_cnt = d->fail_cnt;
+      lock_release (&d->lock);
+    }
+}
+
+/* Prints malloc() statistics for each block size in use. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->arena_cnt > 0 || d->fail_cnt > 0)
+      printf ("Malloc: %zu-byte blocks: %zu arenas, %zu free blocks, "
+              "%zu failed allocations\n", d->block_size, d->arena_cnt,
+              d->free_block_cnt, d->fail_cnt);
+  if (big_cache_pages > 0)
+    printf ("Malloc: %zu pages of big blocks cached\n", big_cache_pages);
+}
+
+/* Returns the running thread's magazine for descriptor D, or a
+   null pointer if D's blocks are not cached in magazines. */
+static struct magazine *
+get_magazine (struct desc *d)
+{
+  size_t idx = d - descs;
+
+  return idx < MAGAZINE_DESC_CNT ? &thread_current ()->magazines[idx] : NULL;
+}
+
+/* Removes a block from D's free list, which must not be empty,
+   and returns it.  D's lock must be held. */
+static struct block *
+take_block (struct desc *d)
+{
+  struct block *b;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  block_to_arena (b)->free_cnt--;
+  d->free_block_cnt--;
+  return b;
+}
+
+/* Adds block B to D's free list, returning its arena to the page
+   allocator if that leaves the arena entirely unused.  D's lock
+   must be held. */
+static void
+put_block (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  list_push_front (&d->free_list, &b->free_elem);
+  d->free_block_cnt++;
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+      d->arena_cnt--;
+      d->free_block_cnt -= d->blocks_per_arena;
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
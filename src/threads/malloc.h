@@ -4,10 +4,26 @@
 #include <debug.h>
 #include <stddef.h>
 
+struct memstat;
+
+/* Per-thread cache of free blocks for one malloc() descriptor,
+   so that most allocations and frees avoid the descriptor's
+   lock.  Owned by malloc.c; lives in struct thread. */
+#define MAGAZINE_SIZE 8                 /* Blocks per magazine. */
+#define MAGAZINE_DESC_CNT 7             /* Descriptors with magazines. */
+struct magazine
+  {
+    unsigned cnt;                       /* Number of cached blocks. */
+    void *blocks[MAGAZINE_SIZE];        /* Cached blocks. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_thread_exit (void);
+void malloc_get_stats (struct memstat *);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
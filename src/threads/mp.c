@@ -0,0 +1,488 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/io.h"
+#include "threads/ioapic.h"
+#include "threads/lapic.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/vaddr.h"
+
+/* Multiprocessor bring-up.
+
+   The BIOS starts only the bootstrap processor (BSP); the others,
+   the application processors (APs), wait in a halted state for
+   an INIT and a start-up interprocessor interrupt from the BSP.
+   mp_init() finds them in the MP configuration table that the
+   BIOS leaves in low memory, and mp_start() starts each in turn.
+   An AP begins in real mode at MP_TRAMPOLINE, where mpentry.S
+   switches it to protected mode with init_page_dir's paging and
+   calls mp_ap_main() on a stack of its own.
+
+   So far the APs only report in and then halt with interrupts
+   disabled: the scheduler and everything else still run on the
+   BSP alone.  cpus[] and struct spinlock are the pieces that
+   running threads on the APs will need.  The table also
+   describes the I/O APIC, which then takes over device
+   interrupts from the PICs (see ioapic.c).
+
+   All of this is built only with SMP defined (see Make.config).
+   Otherwise cpus[] has the BSP's entry alone and the APs are
+   left halted, so the BSP pays nothing for them.
+
+   See [MP] chapter 4 "MP Configuration Table" and appendix B.4
+   "Application Processor Startup". */
+
+/* MP floating pointer structure, on a 16-byte boundary. */
+struct mp_fptr
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t features[5];        /* Nonzero features[0]: default config. */
+  }
+PACKED;
+
+/* MP configuration table header, followed by its entries. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Bytes in header and entries. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* All LENGTH bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic;             /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  }
+PACKED;
+
+/* Processor entry in the configuration table. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;              /* PROC_* bits. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  }
+PACKED;
+
+/* Bus entry in the configuration table. */
+struct mp_bus
+  {
+    uint8_t type;               /* MP_BUS. */
+    uint8_t bus_id;             /* Bus number. */
+    char bus_type[6];           /* "ISA   ", "PCI   ", .... */
+  }
+PACKED;
+
+/* I/O APIC entry in the configuration table. */
+struct mp_ioapic
+  {
+    uint8_t type;               /* MP_IOAPIC. */
+    uint8_t apic_id;            /* I/O APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;              /* IOAPIC_ENABLED. */
+    uint32_t addr;              /* Physical address of registers. */
+  }
+PACKED;
+
+/* I/O interrupt assignment entry in the configuration table. */
+struct mp_intr
+  {
+    uint8_t type;               /* MP_INTR. */
+    uint8_t intr_type;          /* INTR_INT for a vectored interrupt. */
+    uint16_t flags;             /* INTR_* polarity and trigger bits. */
+    uint8_t src_bus;            /* Bus ID of source. */
+    uint8_t src_irq;            /* IRQ on the source bus. */
+    uint8_t dst_apic;           /* I/O APIC ID, or 0xff for all. */
+    uint8_t dst_pin;            /* Input pin on the I/O APIC. */
+  }
+PACKED;
+
+/* Configuration table entry types.  All but processor entries
+   are 8 bytes long. */
+#define MP_PROC 0
+#define MP_BUS 1
+#define MP_IOAPIC 2
+#define MP_INTR 3
+#define MP_OTHER_SIZE 8
+
+/* I/O APIC entry flags. */
+#define IOAPIC_ENABLED 0x01     /* Usable. */
+
+/* I/O interrupt assignment entry types and flags. */
+#define INTR_INT 0              /* Vectored interrupt. */
+#define INTR_POLARITY 0x3       /* Polarity mask... */
+#define INTR_ACTIVE_LOW 0x3     /* ...if active low. */
+#define INTR_TRIGGER 0xc        /* Trigger mode mask... */
+#define INTR_LEVEL 0xc          /* ...if level triggered. */
+
+/* Floating pointer feature byte 2 bit: the PICs are wired
+   straight to the BSP, through the IMCR, rather than in virtual
+   wire mode. */
+#define FPTR_IMCR 0x80
+
+/* Processor entry flags. */
+#define PROC_ENABLED 0x01       /* Usable. */
+#define PROC_BSP 0x02           /* The bootstrap processor. */
+
+/* Read by the start-up code in mpentry.S, from its copy at
+   MP_TRAMPOLINE. */
+struct mp_boot_args
+  {
+    uint32_t cr0, cr3, cr4;     /* Control registers to load. */
+    void *stack;                /* Initial stack pointer. */
+    struct cpu *cpu;            /* Argument to mp_ap_main(). */
+  };
+
+/* Defined in mpentry.S. */
+extern char mp_trampoline[], mp_trampoline_end[];
+extern struct mp_boot_args mp_boot_args;
+
+struct cpu cpus[MP_MAX_CPUS];
+size_t cpu_cnt;
+bool mp_enabled = true;
+
+/* CPUs running kernel code, counting the BSP. */
+static struct spinlock online_lock = SPINLOCK_INITIALIZER;
+static size_t online_cnt;
+
+#ifdef SMP
+void mp_ap_main (struct cpu *) NO_RETURN;
+static void read_config (void);
+static struct mp_fptr *find_fptr (void);
+static struct mp_fptr *find_fptr_in (uintptr_t paddr, size_t size);
+static uint8_t sum (const void *, size_t);
+static void add_cpu (const struct mp_proc *);
+static void add_intr (const struct mp_intr *, uint32_t isa_buses,
+                      uint8_t ioapic_id);
+#endif
+
+/* Sets up cpus[] for the BSP and then, with SMP, for each AP
+   listed in the MP configuration table, if there is one.  Must
+   be called right after paging_init(), for the reason given in
+   lapic_init(). */
+void
+mp_init (void)
+{
+  cpus[0].id = 0;
+  cpus[0].bsp = true;
+  cpus[0].started = true;
+  cpu_cnt = online_cnt = 1;
+#ifdef SMP
+  read_config ();
+#endif
+}
+
+#ifdef SMP
+/* Adds each AP listed in the MP configuration table, if there is
+   one, to cpus[], and if there are APs, maps the local APIC and
+   sets up the I/O APIC. */
+static void
+read_config (void)
+{
+  struct mp_fptr *fp;
+  struct mp_config *config;
+  uint8_t *p, *end;
+  uint32_t isa_buses = 0;
+  struct mp_ioapic *ioapic = NULL;
+  size_t i;
+
+  fp = find_fptr ();
+  if (fp == NULL)
+    return;
+  if (fp->features[0] != 0 || fp->config == 0)
+    {
+      printf ("mp: default configuration %"PRIu8" not supported\n",
+              fp->features[0]);
+      return;
+    }
+  if (fp->config + sizeof *config > init_ram_pages * PGSIZE)
+    {
+      printf ("mp: configuration table beyond RAM\n");
+      return;
+    }
+  config = ptov (fp->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || fp->config + config->length > init_ram_pages * PGSIZE
+      || sum (config, config->length) != 0)
+    {
+      printf ("mp: bad configuration table\n");
+      return;
+    }
+
+  p = (uint8_t *) (config + 1);
+  end = (uint8_t *) config + config->length;
+  for (i = 0; i < config->entry_cnt && p < end; i++)
+    if (*p == MP_PROC)
+      {
+        add_cpu ((struct mp_proc *) p);
+        p += sizeof (struct mp_proc);
+      }
+    else
+      {
+        /* The table lists buses, then I/O APICs, then interrupt
+           assignments, so each is known before it is referred
+           to. */
+        if (*p == MP_BUS)
+          {
+            struct mp_bus *bus = (struct mp_bus *) p;
+            if (!memcmp (bus->bus_type, "ISA", 3) && bus->bus_id < 32)
+              isa_buses |= 1u << bus->bus_id;
+          }
+        else if (*p == MP_IOAPIC)
+          {
+            struct mp_ioapic *io = (struct mp_ioapic *) p;
+            if (io->flags & IOAPIC_ENABLED && ioapic == NULL)
+              ioapic = io;
+          }
+        else if (*p == MP_INTR && ioapic != NULL)
+          add_intr ((struct mp_intr *) p, isa_buses, ioapic->apic_id);
+        p += MP_OTHER_SIZE;
+      }
+
+  if (cpu_cnt > 1)
+    {
+      lapic_init (config->lapic);
+      cpus[0].apic_id = lapic_id ();
+      printf ("mp: %zu CPUs\n", cpu_cnt);
+
+      if (ioapic != NULL)
+        {
+          /* Disconnect the PICs from the BSP's interrupt pin, if
+             the IMCR connects them, so that ioapic.c is the only
+             route for device interrupts.  See [MP] 3.6.2.1. */
+          if (fp->features[1] & FPTR_IMCR)
+            {
+              outb (0x22, 0x70);
+              outb (0x23, 0x01);
+            }
+          ioapic_init (ioapic->addr);
+        }
+    }
+}
+
+/* Adds the CPU described by PROC to cpus[]. */
+static void
+add_cpu (const struct mp_proc *proc)
+{
+  struct cpu *c;
+
+  if (!(proc->flags & PROC_ENABLED) || proc->flags & PROC_BSP)
+    return;
+  if (cpu_cnt >= MP_MAX_CPUS)
+    {
+      printf ("mp: CPU with APIC ID %"PRIu8" ignored\n", proc->apic_id);
+      return;
+    }
+
+  c = &cpus[cpu_cnt];
+  c->id = cpu_cnt++;
+  c->apic_id = proc->apic_id;
+  c->bsp = false;
+  c->started = false;
+}
+
+/* Records the wiring of the ISA interrupt assigned by INTR, if
+   it is one of the first IOAPIC_IRQ_CNT on a bus in ISA_BUSES
+   and goes to the I/O APIC with ID IOAPIC_ID. */
+static void
+add_intr (const struct mp_intr *intr, uint32_t isa_buses,
+          uint8_t ioapic_id)
+{
+  if (intr->intr_type != INTR_INT
+      || intr->src_bus >= 32 || !(isa_buses & (1u << intr->src_bus))
+      || intr->src_irq >= IOAPIC_IRQ_CNT
+      || (intr->dst_apic != ioapic_id && intr->dst_apic != 0xff))
+    return;
+
+  ioapic_set_source (intr->src_irq, intr->dst_pin,
+                     (intr->flags & INTR_POLARITY) == INTR_ACTIVE_LOW,
+                     (intr->flags & INTR_TRIGGER) == INTR_LEVEL);
+}
+#endif /* SMP */
+
+/* Starts each AP, unless "-nosmp" was given.  Needs timer
+   delays, so must be called after timer_calibrate(). */
+void
+mp_start (void)
+{
+#ifdef SMP
+  struct mp_boot_args *args;
+  size_t i;
+
+  if (cpu_cnt == 1 || !mp_enabled)
+    return;
+
+  /* Copy the start-up code to low memory, and map that memory at
+     its physical address as well as at PHYS_BASE, so that the
+     start-up code keeps running when it turns on paging. */
+  memcpy (ptov (MP_TRAMPOLINE), mp_trampoline,
+          mp_trampoline_end - mp_trampoline);
+  args = ptov (MP_TRAMPOLINE + ((char *) &mp_boot_args - mp_trampoline));
+  args->cr0 = cr0_get ();
+  args->cr3 = vtop (init_page_dir);
+  args->cr4 = cr4_get ();
+  init_page_dir[0] = init_page_dir[pd_no (PHYS_BASE)];
+
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      uint8_t *stack = palloc_get_page (PAL_ZERO);
+      int try;
+
+      if (stack == NULL)
+        break;
+      args->stack = stack + PGSIZE;
+      args->cpu = c;
+
+      /* The INIT-SIPI-SIPI sequence of [MP] B.4. */
+      lapic_send_init (c->apic_id);
+      timer_mdelay (10);
+      for (try = 0; try < 2 && !c->started; try++)
+        {
+          lapic_send_startup (c->apic_id, MP_TRAMPOLINE);
+          timer_udelay (200);
+        }
+      for (try = 0; try < 100 && !c->started; try++)
+        timer_mdelay (1);
+
+      /* An AP that comes up late would read the next AP's
+         arguments, so give up on the rest.  Its stack stays
+         allocated in case it does. */
+      if (!c->started)
+        {
+          printf ("mp: CPU %d (APIC ID %"PRIu8") did not start\n",
+                  c->id, c->apic_id);
+          break;
+        }
+    }
+
+  init_page_dir[0] = 0;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  printf ("mp: %zu of %zu CPUs online\n", mp_online_cnt (), cpu_cnt);
+#endif
+}
+
+#ifdef SMP
+/* Entry point in C of the AP described by C, called by mpentry.S
+   on the AP's own stack. */
+void
+mp_ap_main (struct cpu *c)
+{
+  enum intr_level old_level;
+
+  lapic_enable ();
+
+  old_level = spinlock_acquire (&online_lock);
+  online_cnt++;
+  spinlock_release (&online_lock, old_level);
+  c->started = true;
+
+  /* Park the CPU.  With interrupts disabled, only an NMI or an
+     INIT can wake it. */
+  for (;;)
+    asm volatile ("cli; hlt");
+}
+#endif
+
+
+/* Returns the number of CPUs running kernel code. */
+size_t
+mp_online_cnt (void)
+{
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = spinlock_acquire (&online_lock);
+  cnt = online_cnt;
+  spinlock_release (&online_lock, old_level);
+  return cnt;
+}
+
+#ifdef SMP
+/* Returns the running CPU's entry in cpus[]. */
+struct cpu *
+cpu_current (void)
+{
+  uint8_t apic_id;
+  size_t i;
+
+  if (!lapic_present ())
+    return &cpus[0];
+
+  apic_id = lapic_id ();
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].apic_id == apic_id)
+      return &cpus[i];
+  PANIC ("no CPU with APIC ID %"PRIu8, apic_id);
+}
+
+/* Looks for the MP floating pointer structure where [MP] 4.1
+   says it may be: in the first kB of the extended BIOS data
+   area, else in the last kB of base memory, else in the BIOS
+   ROM.  Returns it, or a null pointer if there is none. */
+static struct mp_fptr *
+find_fptr (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fptr *fp;
+
+  if (ebda_seg != 0)
+    fp = find_fptr_in ((uintptr_t) ebda_seg << 4, 1024);
+  else
+    fp = find_fptr_in ((base_kb - 1) * 1024, 1024);
+  if (fp == NULL)
+    fp = find_fptr_in (0xf0000, 0x10000);
+  return fp;
+}
+
+/* Looks for the MP floating pointer structure in the SIZE bytes
+   starting at physical address PADDR. */
+static struct mp_fptr *
+find_fptr_in (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fptr) <= end; p += 16)
+    {
+      struct mp_fptr *fp = (struct mp_fptr *) p;
+      if (!memcmp (fp->signature, "_MP_", 4)
+          && sum (fp, sizeof *fp) == 0)
+        return fp;
+    }
+  return NULL;
+}
+
+/* Returns the sum of the SIZE bytes at P, modulo 256. */
+static uint8_t
+sum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t s = 0;
+
+  while (size-- > 0)
+    s += *p++;
+  return s;
+}
+#endif /* SMP */
@@ -0,0 +1,61 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+/* Physical address to which the application processors'
+   start-up code is copied.  Must be page-aligned, below 1 MB,
+   and not otherwise used once the kernel is running. */
+#define MP_TRAMPOLINE 0x6000
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most CPUs supported. */
+#ifdef SMP
+#define MP_MAX_CPUS 8
+#else
+#define MP_MAX_CPUS 1
+#endif
+
+/* Per-CPU data.
+
+   The running thread needs no slot here: each CPU runs on its
+   own stack, so running_thread() already finds the right one. */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool bsp;                   /* The bootstrap processor? */
+    volatile bool started;      /* Running kernel code? */
+    struct thread *idle_thread; /* Thread run when nothing else is. */
+    int64_t ticks;              /* Tick of the last thread_tick(). */
+    uint32_t *pagedir;          /* Page directory in CR3, or null. */
+    volatile bool tlb_pending;  /* TLB shootdown to handle? */
+    volatile bool need_resched; /* Work queued here since it idled? */
+    volatile bool idle;         /* Halted in the idle loop? */
+    volatile unsigned rcu_qs_cnt; /* Quiescent states, for RCU. */
+  };
+
+extern struct cpu cpus[MP_MAX_CPUS];
+extern size_t cpu_cnt;
+
+/* When false, with "-nosmp", only the bootstrap processor runs. */
+extern bool mp_enabled;
+
+void mp_init (void);
+void mp_start (void);
+size_t mp_online_cnt (void);
+#ifdef SMP
+struct cpu *cpu_current (void);
+#else
+/* Returns the running CPU's entry in cpus[], the only one. */
+static inline struct cpu *
+cpu_current (void)
+{
+  return &cpus[0];
+}
+#endif
+#endif
+
+#endif /* threads/mp.h */
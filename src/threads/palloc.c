@@ -2,13 +2,19 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
+#include <memstat.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/mp.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +29,108 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are managed by a binary buddy allocator.
+   Free pages form blocks of 2**ORDER pages, each aligned to its
+   own size relative to the pool's base, kept on one free list
+   per order.  An allocation of N pages takes the first block of
+   the smallest order that holds N pages, splitting a larger
+   block if necessary, and gives back the pages it does not
+   need.  Freed pages are merged with their free buddy, the other
+   half of the block of the next order up, for as long as there
+   is one.  Both operations take time proportional to the number
+   of orders, however full the pool is.
+
+   A free block's list element is stored in its first page.  The
+   pool also keeps, for each page, the order of the free block
+   that begins there, if any, so that buddies can be found, and a
+   bitmap of pages in use for checking frees.
+
+   palloc_free_page() is called with interrupts disabled, from
+   thread_schedule_tail(), so pools are protected by a spinlock,
+   which disables interrupts as well, rather than by a lock.
+
+   In front of each pool, each CPU keeps a cache of free single
+   pages, used with interrupts off but without the pool's lock.
+   Single-page allocations and frees go to the running CPU's
+   cache, and only when it runs empty or overflows does the CPU
+   take the lock, to move CACHE_BATCH pages between the cache and
+   the pool at once.  Like the pre-zeroed pages, cached pages are
+   marked used inside the pool, but they are counted in its
+   statistics only once handed out, which without the lock takes
+   lock-prefixed updates.  An allocation that cannot be met gives
+   the running CPU's cached pages back before it fails.
+
+   Each pool also keeps a small cache of free pages that a
+   low-priority background thread has already zeroed, so that
+   single-page PAL_ZERO requests, such as page tables, thread
+   stacks and zero-filled user pages, do not have to clear a page
+   in the caller's context.  The cached pages are marked used; if
+   the pool runs out, they are given back before an allocation
+   fails. */
+
+/* Largest block order. */
+#define MAX_ORDER 20
+
+/* In a pool's ORDERS, marks the first page of a free block. */
+#define FREE_HEAD 0x80
+
+/* Maximum number of pre-zeroed pages per pool. */
+#define ZERO_CACHE_SIZE 32
+
+/* Most pages in a CPU's cache, and the number moved between it
+   and the pool at once. */
+#define CACHE_SIZE 32
+#define CACHE_BATCH 16
+
+/* A CPU's cache of free pages from one pool. */
+struct page_cache
+  {
+    void *pages[CACHE_SIZE];            /* Free pages. */
+    size_t cnt;                         /* Number of pages in PAGES. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct spinlock lock;               /* Protects all but CACHES. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    uint8_t *orders;                    /* FREE_HEAD | order, or 0. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages. */
+    void *zeroed[ZERO_CACHE_SIZE];      /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    struct page_cache caches[MP_MAX_CPUS]; /* Per-CPU free pages. */
+
+    /* Statistics.  USED_CNT and PEAK_CNT are updated atomically,
+       not under LOCK (see count_alloc()). */
+    size_t used_cnt;                    /* Pages handed out. */
+    size_t peak_cnt;                    /* Maximum USED_CNT. */
+    size_t fail_cnt;                    /* Failed allocations. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Upped when a pre-zeroed page is taken, to wake the zeroer. */
+static struct semaphore zero_sema;
+
+static thread_func zeroer NO_RETURN;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static size_t alloc_aligned (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void drain_zeroed (struct pool *);
+static void *cache_get (struct pool *);
+static void cache_put (struct pool *, void *page);
+static void cache_drain (struct pool *, struct page_cache *, size_t cnt);
+static void count_alloc (struct pool *, size_t page_cnt);
+static void count_free (struct pool *, size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,6 +151,15 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  sema_init (&zero_sema, 0);
+}
+
+/* Starts the thread that keeps the pools' caches of zeroed pages
+   full. */
+void
+palloc_start_zeroer (void)
+{
+  thread_create ("palloc-zero", PRI_MIN, zeroer, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -71,15 +172,51 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && !((flags & PAL_ZERO) && pool->zeroed_cnt > 0))
+    {
+      pages = cache_get (pool);
+      if (pages != NULL)
+        {
+          if (flags & PAL_ZERO)
+            memset (pages, 0, PGSIZE);
+          return pages;
+        }
+    }
+
+  old_level = spinlock_acquire (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zeroed_cnt > 0)
+    {
+      pages = pool->zeroed[--pool->zeroed_cnt];
+      count_alloc (pool, 1);
+      spinlock_release (&pool->lock, old_level);
+      sema_up (&zero_sema);
+      return pages;
+    }
+  page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR)
+    {
+      /* Give back the cached and pre-zeroed pages and try
+         again. */
+      cache_drain (pool, &pool->caches[cpu_current ()->id], SIZE_MAX);
+      drain_zeroed (pool);
+      page_idx = alloc_pages (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      count_alloc (pool, page_cnt);
+    }
+  else
+    pool->fail_cnt++;
+  spinlock_release (&pool->lock, old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -100,6 +237,49 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Like palloc_get_multiple(), but the pages' physical address is
+   a multiple of PAGE_CNT pages, which must be a power of 2, as a
+   4 MB page requires.  Never draws on a CPU's cache of single
+   pages except to give it back on failure. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  void *pages = NULL;
+  size_t page_idx;
+
+  ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+  old_level = spinlock_acquire (&pool->lock);
+  page_idx = alloc_aligned (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR)
+    {
+      cache_drain (pool, &pool->caches[cpu_current ()->id], SIZE_MAX);
+      drain_zeroed (pool);
+      page_idx = alloc_aligned (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      count_alloc (pool, page_cnt);
+      pages = pool->base + PGSIZE * page_idx;
+    }
+  else
+    pool->fail_cnt++;
+  spinlock_release (&pool->lock, old_level);
+
+  if (pages != NULL)
+    {
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PGSIZE * page_cnt);
+    }
+  else if (flags & PAL_ASSERT)
+    PANIC ("palloc_get_aligned: out of pages");
+  return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -118,6 +298,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +318,18 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  if (page_cnt == 1)
+    {
+      cache_put (pool, pages);
+      return;
+    }
+
+  old_level = spinlock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_pages (pool, page_idx, page_cnt);
+  count_free (pool, page_cnt);
+  spinlock_release (&pool->lock, old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +339,84 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return user_pool.page_cnt;
+}
+
+/* Copies the counters of POOL into *STAT. */
+static void
+get_pool_stats (struct pool *pool, struct memstat_pool *stat)
+{
+  enum intr_level old_level = spinlock_acquire (&pool->lock);
+  stat->page_cnt = pool->page_cnt;
+  stat->used_cnt = pool->used_cnt;
+  stat->peak_cnt = pool->peak_cnt;
+  stat->zeroed_cnt = pool->zeroed_cnt;
+  stat->fail_cnt = pool->fail_cnt;
+  spinlock_release (&pool->lock, old_level);
+}
+
+/* Stores the page allocator's statistics into STAT. */
+void
+palloc_get_stats (struct memstat *stat)
+{
+  get_pool_stats (&kernel_pool, &stat->kernel_pool);
+  get_pool_stats (&user_pool, &stat->user_pool);
+}
+
+/* Prints statistics for POOL, named NAME. */
+static void
+print_pool_stats (struct pool *pool, const char *name)
+{
+  printf ("%s: %zu of %zu pages used, %zu peak, %zu pre-zeroed, "
+          "%zu failed allocations\n", name,
+          pool->used_cnt, pool->page_cnt, pool->peak_cnt,
+          pool->zeroed_cnt, pool->fail_cnt);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool, "Kernel pool");
+  print_pool_stats (&user_pool, "User pool");
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and orders at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt) + page_cnt,
+                                  PGSIZE);
+  size_t bm_size;
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
+  spinlock_init (&p->lock);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  bm_size = bitmap_buf_size (page_cnt);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->orders = (uint8_t *) base + bm_size;
+  memset (p->orders, 0, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+
+  /* Every page starts out free. */
+  free_pages (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +426,281 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Takes a page from the running CPU's cache for POOL, refilling
+   the cache from POOL first if it is empty.  Returns the page, or
+   a null pointer if POOL has no free page. */
+static void *
+cache_get (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  struct page_cache *c = &pool->caches[cpu_current ()->id];
+  void *page = NULL;
+
+  if (c->cnt == 0)
+    {
+      spinlock_acquire (&pool->lock);
+      while (c->cnt < CACHE_BATCH)
+        {
+          size_t page_idx = alloc_pages (pool, 1);
+          if (page_idx == BITMAP_ERROR)
+            break;
+          bitmap_mark (pool->used_map, page_idx);
+          c->pages[c->cnt++] = pool->base + page_idx * PGSIZE;
+        }
+      spinlock_release (&pool->lock, INTR_OFF);
+    }
+  if (c->cnt > 0)
+    {
+      page = c->pages[--c->cnt];
+      count_alloc (pool, 1);
+    }
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Puts PAGE, a page of POOL being freed, into the running CPU's
+   cache, first moving CACHE_BATCH pages from the cache back to
+   POOL if it is full. */
+static void
+cache_put (struct pool *pool, void *page)
+{
+  enum intr_level old_level = intr_disable ();
+  struct page_cache *c = &pool->caches[cpu_current ()->id];
+#ifndef NDEBUG
+  size_t i;
+
+  ASSERT (bitmap_test (pool->used_map, pg_no (page) - pg_no (pool->base)));
+  for (i = 0; i < c->cnt; i++)
+    ASSERT (c->pages[i] != page);
+#endif
+
+  if (c->cnt >= CACHE_SIZE)
+    {
+      spinlock_acquire (&pool->lock);
+      cache_drain (pool, c, CACHE_BATCH);
+      spinlock_release (&pool->lock, INTR_OFF);
+    }
+  c->pages[c->cnt++] = page;
+  count_free (pool, 1);
+  intr_set_level (old_level);
+}
+
+/* Moves up to CNT pages from cache C back to POOL's free lists.
+   POOL's lock must be held. */
+static void
+cache_drain (struct pool *pool, struct page_cache *c, size_t cnt)
+{
+  for (; cnt > 0 && c->cnt > 0; cnt--)
+    {
+      void *page = c->pages[--c->cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+}
+
+/* Counts PAGE_CNT pages of POOL as handed out, raising its peak
+   if need be.  Safe without POOL's lock, as from a CPU's
+   cache. */
+static void
+count_alloc (struct pool *pool, size_t page_cnt)
+{
+  size_t used = __sync_add_and_fetch (&pool->used_cnt, page_cnt);
+  size_t peak = pool->peak_cnt;
+
+  while (used > peak
+         && !__sync_bool_compare_and_swap (&pool->peak_cnt, peak, used))
+    peak = pool->peak_cnt;
+}
+
+/* Counts PAGE_CNT pages of POOL as given back.  Safe without
+   POOL's lock. */
+static void
+count_free (struct pool *pool, size_t page_cnt)
+{
+  __sync_sub_and_fetch (&pool->used_cnt, page_cnt);
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Interrupts must be off. */
+static void
+drain_zeroed (struct pool *pool)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+}
+
+/* Zeroes free pages into POOL's cache until it is full or POOL
+   has no free pages left. */
+static void
+refill_zeroed (struct pool *pool)
+{
+  while (pool->zeroed_cnt < ZERO_CACHE_SIZE)
+    {
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+
+      old_level = intr_disable ();
+      page_idx = alloc_pages (pool, 1);
+      if (page_idx != BITMAP_ERROR)
+        bitmap_mark (pool->used_map, page_idx);
+      intr_set_level (old_level);
+      if (page_idx == BITMAP_ERROR)
+        break;
+
+      /* Only this thread adds pages, so there is still room. */
+      page = pool->base + page_idx * PGSIZE;
+      memset (page, 0, PGSIZE);
+      old_level = intr_disable ();
+      pool->zeroed[pool->zeroed_cnt++] = page;
+      intr_set_level (old_level);
+    }
+}
+
+/* Zeroer thread: runs at the lowest priority, so it zeroes pages
+   only when nothing else wants the CPU. */
+static void
+zeroer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      refill_zeroed (&kernel_pool);
+      refill_zeroed (&user_pool);
+      sema_down (&zero_sema);
+    }
+}
+
+/* Returns the list element stored in page PAGE_IDX of POOL. */
+static struct list_elem *
+page_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL's
+   free lists, without merging it with its buddy. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->orders[page_idx] = FREE_HEAD | order;
+  list_push_front (&pool->free_lists[order], page_elem (pool, page_idx));
+}
+
+/* Removes the free block at PAGE_IDX from POOL's free lists. */
+static void
+remove_block (struct pool *pool, size_t page_idx)
+{
+  ASSERT (pool->orders[page_idx] & FREE_HEAD);
+  pool->orders[page_idx] = 0;
+  list_remove (page_elem (pool, page_idx));
+}
+
+/* Returns the free block of 2**ORDER pages at PAGE_IDX to POOL,
+   merging it with its buddies. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t size = (size_t) 1 << order;
+      size_t buddy = page_idx ^ size;
+
+      if (buddy + size > pool->page_cnt
+          || pool->orders[buddy] != (FREE_HEAD | order))
+        break;
+      remove_block (pool, buddy);
+      page_idx &= ~size;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL, as the
+   largest aligned blocks that they contain. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes PAGE_CNT contiguous free pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if there is no free
+   block large enough. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  int order, j;
+
+  for (order = 0; ((size_t) 1 << order) < page_cnt; order++)
+    if (order == MAX_ORDER)
+      return BITMAP_ERROR;
+
+  for (j = order; list_empty (&pool->free_lists[j]); j++)
+    if (j == MAX_ORDER)
+      return BITMAP_ERROR;
+
+  /* Split the block down to ORDER, freeing the upper halves. */
+  page_idx = ((uint8_t *) list_front (&pool->free_lists[j]) - pool->base)
+             / PGSIZE;
+  remove_block (pool, page_idx);
+  while (j > order)
+    {
+      j--;
+      push_block (pool, page_idx + ((size_t) 1 << j), j);
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  free_pages (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+  return page_idx;
+}
+
+/* Takes PAGE_CNT contiguous free pages from POOL, where PAGE_CNT
+   is a power of 2, starting at a physical address that is a
+   multiple of PAGE_CNT pages, and returns the index of the first
+   one, or BITMAP_ERROR if there is no such run free.  Blocks are
+   aligned relative to the pool's base, so unless the base itself
+   is aligned, the run is carved out of a block twice as large. */
+static size_t
+alloc_aligned (struct pool *pool, size_t page_cnt)
+{
+  size_t skew = pg_no (pool->base) & (page_cnt - 1);
+  size_t lead, page_idx;
+
+  if (skew == 0)
+    return alloc_pages (pool, page_cnt);
+
+  page_idx = alloc_pages (pool, 2 * page_cnt);
+  if (page_idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+  lead = page_cnt - skew;
+  free_pages (pool, page_idx, lead);
+  free_pages (pool, page_idx + lead + page_cnt, skew);
+  return page_idx + lead;
+}
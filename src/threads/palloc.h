@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+struct memstat;
+
 /* How to allocate pages. */
 enum palloc_flags
   {
@@ -12,9 +14,14 @@ enum palloc_flags
   };
 
 void palloc_init (size_t user_page_limit);
+void palloc_start_zeroer (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_user_page_cnt (void);
+void palloc_get_stats (struct memstat *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,139 @@
+#include "threads/pmu.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+
+/* Hardware performance counters.
+
+   With the kernel's "-pmu" option, the architectural performance
+   monitoring that CPUID leaf 0xa describes (see [IA32-v3b]
+   "Architectural Performance Monitoring") counts the events in
+   enum pmu_event, event E in general-purpose counter E, in user
+   and kernel mode alike.  The counters run freely; at each
+   context switch, schedule() calls pmu_switch() to charge the
+   events since the last switch to the thread leaving the CPU, so
+   that each thread's struct threadstat, as threadstat() returns
+   it, holds the events that occurred while it ran.  Only the
+   bootstrap processor runs threads (see mp.c), so one set of
+   counters and one set of readings suffices.
+
+   "-pmu=user" also sets CR4.PCE, so that benchmarks may read the
+   counters with RDPMC without entering the kernel.  Those
+   readings include every thread that ran in between.
+
+   CPUs, and emulators, without architectural performance
+   monitoring, or with fewer counters than events, count what
+   they can; the rest stay zero. */
+
+/* Performance-monitoring MSRs. */
+#define MSR_PMC0 0xc1                   /* First counter. */
+#define MSR_PERFEVTSEL0 0x186           /* First event select. */
+#define MSR_PERF_GLOBAL_CTRL 0x38f      /* Counter enables (version 2+). */
+
+/* Event select bits. */
+#define EVTSEL_USR (1u << 16)           /* Count in user mode. */
+#define EVTSEL_OS (1u << 17)            /* Count in kernel mode. */
+#define EVTSEL_EN (1u << 22)            /* Enable counter. */
+
+/* An architectural event. */
+struct event
+  {
+    const char *name;
+    uint8_t event;              /* Event select. */
+    uint8_t umask;              /* Unit mask. */
+    uint8_t bit;                /* Bit in CPUID.0xa:EBX if unavailable. */
+  };
+
+static const struct event events[PMU_EVENT_CNT] =
+  {
+    [PMU_CYCLES] = {"cycles", 0x3c, 0x00, 0},
+    [PMU_INSTRUCTIONS] = {"instructions", 0xc0, 0x00, 1},
+    [PMU_LLC_MISSES] = {"llc-misses", 0x2e, 0x41, 4},
+    [PMU_BRANCH_MISSES] = {"branch-misses", 0xc5, 0x00, 6},
+  };
+
+static bool counting[PMU_EVENT_CNT];    /* Counter programmed? */
+static uint64_t last[PMU_EVENT_CNT];    /* Reading at the last switch. */
+static uint64_t counter_mask;           /* Bits in a counter. */
+
+/* Programs the counters, if the CPU has them.  If USER is true,
+   also lets user programs read them with RDPMC. */
+void
+pmu_init (bool user)
+{
+  uint32_t regs[4];
+  unsigned version, counter_cnt, width, event_cnt;
+  uint64_t enable = 0;
+  int i;
+
+  cpu_cpuid (0, regs);
+  if (regs[0] < 0xa)
+    {
+      printf ("pmu: no architectural performance monitoring\n");
+      return;
+    }
+  cpu_cpuid (0xa, regs);
+  version = regs[0] & 0xff;
+  counter_cnt = (regs[0] >> 8) & 0xff;
+  width = (regs[0] >> 16) & 0xff;
+  event_cnt = (regs[0] >> 24) & 0xff;
+  if (version == 0 || counter_cnt == 0 || width == 0)
+    {
+      printf ("pmu: no architectural performance monitoring\n");
+      return;
+    }
+  counter_mask = width < 64 ? ((uint64_t) 1 << width) - 1 : UINT64_MAX;
+
+  printf ("pmu: version %u, %u counters of %u bits, counting",
+          version, counter_cnt, width);
+  for (i = 0; i < PMU_EVENT_CNT && (unsigned) i < counter_cnt; i++)
+    {
+      const struct event *e = &events[i];
+
+      if (e->bit >= event_cnt || (regs[1] & (1u << e->bit)) != 0)
+        continue;
+      cpu_wrmsr (MSR_PERFEVTSEL0 + i, 0);
+      cpu_wrmsr (MSR_PMC0 + i, 0);
+      cpu_wrmsr (MSR_PERFEVTSEL0 + i,
+                 e->event | (e->umask << 8)
+                 | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+      enable |= 1u << i;
+      counting[i] = true;
+      printf (" %s", e->name);
+    }
+  if (version >= 2)
+    cpu_wrmsr (MSR_PERF_GLOBAL_CTRL, enable);
+  if (user)
+    {
+      cr4_set (CR4_PCE);
+      printf (", readable by RDPMC");
+    }
+  printf ("\n");
+}
+
+/* Returns true if EVENT is being counted. */
+bool
+pmu_available (enum pmu_event event)
+{
+  return counting[event];
+}
+
+/* Adds the events counted since the last call to COUNTS, which
+   has PMU_EVENT_CNT elements.  Must be called with interrupts
+   off. */
+void
+pmu_switch (uint64_t counts[])
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < PMU_EVENT_CNT; i++)
+    if (counting[i])
+      {
+        uint64_t now = cpu_rdpmc (i);
+        counts[i] += (now - last[i]) & counter_mask;
+        last[i] = now;
+      }
+}
@@ -0,0 +1,12 @@
+#ifndef THREADS_PMU_H
+#define THREADS_PMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <threadstat.h>
+
+void pmu_init (bool user);
+bool pmu_available (enum pmu_event);
+void pmu_switch (uint64_t counts[]);
+
+#endif /* threads/pmu.h */
@@ -0,0 +1,164 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Samples are counted per address in an open-addressing table
+   allocated up front, since the timer interrupt cannot allocate
+   memory.  A sample whose address has no slot and finds the
+   table full is only counted as dropped.  The table always keeps
+   one slot empty, so that probes terminate.
+
+   Sampling goes at the timer's rate, TIMER_FREQ, which is all the
+   resolution the 8254 gives without changing the length of a
+   tick.  Addresses below PHYS_BASE were in user mode: they are
+   reported apart, and name code in whichever process ran.
+
+   Each sample is also charged the TSC cycles since the sample
+   before it, which is more exact than a count when ticks vary in
+   length, as with Bochs jitter.  Under Bochs, whose TSC counts
+   instructions, this is the instructions executed per address. */
+
+/* Addresses printed in each of the kernel and user lists. */
+#define PROFILE_TOP 20
+
+/* A table slot. */
+struct sample
+  {
+    uint32_t eip;               /* Address, or 0 if slot is empty. */
+    uint32_t cnt;               /* Samples at EIP. */
+    uint64_t cycles;            /* Cycles charged to EIP. */
+  };
+
+size_t profile_page_cnt;
+
+static struct sample *samples;  /* Table, or null if not profiling. */
+static size_t slot_cnt;         /* Slots in SAMPLES. */
+static size_t used_cnt;         /* Slots in use. */
+static uint32_t kernel_cnt;     /* Samples in kernel mode. */
+static uint32_t user_cnt;       /* Samples in user mode. */
+static uint32_t dropped_cnt;    /* Samples that found no slot. */
+static uint64_t last_cycles;    /* TSC at the last sample, or 0. */
+
+/* Allocates the sample table if "-profile" asked for one.  Must
+   be called after palloc_init(). */
+void
+profile_init (void)
+{
+  if (profile_page_cnt == 0)
+    return;
+  samples = palloc_get_multiple (PAL_ZERO, profile_page_cnt);
+  if (samples == NULL)
+    {
+      printf ("profile: no memory for %zu-page table\n", profile_page_cnt);
+      return;
+    }
+  slot_cnt = profile_page_cnt * PGSIZE / sizeof *samples;
+}
+
+/* Counts a sample of the code that interrupt frame F
+   interrupted.  Called by the timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  uint32_t eip = (uint32_t) f->eip;
+  uint64_t now, cycles;
+  size_t i;
+
+  if (samples == NULL)
+    return;
+
+  now = timer_cycles ();
+  cycles = last_cycles != 0 ? now - last_cycles : 0;
+  last_cycles = now;
+
+  if (is_user_vaddr (f->eip))
+    user_cnt++;
+  else
+    kernel_cnt++;
+
+  for (i = eip * 0x9e3779b9u % slot_cnt; samples[i].eip != 0;
+       i = (i + 1) % slot_cnt)
+    if (samples[i].eip == eip)
+      {
+        samples[i].cnt++;
+        samples[i].cycles += cycles;
+        return;
+      }
+  if (used_cnt + 1 >= slot_cnt || eip == 0)
+    {
+      dropped_cnt++;
+      return;
+    }
+  samples[i].eip = eip;
+  samples[i].cnt = 1;
+  samples[i].cycles = cycles;
+  used_cnt++;
+}
+
+/* Orders samples by descending cycles, then by descending
+   count, which alone decides when there is no TSC. */
+static int
+compare_samples (const void *a_, const void *b_)
+{
+  const struct sample *a = a_;
+  const struct sample *b = b_;
+
+  if (a->cycles != b->cycles)
+    return a->cycles < b->cycles ? 1 : -1;
+  return a->cnt < b->cnt ? 1 : a->cnt > b->cnt ? -1 : 0;
+}
+
+/* Prints the PROFILE_TOP hottest addresses in TABLE, sorted by
+   cycles and count, that are in user mode if USER is true, in the kernel
+   otherwise. */
+static void
+print_top (const struct sample *table, bool user)
+{
+  uint32_t total = user ? user_cnt : kernel_cnt;
+  size_t i, n;
+
+  for (i = n = 0; i < slot_cnt && n < PROFILE_TOP; i++)
+    if (table[i].cnt != 0
+        && is_user_vaddr ((void *) table[i].eip) == user)
+      {
+        printf ("Profile %s %#010"PRIx32": %"PRIu32" samples (%"PRIu32
+                "%%), %"PRIu64" cycles\n", user ? "user" : "kernel",
+                table[i].eip, table[i].cnt, table[i].cnt * 100 / total,
+                table[i].cycles);
+        n++;
+      }
+}
+
+/* Stops profiling and prints the results: totals, the hottest
+   kernel and user addresses, and the hottest kernel addresses on
+   one line for utils/backtrace. */
+void
+profile_dump (void)
+{
+  struct sample *table = samples;
+  size_t i, n;
+
+  if (table == NULL)
+    return;
+  samples = NULL;
+
+  printf ("Profile: %"PRIu32" kernel samples, %"PRIu32" user samples, "
+          "%"PRIu32" dropped\n", kernel_cnt, user_cnt, dropped_cnt);
+  qsort (table, slot_cnt, sizeof *table, compare_samples);
+  print_top (table, false);
+  print_top (table, true);
+
+  printf ("Profile:");
+  for (i = n = 0; i < slot_cnt && n < PROFILE_TOP; i++)
+    if (table[i].cnt != 0 && !is_user_vaddr ((void *) table[i].eip))
+      {
+        printf (" %#"PRIx32, table[i].eip);
+        n++;
+      }
+  printf (".\n");
+}
@@ -0,0 +1,22 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stddef.h>
+#include "threads/interrupt.h"
+
+/* Sampling profiler.
+
+   With the "-profile" option, every timer interrupt counts the
+   address it interrupted, and the hottest addresses are printed
+   at shutdown.  The kernel addresses can be pasted into
+   utils/backtrace to name the functions they lie in. */
+
+/* Size of the sample table in pages, from "-profile", or 0 for
+   none. */
+extern size_t profile_page_cnt;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_dump (void);
+
+#endif /* threads/profile.h */
@@ -51,7 +51,8 @@ static inline uintptr_t pd_no (const void *va) {
    |         Physical Address           |         Flags          |
    +------------------------------------+------------------------+
 
-   In a PDE, the physical address points to a page table.
+   In a PDE, the physical address points to a page table, or,
+   if PTE_PS is set, to a 4 MB page aligned on a 4 MB boundary.
    In a PTE, the physical address points to a data or code page.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -64,8 +65,15 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_P 0x1               /* 1=present, 0=not present. */
 #define PTE_W 0x2               /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
+#define PTE_PWT 0x8             /* 1=write-through, 0=write-back. */
+#define PTE_PCD 0x10            /* 1=cache disabled, 0=cache enabled. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept in TLB across CR3 loads. */
+
+/* Size of a page mapped by a single PDE with PTE_PS set. */
+#define LARGE_PGSIZE (1 << PDSHIFT)
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +85,33 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB page at PAGE, which must be
+   4 MB aligned, for ring 0 code only.  The page is readable, and
+   writable as well if WRITABLE is true.  CR4_PSE must be set for
+   the CPU to honor it. */
+static inline uint32_t pde_create_large_kernel (void *page, bool writable) {
+  ASSERT ((uintptr_t) page % LARGE_PGSIZE == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a PDE that maps the 4 MB page at PAGE, which must be
+   4 MB aligned, for user and kernel code.  The page is readable,
+   and writable as well if WRITABLE is true. */
+static inline uint32_t pde_create_large_user (void *page, bool writable) {
+  return pde_create_large_kernel (page, writable) | PTE_U;
+}
+
+/* Returns a pointer to the 4 MB page that PDE, which must be
+   present with PTE_PS set, maps. */
+static inline void *pde_get_large (uint32_t pde) {
+  ASSERT ((pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS));
+  return ptov (pde & ~(uint32_t) (LARGE_PGSIZE - 1));
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
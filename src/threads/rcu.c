@@ -0,0 +1,117 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "threads/mp.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Read-copy update, quiescent-state based.
+
+   Readers bracket a lookup with rcu_read_lock() and
+   rcu_read_unlock(), taking no lock and writing nothing shared.
+   A writer, holding whatever lock excludes other writers,
+   unpublishes an object, for example with list_remove(), and
+   then must not free it until every reader that might still see
+   it is done.  synchronize_rcu() waits for that, and call_rcu()
+   arranges for a function to free the object afterward without
+   waiting.
+
+   Since a reader cannot be switched out, a CPU that has passed
+   through the scheduler, or that is halted in its idle loop, has
+   left any read-side critical section it was in: it has passed
+   through a quiescent state.  schedule() counts them in each
+   CPU's rcu_qs_cnt, and a grace period is over once every other
+   CPU that schedules threads has counted one more, or is idle.
+   The CPU running synchronize_rcu() is in no read-side critical
+   section, since it may sleep, and the parked CPUs run no
+   readers at all.  On a single CPU, then, a grace period is
+   over as soon as it begins.
+
+   Callbacks for call_rcu() are run in batches by a work queue
+   task, each batch after a grace period that begins once the
+   batch is taken. */
+
+static struct rcu_head *pending;        /* Callbacks, newest first. */
+static struct work rcu_work;            /* Runs PENDING's callbacks. */
+
+static void run_callbacks (void *aux);
+
+/* Initializes RCU.  Must be called before call_rcu(). */
+void
+rcu_init (void)
+{
+  work_init (&rcu_work, run_callbacks, NULL, PRI_DEFAULT);
+}
+
+/* Waits until every RCU read-side critical section that was in
+   progress when it was called has ended.  Must not be called
+   from an interrupt handler or inside a read-side critical
+   section. */
+void
+synchronize_rcu (void)
+{
+  unsigned snap[MP_MAX_CPUS];
+  struct cpu *self = cpu_current ();
+  size_t i;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_ON);
+
+  for (i = 0; i < cpu_cnt; i++)
+    snap[i] = cpus[i].rcu_qs_cnt;
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      if (c == self || c->idle_thread == NULL)
+        continue;
+      while (c->rcu_qs_cnt == snap[i] && !c->idle)
+        thread_yield ();
+    }
+}
+
+/* Calls FUNC with HEAD, from a kernel thread, once every RCU
+   read-side critical section in progress now has ended.  HEAD is
+   usually embedded in the object that FUNC frees.  May be called
+   from an interrupt handler. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  head->func = func;
+  old_level = intr_disable ();
+  head->next = pending;
+  pending = head;
+  intr_set_level (old_level);
+
+  work_queue (&rcu_work);
+}
+
+/* Work queue task that takes the pending callbacks, waits for a
+   grace period, and runs them, oldest first. */
+static void
+run_callbacks (void *aux UNUSED)
+{
+  struct rcu_head *batch, *reversed = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  batch = pending;
+  pending = NULL;
+  intr_set_level (old_level);
+
+  synchronize_rcu ();
+
+  while (batch != NULL)
+    {
+      struct rcu_head *next = batch->next;
+      batch->next = reversed;
+      reversed = batch;
+      batch = next;
+    }
+  while (reversed != NULL)
+    {
+      struct rcu_head *next = reversed->next;
+      reversed->func (reversed);
+      reversed = next;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include "threads/interrupt.h"
+
+/* Read-copy update, for data that is read far more often than
+   it is changed.  See rcu.c. */
+
+/* An object waiting to be reclaimed after a grace period. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+struct rcu_head
+  {
+    struct rcu_head *next;      /* Next callback pending. */
+    rcu_func *func;             /* Called after the grace period. */
+  };
+
+void rcu_init (void);
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+
+/* Begins an RCU read-side critical section, returning the
+   interrupt level to pass to rcu_read_unlock().  Readers may not
+   sleep or yield until then: with interrupts off, no context
+   switch, the quiescent state that ends a grace period, can
+   happen on this CPU in between. */
+static inline enum intr_level
+rcu_read_lock (void)
+{
+  return intr_disable ();
+}
+
+/* Ends the RCU read-side critical section that returned
+   OLD_LEVEL. */
+static inline void
+rcu_read_unlock (enum intr_level old_level)
+{
+  intr_set_level (old_level);
+}
+
+/* Inserts ELEM at the front of LIST, so that a reader traversing
+   LIST forward meanwhile sees ELEM either not at all or fully
+   linked.  Writers must still exclude each other.  list_remove()
+   is already safe for such readers, since it leaves the removed
+   element's own links alone, as long as the element is not
+   freed or reused until a grace period later. */
+static inline void
+rcu_list_push_front (struct list *list, struct list_elem *elem)
+{
+  struct list_elem *first = list->head.next;
+
+  elem->prev = &list->head;
+  elem->next = first;
+  asm volatile ("" : : : "memory");
+  first->prev = elem;
+  list->head.next = elem;
+}
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,106 @@
+#ifndef THREADS_REFCOUNT_H
+#define THREADS_REFCOUNT_H
+
+#include <stdbool.h>
+
+/* A reference count for an object shared among threads, and on
+   a multiprocessor among CPUs.  Each operation is one
+   lock-prefixed instruction, which is atomic on every CPU at
+   once and orders the memory accesses around it, so no lock or
+   disabled interrupts are needed just to take or drop a
+   reference.  The thread that drops the last one, and only that
+   thread, frees the object.
+
+   An object that can be found by lookup in a shared table while
+   its count drops to 0 needs the table's lock to decide which
+   of lookup and free wins: see refcount_put_unless_last(). */
+struct refcount
+  {
+    volatile int cnt;           /* Number of references. */
+  };
+
+/* Initializes R to CNT references. */
+static inline void
+refcount_init (struct refcount *r, int cnt)
+{
+  r->cnt = cnt;
+}
+
+/* Returns R's count, which may change as soon as it is read. */
+static inline int
+refcount_read (const struct refcount *r)
+{
+  return r->cnt;
+}
+
+/* Adds a reference to R, of which the caller must already hold
+   one, or hold a lock that keeps R from being freed. */
+static inline void
+refcount_get (struct refcount *r)
+{
+  asm volatile ("lock incl %0" : "+m" (r->cnt) : : "memory", "cc");
+}
+
+/* Adds a reference to R unless its count has already dropped to
+   0, and returns true if it did.  For lookups that find R's
+   object without holding a reference or a lock, as under RCU:
+   once the count is 0, the object is on its way to being freed
+   and must not be revived. */
+static inline bool
+refcount_get_unless_zero (struct refcount *r)
+{
+  int old = r->cnt;
+
+  while (old > 0)
+    {
+      int seen;
+
+      asm volatile ("lock cmpxchgl %2, %1"
+                    : "=a" (seen), "+m" (r->cnt)
+                    : "r" (old + 1), "0" (old)
+                    : "memory", "cc");
+      if (seen == old)
+        return true;
+      old = seen;
+    }
+  return false;
+}
+
+/* Drops a reference to R and returns true if it was the last
+   one, in which case the caller must free the object. */
+static inline bool
+refcount_put (struct refcount *r)
+{
+  bool zero;
+
+  asm volatile ("lock decl %0; sete %1"
+                : "+m" (r->cnt), "=qm" (zero) : : "memory", "cc");
+  return zero;
+}
+
+/* Drops a reference to R, unless it is the last one, and
+   returns true if it did.  If it returns false, the caller
+   takes the lock that keeps lookups from adding references and
+   then calls refcount_put(), which by then may or may not be
+   the last reference. */
+static inline bool
+refcount_put_unless_last (struct refcount *r)
+{
+  int old = r->cnt;
+
+  while (old > 1)
+    {
+      int seen;
+
+      asm volatile ("lock cmpxchgl %2, %1"
+                    : "=a" (seen), "+m" (r->cnt)
+                    : "r" (old - 1), "0" (old)
+                    : "memory", "cc");
+      if (seen == old)
+        return true;
+      old = seen;
+    }
+  return false;
+}
+
+#endif /* threads/refcount.h */
@@ -0,0 +1,209 @@
+#include "threads/slab.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   A cache hands out objects of a single size.  It obtains pages,
+   called "slabs", from the page allocator and divides each one
+   into as many objects as fit after a header and a bitmap that
+   records which of them are free.  Unlike malloc(), which rounds
+   every request up to a power of 2, objects are packed at their
+   exact size (rounded up only for alignment), so an object a
+   little over half a power of 2 does not waste nearly half of
+   its block.
+
+   A cache keeps slabs with at least one free object on its
+   PARTIAL list and the rest on its FULL list.  A slab whose
+   objects are all free goes back to the page allocator, unless
+   it is the cache's only partial slab, which is kept to avoid
+   allocating and freeing a page over and over. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Cache of objects. */
+struct kmem_cache
+  {
+    const char *name;           /* Name (for debugging purposes). */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t objs_ofs;            /* Offset of first object in slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct list partial;        /* Slabs with free objects. */
+    struct list full;           /* Slabs without free objects. */
+    struct lock lock;           /* Protects lists and slabs. */
+  };
+
+/* Slab header, at the start of each slab's page.  The free
+   bitmap follows it, then the objects. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in PARTIAL or FULL. */
+    size_t free_cnt;            /* Number of free objects. */
+    struct bitmap *free_map;    /* True bits mark free objects. */
+  };
+
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void *slab_to_obj (struct slab *, size_t idx);
+
+/* Creates and returns a cache of SIZE-byte objects, each of
+   which is initialized by CTOR, if it is nonnull, when it is
+   first allocated from the page allocator.  NAME must remain
+   valid as long as the cache.  Panics if memory is not
+   available, since caches are created at initialization. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+  size_t obj_size = ROUND_UP (size > 0 ? size : 1, sizeof (void *));
+  size_t cnt;
+
+  ASSERT (obj_size <= PGSIZE / 4);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("%s: out of memory creating slab cache", name);
+
+  /* Fit as many objects as possible after the header and
+     bitmap. */
+  for (cnt = (PGSIZE - sizeof (struct slab)) / obj_size; ; cnt--)
+    {
+      size_t ofs = ROUND_UP (sizeof (struct slab) + bitmap_buf_size (cnt),
+                             sizeof (void *));
+      if (ofs + cnt * obj_size <= PGSIZE)
+        {
+          c->objs_ofs = ofs;
+          break;
+        }
+    }
+
+  c->name = name;
+  c->obj_size = obj_size;
+  c->objs_per_slab = cnt;
+  c->ctor = ctor;
+  list_init (&c->partial);
+  list_init (&c->full);
+  lock_init (&c->lock);
+  return c;
+}
+
+/* Gets a new slab for C from the page allocator and puts it on
+   C's partial list.  Returns false if memory is not available.
+   C's lock must be held. */
+static bool
+grow (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return false;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free_map = bitmap_create_in_buf (c->objs_per_slab, s + 1,
+                                      c->objs_ofs - sizeof *s);
+  bitmap_set_all (s->free_map, true);
+  if (c->ctor != NULL)
+    for (i = 0; i < c->objs_per_slab; i++)
+      c->ctor (slab_to_obj (s, i));
+  list_push_front (&c->partial, &s->elem);
+  return true;
+}
+
+/* Allocates and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t idx;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial) && !grow (c))
+    {
+      lock_release (&c->lock);
+      return NULL;
+    }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  idx = bitmap_scan_and_flip (s->free_map, 0, 1, true);
+  ASSERT (idx != BITMAP_ERROR);
+  if (--s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+  lock_release (&c->lock);
+
+  return slab_to_obj (s, idx);
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (c, obj);
+  idx = ((uint8_t *) obj - ((uint8_t *) s + c->objs_ofs)) / c->obj_size;
+
+  lock_acquire (&c->lock);
+  ASSERT (!bitmap_test (s->free_map, idx));
+  bitmap_mark (s->free_map, idx);
+  if (s->free_cnt++ == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  else if (s->free_cnt == c->objs_per_slab
+           && list_front (&c->partial) != list_back (&c->partial))
+    {
+      list_remove (&s->elem);
+      s->magic = 0;
+      palloc_free_page (s);
+    }
+  lock_release (&c->lock);
+}
+
+/* Returns the slab of cache C that OBJ is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (obj) >= c->objs_ofs);
+  ASSERT ((pg_ofs (obj) - c->objs_ofs) % c->obj_size == 0);
+
+  return s;
+}
+
+/* Returns the IDX'th object within slab S. */
+static void *
+slab_to_obj (struct slab *s, size_t idx)
+{
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (idx < s->cache->objs_per_slab);
+  return (uint8_t *) s + s->cache->objs_ofs + idx * s->cache->obj_size;
+}
@@ -0,0 +1,20 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Cache of fixed-size objects. */
+struct kmem_cache;
+
+/* Constructor, run on each object once when its slab is created.
+   Objects are handed out by kmem_cache_alloc() in the state in
+   which they were last passed to kmem_cache_free(), so callers
+   must return them to their constructed state before freeing. */
+typedef void kmem_ctor_func (void *obj);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+#endif /* threads/slab.h */
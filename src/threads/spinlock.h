@@ -0,0 +1,66 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* A spinlock, for the short critical sections that on one CPU
+   need only interrupts disabled.  With more than one CPU running
+   kernel code, disabling interrupts keeps out interrupt handlers
+   on the local CPU only; the lock keeps out the other CPUs.
+
+   Unlike a struct lock, a spinlock may be acquired in an
+   interrupt handler, and its holder must not sleep. */
+struct spinlock
+  {
+    volatile int locked;        /* 1 if held, 0 if free. */
+  };
+
+/* Initializer for a free spinlock. */
+#define SPINLOCK_INITIALIZER { 0 }
+
+/* Initializes LOCK as free. */
+static inline void
+spinlock_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Acquires LOCK if it is free, without waiting and without
+   changing the interrupt level, and returns true if successful.
+   XCHG with a memory operand is locked implicitly. */
+static inline bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  int locked = 1;
+
+  asm volatile ("xchgl %0, %1"
+                : "+r" (locked), "+m" (lock->locked) : : "memory");
+  return !locked;
+}
+
+/* Disables interrupts, then waits until LOCK is free and
+   acquires it.  Returns the previous interrupt level, to pass
+   to spinlock_release(). */
+static inline enum intr_level
+spinlock_acquire (struct spinlock *lock)
+{
+  enum intr_level old_level = intr_disable ();
+
+  while (!spinlock_try_acquire (lock))
+    while (lock->locked)
+      asm volatile ("pause");
+  return old_level;
+}
+
+/* Releases LOCK, which the running CPU must hold, and restores
+   the interrupt level OLD_LEVEL returned by spinlock_acquire(). */
+static inline void
+spinlock_release (struct spinlock *lock, enum intr_level old_level)
+{
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+  intr_set_level (old_level);
+}
+
+#endif /* threads/spinlock.h */
@@ -27,10 +27,13 @@
 */
 
 #include "threads/synch.h"
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,32 +51,307 @@ sema_init (struct semaphore *sema, unsigned value)
 
   sema->value = value;
   list_init (&sema->waiters);
-  sema->is_locking = (value == 1) ? true : false;
+  sema->is_locking = false;
+  sema->is_owned = false;
 }
 
+/* Waiter lists are kept sorted with the highest priority at the
+   front, and FIFO among equal priorities, so that waking the
+   right thread is a list_pop_front().  The comparators below
+   order list_insert_ordered() accordingly. */
+
+/* Orders threads on a semaphore's waiter list. */
+static bool
+waiter_priority_more (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->priority
+          > list_entry (b, struct thread, elem)->priority);
+}
+
+/* Orders locks on a thread's donlocklist. */
+static bool
+donated_priority_more (const struct list_elem *a, const struct list_elem *b,
+                       void *aux UNUSED)
+{
+  return (list_entry (a, struct lock, lockelem)->donation
+          > list_entry (b, struct lock, lockelem)->donation);
+}
+
+/* Moves ELEM within LIST, which is ordered by MORE, after its
+   key has increased.  Since keys only grow here, it can only move
+   toward the front. */
 static void
-donate_priority(struct semaphore *sema, int priority)
+move_up (struct list *list, struct list_elem *elem, list_less_func *more)
 {
-    struct lock *l = container_of(sema, struct lock, semaphore);
-    struct thread *holder = l->holder;
+  struct list_elem *e = list_prev (elem);
+
+  if (e == list_head (list) || !more (elem, e, NULL))
+    return;
+  list_remove (elem);
+  while (e != list_head (list) && more (elem, e, NULL))
+    e = list_prev (e);
+  list_insert (list_next (e), elem);
+}
+
+/* Priority donation.
+
+   Each lock caches in DONATION the highest priority among the
+   threads waiting for it, and a held lock that has had waiters is
+   kept on its holder's donlocklist, ordered by DONATION.  A
+   thread's priority is then just the larger of its own
+   priority_orig and the DONATION at the front of its donlocklist,
+   which thread_donated_priority() reads in O(1).
+
+   These are maintained incrementally: a new waiter raises the
+   lock's DONATION and passes the increase down the chain of
+   holders waiting on other locks, stopping at the first link
+   where nothing changes; an acquire takes over the donation of
+   the waiters left behind; and a release drops the lock from the
+   donlocklist.  Priorities only ever rise while a thread is
+   waiting, so raising is the only update a waiter list needs. */
+
+/* Raises L's DONATION to PRIORITY, the priority of a thread
+   waiting for it, and propagates the increase to L's holder and
+   on through the locks that holders are themselves waiting for.
+   Interrupts must be off. */
+static void
+donate_priority (struct lock *l, int priority)
+{
+  while (l->donation < priority)
+    {
+      struct thread *holder = l->holder;
+
+      /* Just taken or just released; see fast_acquire(). */
+      if (holder == NULL)
+        break;
 
-     if (holder->priority < priority) {
-      if (!(l->priority_donated)) {
-	l->priority_donated = true;
-	list_push_back(&holder->donlocklist, &l->lockelem);
-	holder->num_lock_donors++;
-      }
       l->donation = priority;
-      holder->priority = priority;
+      if (!l->priority_donated)
+        {
+          l->priority_donated = true;
+          list_insert_ordered (&holder->donlocklist, &l->lockelem,
+                               donated_priority_more, NULL);
+          holder->num_lock_donors++;
+        }
+      else
+        move_up (&holder->donlocklist, &l->lockelem, donated_priority_more);
+
+      if (holder->priority >= priority)
+        break;
+      thread_reprioritize (holder, priority);
 
-      if (holder->status == THREAD_BLOCKED
-	  && holder->waitlock) {
-	donate_priority(&holder->waitlock->semaphore, priority);
+      if (holder->status != THREAD_BLOCKED || holder->waitlock == NULL)
+        break;
+      l = holder->waitlock;
+      move_up (&l->semaphore.waiters, &holder->elem, waiter_priority_more);
+    }
+}
+
+/* Lowers L's donation after a waiter gave up waiting for it.
+   The holder's priority drops with it only if the holder is on a
+   ready queue; a blocked holder sits on a wait list ordered by
+   its priority, so it keeps the higher priority until it next
+   releases a lock.  Interrupts must be off. */
+static void
+withdraw_donation (struct lock *l)
+{
+  struct list *waiters = &l->semaphore.waiters;
+  struct thread *holder = l->holder;
+  int donation;
+
+  donation = (list_empty (waiters) ? PRI_MIN - 1
+              : list_entry (list_front (waiters), struct thread,
+                            elem)->priority);
+  if (donation >= l->donation)
+    return;
+  l->donation = donation;
+  if (holder == NULL || !l->priority_donated)
+    return;
+
+  list_remove (&l->lockelem);
+  list_insert_ordered (&holder->donlocklist, &l->lockelem,
+                       donated_priority_more, NULL);
+  if (holder->status == THREAD_READY)
+    thread_reprioritize (holder, thread_donated_priority (holder));
+}
+
+/* Donation through owned objects.
+
+   An owned semaphore or a completion may be bound to an owner,
+   the thread expected to signal it.  Its struct donation caches
+   the highest priority among its waiters and, while it has both
+   waiters and an owner, sits on the owner's donors list, ordered
+   by that priority, which thread_donated_priority() reads along
+   with the donlocklist.  A raise passes on to the lock the owner
+   is itself waiting for, if any, and from there down the chain
+   of lock holders as in donate_priority().
+
+   Nothing is released to end such a donation, so it shrinks
+   instead as waiters are woken or give up.  Waiters that queue
+   up before an owner is bound donate from the moment it is.  An
+   owner must be unbound, or the object no longer waited on,
+   before the owner exits. */
+
+/* Orders donations on a thread's donors list. */
+static bool
+donation_more (const struct list_elem *a, const struct list_elem *b,
+               void *aux UNUSED)
+{
+  return (list_entry (a, struct donation, elem)->priority
+          > list_entry (b, struct donation, elem)->priority);
+}
+
+/* Initializes D with no owner. */
+static void
+donation_init (struct donation *d)
+{
+  d->owner = NULL;
+  d->priority = PRI_MIN - 1;
+}
+
+/* Returns true if D is on its owner's donors list. */
+static bool
+is_lent (const struct donation *d)
+{
+  return d->owner != NULL && !thread_mlfqs && d->priority >= PRI_MIN;
+}
+
+/* Returns the priority of the first thread on WAITERS, which is
+   ordered by waiter_priority_more(), or PRI_MIN - 1 if there is
+   none. */
+static int
+front_priority (struct list *waiters)
+{
+  return (list_empty (waiters) ? PRI_MIN - 1
+          : list_entry (list_front (waiters), struct thread,
+                        elem)->priority);
+}
+
+/* Raises D's priority to PRIORITY, that of a thread that has
+   started waiting, and lends it to D's owner.  Interrupts must
+   be off. */
+static void
+lend_priority (struct donation *d, int priority)
+{
+  struct thread *owner = d->owner;
+  bool lent = is_lent (d);
+
+  if (d->priority >= priority)
+    return;
+  d->priority = priority;
+  if (!is_lent (d))
+    return;
+  if (!lent)
+    list_insert_ordered (&owner->donors, &d->elem, donation_more, NULL);
+  else
+    move_up (&owner->donors, &d->elem, donation_more);
+
+  if (owner->priority >= priority)
+    return;
+  thread_reprioritize (owner, priority);
+  if (owner->status == THREAD_BLOCKED && owner->waitlock != NULL)
+    {
+      struct lock *l = owner->waitlock;
+      move_up (&l->semaphore.waiters, &owner->elem, waiter_priority_more);
+      donate_priority (l, priority);
+    }
+}
+
+/* Lowers D's priority to PRIORITY, that of the first waiter left
+   after one was woken or gave up, or PRI_MIN - 1 if none is, and
+   takes back from D's owner what it no longer receives.
+   Interrupts must be off. */
+static void
+reclaim_priority (struct donation *d, int priority)
+{
+  struct thread *owner = d->owner;
+  int donated;
+
+  if (priority >= d->priority)
+    return;
+  if (!is_lent (d))
+    {
+      d->priority = priority;
+      return;
+    }
+  list_remove (&d->elem);
+  d->priority = priority;
+  if (is_lent (d))
+    list_insert_ordered (&owner->donors, &d->elem, donation_more, NULL);
+
+  donated = thread_donated_priority (owner);
+  if (donated < owner->priority)
+    thread_reprioritize (owner, donated);
+}
+
+/* Binds D to OWNER, or to no thread if OWNER is null, moving what
+   it lends from its old owner to the new one. */
+static void
+donation_set_owner (struct donation *d, struct thread *owner)
+{
+  enum intr_level old_level = intr_disable ();
+  int priority = d->priority;
+
+  reclaim_priority (d, PRI_MIN - 1);
+  d->owner = owner;
+  lend_priority (d, priority);
+  intr_set_level (old_level);
+}
+
+/* Waits for SEMA's value to become positive, for up to TICKS
+   timer ticks if TIMED, and decrements it.  Returns false on
+   timeout.  Interrupts must be off. */
+static bool
+sema_wait (struct semaphore *sema, bool timed, int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+  int64_t deadline = timer_ticks () + ticks;
+  struct lock *l;
+
+  while (sema->value == 0) 
+    {
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           waiter_priority_more, NULL);
+      if (sema->is_locking) {
+	l = container_of(sema, struct lock, semaphore);
+	cur->waitlock = l;
+        if (!thread_mlfqs)
+          donate_priority(l, cur->priority);
       }
-     } else {
-       if (l->donation < priority)
-	 l->donation = priority;
-     }
+      if (sema->is_owned)
+        lend_priority (&container_of (sema, struct owned_semaphore,
+                                      semaphore)->donation,
+                       cur->priority);
+      if (!timed)
+        thread_block ();
+      else if (!thread_block_timeout (deadline - timer_ticks ()))
+        {
+          if (sema->is_locking) {
+            cur->waitlock = NULL;
+            if (!thread_mlfqs)
+              withdraw_donation (l);
+          }
+          if (sema->is_owned)
+            reclaim_priority (&container_of (sema, struct owned_semaphore,
+                                             semaphore)->donation,
+                              front_priority (&sema->waiters));
+          return false;
+        }
+    }
+
+  sema->value--;
+  if (sema->is_locking) {
+    /* Record the holder before anyone else can wait on the lock,
+       and inherit the donation of the waiters still queued. */
+    l = container_of(sema, struct lock, semaphore);
+    cur->waitlock = NULL;
+    l->holder = cur;
+    if (!thread_mlfqs && !list_empty (&sema->waiters))
+      donate_priority (l, list_entry (list_front (&sema->waiters),
+                                      struct thread, elem)->priority);
+  }
+  return true;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -86,9 +364,7 @@ donate_priority(struct semaphore *sema, int priority)
 void
 sema_down (struct semaphore *sema) 
 {
-  struct thread *cur = thread_current ();
   enum intr_level old_level;
-  struct lock *l;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
@@ -96,22 +372,29 @@ sema_down (struct semaphore *sema)
   /* what is the point of doing this,
      if an ISR cannot call a semaphore function */
   old_level = intr_disable ();
-  while (sema->value == 0) 
-    {
-      list_push_back (&sema->waiters, &cur->elem);
-      if (sema->is_locking) {
-	l = container_of(sema, struct lock, semaphore);
-	cur->waitlock = l;
-        if (!thread_mlfqs)
-          donate_priority(sema, cur->priority);
-      }
-      thread_block ();
-    }
+  sema_wait (sema, false, 0);
+  intr_set_level (old_level);
+}
 
-  if (sema->is_locking)
-    cur->waitlock = NULL;
-  sema->value--;
+/* Like sema_down(), but gives up after TICKS timer ticks.
+   Returns true if SEMA was decremented, false if the time ran
+   out first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  success = sema_wait (sema, true, ticks);
   intr_set_level (old_level);
+  return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -131,6 +414,9 @@ sema_try_down (struct semaphore *sema)
   if (sema->value > 0) 
     {
       sema->value--;
+      if (sema->is_locking)
+        container_of (sema, struct lock, semaphore)->holder
+          = thread_current ();
       success = true; 
     }
   else
@@ -140,18 +426,6 @@ sema_try_down (struct semaphore *sema)
   return success;
 }
 
-static bool donated_priority_less (const struct list_elem *a,
-				   const struct list_elem *b,
-				   void *aux)
-{
-  (void) aux;
-	
-  struct lock *l1 = list_entry (a, struct lock, lockelem);
-  struct lock *l2 = list_entry (b, struct lock, lockelem);
-
-  return (l1->donation < l2->donation);
-}
-
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
 
@@ -174,31 +448,47 @@ sema_up (struct semaphore *sema)
       list_remove(&l->lockelem);
       cur->num_lock_donors--;
       l->priority_donated = false;
-
-      if (cur->num_lock_donors) {
-        if (cur->priority == l->donation) {
-          struct lock *lmax = list_entry(list_max(&cur->donlocklist,
-						  donated_priority_less,
-						  NULL),
-					 struct lock, lockelem);
-          cur->priority = lmax->donation;
-        }
-      } else
-	cur->priority = cur->priority_orig;
+      cur->priority = thread_donated_priority (cur);
     }
+    l->donation = PRI_MIN - 1;
   }
  
-  /* pick the highst priority one */
+  /* the highest priority one is at the front */
   if (!list_empty (&sema->waiters))
-  {
-      struct list_elem *max = list_max (&sema->waiters, priority_less, NULL);
-      list_remove (max);
-      thread_unblock (list_entry (max, struct thread, elem));
-  }
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      if (sema->is_owned)
+        reclaim_priority (&container_of (sema, struct owned_semaphore,
+                                         semaphore)->donation,
+                          front_priority (&sema->waiters));
+      thread_unblock (t);
+    }
 
   intr_set_level (old_level);
 }
 
+/* Initializes owned semaphore OS to VALUE, with no owner. */
+void
+owned_sema_init (struct owned_semaphore *os, unsigned value)
+{
+  ASSERT (os != NULL);
+
+  sema_init (&os->semaphore, value);
+  os->semaphore.is_owned = true;
+  donation_init (&os->donation);
+}
+
+/* Makes OWNER, or no thread if OWNER is null, the owner of OS,
+   to which its waiters donate their priority. */
+void
+owned_sema_set_owner (struct owned_semaphore *os, struct thread *owner)
+{
+  ASSERT (os != NULL);
+
+  donation_set_owner (&os->donation, owner);
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -258,12 +548,146 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   lock->priority_donated = false;
+  lock->donation = PRI_MIN - 1;
+  lock->stats = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->semaphore.is_locking = true;
+}
+
+/* Lock contention profiling.
+
+   A lock initialized with lock_init_named() gets a struct
+   lock_stats that lock_acquire() and lock_release() keep up to
+   date, and lock_print_stats() reports at shutdown.  Locks that
+   are not named cost only a null check.  Several locks may share
+   a name, e.g. all the locks of one kind; each gets its own line.
+   Times are in timer ticks, so short waits and holds round to
+   0. */
+
+#define LOCK_STATS_MAX 32       /* Maximum number of named locks. */
+
+/* Contention profile of a named lock.  All but NAME are protected
+   by the lock itself. */
+struct lock_stats
+  {
+    const char *name;           /* Name given to lock_init_named(). */
+    int64_t acquire_cnt;        /* Number of acquisitions. */
+    int64_t contend_cnt;        /* Number that had to wait. */
+    int64_t wait_ticks;         /* Total time spent waiting. */
+    int64_t max_wait;           /* Longest wait. */
+    int64_t hold_ticks;         /* Total time held. */
+    int64_t max_hold;           /* Longest hold. */
+    int64_t acquired;           /* When the lock was last acquired. */
+  };
+
+static struct lock_stats lock_stats[LOCK_STATS_MAX];
+static size_t lock_stats_cnt;
+
+/* Initializes LOCK like lock_init() and, if there is room, has
+   its contention profiled under NAME, which must remain valid
+   forever. */
+void
+lock_init_named (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  lock_init (lock);
+
+  old_level = intr_disable ();
+  if (lock_stats_cnt < LOCK_STATS_MAX)
+    {
+      struct lock_stats *s = &lock_stats[lock_stats_cnt++];
+      memset (s, 0, sizeof *s);
+      s->name = name;
+      lock->stats = s;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread acquired LOCK after waiting
+   WAIT ticks. */
+static void
+note_acquired (struct lock *lock, int64_t wait)
+{
+  struct lock_stats *s = lock->stats;
+
+  s->acquire_cnt++;
+  if (wait >= 0)
+    {
+      s->contend_cnt++;
+      s->wait_ticks += wait;
+      if (wait > s->max_wait)
+        s->max_wait = wait;
+    }
+  s->acquired = timer_ticks ();
+}
+
+/* Records that LOCK is about to be released. */
+static void
+note_released (struct lock *lock)
+{
+  struct lock_stats *s = lock->stats;
+  int64_t hold = timer_elapsed (s->acquired);
+
+  s->hold_ticks += hold;
+  if (hold > s->max_hold)
+    s->max_hold = hold;
+}
+
+/* Prints the contention profile of every named lock. */
+void
+lock_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < lock_stats_cnt; i++)
+    {
+      const struct lock_stats *s = &lock_stats[i];
+
+      printf ("Lock %s: %lld acquires, %lld contended, "
+              "wait %lld total/%lld max, hold %lld total/%lld max ticks\n",
+              s->name, s->acquire_cnt, s->contend_cnt,
+              s->wait_ticks, s->max_wait, s->hold_ticks, s->max_hold);
+    }
+}
+
+/* Takes LOCK if it is free, without disabling interrupts, and
+   returns true if successful.
+
+   The value is claimed with a single cmpxchg, which an interrupt
+   cannot split on a uniprocessor; SMP would need a lock prefix,
+   and could spin here while the holder runs on another CPU.
+   Until the holder is recorded, a thread that starts waiting
+   finds no one to donate to, so any waiters found afterward have
+   their donation collected the slow way. */
+static bool
+fast_acquire (struct lock *lock)
+{
+  struct semaphore *sema = &lock->semaphore;
+  unsigned old = 1;
+
+  asm volatile ("cmpxchgl %2, %1"
+                : "+a" (old), "+m" (sema->value) : "r" (0u) : "cc", "memory");
+  if (old != 1)
+    return false;
+
+  lock->holder = thread_current ();
+  barrier ();
+  if (!list_empty (&sema->waiters) && !thread_mlfqs)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (!list_empty (&sema->waiters))
+        donate_priority (lock, list_entry (list_front (&sema->waiters),
+                                           struct thread, elem)->priority);
+      intr_set_level (old_level);
+    }
+  return true;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  An uncontended acquire does not touch the interrupt
+   flag.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -276,8 +700,56 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  if (fast_acquire (lock))
+    {
+      if (lock->stats != NULL)
+        note_acquired (lock, -1);
+      trace (TRACE_LOCK_ACQUIRE, (uintptr_t) lock, 0);
+      return;
+    }
+
+  if (lock->stats == NULL)
+    sema_down (&lock->semaphore);
+  else
+    {
+      int64_t start = timer_ticks ();
+      sema_down (&lock->semaphore);
+      note_acquired (lock, timer_elapsed (start));
+    }
+  trace (TRACE_LOCK_ACQUIRE, (uintptr_t) lock, 1);
+}
+
+/* Like lock_acquire(), but gives up after TICKS timer ticks.
+   Returns true if LOCK was acquired, false if the time ran out
+   first.  A waiter that gives up withdraws its priority donation
+   from the holder, as far as withdraw_donation() can.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  int64_t start;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  if (fast_acquire (lock))
+    {
+      if (lock->stats != NULL)
+        note_acquired (lock, -1);
+      trace (TRACE_LOCK_ACQUIRE, (uintptr_t) lock, 0);
+      return true;
+    }
+
+  start = timer_ticks ();
+  if (!sema_down_timeout (&lock->semaphore, ticks))
+    return false;
+  if (lock->stats != NULL)
+    note_acquired (lock, timer_elapsed (start));
+  trace (TRACE_LOCK_ACQUIRE, (uintptr_t) lock, 1);
+  return true;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -294,9 +766,11 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  success = fast_acquire (lock);
+  if (success && lock->stats != NULL)
+    note_acquired (lock, -1);
   if (success)
-    lock->holder = thread_current ();
+    trace (TRACE_LOCK_ACQUIRE, (uintptr_t) lock, 0);
   return success;
 }
 
@@ -311,8 +785,11 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  sema_up (&lock->semaphore);
+  trace (TRACE_LOCK_RELEASE, (uintptr_t) lock, 0);
+  if (lock->stats != NULL)
+    note_released (lock);
   lock->holder = NULL;
+  sema_up (&lock->semaphore);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -334,17 +811,13 @@ struct semaphore_elem
     int priority;
   };
 
-static bool condvar_priority_less (const struct list_elem *a,
-				   const struct list_elem *b,
-				   void *aux)
+/* Orders a condition's waiter list, highest priority first. */
+static bool
+condvar_priority_more (const struct list_elem *a, const struct list_elem *b,
+                       void *aux UNUSED)
 {
-  (void) aux;
-  struct semaphore_elem *se1, *se2;
-
-  se1 = list_entry (a, struct semaphore_elem, elem);
-  se2 = list_entry (b, struct semaphore_elem, elem);
-
-  return (se1->priority < se2->priority);
+  return (list_entry (a, struct semaphore_elem, elem)->priority
+          > list_entry (b, struct semaphore_elem, elem)->priority);
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -389,13 +862,48 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
-  lock_release (lock);
   waiter.priority = thread_get_priority();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       condvar_priority_more, NULL);
+  lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND after TICKS
+   timer ticks.  LOCK is reacquired before returning either way.
+   Returns true if COND was signaled, false if the time ran out
+   first. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct semaphore_elem waiter;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+  
+  sema_init (&waiter.semaphore, 0);
+  waiter.priority = thread_get_priority();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       condvar_priority_more, NULL);
+  lock_release (lock);
+  if (sema_down_timeout (&waiter.semaphore, ticks))
+    {
+      lock_acquire (lock);
+      return true;
+    }
+  lock_acquire (lock);
+
+  /* A signal may have arrived before LOCK was reacquired, in
+     which case WAITER is no longer on COND's list. */
+  if (sema_try_down (&waiter.semaphore))
+    return true;
+  list_remove (&waiter.elem);
+  return false;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -411,14 +919,10 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  /* pick the highest priority one */
-  if (!list_empty (&cond->waiters)) {
-    struct list_elem *le = list_max(&cond->waiters,
-				   condvar_priority_less,
-				   NULL);
-    list_remove(le);
-    sema_up (&list_entry (le, struct semaphore_elem, elem)->semaphore);
-  }
+  /* the highest priority one is at the front */
+  if (!list_empty (&cond->waiters))
+    sema_up (&list_entry (list_pop_front (&cond->waiters),
+                          struct semaphore_elem, elem)->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -436,3 +940,241 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes completion C.  A completion counts events that
+   have happened and lets threads wait for them: each complete()
+   lets one wait through, and complete_all() lets every present
+   and future wait through.  Unlike a semaphore, it is meant to
+   be signaled by one party, often an interrupt handler, and
+   waited on by others.
+
+   Waiters are queued by priority like semaphore waiters. */
+void
+completion_init (struct completion *c)
+{
+  ASSERT (c != NULL);
+
+  c->done = 0;
+  list_init (&c->waiters);
+  donation_init (&c->donation);
+}
+
+/* Makes OWNER, or no thread if OWNER is null, the owner of C, to
+   which the threads waiting for C donate their priority.  The
+   owner is whichever thread is expected to complete C; an
+   interrupt handler that completes it on a thread's behalf may
+   leave that thread as the owner.  complete_all() unbinds it. */
+void
+completion_set_owner (struct completion *c, struct thread *owner)
+{
+  ASSERT (c != NULL);
+
+  donation_set_owner (&c->donation, owner);
+}
+
+/* Signals one occurrence of the event C stands for, waking the
+   highest-priority waiter, if any.
+
+   This function may be called from an interrupt handler. */
+void
+complete (struct completion *c)
+{
+  enum intr_level old_level;
+
+  ASSERT (c != NULL);
+
+  old_level = intr_disable ();
+  if (c->done != UINT_MAX)
+    c->done++;
+  if (!list_empty (&c->waiters))
+    {
+      struct thread *t = list_entry (list_pop_front (&c->waiters),
+                                     struct thread, elem);
+      reclaim_priority (&c->donation, front_priority (&c->waiters));
+      thread_unblock (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Marks C complete for good and wakes all of its waiters, with a
+   single interrupt-disabled section however many there are.
+
+   This function may be called from an interrupt handler. */
+void
+complete_all (struct completion *c)
+{
+  enum intr_level old_level;
+  struct list waiters;
+
+  ASSERT (c != NULL);
+
+  old_level = intr_disable ();
+  c->done = UINT_MAX;
+  reclaim_priority (&c->donation, PRI_MIN - 1);
+  c->donation.owner = NULL;
+
+  /* Detach the waiters first: thread_unblock() may switch to a
+     woken thread before the loop is done. */
+  list_init (&waiters);
+  while (!list_empty (&c->waiters))
+    list_push_back (&waiters, list_pop_front (&c->waiters));
+  while (!list_empty (&waiters))
+    thread_unblock (list_entry (list_pop_front (&waiters),
+                                struct thread, elem));
+  intr_set_level (old_level);
+}
+
+/* Waits for C to be completed, for up to TICKS timer ticks if
+   TIMED, and consumes one completion.  Returns false on timeout.
+   Interrupts must be off. */
+static bool
+completion_wait (struct completion *c, bool timed, int64_t ticks)
+{
+  int64_t deadline = timer_ticks () + ticks;
+
+  while (c->done == 0)
+    {
+      list_insert_ordered (&c->waiters, &thread_current ()->elem,
+                           waiter_priority_more, NULL);
+      lend_priority (&c->donation, thread_current ()->priority);
+      if (!timed)
+        thread_block ();
+      else if (!thread_block_timeout (deadline - timer_ticks ()))
+        {
+          reclaim_priority (&c->donation, front_priority (&c->waiters));
+          return false;
+        }
+    }
+  if (c->done != UINT_MAX)
+    c->done--;
+  return true;
+}
+
+/* Waits for C to be completed.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+wait_for_completion (struct completion *c)
+{
+  enum intr_level old_level;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  completion_wait (c, false, 0);
+  intr_set_level (old_level);
+}
+
+/* Waits up to TICKS timer ticks for C to be completed.  Returns
+   true if it was, false if the time ran out first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+wait_for_completion_timeout (struct completion *c, int64_t ticks)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  success = completion_wait (c, true, ticks);
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Initializes SL. */
+void
+seqlock_init (struct seqlock *sl)
+{
+  sl->seq = 0;
+}
+
+/* Initializes RWLOCK.  A reader-writer lock may be held by any
+   number of readers at once, or by a single writer.
+
+   Writers have preference: a writer holds GATE, an ordinary lock,
+   from the time it starts waiting until it releases the rwlock,
+   and every reader must pass through GATE to get in.  Once a
+   writer arrives, new readers queue behind it, and it waits only
+   for the readers already inside to leave.  Because GATE is a
+   lock, threads waiting behind a writer donate their priority to
+   it through the usual lock donation, and the highest-priority
+   waiter, reader or writer, goes next when it leaves.  Readers
+   are not tracked individually, so a waiting writer does not
+   donate to them. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->gate);
+  lock_init (&rw->mutex);
+  cond_init (&rw->no_readers);
+  rw->readers = 0;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or is
+   waiting for it.  A thread must not acquire RW for reading
+   again while it holds it, since a writer arriving in between
+   would deadlock.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_read_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->gate);
+  lock_acquire (&rw->mutex);
+  rw->readers++;
+  lock_release (&rw->mutex);
+  lock_release (&rw->gate);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_read_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->mutex);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->no_readers, &rw->mutex);
+  lock_release (&rw->mutex);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_write_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->gate);
+  lock_acquire (&rw->mutex);
+  while (rw->readers > 0)
+    cond_wait (&rw->no_readers, &rw->mutex);
+  lock_release (&rw->mutex);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_write_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (lock_held_by_current_thread (&rw->gate));
+
+  lock_release (&rw->gate);
+}
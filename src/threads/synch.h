@@ -3,6 +3,17 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* Priority lent by the threads waiting on an owned semaphore or
+   a completion to its owner, the thread bound to it as the one
+   expected to signal it. */
+struct donation
+  {
+    struct thread *owner;       /* Thread that inherits, or null. */
+    int priority;               /* Highest waiter, or PRI_MIN - 1. */
+    struct list_elem elem;      /* In OWNER's donors, while lent. */
+  };
 
 /* A counting semaphore. */
 struct semaphore 
@@ -10,29 +21,47 @@ struct semaphore
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
     bool is_locking;		/* Is it a locking semaphore? */
+    bool is_owned;              /* Is it an owned semaphore? */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Owned semaphore: a semaphore whose waiters donate their
+   priority to its owner, if it has one.  Down and up it through
+   SEMAPHORE. */
+struct owned_semaphore
+  {
+    struct semaphore semaphore; /* The semaphore proper. */
+    struct donation donation;   /* Priority lent to the owner. */
+  };
+
+void owned_sema_init (struct owned_semaphore *, unsigned value);
+void owned_sema_set_owner (struct owned_semaphore *, struct thread *);
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     bool priority_donated;	/* has donation happened already */
-    int donation;		/* Priority before donations */
+    int donation;		/* Highest priority among waiters */
     struct list_elem lockelem;  /* list element for donating locks */
+    struct lock_stats *stats;   /* Contention profile, or null. */
   };
 
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -42,9 +71,40 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Completion: an event that threads wait to happen. */
+struct completion
+  {
+    unsigned done;              /* Pending completions, or UINT_MAX. */
+    struct list waiters;        /* List of waiting threads. */
+    struct donation donation;   /* Priority lent to an owner. */
+  };
+
+void completion_init (struct completion *);
+void completion_set_owner (struct completion *, struct thread *);
+void complete (struct completion *);
+void complete_all (struct completion *);
+void wait_for_completion (struct completion *);
+bool wait_for_completion_timeout (struct completion *, int64_t ticks);
+
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock gate;           /* Held by a writer, passed by readers. */
+    struct lock mutex;          /* Protects READERS. */
+    struct condition no_readers; /* Signaled when READERS drops to 0. */
+    unsigned readers;           /* Number of readers holding the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_read_acquire (struct rwlock *);
+void rwlock_read_release (struct rwlock *);
+void rwlock_write_acquire (struct rwlock *);
+void rwlock_write_release (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -52,4 +112,64 @@ void cond_broadcast (struct condition *, struct lock *);
    reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
+/* Sequence lock, for data that is read far more often than it
+   is written and that is cheap to copy.  Readers never block or
+   disable interrupts; they read the data between
+   seqlock_read_begin() and seqlock_read_retry() and start over
+   if a writer got in meanwhile:
+
+        do
+          {
+            seq = seqlock_read_begin (&sl);
+            ...copy the data...
+          }
+        while (seqlock_read_retry (&sl, seq));
+
+   SEQ is odd while a write is in progress.  Writers must exclude
+   each other by other means, typically by running with
+   interrupts off, and a reader must not interrupt a writer and
+   spin on it, so readers may not run in an interrupt handler
+   that can preempt the writer. */
+struct seqlock
+  {
+    unsigned seq;               /* Odd while being written. */
+  };
+
+void seqlock_init (struct seqlock *);
+
+/* Starts a read of the data SL protects.  Returns a value for
+   seqlock_read_retry(). */
+static inline unsigned
+seqlock_read_begin (const struct seqlock *sl)
+{
+  unsigned seq = *(const volatile unsigned *) &sl->seq;
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the data read since seqlock_read_begin() which
+   returned SEQ may be torn and must be read again. */
+static inline bool
+seqlock_read_retry (const struct seqlock *sl, unsigned seq)
+{
+  barrier ();
+  return (seq & 1) != 0 || *(const volatile unsigned *) &sl->seq != seq;
+}
+
+/* Starts changing the data SL protects. */
+static inline void
+seqlock_write_begin (struct seqlock *sl)
+{
+  sl->seq++;
+  barrier ();
+}
+
+/* Finishes changing the data SL protects. */
+static inline void
+seqlock_write_end (struct seqlock *sl)
+{
+  barrier ();
+  sl->seq++;
+}
+
 #endif /* threads/synch.h */
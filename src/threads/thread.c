@@ -1,19 +1,30 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <sysstat.h>
 #include "devices/timer.h"
+#include "histogram.h"
 #include "list.h"
 #include "fixpoint.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/lapic.h"
+#include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/pmu.h"
+#include "threads/refcount.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "tests/threads/tests.h"
 
@@ -26,16 +37,112 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, kept in one FIFO queue
+   per priority level.  Bit P of MASK is set iff QUEUES[P] is
+   nonempty, so the highest runnable priority is found with a
+   single bit scan.
+
+   Each CPU has its own run queue, so that CPUs do not contend
+   for one.  A thread is queued on the CPU it last ran on, its
+   `cpu', whose caches are likeliest to still hold its data.  A
+   CPU whose queue runs dry steals from the busiest other queue,
+   and every BALANCE_TICKS each CPU pulls a thread over from the
+   busiest queue if that one is longer by more than one.  Either
+   way the thread taken is the one at the front of the highest
+   priority queue, which has waited longest and so is least
+   likely to have data left in its old CPU's caches.
+
+   Only the bootstrap CPU runs threads so far (see mp.c), so only
+   runqueues[0] is used, and without SMP there is no other queue
+   to steal from or balance against; the interrupt-disable
+   critical sections will need each queue's spinlock once the
+   others do too.  The EDF and fair classes below are not yet
+   per-CPU. */
+struct runqueue
+  {
+    struct list queues[NQ];     /* One FIFO per priority. */
+    uint64_t mask;              /* Nonempty QUEUES. */
+    int cnt;                    /* Threads in QUEUES. */
+  };
+static struct runqueue runqueues[MP_MAX_CPUS];
 
-/* priority queues */
-static struct list ready_queues[NQ];
+#ifdef SMP
+/* Ticks between load balancing passes. */
+#define BALANCE_TICKS (TIME_SLICE * 4)
+
+/* Whether the idle loop waits with MONITOR/MWAIT on its CPU's
+   need_resched flag, which lets another CPU wake it just by
+   setting the flag, instead of HLT and a reschedule IPI. */
+static bool use_mwait;
+#endif
+
+/* Ready threads of the earliest-deadline-first class, which runs
+   ahead of every priority.  Those with budget left this period
+   are on rt_ready, in deadline order; those that have used it up
+   are on rt_throttled until their period ends, when the thread's
+   timer replenishes them.  Both count in ready_cnt. */
+static struct list rt_ready;
+static struct list rt_throttled;
+
+/* Sum of budget / period over all EDF threads, in thousandths.
+   thread_set_edf() refuses parameters that would take it past
+   RT_UTIL_MAX, which leaves the normal classes some of the CPU
+   and keeps every admitted thread's deadlines feasible. */
+#define RT_UTIL_MAX 900
+static int rt_util_total;
+
+/* A group of threads sharing a CPU quota: together they may run
+   for QUOTA ticks out of every PERIOD.  Once the quota is used up
+   the group is throttled, and its ready threads wait on THREADS,
+   out of the ready queues, until the period ends.  Children join
+   their parent's group.  EDF threads are exempt, since their own
+   budgets already bound them. */
+struct thread_group
+  {
+    struct refcount ref_cnt;    /* Member threads. */
+    int64_t quota;              /* Ticks the group may run... */
+    int64_t period;             /* ...per this many ticks. */
+    int64_t used;               /* Ticks used this period. */
+    int64_t period_end;         /* First tick of the next period. */
+    bool throttled;             /* Quota used up this period? */
+    struct list threads;        /* Ready threads while throttled. */
+    struct timer timer;         /* Ends throttling. */
+  };
 
-/* List of processes in the THREAD_BLOCKED state waiting
-  for events to happen, like timer expiration */
-static struct list waiting_list;
+/* Ready threads under the fair scheduler, ordered by vruntime:
+   the thread that has had the least weighted CPU time runs
+   next.  Priorities are not used. */
+static struct rb_tree fair_tree;
+
+/* Never decreasing lower bound on the vruntime of the running
+   and ready threads.  A thread that was blocked is placed no
+   more than FAIR_SLEEPER_CREDIT below it when it wakes, so it
+   gets a prompt turn but cannot make up for all the time it
+   slept; a new thread starts at it. */
+static int64_t min_vruntime;
+
+/* A nice 0 thread's vruntime advances by NICE_0_WEIGHT per
+   tick.  Each step of nice changes a thread's weight by about
+   25%, i.e. its CPU share against a thread of the other nice by
+   about 10%. */
+#define NICE_0_WEIGHT 1024
+#define FAIR_SLEEPER_CREDIT (NICE_0_WEIGHT * TIME_SLICE / 2)
+#define FAIR_WAKEUP_GRAN NICE_0_WEIGHT
+
+/* Weight for each nice value, from -20 to 20. */
+static const int nice_weights[41] =
+  {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906,
+    3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423,
+    335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45,
+    36, 29, 23, 18, 15,
+    12,
+  };
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -47,6 +154,16 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Recently freed thread pages.  A dying thread's page is kept
+   here for reuse by thread_create(), up to THREAD_PAGE_CACHE
+   pages, instead of going back to the page allocator.  Only the
+   struct thread at the bottom of a page needs reinitializing,
+   which init_thread() does; the rest is stack, which is never
+   read before it is written.  Accessed with interrupts off. */
+#define THREAD_PAGE_CACHE 8
+static void *thread_pages[THREAD_PAGE_CACHE];
+static size_t thread_page_cnt;
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -54,6 +171,21 @@ static struct lock tid_lock;
 int load_avg;
 static struct lock load_avg_lock;
 
+/* MLFQS recent_cpu decay.  Once per second every thread's
+   recent_cpu is scaled by a coefficient derived from load_avg.
+   Rather than touching every thread in the timer interrupt, each
+   elapsed second opens a new epoch whose coefficient is kept in
+   decay_coeffs[], and a thread applies the epochs it missed the
+   next time it is examined or re-queued (see mlfqs_catch_up()).
+   After DECAY_HISTORY missed epochs a thread's recent_cpu has
+   long since converged, so older epochs are simply dropped. */
+#define DECAY_HISTORY 64
+static unsigned decay_epoch;            /* # of decays so far. */
+static int decay_coeffs[DECAY_HISTORY]; /* Coefficient for each epoch. */
+
+/* # of threads on the ready queues, for load_avg. */
+static int ready_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -68,15 +200,41 @@ static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 static long long total_ticks;	/* for process aging */
 
-/* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+/* Wakeup latency: time from thread_unblock() until the thread
+   runs.  There is a histogram per priority, taken when the
+   thread runs, and a last one for the deadline class. */
+#define LAT_ROWS (PRI_MAX + 2)
+#define LAT_ROW_EDF (PRI_MAX + 1)
+static struct histogram lat_hist[LAT_ROWS];
+static uint64_t lat_max[LAT_ROWS];  /* Longest wait, in ns. */
+
+/* Scheduling.  The slices at either end of the priority range
+   scale with the tunable one in the middle. */
+unsigned thread_time_slice = 4; /* # of timer ticks to give each thread. */
+#define TIME_SLICE thread_time_slice
+#define TIME_SLICE_MIN ((TIME_SLICE + 1) / 2)   /* Slice at PRI_MAX. */
+#define TIME_SLICE_MAX (TIME_SLICE * 2)         /* Slice at PRI_MIN. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* A thread woken by an interrupt handler preempts one of lower
+   priority at once only if it outranks it by WAKEUP_PRI_GRAN or
+   the running thread has had WAKEUP_MIN_RUN ticks; otherwise
+   thread_tick() preempts at the next tick.  This keeps threads
+   that wake each other in turn from switching on every wakeup. */
+#define WAKEUP_PRI_GRAN 4
+#define WAKEUP_MIN_RUN 1
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the proportional-share fair scheduler, which
+   divides the CPU among threads by weights derived from their
+   nice values.  Controlled by kernel command-line option
+   "-fair". */
+bool thread_fair;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -88,6 +246,33 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static bool rt_preempts (struct thread *);
+static bool preempts (struct thread *, struct thread *cur);
+static bool wakeup_preempts (struct thread *, struct thread *cur);
+static unsigned time_slice (struct thread *);
+static bool fair_less (const struct rb_elem *, const struct rb_elem *,
+                       void *aux);
+static void fair_update_min (struct thread *cur);
+static struct thread *ready_queue_pop (void);
+static struct runqueue *local_runqueue (void);
+static int runqueue_max_priority (const struct runqueue *);
+#ifdef SMP
+static struct runqueue *busiest_runqueue (void);
+static struct thread *runqueue_migrate (struct runqueue *);
+static struct thread *runqueue_steal (void);
+static void runqueue_balance (void);
+static void cpu_kick (struct cpu *);
+static intr_handler_func resched_interrupt;
+#endif
+static timer_func group_replenish;
+static void group_release (struct thread_group *);
+static void mlfqs_catch_up (struct thread *);
+static void mlfqs_decay_epoch (void);
+static void record_latency (struct thread *, uint64_t ns);
+static void print_latency (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -106,18 +291,26 @@ void
 thread_init (void)
 {
   unsigned int i;
+  int cpu;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
   list_init (&all_list);
-  list_init (&waiting_list);
 
-  if (thread_mlfqs) {
-    for (i = 0; i < NQ; i++)
-      list_init (&ready_queues[i]);
-  }
+  for (cpu = 0; cpu < MP_MAX_CPUS; cpu++)
+    {
+      struct runqueue *rq = &runqueues[cpu];
+
+      for (i = 0; i < NQ; i++)
+        list_init (&rq->queues[i]);
+      rq->mask = 0;
+      rq->cnt = 0;
+    }
+  ready_cnt = 0;
+  list_init (&rt_ready);
+  list_init (&rt_throttled);
+  rb_init (&fair_tree, fair_less, NULL);
 
   lock_init (&load_avg_lock);
   load_avg = 0;
@@ -142,13 +335,15 @@ thread_start (void)
   /* idle thread should not be checked when traversing lists of all threads
      eg: when recalculating properties or when scheduling, since it has
      a separate pointer to itself, and receives no accounting information */
-  if (!thread_mlfqs)
-    idle_thread = list_entry (list_front (&ready_list), struct thread, elem);
-  else
-    idle_thread = list_entry (list_front (&ready_queues[PRI_MIN]), struct thread, elem);
-  list_remove(&idle_thread->elem);
+  idle_thread = next_thread_to_run ();
   list_remove(&idle_thread->allelem);
 
+#ifdef SMP
+  use_mwait = (cpu_features2 () & CPUID2_MONITOR) != 0;
+  if (lapic_present ())
+    intr_register_ext (LAPIC_RESCHED_VEC, resched_interrupt, "Reschedule");
+#endif
+
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
@@ -173,110 +368,198 @@ static inline int recalculate_priority(struct thread * t)
   return priority;
 }
 
+/* Applies the recent_cpu decays T missed while it was not being
+   looked at, then recomputes its priority.  T must not be on a
+   ready queue, since its queue index may change. */
+static void
+mlfqs_catch_up (struct thread *t)
+{
+  unsigned missed = decay_epoch - t->decay_epoch;
+  unsigned e;
+
+  if (missed > DECAY_HISTORY)
+    missed = DECAY_HISTORY;
+  for (e = decay_epoch - missed; e != decay_epoch; e++)
+    t->recent_cpu = add_fp_int (mul_fp (decay_coeffs[e % DECAY_HISTORY],
+                                        t->recent_cpu), t->nice);
+  t->decay_epoch = decay_epoch;
+
+  if (t != idle_thread)
+    t->priority = recalculate_priority (t);
+}
+
+/* Starts a new decay epoch using the current load_avg.  Blocked
+   threads are left to catch up lazily; the running thread and the
+   ready threads are brought up to date now because their
+   priorities decide what runs next. */
+static void
+mlfqs_decay_epoch (void)
+{
+  struct list ready;
+  struct thread *t;
+  int cpu, i;
+
+  decay_coeffs[decay_epoch % DECAY_HISTORY] =
+    div_fp (mul_fp_int (load_avg, 2), add_fp_int (mul_fp_int (load_avg, 2), 1));
+  decay_epoch++;
+
+  mlfqs_catch_up (running_thread ());
+
+  for (cpu = 0; cpu < (int) cpu_cnt; cpu++)
+    {
+      struct runqueue *rq = &runqueues[cpu];
+
+      list_init (&ready);
+      for (i = PRI_MAX; i >= PRI_MIN; i--)
+        list_splice (list_end (&ready), list_begin (&rq->queues[i]),
+                     list_end (&rq->queues[i]));
+      rq->mask = 0;
+      rq->cnt = 0;
+      ready_cnt -= list_size (&ready);
+
+      while (!list_empty (&ready)) {
+        t = list_entry (list_pop_front (&ready), struct thread, elem);
+        mlfqs_catch_up (t);
+        ready_queue_push (t);
+      }
+    }
+}
+
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   Thus, this function runs in an external interrupt context.
+
+   TICKS normally advances by one per call, but after a tickless
+   idle period it may jump ahead by several ticks at once; all the
+   periodic work below is keyed on which boundaries were crossed
+   since the previous call rather than on the exact tick value. */
 void
 thread_tick (int64_t ticks)
 {
+  struct cpu *c = cpu_current ();
   struct thread *cur = thread_current ();
-  struct thread *sleeper, *t;
+  struct thread *t;
   struct list_elem *e;
+  int64_t prev_tick = c->ticks;
+  int64_t elapsed = ticks - prev_tick;
+  int64_t sec;
   int ready_threads;
-  int old_priority;
+  int i;
   bool priority_supersded = false;
 
-  /* Update statistics. */
+  c->ticks = ticks;
+
+  /* Update statistics.  A process's thread is charged user time
+     for the whole tick, wherever the tick found it. */
   if (cur == idle_thread)
-    idle_ticks++;
+    idle_ticks += elapsed;
 #ifdef USERPROG
-  else if (t->pagedir != NULL)
-    user_ticks++;
+  else if (cur->pagedir != NULL)
+    {
+      user_ticks += elapsed;
+      cur->stats.user_ticks += elapsed;
+    }
 #endif
   else
-    kernel_ticks++;
+    {
+      kernel_ticks += elapsed;
+      cur->stats.kernel_ticks += elapsed;
+    }
 
-  if (thread_mlfqs) {
+  if (thread_fair) {
+    /* charge the running thread's weighted run time */
+    if (cur != idle_thread && cur->rt_period == 0)
+      cur->vruntime += elapsed * NICE_0_WEIGHT * NICE_0_WEIGHT
+                       / nice_weights[cur->nice + 20];
+    fair_update_min (cur);
+  } else if (thread_mlfqs) {
     /* each timer tick, the running thread's recent_cpu is incremented by 1 */
     if (cur != idle_thread)
-      cur->recent_cpu = add_fp_int(cur->recent_cpu, 1);
-
-    if (ticks % 4 == 0) {
-      if (ticks % TIMER_FREQ == 0) {
-        /* replace this with O(1) */
-        /* need to reduce the time spent in the irq handler slightly */
-        ready_threads = 0;
-        list_foreach(e, t, all_list, allelem) {
-          if (t->status == THREAD_READY ||
-              t->status == THREAD_RUNNING)
-            ready_threads++;
-        }
-        /* load average */
-        load_avg = mul_fp(div_fp(convert_fp(59),convert_fp(60)), load_avg) +
-          mul_fp(div_fp(convert_fp(1),convert_fp(60)), convert_fp(ready_threads));
-      }
-
-      /* Each thread's  priority is recalculated every fourth tick */
-      list_foreach(e, t, all_list, allelem) {
-        if (t->status != THREAD_NASCENT) {
-          if (ticks % TIMER_FREQ == 0)
-            t->recent_cpu = add_fp_int(mul_fp(div_fp(mul_fp_int(load_avg, 2),add_fp_int(mul_fp_int(load_avg, 2),1)),t->recent_cpu) , t->nice);
-
-          old_priority = t->priority;
-          t->priority = recalculate_priority(t);
-
-          if (t->status == THREAD_READY && (old_priority != t->priority)) {
-            list_remove (&t->elem);
-            list_push_back(&ready_queues[t->priority], &t->elem);
+      cur->recent_cpu = add_fp_int(cur->recent_cpu, elapsed);
+
+    for (sec = prev_tick / TIMER_FREQ; sec < ticks / TIMER_FREQ; sec++) {
+      ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+      /* load average */
+      load_avg = mul_fp(div_fp(convert_fp(59),convert_fp(60)), load_avg) +
+        mul_fp(div_fp(convert_fp(1),convert_fp(60)), convert_fp(ready_threads));
+      mlfqs_decay_epoch ();
+    }
 
-            if (t->priority > cur->priority)
-              priority_supersded = true;
-          }
-        }
-      }
+    /* Only the running thread's recent_cpu changed since the last
+       recalculation, so it is the only priority that can move. */
+    if (prev_tick / 4 != ticks / 4 && cur != idle_thread) {
+      cur->priority = recalculate_priority (cur);
+      if (ready_queue_max_priority () > cur->priority)
+        priority_supersded = true;
     }
   } else {
-      /* priority aging */
-    total_ticks++;
-    if ((total_ticks % (TIME_SLICE * 4)) == 0) {
-      for (e = list_begin (&ready_list);
-           e != list_end (&ready_list);
-           e = list_next (e)) {
-        t = list_entry (e, struct thread, elem);
-        if (t->priority < PRI_MAX)
+      /* priority aging: every ready thread below PRI_MAX moves
+         up one level, which shifts each queue into the one above
+         it.  Go from the top down so no thread is aged twice. */
+    struct runqueue *rq = local_runqueue ();
+    int64_t old_total = total_ticks;
+    total_ticks += elapsed;
+    if (old_total / (TIME_SLICE * 4) != total_ticks / (TIME_SLICE * 4)) {
+      for (i = PRI_MAX - 1; i >= PRI_MIN; i--) {
+        if (list_empty (&rq->queues[i]))
+          continue;
+        list_foreach(e, t, rq->queues[i], elem)
           t->priority++;
+        list_splice (list_end (&rq->queues[i + 1]),
+                     list_begin (&rq->queues[i]),
+                     list_end (&rq->queues[i]));
+        rq->mask &= ~((uint64_t) 1 << i);
+        rq->mask |= (uint64_t) 1 << (i + 1);
       }
     }
   }
 
-  /* control this with a debug macro, rather than commenting it out */
-  /* printf("Inside timer interrupt, thread kicks %d\n", thread_ticks); */
+#ifdef SMP
+  /* Even out the run queues. */
+  if (!thread_fair && prev_tick / BALANCE_TICKS != ticks / BALANCE_TICKS)
+    runqueue_balance ();
+#endif
 
-  /* iterate over list of sleeping processes and decrease their ticks */
-  if (!list_empty(&waiting_list)) {
-    e = list_begin (&waiting_list);
-    while (e != list_end(&waiting_list)) {
-      sleeper = list_entry (e, struct thread, elem);
-      sleeper->ticks_wait--;
-      if (sleeper->ticks_wait == 0) {
-        /* 'e' is now the next element to the deleted one */
-        e = list_remove (e);
-        if (!thread_mlfqs)
-          list_push_back (&ready_list, &sleeper->elem);
-        else
-          list_push_back (&ready_queues[sleeper->priority], &sleeper->elem);
-        sleeper->status = THREAD_READY;
-        /* check that priority is higher, then yield on return */
-        if (sleeper->priority > cur->priority)
-          priority_supersded = true;
-        break;
-      }
-      else
-        e = list_next(e);
+  /* Charge an EDF thread's budget; once it is spent the thread is
+     throttled until its period ends (see ready_queue_push()). */
+  if (cur->rt_period != 0)
+    {
+      cur->rt_left -= elapsed;
+      if (cur->rt_left <= 0)
+        priority_supersded = true;
     }
-  }
+  if (rt_preempts (cur))
+    priority_supersded = true;
+
+  /* Charge the running thread's group, throttling it once its
+     quota for this period is gone. */
+  if (cur->group != NULL && cur->rt_period == 0)
+    {
+      struct thread_group *g = cur->group;
+      if (ticks >= g->period_end)
+        {
+          g->used = 0;
+          g->period_end = ticks + g->period;
+        }
+      g->used += elapsed;
+      if (g->used >= g->quota && !g->throttled)
+        {
+          g->throttled = true;
+          timer_add (&g->timer, g->period_end, group_replenish, g);
+        }
+      if (g->throttled)
+        priority_supersded = true;
+    }
+
+  /* control this with a debug macro, rather than commenting it out */
+  /* printf("Inside timer interrupt, thread kicks %d\n", thread_ticks); */
 
   /* Enforce preemption. */
-  if ((++thread_ticks >= TIME_SLICE) || priority_supersded)
+  thread_ticks += elapsed;
+  if (!thread_fair && !thread_mlfqs && cur->rt_period == 0
+      && thread_ticks >= WAKEUP_MIN_RUN
+      && ready_queue_max_priority () > cur->priority)
+    priority_supersded = true;
+  if ((thread_ticks >= time_slice (cur)) || priority_supersded)
     {
       /* printf("Timer has expired, about next time yield\n"); */
       intr_yield_on_return ();
@@ -286,12 +569,77 @@ thread_tick (int64_t ticks)
 
 }
 
-/* Prints thread statistics. */
+/* thread_action_func for thread_print_stats(). */
+static void
+print_thread_stats (struct thread *t, void *aux UNUSED)
+{
+  const struct threadstat *s = &t->stats;
+
+  if (t == idle_thread)
+    return;
+  printf ("Thread %d (%s): %lld user ticks, %lld kernel ticks, "
+          "%lld ready ticks, %lld blocked ticks, "
+          "%"PRIu32" voluntary and %"PRIu32" involuntary switches\n",
+          t->tid, t->name, s->user_ticks, s->kernel_ticks,
+          s->ready_ticks, s->blocked_ticks,
+          s->voluntary_cnt, s->involuntary_cnt);
+}
+
+/* Prints thread statistics, overall and for each live thread. */
 void
 thread_print_stats (void)
 {
+  enum intr_level old_level;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  print_latency ();
+  old_level = intr_disable ();
+  thread_foreach (print_thread_stats, NULL);
+  intr_set_level (old_level);
+}
+
+/* Stores the scheduler's counters into STAT. */
+void
+thread_get_sched_stats (struct sysstat *stat)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  stat->ticks = timer_ticks ();
+  stat->idle_ticks = idle_ticks;
+  stat->kernel_ticks = kernel_ticks;
+  stat->user_ticks = user_ticks;
+  stat->thread_cnt = list_size (&all_list);
+  stat->ready_cnt = ready_cnt;
+  intr_set_level (old_level);
+}
+
+/* Copies the counters of the live thread TID into *STATS.
+   Returns false if there is no such thread. */
+bool
+thread_get_stats (tid_t tid, struct threadstat *stats)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  bool found = false;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      if (t->tid == tid)
+        {
+          if (t == thread_current ())
+            pmu_switch (t->stats.pmu);
+          *stats = t->stats;
+          found = true;
+          break;
+        }
+    }
+  intr_set_level (old_level);
+  return found;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -317,12 +665,18 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread, reusing a dead thread's page if there is
+     one. */
+  old_level = intr_disable ();
+  t = thread_page_cnt > 0 ? thread_pages[--thread_page_cnt] : NULL;
+  intr_set_level (old_level);
+  if (t == NULL)
+    t = palloc_get_page (0);
   if (t == NULL)
     return TID_ERROR;
 
@@ -351,6 +705,34 @@ thread_create (const char *name, int priority,
   return tid;
 }
 
+/* Timer function that wakes the sleeping thread in TIMER's aux.
+   If it was in thread_block_timeout(), it is first taken off the
+   list it was waiting on, and timed_wait is left set to tell it
+   that it timed out. */
+static void
+wake_sleeper (struct timer *timer)
+{
+  struct thread *t = timer->aux;
+  bool timed_out = t->timed_wait;
+
+  ASSERT (t->status == THREAD_BLOCKED);
+
+  if (timed_out)
+    {
+      list_remove (&t->elem);
+      t->timed_wait = false;
+    }
+  thread_unblock (t);
+  t->timed_wait = timed_out;
+
+  /* thread_unblock() does not preempt from an interrupt. */
+  if (wakeup_preempts (t, thread_current ()))
+    intr_yield_on_return ();
+}
+
+/* Puts the current thread to sleep for TICKS timer ticks.  It is
+   made ready again by thread_tick() once the deadline passes.
+   Must be called with interrupts off. */
 void thread_wait (int64_t ticks)
 {
   struct thread *cur = thread_current ();
@@ -359,9 +741,7 @@ void thread_wait (int64_t ticks)
   ASSERT (intr_get_level () == INTR_OFF);
 
   cur->status = THREAD_BLOCKED;
-  cur->ticks_wait = ticks;
-
-  list_push_back (&waiting_list, &cur->elem);
+  timer_add (&cur->timer, timer_ticks () + ticks, wake_sleeper, cur);
   schedule ();
 }
 
@@ -381,6 +761,38 @@ thread_block (void)
   schedule ();
 }
 
+/* Like thread_block(), but gives up after TICKS timer ticks.  The
+   caller must have put the current thread's `elem' on a wait
+   list.  If thread_unblock() is not called within TICKS ticks,
+   the thread is removed from that list and made ready anyway.
+   Returns true if it was unblocked, false if it timed out.
+
+   This function must be called with interrupts turned off. */
+bool
+thread_block_timeout (int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+  bool woken;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (ticks <= 0)
+    {
+      list_remove (&cur->elem);
+      return false;
+    }
+
+  cur->timed_wait = true;
+  timer_add (&cur->timer, timer_ticks () + ticks, wake_sleeper, cur);
+  thread_block ();
+
+  /* thread_unblock() clears timed_wait; wake_sleeper() does not. */
+  woken = !cur->timed_wait;
+  cur->timed_wait = false;
+  return woken;
+}
+
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -402,24 +814,42 @@ thread_unblock (struct thread *t)
   old_level = intr_disable ();
   cur = thread_current();
 
-  if (!thread_mlfqs)
-    list_push_back (&ready_list, &t->elem);
-  else
-    list_push_back (&ready_queues[t->priority], &t->elem);
+  /* woken before its timeout: disarm it */
+  if (t->timed_wait) {
+    timer_cancel (&t->timer);
+    t->timed_wait = false;
+  }
+
+  /* a freshly created thread is already up to date */
+  if (thread_mlfqs && t->status == THREAD_BLOCKED)
+    mlfqs_catch_up (t);
+
+  /* blocked time ends and ready time starts here */
+  if (t->status == THREAD_BLOCKED)
+    t->stats.blocked_ticks += timer_ticks () - t->stats_since;
+  t->stats_since = timer_ticks ();
+  t->wake_ns = timer_ns ();
 
+  /* Place T near the fair scheduler's current position, so that
+     neither a new thread nor one that slept runs for long ahead
+     of the others. */
+  if (thread_fair)
+    {
+      int64_t floor = min_vruntime;
+      if (t->status == THREAD_BLOCKED)
+        floor -= FAIR_SLEEPER_CREDIT;
+      if (t->vruntime < floor)
+        t->vruntime = floor;
+    }
+  ready_queue_push (t);
   t->status = THREAD_READY;
 
-  if (t->priority > cur->priority
+  if (preempts (t, cur)
       /* why was I doing this? */
       && !intr_context()) {
 
     cur->status = THREAD_READY;
-
-    if (!thread_mlfqs)
-      list_push_back (&ready_list, &cur->elem);
-    else
-      list_push_back (&ready_queues[cur->priority], &cur->elem);
-
+    ready_queue_push (cur);
     schedule ();
   }
 
@@ -469,11 +899,16 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  group_release (thread_current ()->group);
+  malloc_thread_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (thread_current ()->rt_period != 0)
+    rt_util_total -= thread_current ()->rt_util;
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -492,12 +927,8 @@ thread_yield (void)
 
   old_level = intr_disable ();
 
-  if (cur != idle_thread) {
-    if (!thread_mlfqs)
-      list_push_back (&ready_list, &cur->elem);
-    else
-      list_push_back (&ready_queues[cur->priority], &cur->elem);
-  }
+  if (cur != idle_thread)
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
   schedule ();
 
@@ -533,30 +964,59 @@ bool priority_less (const struct list_elem *a,
   return (l1->priority < l2->priority);
 }
 
-static inline void
-thread_assign_priority(int new_priority, struct thread *cur)
+/* Changes the priority of T to PRIORITY.  If T is on a ready
+   queue it is moved to the queue for its new priority, at the
+   back, as if it had just become ready.
+   Must be called with interrupts off. */
+void
+thread_reprioritize (struct thread *t, int priority)
 {
-  struct thread *t;
-  int old_priority;
-  int i;
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
 
-  old_priority = cur->priority;
-  cur->priority = new_priority;
+  if (t->status == THREAD_READY && t != idle_thread) {
+    ready_queue_remove (t);
+    t->priority = priority;
+    ready_queue_push (t);
+  } else
+    t->priority = priority;
+}
 
-  /* T: this has to change to reflect mq's*/
-  if (thread_mlfqs && (new_priority < old_priority)) {
-    for (i = old_priority; i > new_priority; i--) {
-      if (!list_empty (&ready_queues[i]))
-        thread_yield();
+/* Returns T's own priority raised by the highest donation it is
+   receiving through the locks it holds and the owned objects it
+   is bound to.  Must be called with interrupts off. */
+int
+thread_donated_priority (struct thread *t)
+{
+  int priority = t->priority_orig;
+
+  if (!list_empty (&t->donlocklist))
+    {
+      struct lock *l = list_entry (list_front (&t->donlocklist),
+                                   struct lock, lockelem);
+      if (l->donation > priority)
+        priority = l->donation;
     }
-  } else {
+  if (!list_empty (&t->donors))
+    {
+      struct donation *d = list_entry (list_front (&t->donors),
+                                       struct donation, elem);
+      if (d->priority > priority)
+        priority = d->priority;
+    }
+  return priority;
+}
+
+static inline void
+thread_assign_priority(int new_priority, struct thread *cur)
+{
+  cur->priority = new_priority;
+  if (!thread_mlfqs)
     cur->priority_orig = new_priority;
-    /* yield if no longer max priority in the ready list */
-    t = list_entry (list_max (&ready_list, priority_less, NULL),
-                    struct thread, elem);
-    if (cur->priority < t->priority)
-      thread_yield ();
-  }
+
+  /* yield if no longer max priority in the ready queues */
+  if (cur->priority < ready_queue_max_priority ())
+    thread_yield ();
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
@@ -564,16 +1024,67 @@ void
 thread_set_priority (int new_priority)
 {
   struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  if (thread_mlfqs)
+  if (thread_mlfqs || thread_fair)
     return;
 
-  /* check we aren't being donated priority through a lock */
-  if (cur->num_lock_donors &&
-      new_priority <= cur->priority)
-    cur->priority_orig = new_priority;
-  else
-    thread_assign_priority(new_priority, cur);
+  /* donations through held locks still apply on top */
+  old_level = intr_disable ();
+  cur->priority_orig = new_priority;
+  cur->priority = thread_donated_priority (cur);
+  if (cur->priority < ready_queue_max_priority ())
+    thread_yield ();
+  intr_set_level (old_level);
+}
+
+/* Returns the share of the CPU taken by a budget of BUDGET ticks
+   every PERIOD ticks, in thousandths, rounded up. */
+static int
+edf_util (int64_t period, int64_t budget)
+{
+  return (budget * 1000 + period - 1) / period;
+}
+
+/* Moves the current thread into the earliest-deadline-first
+   class, to run for BUDGET timer ticks out of every PERIOD, or
+   back to its priority class if PERIOD is 0.  EDF threads run
+   ahead of all others, the one whose period ends first running
+   first, and a thread that uses up its budget does not run
+   again until its period is over.  Returns false, changing
+   nothing, if the parameters are invalid or adding the thread
+   would leave the EDF class unable to meet its deadlines. */
+bool
+thread_set_edf (int64_t period, int64_t budget)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int util = 0;
+
+  if (period < 0 || (period > 0 && (budget <= 0 || budget > period)))
+    return false;
+  if (period > 0)
+    util = edf_util (period, budget);
+
+  old_level = intr_disable ();
+  if (rt_util_total - cur->rt_util + util > RT_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  rt_util_total += util - cur->rt_util;
+  cur->rt_util = util;
+  cur->rt_period = period;
+  cur->rt_budget = budget;
+  cur->rt_deadline = timer_ticks () + period;
+  cur->rt_left = budget;
+
+  /* Leaving the class may let other threads in, and an earlier
+     deadline may be waiting. */
+  if (period == 0 || rt_preempts (cur))
+    thread_yield ();
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Returns the current thread's priority. */
@@ -597,7 +1108,9 @@ thread_set_nice (int nice)
     old_level = intr_disable ();
     thread_assign_priority (recalculate_priority (cur), cur);
     intr_set_level (old_level);
-  }
+  } else if (thread_fair)
+    /* the new weight applies from the next tick */
+    cur->nice = nice;
 }
 
 /* Returns the current thread's nice value. */
@@ -611,12 +1124,8 @@ thread_get_nice (void)
 int
 thread_get_load_avg (void)
 {
-  int32_t lah;                   /* load average hundred times */
-  enum intr_level old_level;
-
-  old_level = intr_disable ();
-  lah = convert_int_near(mul_fp_int(load_avg, 100));
-  intr_set_level (old_level);
+  /* load_avg is a single word, so reading it cannot tear. */
+  int32_t lah = convert_int_near(mul_fp_int(load_avg, 100));
 
   return lah;
 }
@@ -641,15 +1150,28 @@ static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
+  struct cpu *c = cpu_current ();
+
   idle_thread = thread_current ();
+  c->idle_thread = idle_thread;
   sema_up (idle_started);
 
   for (;;)
     {
-      /* Let someone else run. */
+      /* Let someone else run.  With SMP, work queued here from now
+         on sets NEED_RESCHED, so none can slip in unnoticed
+         between the scheduler finding nothing and the halt
+         below. */
       intr_disable ();
+#ifdef SMP
+      c->need_resched = false;
+#endif
       thread_block ();
 
+      /* Nothing is runnable, so no tick is needed before the
+         earliest sleeper is due. */
+      timer_idle_enter (timer_next_deadline ());
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -664,10 +1186,51 @@ idle (void *idle_started_ UNUSED)
          7.11.1 "HLT Instruction". */
         /* printf ("Idle started.\n"); */
 
+      /* MWAIT likewise wakes for an interrupt taken just after
+         `sti', and also when another CPU writes NEED_RESCHED once
+         the monitor is armed.  Without it, cpu_kick() sends an IPI
+         if IDLE is set, which must be visible before we look at
+         NEED_RESCHED for the last time. */
+#ifdef SMP
+      c->idle = true;
+      __sync_synchronize ();
+      if (use_mwait)
+        cpu_monitor (&c->need_resched);
+      if (!c->need_resched)
+        {
+          if (use_mwait)
+            asm volatile ("sti; mwait" : : "a" (0), "c" (0) : "memory");
+          else
+            asm volatile ("sti; hlt" : : : "memory");
+        }
+      c->idle = false;
+#else
       asm volatile ("sti; hlt" : : : "memory");
+#endif
     }
 }
 
+#ifdef SMP
+/* Tells C that there is work queued for it, waking it if it is
+   idle. */
+static void
+cpu_kick (struct cpu *c)
+{
+  c->need_resched = true;
+  __sync_synchronize ();
+  if (c->idle && !use_mwait)
+    lapic_send_ipi (c->apic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Reschedule interrupt handler.  The interrupted thread yields,
+   so that one queued for this CPU by another can run at once. */
+static void
+resched_interrupt (struct intr_frame *f UNUSED)
+{
+  intr_yield_on_return ();
+}
+#endif
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux)
@@ -723,12 +1286,18 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
 
   t->parent = (!is_main_thread(t)) ? thread_current() : t;
+  t->cpu = (!is_main_thread(t)) ? thread_current()->cpu : 0;
+  t->affinity = (!is_main_thread(t)) ? thread_current()->affinity : UINT32_MAX;
+  prng_init (&t->prng, random_ulong () ^ (uintptr_t) t);
 
   /* The initial thread starts with a nice value of zero.  Other threads start
      with a nice value inherited from their parent thread. */
-  if (!thread_mlfqs)
+  if (!thread_mlfqs) {
     t->priority_orig = t->priority = priority;
-  else {
+    if (thread_fair && !is_main_thread(t))
+      t->nice = thread_current()->nice;
+  } else {
+    t->decay_epoch = decay_epoch;
     if (!is_main_thread(t)) {
       t->nice = thread_current()->nice;
       t->recent_cpu = thread_current()->recent_cpu;
@@ -751,9 +1320,34 @@ init_thread (struct thread *t, const char *name, int priority)
   t->num_lock_donors = 0;
   list_init (&t->donlocklist);
   t->waitlock = NULL;
+  list_init (&t->donors);
+#ifdef USERPROG
+  t->exit_status = -1;
+  t->child = NULL;
+  list_init (&t->children);
+  t->fds = NULL;
+  t->fd_map = NULL;
+  t->fd_cnt = 0;
+  t->syscall_ring = NULL;
+  t->syscall_ring_size = 0;
+  t->held_cnt = 0;
+  t->aio = NULL;
+  t->leader = t;
+  list_init (&t->threads);
+  waitq_init (&t->exit_waitq);
+  t->heap_start = t->brk = NULL;
+  lock_init (&t->fd_lock);
+#endif
+#ifdef VM
+  lock_init (&t->vm_lock);
+#endif
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  if (!is_main_thread(t) && t->parent->group != NULL) {
+    t->group = t->parent->group;
+    refcount_get (&t->group->ref_cnt);
+  }
   intr_set_level (old_level);
 }
 
@@ -774,34 +1368,556 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Threads of a group throttled since they became ready are only
+   found here; pushing them again sets them aside on the group. */
 static struct thread *
 next_thread_to_run (void)
 {
-  struct list_elem *max;
-  int i;
+  struct thread *t;
 
-  if (!thread_mlfqs) {
-    /* find a way to always keep the threads sorted
-       by priority, with a binary tree */
-    if (list_empty (&ready_list))
+  while ((t = ready_queue_pop ()) != idle_thread
+         && t->group != NULL && t->group->throttled
+         && t->rt_period == 0)
+    ready_queue_push (t);
+  return t;
+}
+
+/* Removes and returns the ready thread that should run next, or
+   returns idle_thread if there is none. */
+static struct thread *
+ready_queue_pop (void)
+{
+  struct thread *t;
+  int priority = ready_queue_max_priority ();
+
+  if (!list_empty (&rt_ready))
+    {
+      t = list_entry (list_front (&rt_ready), struct thread, elem);
+      ready_queue_remove (t);
+      return t;
+    }
+
+  if (thread_fair)
+    {
+      if (rb_empty (&fair_tree))
+        return idle_thread;
+      t = rb_entry (rb_first (&fair_tree), struct thread, fair_elem);
+      ready_queue_remove (t);
+      return t;
+    }
+
+  /* all queues were empty */
+  if (priority < PRI_MIN)
+    {
+#ifdef SMP
+      t = runqueue_steal ();
+      return t != NULL ? t : idle_thread;
+#else
       return idle_thread;
-    else {
-      max = list_max (&ready_list, priority_less, NULL);
-      list_remove (max);
-      return list_entry (max, struct thread, elem);
+#endif
     }
-  } else {
-    for (i = PRI_MAX; i >= 0; i--) {
-      if (!list_empty(&ready_queues[i])) {
-        max = list_front(&ready_queues[i]);
-        list_remove(max);
-        return list_entry(max, struct thread, elem);
-      }
+
+  t = list_entry (list_front (&local_runqueue ()->queues[priority]),
+                  struct thread, elem);
+  ready_queue_remove (t);
+  return t;
+}
+
+/* Returns the run queue of the running CPU. */
+static struct runqueue *
+local_runqueue (void)
+{
+  return &runqueues[cpu_current ()->id];
+}
+
+/* Returns the CPUs that schedule threads, by bit: the bootstrap
+   processor, and any other that has its own idle thread. */
+static uint32_t
+sched_cpu_mask (void)
+{
+  uint32_t mask = 1;
+  size_t i;
+
+  for (i = 1; i < cpu_cnt; i++)
+    if (cpus[i].idle_thread != NULL)
+      mask |= 1u << i;
+  return mask;
+}
+
+#ifdef SMP
+/* Returns the longest run queue, other than the running CPU's,
+   of a CPU that runs threads, or a null pointer if all of them
+   are empty. */
+static struct runqueue *
+busiest_runqueue (void)
+{
+  struct runqueue *local = local_runqueue ();
+  struct runqueue *busiest = NULL;
+  size_t i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct runqueue *rq = &runqueues[i];
+      if (rq != local && cpus[i].started && rq->cnt > 0
+          && (busiest == NULL || rq->cnt > busiest->cnt))
+        busiest = rq;
+    }
+  return busiest;
+}
+
+/* Removes from RQ the first thread, in priority order, whose
+   affinity allows the running CPU, and makes that CPU its CPU.
+   Returns the thread, or a null pointer if there is none. */
+static struct thread *
+runqueue_migrate (struct runqueue *rq)
+{
+  int cpu = cpu_current ()->id;
+  int priority;
+
+  for (priority = runqueue_max_priority (rq); priority >= PRI_MIN;
+       priority--)
+    {
+      struct list *queue = &rq->queues[priority];
+      struct list_elem *e;
+
+      for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          if (t->affinity & (1u << cpu))
+            {
+              ready_queue_remove (t);
+              t->cpu = cpu;
+              return t;
+            }
+        }
+    }
+  return NULL;
+}
+
+/* Called by a CPU with nothing left to run: takes a thread from
+   the busiest other run queue and returns it, or returns a null
+   pointer if that queue has no thread that may run here. */
+static struct thread *
+runqueue_steal (void)
+{
+  struct runqueue *busiest = busiest_runqueue ();
+
+  return busiest != NULL ? runqueue_migrate (busiest) : NULL;
+}
+
+/* Moves a thread from the busiest other run queue to the running
+   CPU's, if the busiest one has more than one thread more. */
+static void
+runqueue_balance (void)
+{
+  struct runqueue *busiest = busiest_runqueue ();
+  struct thread *t;
+
+  if (busiest != NULL && busiest->cnt > local_runqueue ()->cnt + 1
+      && (t = runqueue_migrate (busiest)) != NULL)
+    ready_queue_push (t);
+}
+#endif
+
+/* Timer function that ends the throttling of the thread group
+   in TIMER's aux at the end of its period, putting its threads
+   back on the ready queues. */
+static void
+group_replenish (struct timer *timer)
+{
+  struct thread_group *g = timer->aux;
+  bool yield = false;
+
+  g->throttled = false;
+  g->used = 0;
+  g->period_end += g->period;
+  while (!list_empty (&g->threads))
+    {
+      struct thread *t = list_entry (list_front (&g->threads),
+                                     struct thread, elem);
+      ready_queue_remove (t);
+      ready_queue_push (t);
+      if (wakeup_preempts (t, thread_current ()))
+        yield = true;
+    }
+  if (yield)
+    intr_yield_on_return ();
+}
+
+/* Drops a reference to G, which may be null, on behalf of the
+   running thread, which leaves it, and frees G if that was the
+   last one. */
+static void
+group_release (struct thread_group *g)
+{
+  enum intr_level old_level;
+  bool last;
+
+  if (g == NULL)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->group = NULL;
+  last = refcount_put (&g->ref_cnt);
+  if (last)
+    timer_cancel (&g->timer);
+  intr_set_level (old_level);
+
+  if (last)
+    free (g);
+}
+
+/* Puts the running thread in a new thread group whose members,
+   this thread and any children it creates from now on, may
+   together run for QUOTA timer ticks out of every PERIOD.  If
+   QUOTA is 0, the thread instead leaves its group and runs
+   unrestricted.  Returns false, leaving the thread's group as it
+   was, if the parameters are invalid or memory is short. */
+bool
+thread_set_quota (int64_t quota, int64_t period)
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = NULL;
+  enum intr_level old_level;
+
+  if (quota < 0 || (quota > 0 && (period <= 0 || quota > period)))
+    return false;
+
+  if (quota > 0)
+    {
+      g = malloc (sizeof *g);
+      if (g == NULL)
+        return false;
+      refcount_init (&g->ref_cnt, 1);
+      g->quota = quota;
+      g->period = period;
+      g->used = 0;
+      g->period_end = timer_ticks () + period;
+      g->throttled = false;
+      list_init (&g->threads);
+    }
+
+  group_release (cur->group);
+  old_level = intr_disable ();
+  cur->group = g;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Restricts the running thread to the CPUs whose bits are set in
+   MASK, bit N standing for cpus[N].  CPUs that do not schedule
+   threads are ignored, so the thread runs on those in MASK that
+   do, moving now if it is on one that MASK leaves out.  Returns
+   false, leaving the affinity as it was, if there are none. */
+bool
+thread_set_affinity (uint32_t mask)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool move;
+
+  old_level = intr_disable ();
+  if ((mask & sched_cpu_mask ()) == 0)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  cur->affinity = mask;
+  move = !(mask & (1u << cur->cpu));
+  intr_set_level (old_level);
+
+  if (move)
+    thread_yield ();
+  return true;
+}
+
+/* Returns the CPUs on which the running thread may run, by bit,
+   as for thread_set_affinity(). */
+uint32_t
+thread_get_affinity (void)
+{
+  return thread_current ()->affinity & sched_cpu_mask ();
+}
+
+/* Returns 32 pseudo-random bits from the running thread's own
+   generator, which is fast and needs no locking but must not be
+   used where unpredictability matters; random_bytes() remains
+   for that.  Not for use in interrupt handlers, which would
+   share the interrupted thread's state. */
+uint32_t
+thread_random (void)
+{
+  ASSERT (!intr_context ());
+  return prng_next (&thread_current ()->prng);
+}
+
+/* Returns true if thread A's deadline is earlier than B's. */
+static bool
+deadline_less (const struct list_elem *a, const struct list_elem *b,
+               void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->rt_deadline
+          < list_entry (b, struct thread, elem)->rt_deadline);
+}
+
+/* Timer function that ends the throttling of the EDF thread in
+   TIMER's aux once its period is over. */
+static void
+rt_replenish (struct timer *timer)
+{
+  struct thread *t = timer->aux;
+
+  ASSERT (t->status == THREAD_READY && t->rt_left <= 0);
+
+  list_remove (&t->elem);
+  ready_cnt--;
+  ready_queue_push (t);
+  if (rt_preempts (thread_current ()))
+    intr_yield_on_return ();
+}
+
+/* Returns true if an EDF thread is ready that should run instead
+   of CUR: any, if CUR is not an EDF thread, otherwise one with an
+   earlier deadline. */
+static bool
+rt_preempts (struct thread *cur)
+{
+  struct thread *t;
+
+  if (list_empty (&rt_ready))
+    return false;
+  t = list_entry (list_front (&rt_ready), struct thread, elem);
+  return cur->rt_period == 0 || t->rt_deadline < cur->rt_deadline;
+}
+
+/* Returns true if thread A has a smaller vruntime than B. */
+static bool
+fair_less (const struct rb_elem *a, const struct rb_elem *b,
+           void *aux UNUSED)
+{
+  return (rb_entry (a, struct thread, fair_elem)->vruntime
+          < rb_entry (b, struct thread, fair_elem)->vruntime);
+}
+
+/* Advances min_vruntime to the smallest vruntime among CUR, the
+   running thread, and the ready threads. */
+static void
+fair_update_min (struct thread *cur)
+{
+  int64_t v = INT64_MAX;
+
+  if (cur != idle_thread && cur->rt_period == 0)
+    v = cur->vruntime;
+  if (!rb_empty (&fair_tree))
+    {
+      struct thread *t = rb_entry (rb_first (&fair_tree),
+                                   struct thread, fair_elem);
+      if (t->vruntime < v)
+        v = t->vruntime;
+    }
+  if (v != INT64_MAX && v > min_vruntime)
+    min_vruntime = v;
+}
+
+/* Returns true if T, which has just become ready, should run
+   instead of CUR, the running thread. */
+static bool
+preempts (struct thread *t, struct thread *cur)
+{
+  if (rt_preempts (cur))
+    return true;
+  if (t->rt_period != 0 || cur->rt_period != 0)
+    return false;
+  if (thread_fair)
+    return (cur == idle_thread
+            || t->vruntime + FAIR_WAKEUP_GRAN < cur->vruntime);
+  return t->priority > cur->priority;
+}
+
+/* Like preempts(), but for T woken from an interrupt handler,
+   where a thread may wait a little for the CPU under the
+   priority scheduler (see WAKEUP_PRI_GRAN). */
+static bool
+wakeup_preempts (struct thread *t, struct thread *cur)
+{
+  if (!preempts (t, cur))
+    return false;
+  if (cur == idle_thread || thread_fair || thread_mlfqs
+      || t->rt_period != 0 || cur->rt_period != 0)
+    return true;
+  return (t->priority >= cur->priority + WAKEUP_PRI_GRAN
+          || thread_ticks >= WAKEUP_MIN_RUN);
+}
+
+/* Returns the number of ticks T runs before yielding to a ready
+   thread of equal standing.  Under the priority scheduler, a
+   thread above PRI_DEFAULT, likely interactive, gets a shorter
+   slice, down to TIME_SLICE_MIN at PRI_MAX, for lower latency;
+   one below it, likely batch work, gets a longer one, up to
+   TIME_SLICE_MAX at PRI_MIN, for fewer switches.  MLFQS, whose
+   priorities move with CPU use, the EDF class and the fair
+   scheduler use TIME_SLICE. */
+static unsigned
+time_slice (struct thread *t)
+{
+  if (thread_fair || thread_mlfqs || t->rt_period != 0)
+    return TIME_SLICE;
+  if (t->priority >= PRI_DEFAULT)
+    return TIME_SLICE - ((TIME_SLICE - TIME_SLICE_MIN)
+                         * (t->priority - PRI_DEFAULT)
+                         / (PRI_MAX - PRI_DEFAULT));
+  return TIME_SLICE + ((TIME_SLICE_MAX - TIME_SLICE)
+                       * (PRI_DEFAULT - t->priority)
+                       / (PRI_DEFAULT - PRI_MIN));
+}
+
+/* Appends T to the back of the ready queue for its priority, on
+   the run queue of the CPU it last ran on, or of the first CPU
+   its affinity allows if that one is not allowed, or inserts it
+   in the fair tree under the fair scheduler.  An EDF thread instead
+   starts a new period if its last one is over, and goes into
+   rt_ready by deadline, or onto rt_throttled until its period
+   ends if its budget is spent.  Any other thread of a throttled
+   group waits on the group. */
+static void
+ready_queue_push (struct thread *t)
+{
+  struct runqueue *rq;
+
+  ready_cnt++;
+  if (t->rt_period == 0 && t->group != NULL && t->group->throttled)
+    {
+      list_push_back (&t->group->threads, &t->elem);
+      t->group_throttled = true;
+      return;
+    }
+  if (t->rt_period != 0)
+    {
+      int64_t now = timer_ticks ();
+
+      if (now >= t->rt_deadline)
+        {
+          t->rt_deadline = now + t->rt_period;
+          t->rt_left = t->rt_budget;
+        }
+      if (t->rt_left > 0)
+        list_insert_ordered (&rt_ready, &t->elem, deadline_less, NULL);
+      else
+        {
+          list_push_back (&rt_throttled, &t->elem);
+          timer_add (&t->timer, t->rt_deadline, rt_replenish, t);
+        }
+      return;
+    }
+  if (thread_fair)
+    {
+      rb_insert (&fair_tree, &t->fair_elem);
+      return;
+    }
+
+  if (!(t->affinity & (1u << t->cpu)))
+    t->cpu = __builtin_ctz (t->affinity & sched_cpu_mask ());
+  rq = &runqueues[t->cpu];
+  list_push_back (&rq->queues[t->priority], &t->elem);
+  rq->mask |= (uint64_t) 1 << t->priority;
+  rq->cnt++;
+#ifdef SMP
+  if (t->cpu != cpu_current ()->id)
+    cpu_kick (&cpus[t->cpu]);
+#endif
+}
+
+/* Removes T from the ready queue for its priority, which must be
+   the queue T was pushed on, or from the EDF lists, the fair
+   tree or its throttled group. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct runqueue *rq;
+
+  ready_cnt--;
+  if (t->group_throttled)
+    {
+      list_remove (&t->elem);
+      t->group_throttled = false;
+      return;
+    }
+  if (t->rt_period != 0)
+    {
+      list_remove (&t->elem);
+      if (t->rt_left <= 0)
+        timer_cancel (&t->timer);
+      return;
+    }
+  if (thread_fair)
+    {
+      rb_remove (&fair_tree, &t->fair_elem);
+      return;
+    }
+  rq = &runqueues[t->cpu];
+  list_remove (&t->elem);
+  if (list_empty (&rq->queues[t->priority]))
+    rq->mask &= ~((uint64_t) 1 << t->priority);
+  rq->cnt--;
+}
+
+/* Returns the highest priority with a ready thread on the
+   running CPU's run queue, or PRI_MIN - 1 if it is empty. */
+static int
+ready_queue_max_priority (void)
+{
+  return runqueue_max_priority (local_runqueue ());
+}
+
+/* Returns the highest priority with a ready thread in RQ, or
+   PRI_MIN - 1 if RQ is empty. */
+static int
+runqueue_max_priority (const struct runqueue *rq)
+{
+  uint32_t hi = rq->mask >> 32;
+  uint32_t lo = rq->mask;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return PRI_MIN - 1;
+}
+
+/* Adds a wakeup latency of NS nanoseconds for T to the
+   histograms. */
+static void
+record_latency (struct thread *t, uint64_t ns)
+{
+  int row = t->rt_period != 0 ? LAT_ROW_EDF : t->priority;
+
+  if (t == idle_thread)
+    return;
+  histogram_add (&lat_hist[row], ns);
+  if (ns > lat_max[row])
+    lat_max[row] = ns;
+}
+
+/* Prints the nonempty rows of the wakeup latency histograms. */
+static void
+print_latency (void)
+{
+  int row;
+
+  for (row = 0; row < LAT_ROWS; row++)
+    {
+      if (lat_max[row] == 0)
+        continue;
+      if (row == LAT_ROW_EDF)
+        printf ("Wakeup latency, deadline class:");
+      else
+        printf ("Wakeup latency, priority %d:", row);
+      histogram_print (&lat_hist[row]);
+      printf (", max %"PRIu64"us\n", lat_max[row] / 1000);
     }
-    /* all queues were empty */
-    return idle_thread;
-  }
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -829,17 +1945,25 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  fpu_activate (cur);
 
   /* Start new time slice. */
   thread_ticks = 0;
 
+  if (cur->wake_ns != 0)
+    {
+      record_latency (cur, timer_ns () - cur->wake_ns);
+      cur->wake_ns = 0;
+    }
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
   /* restore original priority */
-  if ((cur->num_lock_donors == 0) && !thread_mlfqs)
+  if (cur->num_lock_donors == 0 && list_empty (&cur->donors)
+      && !thread_mlfqs)
     cur->priority = cur->priority_orig;
 
   /* If the thread we switched from is dying, destroy its struct
@@ -850,7 +1974,10 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (thread_page_cnt < THREAD_PAGE_CACHE)
+        thread_pages[thread_page_cnt++] = prev;
+      else
+        palloc_free_page (prev);
     }
 }
 
@@ -872,8 +1999,30 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Leaving the idle thread: bring back the periodic tick. */
+  if (cur == idle_thread)
+    timer_idle_exit ();
+
+  /* No RCU reader survives a trip through here (see rcu.c). */
+  cpu_current ()->rcu_qs_cnt++;
+
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      int64_t now = timer_ticks ();
+
+      /* A thread that gives up the CPU still ready was preempted
+         or yielded. */
+      if (cur->status == THREAD_READY)
+        cur->stats.involuntary_cnt++;
+      else if (cur->status == THREAD_BLOCKED)
+        cur->stats.voluntary_cnt++;
+      cur->stats_since = now;
+      next->stats.ready_ticks += now - next->stats_since;
+      pmu_switch (cur->stats.pmu);
+
+      trace (TRACE_SWITCH, cur->tid, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
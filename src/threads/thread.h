@@ -3,7 +3,18 @@
 
 #include <debug.h>
 #include <list.h>
+#include <random.h>
+#include <rbtree.h>
+#ifdef VM
+#include <faultstat.h>
+#include <hash.h>
+#endif
 #include <stdint.h>
+#include <threadstat.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/waitq.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -20,6 +31,9 @@ enum thread_status
 typedef int tid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
 
+struct thread_group;
+struct sysstat;
+
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
@@ -91,13 +105,87 @@ struct thread
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
     struct list_elem allelem;           /* List element for all threads list. */
+    int cpu;                            /* CPU last run on, in cpus[]. */
+    uint32_t affinity;                  /* CPUs it may run on, by bit. */
+    struct prng prng;                   /* State for thread_random(). */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by threads/fpu.c. */
+    uint8_t *fpu;                       /* Saved FPU state, or null. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_status;                    /* Status passed to exit(). */
+    struct child *child;                /* Status shared with parent. */
+    struct list children;               /* Unreaped children's status. */
+
+    /* A process is its main thread, the leader, plus any threads
+       it creates, which share the leader's page directory, page
+       table and file descriptors.  Fields from here to fd_lock
+       are only used in the leader, except for stack_slot. */
+    struct thread *leader;              /* Main thread; itself if main. */
+    size_t stack_slot;                  /* User stack slot, if not main. */
+    bool thread_exited;                 /* Left by thread_exit()? */
+    bool exiting;                       /* Process exiting? */
+    struct list threads;                /* Other threads' status. */
+    int thread_cnt;                     /* Other threads not yet gone. */
+    bool threads_wait;                  /* Waiting for THREAD_CNT == 0? */
+    struct waitq exit_waitq;            /* Woken once EXITING is set. */
+    uint8_t *heap_start;                /* Start of heap, past the data. */
+    uint8_t *brk;                       /* Program break, end of heap. */
+    uint32_t stack_slots;               /* Stack slots in use. */
+
+    /* Owned by userprog/fdtable.c; used in the leader. */
+    struct file **fds;                  /* Open files, by descriptor. */
+    struct bitmap *fd_map;              /* Descriptors in use. */
+    size_t fd_cnt;                      /* Size of FDS and FD_MAP. */
+    struct lock fd_lock;                /* Protects the fields above. */
+
+    /* Owned by userprog/syscall.c. */
+    struct syscall_ring *syscall_ring;  /* Registered ring, user address. */
+    uint32_t syscall_ring_size;         /* Entries in SYSCALL_RING. */
+    struct file *held_files[2];         /* Files the system call uses. */
+    size_t held_cnt;                    /* Number in HELD_FILES. */
+
+    /* Owned by userprog/aio.c; used in the leader. */
+    struct aio_context *aio;            /* Asynchronous I/O, or null. */
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, or null. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+
+    /* Owned by filesys/cache.c. */
+    unsigned cache_dirtied;             /* Sectors dirtied, not yet paid. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c and userprog/process.c.  Only the
+       leader's pages, exec_file, mappings, shm_maps, huge_maps,
+       next_mapid, vm_lock, faults and resident set are used. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, backs code pages. */
+    struct list mappings;               /* Memory-mapped files. */
+    struct list shm_maps;               /* Shared memory mappings. */
+    struct list huge_maps;              /* 4 MB pages. */
+    int next_mapid;                     /* Identifier for next mapping. */
+    struct lock vm_lock;                /* Serializes the threads' faults. */
+    void *user_esp;                     /* User esp at kernel entry. */
+    void *next_fault;                   /* Page after last file fault. */
+    unsigned fault_window;              /* Pages to fault around. */
+    struct faultstat faults;            /* Page fault accounting. */
+
+    /* Resident set, owned by vm/frame.c, under its frame_lock. */
+    size_t resident_cnt;                /* Pages attached to frames. */
+    size_t resident_limit;              /* Most before local eviction. */
+    size_t clock_hand;                  /* Next frame for local eviction. */
+
+    /* Owned by vm/checkpoint.c; used in the leader. */
+    struct checkpoint *checkpoint;      /* Checkpoint chain, or null. */
 #endif
 
     /* priority and locking */
@@ -106,13 +194,40 @@ struct thread
 
     int nice;
     int recent_cpu;
+    unsigned decay_epoch;               /* Last MLFQS decay applied. */
+
+    /* fair scheduler */
+    int64_t vruntime;                   /* Weighted ticks, scaled. */
+    struct rb_elem fair_elem;           /* Element in the fair tree. */
 
     uint32_t num_lock_donors;		/* Number of locks with ongoing priority donation */
     struct list donlocklist;		/* list of priority-donating locks */
     struct lock *waitlock;		/* lock a thread is waiting for */
+    struct list donors;                 /* Owned objects lending priority. */
+
+    /* earliest-deadline-first class, if rt_period is nonzero */
+    int64_t rt_period;                  /* Period, in timer ticks. */
+    int64_t rt_budget;                  /* Ticks to run per period. */
+    int64_t rt_deadline;                /* End of the current period. */
+    int64_t rt_left;                    /* Budget left this period. */
+    int rt_util;                        /* Budget / period, in 1/1000. */
+
+    /* CPU quota shared with other threads */
+    struct thread_group *group;         /* Group, or null. */
+    bool group_throttled;               /* Waiting on GROUP's list? */
+
+    /* wakes a sleeping thread at its deadline */
+    struct timer timer;                 /* Sleep or wait timeout. */
+    bool timed_wait;                    /* In thread_block_timeout()? */
+
+    /* CPU accounting */
+    struct threadstat stats;            /* Counters. */
+    int64_t stats_since;                /* Became ready or blocked. */
+    uint64_t wake_ns;                   /* Unblocked, or 0 if running. */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine magazines[MAGAZINE_DESC_CNT]; /* Cached free blocks. */
 
-    /* timer counter for sleping */
-    int64_t ticks_wait;
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -122,6 +237,14 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the proportional-share fair scheduler instead.
+   Controlled by kernel command-line option "-fair". */
+extern bool thread_fair;
+
+/* Timer ticks per time slice, at PRI_DEFAULT.
+   Controlled by the "time_slice" tunable. */
+extern unsigned thread_time_slice;
+
 extern int load_avg;
 
 void thread_init (void);
@@ -129,11 +252,14 @@ void thread_start (void);
 
 void thread_tick (int64_t ticks);
 void thread_print_stats (void);
+bool thread_get_stats (tid_t, struct threadstat *);
+void thread_get_sched_stats (struct sysstat *);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+bool thread_block_timeout (int64_t ticks);
 void thread_unblock (struct thread *);
 
 void thread_wait (int64_t ticks);
@@ -151,6 +277,13 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_reprioritize (struct thread *, int priority);
+int thread_donated_priority (struct thread *);
+bool thread_set_edf (int64_t period, int64_t budget);
+bool thread_set_quota (int64_t quota, int64_t period);
+bool thread_set_affinity (uint32_t mask);
+uint32_t thread_get_affinity (void);
+uint32_t thread_random (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
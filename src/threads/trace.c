@@ -0,0 +1,206 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "devices/block.h"
+#endif
+
+/* The ring holds the last RECORD_CNT events; older ones are
+   overwritten.  There is only one CPU, so a writer claims and
+   fills its slot with interrupts off and needs no lock, and the
+   record's CPU field is always 0.
+
+   trace_dump() prints the records, oldest first, to the console,
+   or if "-tracedev=BDEV" was given writes them raw to block
+   device BDEV: a struct dump_header in sector 0, then the
+   records packed back to back from sector 1. */
+
+size_t trace_page_cnt;
+struct trace_record *trace_buf;
+
+static size_t record_cnt;       /* Slots in TRACE_BUF. */
+static uint64_t next_record;    /* Records ever logged. */
+
+#ifdef FILESYS
+static const char *bdev_name;   /* Where to dump, or null. */
+
+/* Sector 0 of a dump to a block device. */
+struct dump_header
+  {
+    char magic[8];              /* "PINTRACE". */
+    uint32_t record_size;       /* sizeof (struct trace_record). */
+    uint32_t record_cnt;        /* Records that follow. */
+    uint64_t lost_cnt;          /* Older records overwritten. */
+  };
+#endif
+
+static const char *event_names[TRACE_EVENT_CNT] =
+  {
+    [TRACE_SWITCH] = "switch",
+    [TRACE_INTR] = "intr",
+    [TRACE_LOCK_ACQUIRE] = "lock-acquire",
+    [TRACE_LOCK_RELEASE] = "lock-release",
+    [TRACE_BLOCK_SUBMIT] = "block",
+    [TRACE_PAGE_FAULT] = "page-fault",
+  };
+
+/* Allocates the buffer if "-trace" asked for one.  Must be
+   called after palloc_init(). */
+void
+trace_init (void)
+{
+  struct trace_record *buf;
+
+  if (trace_page_cnt == 0)
+    return;
+  buf = palloc_get_multiple (0, trace_page_cnt);
+  if (buf == NULL)
+    {
+      printf ("trace: no memory for %zu-page buffer\n", trace_page_cnt);
+      return;
+    }
+  record_cnt = trace_page_cnt * PGSIZE / sizeof *buf;
+  trace_buf = buf;
+}
+
+#ifdef FILESYS
+/* Makes trace_dump() write to block device NAME. */
+void
+trace_set_bdev (const char *name)
+{
+  bdev_name = name;
+}
+#endif
+
+/* Appends a record of EVENT with arguments A and B.  Use
+   trace() instead, which skips the call if tracing is off. */
+void
+trace_log (enum trace_event event, uint32_t a, uint32_t b)
+{
+  struct trace_record *r;
+  struct thread *t;
+  enum intr_level old_level;
+  uint32_t *esp;
+
+  /* The running thread, found from the stack pointer as
+     running_thread() in thread.c does, since thread_current()
+     refuses a thread in the middle of a switch. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  t = pg_round_down (esp);
+
+  old_level = intr_disable ();
+  r = &trace_buf[next_record++ % record_cnt];
+  r->ns = timer_ns ();
+  r->tid = t->tid;
+  r->event = event;
+  r->cpu = 0;
+  r->reserved = 0;
+  r->a = a;
+  r->b = b;
+  intr_set_level (old_level);
+}
+
+#ifdef FILESYS
+/* Writes the CNT records of BUF starting at FIRST to BLOCK.
+   Returns false if BLOCK is too small. */
+static bool
+dump_to_block (struct block *block, const struct trace_record *buf,
+               size_t first, size_t cnt, uint64_t lost_cnt)
+{
+  static uint8_t sector[BLOCK_SECTOR_SIZE];
+  struct dump_header *h = (struct dump_header *) sector;
+  block_sector_t s = 1;
+  size_t sofs = 0;
+  size_t i;
+
+  if (DIV_ROUND_UP (cnt * sizeof *buf, BLOCK_SECTOR_SIZE) + 1
+      > block_size (block))
+    return false;
+
+  memset (sector, 0, sizeof sector);
+  memcpy (h->magic, "PINTRACE", sizeof h->magic);
+  h->record_size = sizeof *buf;
+  h->record_cnt = cnt;
+  h->lost_cnt = lost_cnt;
+  block_write (block, 0, sector);
+
+  /* Pack the records, which may straddle sectors. */
+  for (i = 0; i < cnt; i++)
+    {
+      const uint8_t *r = (const uint8_t *) &buf[(first + i) % record_cnt];
+      size_t done = 0;
+
+      while (done < sizeof *buf)
+        {
+          size_t chunk = sizeof *buf - done;
+          if (chunk > BLOCK_SECTOR_SIZE - sofs)
+            chunk = BLOCK_SECTOR_SIZE - sofs;
+          memcpy (sector + sofs, r + done, chunk);
+          sofs += chunk;
+          done += chunk;
+          if (sofs == BLOCK_SECTOR_SIZE)
+            {
+              block_write (block, s++, sector);
+              sofs = 0;
+            }
+        }
+    }
+  if (sofs > 0)
+    {
+      memset (sector + sofs, 0, BLOCK_SECTOR_SIZE - sofs);
+      block_write (block, s, sector);
+    }
+  return true;
+}
+#endif
+
+/* Turns tracing off and dumps the records, oldest first. */
+void
+trace_dump (void)
+{
+  struct trace_record *buf = trace_buf;
+  size_t cnt, first, i;
+  uint64_t lost_cnt;
+
+  if (buf == NULL)
+    return;
+
+  /* The dump's own locking and I/O would trace themselves. */
+  trace_buf = NULL;
+  cnt = next_record < record_cnt ? next_record : record_cnt;
+  first = next_record < record_cnt ? 0 : next_record % record_cnt;
+  lost_cnt = next_record - cnt;
+
+#ifdef FILESYS
+  /* Block I/O needs to sleep, which a panic cannot. */
+  if (bdev_name != NULL && intr_get_level () == INTR_ON
+      && !intr_context ())
+    {
+      struct block *block = block_get_by_name (bdev_name);
+
+      if (block != NULL && dump_to_block (block, buf, first, cnt, lost_cnt))
+        {
+          printf ("trace: %zu records written to %s\n", cnt, bdev_name);
+          return;
+        }
+      printf ("trace: cannot write to %s\n", bdev_name);
+    }
+#endif
+
+  printf ("trace: %zu records, %"PRIu64" older ones lost\n",
+          cnt, lost_cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      const struct trace_record *r = &buf[(first + i) % record_cnt];
+      printf ("trace: %"PRIu64" %d %s %#"PRIx32" %#"PRIx32"\n",
+              r->ns, r->tid, event_names[r->event], r->a, r->b);
+    }
+}
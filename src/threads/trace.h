@@ -0,0 +1,64 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel event tracing.
+
+   Tracepoints throughout the kernel append fixed-size binary
+   records to a ring buffer in memory, which is dumped at
+   shutdown for analysis offline.  Recording takes a handful of
+   instructions and never prints or sleeps, so it barely moves
+   the timing it is meant to show.  Tracing is off unless the
+   "-trace" option is given, and then a tracepoint costs one test
+   and branch. */
+
+/* Events. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Thread switch: from tid, to tid. */
+    TRACE_INTR,                 /* Interrupt: vector, eip. */
+    TRACE_LOCK_ACQUIRE,         /* Lock acquired: lock, 1 if it waited. */
+    TRACE_LOCK_RELEASE,         /* Lock released: lock, 0. */
+    TRACE_BLOCK_SUBMIT,         /* Block request: sector, sector count,
+                                   with TRACE_BLOCK_WRITE for a write. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, error code. */
+    TRACE_EVENT_CNT
+  };
+
+#define TRACE_BLOCK_WRITE 0x80000000u
+
+/* A trace record. */
+struct trace_record
+  {
+    uint64_t ns;                /* timer_ns() at the event. */
+    int32_t tid;                /* Running thread. */
+    uint16_t event;             /* A TRACE_* event. */
+    uint8_t cpu;                /* CPU, always 0. */
+    uint8_t reserved;
+    uint32_t a, b;              /* Arguments, depending on EVENT. */
+  };
+
+/* Size of the buffer in pages, from "-trace", or 0 for none. */
+extern size_t trace_page_cnt;
+
+/* Buffer, or a null pointer if tracing is off. */
+extern struct trace_record *trace_buf;
+
+void trace_init (void);
+void trace_log (enum trace_event, uint32_t a, uint32_t b);
+void trace_dump (void);
+#ifdef FILESYS
+void trace_set_bdev (const char *name);
+#endif
+
+/* Records EVENT with arguments A and B, if tracing is on. */
+static inline void
+trace (enum trace_event event, uint32_t a, uint32_t b)
+{
+  if (trace_buf != NULL)
+    trace_log (event, a, b);
+}
+
+#endif /* threads/trace.h */
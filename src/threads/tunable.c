@@ -0,0 +1,124 @@
+#include "threads/tunable.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/thread.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
+
+/* Tunables.
+
+   Performance parameters that would otherwise be compile-time
+   constants, each a variable of the module that uses it, reached
+   here by name: from the kernel command line, with
+   "-tune=NAME:VALUE", or while running, with the tune() system
+   call.  A new value must lie within the tunable's bounds.  Some
+   size tables when their module starts up, and so may only be
+   set on the command line.
+
+   Each value is a single word, read by its module without
+   locking, so a change takes effect the next time it is read. */
+
+/* A tunable. */
+struct tunable
+  {
+    const char *name;           /* Name, as used to set it. */
+    unsigned *value;            /* The variable. */
+    unsigned min, max;          /* Bounds on the value, inclusive. */
+    bool boot_only;             /* Only settable at boot? */
+    const char *desc;           /* Description, for -h. */
+  };
+
+static const struct tunable tunables[] =
+  {
+    {"time_slice", &thread_time_slice, 1, 100, false,
+     "Timer ticks per time slice"},
+#ifdef FILESYS
+    {"readahead_max", &file_ra_max, 2, 64, false,
+     "Most sectors read ahead of a sequential reader"},
+    {"dirty_limit", &cache_dirty_limit, 1, 64, false,
+     "Most dirty cached sectors before writers are slowed"},
+#endif
+#ifdef VM
+    {"stack_pages", &stack_page_limit, 1, 65536, true,
+     "Most pages a user stack may grow to"},
+    {"low_water", &frame_low_water, 1, 65536, false,
+     "Reclaim user memory when under this many pages are free"},
+    {"high_water", &frame_high_water, 1, 65536, false,
+     "Stop reclaiming once this many pages are free"},
+    {"rss_limit", &frame_rss_limit, 0, 1048576, false,
+     "Most resident pages per process, 0 for no limit"},
+    {"merge_rate", &frame_merge_rate, 0, 65536, false,
+     "Frames scanned per 100 ms for same-page merging, 0 for off"},
+    {"zswap_pages", &swap_pool_limit, 0, 4096, true,
+     "Pages of compressed swap kept in memory"},
+#endif
+  };
+
+#define TUNABLE_CNT (sizeof tunables / sizeof *tunables)
+
+/* Returns the tunable named NAME, or a null pointer if there is
+   none. */
+static const struct tunable *
+lookup (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < TUNABLE_CNT; i++)
+    if (!strcmp (tunables[i].name, name))
+      return &tunables[i];
+  return NULL;
+}
+
+/* Stores the value of tunable NAME in *VALUE and returns true,
+   or returns false if there is no such tunable. */
+bool
+tunable_get (const char *name, unsigned *value)
+{
+  const struct tunable *t = lookup (name);
+
+  if (t == NULL)
+    return false;
+  *value = *t->value;
+  return true;
+}
+
+/* Sets tunable NAME to VALUE.  BOOTING must be true only while
+   the kernel command line is parsed.  Returns false, changing
+   nothing, if there is no such tunable, if VALUE is out of its
+   bounds, or if it is settable only at boot and BOOTING is
+   false. */
+bool
+tunable_set (const char *name, unsigned value, bool booting)
+{
+  const struct tunable *t = lookup (name);
+
+  if (t == NULL || value < t->min || value > t->max
+      || (t->boot_only && !booting))
+    return false;
+  *t->value = value;
+  return true;
+}
+
+/* Prints the tunables, their bounds and their current values. */
+void
+tunable_print (void)
+{
+  size_t i;
+
+  printf ("\nTunables:\n");
+  for (i = 0; i < TUNABLE_CNT; i++)
+    {
+      const struct tunable *t = &tunables[i];
+
+      printf ("  %-18s %s%s (%u to %u, now %u).\n",
+              t->name, t->desc, t->boot_only ? ", at boot only" : "",
+              t->min, t->max, *t->value);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef THREADS_TUNABLE_H
+#define THREADS_TUNABLE_H
+
+#include <stdbool.h>
+
+/* Performance parameters settable by name.  See tunable.c. */
+
+bool tunable_get (const char *name, unsigned *value);
+bool tunable_set (const char *name, unsigned value, bool booting);
+void tunable_print (void);
+
+#endif /* threads/tunable.h */
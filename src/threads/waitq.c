@@ -0,0 +1,68 @@
+#include "threads/waitq.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Wait queues.
+
+   A semaphore or condition variable lets a thread wait on one
+   object.  A thread that waits on several at once, as poll()
+   does, instead adds an entry to the wait queue of each, all
+   pointing to a single semaphore of its own, and sleeps on that.
+   Whichever object becomes ready first ups the semaphore.  The
+   waiter adds its entries before it checks whether any object is
+   already ready, so a wakeup that comes in between is not lost:
+   it leaves the semaphore up.
+
+   Queues are protected by disabling interrupts, so that
+   waitq_wake() may be called from interrupt handlers. */
+
+/* Initializes Q as an empty wait queue. */
+void
+waitq_init (struct waitq *q)
+{
+  list_init (&q->entries);
+}
+
+/* Adds E to Q, so that waitq_wake(Q) ups WAKE until E is
+   removed. */
+void
+waitq_add (struct waitq *q, struct waitq_entry *e, struct semaphore *wake)
+{
+  enum intr_level old_level;
+
+  e->q = q;
+  e->wake = wake;
+  old_level = intr_disable ();
+  list_push_back (&q->entries, &e->elem);
+  intr_set_level (old_level);
+}
+
+/* Removes E from its queue, if it was added to one. */
+void
+waitq_remove (struct waitq_entry *e)
+{
+  enum intr_level old_level;
+
+  if (e->q == NULL)
+    return;
+  old_level = intr_disable ();
+  list_remove (&e->elem);
+  intr_set_level (old_level);
+  e->q = NULL;
+}
+
+/* Wakes every thread waiting on Q.  May be called from an
+   interrupt handler. */
+void
+waitq_wake (struct waitq *q)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&q->entries); e != list_end (&q->entries);
+       e = list_next (e))
+    sema_up (list_entry (e, struct waitq_entry, elem)->wake);
+  intr_set_level (old_level);
+}
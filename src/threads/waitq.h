@@ -0,0 +1,29 @@
+#ifndef THREADS_WAITQ_H
+#define THREADS_WAITQ_H
+
+#include <list.h>
+
+struct semaphore;
+
+/* A wait queue, kept by an object that poll() can wait on, such
+   as a pipe or the console input buffer.  The object calls
+   waitq_wake() whenever it may have become ready. */
+struct waitq
+  {
+    struct list entries;        /* List of struct waitq_entry. */
+  };
+
+/* One waiting thread's place in a wait queue. */
+struct waitq_entry
+  {
+    struct list_elem elem;      /* Element in the queue's ENTRIES. */
+    struct waitq *q;            /* Queue, or null if not added. */
+    struct semaphore *wake;     /* Upped by waitq_wake(). */
+  };
+
+void waitq_init (struct waitq *);
+void waitq_add (struct waitq *, struct waitq_entry *, struct semaphore *);
+void waitq_remove (struct waitq_entry *);
+void waitq_wake (struct waitq *);
+
+#endif /* threads/waitq.h */
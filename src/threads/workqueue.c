@@ -0,0 +1,208 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Kernel work queue.
+
+   Deferred kernel tasks are queued as struct work and run, in
+   order of priority and first come first served within a
+   priority, by a pool of worker threads, so that a subsystem
+   that needs something done in the background does not need a
+   thread of its own.  A worker runs each task at the task's
+   priority.
+
+   The pool starts with WORKERS_MIN workers.  Queuing a task
+   when no worker is free adds one, up to WORKERS_MAX, and a
+   worker that has found nothing to do for WORKER_IDLE_TICKS
+   exits, down to WORKERS_MIN.  New workers can only be created
+   outside interrupt context; a task queued from an interrupt
+   handler waits for a worker to become free.
+
+   The queue and counters are protected by disabling interrupts,
+   so that work_queue() may be called from interrupt handlers.
+   PENDING counts the tasks in the queue. */
+
+#define WORKERS_MIN 1                   /* Workers always kept. */
+#define WORKERS_MAX 8                   /* Most workers at once. */
+#define WORKER_IDLE_TICKS (2 * TIMER_FREQ) /* Idle time before exit. */
+
+static struct heap queue;               /* Tasks, highest priority first. */
+static unsigned next_seq;               /* Next work's seq. */
+static struct semaphore pending;        /* Number of tasks in QUEUE. */
+static size_t queued_cnt;               /* Number of tasks in QUEUE. */
+static size_t worker_cnt;               /* Number of workers. */
+static size_t busy_cnt;                 /* Workers running a task. */
+
+static thread_func worker NO_RETURN;
+static void add_worker (void);
+static heap_less_func runs_first;
+
+/* Initializes the work queue and starts its first workers.  Must
+   be called after thread_start(). */
+void
+workqueue_init (void)
+{
+  size_t i;
+
+  heap_init (&queue, runs_first, NULL);
+  sema_init (&pending, 0);
+  queued_cnt = worker_cnt = busy_cnt = 0;
+  next_seq = 0;
+  for (i = 0; i < WORKERS_MIN; i++)
+    add_worker ();
+}
+
+/* Initializes W to run FUNC with AUX at PRIORITY when queued. */
+void
+work_init (struct work *w, work_func *func, void *aux, int priority)
+{
+  ASSERT (func != NULL);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  w->func = func;
+  w->aux = aux;
+  w->priority = priority;
+  w->queued = false;
+  w->allocated = false;
+}
+
+
+/* Returns true if work A should run before work B: it has higher
+   priority, or the same and was queued earlier. */
+static bool
+runs_first (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct work *a = heap_entry (a_, struct work, elem);
+  const struct work *b = heap_entry (b_, struct work, elem);
+
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return (int) (a->seq - b->seq) < 0;
+}
+
+/* Queues W to be run by a worker.  Returns false, doing nothing,
+   if W is already queued and has not started running yet.  W must
+   not be reinitialized until it has run.  May be called from an
+   interrupt handler. */
+bool
+work_queue (struct work *w)
+{
+  enum intr_level old_level;
+  bool grow;
+
+  old_level = intr_disable ();
+  if (w->queued)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w->queued = true;
+  w->seq = next_seq++;
+  heap_insert (&queue, &w->elem);
+  queued_cnt++;
+  grow = (queued_cnt > worker_cnt - busy_cnt && worker_cnt < WORKERS_MAX
+          && !intr_context ());
+  if (grow)
+    worker_cnt++;
+  intr_set_level (old_level);
+
+  sema_up (&pending);
+  if (grow)
+    add_worker ();
+  return true;
+}
+
+/* Runs FUNC with AUX at default priority in a worker.  Returns
+   true if successful, false if memory is exhausted.  Must not be
+   called from an interrupt handler. */
+bool
+work_submit (work_func *func, void *aux)
+{
+  struct work *w;
+
+  ASSERT (!intr_context ());
+
+  w = malloc (sizeof *w);
+  if (w == NULL)
+    return false;
+  work_init (w, func, aux, PRI_DEFAULT);
+  w->allocated = true;
+  work_queue (w);
+  return true;
+}
+
+/* Starts a worker thread, which has already been counted in
+   worker_cnt. */
+static void
+add_worker (void)
+{
+  char name[16];
+  static unsigned next_id;
+
+  snprintf (name, sizeof name, "worker-%u", next_id++);
+  if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+    {
+      enum intr_level old_level = intr_disable ();
+      worker_cnt--;
+      intr_set_level (old_level);
+    }
+}
+
+/* Worker thread: runs queued tasks until it has been idle long
+   enough to exit. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+      work_func *func;
+      void *func_aux;
+      int priority;
+      bool allocated;
+
+      if (!sema_down_timeout (&pending, WORKER_IDLE_TICKS))
+        {
+          old_level = intr_disable ();
+          if (worker_cnt > WORKERS_MIN)
+            {
+              worker_cnt--;
+              intr_set_level (old_level);
+              thread_exit ();
+            }
+          intr_set_level (old_level);
+          continue;
+        }
+
+      /* Take the highest-priority task.  Once it is dequeued its
+         owner may queue it again, even while it runs, so copy out
+         what we need. */
+      old_level = intr_disable ();
+      w = heap_entry (heap_pop_min (&queue), struct work, elem);
+      w->queued = false;
+      queued_cnt--;
+      busy_cnt++;
+      func = w->func;
+      func_aux = w->aux;
+      priority = w->priority;
+      allocated = w->allocated;
+      intr_set_level (old_level);
+
+      if (allocated)
+        free (w);
+      thread_set_priority (priority);
+      func (func_aux);
+
+      old_level = intr_disable ();
+      busy_cnt--;
+      intr_set_level (old_level);
+      thread_set_priority (PRI_DEFAULT);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <heap.h>
+#include <stdbool.h>
+
+/* A function run by a kernel worker thread, given auxiliary data
+   AUX. */
+typedef void work_func (void *aux);
+
+/* A deferred task.  Owned by its user, who may embed it in some
+   larger object, so that queuing it never allocates. */
+struct work
+  {
+    struct heap_elem elem;      /* Element in the work queue. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* For FUNC's use. */
+    int priority;               /* Priority to run FUNC at. */
+    unsigned seq;               /* Order queued, for ties in priority. */
+    bool queued;                /* In the queue, waiting to run? */
+    bool allocated;             /* Freed once run? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux, int priority);
+bool work_queue (struct work *);
+bool work_submit (work_func *, void *aux);
+
+#endif /* threads/workqueue.h */
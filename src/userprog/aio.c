@@ -0,0 +1,271 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/waitq.h"
+#include "threads/workqueue.h"
+#include "userprog/uaccess.h"
+
+/* Asynchronous file I/O.
+
+   aio_submit() copies a request, and for a write its data, into
+   the kernel and queues it to the kernel work queue, so that the
+   calling thread goes on running while a worker carries it out
+   through the buffer cache, which passes misses on to the block
+   device's request queue.  With several requests queued, several
+   workers wait on the disk at once.
+
+   Workers cannot reach user memory, so a read lands in a kernel
+   buffer and is copied out to the user's buffer only when the
+   request is reaped, by aio_reap() in the process's own context.
+   Reaping removes finished requests from the process's
+   completion queue, oldest first.
+
+   Each process's requests hang off a struct aio_context in its
+   leader, created by its first request.  At exit, aio_exit()
+   waits for the requests still running and frees the rest. */
+
+/* A process's asynchronous I/O state. */
+struct aio_context
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition finished;  /* Signaled when a request finishes. */
+    struct waitq pollers;       /* Woken when a request finishes. */
+    struct list done;           /* Finished requests, oldest first. */
+    unsigned cnt;               /* Requests not yet reaped. */
+    unsigned running;           /* Requests not yet finished. */
+    int next_id;                /* Identifier for the next request. */
+  };
+
+/* An asynchronous read or write. */
+struct aio_request
+  {
+    struct list_elem elem;      /* Element in context's done list. */
+    struct work work;           /* Carries out the transfer. */
+    struct aio_context *ctx;    /* Owning process's context. */
+    int id;                     /* Identifier given to the process. */
+    bool write;                 /* Write, not read? */
+    struct file *file;          /* Own handle on the file. */
+    void *ubuf;                 /* User buffer. */
+    void *kbuf;                 /* Kernel buffer, of PAGE_CNT pages. */
+    size_t page_cnt;            /* Pages in KBUF. */
+    size_t size;                /* Bytes to transfer. */
+    off_t ofs;                  /* Position in FILE. */
+    int result;                 /* Bytes transferred. */
+  };
+
+/* Returns the current process's context, creating it if necessary,
+   or a null pointer if memory is short.  The leader's fd_lock
+   keeps two threads from both creating it. */
+static struct aio_context *
+get_context (void)
+{
+  struct thread *t = thread_current ()->leader;
+  struct aio_context *ctx;
+
+  lock_acquire (&t->fd_lock);
+  ctx = t->aio;
+  if (ctx == NULL)
+    {
+      ctx = t->aio = malloc (sizeof *ctx);
+      if (ctx != NULL)
+        {
+          lock_init (&ctx->lock);
+          cond_init (&ctx->finished);
+          waitq_init (&ctx->pollers);
+          list_init (&ctx->done);
+          ctx->cnt = ctx->running = 0;
+          ctx->next_id = 0;
+        }
+    }
+  lock_release (&t->fd_lock);
+  return ctx;
+}
+
+/* Frees request R. */
+static void
+free_request (struct aio_request *r)
+{
+  file_close (r->file);
+  palloc_free_multiple (r->kbuf, r->page_cnt);
+  free (r);
+}
+
+/* Work function: carries out request R_ and moves it to its
+   context's completion queue. */
+static void
+run_request (void *r_)
+{
+  struct aio_request *r = r_;
+  struct aio_context *ctx = r->ctx;
+
+  r->result = (r->write
+               ? file_write_at (r->file, r->kbuf, r->size, r->ofs)
+               : file_read_at (r->file, r->kbuf, r->size, r->ofs));
+
+  lock_acquire (&ctx->lock);
+  list_push_back (&ctx->done, &r->elem);
+  ctx->running--;
+  cond_broadcast (&ctx->finished, &ctx->lock);
+  waitq_wake (&ctx->pollers);
+  lock_release (&ctx->lock);
+}
+
+/* Starts reading SIZE bytes at OFS in FILE into user buffer UBUF,
+   or writing them from UBUF, according to WRITE.  Returns the
+   request's identifier, which aio_reap() reports when it is
+   done, or -1 if SIZE is more than AIO_SIZE_MAX, the process has
+   AIO_MAX requests unreaped, or memory is short, or AIO_FAULT if
+   UBUF is bad.  FILE must be a regular file; the request has its
+   own handle on it, so FILE may be closed meanwhile. */
+int
+aio_submit (struct file *file, bool write, void *ubuf, size_t size,
+            off_t ofs)
+{
+  struct aio_context *ctx = get_context ();
+  struct aio_request *r;
+  bool ok;
+
+  if (ctx == NULL || size > AIO_SIZE_MAX || ofs < 0)
+    return -1;
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return -1;
+  r->page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  r->kbuf = r->page_cnt > 0 ? palloc_get_multiple (0, r->page_cnt) : NULL;
+  r->file = file_reopen (file);
+  if ((r->kbuf == NULL && r->page_cnt > 0) || r->file == NULL)
+    {
+      free_request (r);
+      return -1;
+    }
+  if (write && !copy_from_user (r->kbuf, ubuf, size))
+    {
+      free_request (r);
+      return AIO_FAULT;
+    }
+  r->ctx = ctx;
+  r->write = write;
+  r->ubuf = ubuf;
+  r->size = size;
+  r->ofs = ofs;
+  work_init (&r->work, run_request, r, thread_get_priority ());
+
+  lock_acquire (&ctx->lock);
+  ok = ctx->cnt < AIO_MAX;
+  if (ok)
+    {
+      ctx->cnt++;
+      ctx->running++;
+      r->id = ctx->next_id++;
+      if (ctx->next_id < 0)
+        ctx->next_id = 0;
+    }
+  lock_release (&ctx->lock);
+  if (!ok)
+    {
+      free_request (r);
+      return -1;
+    }
+  work_queue (&r->work);
+  return r->id;
+}
+
+/* Waits until at least one of the current process's requests has
+   finished, unless it has none outstanding, then reaps up to CNT
+   finished requests, oldest first: copies the data of each read
+   to its user buffer and stores its identifier and result in
+   UEVENTS[], an array of CNT elements in user memory.  Returns
+   the number of requests reaped, or AIO_FAULT if user memory is
+   bad. */
+int
+aio_reap (struct aio_event *uevents, size_t cnt)
+{
+  struct aio_context *ctx = thread_current ()->leader->aio;
+  size_t reaped = 0;
+
+  if (ctx == NULL || cnt == 0)
+    return 0;
+
+  lock_acquire (&ctx->lock);
+  while (list_empty (&ctx->done) && ctx->running > 0)
+    cond_wait (&ctx->finished, &ctx->lock);
+  while (reaped < cnt && !list_empty (&ctx->done))
+    {
+      struct aio_request *r = list_entry (list_pop_front (&ctx->done),
+                                          struct aio_request, elem);
+      struct aio_event e;
+      bool ok;
+
+      ctx->cnt--;
+      lock_release (&ctx->lock);
+
+      e.id = r->id;
+      e.result = r->result;
+      ok = ((r->write || copy_to_user (r->ubuf, r->kbuf, r->result))
+            && copy_to_user (&uevents[reaped], &e, sizeof e));
+      free_request (r);
+      if (!ok)
+        return AIO_FAULT;
+      reaped++;
+
+      lock_acquire (&ctx->lock);
+    }
+  lock_release (&ctx->lock);
+  return reaped;
+}
+
+/* Returns true if the current process has a finished request
+   waiting to be reaped. */
+bool
+aio_ready (void)
+{
+  struct aio_context *ctx = thread_current ()->leader->aio;
+  bool ready;
+
+  if (ctx == NULL)
+    return false;
+  lock_acquire (&ctx->lock);
+  ready = !list_empty (&ctx->done);
+  lock_release (&ctx->lock);
+  return ready;
+}
+
+/* Returns the wait queue woken whenever one of the current
+   process's requests finishes, or a null pointer if memory is
+   short. */
+struct waitq *
+aio_waitq (void)
+{
+  struct aio_context *ctx = get_context ();
+
+  return ctx != NULL ? &ctx->pollers : NULL;
+}
+
+/* Waits for all of the current process's requests to finish and
+   frees them along with its context.  Called at process exit. */
+void
+aio_exit (void)
+{
+  struct thread *t = thread_current ()->leader;
+  struct aio_context *ctx = t->aio;
+
+  if (ctx == NULL)
+    return;
+
+  lock_acquire (&ctx->lock);
+  while (ctx->running > 0)
+    cond_wait (&ctx->finished, &ctx->lock);
+  lock_release (&ctx->lock);
+  while (!list_empty (&ctx->done))
+    free_request (list_entry (list_pop_front (&ctx->done),
+                              struct aio_request, elem));
+  t->aio = NULL;
+  free (ctx);
+}
@@ -0,0 +1,22 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <aio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct waitq;
+
+/* Returned by aio_submit() and aio_reap() if user memory is bad. */
+#define AIO_FAULT (-2)
+
+int aio_submit (struct file *, bool write, void *ubuf, size_t size,
+                off_t ofs);
+int aio_reap (struct aio_event *uevents, size_t cnt);
+bool aio_ready (void);
+struct waitq *aio_waitq (void);
+void aio_exit (void);
+
+#endif /* userprog/aio.h */
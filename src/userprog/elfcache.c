@@ -0,0 +1,173 @@
+#include "userprog/elfcache.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* ELF metadata cache.
+
+   Remembers the entry point and loadable segments of recently
+   executed programs, keyed by inode, so that running the same
+   program again can skip reading and validating its ELF and
+   program headers.
+
+   Each entry keeps its inode open, so that the inode stays in
+   memory and inode_write_cnt() tells whether the file has been
+   written since the entry was made; if so, the entry is stale
+   and is dropped on lookup.  Entries for removed files are
+   dropped on any lookup, so that their sectors can be released.
+   At most ELF_CACHE_SIZE entries are kept, the least recently
+   used being dropped first.
+
+   elf_cache_lock protects the list.  Inodes are closed only
+   after it is released. */
+
+#define ELF_CACHE_SIZE 16               /* Number of cached programs. */
+
+/* A cached program. */
+struct elf_entry
+  {
+    struct list_elem elem;              /* Element in elf_cache. */
+    struct inode *inode;                /* Executable, held open. */
+    unsigned write_cnt;                 /* inode_write_cnt() when cached. */
+    struct elf_image image;             /* Validated metadata. */
+  };
+
+static struct list elf_cache;           /* Most recently used first. */
+static size_t elf_cache_cnt;            /* Number of entries. */
+static struct lock elf_cache_lock;
+
+/* Initializes the ELF metadata cache. */
+void
+elf_cache_init (void)
+{
+  list_init (&elf_cache);
+  elf_cache_cnt = 0;
+  lock_init_named (&elf_cache_lock, "elf-cache");
+}
+
+/* Copies SRC into *DST, allocating a new segment array.  Returns
+   false if memory is exhausted. */
+static bool
+copy_image (struct elf_image *dst, const struct elf_image *src)
+{
+  *dst = *src;
+  if (src->seg_cnt == 0)
+    {
+      dst->segs = NULL;
+      return true;
+    }
+  dst->segs = malloc (src->seg_cnt * sizeof *src->segs);
+  if (dst->segs == NULL)
+    return false;
+  memcpy (dst->segs, src->segs, src->seg_cnt * sizeof *src->segs);
+  return true;
+}
+
+/* Unlinks entry E from the cache and moves it to DEAD.
+   elf_cache_lock must be held. */
+static void
+drop (struct elf_entry *e, struct list *dead)
+{
+  list_remove (&e->elem);
+  elf_cache_cnt--;
+  list_push_back (dead, &e->elem);
+}
+
+/* Frees the entries in DEAD.  elf_cache_lock must not be held. */
+static void
+free_dead (struct list *dead)
+{
+  while (!list_empty (dead))
+    {
+      struct elf_entry *e = list_entry (list_pop_front (dead),
+                                        struct elf_entry, elem);
+      inode_close (e->inode);
+      free (e->image.segs);
+      free (e);
+    }
+}
+
+/* Looks up INODE in the cache.  If it is there and has not been
+   written since, stores a copy of its metadata in *IMAGE, which
+   the caller must free with free(IMAGE->segs), and returns true.
+   Otherwise returns false. */
+bool
+elf_cache_lookup (struct inode *inode, struct elf_image *image)
+{
+  struct list dead;
+  struct list_elem *el, *next;
+  bool found = false;
+
+  list_init (&dead);
+  lock_acquire (&elf_cache_lock);
+  for (el = list_begin (&elf_cache); el != list_end (&elf_cache); el = next)
+    {
+      struct elf_entry *e = list_entry (el, struct elf_entry, elem);
+
+      next = list_next (el);
+      if (inode_is_removed (e->inode))
+        drop (e, &dead);
+      else if (e->inode == inode)
+        {
+          if (e->write_cnt != inode_write_cnt (inode))
+            drop (e, &dead);
+          else if (copy_image (image, &e->image))
+            {
+              list_remove (&e->elem);
+              list_push_front (&elf_cache, &e->elem);
+              found = true;
+            }
+        }
+    }
+  lock_release (&elf_cache_lock);
+  free_dead (&dead);
+
+  return found;
+}
+
+/* Adds IMAGE, the validated metadata of INODE, to the cache.
+   WRITE_CNT must be inode_write_cnt(INODE) from before IMAGE was
+   read from INODE, so that a write that raced with reading it
+   makes the entry stale.  Nothing happens if memory is
+   exhausted. */
+void
+elf_cache_insert (struct inode *inode, unsigned write_cnt,
+                  const struct elf_image *image)
+{
+  struct list dead;
+  struct elf_entry *e;
+  struct list_elem *el;
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    return;
+  if (!copy_image (&e->image, image))
+    {
+      free (e);
+      return;
+    }
+  e->inode = inode_reopen (inode);
+  e->write_cnt = write_cnt;
+
+  list_init (&dead);
+  lock_acquire (&elf_cache_lock);
+
+  /* Replace any older entry for the same inode. */
+  for (el = list_begin (&elf_cache); el != list_end (&elf_cache);
+       el = list_next (el))
+    if (list_entry (el, struct elf_entry, elem)->inode == inode)
+      {
+        drop (list_entry (el, struct elf_entry, elem), &dead);
+        break;
+      }
+
+  list_push_front (&elf_cache, &e->elem);
+  if (++elf_cache_cnt > ELF_CACHE_SIZE)
+    drop (list_entry (list_back (&elf_cache), struct elf_entry, elem),
+          &dead);
+  lock_release (&elf_cache_lock);
+  free_dead (&dead);
+}
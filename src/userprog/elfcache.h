@@ -0,0 +1,33 @@
+#ifndef USERPROG_ELFCACHE_H
+#define USERPROG_ELFCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct inode;
+
+/* A loadable segment of an executable, already validated. */
+struct elf_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in the file. */
+    uint32_t mem_page;          /* Page-aligned user address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after those. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* What load() needs to know about a validated executable. */
+struct elf_image
+  {
+    uint32_t entry;             /* Entry point. */
+    size_t seg_cnt;             /* Number of loadable segments. */
+    struct elf_segment *segs;   /* Array of SEG_CNT segments, malloc'd. */
+  };
+
+void elf_cache_init (void);
+bool elf_cache_lookup (struct inode *, struct elf_image *);
+void elf_cache_insert (struct inode *, unsigned write_cnt,
+                       const struct elf_image *);
+
+#endif /* userprog/elfcache.h */
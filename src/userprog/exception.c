@@ -2,8 +2,15 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include <faultstat.h>
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -45,8 +52,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -65,6 +70,17 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+#ifdef VM
+  {
+    struct faultstat fs;
+
+    page_get_fault_stats (&fs);
+    printf ("Exception: %"PRIu32" minor, %"PRIu32" file, %"PRIu32" swap, "
+            "%"PRIu32" copy-on-write and %"PRIu32" stack faults, "
+            "%"PRIu32" evictions\n", fs.minor_cnt, fs.file_cnt,
+            fs.swap_cnt, fs.cow_cnt, fs.stack_cnt, fs.evict_cnt);
+  }
+#endif
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -135,6 +151,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  trace (TRACE_PAGE_FAULT, (uintptr_t) fault_addr, f->error_code);
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
@@ -148,9 +165,46 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+  /* A kernel page table added to init_page_dir after the running
+     page directory was created. */
+  if (not_present && pagedir_sync_kernel (fault_addr))
+    return;
+
+#ifdef VM
+  if (is_user_vaddr (fault_addr))
+    {
+      struct thread *t = thread_current ();
+      bool handled;
+
+      /* A page that is part of the process but not yet in memory,
+         or a stack access just below the stack.  If the kernel
+         faulted, the user stack pointer is the one saved at
+         system call entry.  Or a write to a page shared
+         copy-on-write.  The process's threads take their faults
+         one at a time. */
+      lock_acquire (&t->leader->vm_lock);
+      if (not_present)
+        handled = (page_fault_in (fault_addr, write)
+                   || page_grow_stack (fault_addr,
+                                       user ? f->esp : t->user_esp));
+      else
+        handled = write && page_cow_break (fault_addr);
+      lock_release (&t->leader->vm_lock);
+      if (handled)
+        return;
+    }
+#endif
+
+  /* A bad user address passed to the kernel, caught by one of the
+     functions in userprog/uaccess.c.  Resume where it says to, in
+     eax, and let it know the access failed. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
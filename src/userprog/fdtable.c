@@ -0,0 +1,234 @@
+#include "userprog/fdtable.h"
+#include <bitmap.h>
+#include <limits.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* File descriptor table.
+
+   Each process has an array of open files indexed directly by
+   file descriptor, so lookup is O(1), and a bitmap of the
+   descriptors in use, so that the lowest free descriptor can be
+   found with bitmap_scan().  Descriptors 0 and 1 belong to the
+   console and are never free.  The table is created by the first
+   open and doubles in size whenever it fills up.  Free entries
+   in the array are null.
+
+   fd_dup2() can redirect descriptor 0 or 1 to a file or pipe,
+   which then takes the console's place in reads and writes
+   until it is closed, and a new process starts with its
+   parent's redirections (see process_execute()).
+
+   The table belongs to the process's leader thread and is
+   shared by all of the process's threads, under the leader's
+   fd_lock. */
+
+#define FD_INIT_CNT 16          /* Initial table size. */
+
+/* Replaces T's table by one twice the size.  The table must be
+   full and T's fd_lock held.  Returns true if successful. */
+static bool
+grow (struct thread *t)
+{
+  size_t new_cnt = t->fd_cnt == 0 ? FD_INIT_CNT : 2 * t->fd_cnt;
+  struct bitmap *map;
+  struct file **fds;
+  size_t i;
+
+  if (new_cnt > INT_MAX)
+    return false;
+  map = bitmap_create (new_cnt);
+  if (map == NULL)
+    return false;
+  fds = realloc (t->fds, new_cnt * sizeof *fds);
+  if (fds == NULL)
+    {
+      bitmap_destroy (map);
+      return false;
+    }
+  for (i = t->fd_cnt; i < new_cnt; i++)
+    fds[i] = NULL;
+
+  if (t->fd_cnt == 0)
+    {
+      bitmap_mark (map, STDIN_FILENO);
+      bitmap_mark (map, STDOUT_FILENO);
+    }
+  else
+    bitmap_set_multiple (map, 0, t->fd_cnt, true);
+  bitmap_destroy (t->fd_map);
+
+  t->fds = fds;
+  t->fd_map = map;
+  t->fd_cnt = new_cnt;
+  return true;
+}
+
+/* Gives FILE the current process's lowest free file descriptor
+   and returns it.  On failure closes FILE and returns -1. */
+int
+fd_open (struct file *file)
+{
+  struct thread *t = thread_current ()->leader;
+  size_t fd;
+
+  lock_acquire (&t->fd_lock);
+  fd = (t->fd_map != NULL
+        ? bitmap_scan_and_flip (t->fd_map, 0, 1, false) : BITMAP_ERROR);
+  if (fd == BITMAP_ERROR)
+    {
+      if (!grow (t))
+        {
+          lock_release (&t->fd_lock);
+          file_close (file);
+          return -1;
+        }
+      fd = bitmap_scan_and_flip (t->fd_map, 0, 1, false);
+    }
+  t->fds[fd] = file;
+  lock_release (&t->fd_lock);
+  return fd;
+}
+
+/* Installs FILE as descriptor FD in the current process,
+   returning true if successful.  Fails if FD is already open, or
+   if it does not fit in the table, which 0 and 1 always do.  On
+   failure closes FILE. */
+bool
+fd_install (int fd, struct file *file)
+{
+  struct thread *t = thread_current ()->leader;
+
+  lock_acquire (&t->fd_lock);
+  if (fd < 0 || ((size_t) fd >= t->fd_cnt
+                 && (fd > STDOUT_FILENO || t->fd_cnt != 0 || !grow (t)))
+      || t->fds[fd] != NULL)
+    {
+      lock_release (&t->fd_lock);
+      file_close (file);
+      return false;
+    }
+  t->fds[fd] = file;
+  bitmap_mark (t->fd_map, fd);
+  lock_release (&t->fd_lock);
+  return true;
+}
+
+/* Makes NEW_FD in the current process refer to a new opening of
+   whatever OLD_FD does, closing NEW_FD first if it is open, and
+   returns NEW_FD.  NEW_FD must fit in the table, as for
+   fd_install(), and so may be 0 or 1 to redirect the console.
+   Returns -1 if OLD_FD is not open to a file, if NEW_FD is out
+   of range, or if memory is short.  The new opening of a file
+   has a position of its own. */
+int
+fd_dup2 (int old_fd, int new_fd)
+{
+  struct thread *t = thread_current ()->leader;
+  struct file *file, *copy;
+
+  file = fd_lookup (old_fd);
+  if (file == NULL)
+    return -1;
+  copy = old_fd != new_fd ? file_reopen (file) : NULL;
+  file_close (file);
+  if (old_fd == new_fd)
+    return new_fd;
+  if (copy == NULL)
+    return -1;
+
+  /* Drop NEW_FD, keeping 0 and 1 reserved for the console. */
+  lock_acquire (&t->fd_lock);
+  file = new_fd >= 0 && (size_t) new_fd < t->fd_cnt ? t->fds[new_fd] : NULL;
+  if (file != NULL)
+    {
+      t->fds[new_fd] = NULL;
+      if (new_fd > STDOUT_FILENO)
+        bitmap_reset (t->fd_map, new_fd);
+    }
+  lock_release (&t->fd_lock);
+  file_close (file);
+
+  return fd_install (new_fd, copy) ? new_fd : -1;
+}
+
+/* Returns the file open as FD in the current process, or a null
+   pointer if FD is not open to a file.  The caller gets a
+   reference of its own, which it must drop with file_close(), so
+   the file stays usable even if another thread closes FD. */
+struct file *
+fd_lookup (int fd)
+{
+  struct thread *t = thread_current ()->leader;
+  struct file *file;
+
+  lock_acquire (&t->fd_lock);
+  file = fd >= 0 && (size_t) fd < t->fd_cnt ? t->fds[fd] : NULL;
+  if (file != NULL)
+    file_get (file);
+  lock_release (&t->fd_lock);
+  return file;
+}
+
+/* Returns true if FD is open to a file in the current process.
+   Another thread may close it as soon as this returns. */
+bool
+fd_is_open (int fd)
+{
+  struct thread *t = thread_current ()->leader;
+  bool open;
+
+  lock_acquire (&t->fd_lock);
+  open = fd >= 0 && (size_t) fd < t->fd_cnt && t->fds[fd] != NULL;
+  lock_release (&t->fd_lock);
+  return open;
+}
+
+/* Closes FD in the current process.  Returns false if FD is not
+   open to a file.  Closing a redirected descriptor 0 or 1 gives
+   it back to the console.  This drops only the descriptor's
+   reference: a system call still using the file keeps it open
+   until it is done. */
+bool
+fd_close (int fd)
+{
+  struct thread *t = thread_current ()->leader;
+  struct file *file;
+
+  lock_acquire (&t->fd_lock);
+  file = fd >= 0 && (size_t) fd < t->fd_cnt ? t->fds[fd] : NULL;
+  if (file != NULL)
+    {
+      t->fds[fd] = NULL;
+      if (fd > STDOUT_FILENO)
+        bitmap_reset (t->fd_map, fd);
+    }
+  lock_release (&t->fd_lock);
+
+  if (file == NULL)
+    return false;
+  file_close (file);
+  return true;
+}
+
+/* Closes all of the current process's files and frees its file
+   descriptor table.  Called by the leader once it is the only
+   thread left. */
+void
+fd_close_all (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->leader == t);
+  size_t i;
+
+  for (i = 0; i < t->fd_cnt; i++)
+    file_close (t->fds[i]);
+  free (t->fds);
+  bitmap_destroy (t->fd_map);
+  t->fds = NULL;
+  t->fd_map = NULL;
+  t->fd_cnt = 0;
+}
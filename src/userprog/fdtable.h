@@ -0,0 +1,16 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+
+struct file;
+
+int fd_open (struct file *);
+bool fd_install (int fd, struct file *);
+int fd_dup2 (int old_fd, int new_fd);
+struct file *fd_lookup (int fd);
+bool fd_is_open (int fd);
+bool fd_close (int fd);
+void fd_close_all (void);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,295 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "filesys/file.h"
+#include "vm/page.h"
+#endif
+
+/* Futexes.
+
+   A futex is a 32-bit word of user memory that processes wait on
+   and wake each other through, so that user-level locks only
+   enter the kernel when they are contended.  futex_wait() sleeps
+   only if the word still holds the value the caller last saw;
+   futex_wake() wakes waiters in the order they arrived.
+
+   A word is identified by what it is a word of, not by the frame
+   that happens to hold it, since eviction, copy-on-write and
+   page merging all move a page between frames while a thread
+   waits on it:
+
+   - A word in a shared memory segment, by the segment's frame
+     for its page, which belongs to the segment as long as it
+     exists, and the offset within it.
+
+   - A word in a memory-mapped file, by the file's inode and the
+     offset within the file.
+
+   - Any other word, which only the process can see, by the
+     process's leader and the user address.
+
+   So the same memory mapped into different processes names the
+   same futex, and equal private words in different processes do
+   not.  Each word with waiters has a struct futex in FUTEXES,
+   keyed so, created by its first waiter and freed when its last
+   one leaves.
+
+   futex_lock is held from reading the word through queuing the
+   waiter, and by futex_wake() while it dequeues, so a wake that
+   follows a change to the word cannot be lost.
+
+   When a process exits, futex_wake_process() wakes all of its
+   threads' waits so that they notice.  Futexes left without
+   waiters that way stay in FUTEXES until the next wait or wake
+   on them, because the table cannot change while it is walked. */
+
+/* Identifies a futex word. */
+struct futex_key
+  {
+    const void *space;          /* Segment frame, inode, or leader. */
+    uintptr_t ofs;              /* Offset or user address in SPACE. */
+  };
+
+/* A futex word with waiters. */
+struct futex
+  {
+    struct hash_elem elem;      /* Element in futexes. */
+    struct futex_key key;       /* Word's identity. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread waiting on a futex. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in futex's waiters. */
+    struct thread *thread;      /* Waiting thread. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+  };
+
+static struct hash futexes;
+static struct lock futex_lock;
+
+static hash_hash_func futex_hash;
+static hash_less_func futex_less;
+
+/* Initializes the futex table. */
+void
+futex_init (void)
+{
+  hash_init (&futexes, futex_hash, futex_less, NULL);
+  lock_init_named (&futex_lock, "futex");
+}
+
+/* Returns a hash value for futex E. */
+static unsigned
+futex_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex *f = hash_entry (e, struct futex, elem);
+  return hash_bytes (&f->key, sizeof f->key);
+}
+
+/* Returns true if futex A's key precedes futex B's. */
+static bool
+futex_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex *a = hash_entry (a_, struct futex, elem);
+  const struct futex *b = hash_entry (b_, struct futex, elem);
+
+  if (a->key.space != b->key.space)
+    return a->key.space < b->key.space;
+  return a->key.ofs < b->key.ofs;
+}
+
+/* Stores in *KEY the identity of the current process's word at
+   UADDR, which the caller has just read.  Returns false if UADDR
+   is not mapped. */
+static bool
+make_key (const uint32_t *uaddr, struct futex_key *key)
+{
+  struct thread *leader = thread_current ()->leader;
+#ifdef VM
+  struct page *p;
+  bool found;
+
+  lock_acquire (&leader->vm_lock);
+  p = page_lookup (uaddr);
+  found = p != NULL;
+  if (p != NULL && p->shared)
+    {
+      key->space = p->kpage;
+      key->ofs = pg_ofs (uaddr);
+    }
+  else if (p != NULL && p->mmapped)
+    {
+      key->space = file_get_inode (p->file);
+      key->ofs = p->ofs + pg_ofs (uaddr);
+    }
+  else
+    {
+      key->space = leader;
+      key->ofs = (uintptr_t) uaddr;
+    }
+  lock_release (&leader->vm_lock);
+  return found;
+#else
+  key->space = leader;
+  key->ofs = (uintptr_t) uaddr;
+  return true;
+#endif
+}
+
+/* Reads the word at UADDR into *VALUE and stores its key in
+   *KEY.  Returns false if the word is misaligned or not
+   accessible. */
+static bool
+read_word (const uint32_t *uaddr, uint32_t *value, struct futex_key *key)
+{
+  return ((uintptr_t) uaddr % sizeof *uaddr == 0
+          && copy_from_user (value, uaddr, sizeof *value)
+          && make_key (uaddr, key));
+}
+
+/* Returns the futex for KEY, or a null pointer if it has no
+   waiters.  futex_lock must be held. */
+static struct futex *
+lookup (const struct futex_key *key)
+{
+  struct futex f;
+  struct hash_elem *e;
+
+  f.key = *key;
+  e = hash_find (&futexes, &f.elem);
+  return e != NULL ? hash_entry (e, struct futex, elem) : NULL;
+}
+
+/* Sleeps until woken by futex_wake() if the word at UADDR holds
+   EXPECTED.  Returns FUTEX_AGAIN without sleeping if it does not,
+   and FUTEX_FAULT if UADDR is misaligned or not accessible. */
+enum futex_result
+futex_wait (const uint32_t *uaddr, uint32_t expected)
+{
+  struct futex_waiter w;
+  struct futex_key key;
+  struct futex *f;
+  uint32_t value;
+
+  lock_acquire (&futex_lock);
+  if (process_killed ())
+    {
+      lock_release (&futex_lock);
+      return FUTEX_AGAIN;
+    }
+  if (!read_word (uaddr, &value, &key))
+    {
+      lock_release (&futex_lock);
+      return FUTEX_FAULT;
+    }
+  if (value != expected)
+    {
+      lock_release (&futex_lock);
+      return FUTEX_AGAIN;
+    }
+
+  f = lookup (&key);
+  if (f == NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          /* Callers recheck their word after any return. */
+          lock_release (&futex_lock);
+          return FUTEX_AGAIN;
+        }
+      f->key = key;
+      list_init (&f->waiters);
+      hash_insert (&futexes, &f->elem);
+    }
+  w.thread = thread_current ();
+  sema_init (&w.sema, 0);
+  list_push_back (&f->waiters, &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.sema);
+  return FUTEX_WOKEN;
+}
+
+/* Wakes up to CNT threads waiting on the word at UADDR and
+   returns the number woken, or -1 if UADDR is misaligned or not
+   accessible. */
+int
+futex_wake (const uint32_t *uaddr, int cnt)
+{
+  struct futex_key key;
+  struct futex *f;
+  uint32_t value;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  if (!read_word (uaddr, &value, &key))
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+
+  f = lookup (&key);
+  if (f != NULL)
+    {
+      while (woken < cnt && !list_empty (&f->waiters))
+        {
+          struct futex_waiter *w = list_entry (list_pop_front (&f->waiters),
+                                               struct futex_waiter, elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+      if (list_empty (&f->waiters))
+        {
+          hash_delete (&futexes, &f->elem);
+          free (f);
+        }
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* The process whose threads futex_wake_process() wakes. */
+static struct thread *wake_leader;
+
+/* hash_action_func for futex_wake_process(). */
+static void
+wake_process (struct hash_elem *fe, void *aux UNUSED)
+{
+  struct futex *f = hash_entry (fe, struct futex, elem);
+  struct list_elem *e;
+
+  for (e = list_begin (&f->waiters); e != list_end (&f->waiters); )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      e = list_next (e);
+      if (w->thread->leader == wake_leader)
+        {
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+        }
+    }
+}
+
+/* Wakes every thread of the process whose main thread is LEADER
+   that waits on any futex. */
+void
+futex_wake_process (struct thread *leader)
+{
+  lock_acquire (&futex_lock);
+  wake_leader = leader;
+  hash_apply (&futexes, wake_process);
+  lock_release (&futex_lock);
+}
@@ -0,0 +1,22 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Results of futex_wait(). */
+enum futex_result
+  {
+    FUTEX_WOKEN,                /* Slept and was woken. */
+    FUTEX_AGAIN,                /* Word did not hold the expected value. */
+    FUTEX_FAULT                 /* Word is not accessible. */
+  };
+
+void futex_init (void);
+enum futex_result futex_wait (const uint32_t *uaddr, uint32_t expected);
+int futex_wake (const uint32_t *uaddr, int cnt);
+void futex_wake_process (struct thread *leader);
+
+#endif /* userprog/futex.h */
@@ -1,50 +1,326 @@
 #include "userprog/pagedir.h"
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
 
+/* Up to this many pages changed by one call are invalidated one
+   at a time; more than this, and the whole TLB is flushed. */
+#define INVLPG_MAX 8
+
+/* Most freed page directories kept for reuse. */
+#define PD_CACHE_MAX 8
+
+/* TLB invalidations for one page directory, collected by one
+   call and carried out together, on the running CPU and on every
+   other CPU that may have PD's entries in its TLB.
+
+   Those are the CPUs whose CR3 holds PD, recorded in each
+   struct cpu's `pagedir' by load_pd().  A CPU switching to a
+   kernel thread leaves the last page directory loaded, since
+   every one maps the kernel the same way (see
+   process_activate()); this "lazy TLB" mode avoids a CR3
+   reload, and the TLB flush that goes with it, when the CPU
+   switches back.  Such a CPU still counts as holding PD, so it
+   still takes PD's invalidations, until pagedir_destroy() makes
+   it drop PD altogether.
+
+   Other CPUs are told by a LAPIC_TLB_VEC interprocessor
+   interrupt, and the sender waits for all of them to handle it.
+   Only one shootdown is in flight at a time; a CPU waiting for
+   its turn, with interrupts off, handles any shootdown sent to
+   it meanwhile, so two senders cannot deadlock. */
+struct tlb_batch
+  {
+    uint32_t *pd;               /* Page directory. */
+    size_t cnt;                 /* Pages, > INVLPG_MAX for all. */
+    const void *pages[INVLPG_MAX]; /* Pages to invalidate. */
+    bool drop;                  /* Load init_page_dir instead? */
+  };
+
+static struct spinlock shootdown_lock = SPINLOCK_INITIALIZER;
+static struct tlb_batch shootdown;      /* Shootdown in flight. */
+static volatile int shootdown_acks;     /* CPUs yet to handle it. */
+
+/* Page directories given to pagedir_destroy_async(), already
+   dropped by every CPU, waiting to be freed by a worker.  Each is
+   linked through a list_elem stored in its kernel half, which
+   nothing reads once the directory is no longer loaded. */
+static struct list reap_list;
+static size_t reap_cnt;                 /* Queued or being freed. */
+static struct lock reap_list_lock;      /* Protects the above. */
+static struct lock reap_lock;           /* Held while freeing. */
+static struct work reap_work;           /* Runs reap_task(). */
+
+/* Freed page directories kept for pagedir_create() to reuse,
+   linked like those in reap_list.  Each has an empty user half
+   and, apart from that link, the kernel half it was created
+   with; kernel PDEs that init_page_dir gained since then are
+   filled in by pagedir_sync_kernel() on first use. */
+static struct list pd_cache;
+static size_t pd_cache_cnt;             /* Number in pd_cache. */
+static struct lock pd_cache_lock;       /* Protects the above. */
+
+static void detach_pd (uint32_t *pd);
+static void free_pd (uint32_t *pd);
+static uint32_t *cache_get_pd (void);
+static bool cache_put_pd (uint32_t *pd);
+static work_func reap_task;
 static uint32_t *active_pd (void);
+static void load_pd (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 static void invalidate_pagedir (uint32_t *);
+static void tlb_batch_init (struct tlb_batch *, uint32_t *pd);
+static void tlb_batch_add (struct tlb_batch *, const void *);
+static void tlb_batch_flush (const struct tlb_batch *);
+static void tlb_flush_local (const struct tlb_batch *);
+static void tlb_shootdown (const struct tlb_batch *);
+static void tlb_handle (struct cpu *);
+static intr_handler_func tlb_interrupt;
+
+/* Registers the TLB shootdown interrupt, if there are other CPUs
+   to send it. */
+void
+pagedir_init (void)
+{
+  if (lapic_present ())
+    intr_register_ext (LAPIC_TLB_VEC, tlb_interrupt, "TLB Shootdown");
+  list_init (&reap_list);
+  lock_init_named (&reap_list_lock, "reap_list");
+  lock_init_named (&reap_lock, "reap");
+  work_init (&reap_work, reap_task, NULL, PRI_DEFAULT);
+  list_init (&pd_cache);
+  lock_init_named (&pd_cache_lock, "pd_cache");
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
-   allocation fails. */
+   allocation fails.
+
+   A recycled page directory needs no copying at all.  A fresh
+   one gets only the kernel half of init_page_dir, whose user
+   half is empty except while mp_start() borrows its first
+   entry. */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  size_t user_pdes = pd_no (PHYS_BASE);
+  uint32_t *pd;
+
+  pd = cache_get_pd ();
+  if (pd != NULL)
+    return pd;
+
+  pd = palloc_get_page (0);
+  if (pd == NULL && pagedir_reap ())
+    {
+      pd = cache_get_pd ();
+      if (pd != NULL)
+        return pd;
+      pd = palloc_get_page (0);
+    }
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    {
+      memset (pd, 0, user_pdes * sizeof *pd);
+      memcpy (pd + user_pdes, init_page_dir + user_pdes,
+              PGSIZE - user_pdes * sizeof *pd);
+    }
   return pd;
 }
 
+/* Copies into the running page directory the kernel PDE for
+   VADDR from init_page_dir, if init_page_dir has one that the
+   running page directory lacks, as when a kernel page table was
+   added after it was created.  Returns true if it copied one, in
+   which case an access to VADDR that faulted may be retried,
+   false otherwise.  Kernel page tables are shared by every page
+   directory and never freed, so only their PDEs need copying. */
+bool
+pagedir_sync_kernel (const void *vaddr)
+{
+  uint32_t *pd = active_pd ();
+  size_t idx = pd_no (vaddr);
+
+  if (!is_kernel_vaddr (vaddr) || pd == init_page_dir
+      || pd[idx] != 0 || init_page_dir[idx] == 0)
+    return false;
+  pd[idx] = init_page_dir[idx];
+  return true;
+}
+
 /* Destroys page directory PD, freeing all the pages it
    references. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  if (pd == NULL)
+    return;
 
+  detach_pd (pd);
+  free_pd (pd);
+}
+
+/* Like pagedir_destroy(), but only makes sure that no CPU uses PD
+   any more before returning, and leaves freeing its pages to a
+   worker thread.  An exiting process can then report to its
+   parent without first walking its whole address space. */
+void
+pagedir_destroy_async (uint32_t *pd)
+{
   if (pd == NULL)
     return;
 
+  detach_pd (pd);
+  lock_acquire (&reap_list_lock);
+  list_push_back (&reap_list, (struct list_elem *) (pd + pd_no (PHYS_BASE)));
+  reap_cnt++;
+  lock_release (&reap_list_lock);
+  work_queue (&reap_work);
+}
+
+/* Frees the page directories given to pagedir_destroy_async()
+   that have not been freed yet, waiting for any that a worker is
+   freeing.  Returns true if there were any, in which case their
+   pages are now back in their pools, false otherwise. */
+bool
+pagedir_reap (void)
+{
+  bool pending;
+
+  lock_acquire (&reap_list_lock);
+  pending = reap_cnt > 0;
+  lock_release (&reap_list_lock);
+  if (!pending)
+    return false;
+
+  lock_acquire (&reap_lock);
+  for (;;)
+    {
+      uint32_t *pd = NULL;
+
+      lock_acquire (&reap_list_lock);
+      if (!list_empty (&reap_list))
+        pd = pg_round_down (list_pop_front (&reap_list));
+      lock_release (&reap_list_lock);
+      if (pd == NULL)
+        break;
+
+      free_pd (pd);
+      lock_acquire (&reap_list_lock);
+      reap_cnt--;
+      lock_release (&reap_list_lock);
+    }
+  lock_release (&reap_lock);
+  return true;
+}
+
+/* Work function that runs pagedir_reap(). */
+static void
+reap_task (void *aux UNUSED)
+{
+  pagedir_reap ();
+}
+
+/* Makes sure that no CPU keeps PD loaded, lazily or otherwise. */
+static void
+detach_pd (uint32_t *pd)
+{
   ASSERT (pd != init_page_dir);
+
+  if (active_pd () == pd)
+    pagedir_activate (NULL);
+  if (cpu_cnt > 1)
+    {
+      struct tlb_batch b;
+
+      tlb_batch_init (&b, pd);
+      b.drop = true;
+      tlb_shootdown (&b);
+    }
+}
+
+/* Frees PD, which no CPU uses, and the pages it references. */
+static void
+free_pd (uint32_t *pd)
+{
+  uint32_t *pde;
+
+  /* A 4 MB page's frames, like any other user frames under VM,
+     are released with the supplemental page table. */
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & PTE_P) && !(*pde & PTE_PS))
       {
         uint32_t *pt = pde_get_pt (*pde);
+#ifndef VM
+        /* With VM, user frames belong to the frame table and are
+           released with the supplemental page table. */
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
+#endif
         palloc_free_page (pt);
+        *pde = 0;
       }
-  palloc_free_page (pd);
+    else
+      *pde = 0;
+  if (!cache_put_pd (pd))
+    palloc_free_page (pd);
+}
+
+/* Takes a page directory from pd_cache and returns it, ready for
+   use, or returns a null pointer if the cache is empty. */
+static uint32_t *
+cache_get_pd (void)
+{
+  size_t link = pd_no (PHYS_BASE);
+  uint32_t *pd = NULL;
+
+  lock_acquire (&pd_cache_lock);
+  if (!list_empty (&pd_cache))
+    {
+      pd = pg_round_down (list_pop_front (&pd_cache));
+      pd_cache_cnt--;
+    }
+  lock_release (&pd_cache_lock);
+
+  /* Put back the kernel PDEs that the link overwrote. */
+  if (pd != NULL)
+    memcpy (pd + link, init_page_dir + link, sizeof (struct list_elem));
+  return pd;
+}
+
+/* Adds PD, which no CPU uses and whose user half is empty, to
+   pd_cache, unless the cache is full.  Returns true if PD was
+   added, false if the caller should free it. */
+static bool
+cache_put_pd (uint32_t *pd)
+{
+  bool cached = false;
+
+  lock_acquire (&pd_cache_lock);
+  if (pd_cache_cnt < PD_CACHE_MAX)
+    {
+      list_push_back (&pd_cache,
+                      (struct list_elem *) (pd + pd_no (PHYS_BASE)));
+      pd_cache_cnt++;
+      cached = true;
+    }
+  lock_release (&pd_cache_lock);
+  return cached;
 }
 
 /* Returns the address of the page table entry for virtual
@@ -52,7 +328,8 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  If VADDR is in a 4 MB page, returns the
+   PDE that maps it, whose flags mean the same as a PTE's. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -79,6 +356,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
       else
         return NULL;
     }
+  if (*pde & PTE_PS)
+    return pde;
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -106,6 +385,8 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
   ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
   ASSERT (pd != init_page_dir);
 
+  ASSERT (!(pd[pd_no (upage)] & PTE_PS));
+
   pte = lookup_page (pd, upage, true);
 
   if (pte != NULL) 
@@ -129,6 +410,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 
   ASSERT (is_user_vaddr (uaddr));
   
+  if (pd[pd_no (uaddr)] & PTE_PS)
+    return ((uint8_t *) pde_get_large (pd[pd_no (uaddr)])
+            + ((uintptr_t) uaddr & (LARGE_PGSIZE - 1)));
+
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
@@ -139,7 +424,7 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   UPAGE need not be mapped, but must not be in a 4 MB page. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
@@ -147,15 +432,63 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
+  ASSERT (!(pd[pd_no (upage)] & PTE_PS));
 
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/* Maps the LARGE_PGSIZE bytes of user virtual memory at UPAGE
+   in PD to the 4 MB page at KPAGE, read/write if WRITABLE is true
+   and read-only otherwise, with a single PDE.  Both addresses
+   must be LARGE_PGSIZE aligned, and CR4_PSE must be set.  UPAGE's
+   region must have a page table, in which no page is mapped.
+   Returns that page table, which PD no longer uses, so that the
+   caller can keep it for pagedir_split_large_page(): splitting
+   then never has to allocate. */
+uint32_t *
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  uint32_t *pt;
+  size_t i;
+
+  ASSERT ((uintptr_t) upage % LARGE_PGSIZE == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (cr4_get () & CR4_PSE);
+
+  pt = pde_get_pt (*pde);
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    ASSERT (!(pt[i] & PTE_P));
+  *pde = pde_create_large_user (kpage, writable);
+  invalidate_pagedir (pd);
+  return pt;
+}
+
+/* Replaces the 4 MB page at UPAGE in PD by page table PT, which
+   pagedir_set_large_page() returned, mapping the same frames
+   with 4 kB pages that inherit the large page's access rights
+   and accessed and dirty bits. */
+void
+pagedir_split_large_page (uint32_t *pd, void *upage, uint32_t *pt)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  uint8_t *kpage = pde_get_large (*pde);
+  uint32_t bits = *pde & (PTE_A | PTE_D);
+  bool writable = (*pde & PTE_W) != 0;
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = pte_create_user (kpage + i * PGSIZE, writable) | bits;
+  *pde = pde_create (pt);
+  invalidate_pagedir (pd);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +513,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,25 +542,106 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
-/* Loads page directory PD into the CPU's page directory base
-   register. */
+/* Calls FUNC for each mapped page in PD from START up to END,
+   passing it the page's accessed and dirty bits and AUX, and
+   clears the accessed bits.  Unlike a pagedir_is_accessed() and
+   pagedir_set_accessed() pair per page, this walks each page
+   table once, skips unmapped 4 MB regions in one step, and
+   invalidates the TLB once at the end.  FUNC must not change
+   PD. */
+void
+pagedir_scan_and_clear_accessed (uint32_t *pd, const void *start,
+                                 const void *end, pagedir_scan_func *func,
+                                 void *aux)
+{
+  const uint8_t *upage = pg_round_down (start);
+  struct tlb_batch b;
+  size_t i;
+
+  ASSERT (end <= PHYS_BASE);
+
+  tlb_batch_init (&b, pd);
+  while (upage < (const uint8_t *) end)
+    {
+      uint32_t pde = pd[pd_no (upage)];
+      uint32_t *pt;
+
+      if ((pde & PTE_P) == 0)
+        {
+          /* Skip to the next page table. */
+          upage = (const uint8_t *) (((uintptr_t) upage
+                                      | (LARGE_PGSIZE - 1)) + 1);
+          continue;
+        }
+
+      if (pde & PTE_PS)
+        {
+          /* A 4 MB page has one set of bits for all of its pages. */
+          const uint8_t *next = (const uint8_t *) (((uintptr_t) upage
+                                                    | (LARGE_PGSIZE - 1)) + 1);
+
+          if (pde & PTE_A)
+            {
+              pd[pd_no (upage)] &= ~(uint32_t) PTE_A;
+              tlb_batch_add (&b, upage);
+            }
+          for (; upage < next && upage < (const uint8_t *) end;
+               upage += PGSIZE)
+            func (upage, (pde & PTE_A) != 0, (pde & PTE_D) != 0, aux);
+          continue;
+        }
+
+      pt = pde_get_pt (pde);
+      for (i = pt_no (upage);
+           i < (1 << PTBITS) && upage < (const uint8_t *) end;
+           i++, upage += PGSIZE)
+        {
+          uint32_t pte = pt[i];
+
+          if ((pte & PTE_P) == 0)
+            continue;
+          if (pte & PTE_A)
+            {
+              pt[i] &= ~(uint32_t) PTE_A;
+              tlb_batch_add (&b, upage);
+            }
+          func (upage, (pte & PTE_A) != 0, (pte & PTE_D) != 0, aux);
+        }
+    }
+
+  tlb_batch_flush (&b);
+}
+
+/* Loads page directory PD, or init_page_dir if PD is null, into
+   the CPU's page directory base register, unless it is already
+   there.  Loading it flushes the TLB, except for the kernel's
+   mappings, which are global (see paging_init()). */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (active_pd () != pd)
+    load_pd (pd);
+}
 
+/* Loads PD into CR3, flushing the TLB, and records it as the
+   running CPU's. */
+static void
+load_pd (uint32_t *pd)
+{
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  cpu_current ()->pagedir = pd;
 }
 
 /* Returns the currently active page directory. */
@@ -243,21 +657,145 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
+
+   This function invalidates the TLB entry for VADDR on each CPU
+   on which PD is the active page directory.  (Where PD is not
+   active its entries are not in the TLB, so there is no need to
+   invalidate anything.)  A single INVLPG leaves the rest of the
+   TLB alone, unlike re-activating PD.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  struct tlb_batch b;
+
+  tlb_batch_init (&b, pd);
+  tlb_batch_add (&b, vaddr);
+  tlb_batch_flush (&b);
+}
+
+/* Invalidates every TLB entry for user pages on each CPU on which
+   PD is the active page directory, by re-loading it. */
+static void
+invalidate_pagedir (uint32_t *pd)
+{
+  struct tlb_batch b;
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+  tlb_batch_init (&b, pd);
+  b.cnt = INVLPG_MAX + 1;
+  tlb_batch_flush (&b);
+}
+
+/* Initializes B as empty, for page directory PD. */
+static void
+tlb_batch_init (struct tlb_batch *b, uint32_t *pd)
+{
+  b->pd = pd;
+  b->cnt = 0;
+  b->drop = false;
+}
+
+/* Adds the TLB entry for VADDR to those B will invalidate. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+tlb_batch_add (struct tlb_batch *b, const void *vaddr)
 {
-  if (active_pd () == pd) 
+  if (b->cnt < INVLPG_MAX)
+    b->pages[b->cnt] = vaddr;
+  if (b->cnt <= INVLPG_MAX)
+    b->cnt++;
+}
+
+/* Carries out B's invalidations, if any, on every CPU. */
+static void
+tlb_batch_flush (const struct tlb_batch *b)
+{
+  if (b->cnt == 0)
+    return;
+  tlb_flush_local (b);
+  if (cpu_cnt > 1)
+    tlb_shootdown (b);
+}
+
+/* Carries out B on the running CPU, if PD is active there. */
+static void
+tlb_flush_local (const struct tlb_batch *b)
+{
+  size_t i;
+
+  if (active_pd () != b->pd)
+    return;
+  if (b->drop)
+    load_pd (init_page_dir);
+  else if (b->cnt > INVLPG_MAX)
+    load_pd (b->pd);
+  else
+    for (i = 0; i < b->cnt; i++)
+      asm volatile ("invlpg (%0)" : : "r" (b->pages[i]) : "memory");
+}
+
+/* Carries out B on each other CPU that holds B's page directory,
+   and waits until they all have. */
+static void
+tlb_shootdown (const struct tlb_batch *b)
+{
+  enum intr_level old_level;
+  struct cpu *self;
+  uint32_t targets = 0;
+  int target_cnt = 0;
+  size_t i;
+
+  if (!lapic_present ())
+    return;
+
+  old_level = intr_disable ();
+  self = cpu_current ();
+  while (!spinlock_try_acquire (&shootdown_lock))
+    tlb_handle (self);
+
+  /* Choose the targets first, since each may handle the
+     shootdown as soon as it is marked pending. */
+  for (i = 0; i < cpu_cnt; i++)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      struct cpu *c = &cpus[i];
+      if (c != self && c->started && c->pagedir == b->pd)
+        {
+          targets |= 1u << i;
+          target_cnt++;
+        }
+    }
+  shootdown = *b;
+  shootdown_acks = target_cnt;
+  for (i = 0; i < cpu_cnt; i++)
+    if (targets & (1u << i))
+      {
+        cpus[i].tlb_pending = true;
+        lapic_send_ipi (cpus[i].apic_id, LAPIC_TLB_VEC);
+      }
+  while (shootdown_acks > 0)
+    asm volatile ("pause");
+
+  spinlock_release (&shootdown_lock, old_level);
+}
+
+/* Carries out the shootdown in flight on the running CPU C, if it
+   was sent to C and C has not done so yet. */
+static void
+tlb_handle (struct cpu *c)
+{
+  if (!c->tlb_pending)
+    return;
+  tlb_flush_local (&shootdown);
+  c->tlb_pending = false;
+  asm volatile ("lock decl %0" : "+m" (shootdown_acks) : : "memory");
+}
+
+/* TLB shootdown interrupt handler. */
+static void
+tlb_interrupt (struct intr_frame *f UNUSED)
+{
+  tlb_handle (cpu_current ());
 }
@@ -4,15 +4,31 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
+void pagedir_destroy_async (uint32_t *pd);
+bool pagedir_reap (void);
+bool pagedir_sync_kernel (const void *vaddr);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+uint32_t *pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                                  bool writable);
+void pagedir_split_large_page (uint32_t *pd, void *upage, uint32_t *pt);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+
+/* Called by pagedir_scan_and_clear_accessed() for each mapped
+   page, with the page's accessed and dirty bits as they were
+   before the scan cleared the accessed bit. */
+typedef void pagedir_scan_func (const void *upage, bool accessed, bool dirty,
+                                void *aux);
+void pagedir_scan_and_clear_accessed (uint32_t *pd, const void *start,
+                                      const void *end, pagedir_scan_func *,
+                                      void *aux);
 void pagedir_activate (uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
@@ -0,0 +1,165 @@
+#include "userprog/poll.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/input.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/pipe.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/waitq.h"
+#include "userprog/aio.h"
+#include "userprog/fdtable.h"
+#include "userprog/process.h"
+
+/* Readiness waits.
+
+   poll_wait() checks each source in turn and, if none is ready,
+   sleeps on a semaphore of its own that the wait queue of every
+   source that can change ups, as described in threads/waitq.c,
+   then checks them all again.  It is added to each queue the
+   first time it checks that source, and checks them all once
+   more after adding any before it sleeps, so that no wakeup is
+   lost.  It also waits on the process's exit queue, so that an
+   exiting process need not wait out a poll.  While it is on a
+   pipe's queue it keeps the file it found the pipe through open,
+   so that closing the pipe's other descriptors meanwhile cannot
+   free the queue under it.
+
+   Console input, pipes and asynchronous I/O completions have
+   wait queues.  Console output and files never make a writer or
+   reader wait for long, so they are always ready. */
+
+/* A source that poll_wait() waits on. */
+struct poll_source
+  {
+    struct waitq_entry entry;   /* In the source's wait queue. */
+    struct file *file;          /* File that owns the queue, or null. */
+  };
+
+/* Works out the events, of EVENTS and POLLHUP, that PFD is ready
+   for, and stores in *Q the wait queue that is woken when that
+   may change, or a null pointer if it cannot.  If *Q belongs to
+   a file, stores a reference to the file in *FILEP, which the
+   caller must drop with file_close() once it is done with *Q;
+   otherwise stores a null pointer there. */
+static unsigned
+poll_one (const struct pollfd *pfd, struct waitq **q, struct file **filep)
+{
+  unsigned events = pfd->events | POLLHUP;
+  struct file *file;
+  struct pipe *p;
+
+  *q = NULL;
+  *filep = NULL;
+  if (pfd->fd == POLLFD_AIO)
+    {
+      *q = aio_waitq ();
+      return aio_ready () ? POLLIN & events : 0;
+    }
+
+  file = fd_lookup (pfd->fd);
+  if (file == NULL)
+    {
+      if (pfd->fd == STDIN_FILENO)
+        {
+          *q = input_waitq ();
+          return input_empty () ? 0 : POLLIN & events;
+        }
+      else if (pfd->fd == STDOUT_FILENO)
+        return POLLOUT & events;
+      else
+        return POLLNVAL;
+    }
+
+  if ((p = file_get_pipe (file, false)) != NULL
+      || (p = file_get_pipe (file, true)) != NULL)
+    {
+      *q = pipe_waitq (p);
+      *filep = file;
+      return events & pipe_poll (p, p == file_get_pipe (file, true));
+    }
+  file_close (file);
+  return events & (POLLIN | POLLOUT);
+}
+
+/* Waits until at least one of the CNT sources in FDS is ready for
+   one of the events it asks for, or TIMEOUT milliseconds have
+   passed, or forever if TIMEOUT is negative.  Sets the REVENTS of
+   every source.  Returns the number of sources ready, 0 on
+   timeout, or -1 if memory is short. */
+int
+poll_wait (struct pollfd *fds, size_t cnt, int timeout)
+{
+  struct thread *leader = thread_current ()->leader;
+  struct poll_source *sources;
+  struct waitq_entry exit_entry;
+  struct semaphore wake;
+  int64_t deadline = 0;
+  bool timed_out = false;
+  int ready;
+  size_t i;
+
+  sources = malloc (cnt * sizeof *sources);
+  if (sources == NULL && cnt > 0)
+    return -1;
+  for (i = 0; i < cnt; i++)
+    {
+      sources[i].entry.q = NULL;
+      sources[i].file = NULL;
+    }
+  sema_init (&wake, 0);
+  waitq_add (&leader->exit_waitq, &exit_entry, &wake);
+  if (timeout > 0)
+    deadline = timer_ticks () + DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ,
+                                              1000);
+
+  for (;;)
+    {
+      bool added = false;
+
+      ready = 0;
+      for (i = 0; i < cnt; i++)
+        {
+          struct poll_source *s = &sources[i];
+          struct file *file;
+          struct waitq *q;
+
+          fds[i].revents = poll_one (&fds[i], &q, &file);
+          if (fds[i].revents != 0)
+            ready++;
+          if (q != NULL && s->entry.q == NULL)
+            {
+              waitq_add (q, &s->entry, &wake);
+              s->file = file;
+              added = true;
+            }
+          else
+            file_close (file);
+        }
+      if (ready > 0 || timeout == 0 || timed_out || process_killed ())
+        break;
+      if (added)
+        continue;
+
+      if (timeout < 0)
+        sema_down (&wake);
+      else
+        {
+          int64_t left = deadline - timer_ticks ();
+          if (left <= 0 || !sema_down_timeout (&wake, left))
+            timed_out = true;
+        }
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      waitq_remove (&sources[i].entry);
+      file_close (sources[i].file);
+    }
+  waitq_remove (&exit_entry);
+  free (sources);
+  return ready;
+}
@@ -0,0 +1,9 @@
+#ifndef USERPROG_POLL_H
+#define USERPROG_POLL_H
+
+#include <poll.h>
+#include <stddef.h>
+
+int poll_wait (struct pollfd *, size_t cnt, int timeout);
+
+#endif /* userprog/poll.h */
@@ -5,64 +5,304 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time-page.h>
+#include "userprog/elfcache.h"
+#include "userprog/aio.h"
+#include "userprog/fdtable.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/uaccess.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/refcount.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/checkpoint.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
+
+/* A child process's exit status, shared by the child and its
+   parent so that either may exit first.  The child's thread,
+   page and all, is freed when it exits, whether or not the
+   parent has waited for it; this small record is all that waits
+   around, in the parent's children list, to be reaped.  A thread
+   created by process_thread_create() has one too, in its
+   leader's threads list, reaped by process_thread_join(). */
+struct child
+  {
+    struct list_elem elem;      /* Element in parent's children. */
+    tid_t tid;                  /* Child's thread identifier. */
+    int exit_status;            /* Child's exit status. */
+    struct completion dead;     /* Completed when the child exits. */
+    struct refcount ref_cnt;    /* Parent and/or child still using it. */
+  };
+
+/* Passed from process_execute() to start_process(). */
+struct exec_info
+  {
+    const char *cmd_line;       /* Program and arguments. */
+    const char *checkpoint;     /* Checkpoint to restore instead, or null. */
+    struct child *child;        /* New process's status record. */
+    struct dir *cwd;            /* New process's working directory. */
+    struct file *stdio[2];      /* Redirected stdin, stdout, or null. */
+    struct owned_semaphore loaded; /* Upped when loading is done. */
+    bool success;               /* Did it load successfully? */
+  };
+
+/* Passed from process_thread_create() to start_thread(). */
+struct thread_info
+  {
+    void (*eip) (void);         /* User entry point. */
+    void *arg0, *arg1;          /* Its two arguments. */
+    struct thread *leader;      /* Process's main thread. */
+    struct child *child;        /* New thread's status record. */
+    struct dir *cwd;            /* New thread's working directory. */
+    size_t stack_slot;          /* New thread's stack slot. */
+    struct owned_semaphore started; /* Upped when the stack is set up. */
+    bool success;               /* Was it set up successfully? */
+  };
+
+#ifdef VM
+/* A process template: the address space of an executable, loaded
+   and faulted in by a thread of its own that then waits, never
+   running user code, so that new processes running the same
+   executable can be cloned from it copy-on-write instead of being
+   loaded afresh.  Only the new process's stack is built for it.
+
+   A template is made for an executable the second time in a row
+   it is run while its headers are still in the ELF cache, that
+   is, for a program that is run often, such as the shell's
+   children.  It is dropped when the executable is written or
+   removed, or when TEMPLATE_MAX others have been used more
+   recently.  templates and each template's members are protected
+   by template_lock, which is also held while a template is
+   cloned, so that the template cannot go away meanwhile. */
+struct template
+  {
+    struct list_elem elem;      /* Element in templates. */
+    struct file *file;          /* Executable, backs its code pages. */
+    unsigned write_cnt;         /* inode_write_cnt() when loaded. */
+    struct elf_image image;     /* Segments, until loaded. */
+    struct thread *thread;      /* Thread whose address space it is. */
+    uint8_t *heap_start;        /* Start of heap, past the data. */
+    bool ready;                 /* Loaded, and may be cloned? */
+    bool dropped;               /* No longer in templates? */
+    struct semaphore exit;      /* Upped to make the thread exit. */
+  };
+
+/* Most templates kept. */
+#define TEMPLATE_MAX 4
+
+static struct list templates;   /* Most recently used first. */
+static size_t template_cnt;     /* Number in templates. */
+static struct lock template_lock;
+
+static bool clone_template (struct file *, unsigned write_cnt,
+                            void (**eip) (void), bool *success);
+static void create_template (struct file *, unsigned write_cnt,
+                             const struct elf_image *);
+#endif
+
+/* Most threads a process may have besides its leader. */
+#define THREAD_MAX 32
+
+/* Size of each of those threads' stack, in pages.  Under VM the
+   pages are only allocated as they are touched; without it, each
+   thread gets one page, like the main stack. */
+#define THREAD_STACK_PAGES 8
 
 static thread_func start_process NO_RETURN;
+static thread_func start_thread NO_RETURN;
+static tid_t execute (const char *cmd_line, const char *checkpoint);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifdef VM
+static bool restore (const char *checkpoint, struct intr_frame *);
+#endif
+static uint8_t *thread_stack_top (size_t slot);
+static void free_thread_stack (size_t slot);
+static uint8_t *heap_limit (void);
+#ifndef VM
+static void *get_user_page (enum palloc_flags);
+static bool install_page (void *upage, void *kpage, bool writable);
+#endif
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+#ifdef VM
+  list_init (&templates);
+  template_cnt = 0;
+  lock_init_named (&template_lock, "template");
+#endif
+}
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Drops a reference to C, freeing it when neither the parent nor
+   the child needs it any more. */
+static void
+release_child (struct child *c)
+{
+  if (refcount_put (&c->ref_cnt))
+    free (c);
+}
+
+/* Starts a new thread running the user program named by the
+   first word of CMD_LINE, with the words of CMD_LINE as its
+   arguments, and waits for it to be loaded.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
+tid_t
+process_execute (const char *cmd_line) 
+{
+  return execute (cmd_line, NULL);
+}
+
+#ifdef VM
+/* Starts a new process from the checkpoint in the file named
+   CHECKPOINT, as written by checkpoint_save(), and waits for it
+   to be loaded.  It resumes where the checkpoint was taken, but
+   with the working directory and console redirections that
+   process_execute() would give it.  Returns the new process's
+   thread id, or TID_ERROR on failure. */
 tid_t
-process_execute (const char *file_name) 
+process_restore (const char *checkpoint)
+{
+  return execute (checkpoint, checkpoint);
+}
+#endif
+
+/* Does the work of process_execute() for CMD_LINE, or of
+   process_restore() if CHECKPOINT is nonnull, in which case
+   CMD_LINE only names the new thread. */
+static tid_t
+execute (const char *cmd_line, const char *checkpoint)
 {
-  char *fn_copy;
+  struct exec_info info;
   tid_t tid;
+  int fd;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  /* The new process reads CMD_LINE straight into its stack while
+     we wait for it to load, so CMD_LINE needs no copy. */
+  info.cmd_line = cmd_line;
+  info.checkpoint = checkpoint;
+  info.child = malloc (sizeof *info.child);
+  if (info.child == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  /* The child starts in our working directory. */
+  info.cwd = NULL;
+  if (thread_current ()->cwd != NULL)
+    {
+      info.cwd = dir_reopen (thread_current ()->cwd);
+      if (info.cwd == NULL)
+        {
+          free (info.child);
+          return TID_ERROR;
+        }
+    }
+  /* And with our standard input and output, if redirected. */
+  for (fd = 0; fd < 2; fd++)
+    {
+      struct file *file = fd_lookup (fd);
+      info.stdio[fd] = file != NULL ? file_reopen (file) : NULL;
+      file_close (file);
+      if (file != NULL && info.stdio[fd] == NULL)
+        {
+          file_close (info.stdio[0]);
+          dir_close (info.cwd);
+          free (info.child);
+          return TID_ERROR;
+        }
+    }
+  info.child->exit_status = -1;
+  completion_init (&info.child->dead);
+  refcount_init (&info.child->ref_cnt, 2);
+  owned_sema_init (&info.loaded, 0);
+
+  /* Create a new thread to execute CMD_LINE.  It renames itself
+     after the program once it has parsed CMD_LINE. */
+  tid = thread_create (cmd_line, PRI_DEFAULT, start_process, &info);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      file_close (info.stdio[0]);
+      file_close (info.stdio[1]);
+      dir_close (info.cwd);
+      free (info.child);
+      return TID_ERROR;
+    }
+
+  sema_down (&info.loaded.semaphore);
+  if (!info.success)
+    {
+      release_child (info.child);
+      return TID_ERROR;
+    }
+  list_push_back (&thread_current ()->children, &info.child->elem);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-  char *file_name = file_name_;
+  struct exec_info *info = info_;
+  struct thread *t = thread_current ();
   struct intr_frame if_;
   bool success;
 
+  t->child = info->child;
+  t->child->tid = t->tid;
+  t->cwd = info->cwd;
+  boot_mark ("exec");
+
+  /* Whoever waits for us to load, or to exit, lends us its
+     priority meanwhile.  complete_all() in process_exit() unbinds
+     us from the latter. */
+  owned_sema_set_owner (&info->loaded, t);
+  completion_set_owner (&t->child->dead, t);
+
+  /* fd_install() closes the file if it fails, and process_exit()
+     closes the ones that it installs. */
+  success = true;
+  if (info->stdio[0] != NULL && !fd_install (STDIN_FILENO, info->stdio[0]))
+    success = false;
+  if (info->stdio[1] != NULL && !fd_install (STDOUT_FILENO, info->stdio[1]))
+    success = false;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+#ifdef VM
+  if (info->checkpoint != NULL)
+    success = success && restore (info->checkpoint, &if_);
+  else
+#endif
+    success = success && load (info->cmd_line, &if_.eip, &if_.esp);
+  boot_mark ("load");
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* Tell the parent, then quit if load failed.  INFO is gone as
+     soon as the parent wakes up. */
+  info->success = success;
+  sema_up (&info->loaded.semaphore);
   if (!success) 
     thread_exit ();
 
@@ -72,48 +312,370 @@ start_process (void *file_name_)
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
      and jump to it. */
+  boot_finish ();
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
 
+/* Releases stack slot SLOT of the current thread's process and
+   lets the leader know if that was its last thread. */
+static void
+thread_gone (size_t slot)
+{
+  struct thread *leader = thread_current ()->leader;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  leader->stack_slots &= ~(1u << slot);
+  if (--leader->thread_cnt == 0 && leader->threads_wait)
+    thread_unblock (leader);
+  intr_set_level (old_level);
+}
+
+/* Starts a new thread in the current process, sharing its
+   address space and file descriptors, that begins running user
+   code at EIP with ARG0 and ARG1 as the arguments on its own
+   stack.  Returns the new thread's id, or TID_ERROR if the
+   process has too many threads, is exiting, or memory is
+   short. */
+tid_t
+process_thread_create (void (*eip) (void), void *arg0, void *arg1)
+{
+  struct thread *cur = thread_current ();
+  struct thread *leader = cur->leader;
+  struct thread_info info;
+  enum intr_level old_level;
+  tid_t tid;
+
+  info.eip = eip;
+  info.arg0 = arg0;
+  info.arg1 = arg1;
+  info.leader = leader;
+  info.child = malloc (sizeof *info.child);
+  if (info.child == NULL)
+    return TID_ERROR;
+
+  /* Claim a stack slot.  Counting the thread now keeps the
+     leader from finishing its exit until the thread is gone. */
+  old_level = intr_disable ();
+  for (info.stack_slot = 0; info.stack_slot < THREAD_MAX; info.stack_slot++)
+    if (!(leader->stack_slots & (1u << info.stack_slot)))
+      break;
+  if (leader->exiting || info.stack_slot >= THREAD_MAX)
+    {
+      intr_set_level (old_level);
+      free (info.child);
+      return TID_ERROR;
+    }
+  leader->stack_slots |= 1u << info.stack_slot;
+  leader->thread_cnt++;
+  intr_set_level (old_level);
+
+  info.cwd = NULL;
+  if (cur->cwd != NULL && (info.cwd = dir_reopen (cur->cwd)) == NULL)
+    goto fail;
+  info.child->exit_status = -1;
+  completion_init (&info.child->dead);
+  refcount_init (&info.child->ref_cnt, 2);
+  owned_sema_init (&info.started, 0);
+
+  tid = thread_create (cur->name, thread_get_priority (), start_thread,
+                       &info);
+  if (tid == TID_ERROR)
+    {
+      dir_close (info.cwd);
+      goto fail;
+    }
+
+  /* On failure the new thread has already given its slot back. */
+  sema_down (&info.started.semaphore);
+  if (!info.success)
+    {
+      release_child (info.child);
+      return TID_ERROR;
+    }
+  old_level = intr_disable ();
+  list_push_back (&leader->threads, &info.child->elem);
+  intr_set_level (old_level);
+  return tid;
+
+ fail:
+  thread_gone (info.stack_slot);
+  free (info.child);
+  return TID_ERROR;
+}
+
+/* A thread function that joins the creating thread's process
+   and starts running user code on a fresh stack. */
+static void
+start_thread (void *info_)
+{
+  struct thread_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  uint8_t *top;
+  void *args[3];
+  bool success = false;
+
+  t->leader = info->leader;
+  t->pagedir = t->leader->pagedir;
+  t->child = info->child;
+  t->child->tid = t->tid;
+  t->cwd = info->cwd;
+  t->stack_slot = info->stack_slot;
+  owned_sema_set_owner (&info->started, t);
+  completion_set_owner (&t->child->dead, t);
+  process_activate ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = info->eip;
+
+  /* Lay out a fake return address and the two arguments, as if
+     EIP had been called. */
+  args[0] = NULL;
+  args[1] = info->arg0;
+  args[2] = info->arg1;
+  top = thread_stack_top (t->stack_slot);
+  if (top != NULL)
+    {
+#ifdef VM
+      size_t i;
+
+      lock_acquire (&t->leader->vm_lock);
+      for (i = 1; i <= THREAD_STACK_PAGES; i++)
+        if (!page_add_zero (top - i * PGSIZE, true))
+          break;
+      lock_release (&t->leader->vm_lock);
+      success = i > THREAD_STACK_PAGES;
+#else
+      uint8_t *upage = top - PGSIZE;
+      uint8_t *kpage = get_user_page (PAL_ZERO);
+
+      success = kpage != NULL && install_page (upage, kpage, true);
+      if (kpage != NULL && !success)
+        palloc_free_page (kpage);
+#endif
+      if_.esp = top - sizeof args;
+      success = success && copy_to_user (if_.esp, args, sizeof args);
+    }
+
+  /* Tell the creator, then quit if that failed.  INFO is gone as
+     soon as the creator wakes up. */
+  info->success = success;
+  sema_up (&info->started.semaphore);
+  if (!success)
+    {
+      t->thread_exited = true;
+      thread_exit ();
+    }
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for thread TID of the current process to exit and
+   returns the value it passed to process_thread_exit(), or -1 if
+   it was killed.  Returns -1 immediately if TID is the current
+   thread, is not a thread created in this process, or has
+   already been joined. */
+int
+process_thread_join (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct thread *leader = cur->leader;
+  struct child *c = NULL;
+  enum intr_level old_level;
+  struct list_elem *e;
+  int exit_status;
+
+  if (tid == cur->tid)
+    return -1;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&leader->threads); e != list_end (&leader->threads);
+       e = list_next (e))
+    if (list_entry (e, struct child, elem)->tid == tid)
+      {
+        c = list_entry (e, struct child, elem);
+        list_remove (e);
+        break;
+      }
+  intr_set_level (old_level);
+  if (c == NULL)
+    return -1;
+
+  wait_for_completion (&c->dead);
+  exit_status = c->exit_status;
+  release_child (c);
+  return exit_status;
+}
+
+/* Ends the current thread with VALUE as the result its joiner
+   receives.  In a process's main thread, this exits the whole
+   process with VALUE as its exit status. */
+void
+process_thread_exit (int value)
+{
+  struct thread *cur = thread_current ();
+
+  cur->exit_status = value;
+  cur->thread_exited = true;
+  thread_exit ();
+}
+
+/* Returns true if the current thread's process is exiting, in
+   which case the thread should call thread_exit() instead of
+   returning to user mode. */
+bool
+process_killed (void)
+{
+  return thread_current ()->leader->exiting;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct child *c = list_entry (e, struct child, elem);
+      if (c->tid == child_tid)
+        {
+          int exit_status;
+
+          list_remove (e);
+          wait_for_completion (&c->dead);
+          exit_status = c->exit_status;
+          release_child (c);
+          return exit_status;
+        }
+    }
   return -1;
 }
 
-/* Free the current process's resources. */
+/* Free the current process's resources.  A thread other than
+   the main one frees only its own; the main one first waits for
+   all the others to go, then frees everything they shared. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct thread *leader = cur->leader;
+  enum intr_level old_level;
   uint32_t *pd;
 
+  /* Let go of the files of a system call cut short. */
+  syscall_release_files ();
+
+  if (leader != cur)
+    {
+      /* Leaving any way but process_thread_exit() takes the rest
+         of the process along. */
+      if (!cur->thread_exited)
+        {
+          leader->exiting = true;
+          futex_wake_process (leader);
+          waitq_wake (&leader->exit_waitq);
+        }
+      dir_close (cur->cwd);
+      cur->cwd = NULL;
+      free_thread_stack (cur->stack_slot);
+      cur->pagedir = NULL;
+      pagedir_activate (NULL);
+      goto report;
+    }
+
+  /* Get the other threads out of user mode and wait for them. */
+  cur->exiting = true;
+  if (cur->thread_cnt > 0)
+    {
+      futex_wake_process (cur);
+      waitq_wake (&cur->exit_waitq);
+    }
+  old_level = intr_disable ();
+  while (cur->thread_cnt > 0)
+    {
+      cur->threads_wait = true;
+      thread_block ();
+    }
+  cur->threads_wait = false;
+  intr_set_level (old_level);
+  while (!list_empty (&cur->threads))
+    release_child (list_entry (list_pop_front (&cur->threads),
+                               struct child, elem));
+
+  aio_exit ();
+  fd_close_all ();
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+
+#ifdef VM
+      /* Write back memory-mapped files while the page directory
+         still knows which pages are dirty. */
+      mmap_unmap_all ();
+      shm_unmap_all ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
          process page directory.  We must activate the base page
          directory before destroying the process's page
          directory, or our active page directory will be one
-         that's been freed (and cleared). */
+         that's been freed (and cleared).  Under VM, cur->pagedir
+         is cleared under frame_lock, so that no eviction is
+         still looking at the directory we destroy.  Freeing its
+         pages is left to a worker, so that our parent hears of
+         our exit without waiting for it. */
+#ifdef VM
+      frame_clear_pagedir ();
+#else
       cur->pagedir = NULL;
+#endif
       pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      if (pagedir_get_page (pd, (void *) TIME_PAGE) == timer_time_page ())
+        pagedir_clear_page (pd, (void *) TIME_PAGE);
+      pagedir_destroy_async (pd);
+#ifdef VM
+      page_table_destroy ();
+      file_close (cur->exec_file);
+      checkpoint_release ();
+#endif
+    }
+
+  /* Report our exit status to our parent, or our joiner, and
+     forget about our children's. */
+ report:
+  if (cur->child != NULL)
+    {
+      cur->child->exit_status = cur->exit_status;
+      complete_all (&cur->child->dead);
+      release_child (cur->child);
     }
+  while (!list_empty (&cur->children))
+    release_child (list_entry (list_pop_front (&cur->children),
+                               struct child, elem));
+  if (leader != cur)
+    thread_gone (cur->stack_slot);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -124,8 +686,11 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread has none of
+     its own and keeps whichever are loaded, whose kernel mappings
+     are the same as all the others' (see userprog/pagedir.c). */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -195,31 +760,54 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static uint8_t *setup_stack (const char *cmd_line, void **esp,
+                             char **file_name);
+static bool read_image (struct file *, const char *file_name,
+                        struct elf_image *);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
+static void prefetch_image (struct file *, const struct elf_image *);
+static bool map_time_page (void);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads the ELF executable named by the first word of CMD_LINE
+   into the current thread, with the words of CMD_LINE as its
+   arguments.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const char *cmd_line, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct elf_image image;
   struct file *file = NULL;
-  off_t file_ofs;
+  struct inode *inode;
+  unsigned write_cnt;
+  uint8_t *stack_kpage = NULL;
+  char *file_name;
   bool success = false;
-  int i;
+  bool cached;
+  size_t i;
+
+  image.segs = NULL;
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  page_table_init ();
+#endif
+
+  /* Set up stack.  This parses CMD_LINE, leaving the program name
+     as argv[0] on the stack, so it comes first. */
+  stack_kpage = setup_stack (cmd_line, esp, &file_name);
+  if (stack_kpage == NULL)
+    goto done;
+  strlcpy (t->name, file_name, sizeof t->name);
 
   /* Open executable file. */
   file = filesys_open (file_name);
@@ -229,6 +817,158 @@ load (const char *file_name, void (**eip) (void), void **esp)
       goto done; 
     }
 
+  /* Clone the executable's template, if it has one. */
+  inode = file_get_inode (file);
+  write_cnt = inode_write_cnt (inode);
+#ifdef VM
+  if (clone_template (file, write_cnt, eip, &success))
+    {
+      success = success && map_time_page ();
+      goto done;
+    }
+#endif
+
+  /* Read and verify the executable's headers, unless they are
+     cached from an earlier run of the same file. */
+  cached = elf_cache_lookup (inode, &image);
+  if (!cached)
+    {
+      if (!read_image (file, file_name, &image))
+        goto done;
+      elf_cache_insert (inode, write_cnt, &image);
+    }
+  prefetch_image (file, &image);
+
+  /* Map the loadable segments.  The heap starts out empty just
+     past the last of them. */
+  for (i = 0; i < image.seg_cnt; i++)
+    {
+      const struct elf_segment *seg = &image.segs[i];
+      uint8_t *end = ((uint8_t *) seg->mem_page
+                      + seg->read_bytes + seg->zero_bytes);
+
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+      if (end > t->heap_start)
+        t->heap_start = end;
+    }
+  t->brk = t->heap_start;
+
+  if (!map_time_page ())
+    goto done;
+
+  /* Start address. */
+  *eip = (void (*) (void)) image.entry;
+
+  success = true;
+#ifdef VM
+  if (cached)
+    create_template (file, write_cnt, &image);
+#endif
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+  free (image.segs);
+#ifdef VM
+  if (stack_kpage != NULL)
+    frame_unpin (stack_kpage);
+
+  /* Pages are read from the executable as they are touched, so
+     keep it open until the process exits. */
+  t->exec_file = file;
+#else
+  file_close (file);
+#endif
+  return success;
+}
+
+#ifdef VM
+/* Loads the executable of the checkpoint in the file named
+   CHECKPOINT into the current thread, then the state saved in
+   the checkpoint, and sets up IF_ to resume it.  Returns true if
+   successful, false otherwise. */
+static bool
+restore (const char *checkpoint, struct intr_frame *if_)
+{
+  struct checkpoint_image *image = checkpoint_open (checkpoint);
+  bool success;
+
+  success = (image != NULL
+             && load (checkpoint_program (image), &if_->eip, &if_->esp)
+             && checkpoint_restore (image, if_));
+  checkpoint_close (image);
+  return success;
+}
+#endif
+
+/* load() helpers. */
+
+/* Starts reading into the buffer cache, in the background, the
+   parts of FILE that the process described by IMAGE reads
+   first: the page holding its entry point, then the start of
+   each other segment read from FILE.  The disk reads then
+   overlap mapping the segments and starting the process.
+   file_prefetch() bounds each request, and the buffer cache's
+   read-ahead queue drops requests once full, so a large
+   executable is not read in only to evict itself. */
+static void
+prefetch_image (struct file *file, const struct elf_image *image)
+{
+  uint32_t entry_page = image->entry & ~PGMASK;
+  size_t i;
+
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      const struct elf_segment *seg = &image->segs[i];
+
+      if (entry_page >= seg->mem_page
+          && entry_page - seg->mem_page < seg->read_bytes)
+        file_prefetch (file, seg->file_page + (entry_page - seg->mem_page),
+                       PGSIZE);
+    }
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      const struct elf_segment *seg = &image->segs[i];
+
+      if (seg->read_bytes > 0
+          && (entry_page < seg->mem_page
+              || entry_page - seg->mem_page >= seg->read_bytes))
+        file_prefetch (file, seg->file_page, seg->read_bytes);
+    }
+}
+
+/* Maps the timer's time page read-only at TIME_PAGE in the
+   current process, unless the executable already occupies that
+   page.  Returns false only if memory runs out. */
+static bool
+map_time_page (void)
+{
+  struct thread *t = thread_current ();
+  void *upage = (void *) TIME_PAGE;
+
+  if (pagedir_get_page (t->pagedir, upage) != NULL)
+    return true;
+#ifdef VM
+  if (page_lookup (upage) != NULL)
+    return true;
+#endif
+  return pagedir_set_page (t->pagedir, upage, timer_time_page (), false);
+}
+
+/* Reads and verifies the executable header and program headers
+   of FILE, named FILE_NAME, and stores its entry point and
+   loadable segments in *IMAGE.  On success the caller must free
+   IMAGE->segs.  Returns true if successful, false if FILE is not
+   a valid executable or memory is exhausted. */
+static bool
+read_image (struct file *file, const char *file_name,
+            struct elf_image *image)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
+
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
@@ -239,7 +979,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_phnum > 1024) 
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return false;
+    }
+
+  image->entry = ehdr.e_entry;
+  image->seg_cnt = 0;
+  image->segs = NULL;
+  if (ehdr.e_phnum > 0)
+    {
+      image->segs = malloc (ehdr.e_phnum * sizeof *image->segs);
+      if (image->segs == NULL)
+        return false;
     }
 
   /* Read program headers. */
@@ -249,11 +999,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        goto error;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        goto error;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -267,58 +1017,46 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto error;
         case PT_LOAD:
           if (validate_segment (&phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct elf_segment *seg = &image->segs[image->seg_cnt++];
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+
+              seg->writable = (phdr.p_flags & PF_W) != 0;
+              seg->file_page = phdr.p_offset & ~PGMASK;
+              seg->mem_page = phdr.p_vaddr & ~PGMASK;
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr.p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            goto error;
           break;
         }
     }
+  return true;
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
-  success = true;
-
- done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
-  return success;
+ error:
+  free (image->segs);
+  image->segs = NULL;
+  return false;
 }
-
-/* load() helpers. */
-
-static bool install_page (void *upage, void *kpage, bool writable);
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -396,8 +1134,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where the page comes from.  It is read in by the
+         page fault handler when first touched. */
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
+      uint8_t *kpage = get_user_page (0);
       if (kpage == NULL)
         return false;
 
@@ -415,6 +1160,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -424,24 +1170,473 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
-static bool
-setup_stack (void **esp) 
+/* Pushes SIZE bytes of DATA onto the stack whose kernel page is
+   KPAGE and whose top is at *OFS bytes into the page.  Returns
+   the user address of the copy, or a null pointer if the page is
+   full. */
+static void *
+push (uint8_t *kpage, size_t *ofs, const void *data, size_t size)
+{
+  if (*ofs < size)
+    return NULL;
+  *ofs -= size;
+  memcpy (kpage + *ofs, data, size);
+  return (uint8_t *) PHYS_BASE - PGSIZE + *ofs;
+}
+
+/* Creates the user stack by mapping a zeroed page at the top of
+   user virtual memory, and lays out main()'s arguments on it
+   directly from CMD_LINE: a copy of CMD_LINE, split into words in
+   place, then argv[], argv, argc, and a fake return address.
+   Stores the initial stack pointer in *ESP and the kernel address
+   of the program name, argv[0], in *FILE_NAME.  Returns the
+   stack's kernel page, or a null pointer on failure, including
+   if CMD_LINE has no words or does not fit.  Under VM the stack
+   page stays pinned, for the sake of *FILE_NAME, until the caller
+   unpins it. */
+static uint8_t *
+setup_stack (const char *cmd_line, void **esp, char **file_name)
 {
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  size_t len = strnlen (cmd_line, PGSIZE);
+  size_t ofs = PGSIZE;
+  char *args, *token, *save_ptr;
+  char **argv, **first, **last;
+  void *uargv, *fake_ret = NULL, *null = NULL;
   uint8_t *kpage;
-  bool success = false;
+  int argc = 0;
+
+#ifdef VM
+  struct page *p;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  if (!page_add_zero (upage, true))
+    return NULL;
+  p = page_lookup (upage);
+  do
+    if (!page_fault_in (upage, true))
+      return NULL;
+  while (!frame_pin (p));
+  kpage = p->kpage;
+#else
+  kpage = get_user_page (PAL_ZERO);
+  if (kpage == NULL)
+    return NULL;
+  if (!install_page (upage, kpage, true))
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
+      palloc_free_page (kpage);
+      return NULL;
     }
-  return success;
+#endif
+
+  /* The words, split in place.  Their argv[] entries are pushed
+     as they are found, so they come out last to first and have
+     to be reversed afterward. */
+  if (len >= PGSIZE / 2)
+    goto fail;
+  ofs -= len + 1;
+  args = (char *) kpage + ofs;
+  memcpy (args, cmd_line, len + 1);
+  ofs = ROUND_DOWN (ofs, sizeof (char *));
+  if (push (kpage, &ofs, &null, sizeof null) == NULL)
+    goto fail;
+  for (token = strtok_r (args, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
+    {
+      void *utoken = upage + ((uint8_t *) token - kpage);
+      if (push (kpage, &ofs, &utoken, sizeof utoken) == NULL)
+        goto fail;
+      argc++;
+    }
+  if (argc == 0)
+    goto fail;
+
+  argv = (char **) (kpage + ofs);
+  for (first = argv, last = argv + argc - 1; first < last; first++, last--)
+    {
+      char *tmp = *first;
+      *first = *last;
+      *last = tmp;
+    }
+  *file_name = (char *) kpage + ((uint8_t *) argv[0] - upage);
+
+  uargv = upage + ofs;
+  if (push (kpage, &ofs, &uargv, sizeof uargv) == NULL
+      || push (kpage, &ofs, &argc, sizeof argc) == NULL
+      || push (kpage, &ofs, &fake_ret, sizeof fake_ret) == NULL)
+    goto fail;
+  *esp = upage + ofs;
+  return kpage;
+
+ fail:
+  /* The page is torn down with the rest of the address space. */
+#ifdef VM
+  frame_unpin (kpage);
+#endif
+  return NULL;
+}
+
+/* Returns the user address just above the stack of the
+   process's thread in stack slot SLOT, or a null pointer if it
+   does not fit.  The slots lie one below another under the
+   region reserved for the main stack. */
+static uint8_t *
+thread_stack_top (size_t slot)
+{
+#ifdef VM
+  size_t main_pages = stack_page_limit;
+#else
+  size_t main_pages = 1;
+#endif
+  size_t user_pages = (uintptr_t) PHYS_BASE / PGSIZE;
+
+  if (main_pages >= user_pages
+      || (user_pages - main_pages) / THREAD_STACK_PAGES <= slot + 1)
+    return NULL;
+  return ((uint8_t *) PHYS_BASE
+          - (main_pages + slot * THREAD_STACK_PAGES) * PGSIZE);
+}
+
+/* Returns the highest address the heap may grow to, just below
+   the lowest thread stack slot. */
+static uint8_t *
+heap_limit (void)
+{
+#ifdef VM
+  size_t main_pages = stack_page_limit;
+#else
+  size_t main_pages = 1;
+#endif
+  size_t top_pages = main_pages + THREAD_MAX * THREAD_STACK_PAGES;
+  size_t user_pages = (uintptr_t) PHYS_BASE / PGSIZE;
+
+  return (top_pages < user_pages
+          ? (uint8_t *) PHYS_BASE - top_pages * PGSIZE : NULL);
+}
+
+/* Moves the current process's program break, the end of its heap,
+   by INCREMENT bytes, which may be negative, and returns the
+   break's old value.  Pages that become part of the heap are all
+   zeros; under VM they get memory only when touched, like the
+   stack.  Pages that leave it are freed.  Returns a null pointer,
+   changing nothing, if the break would move below the start of
+   the heap or above heap_limit(), or the heap would run into
+   other memory, or memory is short. */
+void *
+process_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ()->leader;
+  uint8_t *old_brk, *new_brk, *upage, *old_end, *new_end;
+  bool success = true;
+
+#ifdef VM
+  lock_acquire (&t->vm_lock);
+#endif
+  old_brk = t->brk;
+  new_brk = old_brk + increment;
+  if (increment >= 0
+      ? new_brk < old_brk || new_brk > heap_limit ()
+      : new_brk > old_brk || new_brk < t->heap_start)
+    success = false;
+  old_end = pg_round_up (old_brk);
+  new_end = success ? pg_round_up (new_brk) : old_end;
+
+  /* Grow, undoing the growth if it fails partway. */
+  for (upage = old_end; upage < new_end; upage += PGSIZE)
+    {
+#ifdef VM
+      if (pagedir_get_page (t->pagedir, upage) != NULL
+          || !page_add_zero (upage, true))
+        break;
+#else
+      uint8_t *kpage = get_user_page (PAL_ZERO);
+
+      if (kpage == NULL)
+        break;
+      if (!install_page (upage, kpage, true))
+        {
+          palloc_free_page (kpage);
+          break;
+        }
+#endif
+    }
+  if (upage < new_end)
+    {
+      success = false;
+      new_end = old_end;
+      old_end = upage;
+    }
+
+  /* Shrink. */
+  for (upage = new_end; upage < old_end; upage += PGSIZE)
+    {
+#ifdef VM
+      page_remove (upage);
+#else
+      void *kpage = pagedir_get_page (t->pagedir, upage);
+
+      pagedir_clear_page (t->pagedir, upage);
+      palloc_free_page (kpage);
+#endif
+    }
+
+  if (success)
+    t->brk = new_brk;
+#ifdef VM
+  lock_release (&t->vm_lock);
+#endif
+  return success ? old_brk : NULL;
+}
+
+/* Frees whatever memory the current thread's process has in the
+   stack of stack slot SLOT. */
+static void
+free_thread_stack (size_t slot)
+{
+  uint8_t *top = thread_stack_top (slot);
+#ifdef VM
+  struct thread *leader = thread_current ()->leader;
+  size_t i;
+
+  if (top == NULL)
+    return;
+  lock_acquire (&leader->vm_lock);
+  for (i = 1; i <= THREAD_STACK_PAGES; i++)
+    if (page_lookup (top - i * PGSIZE) != NULL)
+      page_remove (top - i * PGSIZE);
+  lock_release (&leader->vm_lock);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage;
+
+  if (top == NULL)
+    return;
+  kpage = pagedir_get_page (pd, top - PGSIZE);
+  if (kpage != NULL)
+    {
+      pagedir_clear_page (pd, top - PGSIZE);
+      palloc_free_page (kpage);
+    }
+#endif
+}
+
+#ifdef VM
+/* Drops template Z.  template_lock must be held. */
+static void
+drop_template (struct template *z)
+{
+  list_remove (&z->elem);
+  template_cnt--;
+  z->dropped = true;
+  sema_up (&z->exit);
+}
+
+/* If there is a template for FILE, an executable that has been
+   written WRITE_CNT times, gives the current process a copy of
+   its address space and stores its entry point in *EIP.  Returns
+   true if there was such a template, storing in *SUCCESS whether
+   the copy succeeded; on failure the address space may be only
+   partly copied.  Otherwise returns false and does nothing.  The
+   current process must have just its stack. */
+static bool
+clone_template (struct file *file, unsigned write_cnt,
+                void (**eip) (void), bool *success)
+{
+  struct thread *t = thread_current ();
+  struct inode *inode = file_get_inode (file);
+  struct template *z = NULL;
+  struct list_elem *e, *next;
+
+  lock_acquire (&template_lock);
+  for (e = list_begin (&templates); e != list_end (&templates); e = next)
+    {
+      struct template *y = list_entry (e, struct template, elem);
+      struct inode *y_inode = file_get_inode (y->file);
+
+      next = list_next (e);
+      if (inode_is_removed (y_inode)
+          || (y_inode == inode && y->write_cnt != write_cnt))
+        drop_template (y);
+      else if (y_inode == inode && y->ready)
+        z = y;
+    }
+  if (z == NULL)
+    {
+      lock_release (&template_lock);
+      return false;
+    }
+  list_remove (&z->elem);
+  list_push_front (&templates, &z->elem);
+
+  /* The template's code pages are backed by its own open file,
+     which page_table_fork() swaps for ours. */
+  t->exec_file = file;
+  lock_acquire (&z->thread->vm_lock);
+  *success = page_table_fork (z->thread);
+  lock_release (&z->thread->vm_lock);
+  t->heap_start = t->brk = z->heap_start;
+  *eip = (void (*) (void)) z->image.entry;
+  lock_release (&template_lock);
+  return true;
+}
+
+/* Loads template Z's segments into the current thread, which is
+   its thread, and faults in each of their pages, as far as memory
+   allows.  Returns false if the segments could not be loaded. */
+static bool
+load_template (struct template *z)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  t->exec_file = z->file;
+  for (i = 0; i < z->image.seg_cnt; i++)
+    {
+      const struct elf_segment *seg = &z->image.segs[i];
+      uint8_t *end = ((uint8_t *) seg->mem_page
+                      + seg->read_bytes + seg->zero_bytes);
+
+      if (!load_segment (z->file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        return false;
+      if (end > t->heap_start)
+        t->heap_start = end;
+    }
+  z->heap_start = t->brk = t->heap_start;
+
+  lock_acquire (&t->vm_lock);
+  for (i = 0; i < z->image.seg_cnt; i++)
+    {
+      const struct elf_segment *seg = &z->image.segs[i];
+      uint8_t *upage = (uint8_t *) seg->mem_page;
+      uint8_t *end = upage + seg->read_bytes + seg->zero_bytes;
+
+      for (; upage < end; upage += PGSIZE)
+        {
+          struct page *p = page_lookup (upage);
+          if (p->kpage == NULL && !page_fault_in (upage, false))
+            goto done;
+        }
+    }
+ done:
+  lock_release (&t->vm_lock);
+  return true;
+}
+
+/* A thread function that builds template Z, then waits until it
+   is dropped and frees it. */
+static void
+start_template (void *z_)
+{
+  struct template *z = z_;
+  struct thread *t = thread_current ();
+  uint32_t *pd;
+  bool success;
+
+  z->thread = t;
+  t->pagedir = pagedir_create ();
+  success = t->pagedir != NULL;
+  if (success)
+    {
+      process_activate ();
+      page_table_init ();
+      success = load_template (z);
+    }
+  else
+    file_close (z->file);
+
+  lock_acquire (&template_lock);
+  if (success && !z->dropped)
+    z->ready = true;
+  else if (!z->dropped)
+    drop_template (z);
+  lock_release (&template_lock);
+
+  sema_down (&z->exit);
+  pd = t->pagedir;
+  if (pd != NULL)
+    {
+      frame_clear_pagedir ();
+      pagedir_activate (NULL);
+      pagedir_destroy (pd);
+      page_table_destroy ();
+      file_close (t->exec_file);
+      t->exec_file = NULL;
+    }
+  free (z->image.segs);
+  free (z);
+  thread_exit ();
+}
+
+/* Starts building a template for FILE, an executable that had
+   been written WRITE_CNT times when its segments, IMAGE, were
+   read, unless it already has one.  Nothing happens if memory is
+   exhausted. */
+static void
+create_template (struct file *file, unsigned write_cnt,
+                 const struct elf_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+  struct template *z;
+  struct list_elem *e;
+
+  lock_acquire (&template_lock);
+  for (e = list_begin (&templates); e != list_end (&templates);
+       e = list_next (e))
+    if (file_get_inode (list_entry (e, struct template, elem)->file)
+        == inode)
+      {
+        lock_release (&template_lock);
+        return;
+      }
+
+  z = malloc (sizeof *z);
+  if (z == NULL)
+    goto done;
+  z->image = *image;
+  z->image.segs = malloc (image->seg_cnt * sizeof *image->segs);
+  z->file = file_reopen (file);
+  if (z->image.segs == NULL || z->file == NULL)
+    goto fail;
+  memcpy (z->image.segs, image->segs, image->seg_cnt * sizeof *image->segs);
+  z->write_cnt = write_cnt;
+  z->ready = z->dropped = false;
+  sema_init (&z->exit, 0);
+
+  list_push_front (&templates, &z->elem);
+  if (thread_create ("template", PRI_DEFAULT, start_template, z)
+      == TID_ERROR)
+    {
+      list_remove (&z->elem);
+      goto fail;
+    }
+  if (++template_cnt > TEMPLATE_MAX)
+    drop_template (list_entry (list_back (&templates),
+                               struct template, elem));
+  goto done;
+
+ fail:
+  if (z->file != NULL)
+    file_close (z->file);
+  free (z->image.segs);
+  free (z);
+ done:
+  lock_release (&template_lock);
+}
+#endif
+
+#ifndef VM
+/* Returns a page from the user pool, obtained with FLAGS as for
+   palloc_get_page(), or a null pointer if the pool is empty even
+   after freeing the address spaces of processes that have exited
+   (see pagedir_destroy_async()). */
+static void *
+get_user_page (enum palloc_flags flags)
+{
+  void *kpage = palloc_get_page (PAL_USER | flags);
+
+  if (kpage == NULL && pagedir_reap ())
+    kpage = palloc_get_page (PAL_USER | flags);
+  return kpage;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -463,3 +1658,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -3,9 +3,19 @@
 
 #include "threads/thread.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
+#ifdef VM
+tid_t process_restore (const char *checkpoint);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
+tid_t process_thread_create (void (*eip) (void), void *arg0, void *arg1);
+int process_thread_join (tid_t);
+void process_thread_exit (int value) NO_RETURN;
+bool process_killed (void);
+void *process_sbrk (intptr_t increment);
+
 #endif /* userprog/process.h */
@@ -1,20 +1,1411 @@
 #include "userprog/syscall.h"
+#include <aio.h>
+#include <checkpoint.h>
+#include <dirent.h>
+#include <iovec.h>
+#include <limits.h>
+#include <memstat.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <syscall-ring.h>
+#include <sysstat.h>
+#include <threadstat.h>
+#include "devices/block.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/cache.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "userprog/aio.h"
+#include "userprog/fdtable.h"
+#include "userprog/futex.h"
+#include "userprog/poll.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/checkpoint.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
+
+/* System call dispatch.
+
+   The handler for system call N is syscalls[N].func, which takes
+   syscalls[N].argc 32-bit arguments.  The arguments sit on the
+   user stack just above the system call number, so the handler
+   validates the number and all of the arguments as one range and
+   copies them in with a single copy_in().  Handlers are called
+   with their arguments in registers (regparm), so they never
+   touch the copied array, and return the value for eax.
+
+   A process may also queue calls in a struct syscall_ring and
+   run a batch of them with one ring_enter() trap; see
+   lib/syscall-ring.h.  They go through the same table.
+
+   User memory is only accessed through userprog/uaccess.h.  A
+   bad pointer from the user process, anywhere, terminates it
+   with exit status -1. */
+
+#define SYSCALL_MAX_ARGS 3
+#define CONSOLE_CHUNK 256       /* Bytes written to console at once. */
+
+/* Passes arguments in eax, edx, and ecx instead of on the stack. */
+#define REGPARM __attribute__ ((regparm (SYSCALL_MAX_ARGS)))
+
+/* A system call handler.  Takes up to SYSCALL_MAX_ARGS arguments
+   and returns the result for eax. */
+typedef uint32_t REGPARM syscall_func (uint32_t, uint32_t, uint32_t);
+
+/* A system call. */
+struct syscall
+  {
+    syscall_func *func;         /* Handler. */
+    size_t argc;                /* Number of arguments. */
+  };
 
 static void syscall_handler (struct intr_frame *);
+uint32_t syscall_sysenter (void *esp);
+static void copy_in (void *, const void *, size_t);
+static void copy_out (void *, const void *, size_t);
+static char *copy_in_string (const char *);
+
+static syscall_func sys_halt NO_RETURN;
+static syscall_func sys_exit NO_RETURN;
+static syscall_func sys_exec;
+static syscall_func sys_wait;
+static syscall_func sys_create;
+static syscall_func sys_remove;
+static syscall_func sys_open;
+static syscall_func sys_filesize;
+static syscall_func sys_read;
+static syscall_func sys_write;
+static syscall_func sys_seek;
+static syscall_func sys_tell;
+static syscall_func sys_close;
+static syscall_func sys_chdir;
+static syscall_func sys_mkdir;
+static syscall_func sys_readdir;
+static syscall_func sys_isdir;
+static syscall_func sys_inumber;
+static syscall_func sys_readv;
+static syscall_func sys_writev;
+static syscall_func sys_copy_file_range;
+static syscall_func sys_ring_setup;
+static syscall_func sys_ring_enter;
+static syscall_func sys_memstat;
+static syscall_func sys_futex_wait;
+static syscall_func sys_futex_wake;
+static syscall_func sys_readdir_batch;
+static syscall_func sys_fallocate;
+static syscall_func sys_sched_edf;
+static syscall_func sys_cpu_quota;
+static syscall_func sys_thread_create;
+static syscall_func sys_thread_join;
+static syscall_func sys_thread_exit;
+static syscall_func sys_threadstat;
+static syscall_func sys_stats;
+static syscall_func sys_sched_setaffinity;
+static syscall_func sys_sched_getaffinity;
+static syscall_func sys_pipe;
+static syscall_func sys_dup2;
+static syscall_func sys_aio_read;
+static syscall_func sys_aio_write;
+static syscall_func sys_aio_wait;
+static syscall_func sys_poll;
+static syscall_func sys_sbrk;
+static syscall_func sys_direct_io;
+static syscall_func sys_fadvise;
+static syscall_func sys_tune;
+#ifdef VM
+static syscall_func sys_madvise;
+static syscall_func sys_mlock;
+static syscall_func sys_munlock;
+static syscall_func sys_rss_limit;
+static syscall_func sys_checkpoint;
+static syscall_func sys_restore;
+static syscall_func sys_mmap;
+static syscall_func sys_munmap;
+static syscall_func sys_shm_create;
+static syscall_func sys_shm_remove;
+static syscall_func sys_shm_map;
+static syscall_func sys_shm_unmap;
+#endif
+
+/* System call table, indexed by SYS_* number.  Calls without an
+   entry terminate the process. */
+static const struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_CREATE] = {sys_create, 2},
+    [SYS_REMOVE] = {sys_remove, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+#ifdef VM
+    [SYS_MMAP] = {sys_mmap, 2},
+    [SYS_MUNMAP] = {sys_munmap, 1},
+#endif
+    [SYS_CHDIR] = {sys_chdir, 1},
+    [SYS_MKDIR] = {sys_mkdir, 1},
+    [SYS_READDIR] = {sys_readdir, 2},
+    [SYS_ISDIR] = {sys_isdir, 1},
+    [SYS_INUMBER] = {sys_inumber, 1},
+    [SYS_READV] = {sys_readv, 3},
+    [SYS_WRITEV] = {sys_writev, 3},
+    [SYS_COPY_FILE_RANGE] = {sys_copy_file_range, 3},
+    [SYS_RING_SETUP] = {sys_ring_setup, 2},
+    [SYS_RING_ENTER] = {sys_ring_enter, 1},
+    [SYS_MEMSTAT] = {sys_memstat, 1},
+    [SYS_FUTEX_WAIT] = {sys_futex_wait, 2},
+    [SYS_FUTEX_WAKE] = {sys_futex_wake, 2},
+    [SYS_READDIR_BATCH] = {sys_readdir_batch, 3},
+    [SYS_FALLOCATE] = {sys_fallocate, 2},
+    [SYS_SCHED_EDF] = {sys_sched_edf, 2},
+    [SYS_CPU_QUOTA] = {sys_cpu_quota, 2},
+    [SYS_THREAD_CREATE] = {sys_thread_create, 3},
+    [SYS_THREAD_JOIN] = {sys_thread_join, 1},
+    [SYS_THREAD_EXIT] = {sys_thread_exit, 1},
+    [SYS_THREADSTAT] = {sys_threadstat, 2},
+    [SYS_STATS] = {sys_stats, 2},
+    [SYS_SCHED_SETAFFINITY] = {sys_sched_setaffinity, 1},
+    [SYS_SCHED_GETAFFINITY] = {sys_sched_getaffinity, 0},
+    [SYS_PIPE] = {sys_pipe, 1},
+    [SYS_DUP2] = {sys_dup2, 2},
+    [SYS_AIO_READ] = {sys_aio_read, 1},
+    [SYS_AIO_WRITE] = {sys_aio_write, 1},
+    [SYS_AIO_WAIT] = {sys_aio_wait, 2},
+    [SYS_POLL] = {sys_poll, 3},
+    [SYS_SBRK] = {sys_sbrk, 1},
+    [SYS_DIRECT_IO] = {sys_direct_io, 2},
+    [SYS_FADVISE] = {sys_fadvise, 2},
+    [SYS_TUNE] = {sys_tune, 3},
+#ifdef VM
+    [SYS_MADVISE] = {sys_madvise, 3},
+    [SYS_MLOCK] = {sys_mlock, 2},
+    [SYS_MUNLOCK] = {sys_munlock, 2},
+    [SYS_RSS_LIMIT] = {sys_rss_limit, 1},
+    [SYS_CHECKPOINT] = {sys_checkpoint, 2},
+    [SYS_RESTORE] = {sys_restore, 1},
+    [SYS_SHM_CREATE] = {sys_shm_create, 2},
+    [SYS_SHM_REMOVE] = {sys_shm_remove, 1},
+    [SYS_SHM_MAP] = {sys_shm_map, 2},
+    [SYS_SHM_UNMAP] = {sys_shm_unmap, 1},
+#endif
+  };
+
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
 
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  futex_init ();
+}
+
+/* Terminates the current process with exit status -1. */
+static void NO_RETURN
+kill_process (void)
+{
+  thread_current ()->leader->exit_status = -1;
+  thread_exit ();
+}
+
+/* Runs the system call whose number and arguments are on the
+   user stack at ESP and returns its result. */
+static uint32_t
+dispatch (void *esp)
+{
+  uint32_t args[1 + SYSCALL_MAX_ARGS];
+  const struct syscall *sc;
+  uint32_t retval;
+  unsigned nr;
+
+#ifdef VM
+  /* Lets the page fault handler grow the stack on faults taken
+     while accessing user memory on the process's behalf. */
+  thread_current ()->user_esp = esp;
+#endif
+
+  copy_in (&nr, esp, sizeof nr);
+  if (nr >= SYSCALL_CNT || syscalls[nr].func == NULL)
+    kill_process ();
+  sc = &syscalls[nr];
+
+  memset (args, 0, sizeof args);
+  copy_in (args, esp, sizeof *args * (1 + sc->argc));
+  retval = sc->func (args[1], args[2], args[3]);
+  syscall_release_files ();
+
+  /* Another thread may have ended the process meanwhile. */
+  if (process_killed ())
+    thread_exit ();
+
+  /* Hold back a heavy writer, now that it holds no locks. */
+  cache_throttle ();
+  return retval;
 }
 
+/* System call entry through "int $0x30". */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f)
+{
+  f->eax = dispatch (f->esp);
+}
+
+/* System call entry through SYSENTER, called from
+   userprog/sysenter.S with the user stack pointer. */
+uint32_t
+syscall_sysenter (void *esp)
+{
+  return dispatch (esp);
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Terminates
+   the process if any of them is not accessible. */
+static void
+copy_in (void *dst, const void *usrc, size_t size)
+{
+  if (!copy_from_user (dst, usrc, size))
+    kill_process ();
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Terminates
+   the process if any of them is not writable. */
+static void
+copy_out (void *udst, const void *src, size_t size)
+{
+  if (!copy_to_user (udst, src, size))
+    kill_process ();
+}
+
+/* Returns a copy of the null-terminated user string US in a page
+   of kernel memory, which the caller must free with
+   palloc_free_page().  Terminates the process if the string is
+   not accessible or does not fit in a page. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks = palloc_get_page (0);
+  size_t len;
+
+  if (ks == NULL)
+    kill_process ();
+  for (len = 0; len < PGSIZE; len++)
+    {
+      if (!get_user ((uint8_t *) ks + len, (const uint8_t *) us + len))
+        break;
+      if (ks[len] == '\0')
+        return ks;
+    }
+  palloc_free_page (ks);
+  kill_process ();
+}
+
+/* Halt system call. */
+static uint32_t REGPARM
+sys_halt (uint32_t a UNUSED, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Exit system call. */
+static uint32_t REGPARM
+sys_exit (uint32_t status, uint32_t b UNUSED, uint32_t c UNUSED)
 {
-  printf ("system call!\n");
+  thread_current ()->leader->exit_status = status;
   thread_exit ();
 }
+
+/* Exec system call. */
+static uint32_t REGPARM
+sys_exec (uint32_t ucmd_line, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *cmd_line = copy_in_string ((const char *) ucmd_line);
+  tid_t tid = process_execute (cmd_line);
+
+  palloc_free_page (cmd_line);
+  return tid;
+}
+
+/* Wait system call. */
+static uint32_t REGPARM
+sys_wait (uint32_t child, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static uint32_t REGPARM
+sys_create (uint32_t ufile, uint32_t initial_size, uint32_t c UNUSED)
+{
+  char *file = copy_in_string ((const char *) ufile);
+  bool ok = filesys_create (file, initial_size);
+
+  palloc_free_page (file);
+  return ok;
+}
+
+/* Remove system call. */
+static uint32_t REGPARM
+sys_remove (uint32_t ufile, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *file = copy_in_string ((const char *) ufile);
+  bool ok = filesys_remove (file);
+
+  palloc_free_page (file);
+  return ok;
+}
+
+/* Open system call. */
+static uint32_t REGPARM
+sys_open (uint32_t ufile, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *file_name = copy_in_string ((const char *) ufile);
+  struct file *file = filesys_open (file_name);
+
+  palloc_free_page (file_name);
+  return file != NULL ? fd_open (file) : -1;
+}
+
+/* Returns the file open as FD, terminating the process if there
+   is none.  The file stays open until the system call returns,
+   even if another thread closes FD meanwhile. */
+static struct file *
+lookup_file (int fd)
+{
+  struct thread *t = thread_current ();
+  struct file *file = fd_lookup (fd);
+
+  if (file == NULL)
+    kill_process ();
+  ASSERT (t->held_cnt < sizeof t->held_files / sizeof *t->held_files);
+  t->held_files[t->held_cnt++] = file;
+  return file;
+}
+
+/* Drops the current thread's references to the files that
+   lookup_file() returned during its system call.  Called when
+   the system call returns, after each entry that sys_ring_enter()
+   runs, and when the thread exits in the middle of one. */
+void
+syscall_release_files (void)
+{
+  struct thread *t = thread_current ();
+
+  while (t->held_cnt > 0)
+    file_close (t->held_files[--t->held_cnt]);
+}
+
+/* Returns true if FILE is open to a directory, which cannot be
+   read or written as a file. */
+static bool
+is_dir (struct file *file)
+{
+  struct inode *inode = file_get_inode (file);
+
+  return inode != NULL && inode_is_dir (inode);
+}
+
+/* Returns true if FD is STD_FD, that is, STDIN_FILENO or
+   STDOUT_FILENO, and still the console, not redirected by
+   dup2(). */
+static bool
+is_console (uint32_t fd, int std_fd)
+{
+  return fd == (uint32_t) std_fd && !fd_is_open (fd);
+}
+
+/* Reads up to SIZE bytes from pipe P into user BUFFER, for
+   sys_read().  A whole page that the writer handed over with
+   pipe_write_page() is copied to BUFFER from that page, taken
+   out of the pipe, without another copy into a bounce page.
+   Only the first chunk waits for data, so a read returns once
+   the pipe is drained.  Returns the number of bytes read, or -1
+   if memory is short. */
+static int
+read_pipe (struct pipe *p, uint8_t *buffer, size_t size)
+{
+  uint8_t *bounce = NULL;
+  size_t ofs;
+  off_t n;
+
+  for (ofs = 0; ofs < size; ofs += n)
+    {
+      size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+      bool wait = ofs == 0;
+      uint8_t *data = chunk == PGSIZE ? pipe_read_page (p, wait) : NULL;
+      bool ok;
+
+      if (data != NULL)
+        n = PGSIZE;
+      else
+        {
+          if (bounce == NULL && (bounce = palloc_get_page (0)) == NULL)
+            return ofs > 0 ? (int) ofs : -1;
+          data = bounce;
+          n = pipe_read (p, bounce, chunk, wait);
+          if (n == 0)
+            break;
+        }
+      ok = copy_to_user (buffer + ofs, data, n);
+      if (data != bounce)
+        palloc_free_page (data);
+      if (!ok)
+        {
+          palloc_free_page (bounce);
+          kill_process ();
+        }
+    }
+  palloc_free_page (bounce);
+  return ofs;
+}
+
+/* Writes SIZE bytes from user BUFFER into pipe P, for
+   sys_write().  Each whole page of data is handed to the pipe in
+   the bounce page it was copied into, with pipe_write_page(), so
+   that the reader can take it without copying it again.
+   Returns the number of bytes written, or -1 if none could be
+   because memory is short or no reader is left. */
+static int
+write_pipe (struct pipe *p, const uint8_t *buffer, size_t size)
+{
+  uint8_t *page = NULL;
+  size_t ofs;
+  off_t n;
+
+  for (ofs = 0; ofs < size; ofs += n)
+    {
+      size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+
+      if (page == NULL && (page = palloc_get_page (0)) == NULL)
+        break;
+      if (!copy_from_user (page, buffer + ofs, chunk))
+        {
+          palloc_free_page (page);
+          kill_process ();
+        }
+      if (chunk == PGSIZE)
+        {
+          if (!pipe_write_page (p, page))
+            break;
+          page = NULL;
+          n = PGSIZE;
+        }
+      else
+        {
+          n = pipe_write (p, page, chunk);
+          if ((size_t) n < chunk)
+            {
+              ofs += n;
+              break;
+            }
+        }
+    }
+  palloc_free_page (page);
+  return ofs > 0 || size == 0 ? (int) ofs : -1;
+}
+
+/* Filesize system call. */
+static uint32_t REGPARM
+sys_filesize (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return file_length (lookup_file (fd));
+}
+
+/* Read system call. */
+static uint32_t REGPARM
+sys_read (uint32_t fd, uint32_t ubuffer, uint32_t size)
+{
+  uint8_t *buffer = (uint8_t *) ubuffer;
+  struct file *file;
+  uint8_t *page;
+  size_t ofs;
+  off_t n;
+
+  if (is_console (fd, STDIN_FILENO))
+    {
+      for (ofs = 0; ofs < size; ofs++)
+        if (!put_user (buffer + ofs, input_getc ()))
+          kill_process ();
+      return size;
+    }
+
+  /* The file system must not fault on user memory, so the data
+     goes through a kernel page. */
+  file = lookup_file (fd);
+  if (is_dir (file))
+    return -1;
+  if (file_get_pipe (file, false) != NULL)
+    return read_pipe (file_get_pipe (file, false), buffer, size);
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+  for (ofs = 0; ofs < size; ofs += n)
+    {
+      size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+
+      n = file_read (file, page, chunk);
+      if (!copy_to_user (buffer + ofs, page, n))
+        {
+          palloc_free_page (page);
+          kill_process ();
+        }
+      if ((size_t) n < chunk)
+        {
+          ofs += n;
+          break;
+        }
+    }
+  palloc_free_page (page);
+  return ofs;
+}
+
+/* Write system call. */
+static uint32_t REGPARM
+sys_write (uint32_t fd, uint32_t ubuffer, uint32_t size)
+{
+  const uint8_t *buffer = (const uint8_t *) ubuffer;
+  struct file *file;
+  uint8_t *page;
+  size_t ofs;
+  off_t n;
+
+  if (is_console (fd, STDOUT_FILENO))
+    {
+      char chunk[CONSOLE_CHUNK];
+
+      for (ofs = 0; ofs < size; ofs += n)
+        {
+          n = size - ofs < CONSOLE_CHUNK ? size - ofs : CONSOLE_CHUNK;
+          copy_in (chunk, buffer + ofs, n);
+          putbuf (chunk, n);
+        }
+      return size;
+    }
+
+  file = lookup_file (fd);
+  if (is_dir (file))
+    return -1;
+  if (file_get_pipe (file, true) != NULL)
+    return write_pipe (file_get_pipe (file, true), buffer, size);
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+  for (ofs = 0; ofs < size; ofs += n)
+    {
+      size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+
+      if (!copy_from_user (page, buffer + ofs, chunk))
+        {
+          palloc_free_page (page);
+          kill_process ();
+        }
+      n = file_write (file, page, chunk);
+      if ((size_t) n < chunk)
+        {
+          ofs += n;
+          break;
+        }
+    }
+  palloc_free_page (page);
+  return ofs;
+}
+
+/* Seek system call. */
+static uint32_t REGPARM
+sys_seek (uint32_t fd, uint32_t position, uint32_t c UNUSED)
+{
+  file_seek (lookup_file (fd), position);
+  return 0;
+}
+
+/* Tell system call. */
+static uint32_t REGPARM
+sys_tell (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return file_tell (lookup_file (fd));
+}
+
+/* Close system call. */
+static uint32_t REGPARM
+sys_close (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  if (!fd_close (fd))
+    kill_process ();
+  return 0;
+}
+
+/* Chdir system call. */
+static uint32_t REGPARM
+sys_chdir (uint32_t udir, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *dir = copy_in_string ((const char *) udir);
+  bool ok = filesys_chdir (dir);
+
+  palloc_free_page (dir);
+  return ok;
+}
+
+/* Mkdir system call. */
+static uint32_t REGPARM
+sys_mkdir (uint32_t udir, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *dir = copy_in_string ((const char *) udir);
+  bool ok = filesys_mkdir (dir);
+
+  palloc_free_page (dir);
+  return ok;
+}
+
+/* Readdir system call.  The file position of FD is the position
+   within the directory.  Returns false, leaving the position
+   alone, if there is no entry left or NAME is not writable. */
+static uint32_t REGPARM
+sys_readdir (uint32_t fd, uint32_t uname, uint32_t c UNUSED)
+{
+  struct file *file = lookup_file (fd);
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool ok;
+
+  if (!is_dir (file))
+    return false;
+  dir = dir_open (inode_reopen (file_get_inode (file)));
+  if (dir == NULL)
+    return false;
+  dir_seek (dir, file_tell (file));
+  ok = (dir_readdir (dir, name)
+        && copy_to_user ((char *) uname, name, strlen (name) + 1));
+  if (ok)
+    file_seek (file, dir_tell (dir));
+  dir_close (dir);
+  return ok;
+}
+
+/* Isdir system call. */
+static uint32_t REGPARM
+sys_isdir (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return is_dir (lookup_file (fd));
+}
+
+/* Inumber system call. */
+static uint32_t REGPARM
+sys_inumber (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct inode *inode = file_get_inode (lookup_file (fd));
+
+  return inode != NULL ? inode_get_inumber (inode) : (uint32_t) -1;
+}
+
+/* Carries out readv() or writev() on FILE for the CNT user
+   buffers in UIOV, according to WRITE.
+
+   The data passes through a kernel page.  Each round packs as
+   many of the user buffers as fit into the page, described by a
+   kernel iovec per buffer, so the file system sees a single
+   vectored transfer per page of data; a buffer that does not fit
+   is continued in the next round.  Returns the number of bytes
+   transferred, or -1 if memory is short. */
+static int
+transfer_vector (struct file *file, const struct iovec *uiov, size_t cnt,
+                 bool write)
+{
+  struct iovec kiov[IOV_MAX];
+  uint8_t *ubufs[IOV_MAX];
+  size_t seg = 0, seg_ofs = 0;
+  uint8_t *page;
+  int total = 0;
+
+  if (is_dir (file))
+    return -1;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+  while (seg < cnt)
+    {
+      size_t used = 0, k = 0, i;
+      off_t done;
+
+      while (seg < cnt && used < PGSIZE)
+        {
+          size_t left = uiov[seg].iov_len - seg_ofs;
+          size_t n = left < PGSIZE - used ? left : PGSIZE - used;
+
+          ubufs[k] = (uint8_t *) uiov[seg].iov_base + seg_ofs;
+          kiov[k].iov_base = page + used;
+          kiov[k].iov_len = n;
+          if (write && !copy_from_user (page + used, ubufs[k], n))
+            {
+              palloc_free_page (page);
+              kill_process ();
+            }
+          used += n;
+          k++;
+
+          seg_ofs += n;
+          if (seg_ofs == uiov[seg].iov_len)
+            {
+              seg++;
+              seg_ofs = 0;
+            }
+        }
+
+      done = write ? file_writev (file, kiov, k) : file_readv (file, kiov, k);
+      for (i = 0; !write && i < k; i++)
+        {
+          size_t ofs = (uint8_t *) kiov[i].iov_base - page;
+          size_t n;
+
+          if (ofs >= (size_t) done)
+            break;
+          n = kiov[i].iov_len < done - ofs ? kiov[i].iov_len : done - ofs;
+          if (!copy_to_user (ubufs[i], kiov[i].iov_base, n))
+            {
+              palloc_free_page (page);
+              kill_process ();
+            }
+        }
+      total += done;
+      if ((size_t) done < used)
+        break;
+    }
+  palloc_free_page (page);
+  return total;
+}
+
+/* Copies the CNT-element iovec array at user address UIOV into
+   IOV, which must have room for IOV_MAX elements.  Returns false
+   if CNT is out of range or the buffers add up to more than
+   INT_MAX bytes. */
+static bool
+copy_in_iovec (struct iovec *iov, const struct iovec *uiov, size_t cnt)
+{
+  size_t total = 0;
+  size_t i;
+
+  if (cnt > IOV_MAX)
+    return false;
+  copy_in (iov, uiov, cnt * sizeof *iov);
+  for (i = 0; i < cnt; i++)
+    {
+      if (iov[i].iov_len > INT_MAX - total)
+        return false;
+      total += iov[i].iov_len;
+    }
+  return true;
+}
+
+/* Readv system call. */
+static uint32_t REGPARM
+sys_readv (uint32_t fd, uint32_t uiov, uint32_t cnt)
+{
+  struct iovec iov[IOV_MAX];
+  int total = 0;
+  size_t i;
+
+  if (!copy_in_iovec (iov, (const struct iovec *) uiov, cnt))
+    return -1;
+  if (is_console (fd, STDIN_FILENO))
+    {
+      for (i = 0; i < cnt; i++)
+        total += sys_read (fd, (uint32_t) iov[i].iov_base, iov[i].iov_len);
+      return total;
+    }
+  return transfer_vector (lookup_file (fd), iov, cnt, false);
+}
+
+/* Writev system call. */
+static uint32_t REGPARM
+sys_writev (uint32_t fd, uint32_t uiov, uint32_t cnt)
+{
+  struct iovec iov[IOV_MAX];
+  int total = 0;
+  size_t i;
+
+  if (!copy_in_iovec (iov, (const struct iovec *) uiov, cnt))
+    return -1;
+  if (is_console (fd, STDOUT_FILENO))
+    {
+      for (i = 0; i < cnt; i++)
+        total += sys_write (fd, (uint32_t) iov[i].iov_base, iov[i].iov_len);
+      return total;
+    }
+  return transfer_vector (lookup_file (fd), iov, cnt, true);
+}
+
+/* Copy_file_range system call.  The data never passes through
+   user memory. */
+static uint32_t REGPARM
+sys_copy_file_range (uint32_t in_fd, uint32_t out_fd, uint32_t size)
+{
+  struct file *in = lookup_file (in_fd);
+  struct file *out = lookup_file (out_fd);
+  off_t copied;
+
+  if (is_dir (in) || is_dir (out))
+    return -1;
+  if (size > INT_MAX)
+    size = INT_MAX;
+  copied = file_copy (out, in, size);
+
+  /* Nothing copied before end of file means the write or the
+     copy buffer failed. */
+  if (copied == 0 && size > 0 && file_tell (in) < file_length (in))
+    return -1;
+  return copied;
+}
+
+/* Ring_setup system call.  Registers RING, with SIZE entries, as
+   the process's system call ring, replacing any earlier one.  A
+   null RING unregisters it. */
+static uint32_t REGPARM
+sys_ring_setup (uint32_t ring, uint32_t size, uint32_t c UNUSED)
+{
+  struct thread *t = thread_current ();
+
+  if (ring != 0
+      && (size == 0 || size > SYSCALL_RING_MAX || (size & (size - 1)) != 0
+          || ring % sizeof (uint32_t) != 0))
+    return false;
+  t->syscall_ring = (struct syscall_ring *) ring;
+  t->syscall_ring_size = ring != 0 ? size : 0;
+  return true;
+}
+
+/* Ring_enter system call.  Runs up to CNT of the calls queued in
+   the process's ring, in order, and returns the number run.  A
+   call with a bad number, including ring_enter() itself, gets -1
+   as its result instead of terminating the process. */
+static uint32_t REGPARM
+sys_ring_enter (uint32_t cnt, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct thread *t = thread_current ();
+  struct syscall_ring *ring = t->syscall_ring;
+  uint32_t head, tail, done;
+
+  if (ring == NULL)
+    return -1;
+  copy_in (&head, &ring->head, sizeof head);
+  copy_in (&tail, &ring->tail, sizeof tail);
+  for (done = 0; head != tail && done < cnt; done++)
+    {
+      struct syscall_entry *ue;
+      struct syscall_entry e;
+
+      ue = &ring->entries[head & (t->syscall_ring_size - 1)];
+      copy_in (&e, ue, sizeof e);
+      if (e.nr < SYSCALL_CNT && syscalls[e.nr].func != NULL
+          && e.nr != SYS_RING_ENTER)
+        e.result = syscalls[e.nr].func (e.args[0], e.args[1], e.args[2]);
+      else
+        e.result = -1;
+
+      /* Each entry is a system call of its own, so it lets go of
+         its files before the next one takes any. */
+      syscall_release_files ();
+      copy_out (&ue->result, &e.result, sizeof e.result);
+
+      /* The call may have replaced or removed the ring. */
+      head++;
+      copy_out (&ring->head, &head, sizeof head);
+      if (t->syscall_ring != ring)
+        return done + 1;
+    }
+  return done;
+}
+
+/* Memstat system call.  Copies the page and block allocators'
+   statistics into the struct memstat at STAT.  Returns 0, or -1
+   if STAT is not writable. */
+static uint32_t REGPARM
+sys_memstat (uint32_t stat, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct memstat ms;
+
+  memset (&ms, 0, sizeof ms);
+  palloc_get_stats (&ms);
+  malloc_get_stats (&ms);
+  return copy_to_user ((void *) stat, &ms, sizeof ms) ? 0 : -1;
+}
+
+/* Futex wait system call.  Returns 0 after being woken, or -1
+   without sleeping if the word at UADDR does not hold EXPECTED. */
+static uint32_t REGPARM
+sys_futex_wait (uint32_t uaddr, uint32_t expected, uint32_t c UNUSED)
+{
+  switch (futex_wait ((const uint32_t *) uaddr, expected))
+    {
+    case FUTEX_WOKEN:
+      return 0;
+    case FUTEX_AGAIN:
+      return -1;
+    default:
+      kill_process ();
+    }
+}
+
+/* Futex wake system call.  Returns the number of threads woken. */
+static uint32_t REGPARM
+sys_futex_wake (uint32_t uaddr, uint32_t cnt, uint32_t c UNUSED)
+{
+  int woken = futex_wake ((const uint32_t *) uaddr, (int) cnt);
+
+  if (woken < 0)
+    kill_process ();
+  return woken;
+}
+
+/* Readdir_batch system call.  Reads up to CNT entries of the
+   directory open as FD into the struct dirent array at UENTS and
+   returns the number read, 0 at the end of the directory, or -1
+   if FD is not a directory.  The entries go out a page at a
+   time. */
+static uint32_t REGPARM
+sys_readdir_batch (uint32_t fd, uint32_t uents, uint32_t cnt)
+{
+  struct file *file = lookup_file (fd);
+  struct dirent *ents;
+  struct dir *dir;
+  uint32_t total = 0;
+
+  if (!is_dir (file))
+    return -1;
+  dir = dir_open (inode_reopen (file_get_inode (file)));
+  ents = palloc_get_page (0);
+  if (dir == NULL || ents == NULL)
+    {
+      dir_close (dir);
+      palloc_free_page (ents);
+      return -1;
+    }
+
+  dir_seek (dir, file_tell (file));
+  while (total < cnt)
+    {
+      size_t chunk = PGSIZE / sizeof *ents;
+      int n;
+
+      if (chunk > cnt - total)
+        chunk = cnt - total;
+      n = dir_readdir_many (dir, ents, chunk);
+      if (n <= 0)
+        break;
+      if (!copy_to_user ((struct dirent *) uents + total, ents,
+                         n * sizeof *ents))
+        {
+          dir_close (dir);
+          palloc_free_page (ents);
+          kill_process ();
+        }
+      total += n;
+      if ((size_t) n < chunk)
+        break;
+    }
+  file_seek (file, dir_tell (dir));
+  dir_close (dir);
+  palloc_free_page (ents);
+  return total;
+}
+
+/* Fallocate system call.  Reserves disk space for the first
+   LENGTH bytes of the file open as FD, extending it to LENGTH
+   bytes if it is shorter, so that later writes there neither
+   fail for lack of space nor scatter the file.  The new space
+   reads as zeros. */
+static uint32_t REGPARM
+sys_fallocate (uint32_t fd, uint32_t length, uint32_t c UNUSED)
+{
+  struct file *file = lookup_file (fd);
+
+  if (file_get_inode (file) == NULL || is_dir (file) || length > INT_MAX)
+    return false;
+  return inode_reserve (file_get_inode (file), length);
+}
+
+/* Sched_edf system call: runs the process in the deadline class
+   for BUDGET timer ticks of every PERIOD, or in its priority
+   class again if PERIOD is 0.  Fails if admission control
+   refuses the parameters. */
+static uint32_t REGPARM
+sys_sched_edf (uint32_t period, uint32_t budget, uint32_t c UNUSED)
+{
+  return thread_set_edf (period, budget);
+}
+
+/* Cpu_quota system call: limits the process, and the children
+   it starts from now on, to QUOTA timer ticks of CPU time every
+   PERIOD between them, or lifts the limit if QUOTA is 0. */
+static uint32_t REGPARM
+sys_cpu_quota (uint32_t quota, uint32_t period, uint32_t c UNUSED)
+{
+  return thread_set_quota (quota, period);
+}
+
+/* Thread_create system call: starts a thread in the process at
+   user address EIP, with FUNC and AUX as its arguments. */
+static uint32_t REGPARM
+sys_thread_create (uint32_t eip, uint32_t func, uint32_t aux)
+{
+  if (!is_user_vaddr ((void *) eip))
+    return TID_ERROR;
+  return process_thread_create ((void (*) (void)) eip, (void *) func,
+                                (void *) aux);
+}
+
+/* Thread_join system call. */
+static uint32_t REGPARM
+sys_thread_join (uint32_t tid, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return process_thread_join (tid);
+}
+
+/* Thread_exit system call. */
+static uint32_t REGPARM
+sys_thread_exit (uint32_t value, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  process_thread_exit (value);
+}
+
+/* Threadstat system call: copies the CPU accounting of thread
+   TID, which may be any live thread, into the struct threadstat
+   at STATS.  Returns false if there is no such thread. */
+static uint32_t REGPARM
+sys_threadstat (uint32_t tid, uint32_t stats, uint32_t c UNUSED)
+{
+  struct threadstat ts;
+
+  if (!thread_get_stats (tid, &ts))
+    return false;
+  copy_out ((void *) stats, &ts, sizeof ts);
+  return true;
+}
+
+/* Stats system call: copies the kernel-wide counters into the
+   struct sysstat at STAT, but no more than SIZE bytes of it.
+   Returns the size of the kernel's struct sysstat. */
+static uint32_t REGPARM
+sys_stats (uint32_t stat, uint32_t size, uint32_t c UNUSED)
+{
+  struct sysstat ss;
+
+  memset (&ss, 0, sizeof ss);
+  ss.version = SYSSTAT_VERSION;
+  ss.size = sizeof ss;
+  thread_get_sched_stats (&ss);
+  palloc_get_stats (&ss.mem);
+  malloc_get_stats (&ss.mem);
+  block_get_stats (&ss);
+  intr_get_stats (&ss);
+  cache_get_stats (&ss);
+#ifdef VM
+  page_get_fault_stats (&ss.faults);
+  ss.proc_faults = thread_current ()->leader->faults;
+#endif
+
+  if (size > sizeof ss)
+    size = sizeof ss;
+  copy_out ((void *) stat, &ss, size);
+  return sizeof ss;
+}
+
+/* Sched_setaffinity system call: lets the calling thread run
+   only on the CPUs whose bits are set in MASK, bit N for CPU N.
+   Fails if none of them schedules threads. */
+static uint32_t REGPARM
+sys_sched_setaffinity (uint32_t mask, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return thread_set_affinity (mask);
+}
+
+/* Sched_getaffinity system call: returns the CPUs the calling
+   thread may run on, as for sched_setaffinity. */
+static uint32_t REGPARM
+sys_sched_getaffinity (uint32_t a UNUSED, uint32_t b UNUSED,
+                       uint32_t c UNUSED)
+{
+  return thread_get_affinity ();
+}
+
+/* Pipe system call: creates a pipe and stores file descriptors
+   for its read and write ends in the 2-element array at UFDS. */
+static uint32_t REGPARM
+sys_pipe (uint32_t ufds, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct file *read_end, *write_end;
+  int fds[2];
+
+  if (!pipe_create (&read_end, &write_end))
+    return false;
+  fds[0] = fd_open (read_end);
+  fds[1] = fd_open (write_end);
+  if (fds[0] < 0 || fds[1] < 0)
+    {
+      if (fds[0] >= 0)
+        fd_close (fds[0]);
+      if (fds[1] >= 0)
+        fd_close (fds[1]);
+      return false;
+    }
+  copy_out ((int *) ufds, fds, sizeof fds);
+  return true;
+}
+
+/* Dup2 system call. */
+static uint32_t REGPARM
+sys_dup2 (uint32_t old_fd, uint32_t new_fd, uint32_t c UNUSED)
+{
+  return fd_dup2 (old_fd, new_fd);
+}
+
+/* Starts the asynchronous read or write, according to WRITE,
+   described by the struct aiocb at user address UAIOCB. */
+static int
+submit_aio (uint32_t uaiocb, bool write)
+{
+  struct aiocb cb;
+  struct file *file;
+  int id;
+
+  copy_in (&cb, (const struct aiocb *) uaiocb, sizeof cb);
+  file = lookup_file (cb.fd);
+  if (file_get_inode (file) == NULL || is_dir (file))
+    return -1;
+  id = aio_submit (file, write, cb.buf, cb.size, cb.offset);
+  if (id == AIO_FAULT)
+    kill_process ();
+  return id;
+}
+
+/* Aio_read system call. */
+static uint32_t REGPARM
+sys_aio_read (uint32_t uaiocb, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return submit_aio (uaiocb, false);
+}
+
+/* Aio_write system call. */
+static uint32_t REGPARM
+sys_aio_write (uint32_t uaiocb, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return submit_aio (uaiocb, true);
+}
+
+/* Aio_wait system call. */
+static uint32_t REGPARM
+sys_aio_wait (uint32_t uevents, uint32_t cnt, uint32_t c UNUSED)
+{
+  int n = aio_reap ((struct aio_event *) uevents, cnt);
+
+  if (n == AIO_FAULT)
+    kill_process ();
+  return n;
+}
+
+/* Poll system call. */
+static uint32_t REGPARM
+sys_poll (uint32_t ufds, uint32_t cnt, uint32_t timeout)
+{
+  struct pollfd fds[POLL_MAX];
+  int ready;
+
+  if (cnt > POLL_MAX)
+    return -1;
+  copy_in (fds, (const struct pollfd *) ufds, cnt * sizeof *fds);
+  ready = poll_wait (fds, cnt, timeout);
+  if (ready >= 0)
+    copy_out ((struct pollfd *) ufds, fds, cnt * sizeof *fds);
+  return ready;
+}
+
+/* Sbrk system call. */
+static uint32_t REGPARM
+sys_sbrk (uint32_t increment, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return (uint32_t) process_sbrk ((intptr_t) increment);
+}
+
+/* Direct_io system call: makes reads and writes of FD bypass the
+   buffer cache if DIRECT is nonzero, or use it again if it is
+   zero.  Fails for a directory or a pipe. */
+static uint32_t REGPARM
+sys_direct_io (uint32_t fd, uint32_t direct, uint32_t c UNUSED)
+{
+  struct file *file = lookup_file (fd);
+
+  if (file_get_inode (file) == NULL || is_dir (file))
+    return false;
+  file_set_direct (file, direct != 0);
+  return true;
+}
+
+/* Fadvise system call: applies access hint ADVICE to FD.  Fails
+   for a directory or an invalid hint. */
+static uint32_t REGPARM
+sys_fadvise (uint32_t fd, uint32_t advice, uint32_t c UNUSED)
+{
+  struct file *file = lookup_file (fd);
+
+  if (is_dir (file))
+    return false;
+  return file_advise (file, advice);
+}
+
+/* Tune system call: stores the value of the tunable named NAME
+   in *OLD, if OLD is nonnull, then sets it to *NEW, if NEW is
+   nonnull.  Fails, changing nothing, if there is no such
+   tunable or it cannot take *NEW. */
+static uint32_t REGPARM
+sys_tune (uint32_t uname, uint32_t unew, uint32_t uold)
+{
+  unsigned old, new = 0;
+  char *name;
+  bool success;
+
+  if (unew != 0)
+    copy_in (&new, (const unsigned *) unew, sizeof new);
+  name = copy_in_string ((const char *) uname);
+  success = (tunable_get (name, &old)
+             && (unew == 0 || tunable_set (name, new, false)));
+  palloc_free_page (name);
+  if (success && uold != 0)
+    copy_out ((unsigned *) uold, &old, sizeof old);
+  return success;
+}
+
+#ifdef VM
+/* Mmap system call. */
+static uint32_t REGPARM
+sys_mmap (uint32_t fd, uint32_t addr, uint32_t c UNUSED)
+{
+  struct file *file = fd_lookup (fd);
+  mapid_t mapping;
+
+  mapping = (file != NULL && !is_dir (file)
+             ? mmap_map (file, (void *) addr) : MAP_FAILED);
+  file_close (file);
+  return mapping;
+}
+
+/* Munmap system call. */
+static uint32_t REGPARM
+sys_munmap (uint32_t mapping, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  mmap_unmap (mapping);
+  return 0;
+}
+
+/* Madvise system call. */
+static uint32_t REGPARM
+sys_madvise (uint32_t addr, uint32_t length, uint32_t advice)
+{
+  return page_advise ((void *) addr, length, advice);
+}
+
+/* Mlock system call. */
+static uint32_t REGPARM
+sys_mlock (uint32_t addr, uint32_t length, uint32_t c UNUSED)
+{
+  return page_lock ((void *) addr, length, true);
+}
+
+/* Munlock system call. */
+static uint32_t REGPARM
+sys_munlock (uint32_t addr, uint32_t length, uint32_t c UNUSED)
+{
+  return page_lock ((void *) addr, length, false);
+}
+
+/* Rss_limit system call. */
+static uint32_t REGPARM
+sys_rss_limit (uint32_t limit, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return frame_set_rss_limit (limit);
+}
+
+/* Checkpoint system call. */
+static uint32_t REGPARM
+sys_checkpoint (uint32_t ufile, uint32_t uregs, uint32_t c UNUSED)
+{
+  struct checkpoint_regs regs;
+  char *file;
+  bool ok;
+
+  copy_in (&regs, (const void *) uregs, sizeof regs);
+  file = copy_in_string ((const char *) ufile);
+  ok = checkpoint_save (file, &regs);
+  palloc_free_page (file);
+  return ok ? 0 : -1;
+}
+
+/* Restore system call. */
+static uint32_t REGPARM
+sys_restore (uint32_t ufile, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *file = copy_in_string ((const char *) ufile);
+  tid_t tid = process_restore (file);
+
+  palloc_free_page (file);
+  return tid;
+}
+
+/* Shm_create system call. */
+static uint32_t REGPARM
+sys_shm_create (uint32_t uname, uint32_t size, uint32_t c UNUSED)
+{
+  char *name = copy_in_string ((const char *) uname);
+  bool ok = shm_create (name, size);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/* Shm_remove system call. */
+static uint32_t REGPARM
+sys_shm_remove (uint32_t uname, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  char *name = copy_in_string ((const char *) uname);
+  bool ok = shm_remove (name);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/* Shm_map system call. */
+static uint32_t REGPARM
+sys_shm_map (uint32_t uname, uint32_t addr, uint32_t c UNUSED)
+{
+  char *name = copy_in_string ((const char *) uname);
+  bool ok = shm_map (name, (void *) addr);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/* Shm_unmap system call. */
+static uint32_t REGPARM
+sys_shm_unmap (uint32_t addr, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return shm_unmap ((void *) addr);
+}
+#endif
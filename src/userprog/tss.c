@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,6 +76,15 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* SYSENTER model-specific registers.  See [IA32-v3a] 4.8.7
+   "Performing Fast Calls to System Procedures with the SYSENTER
+   and SYSEXIT Instructions". */
+#define MSR_SYSENTER_CS 0x174   /* Kernel code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Kernel entry point. */
+
+static void sysenter_init (void);
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +96,33 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+  sysenter_init ();
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Enables SYSENTER in userprog/sysenter.S as a faster way into
+   the kernel for system calls, if the CPU has it.  SYSENTER
+   loads its stack pointer from an MSR, not the TSS, so rather
+   than rewriting the MSR on every thread switch we point it at
+   the TSS's esp0 member and the entry stub loads the real stack
+   pointer from there. */
+static void
+sysenter_init (void)
+{
+  extern char sysenter_entry[];
+
+  if ((cpu_features () & CPUID_SEP) == 0)
+    return;
+
+  wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+  wrmsr (MSR_SYSENTER_ESP, (uintptr_t) &tss->esp0);
+  wrmsr (MSR_SYSENTER_EIP, (uintptr_t) sysenter_entry);
 }
 
 /* Returns the kernel TSS. */
@@ -0,0 +1,98 @@
+#include "userprog/uaccess.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory on a user process's behalf.
+
+   Rather than checking each user address against the page table
+   before touching it, these functions just touch it.  If the
+   access faults, page_fault() in userprog/exception.c sees a
+   kernel-mode fault on a user address and resumes execution at
+   the address these functions keep in eax during the access,
+   with eax set to -1.  So the cost of a bad pointer is a page
+   fault, and the cost of a good one is nothing beyond the copy.
+
+   This only works for addresses below PHYS_BASE, which every
+   function checks first, and only for accesses made here: any
+   other kernel code that faults on a user address jumps to
+   whatever happens to be in eax.  Kernel code must therefore
+   never touch user memory except through these functions. */
+
+/* Returns true if the SIZE bytes at UADDR lie below PHYS_BASE. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  const uint8_t *start = uaddr;
+  const uint8_t *end = start + size;
+
+  return end >= start && (size == 0 || is_user_vaddr (end - 1));
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be a
+   user address already checked to be below PHYS_BASE.  Moves
+   words, then the remaining bytes.  Returns false if a user page
+   turned out to be inaccessible. */
+static bool
+copy_user (void *dst, const void *src, size_t size)
+{
+  int result;
+
+  asm volatile ("movl $1f, %%eax\n\t"
+                "movl %%ecx, %%edx\n\t"
+                "shrl $2, %%ecx\n\t"
+                "rep movsl\n\t"
+                "movl %%edx, %%ecx\n\t"
+                "andl $3, %%ecx\n\t"
+                "rep movsb\n\t"
+                "xorl %%eax, %%eax\n"
+                "1:"
+                : "=&a" (result), "+D" (dst), "+S" (src), "+c" (size)
+                : : "edx", "memory");
+  return result == 0;
+}
+
+/* Reads a byte at user address USRC into *DST.  Returns false if
+   USRC is not accessible. */
+bool
+get_user (uint8_t *dst, const uint8_t *usrc)
+{
+  int result;
+
+  if (!is_user_vaddr (usrc))
+    return false;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*usrc));
+  if (result == -1)
+    return false;
+  *dst = result;
+  return true;
+}
+
+/* Writes BYTE to user address UDST.  Returns false if UDST is not
+   writable. */
+bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+
+  if (!is_user_vaddr (udst))
+    return false;
+  asm volatile ("movl $1f, %0; movb %b2, %1; 1:"
+                : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns false
+   if any of them is not accessible. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_user (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns false
+   if any of them is not writable. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, src, size);
+}
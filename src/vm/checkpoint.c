@@ -0,0 +1,689 @@
+#include "vm/checkpoint.h"
+#include <checkpoint.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/fdtable.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Process checkpoints.
+
+   checkpoint_save() writes the state of the current process to a
+   file from which checkpoint_restore() can later start a new
+   process, even after a reboot, that carries on from where the
+   checkpoint was taken.  The file holds the registers saved by
+   the user's checkpoint() call, the heap bounds, the name in the
+   working directory and the position of each file open on a
+   descriptor, and a record of every page.  Only pages whose
+   contents differ from what the executable would give them are
+   copied into the file.
+
+   Checkpoints are incremental.  A process keeps its checkpoint
+   files open as a chain of up to CKPT_CHAIN_MAX generations, and
+   each of its pages remembers the generation and offset that
+   hold its current contents.  A page forgets them as soon as it
+   is known to have changed: when the dirty bit in its page table
+   entry is found set, which may be when it is evicted, or when it
+   is copied.  A new checkpoint copies only the pages with no
+   generation, refers to the older files for the others, and then
+   clears the dirty bits.  Once the chain is full, the next
+   checkpoint starts another by copying every changed page.
+
+   A restored process reads its pages from the checkpoint files
+   as it touches them, as it does from its executable, and
+   continues the chain.  Writing to a file in use in a chain is
+   denied.
+
+   Only a process with a single thread and no memory-mapped
+   files, shared memory, asynchronous I/O or system call ring can
+   be checkpointed, and each file it has open, other than the
+   console, must be a file or directory named in its working
+   directory; pipes cannot be.  File names are resolved again in
+   the working directory of the process that restores, which
+   passes on its own console redirections, as exec() does.  FPU
+   state, mlock() locks and 4 MB pages are not kept. */
+
+#define CKPT_MAGIC 0x54504b43   /* "CKPT". */
+
+/* Most open files recorded by a checkpoint. */
+#define CKPT_FD_MAX 32
+
+/* An open file of a checkpointed process. */
+struct ckpt_fd
+  {
+    int32_t fd;                         /* Descriptor. */
+    int32_t pos;                        /* Current position. */
+    char name[NAME_MAX + 1];            /* Name in working directory. */
+  };
+
+/* The start of a checkpoint file. */
+struct ckpt_header
+  {
+    uint32_t magic;                     /* CKPT_MAGIC. */
+    uint32_t gen;                       /* Generation, from 1. */
+    char chain[CKPT_CHAIN_MAX - 1][CKPT_NAME_MAX + 1]; /* Older ones. */
+    char program[16];                   /* Executable's name. */
+    uint32_t exec_inumber;              /* Executable's inode sector. */
+    uint32_t exec_length;               /* Executable's length. */
+    struct checkpoint_regs regs;        /* Where to resume. */
+    uint32_t heap_start, brk;           /* Heap bounds. */
+    uint32_t page_cnt;                  /* Number of page records. */
+    uint32_t fd_cnt;                    /* Number of FDS in use. */
+    struct ckpt_fd fds[CKPT_FD_MAX];    /* Open files. */
+  };
+
+/* Where a page gets its contents. */
+enum ckpt_kind
+  {
+    CKPT_ZERO,                          /* All zeros. */
+    CKPT_EXEC,                          /* The executable. */
+    CKPT_SAVED                          /* A checkpoint file. */
+  };
+
+/* A record of a page.  The header takes the file's first page,
+   and the records follow, one after another, from the second.
+   Saved pages come after those, each page-aligned. */
+struct ckpt_page
+  {
+    uint32_t upage;                     /* User virtual address. */
+    uint8_t kind;                       /* A ckpt_kind. */
+    uint8_t writable;                   /* Writable by the process? */
+    uint16_t gen;                       /* CKPT_SAVED: generation. */
+    uint32_t ofs;                       /* Offset in file. */
+    uint32_t read_bytes;                /* CKPT_EXEC: bytes to read. */
+  };
+
+/* Page records in a page. */
+#define RECORDS_PER_PAGE (PGSIZE / sizeof (struct ckpt_page))
+
+/* A process's chain of checkpoints, in its leader. */
+struct checkpoint
+  {
+    unsigned gen_cnt;                   /* Generations in CHAIN. */
+    struct file *chain[CKPT_CHAIN_MAX]; /* Files, oldest first. */
+    char names[CKPT_CHAIN_MAX][CKPT_NAME_MAX + 1]; /* Their names. */
+    struct file *backing[CKPT_CHAIN_MAX]; /* Files restored from. */
+  };
+
+/* A checkpoint file opened for restoring. */
+struct checkpoint_image
+  {
+    struct file *file;                  /* The file. */
+    char name[CKPT_NAME_MAX + 1];       /* Its name. */
+    struct ckpt_header header;          /* Its header. */
+  };
+
+/* Returns the process's chain, creating an empty one if it has
+   none, or a null pointer if memory is short. */
+static struct checkpoint *
+get_chain (struct thread *t)
+{
+  if (t->checkpoint == NULL)
+    t->checkpoint = calloc (1, sizeof *t->checkpoint);
+  return t->checkpoint;
+}
+
+/* Returns true if FILE is the same file as one in chain C. */
+static bool
+in_chain (const struct checkpoint *c, struct file *file)
+{
+  struct inode *inode = file_get_inode (file);
+  size_t i;
+
+  for (i = 0; i < CKPT_CHAIN_MAX; i++)
+    if ((c->chain[i] != NULL && file_get_inode (c->chain[i]) == inode)
+        || (c->backing[i] != NULL
+            && file_get_inode (c->backing[i]) == inode))
+      return true;
+  return false;
+}
+
+/* Finds the inode numbered INUMBER in the current thread's
+   working directory and stores its name into NAME.  Returns true
+   if successful, false if it is not there. */
+static bool
+find_name (block_sector_t inumber, char name[NAME_MAX + 1])
+{
+  struct thread *cur = thread_current ();
+  struct dir *dir;
+  bool found = false;
+
+  dir = cur->cwd != NULL ? dir_reopen (cur->cwd) : dir_open_root ();
+  if (dir == NULL)
+    return false;
+  while (!found && dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      if (dir_lookup (dir, name, &inode))
+        {
+          found = inode_get_inumber (inode) == inumber;
+          inode_close (inode);
+        }
+    }
+  dir_close (dir);
+  return found;
+}
+
+/* Records process T's open files, other than the console, in H.
+   Returns false if one of them cannot be recorded. */
+static bool
+save_fds (struct thread *t, struct ckpt_header *h)
+{
+  size_t fd;
+
+  for (fd = 0; fd < t->fd_cnt; fd++)
+    {
+      struct file *file = fd_lookup (fd);
+      struct ckpt_fd *f = &h->fds[h->fd_cnt];
+      struct inode *inode;
+
+      if (file == NULL)
+        continue;
+      inode = file_get_inode (file);
+      if (inode == NULL || h->fd_cnt >= CKPT_FD_MAX
+          || !find_name (inode_get_inumber (inode), f->name))
+        {
+          file_close (file);
+          return false;
+        }
+      f->fd = fd;
+      f->pos = file_tell (file);
+      h->fd_cnt++;
+      file_close (file);
+    }
+  return true;
+}
+
+/* Makes process T's pages forget generation GEN of its
+   checkpoints and all later ones. */
+static void
+forget_gens (struct thread *t, unsigned gen)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      if (p->ckpt_gen >= gen)
+        p->ckpt_gen = 0;
+    }
+}
+
+/* Makes each of process T's resident pages whose dirty bit is
+   set forget the checkpoint that holds it.  The bits themselves
+   are cleared only as the pages are saved, because a 4 MB page
+   has one bit for all of its pages. */
+static void
+note_dirty (struct thread *t)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      if (p->kpage != NULL && pagedir_is_dirty (t->pagedir, p->upage))
+        {
+          p->dirty = true;
+          p->ckpt_gen = 0;
+        }
+    }
+}
+
+/* Describes page P of process T in record R of a checkpoint of
+   generation GEN.  If no earlier generation holds P's contents,
+   and they are not zeros or the executable's, first writes them
+   to FILE at *DATA_OFS and advances *DATA_OFS past them.  BOUNCE
+   is a page of memory.  Returns false if writing fails. */
+static bool
+save_page (struct thread *t, struct page *p, unsigned gen,
+           struct file *file, off_t *data_ofs, void *bounce,
+           struct ckpt_page *r)
+{
+  const void *data = bounce;
+  bool resident, ok;
+
+  r->upage = (uintptr_t) p->upage;
+  r->writable = p->writable;
+  r->gen = 0;
+  r->ofs = 0;
+  r->read_bytes = 0;
+  if (p->ckpt_gen != 0)
+    {
+      r->kind = CKPT_SAVED;
+      r->gen = p->ckpt_gen;
+      r->ofs = p->ckpt_ofs;
+      return true;
+    }
+  if (!p->dirty && (p->file == NULL || p->file == t->exec_file))
+    {
+      r->kind = p->file == NULL ? CKPT_ZERO : CKPT_EXEC;
+      r->ofs = p->ofs;
+      r->read_bytes = p->read_bytes;
+      return true;
+    }
+
+  /* A restored page from a chain that has since been replaced
+     has to be copied as well. */
+  resident = frame_pin (p);
+  if (resident)
+    data = p->kpage;
+  else if (p->swap_slot != SWAP_NONE)
+    swap_read (p->swap_slot, bounce);
+  else
+    {
+      memset (bounce, 0, PGSIZE);
+      if (p->file != NULL
+          && file_read_at (p->file, bounce, p->read_bytes, p->ofs)
+             != (off_t) p->read_bytes)
+        return false;
+    }
+  ok = file_write_at (file, data, PGSIZE, *data_ofs) == PGSIZE;
+  if (resident)
+    {
+      if (ok)
+        pagedir_set_dirty (t->pagedir, p->upage, false);
+      frame_unpin (p->kpage);
+    }
+  if (!ok)
+    return false;
+
+  r->kind = CKPT_SAVED;
+  r->gen = gen;
+  r->ofs = *data_ofs;
+  p->ckpt_gen = gen;
+  p->ckpt_ofs = *data_ofs;
+  *data_ofs += PGSIZE;
+  return true;
+}
+
+/* Writes records for all of process T's pages to FILE, as
+   generation GEN, with the contents of those that need it.
+   RECORDS and BOUNCE are pages of memory.  Returns true if
+   successful.  The caller must hold T's vm_lock. */
+static bool
+save_pages (struct thread *t, unsigned gen, struct file *file,
+            size_t page_cnt, struct ckpt_page *records, void *bounce)
+{
+  off_t record_ofs = PGSIZE;
+  off_t data_ofs = PGSIZE + ROUND_UP (page_cnt * sizeof *records, PGSIZE);
+  struct hash_iterator i;
+  size_t n = 0;
+
+  hash_first (&i, &t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+      if (!save_page (t, p, gen, file, &data_ofs, bounce, &records[n]))
+        return false;
+      if (++n == RECORDS_PER_PAGE)
+        {
+          if (file_write_at (file, records, PGSIZE, record_ofs) != PGSIZE)
+            return false;
+          record_ofs += PGSIZE;
+          n = 0;
+        }
+    }
+  return (n == 0
+          || file_write_at (file, records, n * sizeof *records, record_ofs)
+             == (off_t) (n * sizeof *records));
+}
+
+/* Writes a checkpoint of the current process, which is to resume
+   with REGS, to the file named NAME, creating it if necessary.
+   The checkpoint is incremental from the last one the process
+   took or was restored from, unless the chain of them is full.
+   Returns true if successful, false on failure or if the process
+   cannot be checkpointed, as described at the top of this
+   file. */
+bool
+checkpoint_save (const char *name, const struct checkpoint_regs *regs)
+{
+  struct thread *t = thread_current ()->leader;
+  struct checkpoint *c;
+  struct ckpt_header *h = NULL;
+  struct ckpt_page *records = NULL;
+  void *bounce = NULL;
+  struct file *file = NULL;
+  bool success = false;
+  unsigned gen;
+  size_t i;
+
+  if (strlen (name) > CKPT_NAME_MAX || t->thread_cnt != 0
+      || !list_empty (&t->mappings) || !list_empty (&t->shm_maps)
+      || t->aio != NULL || t->syscall_ring != NULL)
+    return false;
+  c = get_chain (t);
+  h = palloc_get_page (PAL_ZERO);
+  records = palloc_get_page (0);
+  bounce = palloc_get_page (0);
+  if (c == NULL || h == NULL || records == NULL || bounce == NULL)
+    goto done;
+
+  filesys_create (name, 0);
+  file = filesys_open (name);
+  if (file == NULL || inode_is_dir (file_get_inode (file))
+      || in_chain (c, file))
+    goto done;
+
+  gen = c->gen_cnt < CKPT_CHAIN_MAX ? c->gen_cnt + 1 : 1;
+  h->gen = gen;
+  for (i = 0; i + 1 < gen; i++)
+    strlcpy (h->chain[i], c->names[i], sizeof h->chain[i]);
+  strlcpy (h->program, t->name, sizeof h->program);
+  h->exec_inumber = inode_get_inumber (file_get_inode (t->exec_file));
+  h->exec_length = file_length (t->exec_file);
+  h->regs = *regs;
+  h->heap_start = (uintptr_t) t->heap_start;
+  h->brk = (uintptr_t) t->brk;
+  if (!save_fds (t, h))
+    goto done;
+
+  /* Until it is complete, the file does not look like a
+     checkpoint, even if it held one before. */
+  if (file_write_at (file, h, PGSIZE, 0) != PGSIZE)
+    goto done;
+
+  lock_acquire (&t->vm_lock);
+  if (gen == 1)
+    forget_gens (t, 1);
+  note_dirty (t);
+  h->page_cnt = hash_size (&t->pages);
+  success = save_pages (t, gen, file, h->page_cnt, records, bounce);
+  if (!success)
+    forget_gens (t, gen);
+  lock_release (&t->vm_lock);
+
+  h->magic = CKPT_MAGIC;
+  if (success && file_write_at (file, h, PGSIZE, 0) != PGSIZE)
+    {
+      lock_acquire (&t->vm_lock);
+      forget_gens (t, gen);
+      lock_release (&t->vm_lock);
+      success = false;
+    }
+  if (success)
+    {
+      if (gen == 1)
+        for (i = 0; i < c->gen_cnt; i++)
+          {
+            file_close (c->chain[i]);
+            c->chain[i] = NULL;
+          }
+      file_deny_write (file);
+      c->chain[gen - 1] = file;
+      strlcpy (c->names[gen - 1], name, sizeof c->names[gen - 1]);
+      c->gen_cnt = gen;
+      file = NULL;
+    }
+
+ done:
+  file_close (file);
+  palloc_free_page (bounce);
+  palloc_free_page (records);
+  palloc_free_page (h);
+  return success;
+}
+
+/* Reads the header of the checkpoint file FILE into H.  Returns
+   true if it is a checkpoint, false otherwise. */
+static bool
+read_header (struct file *file, struct ckpt_header *h)
+{
+  if (file_read_at (file, h, sizeof *h, 0) != sizeof *h
+      || h->magic != CKPT_MAGIC || h->gen < 1 || h->gen > CKPT_CHAIN_MAX
+      || h->fd_cnt > CKPT_FD_MAX)
+    return false;
+  h->program[sizeof h->program - 1] = '\0';
+  return true;
+}
+
+/* Opens the checkpoint in the file named NAME for restoring.
+   Returns the opened checkpoint, or a null pointer if NAME is not
+   a checkpoint or memory is short. */
+struct checkpoint_image *
+checkpoint_open (const char *name)
+{
+  struct checkpoint_image *image;
+
+  if (strlen (name) > CKPT_NAME_MAX)
+    return NULL;
+  image = malloc (sizeof *image);
+  if (image == NULL)
+    return NULL;
+  image->file = filesys_open (name);
+  if (image->file == NULL || !read_header (image->file, &image->header))
+    {
+      checkpoint_close (image);
+      return NULL;
+    }
+  strlcpy (image->name, name, sizeof image->name);
+  return image;
+}
+
+/* Returns the name of the executable of the process saved in
+   IMAGE, which must be loaded before calling
+   checkpoint_restore(). */
+const char *
+checkpoint_program (const struct checkpoint_image *image)
+{
+  return image->header.program;
+}
+
+/* Opens the files of IMAGE's chain into the current process's
+   chain C, denying writes to them.  Returns true if successful,
+   false if one is missing or is not the checkpoint it should
+   be. */
+static bool
+open_chain (struct checkpoint *c, struct checkpoint_image *image)
+{
+  const struct ckpt_header *h = &image->header;
+  struct ckpt_header *older;
+  bool success = true;
+  unsigned i;
+
+  older = malloc (sizeof *older);
+  if (older == NULL)
+    return false;
+  for (i = 0; success && i < h->gen; i++)
+    {
+      const char *name = i + 1 < h->gen ? h->chain[i] : image->name;
+      struct file *file = (i + 1 < h->gen
+                           ? filesys_open (name)
+                           : file_reopen (image->file));
+
+      c->backing[i] = file;
+      if (file == NULL)
+        {
+          success = false;
+          break;
+        }
+      file_deny_write (file);
+      if (i + 1 < h->gen
+          && (!read_header (file, older) || older->gen != i + 1))
+        success = false;
+      c->chain[i] = file_reopen (file);
+      if (c->chain[i] == NULL)
+        success = false;
+      else
+        file_deny_write (c->chain[i]);
+      strlcpy (c->names[i], name, sizeof c->names[i]);
+      c->gen_cnt = i + 1;
+    }
+  free (older);
+  return success;
+}
+
+/* Replaces the current process's pages by those recorded in
+   IMAGE, whose chain C has been opened.  RECORDS is a page of
+   memory.  Returns true if successful. */
+static bool
+restore_pages (struct thread *t, struct checkpoint *c,
+               struct checkpoint_image *image, struct ckpt_page *records)
+{
+  const struct ckpt_header *h = &image->header;
+  size_t i;
+
+  for (i = 0; i < h->page_cnt; i++)
+    {
+      struct ckpt_page *r = &records[i % RECORDS_PER_PAGE];
+      void *upage;
+      bool ok;
+
+      if (i % RECORDS_PER_PAGE == 0)
+        {
+          size_t n = h->page_cnt - i;
+          off_t size;
+
+          if (n > RECORDS_PER_PAGE)
+            n = RECORDS_PER_PAGE;
+          size = n * sizeof *records;
+          if (file_read_at (image->file, records, size,
+                            PGSIZE + i * sizeof *records) != size)
+            return false;
+        }
+
+      upage = (void *) r->upage;
+      if (pg_ofs (upage) != 0 || upage == NULL || !is_user_vaddr (upage))
+        return false;
+      if (page_lookup (upage) != NULL)
+        page_remove (upage);
+      if (r->kind == CKPT_ZERO)
+        ok = page_add_zero (upage, r->writable);
+      else if (r->kind == CKPT_EXEC)
+        ok = (r->read_bytes <= PGSIZE
+              && page_add_file (upage, t->exec_file, r->ofs, r->read_bytes,
+                                r->writable));
+      else if (r->kind == CKPT_SAVED && r->gen >= 1 && r->gen <= h->gen)
+        {
+          ok = page_add_file (upage, c->backing[r->gen - 1], r->ofs,
+                              PGSIZE, r->writable);
+          if (ok)
+            {
+              struct page *p = page_lookup (upage);
+              p->ckpt_gen = r->gen;
+              p->ckpt_ofs = r->ofs;
+            }
+        }
+      else
+        ok = false;
+      if (!ok)
+        return false;
+    }
+  return true;
+}
+
+/* Reopens the files recorded in IMAGE on their descriptors in the
+   current process.  Descriptors 0 and 1 that the process already
+   had redirected are left alone.  Returns true if successful. */
+static bool
+restore_fds (const struct checkpoint_image *image)
+{
+  const struct ckpt_header *h = &image->header;
+  size_t i;
+
+  for (i = 0; i < h->fd_cnt; i++)
+    {
+      const struct ckpt_fd *f = &h->fds[i];
+      char name[NAME_MAX + 1];
+      struct file *file;
+
+      if (f->fd <= STDOUT_FILENO && fd_is_open (f->fd))
+        continue;
+      strlcpy (name, f->name, sizeof name);
+      file = filesys_open (name);
+      if (file == NULL)
+        return false;
+      file_seek (file, f->pos);
+      if (!fd_install (f->fd, file))
+        return false;
+    }
+  return true;
+}
+
+/* Gives the current process, freshly loaded with the executable
+   named by checkpoint_program(), the state saved in IMAGE, and
+   sets up IF_ to resume it where it took the checkpoint, with
+   checkpoint() returning 1.  Returns true if successful.  On
+   failure the process must exit. */
+bool
+checkpoint_restore (struct checkpoint_image *image, struct intr_frame *if_)
+{
+  struct thread *t = thread_current ();
+  const struct ckpt_header *h = &image->header;
+  struct checkpoint *c;
+  struct ckpt_page *records;
+  bool success;
+
+  if (inode_get_inumber (file_get_inode (t->exec_file)) != h->exec_inumber
+      || (uint32_t) file_length (t->exec_file) != h->exec_length)
+    return false;
+  c = get_chain (t);
+  if (c == NULL || !open_chain (c, image))
+    return false;
+  records = palloc_get_page (0);
+  if (records == NULL)
+    return false;
+  success = restore_pages (t, c, image, records) && restore_fds (image);
+  palloc_free_page (records);
+  if (!success)
+    return false;
+
+  t->heap_start = (uint8_t *) h->heap_start;
+  t->brk = (uint8_t *) h->brk;
+  if_->ebx = h->regs.ebx;
+  if_->esi = h->regs.esi;
+  if_->edi = h->regs.edi;
+  if_->ebp = h->regs.ebp;
+  if_->esp = (void *) h->regs.esp;
+  if_->eip = (void (*) (void)) h->regs.eip;
+  if_->eax = 1;
+  return true;
+}
+
+/* Closes IMAGE, which may be a null pointer. */
+void
+checkpoint_close (struct checkpoint_image *image)
+{
+  if (image != NULL)
+    {
+      file_close (image->file);
+      free (image);
+    }
+}
+
+/* Closes the current process's checkpoint files, once its pages,
+   which may be read from them, are gone. */
+void
+checkpoint_release (void)
+{
+  struct thread *t = thread_current ();
+  struct checkpoint *c = t->checkpoint;
+  size_t i;
+
+  if (c == NULL)
+    return;
+  for (i = 0; i < CKPT_CHAIN_MAX; i++)
+    {
+      file_close (c->chain[i]);
+      file_close (c->backing[i]);
+    }
+  free (c);
+  t->checkpoint = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef VM_CHECKPOINT_H
+#define VM_CHECKPOINT_H
+
+#include <stdbool.h>
+
+/* Most generations in a chain of incremental checkpoints. */
+#define CKPT_CHAIN_MAX 8
+
+/* Longest checkpoint file name. */
+#define CKPT_NAME_MAX 63
+
+struct checkpoint_regs;
+struct checkpoint_image;
+struct intr_frame;
+
+bool checkpoint_save (const char *file, const struct checkpoint_regs *);
+struct checkpoint_image *checkpoint_open (const char *file);
+const char *checkpoint_program (const struct checkpoint_image *);
+bool checkpoint_restore (struct checkpoint_image *, struct intr_frame *);
+void checkpoint_close (struct checkpoint_image *);
+void checkpoint_release (void);
+
+#endif /* vm/checkpoint.h */
@@ -0,0 +1,1098 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <madvise.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every page of the user pool that holds a user page has an
+   entry here listing the supplemental page table entries, and
+   through them the threads and user virtual addresses, that map
+   it.  Usually there is just one; after a fork, copy-on-write
+   pages are shared until written.  Entries are indexed by
+   physical page number, so finding a frame's entry is O(1).
+
+   When the user pool is exhausted, frame_alloc() evicts a frame
+   chosen by the clock (second chance) algorithm: the hand sweeps
+   the table, clearing the accessed bit of each in-use frame it
+   passes and stopping at the first one whose bit was already
+   clear.  Each step either clears a bit or finds a victim, so
+   eviction is O(1) amortized.  Modified victims are written to
+   swap in batches; see evict().  Shared frames are passed over:
+   they stay resident until sharing ends.  Pages advised
+   MADV_DONTNEED get no second chance, and pages locked with
+   mlock() or mapped as part of a 4 MB page (see page.c) are never
+   chosen.
+
+   Frames holding read-only pages of a file, which in practice
+   means program text, are also entered in text_frames under
+   their inode and offset, so that every process running the same
+   executable maps the same frames.
+
+   Frames holding pages of memory-mapped files are likewise
+   entered in their inode's mapped pages (see inode.h) and shared
+   by every mapping of the same page of the same file, in however
+   many processes.  Through the inode, read() and write() of the
+   file use the same frames, so there is one copy of each mapped
+   page and every view of it is the same.
+
+   Frames of shared memory segments (see vm/shm.c) are held by
+   their segment as well as by the pages that map them, in
+   however many processes.  The segment's hold keeps such a frame
+   allocated while nothing maps it and keeps it from being
+   evicted at all; the frame is freed only once the segment is
+   gone and the last page that mapped it has been released.
+
+   So that faults seldom have to evict, a reclaimer thread keeps
+   a reserve of free frames: once fewer than frame_low_water user
+   pool pages are free, it runs the same clock, in the
+   background, until frame_high_water are.  Eviction from
+   frame_alloc() remains as the fallback when the reserve runs
+   dry.
+
+   A process may be limited to a number of resident pages, its
+   own with rss_limit() or else frame_rss_limit.  Once it has that
+   many, each frame it needs comes from evicting one of its own
+   pages, by a clock with a hand of its own that passes over
+   other processes' frames, so that a process with a huge
+   working set pushes out only itself.  If none of its pages can
+   be evicted, it takes a frame as usual.  Every page attached to
+   a frame counts toward its process's resident pages, shared or
+   not.
+
+   The "-evict=random" option replaces the clock by a policy that
+   ignores accessed bits and takes frames at random, as a
+   baseline for judging the clock with tests/bench/user.
+
+   A merging thread finds frames of private, writable pages with
+   the same contents, in any processes, and maps all of those
+   pages copy-on-write to one of the frames, freeing the rest.
+   Every MERGE_INTERVAL milliseconds it hashes the next
+   frame_merge_rate frames of the table with hash_bytes().  A
+   frame whose hash is the same as at the last pass is taken to
+   be stable: it joins another frame already merged with the same
+   contents, or else one found earlier in this pass, kept in
+   merge_candidates.  Merged frames are kept in merged_frames
+   until written or freed; like other shared frames, they are not
+   evicted while shared.  Merging moves a page to another frame,
+   which is safe only because nothing names a private page by its
+   frame: a futex on one, in particular, is keyed by its process
+   and user address (see userprog/futex.c), so a thread waiting
+   on a word in a page that is merged is still woken. */
+
+/* Where a frame is in same-page merging. */
+enum merge_state
+  {
+    MERGE_NONE,                 /* In neither table. */
+    MERGE_CANDIDATE,            /* In merge_candidates. */
+    MERGE_MERGED                /* In merged_frames. */
+  };
+
+/* A user frame. */
+struct frame
+  {
+    void *kpage;                /* Kernel address, or null if free. */
+    struct list pages;          /* Pages mapping it. */
+    unsigned pin_cnt;           /* Exempt from eviction while nonzero. */
+    bool segment;               /* Held by a shared memory segment? */
+
+    /* In text_frames, if INODE is nonnull and MAPPED is false, or
+       else in INODE's mapped pages as FILE_PAGE. */
+    struct hash_elem text_elem;
+    struct inode *inode;        /* File the contents come from. */
+    off_t ofs;                  /* Offset in INODE. */
+    bool mapped;                /* Page of a memory-mapped file? */
+    struct inode_page file_page;
+
+    /* Same-page merging. */
+    struct hash_elem merge_elem;        /* In the table MERGE names. */
+    enum merge_state merge;
+    unsigned checksum;                  /* Hash of contents at last pass. */
+    bool checksummed;                   /* CHECKSUM valid? */
+  };
+
+static struct frame *frames;    /* One entry per physical page. */
+static size_t frame_cnt;        /* Number of entries. */
+static size_t clock_hand;       /* Next entry the clock examines. */
+static struct hash text_frames; /* Shareable read-only file pages. */
+static size_t user_frame_cnt;   /* Pages in the user pool. */
+static size_t used_cnt;         /* Pages of the user pool in use. */
+static bool reclaim_wanted;     /* Reclaimer woken but not done? */
+static size_t locked_cnt;       /* Pages locked with frame_mlock(). */
+static struct hash merged_frames;       /* Read-only, shared by merging. */
+static struct hash merge_candidates;    /* Stable frames seen this pass. */
+static size_t merge_hand;       /* Next entry to merge. */
+static struct lock frame_lock;  /* Protects all of the above. */
+
+/* Free frames the reclaimer keeps in reserve.  Zero selects a
+   default based on the size of the user pool. */
+size_t frame_low_water;
+size_t frame_high_water;
+
+/* Eviction policy. */
+enum frame_policy frame_policy;
+
+/* Most pages a process may have resident before replacing its
+   own pages instead of others', for processes that have not set
+   a limit of their own.  Zero means no limit. */
+size_t frame_rss_limit;
+
+/* Frames the merging thread examines every MERGE_INTERVAL
+   milliseconds.  Zero turns merging off. */
+#define MERGE_INTERVAL 100
+size_t frame_merge_rate = 256;
+
+static struct semaphore reclaim_sema;   /* Upped to wake reclaimer. */
+static thread_func reclaimer NO_RETURN;
+static thread_func merger NO_RETURN;
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+static void forget_file (struct frame *);
+static void forget_merge (struct frame *);
+static void attach_page (struct frame *, struct page *);
+static void detach_page (struct page *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  frame_cnt = init_ram_pages;
+  frames = calloc (frame_cnt, sizeof *frames);
+  if (frames == NULL)
+    PANIC ("can't allocate frame table");
+  clock_hand = merge_hand = 0;
+  if (!hash_init (&text_frames, text_hash, text_less, NULL)
+      || !hash_init (&merged_frames, merge_hash, merge_less, NULL)
+      || !hash_init (&merge_candidates, merge_hash, merge_less, NULL))
+    PANIC ("can't allocate text frame table");
+  lock_init_named (&frame_lock, "frame");
+
+  user_frame_cnt = palloc_user_page_cnt ();
+  used_cnt = 0;
+  if (frame_low_water == 0)
+    frame_low_water = user_frame_cnt / 64 + 1;
+  if (frame_high_water <= frame_low_water)
+    frame_high_water = 2 * frame_low_water;
+  reclaim_wanted = false;
+  sema_init (&reclaim_sema, 0);
+}
+
+/* Starts the reclaimer and merging threads.  Eviction may need
+   swap, so this must come after swap_init(). */
+void
+frame_reclaim_start (void)
+{
+  thread_create ("reclaim", PRI_DEFAULT, reclaimer, NULL);
+  thread_create ("merge", PRI_MIN, merger, NULL);
+}
+
+/* Returns the frame table entry for KPAGE. */
+static struct frame *
+frame_lookup (void *kpage)
+{
+  uintptr_t pfn = vtop (kpage) >> PGBITS;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (pfn < frame_cnt);
+  return &frames[pfn];
+}
+
+/* Adds PAGE to the pages that map F and counts it as resident.
+   frame_lock must be held. */
+static void
+attach_page (struct frame *f, struct page *page)
+{
+  list_push_back (&f->pages, &page->frame_elem);
+  page->owner->resident_cnt++;
+}
+
+/* Removes PAGE from the pages that map its frame.  frame_lock
+   must be held. */
+static void
+detach_page (struct page *page)
+{
+  list_remove (&page->frame_elem);
+  page->owner->resident_cnt--;
+}
+
+/* Returns true if process T has as many pages resident as it may
+   before replacing its own. */
+static bool
+at_rss_limit (const struct thread *t)
+{
+  size_t limit = t->resident_limit != 0 ? t->resident_limit : frame_rss_limit;
+  return limit != 0 && t->resident_cnt >= limit;
+}
+
+/* Returns the page held by unshared frame F. */
+static struct page *
+frame_page (struct frame *f)
+{
+  ASSERT (list_size (&f->pages) == 1);
+  return list_entry (list_front (&f->pages), struct page, frame_elem);
+}
+
+/* Returns true if F is mapped by more than one page. */
+static bool
+frame_is_shared (struct frame *f)
+{
+  return list_begin (&f->pages) != list_rbegin (&f->pages);
+}
+
+/* pagedir_scan_func for test_and_clear_accessed(). */
+static void
+note_accessed (const void *upage UNUSED, bool accessed, bool dirty UNUSED,
+               void *accessedp)
+{
+  *(bool *) accessedp = accessed;
+}
+
+/* Clears the accessed bit of UPAGE in PD and returns its old
+   value, with a single page table walk. */
+static bool
+test_and_clear_accessed (uint32_t *pd, const void *upage)
+{
+  bool accessed = false;
+
+  pagedir_scan_and_clear_accessed (pd, upage, (const uint8_t *) upage + PGSIZE,
+                                   note_accessed, &accessed);
+  return accessed;
+}
+
+/* Chooses a frame with the clock algorithm, or at random under
+   FRAME_RANDOM, and pages out its contents.  If OWNER is nonnull,
+   chooses only among process OWNER's unshared frames, with its
+   own clock hand.  Returns the freed frame, or a null pointer if
+   no frame could be paged out.
+
+   A clean victim is simply dropped.  A modified one has to go to
+   swap; since that means waiting for the disk anyway, the sweep
+   goes on to collect up to SWAP_BATCH modified victims and writes
+   them out together.  The extra frames go back to the user pool
+   for the allocations that are sure to follow.  frame_lock must
+   be held. */
+static struct frame *
+evict (struct thread *owner)
+{
+  struct frame *batch[SWAP_BATCH];
+  struct page *pages[SWAP_BATCH];
+  size_t *hand = owner != NULL ? &owner->clock_hand : &clock_hand;
+  size_t batch_cnt = 0;
+  size_t scanned, i;
+
+  for (scanned = 0; scanned < 2 * frame_cnt && batch_cnt < SWAP_BATCH;
+       scanned++)
+    {
+      struct frame *f;
+      struct page *p;
+      uint32_t *pd;
+
+      if (frame_policy == FRAME_RANDOM)
+        *hand = thread_random () % frame_cnt;
+      f = &frames[*hand];
+      *hand = (*hand + 1) % frame_cnt;
+      if (f->kpage == NULL || f->pin_cnt > 0 || f->segment
+          || frame_is_shared (f) || frame_page (f)->locked
+          || frame_page (f)->huge)
+        continue;
+
+      p = frame_page (f);
+      if (owner != NULL && p->owner != owner)
+        continue;
+
+      /* The owner is exiting and about to free it anyway.  It
+         cannot drop its page directory while we hold frame_lock
+         (see frame_clear_pagedir()). */
+      pd = p->owner->pagedir;
+      if (pd == NULL)
+        continue;
+
+      if (test_and_clear_accessed (pd, p->upage)
+          && frame_policy == FRAME_CLOCK && p->advice != MADV_DONTNEED)
+        continue;
+      if (page_out (p))
+        {
+          /* A clean page is as good a victim as any. */
+          for (i = 0; i < batch_cnt; i++)
+            batch[i]->pin_cnt--;
+          detach_page (p);
+          forget_file (f);
+          return f;
+        }
+      else
+        {
+          f->pin_cnt++;
+          pages[batch_cnt] = p;
+          batch[batch_cnt++] = f;
+        }
+    }
+
+  if (batch_cnt == 0)
+    return NULL;
+  if (!page_swap_out (pages, batch_cnt))
+    {
+      for (i = 0; i < batch_cnt; i++)
+        batch[i]->pin_cnt--;
+      return NULL;
+    }
+
+  for (i = 0; i < batch_cnt; i++)
+    detach_page (pages[i]);
+  for (i = 1; i < batch_cnt; i++)
+    {
+      forget_file (batch[i]);
+      palloc_free_page (batch[i]->kpage);
+      batch[i]->kpage = NULL;
+      used_cnt--;
+    }
+  batch[0]->pin_cnt--;
+  forget_file (batch[0]);
+  return batch[0];
+}
+
+/* Makes KPAGE, a page of the user pool, a pinned frame holding
+   PAGE, or no page if PAGE is null.  frame_lock must be held. */
+static void
+claim_frame (void *kpage, struct page *page)
+{
+  struct frame *f = frame_lookup (kpage);
+
+  f->kpage = kpage;
+  f->inode = NULL;
+  f->mapped = false;
+  f->merge = MERGE_NONE;
+  f->checksummed = false;
+  list_init (&f->pages);
+  if (page != NULL)
+    attach_page (f, page);
+  f->pin_cnt = 1;
+  f->segment = false;
+}
+
+/* Obtains a user pool page, evicting another page if the pool is
+   empty or PAGE's process is at its resident set limit, and
+   makes it a pinned frame holding PAGE, or no page if PAGE is
+   null.  FLAGS are as for palloc_get_page().  Returns a null
+   pointer if no frame could be freed.  frame_lock must be
+   held. */
+static void *
+get_frame (enum palloc_flags flags, struct page *page)
+{
+  struct frame *f = NULL;
+  void *kpage = NULL;
+
+  if (page != NULL && at_rss_limit (page->owner))
+    f = evict (page->owner);
+  if (f == NULL)
+    {
+      kpage = palloc_get_page (flags | PAL_USER);
+      if (kpage != NULL)
+        used_cnt++;
+      else
+        f = evict (NULL);
+    }
+  if (kpage == NULL)
+    {
+      if (f == NULL)
+        return NULL;
+      kpage = f->kpage;
+      if (flags & PAL_ZERO)
+        memset (kpage, 0, PGSIZE);
+    }
+
+  claim_frame (kpage, page);
+  if (!reclaim_wanted && user_frame_cnt - used_cnt < frame_low_water)
+    {
+      reclaim_wanted = true;
+      sema_up (&reclaim_sema);
+    }
+  return kpage;
+}
+
+/* Obtains a frame from the user pool to hold PAGE, evicting
+   another page if the pool is empty.
+   FLAGS are passed to palloc_get_page(), with PAL_USER added.
+   Returns the frame's kernel virtual address, or a null pointer
+   if no frame could be freed.  The frame is pinned until the
+   caller is done filling it and calls frame_unpin(). */
+void *
+frame_alloc (enum palloc_flags flags, struct page *page)
+{
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = get_frame (flags, page);
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Sets the current process's resident set limit to LIMIT pages,
+   or to frame_rss_limit if LIMIT is 0, and returns the previous
+   limit, 0 if it was frame_rss_limit.  Lowering the limit below
+   the pages now resident evicts nothing at once: the process
+   simply replaces its own pages from then on. */
+size_t
+frame_set_rss_limit (size_t limit)
+{
+  struct thread *t = thread_current ()->leader;
+  size_t old;
+
+  lock_acquire (&frame_lock);
+  old = t->resident_limit;
+  t->resident_limit = limit;
+  lock_release (&frame_lock);
+  return old;
+}
+
+/* Obtains LARGE_PGSIZE bytes of contiguous user pool pages,
+   aligned to LARGE_PGSIZE, for a 4 MB page, and makes each of
+   them a pinned frame holding no page.  Nothing is evicted to
+   make room, since freeing a whole aligned block that way would
+   take luck.  Returns the first frame, or a null pointer if no
+   such block is free.  The frames are freed one by one with
+   frame_free(), or given pages with frame_move(). */
+void *
+frame_alloc_large (void)
+{
+  size_t cnt = LARGE_PGSIZE / PGSIZE;
+  uint8_t *kpage;
+  size_t i;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_aligned (PAL_USER, cnt);
+  if (kpage != NULL)
+    {
+      for (i = 0; i < cnt; i++)
+        claim_frame (kpage + i * PGSIZE, NULL);
+      used_cnt += cnt;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Moves PAGE, which must be resident in a frame of its own and
+   unmapped, to KPAGE, a frame from frame_alloc_large() that
+   holds no page yet, copying its contents, and frees the frame
+   it was in.  The caller is responsible for mapping it again. */
+void
+frame_move (struct page *page, void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (page->kpage);
+  ASSERT (!frame_is_shared (f) && !f->segment);
+  memcpy (kpage, page->kpage, PGSIZE);
+  detach_page (page);
+  forget_file (f);
+  f->kpage = NULL;
+  palloc_free_page (page->kpage);
+  used_cnt--;
+
+  f = frame_lookup (kpage);
+  ASSERT (f->kpage == kpage && list_empty (&f->pages));
+  attach_page (f, page);
+  page->kpage = kpage;
+  lock_release (&frame_lock);
+}
+
+/* Takes the running process's page directory away from it, so
+   that the caller may destroy it.  Eviction and merging reach
+   into other processes' page directories under frame_lock, and
+   pass over a process whose page directory is null, so once this
+   returns none of them is still using the old one. */
+void
+frame_clear_pagedir (void)
+{
+  lock_acquire (&frame_lock);
+  thread_current ()->pagedir = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Returns KPAGE, obtained with frame_alloc() but never given to
+   its page, to the user pool. */
+void
+frame_free (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f->kpage == kpage);
+  if (!list_empty (&f->pages))
+    detach_page (frame_page (f));
+  f->kpage = NULL;
+  palloc_free_page (kpage);
+  used_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Detaches PAGE from its frame, if it is resident, and frees the
+   frame if no other page shares it.  The caller is responsible
+   for PAGE's mapping.  Returns true if PAGE was resident. */
+bool
+frame_release (struct page *page)
+{
+  struct frame *f;
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  resident = page->kpage != NULL;
+  if (resident)
+    {
+      f = frame_lookup (page->kpage);
+      detach_page (page);
+      if (list_empty (&f->pages) && !f->segment)
+        {
+          forget_file (f);
+          f->kpage = NULL;
+          palloc_free_page (page->kpage);
+          used_cnt--;
+        }
+      page->kpage = NULL;
+    }
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Makes CHILD share PARENT's frame, if PARENT is resident.
+   Returns the frame, pinned, or a null pointer if PARENT is not
+   resident.  The caller must map it and call frame_unpin(). */
+void *
+frame_share (struct page *parent, struct page *child)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = parent->kpage;
+  if (kpage != NULL)
+    {
+      f = frame_lookup (kpage);
+      attach_page (f, child);
+      f->pin_cnt++;
+      child->kpage = kpage;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Gives PAGE a frame of its own, if its frame is shared, by
+   copying it to a new one.  Returns PAGE's frame, pinned, or a
+   null pointer if PAGE is not resident or no memory could be
+   found for the copy.  The caller must remap PAGE and call
+   frame_unpin(). */
+void *
+frame_unshare (struct page *page)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  if (page->kpage == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+  f = frame_lookup (page->kpage);
+  if (!frame_is_shared (f))
+    {
+      /* About to be writable, so no longer fit to merge with. */
+      forget_merge (f);
+      f->pin_cnt++;
+      kpage = page->kpage;
+    }
+  else
+    {
+      /* Pin the original so that the copy's eviction can't pick
+         it, should sharing end under us. */
+      f->pin_cnt++;
+      detach_page (page);
+      kpage = get_frame (0, page);
+      if (kpage != NULL)
+        {
+          memcpy (kpage, page->kpage, PGSIZE);
+          page->kpage = kpage;
+        }
+      else
+        attach_page (f, page);
+      f->pin_cnt--;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Obtains a zeroed frame from the user pool for a shared memory
+   segment, evicting another page if the pool is empty.  The
+   frame is held by the segment until frame_free_segment() and is
+   never evicted.  Returns the frame's kernel virtual address, or
+   a null pointer if no frame could be freed. */
+void *
+frame_alloc_segment (void)
+{
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = get_frame (PAL_ZERO, NULL);
+  if (kpage != NULL)
+    {
+      struct frame *f = frame_lookup (kpage);
+      f->segment = true;
+      f->pin_cnt--;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Makes PAGE map KPAGE, a frame of a shared memory segment.  The
+   caller must map it in PAGE's page directory. */
+void
+frame_map_segment (void *kpage, struct page *page)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f->segment);
+  attach_page (f, page);
+  page->kpage = kpage;
+  lock_release (&frame_lock);
+}
+
+/* Drops a shared memory segment's hold on frame KPAGE, freeing
+   it unless some page still maps it, in which case the last
+   frame_release() does. */
+void
+frame_free_segment (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f->segment);
+  f->segment = false;
+  if (list_empty (&f->pages))
+    {
+      f->kpage = NULL;
+      palloc_free_page (kpage);
+      used_cnt--;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Keeps PAGE's frame from being evicted, e.g. while the kernel
+   is accessing it on a user process's behalf, until a matching
+   frame_unpin().  Pins nest, since the processes sharing a frame
+   may each pin it.  Returns false if PAGE is not resident. */
+bool
+frame_pin (struct page *page)
+{
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  resident = page->kpage != NULL;
+  if (resident)
+    frame_lookup (page->kpage)->pin_cnt++;
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Drops a pin on KPAGE, which is eligible for eviction again once
+   the last is dropped. */
+void
+frame_unpin (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* If LOCK is true, locks PAGE into memory, so that eviction
+   passes over whatever frame it is in, until it is unlocked with
+   LOCK false.  Locking a locked page, or unlocking an unlocked
+   one, does nothing.  So that locked pages cannot crowd out
+   everything else, at most half of the user pool may be locked
+   at a time; returns false if locking PAGE would exceed that. */
+bool
+frame_mlock (struct page *page, bool lock)
+{
+  bool success = true;
+
+  lock_acquire (&frame_lock);
+  if (lock && !page->locked)
+    {
+      if (locked_cnt < user_frame_cnt / 2)
+        {
+          page->locked = true;
+          locked_cnt++;
+        }
+      else
+        success = false;
+    }
+  else if (!lock && page->locked)
+    {
+      page->locked = false;
+      locked_cnt--;
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Returns a hash value for text frame F. */
+static unsigned
+text_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, text_elem);
+  return hash_ptr (f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if text frame A precedes text frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, text_elem);
+  const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Removes F from text_frames or its inode's mapped pages, if it
+   is in either, and from same-page merging, since it is about to
+   hold something else.  frame_lock must be held. */
+static void
+forget_file (struct frame *f)
+{
+  forget_merge (f);
+  if (f->inode != NULL)
+    {
+      if (f->mapped)
+        inode_remove_page (f->inode, &f->file_page);
+      else
+        hash_delete (&text_frames, &f->text_elem);
+      f->inode = NULL;
+      f->mapped = false;
+    }
+}
+
+/* Returns true if PAGE's contents may be shared with every other
+   page showing the same part of the same file. */
+static bool
+is_text (const struct page *page)
+{
+  return page->file != NULL && !page->writable && !page->mmapped;
+}
+
+/* If another process, or another mapping, already has PAGE's
+   contents in a frame, makes PAGE share it and returns it,
+   pinned.  Otherwise returns a null pointer.  The caller must map
+   the frame and call frame_unpin(). */
+void *
+frame_share_file (struct page *page)
+{
+  struct frame *f = NULL;
+  void *kpage = NULL;
+
+  if (!is_text (page) && !page->mmapped)
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  if (page->kpage != NULL)
+    {
+      /* Already loaded meanwhile. */
+    }
+  else if (page->mmapped)
+    {
+      struct inode_page *ip = inode_find_page (file_get_inode (page->file),
+                                               page->ofs);
+      if (ip != NULL)
+        f = frame_lookup (ip->kpage);
+    }
+  else
+    {
+      struct frame key;
+      struct hash_elem *e;
+
+      key.inode = file_get_inode (page->file);
+      key.ofs = page->ofs;
+      e = hash_find (&text_frames, &key.text_elem);
+      if (e != NULL)
+        f = hash_entry (e, struct frame, text_elem);
+    }
+  if (f != NULL)
+    {
+      attach_page (f, page);
+      f->pin_cnt++;
+      page->kpage = kpage = f->kpage;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Offers KPAGE, just loaded with PAGE's contents, for sharing
+   with other processes that run the same file or, for a page of
+   a memory-mapped file, with every other mapping of it and with
+   reads and writes of the file.  WRITE_CNT must be
+   inode_write_cnt() from before KPAGE was loaded.
+
+   Returns false if KPAGE may not be used: a memory-mapped page's
+   file was written while it was being loaded, or another mapping
+   loaded the same page first.  The caller should free KPAGE and
+   start over. */
+bool
+frame_publish_file (void *kpage, struct page *page, unsigned write_cnt)
+{
+  struct frame *f;
+  bool success = true;
+
+  if (!is_text (page) && !page->mmapped)
+    return true;
+
+  lock_acquire (&frame_lock);
+  f = frame_lookup (kpage);
+  f->inode = file_get_inode (page->file);
+  f->ofs = page->ofs;
+  if (page->mmapped)
+    {
+      f->file_page.ofs = page->ofs;
+      f->file_page.kpage = kpage;
+      f->mapped = success = inode_add_page (f->inode, &f->file_page,
+                                            write_cnt);
+      if (!success)
+        f->inode = NULL;
+    }
+  else if (hash_insert (&text_frames, &f->text_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Reclaimer thread: when woken by get_frame(), evicts frames
+   until frame_high_water of the user pool are free, dropping
+   frame_lock between evictions so that faults are not held up. */
+static void
+reclaimer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&reclaim_sema);
+      lock_acquire (&frame_lock);
+      while (user_frame_cnt - used_cnt < frame_high_water)
+        {
+          struct frame *f = evict (NULL);
+          if (f == NULL)
+            break;
+          palloc_free_page (f->kpage);
+          f->kpage = NULL;
+          used_cnt--;
+
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+      reclaim_wanted = false;
+      lock_release (&frame_lock);
+    }
+}
+
+/* Returns a hash value for frame F, for same-page merging. */
+static unsigned
+merge_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  return hash_entry (f_, struct frame, merge_elem)->checksum;
+}
+
+/* Returns true if frame A's checksum is less than B's.  Frames
+   with the same checksum are compared in full before merging. */
+static bool
+merge_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, merge_elem);
+  const struct frame *b = hash_entry (b_, struct frame, merge_elem);
+
+  return a->checksum < b->checksum;
+}
+
+/* Removes F from whichever same-page merging table it is in.
+   frame_lock must be held. */
+static void
+forget_merge (struct frame *f)
+{
+  if (f->merge == MERGE_MERGED)
+    hash_delete (&merged_frames, &f->merge_elem);
+  else if (f->merge == MERGE_CANDIDATE)
+    hash_delete (&merge_candidates, &f->merge_elem);
+  f->merge = MERGE_NONE;
+}
+
+/* hash_action_func that notes that a frame has left
+   merge_candidates. */
+static void
+drop_candidate (struct hash_elem *f_, void *aux UNUSED)
+{
+  hash_entry (f_, struct frame, merge_elem)->merge = MERGE_NONE;
+}
+
+/* Returns true if F holds a single private, writable page that
+   may be merged with others.  frame_lock must be held. */
+static bool
+is_mergeable (struct frame *f)
+{
+  struct page *p;
+
+  if (f->kpage == NULL || f->pin_cnt > 0 || f->segment || f->inode != NULL
+      || list_empty (&f->pages) || frame_is_shared (f))
+    return false;
+  p = frame_page (f);
+  return (p->writable && !p->mmapped && !p->shared && !p->locked
+          && !p->huge && p->owner->pagedir != NULL);
+}
+
+/* Returns the frame in TABLE with the same checksum as F, or a
+   null pointer if there is none. */
+static struct frame *
+find_twin (struct hash *table, struct frame *f)
+{
+  struct hash_elem *e = hash_find (table, &f->merge_elem);
+  return e != NULL ? hash_entry (e, struct frame, merge_elem) : NULL;
+}
+
+/* Merges F's page into TWIN, a frame already merged or a
+   candidate, if their contents are the same: maps the page, and
+   TWIN's own page if TWIN is a candidate, copy-on-write to TWIN,
+   and frees F.  Returns true if merged.  frame_lock must be
+   held. */
+static bool
+merge_into (struct frame *f, struct frame *twin)
+{
+  struct page *p = frame_page (f);
+  enum intr_level old_level;
+  bool same;
+
+  /* With interrupts off, neither page's process can write to it
+     between the comparison and the remapping. */
+  old_level = intr_disable ();
+  same = !memcmp (f->kpage, twin->kpage, PGSIZE);
+  if (same)
+    {
+      if (twin->merge == MERGE_CANDIDATE)
+        page_merge (frame_page (twin), twin->kpage);
+      page_merge (p, twin->kpage);
+    }
+  intr_set_level (old_level);
+  if (!same)
+    return false;
+
+  if (twin->merge == MERGE_CANDIDATE)
+    {
+      /* Another merged frame may have the same checksum but other
+         contents; TWIN then just cannot take further pages. */
+      forget_merge (twin);
+      if (hash_insert (&merged_frames, &twin->merge_elem) == NULL)
+        twin->merge = MERGE_MERGED;
+    }
+  list_remove (&p->frame_elem);
+  list_push_back (&twin->pages, &p->frame_elem);
+  forget_file (f);
+  palloc_free_page (f->kpage);
+  f->kpage = NULL;
+  used_cnt--;
+  return true;
+}
+
+/* Examines F for same-page merging.  frame_lock must be held. */
+static void
+merge_frame (struct frame *f)
+{
+  struct frame *twin;
+  unsigned checksum;
+  bool stable;
+
+  if (f->merge == MERGE_MERGED)
+    return;
+  if (!is_mergeable (f))
+    {
+      f->checksummed = false;
+      return;
+    }
+
+  checksum = hash_bytes (f->kpage, PGSIZE);
+  stable = f->checksummed && f->checksum == checksum;
+  f->checksum = checksum;
+  f->checksummed = true;
+  if (!stable)
+    return;
+
+  twin = find_twin (&merged_frames, f);
+  if (twin != NULL && merge_into (f, twin))
+    return;
+
+  /* A candidate may have been written, shared or pinned since it
+     was found; F can take its place. */
+  twin = find_twin (&merge_candidates, f);
+  if (twin != NULL && !is_mergeable (twin))
+    {
+      forget_merge (twin);
+      twin = NULL;
+    }
+  if (twin == NULL)
+    {
+      f->merge = MERGE_CANDIDATE;
+      hash_insert (&merge_candidates, &f->merge_elem);
+    }
+  else
+    merge_into (f, twin);
+}
+
+/* Merging thread: every MERGE_INTERVAL milliseconds, examines the
+   next frame_merge_rate frames.  Candidates last only for the
+   pass over the table in which they are found.  Like the
+   reclaimer, drops frame_lock between frames so that faults are
+   not held up by a long pass. */
+static void
+merger (void *aux UNUSED)
+{
+  for (;;)
+    {
+      size_t i;
+
+      timer_msleep (MERGE_INTERVAL);
+      lock_acquire (&frame_lock);
+      for (i = 0; i < frame_merge_rate && i < frame_cnt; i++)
+        {
+          if (merge_hand == 0)
+            hash_clear (&merge_candidates, drop_candidate);
+          merge_frame (&frames[merge_hand]);
+          merge_hand = (merge_hand + 1) % frame_cnt;
+
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+      lock_release (&frame_lock);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/palloc.h"
+
+struct page;
+
+/* Free frame reserve maintained by the reclaimer thread. */
+extern size_t frame_low_water;
+extern size_t frame_high_water;
+
+/* How eviction chooses its victims. */
+enum frame_policy
+  {
+    FRAME_CLOCK,                /* Clock (second chance), the default. */
+    FRAME_RANDOM                /* Uniformly at random. */
+  };
+
+extern enum frame_policy frame_policy;
+
+/* Default resident set limit, in pages, or 0 for none. */
+extern size_t frame_rss_limit;
+
+/* Frames examined per interval for same-page merging, 0 for off. */
+extern size_t frame_merge_rate;
+
+void frame_init (void);
+void frame_reclaim_start (void);
+void *frame_alloc (enum palloc_flags, struct page *);
+void frame_free (void *kpage);
+bool frame_release (struct page *);
+void *frame_share (struct page *parent, struct page *child);
+void *frame_unshare (struct page *);
+void *frame_share_file (struct page *);
+bool frame_publish_file (void *kpage, struct page *, unsigned write_cnt);
+void *frame_alloc_segment (void);
+void frame_map_segment (void *kpage, struct page *);
+void frame_free_segment (void *kpage);
+bool frame_pin (struct page *);
+void frame_unpin (void *kpage);
+bool frame_mlock (struct page *, bool lock);
+size_t frame_set_rss_limit (size_t limit);
+void *frame_alloc_large (void);
+void frame_move (struct page *, void *kpage);
+void frame_clear_pagedir (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,139 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   A mapping is a run of consecutive pages of the process's
+   supplemental page table, each backed by the corresponding page
+   of the file.  Pages are read from the file on first touch
+   like any other; when a mapping's page is evicted or unmapped
+   it is written back to the file only if it was modified.
+
+   The mappings belong to the process's main thread and are
+   changed under its vm_lock, like the rest of its page table. */
+
+/* A memory mapping. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's mappings. */
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* Own handle on the mapped file. */
+    uint8_t *base;              /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+  };
+
+/* Removes the first CNT pages of mapping M. */
+static void
+unmap_pages (struct mapping *m, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+}
+
+/* Maps FILE into the current process's address space starting at
+   ADDR.  Returns the new mapping's identifier, or MAP_FAILED if
+   FILE is empty, ADDR is not page-aligned or is 0, or any of the
+   pages needed overlaps memory already in use. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ()->leader;
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (file == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  lock_acquire (&t->vm_lock);
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->base + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!is_user_vaddr (upage) || page_lookup (upage) != NULL
+          || pagedir_get_page (t->pagedir, upage) != NULL
+          || !page_add_mmap (upage, m->file, ofs, read_bytes))
+        {
+          unmap_pages (m, i);
+          lock_release (&t->vm_lock);
+          file_close (m->file);
+          free (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  lock_release (&t->vm_lock);
+  return m->id;
+}
+
+/* Removes mapping M, writing its modified pages back. */
+static void
+unmap (struct mapping *m)
+{
+  list_remove (&m->elem);
+  unmap_pages (m, m->page_cnt);
+  file_close (m->file);
+  free (m);
+}
+
+/* Removes the current process's mapping MAPPING, if it exists. */
+void
+mmap_unmap (mapid_t mapping)
+{
+  struct thread *t = thread_current ()->leader;
+  struct list_elem *e;
+
+  lock_acquire (&t->vm_lock);
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapping)
+        {
+          unmap (m);
+          break;
+        }
+    }
+  lock_release (&t->vm_lock);
+}
+
+/* Removes all of the current process's mappings.  Called at
+   process exit, while the page directory still records which
+   pages were modified. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ()->leader;
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
@@ -0,0 +1,1100 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <madvise.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/cpu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   Each process keeps a hash table, keyed by user page address, of
+   every page in its address space.  Entries are created when the
+   page is set up, e.g. by the executable loader, but no memory is
+   given to the page until the process first touches it and the
+   page fault handler calls page_fault_in().  A page that has been
+   modified is written to swap when it is evicted and read back
+   from there.
+
+   A process may describe how it will use a range of its pages
+   with page_advise().  The hint tunes fault-around and, for pages
+   it will not need again, makes eviction take them first.  With
+   page_lock(), it may instead keep pages in memory, so that
+   touching them never faults.
+
+   With MADV_HUGEPAGE, each 4 MB aligned region of writable,
+   private pages in the range is moved into an aligned block of
+   physically contiguous frames, if one is free, and mapped with
+   a single PDE, so that the whole region takes one TLB entry and
+   no page table.  Such a page stays in memory.  Anything that
+   needs the region's pages one at a time, such as fork() or
+   unmapping one of them, first splits it back into 4 kB pages in
+   the same frames, which are then evicted like any others. */
+
+/* Pages in a 4 MB page. */
+#define LARGE_PAGE_CNT (LARGE_PGSIZE / PGSIZE)
+
+/* Returns the start of the 4 MB region containing VA. */
+static inline uint8_t *
+large_round_down (const void *va)
+{
+  return (uint8_t *) ((uintptr_t) va & ~(uintptr_t) (LARGE_PGSIZE - 1));
+}
+
+/* A 4 MB page of a process. */
+struct huge_map
+  {
+    struct list_elem elem;              /* In process's huge_maps. */
+    uint8_t *upage;                     /* First user page. */
+    uint32_t *pt;                       /* Page table for splitting. */
+  };
+
+/* The 80x86 PUSHA instruction faults up to this many bytes below
+   the stack pointer. */
+#define STACK_SLACK 32
+
+/* Bounds on how many pages past a sequential file-backed fault
+   are brought in along with it. */
+#define FAULT_AROUND_MIN 4
+#define FAULT_AROUND_MAX 16
+
+/* Most pages read in by one fault on a page in swap. */
+#define SWAP_CLUSTER SWAP_BATCH
+
+size_t stack_page_limit = 2048;
+
+/* Page fault accounting for the whole system.  Each process's
+   share is kept in its leader's FAULTS.  The counters are updated
+   without locking; an occasional lost count is harmless. */
+static struct faultstat faults;
+
+/* Counts an event of kind MEMBER of struct faultstat against
+   process OWNER and the system. */
+#define COUNT_FAULT(OWNER, MEMBER) \
+        ((OWNER)->faults.MEMBER++, faults.MEMBER++)
+
+static bool fault_in (const void *fault_addr, bool write, bool count);
+static void swap_in_around (struct page *, void *kpage);
+static struct page *find_page (struct thread *, const void *upage);
+static bool make_huge (uint8_t *upage);
+static void split_huge (struct thread *, struct huge_map *);
+
+/* A page of zeros, mapped read-only in place of every all-zero
+   page until the page is first written. */
+static void *zero_kpage;
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_ptr (p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
+
+/* Initializes the current thread's supplemental page table.  The
+   current thread must be a process's main thread: the others use
+   its table, under its vm_lock. */
+void
+page_table_init (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!hash_init (&t->pages, page_hash, page_less, NULL))
+    PANIC ("can't initialize supplemental page table");
+  list_init (&t->mappings);
+  list_init (&t->shm_maps);
+  list_init (&t->huge_maps);
+  t->resident_cnt = 0;
+  t->resident_limit = 0;
+  t->clock_hand = 0;
+  t->next_mapid = 0;
+  t->next_fault = NULL;
+  t->fault_window = 0;
+}
+
+/* Frees a page table entry. */
+static void
+page_destructor (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+
+  frame_mlock (p, false);
+  frame_release (p);
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  free (p);
+}
+
+/* Destroys the current thread's supplemental page table,
+   releasing its frames and swap slots.  The page directory must
+   already be gone, so that nothing maps the frames any more. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ()->leader;
+
+  while (!list_empty (&t->huge_maps))
+    {
+      struct huge_map *h = list_entry (list_pop_front (&t->huge_maps),
+                                       struct huge_map, elem);
+      palloc_free_page (h->pt);
+      free (h);
+    }
+  hash_destroy (&t->pages, page_destructor);
+}
+
+/* Adds a page at UPAGE to the current process, not yet resident.
+   Returns the new page, or a null pointer if UPAGE is already in
+   use or memory is short. */
+static struct page *
+page_add (void *upage, bool writable)
+{
+  struct thread *t = thread_current ()->leader;
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->owner = t;
+  p->writable = writable;
+  p->cow = false;
+  p->zero_mapped = false;
+  p->kpage = NULL;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->mmapped = false;
+  p->shared = false;
+  p->dirty = false;
+  p->swap_slot = SWAP_NONE;
+  p->advice = MADV_NORMAL;
+  p->locked = false;
+  p->huge = false;
+  p->ckpt_gen = 0;
+  p->ckpt_ofs = 0;
+  if (hash_insert (&t->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds a page at UPAGE whose contents are READ_BYTES bytes of
+   FILE starting at OFS, followed by zeros.  FILE must stay open
+   as long as the page exists.  Returns true if successful. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, writable);
+  if (p == NULL)
+    return false;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Adds an all-zero page at UPAGE.  Returns true if successful. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, writable) != NULL;
+}
+
+/* Adds a page at UPAGE that maps READ_BYTES bytes of FILE
+   starting at OFS, followed by zeros.  Changes to the page are
+   written back to FILE.  Returns true if successful. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = page_add (upage, true);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->mmapped = true;
+  return true;
+}
+
+/* Adds a writable page at UPAGE that maps KPAGE, a frame of a
+   shared memory segment, and maps it at once.  The page stays
+   resident as long as it exists.  Returns true if successful. */
+bool
+page_add_segment (void *upage, void *kpage)
+{
+  struct page *p;
+
+  p = page_add (upage, true);
+  if (p == NULL)
+    return false;
+  p->shared = true;
+  frame_map_segment (kpage, p);
+  if (!pagedir_set_page (p->owner->pagedir, upage, kpage, true))
+    {
+      page_remove (upage);
+      return false;
+    }
+  return true;
+}
+
+/* Writes memory-mapped page P, resident in frame KPAGE, back to
+   its file. */
+static void
+write_back (struct page *p, void *kpage)
+{
+  file_write_at (p->file, kpage, p->read_bytes, p->ofs);
+}
+
+/* Removes the current process's page at UPAGE, releasing its
+   frame or swap slot.  A modified memory-mapped page is first
+   written back to its file. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+  uint32_t *pd = thread_current ()->pagedir;
+
+  ASSERT (p != NULL);
+
+  if (p->huge)
+    {
+      struct thread *t = thread_current ()->leader;
+      struct list_elem *e;
+
+      for (e = list_begin (&t->huge_maps); e != list_end (&t->huge_maps);
+           e = list_next (e))
+        {
+          struct huge_map *h = list_entry (e, struct huge_map, elem);
+          if (h->upage == large_round_down (upage))
+            {
+              split_huge (t, h);
+              break;
+            }
+        }
+    }
+  frame_mlock (p, false);
+  if (frame_pin (p))
+    {
+      if (p->mmapped && pagedir_is_dirty (pd, p->upage))
+        write_back (p, p->kpage);
+      pagedir_clear_page (pd, p->upage);
+      frame_unpin (p->kpage);
+      frame_release (p);
+    }
+  else if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  else if (p->zero_mapped)
+    pagedir_clear_page (pd, p->upage);
+
+  hash_delete (&thread_current ()->leader->pages, &p->hash_elem);
+  free (p);
+}
+
+/* Returns the current process's page containing UPAGE, or a null
+   pointer if there is none. */
+struct page *
+page_lookup (const void *upage)
+{
+  return find_page (thread_current ()->leader, upage);
+}
+
+/* Returns process T's page containing UPAGE, or a null pointer if
+   there is none. */
+static struct page *
+find_page (struct thread *t, const void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = pg_round_down (upage);
+  e = hash_find (&t->pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Notes that P has been modified, losing the dirty bit in its
+   page table entry: it no longer has its initial contents, nor
+   those of any checkpoint (see vm/checkpoint.c). */
+static void
+mark_dirty (struct page *p)
+{
+  p->dirty = true;
+  p->ckpt_gen = 0;
+}
+
+/* Returns true if P would read as all zeros. */
+static bool
+is_zero (const struct page *p)
+{
+  return p->file == NULL && p->swap_slot == SWAP_NONE && !p->dirty;
+}
+
+/* Loads P, which is not resident, into a frame and maps it.  If
+   COUNT is true, counts the load as a minor or major fault. */
+static bool
+load_page (struct page *p, bool count)
+{
+  unsigned write_cnt = 0;
+  bool from_file = false;
+  void *kpage;
+
+ retry:
+  /* Program text may already be in memory for another process,
+     and a page of a mapped file for another mapping. */
+  kpage = frame_share_file (p);
+  if (kpage != NULL)
+    {
+      if (!pagedir_set_page (p->owner->pagedir, p->upage, kpage,
+                             p->writable))
+        {
+          frame_unpin (kpage);
+          frame_release (p);
+          return false;
+        }
+      frame_unpin (kpage);
+      if (count)
+        COUNT_FAULT (p->owner, minor_cnt);
+      return true;
+    }
+
+  /* Allocating the frame also waits out any eviction of P that is
+     in progress, so P's state can be examined afterward. */
+  kpage = frame_alloc (0, p);
+  if (kpage == NULL)
+    return false;
+  if (p->kpage != NULL)
+    {
+      frame_free (kpage);
+      return false;
+    }
+
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_in_around (p, kpage);
+      if (count)
+        COUNT_FAULT (p->owner, swap_cnt);
+    }
+  else if (p->file == NULL)
+    {
+      memset (kpage, 0, PGSIZE);
+      if (count)
+        COUNT_FAULT (p->owner, minor_cnt);
+    }
+  else
+    {
+      write_cnt = inode_write_cnt (file_get_inode (p->file));
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (kpage);
+          return false;
+        }
+      memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      from_file = true;
+    }
+
+  /* Offer the frame for sharing before mapping it: once mapped,
+     other threads of the process may write to it. */
+  if (!frame_publish_file (kpage, p, write_cnt))
+    {
+      frame_free (kpage);
+      goto retry;
+    }
+  p->kpage = kpage;
+  p->cow = false;
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_unpin (kpage);
+      frame_release (p);
+      return false;
+    }
+  if (from_file && count)
+    COUNT_FAULT (p->owner, file_cnt);
+  frame_unpin (kpage);
+  return true;
+}
+
+/* Returns true if the page DELTA pages from P in P's process is
+   in swap in the slot DELTA slots from P's, both on disk, and is
+   not resident, so that it may be read in along with P. */
+static bool
+swap_follows (const struct page *p, int delta)
+{
+  struct page *q = find_page (p->owner,
+                              (uint8_t *) p->upage + delta * PGSIZE);
+
+  return (q != NULL && q->kpage == NULL && q->swap_slot != SWAP_NONE
+          && swap_on_disk (q->swap_slot)
+          && q->swap_slot == p->swap_slot + delta);
+}
+
+/* Reads P, which is in swap, into KPAGE, and with it the pages
+   around P that were swapped out with it into neighbouring
+   slots, SWAP_CLUSTER pages in all at most, with all the disk
+   reads queued at once.  Pages evicted together go to swap in
+   order of address (see page_swap_out()), so a run of
+   neighbouring pages takes one transfer instead of one per page.
+   The other pages are mapped at once, without a fault, unless
+   memory is short or they were advised MADV_RANDOM. */
+static void
+swap_in_around (struct page *p, void *kpage)
+{
+  struct page *pages[SWAP_CLUSTER];
+  size_t slots[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt = 0, i;
+  int lo = 0, hi = 0, delta;
+
+  if (swap_on_disk (p->swap_slot) && p->advice != MADV_RANDOM)
+    {
+      while (lo > 1 - SWAP_CLUSTER && swap_follows (p, lo - 1))
+        lo--;
+      while (hi - lo < SWAP_CLUSTER - 1 && swap_follows (p, hi + 1))
+        hi++;
+    }
+
+  for (delta = lo; delta <= hi; delta++)
+    {
+      struct page *q = p;
+      void *qpage = kpage;
+
+      if (delta != 0)
+        {
+          q = find_page (p->owner, (uint8_t *) p->upage + delta * PGSIZE);
+          qpage = frame_alloc (0, q);
+          if (qpage == NULL)
+            continue;
+
+          /* Allocating may have waited out changes to Q. */
+          if (!swap_follows (p, delta))
+            {
+              frame_free (qpage);
+              continue;
+            }
+        }
+      pages[cnt] = q;
+      slots[cnt] = q->swap_slot;
+      kpages[cnt++] = qpage;
+    }
+  swap_in_multiple (slots, kpages, cnt);
+
+  /* Each page was mapped before it was swapped out, so it still
+     has a page table and mapping it cannot fail. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *q = pages[i];
+
+      q->swap_slot = SWAP_NONE;
+      if (q == p)
+        continue;
+      q->kpage = kpages[i];
+      q->cow = false;
+      if (!pagedir_set_page (q->owner->pagedir, q->upage, kpages[i],
+                             q->writable))
+        PANIC ("can't map swapped-in page");
+      frame_unpin (kpages[i]);
+    }
+}
+
+/* Returns true if page Q holds the data of FILE that follows P's,
+   unchanged, and is not yet in memory, so that it may be loaded
+   ahead of a fault on it. */
+static bool
+follows (const struct page *p, const struct page *q)
+{
+  return (q != NULL && q->kpage == NULL && !q->zero_mapped
+          && q->file == p->file && q->ofs == p->ofs + PGSIZE
+          && q->swap_slot == SWAP_NONE && !q->dirty);
+}
+
+/* Called after file-backed page P has been faulted in.  Once the
+   faults on a file run sequentially, loads a window of the pages
+   following P as well, doubling the window while the pattern
+   holds, so that a linear scan takes one fault per window instead
+   of one per page.  Each page is read in a single multi-sector
+   transfer by the file system.  Any fault out of sequence closes
+   the window.  Pages advised MADV_SEQUENTIAL get the largest
+   window on every fault, and those advised MADV_RANDOM none. */
+static void
+fault_around (struct page *p)
+{
+  struct thread *t = thread_current ();
+  unsigned i;
+
+  if (p->advice == MADV_SEQUENTIAL)
+    t->fault_window = FAULT_AROUND_MAX;
+  else if (p->upage != t->next_fault || p->advice == MADV_RANDOM)
+    {
+      t->fault_window = 0;
+      t->next_fault = (uint8_t *) p->upage + PGSIZE;
+      return;
+    }
+  else if (t->fault_window == 0)
+    t->fault_window = FAULT_AROUND_MIN;
+  else if (t->fault_window < FAULT_AROUND_MAX)
+    t->fault_window *= 2;
+
+  for (i = 0; i < t->fault_window; i++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + PGSIZE);
+
+      if (!follows (p, q) || !load_page (q, false))
+        break;
+      p = q;
+    }
+  t->next_fault = (uint8_t *) p->upage + PGSIZE;
+}
+
+/* Brings the page containing FAULT_ADDR into memory and maps it.
+   WRITE says whether the access that faulted was a write.  An
+   all-zero page that is only read is mapped to the shared zero
+   page instead of getting a frame.  Returns true if successful,
+   false if the address is not part of the process or memory
+   cannot be found for it.  The fault is counted as minor or
+   major. */
+bool
+page_fault_in (const void *fault_addr, bool write)
+{
+  return fault_in (fault_addr, write, true);
+}
+
+/* Does the work of page_fault_in(), counting the fault only if
+   COUNT is true. */
+static bool
+fault_in (const void *fault_addr, bool write, bool count)
+{
+  struct page *p = page_lookup (fault_addr);
+
+  if (p == NULL)
+    return false;
+
+  if (!write && is_zero (p) && p->kpage == NULL)
+    {
+      if (!pagedir_set_page (p->owner->pagedir, p->upage, zero_kpage, false))
+        return false;
+      p->zero_mapped = true;
+      if (count)
+        COUNT_FAULT (p->owner, minor_cnt);
+      return true;
+    }
+  if (p->zero_mapped)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      p->zero_mapped = false;
+    }
+
+  if (!load_page (p, count))
+    return false;
+  if (p->file != NULL && p->owner == thread_current ()->leader)
+    fault_around (p);
+  return true;
+}
+
+/* Applies access hint ADVICE, one of the MADV_* values, to the
+   current process's pages in the LENGTH bytes starting at ADDR,
+   which must be page-aligned.  MADV_WILLNEED brings those of the
+   pages that are not resident into memory now, as far as memory
+   allows, without counting faults, and MADV_HUGEPAGE maps each
+   4 MB aligned region wholly inside the range as a 4 MB page;
+   the other hints are recorded in the pages, replacing any
+   earlier one.  Returns false if ADDR or ADVICE is invalid or
+   part of the range is not mapped, or, for MADV_HUGEPAGE, if the
+   CPU lacks 4 MB pages or some region could not be mapped as
+   one; the hint still applies to the rest. */
+bool
+page_advise (void *addr, size_t length, int advice)
+{
+  struct thread *t = thread_current ()->leader;
+  uint8_t *upage = addr;
+  uint8_t *end = upage + ROUND_UP (length, PGSIZE);
+  bool success = true;
+
+  if (pg_ofs (addr) != 0 || end < upage || advice < MADV_NORMAL
+      || advice > MADV_HUGEPAGE)
+    return false;
+
+  if (advice == MADV_HUGEPAGE)
+    {
+      if (!(cr4_get () & CR4_PSE))
+        return false;
+      lock_acquire (&t->vm_lock);
+      for (upage = large_round_down (upage + LARGE_PGSIZE - 1);
+           upage >= (uint8_t *) addr && upage + LARGE_PGSIZE <= end
+             && upage + LARGE_PGSIZE > upage;
+           upage += LARGE_PGSIZE)
+        if (!make_huge (upage))
+          success = false;
+      lock_release (&t->vm_lock);
+      return success;
+    }
+
+  lock_acquire (&t->vm_lock);
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+
+      if (p == NULL)
+        success = false;
+      else if (advice != MADV_WILLNEED)
+        p->advice = advice;
+      else if (p->kpage == NULL && !is_zero (p) && !load_page (p, false))
+        break;
+    }
+  lock_release (&t->vm_lock);
+  return success;
+}
+
+/* Maps the current process's LARGE_PGSIZE bytes at UPAGE, which
+   is LARGE_PGSIZE aligned, as a single 4 MB page, as described at
+   the top of this file.  Returns false if some page in the region
+   is missing, read-only, shared in any way, or already in a 4 MB
+   page, or if no block of frames or other memory could be found.
+   The caller must hold the process's vm_lock. */
+static bool
+make_huge (uint8_t *upage)
+{
+  struct thread *t = thread_current ()->leader;
+  struct huge_map *h;
+  uint8_t *kpage;
+  size_t i, j;
+
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    {
+      struct page *p = page_lookup (upage + i * PGSIZE);
+
+      if (p == NULL || !p->writable || p->mmapped || p->shared || p->cow
+          || p->huge)
+        return false;
+    }
+
+  h = malloc (sizeof *h);
+  if (h == NULL)
+    return false;
+  kpage = frame_alloc_large ();
+  if (kpage == NULL)
+    {
+      free (h);
+      return false;
+    }
+
+  /* Bring every page in, writable, and keep it there. */
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    {
+      struct page *p = page_lookup (upage + i * PGSIZE);
+
+      if (!frame_pin (p)
+          && (!fault_in (p->upage, true, false) || !frame_pin (p)))
+        {
+          for (j = 0; j < i; j++)
+            frame_unpin (page_lookup (upage + j * PGSIZE)->kpage);
+          for (j = 0; j < LARGE_PAGE_CNT; j++)
+            frame_free (kpage + j * PGSIZE);
+          free (h);
+          return false;
+        }
+    }
+
+  /* Unmap each page before copying it, so that other threads of
+     the process wait on our vm_lock instead of writing to the old
+     frame. */
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    {
+      struct page *p = page_lookup (upage + i * PGSIZE);
+
+      pagedir_clear_page (t->pagedir, p->upage);
+      frame_move (p, kpage + i * PGSIZE);
+      p->huge = true;
+      mark_dirty (p);
+    }
+  h->upage = upage;
+  h->pt = pagedir_set_large_page (t->pagedir, upage, kpage, true);
+  list_push_back (&t->huge_maps, &h->elem);
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    frame_unpin (kpage + i * PGSIZE);
+  return true;
+}
+
+/* Splits 4 MB page H of process T back into 4 kB pages, in the
+   same frames, and forgets it.  The caller must hold T's
+   vm_lock. */
+static void
+split_huge (struct thread *t, struct huge_map *h)
+{
+  size_t i;
+
+  pagedir_split_large_page (t->pagedir, h->upage, h->pt);
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    find_page (t, h->upage + i * PGSIZE)->huge = false;
+  list_remove (&h->elem);
+  free (h);
+}
+
+/* If LOCK is true, locks the current process's pages in the
+   LENGTH bytes starting at ADDR, which must be page-aligned, into
+   memory, bringing in those that are not resident, as mlock()
+   does; if LOCK is false, unlocks them again.  A writable page
+   gets a frame even if it has never been written, so that its
+   first write does not fault either, but one still shared
+   copy-on-write after fork() is copied only when written.  Locks are not
+   inherited across fork() and end when the page is unmapped.
+   Returns false if ADDR is invalid, part of the range is not
+   mapped, or memory or the limit on locked pages (see
+   frame_mlock()) runs out; pages before the failure stay
+   locked. */
+bool
+page_lock (void *addr, size_t length, bool lock)
+{
+  struct thread *t = thread_current ()->leader;
+  uint8_t *upage = addr;
+  uint8_t *end = upage + ROUND_UP (length, PGSIZE);
+  bool success = true;
+
+  if (pg_ofs (addr) != 0 || end < upage)
+    return false;
+
+  lock_acquire (&t->vm_lock);
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+
+      if (p == NULL)
+        success = false;
+      else if (!lock)
+        frame_mlock (p, false);
+      else if (!frame_mlock (p, true))
+        {
+          success = false;
+          break;
+        }
+      else if (p->kpage == NULL && !fault_in (upage, p->writable, false))
+        {
+          frame_mlock (p, false);
+          success = false;
+          break;
+        }
+    }
+  lock_release (&t->vm_lock);
+  return success;
+}
+
+/* Extends the current process's stack down to the page containing
+   FAULT_ADDR, given that the faulting code's stack pointer is
+   ESP, and brings that page in.  Returns false if FAULT_ADDR does
+   not look like a stack access or lies beyond stack_page_limit
+   pages below PHYS_BASE.  Only the faulting page is added; pages
+   skipped over are added if and when they are touched. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  uint8_t *upage = pg_round_down (fault_addr);
+
+  if (!is_user_vaddr (fault_addr)
+      || (const uint8_t *) fault_addr + STACK_SLACK < (const uint8_t *) esp
+      || (size_t) ((uint8_t *) PHYS_BASE - upage) > stack_page_limit * PGSIZE)
+    return false;
+
+  if (!page_add_zero (upage, true) || !fault_in (upage, true, false))
+    return false;
+  COUNT_FAULT (thread_current ()->leader, stack_cnt);
+  return true;
+}
+
+/* Unmaps resident page P from its owner so that its frame can be
+   reused.  It will be faulted back in from where it came; a
+   modified memory-mapped page is written back to its file first.
+   Returns false if any other page has been modified, in which
+   case it has to go through page_swap_out() instead.  Called by
+   the frame table with P's frame locked against other
+   eviction. */
+bool
+page_out (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  enum intr_level old_level;
+  bool clean;
+
+  ASSERT (p->kpage != NULL);
+
+  /* The owner must not dirty the page between the check and the
+     unmapping. */
+  old_level = intr_disable ();
+  clean = !p->dirty && !pagedir_is_dirty (pd, p->upage);
+  if (clean || p->mmapped)
+    pagedir_clear_page (pd, p->upage);
+  intr_set_level (old_level);
+
+  if (!clean && p->mmapped)
+    {
+      write_back (p, p->kpage);
+      clean = true;
+    }
+  if (clean)
+    {
+      p->kpage = NULL;
+      COUNT_FAULT (p->owner, evict_cnt);
+    }
+  return clean;
+}
+
+/* Returns true if page A should precede page B in a batch
+   written to swap. */
+static bool
+swap_order_less (const struct page *a, const struct page *b)
+{
+  if (a->owner != b->owner)
+    return a->owner < b->owner;
+  return a->upage < b->upage;
+}
+
+/* Unmaps the CNT resident pages in VICTIMS[], which may belong to
+   different processes, and writes them to swap in one batch.
+   Returns true if successful.  On failure, which happens when
+   swap space runs out, the pages stay mapped.  Called by the
+   frame table with the pages' frames locked against other
+   eviction.
+
+   The pages are written in order of process and address, so
+   that the neighbouring slots that swap_out() tries to give a
+   batch go to neighbouring pages, which swap_in_around() can
+   then read back together. */
+bool
+page_swap_out (struct page *victims[], size_t cnt)
+{
+  struct page *pages[SWAP_BATCH];
+  void *kpages[SWAP_BATCH];
+  size_t slots[SWAP_BATCH];
+  enum intr_level old_level;
+  size_t i, j;
+
+  ASSERT (cnt <= SWAP_BATCH);
+
+  /* Insertion sort, on a copy: the caller's array stays in step
+     with its frames. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = victims[i];
+
+      for (j = i; j > 0 && swap_order_less (p, pages[j - 1]); j--)
+        pages[j] = pages[j - 1];
+      pages[j] = p;
+    }
+
+  /* Unmap first, so that no process can modify a page while it is
+     being written. */
+  old_level = intr_disable ();
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+
+      if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+        mark_dirty (p);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      kpages[i] = p->kpage;
+    }
+  intr_set_level (old_level);
+
+  if (!swap_out (kpages, cnt, slots))
+    {
+      for (i = 0; i < cnt; i++)
+        pagedir_set_page (pages[i]->owner->pagedir, pages[i]->upage,
+                          pages[i]->kpage,
+                          pages[i]->writable && !pages[i]->cow);
+      return false;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      pages[i]->swap_slot = slots[i];
+      pages[i]->kpage = NULL;
+      COUNT_FAULT (pages[i]->owner, evict_cnt);
+    }
+  return true;
+}
+
+/* Maps P, which is resident, read-only to KPAGE, a frame with the
+   same contents as P's own, and makes it copy-on-write, keeping
+   the dirty bit that remapping loses.  For the frame table's
+   same-page merging, which moves P to KPAGE's frame.  Interrupts
+   must be off, so that P's process cannot write to P
+   meanwhile. */
+void
+page_merge (struct page *p, void *kpage)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (p->writable);
+
+  if (pagedir_is_dirty (pd, p->upage))
+    mark_dirty (p);
+  pagedir_clear_page (pd, p->upage);
+  pagedir_set_page (pd, p->upage, kpage, false);
+  p->kpage = kpage;
+  p->cow = true;
+}
+
+/* Handles a write fault at FAULT_ADDR on a copy-on-write page of
+   the current process by giving the process its own copy of the
+   page, or just write access if it is the last one sharing it.
+   A write to the shared zero page gets a zeroed frame.  Returns
+   false if FAULT_ADDR is not in such a page or memory cannot be
+   found. */
+bool
+page_cow_break (const void *fault_addr)
+{
+  struct page *p = page_lookup (fault_addr);
+  void *kpage;
+
+  if (p == NULL)
+    return false;
+  if (p->zero_mapped)
+    {
+      if (!fault_in (fault_addr, true, false))
+        return false;
+      COUNT_FAULT (p->owner, cow_cnt);
+      return true;
+    }
+  if (!p->cow)
+    return false;
+
+  kpage = frame_unshare (p);
+  if (kpage == NULL)
+    {
+      /* Evicted since the fault: it comes back in writable. */
+      return p->kpage == NULL && page_fault_in (fault_addr, true);
+    }
+  pagedir_clear_page (p->owner->pagedir, p->upage);
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, kpage, true))
+    PANIC ("can't remap copy-on-write page");
+  p->cow = false;
+  frame_unpin (kpage);
+  COUNT_FAULT (p->owner, cow_cnt);
+  return true;
+}
+
+/* Stores the system's page fault accounting into STATS. */
+void
+page_get_fault_stats (struct faultstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = faults;
+  intr_set_level (old_level);
+}
+
+/* Gives the current thread, whose page directory and page table
+   are freshly created, a copy of PARENT's address space.  Pages
+   in memory are shared copy-on-write: both processes map them
+   read-only until one of them writes.  Pages in swap are read
+   into a private frame and pages not yet loaded are loaded from
+   their source as usual, those of PARENT's executable from the
+   current thread's, which must already be open.  Memory-mapped
+   files and shared memory segments are not inherited.
+   PARENT must not run meanwhile.  Returns true if successful. */
+bool
+page_table_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  /* Sharing pages copy-on-write changes their mappings one by
+     one. */
+  while (!list_empty (&parent->huge_maps))
+    split_huge (parent, list_entry (list_front (&parent->huge_maps),
+                                    struct huge_map, elem));
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *cp;
+      void *kpage;
+
+      if (pp->mmapped || pp->shared)
+        continue;
+      cp = page_add (pp->upage, pp->writable);
+      if (cp == NULL)
+        return false;
+      cp->file = pp->file == parent->exec_file ? t->exec_file : pp->file;
+      cp->ofs = pp->ofs;
+      cp->read_bytes = pp->read_bytes;
+      cp->advice = pp->advice;
+
+      kpage = frame_share (pp, cp);
+      if (kpage != NULL)
+        {
+          /* Preserve the dirty bit lost by remapping read-only. */
+          if (pagedir_is_dirty (parent->pagedir, pp->upage))
+            mark_dirty (pp);
+          cp->dirty = pp->dirty;
+          if (pp->writable)
+            {
+              pagedir_set_page (parent->pagedir, pp->upage, kpage, false);
+              pp->cow = cp->cow = true;
+            }
+          if (!pagedir_set_page (t->pagedir, cp->upage, kpage, false))
+            {
+              frame_unpin (kpage);
+              return false;
+            }
+          frame_unpin (kpage);
+        }
+      else if (pp->swap_slot != SWAP_NONE)
+        {
+          kpage = frame_alloc (0, cp);
+          if (kpage == NULL)
+            return false;
+          swap_read (pp->swap_slot, kpage);
+          if (!pagedir_set_page (t->pagedir, cp->upage, kpage, cp->writable))
+            {
+              frame_free (kpage);
+              return false;
+            }
+          cp->kpage = kpage;
+          cp->dirty = true;
+          frame_unpin (kpage);
+        }
+    }
+  return true;
+}
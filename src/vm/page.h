@@ -0,0 +1,70 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct faultstat;
+struct file;
+struct thread;
+
+/* A page of a process's virtual address space, whether or not it
+   is currently in memory. */
+struct page
+  {
+    struct hash_elem hash_elem;         /* Element in thread's pages. */
+    struct list_elem frame_elem;        /* Element in frame's pages. */
+    void *upage;                        /* User virtual address. */
+    struct thread *owner;               /* Owning thread. */
+    bool writable;                      /* May the process write it? */
+    bool cow;                           /* Mapped read-only until written? */
+    bool zero_mapped;                   /* Mapped to the shared zero page? */
+    void *kpage;                        /* Frame, or null if not resident. */
+
+    /* Initial contents: READ_BYTES bytes of FILE at OFS, then
+       zeros to the end of the page.  FILE is null for a page that
+       starts out all zeros. */
+    struct file *file;
+    off_t ofs;
+    uint32_t read_bytes;
+
+    bool mmapped;                       /* Written back to FILE, not swap? */
+    bool shared;                        /* In a shared memory segment? */
+    bool dirty;                         /* Changed from initial contents? */
+    size_t swap_slot;                   /* Swap slot, or SWAP_NONE. */
+    uint8_t advice;                     /* MADV_* access hint. */
+    bool locked;                        /* Locked by mlock()? */
+    bool huge;                          /* Part of a 4 MB page? */
+    unsigned ckpt_gen;                  /* Checkpoint holding it, or 0. */
+    off_t ckpt_ofs;                     /* Offset in that checkpoint. */
+  };
+
+/* Most pages a user stack may grow to. */
+extern size_t stack_page_limit;
+
+void page_init (void);
+void page_table_init (void);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes);
+bool page_add_segment (void *upage, void *kpage);
+void page_remove (void *upage);
+struct page *page_lookup (const void *upage);
+bool page_fault_in (const void *fault_addr, bool write);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_cow_break (const void *fault_addr);
+void page_merge (struct page *, void *kpage);
+bool page_advise (void *addr, size_t length, int advice);
+bool page_lock (void *addr, size_t length, bool lock);
+bool page_table_fork (struct thread *parent);
+bool page_out (struct page *);
+bool page_swap_out (struct page *[], size_t cnt);
+void page_get_fault_stats (struct faultstat *);
+
+#endif /* vm/page.h */
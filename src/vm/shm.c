@@ -0,0 +1,316 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Shared memory segments.
+
+   A segment is a named run of zeroed frames that any number of
+   processes may map, each at an address of its choosing, so that
+   what one writes the others see at once, with no copying and no
+   trip to disk.  The frames are allocated when the segment is
+   created and belong to it until it is gone; see the frame table
+   for how they are shared.  Such frames are never evicted, so
+   all the segments together, including those removed but still
+   mapped, are limited to a quarter of the user pool.
+
+   A segment lives until it has been removed with shm_remove()
+   and the last process that maps it has unmapped it, whether
+   with shm_unmap() or by exiting, much as a file lives until it
+   is removed and closed.  A name that has been removed may be
+   used for a new segment at once.
+
+   Each process keeps its mappings in its leader's shm_maps,
+   changed under its vm_lock, like its memory-mapped files.
+   Mappings are not inherited by fork(). */
+
+/* A shared memory segment. */
+struct shm_segment
+  {
+    struct list_elem elem;      /* Element in segments, unless removed. */
+    char name[SHM_NAME_MAX + 1]; /* Name. */
+    bool removed;               /* Has shm_remove() been called? */
+    unsigned map_cnt;           /* Number of mappings. */
+    size_t page_cnt;            /* Number of frames. */
+    void *kpages[];             /* Frames. */
+  };
+
+/* A mapping of a segment into a process. */
+struct shm_mapping
+  {
+    struct list_elem elem;      /* Element in thread's shm_maps. */
+    struct shm_segment *segment; /* Mapped segment. */
+    uint8_t *base;              /* First mapped page. */
+  };
+
+static struct list segments;    /* Segments not yet removed. */
+static size_t shm_page_cnt;     /* Frames reserved by all segments. */
+static struct lock shm_lock;    /* Protects the above, removed, map_cnt. */
+
+/* Initializes shared memory segments. */
+void
+shm_init (void)
+{
+  list_init (&segments);
+  shm_page_cnt = 0;
+  lock_init_named (&shm_lock, "shm");
+}
+
+/* Returns the segment named NAME that has not been removed, or a
+   null pointer if there is none.  shm_lock must be held. */
+static struct shm_segment *
+lookup (const char *name)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&segments); e != list_end (&segments);
+       e = list_next (e))
+    {
+      struct shm_segment *s = list_entry (e, struct shm_segment, elem);
+      if (!strcmp (s->name, name))
+        return s;
+    }
+  return NULL;
+}
+
+/* Reserves PAGE_CNT frames for a segment.  Returns false if that
+   would take the segments past a quarter of the user pool. */
+static bool
+reserve (size_t page_cnt)
+{
+  bool ok;
+
+  lock_acquire (&shm_lock);
+  ok = page_cnt <= palloc_user_page_cnt () / 4 - shm_page_cnt;
+  if (ok)
+    shm_page_cnt += page_cnt;
+  lock_release (&shm_lock);
+  return ok;
+}
+
+/* Gives back PAGE_CNT frames reserved with reserve(). */
+static void
+unreserve (size_t page_cnt)
+{
+  lock_acquire (&shm_lock);
+  shm_page_cnt -= page_cnt;
+  lock_release (&shm_lock);
+}
+
+/* Frees segment S and its frames. */
+static void
+destroy (struct shm_segment *s)
+{
+  size_t i;
+
+  unreserve (s->page_cnt);
+  for (i = 0; i < s->page_cnt; i++)
+    frame_free_segment (s->kpages[i]);
+  free (s);
+}
+
+/* Drops a mapping's reference to segment S, destroying S if it
+   has been removed and this was its last mapping. */
+static void
+release (struct shm_segment *s)
+{
+  bool dead;
+
+  lock_acquire (&shm_lock);
+  dead = --s->map_cnt == 0 && s->removed;
+  lock_release (&shm_lock);
+  if (dead)
+    destroy (s);
+}
+
+/* Creates a segment named NAME of SIZE bytes, rounded up to whole
+   pages, all zeros.  Returns true if successful, false if NAME is
+   empty, too long or already in use, SIZE is 0, the segments
+   would take up more than a quarter of the user pool, or memory
+   is short. */
+bool
+shm_create (const char *name, size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct shm_segment *s;
+  bool ok;
+
+  if (name[0] == '\0' || strlen (name) > SHM_NAME_MAX
+      || page_cnt == 0 || !reserve (page_cnt))
+    return false;
+
+  s = malloc (sizeof *s + page_cnt * sizeof *s->kpages);
+  if (s == NULL)
+    {
+      unreserve (page_cnt);
+      return false;
+    }
+  strlcpy (s->name, name, sizeof s->name);
+  s->removed = true;
+  s->map_cnt = 0;
+  for (s->page_cnt = 0; s->page_cnt < page_cnt; s->page_cnt++)
+    {
+      s->kpages[s->page_cnt] = frame_alloc_segment ();
+      if (s->kpages[s->page_cnt] == NULL)
+        {
+          unreserve (page_cnt - s->page_cnt);
+          destroy (s);
+          return false;
+        }
+    }
+
+  lock_acquire (&shm_lock);
+  ok = lookup (name) == NULL;
+  if (ok)
+    {
+      s->removed = false;
+      list_push_back (&segments, &s->elem);
+    }
+  lock_release (&shm_lock);
+  if (!ok)
+    destroy (s);
+  return ok;
+}
+
+/* Removes the name NAME, so that the segment it names is
+   destroyed once no process maps it.  Returns true if
+   successful, false if there is no such segment. */
+bool
+shm_remove (const char *name)
+{
+  struct shm_segment *s;
+  bool dead = false;
+
+  lock_acquire (&shm_lock);
+  s = lookup (name);
+  if (s != NULL)
+    {
+      list_remove (&s->elem);
+      s->removed = true;
+      dead = s->map_cnt == 0;
+    }
+  lock_release (&shm_lock);
+  if (dead)
+    destroy (s);
+  return s != NULL;
+}
+
+/* Removes the first CNT pages of mapping M. */
+static void
+unmap_pages (struct shm_mapping *m, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+}
+
+/* Maps the segment named NAME into the current process's address
+   space starting at ADDR, writable.  Returns true if successful,
+   false if there is no such segment, ADDR is not page-aligned or
+   is 0, any of the pages needed overlaps memory already in use,
+   or memory is short. */
+bool
+shm_map (const char *name, void *addr)
+{
+  struct thread *t = thread_current ()->leader;
+  struct shm_segment *s;
+  struct shm_mapping *m;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return false;
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return false;
+
+  lock_acquire (&shm_lock);
+  s = lookup (name);
+  if (s != NULL)
+    s->map_cnt++;
+  lock_release (&shm_lock);
+  if (s == NULL)
+    {
+      free (m);
+      return false;
+    }
+  m->segment = s;
+  m->base = addr;
+
+  lock_acquire (&t->vm_lock);
+  for (i = 0; i < s->page_cnt; i++)
+    {
+      uint8_t *upage = m->base + i * PGSIZE;
+
+      if (!is_user_vaddr (upage) || page_lookup (upage) != NULL
+          || pagedir_get_page (t->pagedir, upage) != NULL
+          || !page_add_segment (upage, s->kpages[i]))
+        {
+          unmap_pages (m, i);
+          lock_release (&t->vm_lock);
+          release (s);
+          free (m);
+          return false;
+        }
+    }
+  list_push_back (&t->shm_maps, &m->elem);
+  lock_release (&t->vm_lock);
+  return true;
+}
+
+/* Removes mapping M.  The caller must hold the leader's
+   vm_lock. */
+static void
+unmap (struct shm_mapping *m)
+{
+  list_remove (&m->elem);
+  unmap_pages (m, m->segment->page_cnt);
+  release (m->segment);
+  free (m);
+}
+
+/* Removes the current process's mapping of a segment at ADDR.
+   Returns true if successful, false if no segment is mapped
+   there. */
+bool
+shm_unmap (void *addr)
+{
+  struct thread *t = thread_current ()->leader;
+  struct list_elem *e;
+  bool found = false;
+
+  lock_acquire (&t->vm_lock);
+  for (e = list_begin (&t->shm_maps); e != list_end (&t->shm_maps);
+       e = list_next (e))
+    {
+      struct shm_mapping *m = list_entry (e, struct shm_mapping, elem);
+      if (m->base == addr)
+        {
+          unmap (m);
+          found = true;
+          break;
+        }
+    }
+  lock_release (&t->vm_lock);
+  return found;
+}
+
+/* Removes all of the current process's mappings.  Called at
+   process exit, before the page directory is destroyed. */
+void
+shm_unmap_all (void)
+{
+  struct thread *t = thread_current ()->leader;
+
+  while (!list_empty (&t->shm_maps))
+    unmap (list_entry (list_front (&t->shm_maps), struct shm_mapping, elem));
+}
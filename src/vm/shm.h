@@ -0,0 +1,17 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Longest shared memory segment name. */
+#define SHM_NAME_MAX 31
+
+void shm_init (void);
+bool shm_create (const char *name, size_t size);
+bool shm_remove (const char *name);
+bool shm_map (const char *name, void *addr);
+bool shm_unmap (void *addr);
+void shm_unmap_all (void);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,309 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap block device is divided into slots of
+   SECTORS_PER_SLOT sectors, each holding one page.  A bitmap
+   tracks which slots are in use.  Pages evicted together are
+   given consecutive slots where possible and written with all of
+   their requests queued at once, so that the block layer merges
+   them into a few large transfers.  The pages of a batch take
+   their slots in order of process and virtual address, so that a
+   process's neighbouring pages end up in neighbouring slots and
+   may be read back together by swap_in_multiple().
+
+   In front of the device is a pool of compressed pages in kernel
+   memory, holding up to swap_pool_limit pages' worth of data.  A
+   page being swapped out that compresses to at most
+   POOL_MAX_SIZE bytes, if it fits, goes there instead of to
+   disk, so that swapping it back in costs a decompression rather
+   than a disk read.  Slot numbers with POOL_SLOT set are entries
+   in the pool. */
+
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+static struct bitmap *swap_slots;       /* Slots in use. */
+static struct lock swap_lock;           /* Protects swap_slots. */
+
+/* Compressed pool. */
+#define POOL_SLOT ((size_t) 1 << 31)    /* Set in slots in the pool. */
+#define POOL_MAX_SIZE (PGSIZE / 2)      /* Largest compressed page kept. */
+#define POOL_DENSITY 8                  /* Entries per page of limit. */
+
+/* A compressed page, or a free entry if DATA is null. */
+struct pool_entry
+  {
+    void *data;                 /* Compressed contents, from malloc(). */
+    size_t size;                /* Bytes in DATA. */
+  };
+
+size_t swap_pool_limit = 64;            /* Pages of compressed data. */
+static struct pool_entry *pool;         /* Entries. */
+static struct bitmap *pool_slots;       /* Entries in use. */
+static size_t pool_bytes;               /* Total size of their data. */
+static struct lz_state pool_lz;         /* Compressor's working memory. */
+static uint8_t pool_buf[POOL_MAX_SIZE]; /* Compressor's output. */
+static struct lock pool_lock;           /* Protects all of the above. */
+
+/* Sets up swap space on the block device in the swap role, if
+   there is one, and the compressed pool.  Without a device, only
+   pages that go to the pool can be swapped out. */
+void
+swap_init (void)
+{
+  lock_init_named (&swap_lock, "swap");
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, swapping disabled\n");
+      swap_slots = bitmap_create (0);
+    }
+  else
+    swap_slots = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (swap_slots == NULL)
+    PANIC ("can't allocate swap bitmap");
+
+  lock_init_named (&pool_lock, "swap pool");
+  pool = calloc (swap_pool_limit * POOL_DENSITY, sizeof *pool);
+  pool_slots = bitmap_create (swap_pool_limit * POOL_DENSITY);
+  if (pool == NULL || pool_slots == NULL)
+    PANIC ("can't allocate swap pool");
+}
+
+/* Compresses the page at KPAGE into the pool and stores the slot
+   it gets in *SLOT.  Returns false if the page compresses poorly
+   or the pool is full, in which case it must go to disk. */
+static bool
+pool_store (const void *kpage, size_t *slot)
+{
+  size_t size, idx;
+  void *data;
+
+  lock_acquire (&pool_lock);
+  size = lz_compress (&pool_lz, kpage, PGSIZE, pool_buf, sizeof pool_buf);
+  if (size == 0 || pool_bytes + size > swap_pool_limit * PGSIZE)
+    {
+      lock_release (&pool_lock);
+      return false;
+    }
+  idx = bitmap_scan_and_flip (pool_slots, 0, 1, false);
+  data = idx != BITMAP_ERROR ? malloc (size) : NULL;
+  if (data == NULL)
+    {
+      if (idx != BITMAP_ERROR)
+        bitmap_reset (pool_slots, idx);
+      lock_release (&pool_lock);
+      return false;
+    }
+  memcpy (data, pool_buf, size);
+  pool[idx].data = data;
+  pool[idx].size = size;
+  pool_bytes += size;
+  lock_release (&pool_lock);
+
+  *slot = POOL_SLOT | idx;
+  return true;
+}
+
+/* Frees pool entry IDX. */
+static void
+pool_free (size_t idx)
+{
+  lock_acquire (&pool_lock);
+  ASSERT (bitmap_test (pool_slots, idx));
+  free (pool[idx].data);
+  pool[idx].data = NULL;
+  pool_bytes -= pool[idx].size;
+  bitmap_reset (pool_slots, idx);
+  lock_release (&pool_lock);
+}
+
+/* Reserves CNT slots, storing their numbers in SLOTS[].  The
+   slots are consecutive if such a run is free.  Returns false,
+   reserving nothing, if there are fewer than CNT free slots. */
+static bool
+reserve_slots (size_t cnt, size_t slots[])
+{
+  size_t first, i;
+
+  lock_acquire (&swap_lock);
+  first = bitmap_scan_and_flip (swap_slots, 0, cnt, false);
+  if (first != BITMAP_ERROR)
+    for (i = 0; i < cnt; i++)
+      slots[i] = first + i;
+  else
+    for (i = 0; i < cnt; i++)
+      {
+        slots[i] = bitmap_scan_and_flip (swap_slots, 0, 1, false);
+        if (slots[i] == BITMAP_ERROR)
+          {
+            while (i-- > 0)
+              bitmap_reset (swap_slots, slots[i]);
+            lock_release (&swap_lock);
+            return false;
+          }
+      }
+  lock_release (&swap_lock);
+  return true;
+}
+
+/* Completion function for swap_out() and swap_in_multiple()
+   requests. */
+static void
+request_done (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Writes the CNT pages, at most SWAP_BATCH, at KPAGES[] to swap,
+   storing the slot used for each in SLOTS[].  Pages that compress
+   well go to the pool while there is room.  The rest go to disk,
+   with all the writes queued before waiting for any of them.
+   Returns false, writing nothing, if swap space is short. */
+bool
+swap_out (void *kpages[], size_t cnt, size_t slots[])
+{
+  struct block_request r[SWAP_BATCH];
+  size_t disk[SWAP_BATCH], disk_slots[SWAP_BATCH];
+  size_t disk_cnt = 0;
+  struct semaphore done;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_BATCH);
+  if (cnt == 0)
+    return false;
+
+  for (i = 0; i < cnt; i++)
+    if (!pool_store (kpages[i], &slots[i]))
+      {
+        slots[i] = SWAP_NONE;
+        disk[disk_cnt++] = i;
+      }
+  if (disk_cnt == 0)
+    return true;
+  if (!reserve_slots (disk_cnt, disk_slots))
+    {
+      for (i = 0; i < cnt; i++)
+        if (slots[i] != SWAP_NONE)
+          pool_free (slots[i] & ~POOL_SLOT);
+      return false;
+    }
+
+  sema_init (&done, 0);
+  for (i = 0; i < disk_cnt; i++)
+    {
+      slots[disk[i]] = disk_slots[i];
+      r[i].sector = disk_slots[i] * SECTORS_PER_SLOT;
+      r[i].cnt = SECTORS_PER_SLOT;
+      r[i].buffer = kpages[disk[i]];
+      r[i].write = true;
+      r[i].waiter = thread_current ();
+      r[i].complete = request_done;
+      r[i].aux = &done;
+      block_submit (swap_device, &r[i]);
+    }
+  for (i = 0; i < disk_cnt; i++)
+    sema_down (&done);
+  return true;
+}
+
+/* Reads the page in SLOT into KPAGE and frees SLOT. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  swap_read (slot, kpage);
+  swap_free (slot);
+}
+
+/* Reads the page in SLOT into KPAGE, leaving SLOT in use. */
+void
+swap_read (size_t slot, void *kpage)
+{
+  ASSERT (slot != SWAP_NONE);
+
+  if (slot & POOL_SLOT)
+    {
+      struct pool_entry *e = &pool[slot & ~POOL_SLOT];
+      size_t size;
+
+      lock_acquire (&pool_lock);
+      size = lz_decompress (e->data, e->size, kpage, PGSIZE);
+      lock_release (&pool_lock);
+      ASSERT (size == PGSIZE);
+      return;
+    }
+  block_read_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                       SECTORS_PER_SLOT, kpage);
+}
+
+/* Reads the CNT pages, at most SWAP_BATCH, in SLOTS[] into
+   KPAGES[] and frees the slots.  All the disk reads are queued
+   before waiting for any of them, so that those of consecutive
+   slots are merged into one transfer. */
+void
+swap_in_multiple (const size_t slots[], void *kpages[], size_t cnt)
+{
+  struct block_request r[SWAP_BATCH];
+  struct semaphore done;
+  size_t disk_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_BATCH);
+
+  sema_init (&done, 0);
+  for (i = 0; i < cnt; i++)
+    if (slots[i] & POOL_SLOT)
+      swap_read (slots[i], kpages[i]);
+    else
+      {
+        struct block_request *rq = &r[disk_cnt++];
+
+        rq->sector = slots[i] * SECTORS_PER_SLOT;
+        rq->cnt = SECTORS_PER_SLOT;
+        rq->buffer = kpages[i];
+        rq->write = false;
+        rq->waiter = thread_current ();
+        rq->complete = request_done;
+        rq->aux = &done;
+        block_submit (swap_device, rq);
+      }
+  for (i = 0; i < disk_cnt; i++)
+    sema_down (&done);
+  for (i = 0; i < cnt; i++)
+    swap_free (slots[i]);
+}
+
+/* Returns true if SLOT is on the swap device, false if it is in
+   the compressed pool. */
+bool
+swap_on_disk (size_t slot)
+{
+  ASSERT (slot != SWAP_NONE);
+  return !(slot & POOL_SLOT);
+}
+
+/* Frees SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  if (slot & POOL_SLOT)
+    {
+      pool_free (slot & ~POOL_SLOT);
+      return;
+    }
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  bitmap_reset (swap_slots, slot);
+  lock_release (&swap_lock);
+}
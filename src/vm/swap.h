@@ -0,0 +1,24 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Marks a page that has no swap slot. */
+#define SWAP_NONE ((size_t) -1)
+
+/* Most pages written by one swap_out() call. */
+#define SWAP_BATCH 8
+
+/* Most pages' worth of compressed data kept in memory. */
+extern size_t swap_pool_limit;
+
+void swap_init (void);
+bool swap_out (void *kpages[], size_t cnt, size_t slots[]);
+void swap_in (size_t slot, void *kpage);
+void swap_read (size_t slot, void *kpage);
+void swap_in_multiple (const size_t slots[], void *kpages[], size_t cnt);
+bool swap_on_disk (size_t slot);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */